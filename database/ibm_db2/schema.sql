@@ -1758,11 +1758,20 @@ CREATE TABLE maintenance_tag (
 	PRIMARY KEY (maintenancetagid)
 );
 CREATE INDEX maintenance_tag_1 ON maintenance_tag (maintenanceid);
+CREATE TABLE changelog (
+	changelogid              bigint                                    NOT NULL	GENERATED ALWAYS AS IDENTITY (START WITH 1 INCREMENT BY 1),
+	object                   integer         DEFAULT '0'               NOT NULL,
+	objectid                 bigint                                    NOT NULL,
+	operation                integer         DEFAULT '0'               NOT NULL,
+	clock                    integer         DEFAULT '0'               NOT NULL,
+	PRIMARY KEY (changelogid)
+);
+CREATE INDEX changelog_1 ON changelog (clock);
 CREATE TABLE dbversion (
 	mandatory                integer         WITH DEFAULT '0'          NOT NULL,
 	optional                 integer         WITH DEFAULT '0'          NOT NULL
 );
-INSERT INTO dbversion VALUES ('4000000','4000000');
+INSERT INTO dbversion VALUES ('4000000','4000003');
 ALTER TABLE hosts ADD CONSTRAINT c_hosts_1 FOREIGN KEY (proxy_hostid) REFERENCES hosts (hostid);
 ALTER TABLE hosts ADD CONSTRAINT c_hosts_2 FOREIGN KEY (maintenanceid) REFERENCES maintenances (maintenanceid);
 ALTER TABLE hosts ADD CONSTRAINT c_hosts_3 FOREIGN KEY (templateid) REFERENCES hosts (hostid) ON DELETE CASCADE;
@@ -1965,3 +1974,15 @@ ALTER TABLE task_check_now ADD CONSTRAINT c_task_check_now_1 FOREIGN KEY (taskid
 ALTER TABLE event_suppress ADD CONSTRAINT c_event_suppress_1 FOREIGN KEY (eventid) REFERENCES events (eventid) ON DELETE CASCADE;
 ALTER TABLE event_suppress ADD CONSTRAINT c_event_suppress_2 FOREIGN KEY (maintenanceid) REFERENCES maintenances (maintenanceid) ON DELETE CASCADE;
 ALTER TABLE maintenance_tag ADD CONSTRAINT c_maintenance_tag_1 FOREIGN KEY (maintenanceid) REFERENCES maintenances (maintenanceid) ON DELETE CASCADE;
+CREATE TRIGGER items_insert AFTER INSERT ON items REFERENCING NEW AS n FOR EACH ROW MODE DB2SQL INSERT INTO changelog (object,objectid,operation,clock) VALUES (1,n.itemid,1,(days(current timestamp-current timezone)-days('1970-01-01'))*86400+midnight_seconds(current timestamp-current timezone));
+CREATE TRIGGER items_update AFTER UPDATE OF hostid,status,type,value_type,key_,snmp_community,snmp_oid,port,snmpv3_securityname,snmpv3_securitylevel,snmpv3_authpassphrase,snmpv3_privpassphrase,ipmi_sensor,delay,trapper_hosts,logtimefmt,params,authtype,username,password,publickey,privatekey,flags,interfaceid,snmpv3_authprotocol,snmpv3_privprotocol,snmpv3_contextname,history,trends,inventory_link,valuemapid,units,jmx_endpoint,master_itemid,timeout,url,query_fields,posts,status_codes,follow_redirects,post_type,http_proxy,headers,retrieve_mode,request_method,output_format,ssl_cert_file,ssl_key_file,ssl_key_password,verify_peer,verify_host,allow_traps ON items REFERENCING NEW AS n FOR EACH ROW MODE DB2SQL INSERT INTO changelog (object,objectid,operation,clock) VALUES (1,n.itemid,2,(days(current timestamp-current timezone)-days('1970-01-01'))*86400+midnight_seconds(current timestamp-current timezone));
+CREATE TRIGGER items_delete AFTER DELETE ON items REFERENCING OLD AS o FOR EACH ROW MODE DB2SQL INSERT INTO changelog (object,objectid,operation,clock) VALUES (1,o.itemid,3,(days(current timestamp-current timezone)-days('1970-01-01'))*86400+midnight_seconds(current timestamp-current timezone));
+CREATE TRIGGER item_preproc_insert AFTER INSERT ON item_preproc REFERENCING NEW AS n FOR EACH ROW MODE DB2SQL INSERT INTO changelog (object,objectid,operation,clock) VALUES (2,n.item_preprocid,1,(days(current timestamp-current timezone)-days('1970-01-01'))*86400+midnight_seconds(current timestamp-current timezone));
+CREATE TRIGGER item_preproc_update AFTER UPDATE ON item_preproc REFERENCING NEW AS n FOR EACH ROW MODE DB2SQL INSERT INTO changelog (object,objectid,operation,clock) VALUES (2,n.item_preprocid,2,(days(current timestamp-current timezone)-days('1970-01-01'))*86400+midnight_seconds(current timestamp-current timezone));
+CREATE TRIGGER item_preproc_delete AFTER DELETE ON item_preproc REFERENCING OLD AS o FOR EACH ROW MODE DB2SQL INSERT INTO changelog (object,objectid,operation,clock) VALUES (2,o.item_preprocid,3,(days(current timestamp-current timezone)-days('1970-01-01'))*86400+midnight_seconds(current timestamp-current timezone));
+CREATE TRIGGER functions_insert AFTER INSERT ON functions REFERENCING NEW AS n FOR EACH ROW MODE DB2SQL INSERT INTO changelog (object,objectid,operation,clock) VALUES (3,n.functionid,1,(days(current timestamp-current timezone)-days('1970-01-01'))*86400+midnight_seconds(current timestamp-current timezone));
+CREATE TRIGGER functions_update AFTER UPDATE ON functions REFERENCING NEW AS n FOR EACH ROW MODE DB2SQL INSERT INTO changelog (object,objectid,operation,clock) VALUES (3,n.functionid,2,(days(current timestamp-current timezone)-days('1970-01-01'))*86400+midnight_seconds(current timestamp-current timezone));
+CREATE TRIGGER functions_delete AFTER DELETE ON functions REFERENCING OLD AS o FOR EACH ROW MODE DB2SQL INSERT INTO changelog (object,objectid,operation,clock) VALUES (3,o.functionid,3,(days(current timestamp-current timezone)-days('1970-01-01'))*86400+midnight_seconds(current timestamp-current timezone));
+CREATE TRIGGER triggers_insert AFTER INSERT ON triggers REFERENCING NEW AS n FOR EACH ROW MODE DB2SQL INSERT INTO changelog (object,objectid,operation,clock) VALUES (4,n.triggerid,1,(days(current timestamp-current timezone)-days('1970-01-01'))*86400+midnight_seconds(current timestamp-current timezone));
+CREATE TRIGGER triggers_update AFTER UPDATE OF description,expression,priority,type,status,recovery_mode,recovery_expression,correlation_mode,correlation_tag,flags ON triggers REFERENCING NEW AS n FOR EACH ROW MODE DB2SQL INSERT INTO changelog (object,objectid,operation,clock) VALUES (4,n.triggerid,2,(days(current timestamp-current timezone)-days('1970-01-01'))*86400+midnight_seconds(current timestamp-current timezone));
+CREATE TRIGGER triggers_delete AFTER DELETE ON triggers REFERENCING OLD AS o FOR EACH ROW MODE DB2SQL INSERT INTO changelog (object,objectid,operation,clock) VALUES (4,o.triggerid,3,(days(current timestamp-current timezone)-days('1970-01-01'))*86400+midnight_seconds(current timestamp-current timezone));
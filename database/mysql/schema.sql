@@ -1758,11 +1758,20 @@ CREATE TABLE `maintenance_tag` (
 	PRIMARY KEY (maintenancetagid)
 ) ENGINE=InnoDB;
 CREATE INDEX `maintenance_tag_1` ON `maintenance_tag` (`maintenanceid`);
+CREATE TABLE `changelog` (
+	`changelogid`            bigint unsigned                           NOT NULL auto_increment,
+	`object`                 integer         DEFAULT '0'               NOT NULL,
+	`objectid`               bigint unsigned                           NOT NULL,
+	`operation`              integer         DEFAULT '0'               NOT NULL,
+	`clock`                  integer         DEFAULT '0'               NOT NULL,
+	PRIMARY KEY (changelogid)
+) ENGINE=InnoDB;
+CREATE INDEX `changelog_1` ON `changelog` (`clock`);
 CREATE TABLE `dbversion` (
 	`mandatory`              integer         DEFAULT '0'               NOT NULL,
 	`optional`               integer         DEFAULT '0'               NOT NULL
 ) ENGINE=InnoDB;
-INSERT INTO dbversion VALUES ('4000000','4000000');
+INSERT INTO dbversion VALUES ('4000000','4000003');
 ALTER TABLE `hosts` ADD CONSTRAINT `c_hosts_1` FOREIGN KEY (`proxy_hostid`) REFERENCES `hosts` (`hostid`);
 ALTER TABLE `hosts` ADD CONSTRAINT `c_hosts_2` FOREIGN KEY (`maintenanceid`) REFERENCES `maintenances` (`maintenanceid`);
 ALTER TABLE `hosts` ADD CONSTRAINT `c_hosts_3` FOREIGN KEY (`templateid`) REFERENCES `hosts` (`hostid`) ON DELETE CASCADE;
@@ -1965,3 +1974,15 @@ ALTER TABLE `task_check_now` ADD CONSTRAINT `c_task_check_now_1` FOREIGN KEY (`t
 ALTER TABLE `event_suppress` ADD CONSTRAINT `c_event_suppress_1` FOREIGN KEY (`eventid`) REFERENCES `events` (`eventid`) ON DELETE CASCADE;
 ALTER TABLE `event_suppress` ADD CONSTRAINT `c_event_suppress_2` FOREIGN KEY (`maintenanceid`) REFERENCES `maintenances` (`maintenanceid`) ON DELETE CASCADE;
 ALTER TABLE `maintenance_tag` ADD CONSTRAINT `c_maintenance_tag_1` FOREIGN KEY (`maintenanceid`) REFERENCES `maintenances` (`maintenanceid`) ON DELETE CASCADE;
+CREATE TRIGGER items_insert AFTER INSERT ON items FOR EACH ROW INSERT INTO changelog (object,objectid,operation,clock) VALUES (1,new.itemid,1,unix_timestamp());
+CREATE TRIGGER items_update AFTER UPDATE ON items FOR EACH ROW INSERT INTO changelog (object,objectid,operation,clock) SELECT 1,new.itemid,2,unix_timestamp() FROM DUAL WHERE NOT (new.hostid<=>old.hostid AND new.status<=>old.status AND new.type<=>old.type AND new.value_type<=>old.value_type AND new.key_<=>old.key_ AND new.snmp_community<=>old.snmp_community AND new.snmp_oid<=>old.snmp_oid AND new.port<=>old.port AND new.snmpv3_securityname<=>old.snmpv3_securityname AND new.snmpv3_securitylevel<=>old.snmpv3_securitylevel AND new.snmpv3_authpassphrase<=>old.snmpv3_authpassphrase AND new.snmpv3_privpassphrase<=>old.snmpv3_privpassphrase AND new.ipmi_sensor<=>old.ipmi_sensor AND new.delay<=>old.delay AND new.trapper_hosts<=>old.trapper_hosts AND new.logtimefmt<=>old.logtimefmt AND new.params<=>old.params AND new.authtype<=>old.authtype AND new.username<=>old.username AND new.password<=>old.password AND new.publickey<=>old.publickey AND new.privatekey<=>old.privatekey AND new.flags<=>old.flags AND new.interfaceid<=>old.interfaceid AND new.snmpv3_authprotocol<=>old.snmpv3_authprotocol AND new.snmpv3_privprotocol<=>old.snmpv3_privprotocol AND new.snmpv3_contextname<=>old.snmpv3_contextname AND new.history<=>old.history AND new.trends<=>old.trends AND new.inventory_link<=>old.inventory_link AND new.valuemapid<=>old.valuemapid AND new.units<=>old.units AND new.jmx_endpoint<=>old.jmx_endpoint AND new.master_itemid<=>old.master_itemid AND new.timeout<=>old.timeout AND new.url<=>old.url AND new.query_fields<=>old.query_fields AND new.posts<=>old.posts AND new.status_codes<=>old.status_codes AND new.follow_redirects<=>old.follow_redirects AND new.post_type<=>old.post_type AND new.http_proxy<=>old.http_proxy AND new.headers<=>old.headers AND new.retrieve_mode<=>old.retrieve_mode AND new.request_method<=>old.request_method AND new.output_format<=>old.output_format AND new.ssl_cert_file<=>old.ssl_cert_file AND new.ssl_key_file<=>old.ssl_key_file AND new.ssl_key_password<=>old.ssl_key_password AND new.verify_peer<=>old.verify_peer AND new.verify_host<=>old.verify_host AND new.allow_traps<=>old.allow_traps);
+CREATE TRIGGER items_delete AFTER DELETE ON items FOR EACH ROW INSERT INTO changelog (object,objectid,operation,clock) VALUES (1,old.itemid,3,unix_timestamp());
+CREATE TRIGGER item_preproc_insert AFTER INSERT ON item_preproc FOR EACH ROW INSERT INTO changelog (object,objectid,operation,clock) VALUES (2,new.item_preprocid,1,unix_timestamp());
+CREATE TRIGGER item_preproc_update AFTER UPDATE ON item_preproc FOR EACH ROW INSERT INTO changelog (object,objectid,operation,clock) VALUES (2,new.item_preprocid,2,unix_timestamp());
+CREATE TRIGGER item_preproc_delete AFTER DELETE ON item_preproc FOR EACH ROW INSERT INTO changelog (object,objectid,operation,clock) VALUES (2,old.item_preprocid,3,unix_timestamp());
+CREATE TRIGGER functions_insert AFTER INSERT ON functions FOR EACH ROW INSERT INTO changelog (object,objectid,operation,clock) VALUES (3,new.functionid,1,unix_timestamp());
+CREATE TRIGGER functions_update AFTER UPDATE ON functions FOR EACH ROW INSERT INTO changelog (object,objectid,operation,clock) VALUES (3,new.functionid,2,unix_timestamp());
+CREATE TRIGGER functions_delete AFTER DELETE ON functions FOR EACH ROW INSERT INTO changelog (object,objectid,operation,clock) VALUES (3,old.functionid,3,unix_timestamp());
+CREATE TRIGGER triggers_insert AFTER INSERT ON triggers FOR EACH ROW INSERT INTO changelog (object,objectid,operation,clock) VALUES (4,new.triggerid,1,unix_timestamp());
+CREATE TRIGGER triggers_update AFTER UPDATE ON triggers FOR EACH ROW INSERT INTO changelog (object,objectid,operation,clock) SELECT 4,new.triggerid,2,unix_timestamp() FROM DUAL WHERE NOT (new.description<=>old.description AND new.expression<=>old.expression AND new.priority<=>old.priority AND new.type<=>old.type AND new.status<=>old.status AND new.recovery_mode<=>old.recovery_mode AND new.recovery_expression<=>old.recovery_expression AND new.correlation_mode<=>old.correlation_mode AND new.correlation_tag<=>old.correlation_tag AND new.flags<=>old.flags);
+CREATE TRIGGER triggers_delete AFTER DELETE ON triggers FOR EACH ROW INSERT INTO changelog (object,objectid,operation,clock) VALUES (4,old.triggerid,3,unix_timestamp());
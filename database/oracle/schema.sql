@@ -1758,11 +1758,20 @@ CREATE TABLE maintenance_tag (
 	PRIMARY KEY (maintenancetagid)
 );
 CREATE INDEX maintenance_tag_1 ON maintenance_tag (maintenanceid);
+CREATE TABLE changelog (
+	changelogid              number(20)                                NOT NULL,
+	object                   number(10)      DEFAULT '0'               NOT NULL,
+	objectid                 number(20)                                NOT NULL,
+	operation                number(10)      DEFAULT '0'               NOT NULL,
+	clock                    number(10)      DEFAULT '0'               NOT NULL,
+	PRIMARY KEY (changelogid)
+);
+CREATE INDEX changelog_1 ON changelog (clock);
 CREATE TABLE dbversion (
 	mandatory                number(10)      DEFAULT '0'               NOT NULL,
 	optional                 number(10)      DEFAULT '0'               NOT NULL
 );
-INSERT INTO dbversion VALUES ('4000000','4000000');
+INSERT INTO dbversion VALUES ('4000000','4000003');
 CREATE SEQUENCE proxy_history_seq
 START WITH 1
 INCREMENT BY 1
@@ -2001,3 +2010,67 @@ ALTER TABLE task_check_now ADD CONSTRAINT c_task_check_now_1 FOREIGN KEY (taskid
 ALTER TABLE event_suppress ADD CONSTRAINT c_event_suppress_1 FOREIGN KEY (eventid) REFERENCES events (eventid) ON DELETE CASCADE;
 ALTER TABLE event_suppress ADD CONSTRAINT c_event_suppress_2 FOREIGN KEY (maintenanceid) REFERENCES maintenances (maintenanceid) ON DELETE CASCADE;
 ALTER TABLE maintenance_tag ADD CONSTRAINT c_maintenance_tag_1 FOREIGN KEY (maintenanceid) REFERENCES maintenances (maintenanceid) ON DELETE CASCADE;
+CREATE SEQUENCE changelog_seq
+START WITH 1
+INCREMENT BY 1
+NOMAXVALUE
+/
+CREATE TRIGGER changelog_tr
+BEFORE INSERT ON changelog
+FOR EACH ROW
+BEGIN
+SELECT changelog_seq.nextval INTO :new.changelogid FROM dual;
+END;
+/
+CREATE TRIGGER items_changelog
+AFTER INSERT OR DELETE OR UPDATE OF hostid,status,type,value_type,key_,snmp_community,snmp_oid,port,snmpv3_securityname,snmpv3_securitylevel,snmpv3_authpassphrase,snmpv3_privpassphrase,ipmi_sensor,delay,trapper_hosts,logtimefmt,params,authtype,username,password,publickey,privatekey,flags,interfaceid,snmpv3_authprotocol,snmpv3_privprotocol,snmpv3_contextname,history,trends,inventory_link,valuemapid,units,jmx_endpoint,master_itemid,timeout,url,query_fields,posts,status_codes,follow_redirects,post_type,http_proxy,headers,retrieve_mode,request_method,output_format,ssl_cert_file,ssl_key_file,ssl_key_password,verify_peer,verify_host,allow_traps ON items
+FOR EACH ROW
+BEGIN
+IF INSERTING THEN
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (1,:new.itemid,1,round((cast(sys_extract_utc(systimestamp) as date)-date'1970-01-01')*86400));
+ELSIF UPDATING THEN
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (1,:new.itemid,2,round((cast(sys_extract_utc(systimestamp) as date)-date'1970-01-01')*86400));
+ELSE
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (1,:old.itemid,3,round((cast(sys_extract_utc(systimestamp) as date)-date'1970-01-01')*86400));
+END IF;
+END;
+/
+CREATE TRIGGER item_preproc_changelog
+AFTER INSERT OR DELETE OR UPDATE ON item_preproc
+FOR EACH ROW
+BEGIN
+IF INSERTING THEN
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (2,:new.item_preprocid,1,round((cast(sys_extract_utc(systimestamp) as date)-date'1970-01-01')*86400));
+ELSIF UPDATING THEN
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (2,:new.item_preprocid,2,round((cast(sys_extract_utc(systimestamp) as date)-date'1970-01-01')*86400));
+ELSE
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (2,:old.item_preprocid,3,round((cast(sys_extract_utc(systimestamp) as date)-date'1970-01-01')*86400));
+END IF;
+END;
+/
+CREATE TRIGGER functions_changelog
+AFTER INSERT OR DELETE OR UPDATE ON functions
+FOR EACH ROW
+BEGIN
+IF INSERTING THEN
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (3,:new.functionid,1,round((cast(sys_extract_utc(systimestamp) as date)-date'1970-01-01')*86400));
+ELSIF UPDATING THEN
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (3,:new.functionid,2,round((cast(sys_extract_utc(systimestamp) as date)-date'1970-01-01')*86400));
+ELSE
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (3,:old.functionid,3,round((cast(sys_extract_utc(systimestamp) as date)-date'1970-01-01')*86400));
+END IF;
+END;
+/
+CREATE TRIGGER triggers_changelog
+AFTER INSERT OR DELETE OR UPDATE OF description,expression,priority,type,status,recovery_mode,recovery_expression,correlation_mode,correlation_tag,flags ON triggers
+FOR EACH ROW
+BEGIN
+IF INSERTING THEN
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (4,:new.triggerid,1,round((cast(sys_extract_utc(systimestamp) as date)-date'1970-01-01')*86400));
+ELSIF UPDATING THEN
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (4,:new.triggerid,2,round((cast(sys_extract_utc(systimestamp) as date)-date'1970-01-01')*86400));
+ELSE
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (4,:old.triggerid,3,round((cast(sys_extract_utc(systimestamp) as date)-date'1970-01-01')*86400));
+END IF;
+END;
+/
@@ -1758,11 +1758,20 @@ CREATE TABLE maintenance_tag (
 	PRIMARY KEY (maintenancetagid)
 );
 CREATE INDEX maintenance_tag_1 ON maintenance_tag (maintenanceid);
+CREATE TABLE changelog (
+	changelogid              bigserial                                 NOT NULL,
+	object                   integer         DEFAULT '0'               NOT NULL,
+	objectid                 bigint                                    NOT NULL,
+	operation                integer         DEFAULT '0'               NOT NULL,
+	clock                    integer         DEFAULT '0'               NOT NULL,
+	PRIMARY KEY (changelogid)
+);
+CREATE INDEX changelog_1 ON changelog (clock);
 CREATE TABLE dbversion (
 	mandatory                integer         DEFAULT '0'               NOT NULL,
 	optional                 integer         DEFAULT '0'               NOT NULL
 );
-INSERT INTO dbversion VALUES ('4000000','4000000');
+INSERT INTO dbversion VALUES ('4000000','4000003');
 ALTER TABLE ONLY hosts ADD CONSTRAINT c_hosts_1 FOREIGN KEY (proxy_hostid) REFERENCES hosts (hostid);
 ALTER TABLE ONLY hosts ADD CONSTRAINT c_hosts_2 FOREIGN KEY (maintenanceid) REFERENCES maintenances (maintenanceid);
 ALTER TABLE ONLY hosts ADD CONSTRAINT c_hosts_3 FOREIGN KEY (templateid) REFERENCES hosts (hostid) ON DELETE CASCADE;
@@ -1965,3 +1974,47 @@ ALTER TABLE ONLY task_check_now ADD CONSTRAINT c_task_check_now_1 FOREIGN KEY (t
 ALTER TABLE ONLY event_suppress ADD CONSTRAINT c_event_suppress_1 FOREIGN KEY (eventid) REFERENCES events (eventid) ON DELETE CASCADE;
 ALTER TABLE ONLY event_suppress ADD CONSTRAINT c_event_suppress_2 FOREIGN KEY (maintenanceid) REFERENCES maintenances (maintenanceid) ON DELETE CASCADE;
 ALTER TABLE ONLY maintenance_tag ADD CONSTRAINT c_maintenance_tag_1 FOREIGN KEY (maintenanceid) REFERENCES maintenances (maintenanceid) ON DELETE CASCADE;
+CREATE FUNCTION changelog_items_op() RETURNS TRIGGER AS $$
+BEGIN
+IF TG_OP = 'DELETE' THEN
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (1,OLD.itemid,3,cast(extract(epoch from now()) as integer));
+RETURN OLD;
+END IF;
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (1,NEW.itemid,CASE WHEN TG_OP = 'INSERT' THEN 1 ELSE 2 END,cast(extract(epoch from now()) as integer));
+RETURN NEW;
+END;
+$$ LANGUAGE plpgsql;
+CREATE TRIGGER items_changelog AFTER INSERT OR DELETE OR UPDATE OF hostid,status,type,value_type,key_,snmp_community,snmp_oid,port,snmpv3_securityname,snmpv3_securitylevel,snmpv3_authpassphrase,snmpv3_privpassphrase,ipmi_sensor,delay,trapper_hosts,logtimefmt,params,authtype,username,password,publickey,privatekey,flags,interfaceid,snmpv3_authprotocol,snmpv3_privprotocol,snmpv3_contextname,history,trends,inventory_link,valuemapid,units,jmx_endpoint,master_itemid,timeout,url,query_fields,posts,status_codes,follow_redirects,post_type,http_proxy,headers,retrieve_mode,request_method,output_format,ssl_cert_file,ssl_key_file,ssl_key_password,verify_peer,verify_host,allow_traps ON items FOR EACH ROW EXECUTE PROCEDURE changelog_items_op();
+CREATE FUNCTION changelog_item_preproc_op() RETURNS TRIGGER AS $$
+BEGIN
+IF TG_OP = 'DELETE' THEN
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (2,OLD.item_preprocid,3,cast(extract(epoch from now()) as integer));
+RETURN OLD;
+END IF;
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (2,NEW.item_preprocid,CASE WHEN TG_OP = 'INSERT' THEN 1 ELSE 2 END,cast(extract(epoch from now()) as integer));
+RETURN NEW;
+END;
+$$ LANGUAGE plpgsql;
+CREATE TRIGGER item_preproc_changelog AFTER INSERT OR DELETE OR UPDATE ON item_preproc FOR EACH ROW EXECUTE PROCEDURE changelog_item_preproc_op();
+CREATE FUNCTION changelog_functions_op() RETURNS TRIGGER AS $$
+BEGIN
+IF TG_OP = 'DELETE' THEN
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (3,OLD.functionid,3,cast(extract(epoch from now()) as integer));
+RETURN OLD;
+END IF;
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (3,NEW.functionid,CASE WHEN TG_OP = 'INSERT' THEN 1 ELSE 2 END,cast(extract(epoch from now()) as integer));
+RETURN NEW;
+END;
+$$ LANGUAGE plpgsql;
+CREATE TRIGGER functions_changelog AFTER INSERT OR DELETE OR UPDATE ON functions FOR EACH ROW EXECUTE PROCEDURE changelog_functions_op();
+CREATE FUNCTION changelog_triggers_op() RETURNS TRIGGER AS $$
+BEGIN
+IF TG_OP = 'DELETE' THEN
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (4,OLD.triggerid,3,cast(extract(epoch from now()) as integer));
+RETURN OLD;
+END IF;
+INSERT INTO changelog (object,objectid,operation,clock) VALUES (4,NEW.triggerid,CASE WHEN TG_OP = 'INSERT' THEN 1 ELSE 2 END,cast(extract(epoch from now()) as integer));
+RETURN NEW;
+END;
+$$ LANGUAGE plpgsql;
+CREATE TRIGGER triggers_changelog AFTER INSERT OR DELETE OR UPDATE OF description,expression,priority,type,status,recovery_mode,recovery_expression,correlation_mode,correlation_tag,flags ON triggers FOR EACH ROW EXECUTE PROCEDURE changelog_triggers_op();
@@ -541,7 +541,9 @@ const char	*get_program_type_string(unsigned char program_type);
 #define ZBX_PROCESS_TYPE_PREPROCESSOR	27
 #define ZBX_PROCESS_TYPE_ASYNC_SNMP	28
 #define ZBX_PROCESS_TYPE_ASYNC_AGENT	29
-#define ZBX_PROCESS_TYPE_COUNT		30	/* number of process types */
+#define ZBX_PROCESS_TYPE_HISTWRITER	30
+#define ZBX_PROCESS_TYPE_AVAILMAN	31
+#define ZBX_PROCESS_TYPE_COUNT		32	/* number of process types */
 #define ZBX_PROCESS_TYPE_UNKNOWN	255
 const char	*get_process_type_string(unsigned char process_type);
 int		get_process_type_by_name(const char *proc_type_str);
@@ -713,6 +713,7 @@ zbx_host_availability_t;
 
 int	zbx_sql_add_host_availability(char **sql, size_t *sql_alloc, size_t *sql_offset,
 		const zbx_host_availability_t *ha);
+void	zbx_db_update_hosts_availability(const zbx_vector_ptr_t *hosts);
 int	DBget_user_by_active_session(const char *sessionid, zbx_user_t *user);
 
 typedef struct
@@ -236,6 +236,12 @@ typedef struct _DC_TRIGGER
 	char			*expression;
 	char			*recovery_expression;
 
+	/* compiled expressions, NULL if trigger expressions must be evaluated as text */
+	zbx_eval_code_t		*expression_code;
+	zbx_eval_code_t		*recovery_expression_code;
+	/* values of compiled expression functions, allocated during processing */
+	zbx_eval_value_t	*function_values;
+
 	char			*error;
 	char			*new_error;
 	char			*correlation_tag;
@@ -587,6 +593,7 @@ zbx_uint64_t	DCget_nextid(const char *table_name, int num);
 #define ZBX_DBSYNC_UPDATE	1
 
 void	DCsync_configuration(unsigned char mode);
+int	zbx_dc_config_snapshot_write(const char *path);
 int	init_configuration_cache(char **error);
 void	free_configuration_cache(void);
 
@@ -617,6 +624,7 @@ int	DCconfig_get_interface_by_type(DC_INTERFACE *interface, zbx_uint64_t hostid,
 int	DCconfig_get_interface(DC_INTERFACE *interface, zbx_uint64_t hostid, zbx_uint64_t itemid);
 int	DCconfig_get_poller_nextcheck(unsigned char poller_type);
 int	DCconfig_get_poller_items(unsigned char poller_type, DC_ITEM *items);
+int	zbx_dc_get_poller_items(unsigned char poller_type, DC_ITEM *items, int max_items);
 int	DCconfig_get_ipmi_poller_items(int now, DC_ITEM *items, int items_num, int *nextcheck);
 int	DCconfig_get_snmp_interfaceids_by_addr(const char *addr, zbx_uint64_t **interfaceids);
 size_t	DCconfig_get_snmp_items_by_interfaceid(zbx_uint64_t interfaceid, DC_ITEM **items);
@@ -632,6 +640,7 @@ void	DCrequeue_items(const zbx_uint64_t *itemids, const unsigned char *states, c
 void	DCpoller_requeue_items(const zbx_uint64_t *itemids, const unsigned char *states, const int *lastclocks,
 		const int *errcodes, size_t num, unsigned char poller_type, int *nextcheck);
 void	zbx_dc_requeue_unreachable_items(zbx_uint64_t *itemids, size_t itemids_num);
+void	zbx_dc_requeue_deferred_items(const zbx_uint64_t *itemids, size_t itemids_num, int nextcheck);
 int	DCconfig_activate_host(DC_ITEM *item);
 int	DCconfig_deactivate_host(DC_ITEM *item, int now);
 
@@ -29,6 +29,10 @@
 typedef wchar_t * zbx_mutex_name_t;
 typedef HANDLE zbx_mutex_t;
 #else	/* not _WINDOWS */
+
+/* the maximum number of value cache lock stripes */
+#define ZBX_MUTEX_VALUECACHE_NUM	16
+
 typedef enum
 {
 	ZBX_MUTEX_LOG = 0,
@@ -40,6 +44,8 @@ typedef enum
 	ZBX_MUTEX_DISKSTATS,
 	ZBX_MUTEX_ITSERVICES,
 	ZBX_MUTEX_VALUECACHE,
+	ZBX_MUTEX_VALUECACHE_LAST = ZBX_MUTEX_VALUECACHE + ZBX_MUTEX_VALUECACHE_NUM - 1,
+	ZBX_MUTEX_VALUECACHE_MEM,
 	ZBX_MUTEX_VMWARE,
 	ZBX_MUTEX_SQLITE3,
 	ZBX_MUTEX_PROCSTAT,
@@ -88,10 +94,12 @@ int	zbx_rwlock_create(zbx_rwlock_t *rwlock, zbx_rwlock_name_t name, char **error
 #endif	/* _WINDOWS */
 #	define zbx_mutex_lock(mutex)		__zbx_mutex_lock(__FILE__, __LINE__, mutex)
 #	define zbx_mutex_unlock(mutex)		__zbx_mutex_unlock(__FILE__, __LINE__, mutex)
+#	define zbx_mutex_trylock(mutex)		__zbx_mutex_trylock(__FILE__, __LINE__, mutex)
 
 int	zbx_mutex_create(zbx_mutex_t *mutex, zbx_mutex_name_t name, char **error);
 void	__zbx_mutex_lock(const char *filename, int line, zbx_mutex_t mutex);
 void	__zbx_mutex_unlock(const char *filename, int line, zbx_mutex_t mutex);
+int	__zbx_mutex_trylock(const char *filename, int line, zbx_mutex_t mutex);
 void	zbx_mutex_destroy(zbx_mutex_t *mutex);
 
 #ifdef _WINDOWS
@@ -351,6 +351,31 @@ unsigned int	zbx_isqrt32(unsigned int value);
 int	evaluate(double *value, const char *expression, char *error, size_t max_error_len,
 		zbx_vector_ptr_t *unknown_msgs);
 
+/* compiled expression, stored as a single memory block: the header is followed by */
+/* functionids_num function identifiers and ops_num operations in postfix order     */
+typedef struct
+{
+	int	size;			/* the total size of compiled expression in bytes */
+	int	ops_num;
+	int	functionids_num;
+	int	stack_size;
+}
+zbx_eval_code_t;
+
+#define ZBX_EVAL_CODE_FUNCTIONIDS(code)	((const zbx_uint64_t *)((const zbx_eval_code_t *)(code) + 1))
+
+/* value of a function referenced by compiled expression */
+typedef struct
+{
+	double	value;
+	int	unknown_idx;		/* index of 'unknown' message, -1 for known values */
+}
+zbx_eval_value_t;
+
+zbx_eval_code_t	*zbx_eval_compile(const char *expression);
+int	zbx_eval_execute(double *value, const zbx_eval_code_t *code, const zbx_eval_value_t *functions,
+		double trigger_value, char *error, size_t max_error_len, zbx_vector_ptr_t *unknown_msgs);
+
 /* forecasting */
 
 #define ZBX_MATH_ERROR	-1.0
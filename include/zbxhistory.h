@@ -51,6 +51,8 @@ void	zbx_history_destroy(void);
 int	zbx_history_add_values(const zbx_vector_ptr_t *values);
 int	zbx_history_get_values(zbx_uint64_t itemid, int value_type, int start, int count, int end,
 		zbx_vector_history_record_t *values);
+int	zbx_history_get_values_multi(const zbx_uint64_t *itemids, int itemids_num, int value_type, int start,
+		int end, zbx_vector_uint64_t *value_itemids, zbx_vector_history_record_t *values);
 
 int	zbx_history_requires_trends(int value_type);
 
@@ -17,6 +17,9 @@
 ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 **/
 
+#ifndef ZABBIX_ZBXICMPPING_H
+#define ZABBIX_ZBXICMPPING_H
+
 #include "common.h"
 
 typedef struct
@@ -53,6 +56,7 @@ typedef struct
 	int			interval;
 	int			size;
 	int			timeout;
+	int			host_index;	/* index of the item address in the ping list */
 	zbx_uint64_t		itemid;
 	char			*addr;
 	icmpping_t		icmpping;
@@ -61,3 +65,5 @@ typedef struct
 icmpitem_t;
 
 int	do_ping(ZBX_FPING_HOST *hosts, int hosts_count, int count, int interval, int size, int timeout, char *error, int max_error_len);
+
+#endif
@@ -67,6 +67,9 @@ typedef struct
 	struct event		*ev_listener;
 	struct event		*ev_timer;
 
+	/* the optional wakeup descriptor event, makes the service loop return */
+	struct event		*ev_wakeup;
+
 	/* the unix socket path */
 	char			*path;
 
@@ -84,6 +87,7 @@ int	zbx_ipc_service_start(zbx_ipc_service_t *service, const char *service_name,
 int	zbx_ipc_service_recv(zbx_ipc_service_t *service, int timeout, zbx_ipc_client_t **client,
 		zbx_ipc_message_t **message);
 void	zbx_ipc_service_close(zbx_ipc_service_t *service);
+void	zbx_ipc_service_set_wakeup(zbx_ipc_service_t *service, int fd);
 
 int	zbx_ipc_client_send(zbx_ipc_client_t *client, zbx_uint32_t code, const unsigned char *data, zbx_uint32_t size);
 void	zbx_ipc_client_close(zbx_ipc_client_t *client);
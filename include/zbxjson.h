@@ -197,8 +197,33 @@ int		zbx_json_count(const struct zbx_json_parse *jp);
 const char	*zbx_json_decodevalue(const char *p, char *string, size_t size, int *is_null);
 void		zbx_json_escape(char **string);
 
+/* parsed json path component */
+typedef struct
+{
+	int	type;
+	int	index;
+	char	*name;
+	size_t	offset;
+}
+zbx_json_path_component_t;
+
+/* parsed json path */
+typedef struct
+{
+	char				*path;
+	zbx_json_path_component_t	*components;
+	int				components_num;
+}
+zbx_json_path_t;
+
 int	zbx_json_path_check(const char *path, char * error, size_t errlen);
 int	zbx_json_path_open(const struct zbx_json_parse *jp, const char *path, struct zbx_json_parse *out);
+int	zbx_json_path_compile(const char *path, zbx_json_path_t *compiled);
+void	zbx_json_path_clear(zbx_json_path_t *compiled);
+int	zbx_json_path_open_compiled(const struct zbx_json_parse *jp, const zbx_json_path_t *compiled,
+		struct zbx_json_parse *out);
+void	zbx_json_path_open_multi(const struct zbx_json_parse *jp, const zbx_json_path_t * const *paths, int paths_num,
+		struct zbx_json_parse *out, int *ret);
 void	zbx_json_value_dyn(const struct zbx_json_parse *jp, char **string, size_t *string_alloc);
 
 #endif /* ZABBIX_ZJSON_H */
@@ -44,6 +44,10 @@ char	*zbx_regexp_match(const char *string, const char *pattern, int *len);
 int	zbx_regexp_sub(const char *string, const char *pattern, const char *output_template, char **out);
 int	zbx_mregexp_sub(const char *string, const char *pattern, const char *output_template, char **out);
 int	zbx_iregexp_sub(const char *string, const char *pattern, const char *output_template, char **out);
+int	zbx_mregexp_sub_compile(const char *pattern, const char *output_template, zbx_regexp_t **regexp,
+		const char **error);
+void	zbx_regexp_sub_precompiled(const char *string, const zbx_regexp_t *regexp, const char *output_template,
+		char **out);
 
 void	zbx_regexp_clean_expressions(zbx_vector_ptr_t *expressions);
 
@@ -663,6 +663,44 @@ static double	evaluate_term1(int *unknown_idx)
 	return result;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: map unknown expression result to error message                    *
+ *                                                                            *
+ ******************************************************************************/
+static void	evaluate_unknown_error(const char *function_name, const char *expression, int unknown_idx,
+		char *error, size_t max_error_len, const zbx_vector_ptr_t *unknown_msgs)
+{
+	if (NULL != unknown_msgs)
+	{
+		if (0 > unknown_idx)
+		{
+			THIS_SHOULD_NEVER_HAPPEN;
+			zabbix_log(LOG_LEVEL_WARNING, "%s() internal error: " ZBX_UNKNOWN_STR " index:%d"
+					" expression:'%s'", function_name, unknown_idx, ZBX_NULL2STR(expression));
+			zbx_snprintf(error, max_error_len, "Internal error: " ZBX_UNKNOWN_STR " index %d."
+					" Please report this to Zabbix developers.", unknown_idx);
+		}
+		else if (unknown_msgs->values_num > unknown_idx)
+		{
+			zbx_snprintf(error, max_error_len, "Cannot evaluate expression: \"%s\".",
+					(char *)(unknown_msgs->values[unknown_idx]));
+		}
+		else
+		{
+			zbx_snprintf(error, max_error_len, "Cannot evaluate expression: unsupported "
+					ZBX_UNKNOWN_STR "%d value.", unknown_idx);
+		}
+	}
+	else
+	{
+		THIS_SHOULD_NEVER_HAPPEN;
+		/* do not leave garbage in error buffer, write something helpful */
+		zbx_snprintf(error, max_error_len, "%s(): internal error: no message for unknown result",
+				function_name);
+	}
+}
+
 /******************************************************************************
  *                                                                            *
  * Purpose: evaluate an expression like "(26.416>10) or (0=1)"                *
@@ -694,45 +732,714 @@ int	evaluate(double *value, const char *expression, char *error, size_t max_erro
 	if (ZBX_UNKNOWN == *value)
 	{
 		/* Map Unknown result to error. Callers currently do not operate with ZBX_UNKNOWN. */
-		if (NULL != unknown_msgs)
+		evaluate_unknown_error(__function_name, expression, unknown_idx, error, max_error_len, unknown_msgs);
+		*value = ZBX_INFINITY;
+	}
+
+	if (ZBX_INFINITY == *value)
+	{
+		zabbix_log(LOG_LEVEL_DEBUG, "End of %s() error:'%s'", __function_name, error);
+		return FAIL;
+	}
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() value:" ZBX_FS_DBL, __function_name, *value);
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ *                     Compiled expressions                                   *
+ *                  ---------------------------------------                   *
+ *                                                                            *
+ * Trigger expressions are compiled into a sequence of operations in postfix  *
+ * order, which is executed on a value stack with function values supplied   *
+ * as doubles. The compiler uses the same recursive descent as the evaluator  *
+ * above, so both accept the same expressions and give the same results.     *
+ *                                                                            *
+ * The evaluator works with expressions where function values and macros are *
+ * already substituted as text. Expressions where the substituted text could *
+ * change the way expression is parsed are not compiled and must be evaluated *
+ * with evaluate() function.                                                  *
+ *                                                                            *
+ ******************************************************************************/
+
+#define ZBX_EVAL_OP_CONST		0
+#define ZBX_EVAL_OP_FUNCTION		1
+#define ZBX_EVAL_OP_TRIGGER_VALUE	2
+#define ZBX_EVAL_OP_NEG			3
+#define ZBX_EVAL_OP_NOT			4
+#define ZBX_EVAL_OP_MUL			5
+#define ZBX_EVAL_OP_DIV			6
+#define ZBX_EVAL_OP_ADD			7
+#define ZBX_EVAL_OP_SUB			8
+#define ZBX_EVAL_OP_LT			9
+#define ZBX_EVAL_OP_LE			10
+#define ZBX_EVAL_OP_GE			11
+#define ZBX_EVAL_OP_GT			12
+#define ZBX_EVAL_OP_EQ			13
+#define ZBX_EVAL_OP_NE			14
+#define ZBX_EVAL_OP_AND			15
+#define ZBX_EVAL_OP_OR			16
+
+#define ZBX_EVAL_STACK_SIZE		256
+
+#define ZBX_EVAL_MACRO_TRIGGER_VALUE	"{TRIGGER.VALUE}"
+
+typedef struct
+{
+	unsigned char	type;		/* see ZBX_EVAL_OP_* defines                */
+	int		index;		/* function index for ZBX_EVAL_OP_FUNCTION */
+	double		value;		/* constant value for ZBX_EVAL_OP_CONST    */
+}
+zbx_eval_op_t;
+
+#define ZBX_EVAL_CODE_OPS(code)	((const zbx_eval_op_t *)(ZBX_EVAL_CODE_FUNCTIONIDS(code) + (code)->functionids_num))
+
+typedef struct
+{
+	const char		*expression;
+	zbx_eval_op_t		*ops;
+	int			ops_num;
+	int			ops_alloc;
+	int			stack_depth;
+	int			stack_size;
+	zbx_vector_uint64_t	functionids;
+}
+zbx_eval_compiler_t;
+
+static zbx_eval_compiler_t	compiler;	/* the expression being compiled */
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: append operation to the compiled expression                       *
+ *                                                                            *
+ ******************************************************************************/
+static void	compile_op(unsigned char type, int index, double value)
+{
+	zbx_eval_op_t	*op;
+
+	if (compiler.ops_num == compiler.ops_alloc)
+	{
+		compiler.ops_alloc = (0 == compiler.ops_alloc ? 16 : compiler.ops_alloc * 2);
+		compiler.ops = (zbx_eval_op_t *)zbx_realloc(compiler.ops, compiler.ops_alloc * sizeof(zbx_eval_op_t));
+	}
+
+	op = &compiler.ops[compiler.ops_num++];
+	op->type = type;
+	op->index = index;
+	op->value = value;
+
+	switch (type)
+	{
+		case ZBX_EVAL_OP_CONST:
+		case ZBX_EVAL_OP_FUNCTION:
+		case ZBX_EVAL_OP_TRIGGER_VALUE:
+			if (++compiler.stack_depth > compiler.stack_size)
+				compiler.stack_size = compiler.stack_depth;
+			break;
+		case ZBX_EVAL_OP_NEG:
+		case ZBX_EVAL_OP_NOT:
+			break;
+		default:
+			compiler.stack_depth--;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compile function or {TRIGGER.VALUE} macro token                   *
+ *                                                                            *
+ * Comments: Positive function values are substituted into expression as is, *
+ *           other values are enclosed in parentheses. To be parsed in the    *
+ *           same way regardless of the value the token must not be adjacent  *
+ *           to characters that could be parsed together with a number.       *
+ *                                                                            *
+ ******************************************************************************/
+static int	compile_token(void)
+{
+	const char	*end;
+	zbx_uint64_t	functionid;
+	int		index;
+
+	if (ptr != compiler.expression && (0 != isalnum((unsigned char)ptr[-1]) || '.' == ptr[-1] || '}' == ptr[-1]))
+		return FAIL;
+
+	if (NULL == (end = strchr(ptr, '}')))
+		return FAIL;
+
+	if (SUCCEED == is_uint64_n(ptr + 1, end - ptr - 1, &functionid))
+	{
+		/* parentheses around function value increase the nesting level */
+		if (32 < level + 1)
+			return FAIL;
+
+		if (FAIL == (index = zbx_vector_uint64_search(&compiler.functionids, functionid,
+				ZBX_DEFAULT_UINT64_COMPARE_FUNC)))
 		{
-			if (0 > unknown_idx)
-			{
-				THIS_SHOULD_NEVER_HAPPEN;
-				zabbix_log(LOG_LEVEL_WARNING, "%s() internal error: " ZBX_UNKNOWN_STR " index:%d"
-						" expression:'%s'", __function_name, unknown_idx, expression);
-				zbx_snprintf(error, max_error_len, "Internal error: " ZBX_UNKNOWN_STR " index %d."
-						" Please report this to Zabbix developers.", unknown_idx);
-			}
-			else if (unknown_msgs->values_num > unknown_idx)
-			{
-				zbx_snprintf(error, max_error_len, "Cannot evaluate expression: \"%s\".",
-						(char *)(unknown_msgs->values[unknown_idx]));
-			}
-			else
-			{
-				zbx_snprintf(error, max_error_len, "Cannot evaluate expression: unsupported "
-						ZBX_UNKNOWN_STR "%d value.", unknown_idx);
-			}
+			index = compiler.functionids.values_num;
+			zbx_vector_uint64_append(&compiler.functionids, functionid);
+		}
+
+		compile_op(ZBX_EVAL_OP_FUNCTION, index, 0.0);
+	}
+	else if (ZBX_CONST_STRLEN(ZBX_EVAL_MACRO_TRIGGER_VALUE) == end - ptr + 1 &&
+			0 == strncmp(ptr, ZBX_EVAL_MACRO_TRIGGER_VALUE, ZBX_CONST_STRLEN(ZBX_EVAL_MACRO_TRIGGER_VALUE)))
+	{
+		compile_op(ZBX_EVAL_OP_TRIGGER_VALUE, 0, 0.0);
+	}
+	else
+		return FAIL;
+
+	ptr = end + 1;
+
+	if (SUCCEED != is_number_delimiter(*ptr) || '{' == *ptr)
+		return FAIL;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compile a suffixed number, function or macro                      *
+ *                                                                            *
+ ******************************************************************************/
+static int	compile_number(void)
+{
+	double	value;
+	int	len;
+
+	if ('{' == *ptr)
+		return compile_token();
+
+	/* unknown values are never compiled */
+	if (0 == strncmp(ZBX_UNKNOWN_STR, ptr, ZBX_UNKNOWN_STR_LEN))
+		return FAIL;
+
+	if (SUCCEED != zbx_suffixed_number_parse(ptr, &len) || SUCCEED != is_number_delimiter(*(ptr + len)))
+		return FAIL;
+
+	if (ZBX_INFINITY == (value = atof(ptr) * suffix2factor(*(ptr + len - 1))))
+		return FAIL;
+
+	ptr += len;
+	compile_op(ZBX_EVAL_OP_CONST, 0, value);
+
+	return SUCCEED;
+}
+
+static int	compile_term1(void);
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compile an operand or a parenthesized expression                  *
+ *                                                                            *
+ ******************************************************************************/
+static int	compile_term9(void)
+{
+	while (' ' == *ptr || '\r' == *ptr || '\n' == *ptr || '\t' == *ptr)
+		ptr++;
+
+	if ('\0' == *ptr)
+		return FAIL;
+
+	if ('(' == *ptr)
+	{
+		ptr++;
+
+		if (SUCCEED != compile_term1() || ')' != *ptr)
+			return FAIL;
+
+		ptr++;
+	}
+	else if (SUCCEED != compile_number())
+		return FAIL;
+
+	while ('\0' != *ptr && (' ' == *ptr || '\r' == *ptr || '\n' == *ptr || '\t' == *ptr))
+		ptr++;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compile "-" (unary)                                               *
+ *                                                                            *
+ ******************************************************************************/
+static int	compile_term8(void)
+{
+	while (' ' == *ptr || '\r' == *ptr || '\n' == *ptr || '\t' == *ptr)
+		ptr++;
+
+	if ('-' == *ptr)
+	{
+		ptr++;
+
+		if (SUCCEED != compile_term9())
+			return FAIL;
+
+		compile_op(ZBX_EVAL_OP_NEG, 0, 0.0);
+
+		return SUCCEED;
+	}
+
+	return compile_term9();
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compile "not"                                                     *
+ *                                                                            *
+ ******************************************************************************/
+static int	compile_term7(void)
+{
+	while (' ' == *ptr || '\r' == *ptr || '\n' == *ptr || '\t' == *ptr)
+		ptr++;
+
+	if ('n' == ptr[0] && 'o' == ptr[1] && 't' == ptr[2] && SUCCEED == is_operator_delimiter(ptr[3]))
+	{
+		ptr += 3;
+
+		if (SUCCEED != compile_term8())
+			return FAIL;
+
+		compile_op(ZBX_EVAL_OP_NOT, 0, 0.0);
+
+		return SUCCEED;
+	}
+
+	return compile_term8();
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compile "*" and "/"                                               *
+ *                                                                            *
+ ******************************************************************************/
+static int	compile_term6(void)
+{
+	unsigned char	op;
+
+	if (SUCCEED != compile_term7())
+		return FAIL;
+
+	while ('*' == *ptr || '/' == *ptr)
+	{
+		op = ('*' == *ptr++ ? ZBX_EVAL_OP_MUL : ZBX_EVAL_OP_DIV);
+
+		if (SUCCEED != compile_term7())
+			return FAIL;
+
+		compile_op(op, 0, 0.0);
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compile "+" and "-"                                               *
+ *                                                                            *
+ ******************************************************************************/
+static int	compile_term5(void)
+{
+	unsigned char	op;
+
+	if (SUCCEED != compile_term6())
+		return FAIL;
+
+	while ('+' == *ptr || '-' == *ptr)
+	{
+		op = ('+' == *ptr++ ? ZBX_EVAL_OP_ADD : ZBX_EVAL_OP_SUB);
+
+		if (SUCCEED != compile_term6())
+			return FAIL;
+
+		compile_op(op, 0, 0.0);
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compile "<", "<=", ">=", ">"                                      *
+ *                                                                            *
+ ******************************************************************************/
+static int	compile_term4(void)
+{
+	unsigned char	op;
+
+	if (SUCCEED != compile_term5())
+		return FAIL;
+
+	while (1)
+	{
+		if ('<' == ptr[0] && '=' == ptr[1])
+		{
+			op = ZBX_EVAL_OP_LE;
+			ptr += 2;
+		}
+		else if ('>' == ptr[0] && '=' == ptr[1])
+		{
+			op = ZBX_EVAL_OP_GE;
+			ptr += 2;
+		}
+		else if ('<' == ptr[0] && '>' != ptr[1])
+		{
+			op = ZBX_EVAL_OP_LT;
+			ptr++;
+		}
+		else if ('>' == ptr[0])
+		{
+			op = ZBX_EVAL_OP_GT;
+			ptr++;
 		}
 		else
+			break;
+
+		if (SUCCEED != compile_term5())
+			return FAIL;
+
+		compile_op(op, 0, 0.0);
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compile "=" and "<>"                                              *
+ *                                                                            *
+ ******************************************************************************/
+static int	compile_term3(void)
+{
+	unsigned char	op;
+
+	if (SUCCEED != compile_term4())
+		return FAIL;
+
+	while (1)
+	{
+		if ('=' == *ptr)
 		{
-			THIS_SHOULD_NEVER_HAPPEN;
-			/* do not leave garbage in error buffer, write something helpful */
-			zbx_snprintf(error, max_error_len, "%s(): internal error: no message for unknown result",
-					__function_name);
+			op = ZBX_EVAL_OP_EQ;
+			ptr++;
+		}
+		else if ('<' == ptr[0] && '>' == ptr[1])
+		{
+			op = ZBX_EVAL_OP_NE;
+			ptr += 2;
 		}
+		else
+			break;
 
-		*value = ZBX_INFINITY;
+		if (SUCCEED != compile_term4())
+			return FAIL;
+
+		compile_op(op, 0, 0.0);
 	}
 
-	if (ZBX_INFINITY == *value)
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compile "and"                                                     *
+ *                                                                            *
+ ******************************************************************************/
+static int	compile_term2(void)
+{
+	if (SUCCEED != compile_term3())
+		return FAIL;
+
+	while ('a' == ptr[0] && 'n' == ptr[1] && 'd' == ptr[2] && SUCCEED == is_operator_delimiter(ptr[3]))
 	{
-		zabbix_log(LOG_LEVEL_DEBUG, "End of %s() error:'%s'", __function_name, error);
+		ptr += 3;
+
+		if (SUCCEED != compile_term3())
+			return FAIL;
+
+		compile_op(ZBX_EVAL_OP_AND, 0, 0.0);
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compile "or"                                                      *
+ *                                                                            *
+ ******************************************************************************/
+static int	compile_term1(void)
+{
+	if (32 < ++level)
 		return FAIL;
+
+	if (SUCCEED != compile_term2())
+		return FAIL;
+
+	while ('o' == ptr[0] && 'r' == ptr[1] && SUCCEED == is_operator_delimiter(ptr[2]))
+	{
+		ptr += 2;
+
+		if (SUCCEED != compile_term2())
+			return FAIL;
+
+		compile_op(ZBX_EVAL_OP_OR, 0, 0.0);
+	}
+
+	level--;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_eval_compile                                                 *
+ *                                                                            *
+ * Purpose: compile trigger expression like "({15}>10) or ({123}=1)"          *
+ *                                                                            *
+ * Parameters: expression - [IN] the expression with function ids            *
+ *                                                                            *
+ * Return value: The compiled expression or NULL if the expression cannot be  *
+ *               compiled (for example it contains user macros) and must be   *
+ *               evaluated with evaluate() function.                          *
+ *                                                                            *
+ * Comments: The returned expression must be freed by the caller.             *
+ *                                                                            *
+ ******************************************************************************/
+zbx_eval_code_t	*zbx_eval_compile(const char *expression)
+{
+	zbx_eval_code_t	*code = NULL;
+	size_t		functionids_size, ops_size;
+
+	compiler.expression = expression;
+	compiler.ops = NULL;
+	compiler.ops_num = 0;
+	compiler.ops_alloc = 0;
+	compiler.stack_depth = 0;
+	compiler.stack_size = 0;
+	zbx_vector_uint64_create(&compiler.functionids);
+
+	ptr = expression;
+	level = 0;
+
+	if (SUCCEED != compile_term1() || '\0' != *ptr || ZBX_EVAL_STACK_SIZE < compiler.stack_size)
+		goto out;
+
+	functionids_size = compiler.functionids.values_num * sizeof(zbx_uint64_t);
+	ops_size = compiler.ops_num * sizeof(zbx_eval_op_t);
+
+	code = (zbx_eval_code_t *)zbx_malloc(NULL, sizeof(zbx_eval_code_t) + functionids_size + ops_size);
+	code->size = (int)(sizeof(zbx_eval_code_t) + functionids_size + ops_size);
+	code->ops_num = compiler.ops_num;
+	code->functionids_num = compiler.functionids.values_num;
+	code->stack_size = compiler.stack_size;
+
+	memcpy((char *)(code + 1), compiler.functionids.values, functionids_size);
+	memcpy((char *)(code + 1) + functionids_size, compiler.ops, ops_size);
+out:
+	zbx_free(compiler.ops);
+	zbx_vector_uint64_destroy(&compiler.functionids);
+
+	return code;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: apply binary operation to known values                            *
+ *                                                                            *
+ ******************************************************************************/
+static double	execute_op(unsigned char type, double left, double right)
+{
+	switch (type)
+	{
+		case ZBX_EVAL_OP_MUL:
+			return left * right;
+		case ZBX_EVAL_OP_DIV:
+			return left / right;
+		case ZBX_EVAL_OP_ADD:
+			return left + right;
+		case ZBX_EVAL_OP_SUB:
+			return left - right;
+		case ZBX_EVAL_OP_LT:
+			return left < right - ZBX_DOUBLE_EPSILON;
+		case ZBX_EVAL_OP_LE:
+			return left <= right + ZBX_DOUBLE_EPSILON;
+		case ZBX_EVAL_OP_GE:
+			return left >= right - ZBX_DOUBLE_EPSILON;
+		case ZBX_EVAL_OP_GT:
+			return left > right + ZBX_DOUBLE_EPSILON;
+		case ZBX_EVAL_OP_EQ:
+			return SUCCEED == zbx_double_compare(left, right);
+		case ZBX_EVAL_OP_NE:
+			return SUCCEED != zbx_double_compare(left, right);
+		case ZBX_EVAL_OP_AND:
+			return SUCCEED != zbx_double_compare(left, 0.0) && SUCCEED != zbx_double_compare(right, 0.0);
+		case ZBX_EVAL_OP_OR:
+			return SUCCEED != zbx_double_compare(left, 0.0) || SUCCEED != zbx_double_compare(right, 0.0);
+	}
+
+	THIS_SHOULD_NEVER_HAPPEN;
+
+	return ZBX_INFINITY;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_eval_execute                                                 *
+ *                                                                            *
+ * Purpose: evaluate compiled expression                                      *
+ *                                                                            *
+ * Parameters: value         - [OUT] the expression value                     *
+ *             code          - [IN] the compiled expression                   *
+ *             functions     - [IN] the values of functions in the order of   *
+ *                                  compiled expression function identifiers *
+ *             trigger_value - [IN] the {TRIGGER.VALUE} macro value           *
+ *             error         - [OUT] the error message                        *
+ *             max_error_len - [IN] the error message buffer size             *
+ *             unknown_msgs  - [IN] the messages of unknown function values   *
+ *                                                                            *
+ * Return value: SUCCEED - the expression was evaluated successfully          *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ * Comments: The unknown values are handled in the same way as by evaluate(). *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_eval_execute(double *value, const zbx_eval_code_t *code, const zbx_eval_value_t *functions,
+		double trigger_value, char *error, size_t max_error_len, zbx_vector_ptr_t *unknown_msgs)
+{
+	const char		*__function_name = "zbx_eval_execute";
+
+	const zbx_eval_op_t	*op;
+	double			stack[ZBX_EVAL_STACK_SIZE], left, right;
+	int			unknown_idx[ZBX_EVAL_STACK_SIZE], i, top = -1, left_idx, right_idx;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() ops:%d", __function_name, code->ops_num);
+
+	for (i = 0, op = ZBX_EVAL_CODE_OPS(code); i < code->ops_num; i++, op++)
+	{
+		switch (op->type)
+		{
+			case ZBX_EVAL_OP_CONST:
+				stack[++top] = op->value;
+				unknown_idx[top] = -1;
+				continue;
+			case ZBX_EVAL_OP_FUNCTION:
+				unknown_idx[++top] = functions[op->index].unknown_idx;
+				stack[top] = (0 > unknown_idx[top] ? functions[op->index].value : ZBX_UNKNOWN);
+				continue;
+			case ZBX_EVAL_OP_TRIGGER_VALUE:
+				stack[++top] = trigger_value;
+				unknown_idx[top] = -1;
+				continue;
+			case ZBX_EVAL_OP_NEG:
+				if (ZBX_UNKNOWN != stack[top])
+					stack[top] = -stack[top];
+				continue;
+			case ZBX_EVAL_OP_NOT:
+				if (ZBX_UNKNOWN != stack[top])
+					stack[top] = (SUCCEED == zbx_double_compare(stack[top], 0.0) ? 1.0 : 0.0);
+				continue;
+		}
+
+		right = stack[top];
+		right_idx = unknown_idx[top--];
+		left = stack[top];
+		left_idx = unknown_idx[top];
+
+		switch (op->type)
+		{
+			case ZBX_EVAL_OP_AND:
+				if (ZBX_UNKNOWN == left)
+				{
+					if (ZBX_UNKNOWN == right)				/* Unknown and Unknown */
+						left_idx = right_idx;
+					else if (SUCCEED == zbx_double_compare(right, 0.0))	/* Unknown and 0 */
+						left = 0.0;
+				}
+				else if (ZBX_UNKNOWN == right)
+				{
+					if (SUCCEED == zbx_double_compare(left, 0.0))		/* 0 and Unknown */
+					{
+						left = 0.0;
+					}
+					else							/* 1 and Unknown */
+					{
+						left = ZBX_UNKNOWN;
+						left_idx = right_idx;
+					}
+				}
+				else
+					left = execute_op(op->type, left, right);
+				break;
+			case ZBX_EVAL_OP_OR:
+				if (ZBX_UNKNOWN == left)
+				{
+					if (ZBX_UNKNOWN == right)				/* Unknown or Unknown */
+						left_idx = right_idx;
+					else if (SUCCEED != zbx_double_compare(right, 0.0))	/* Unknown or 1 */
+						left = 1;
+				}
+				else if (ZBX_UNKNOWN == right)
+				{
+					if (SUCCEED != zbx_double_compare(left, 0.0))		/* 1 or Unknown */
+					{
+						left = 1;
+					}
+					else							/* 0 or Unknown */
+					{
+						left = ZBX_UNKNOWN;
+						left_idx = right_idx;
+					}
+				}
+				else
+					left = execute_op(op->type, left, right);
+				break;
+			case ZBX_EVAL_OP_DIV:
+				/* catch division by 0 even if 1st operand is Unknown */
+				if (ZBX_UNKNOWN != right && SUCCEED == zbx_double_compare(right, 0.0))
+				{
+					zbx_strlcpy(error, "Cannot evaluate expression: division by zero.", max_error_len);
+					goto out;
+				}
+				/* break; is not missing here */
+			default:
+				if (ZBX_UNKNOWN == right)		/* (anything) op Unknown */
+				{
+					left = ZBX_UNKNOWN;
+					left_idx = right_idx;
+				}
+				else if (ZBX_UNKNOWN != left)		/* Unknown op known keeps Unknown */
+					left = execute_op(op->type, left, right);
+		}
+
+		if (ZBX_INFINITY == left)
+		{
+			zbx_strlcpy(error, "Cannot evaluate expression: value is too large.", max_error_len);
+			goto out;
+		}
+
+		stack[top] = left;
+		unknown_idx[top] = left_idx;
+	}
+
+	*value = stack[0];
+
+	if (ZBX_UNKNOWN == *value)
+	{
+		evaluate_unknown_error(__function_name, NULL, unknown_idx[0], error, max_error_len, unknown_msgs);
+		goto out;
 	}
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() value:" ZBX_FS_DBL, __function_name, *value);
 
 	return SUCCEED;
+out:
+	*value = ZBX_INFINITY;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() error:'%s'", __function_name, error);
+
+	return FAIL;
 }
@@ -1183,6 +1183,10 @@ const char	*get_process_type_string(unsigned char proc_type)
 			return "escalator";
 		case ZBX_PROCESS_TYPE_HISTSYNCER:
 			return "history syncer";
+		case ZBX_PROCESS_TYPE_HISTWRITER:
+			return "history writer";
+		case ZBX_PROCESS_TYPE_AVAILMAN:
+			return "availability manager";
 		case ZBX_PROCESS_TYPE_DISCOVERER:
 			return "discoverer";
 		case ZBX_PROCESS_TYPE_ALERTER:
@@ -165,6 +165,9 @@ struct zbx_tls_context
 	gnutls_psk_server_credentials_t	psk_server_creds;
 #elif defined(HAVE_OPENSSL)
 	SSL				*ctx;
+	char				*psk_identity;	/* PSK from DB for the client callback function */
+	char				*psk;
+	size_t				psk_len;
 #endif
 };
 
@@ -1343,7 +1346,7 @@ static int	zbx_psk_cb(gnutls_session_t session, const char *psk_identity, gnutls
  *     set pre-shared key for outgoing TLS connection upon OpenSSL request    *
  *                                                                            *
  * Parameters:                                                                *
- *     ssl              - [IN] not used                                       *
+ *     ssl              - [IN] the connection, may carry its own PSK          *
  *     hint             - [IN] not used                                       *
  *     identity         - [OUT] buffer to write PSK identity into             *
  *     max_identity_len - [IN] size of the 'identity' buffer                  *
@@ -1361,40 +1364,71 @@ static int	zbx_psk_cb(gnutls_session_t session, const char *psk_identity, gnutls
  *     As a client we use different PSKs depending on connection to be made.  *
  *     Apparently there is no simple way to specify which PSK should be set   *
  *     by this callback function. We use global variables to pass this info.  *
+ *     PSK from DB is attached to the connection as application data instead, *
+ *     because several non-blocking handshakes may be in progress at once.    *
  *                                                                            *
  ******************************************************************************/
 static unsigned int	zbx_psk_client_cb(SSL *ssl, const char *hint, char *identity,
 		unsigned int max_identity_len, unsigned char *psk, unsigned int max_psk_len)
 {
-	const char	*__function_name = "zbx_psk_client_cb";
+	const char		*__function_name = "zbx_psk_client_cb";
+	const zbx_tls_context_t	*tls_ctx;
+	const char		*conn_psk_identity = psk_identity_for_cb, *conn_psk = psk_for_cb;
+	size_t			conn_psk_identity_len = psk_identity_len_for_cb, conn_psk_len = psk_len_for_cb;
 
-	ZBX_UNUSED(ssl);
 	ZBX_UNUSED(hint);
 
+	if (NULL != (tls_ctx = (const zbx_tls_context_t *)SSL_get_app_data(ssl)) && NULL != tls_ctx->psk)
+	{
+		conn_psk_identity = tls_ctx->psk_identity;
+		conn_psk_identity_len = strlen(tls_ctx->psk_identity);
+		conn_psk = tls_ctx->psk;
+		conn_psk_len = tls_ctx->psk_len;
+	}
+
 	if (SUCCEED == zabbix_check_log_level(LOG_LEVEL_DEBUG))
 	{
 		zabbix_log(LOG_LEVEL_DEBUG, "%s() requested PSK identity \"%s\"", __function_name,
-				psk_identity_for_cb);
+				conn_psk_identity);
 	}
 
-	if (max_identity_len < psk_identity_len_for_cb + 1)	/* 1 byte for terminating '\0' */
+	if (max_identity_len < conn_psk_identity_len + 1)	/* 1 byte for terminating '\0' */
 	{
 		zabbix_log(LOG_LEVEL_WARNING, "requested PSK identity \"%s\" does not fit into %u-byte buffer",
-				psk_identity_for_cb, max_identity_len);
+				conn_psk_identity, max_identity_len);
 		return 0;
 	}
 
-	if (max_psk_len < psk_len_for_cb)
+	if (max_psk_len < conn_psk_len)
 	{
 		zabbix_log(LOG_LEVEL_WARNING, "PSK associated with PSK identity \"%s\" does not fit into %u-byte"
-				" buffer", psk_identity_for_cb, max_psk_len);
+				" buffer", conn_psk_identity, max_psk_len);
 		return 0;
 	}
 
-	zbx_strlcpy(identity, psk_identity_for_cb, max_identity_len);
-	memcpy(psk, psk_for_cb, psk_len_for_cb);
+	zbx_strlcpy(identity, conn_psk_identity, max_identity_len);
+	memcpy(psk, conn_psk, conn_psk_len);
+
+	return (unsigned int)conn_psk_len;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_tls_free_conn_psk                                            *
+ *                                                                            *
+ * Purpose: erase and free PSK attached to the connection                     *
+ *                                                                            *
+ ******************************************************************************/
+static void	zbx_tls_free_conn_psk(zbx_tls_context_t *tls_ctx)
+{
+	if (NULL != tls_ctx->psk)
+	{
+		zbx_guaranteed_memset(tls_ctx->psk, 0, tls_ctx->psk_len);
+		zbx_free(tls_ctx->psk);
+		tls_ctx->psk_len = 0;
+	}
 
-	return (unsigned int)psk_len_for_cb;
+	zbx_free(tls_ctx->psk_identity);
 }
 
 /******************************************************************************
@@ -3628,40 +3662,76 @@ void	zbx_tls_free(void)
 #endif
 }
 
+#if defined(HAVE_POLARSSL)
+#	define ZBX_TLS_HANDSHAKE_FUNC_NAME	"ssl_handshake"
+#elif defined(HAVE_GNUTLS)
+#	define ZBX_TLS_HANDSHAKE_FUNC_NAME	"gnutls_handshake"
+#elif defined(HAVE_OPENSSL)
+#	define ZBX_TLS_HANDSHAKE_FUNC_NAME	"SSL_connect"
+#endif
+
 /******************************************************************************
  *                                                                            *
- * Function: zbx_tls_connect                                                  *
+ * Function: zbx_tls_connect_cancel                                           *
  *                                                                            *
- * Purpose: establish a TLS connection over an established TCP connection     *
+ * Purpose: free TLS context of an outgoing connection without TLS shutdown   *
  *                                                                            *
  * Parameters:                                                                *
- *     s           - [IN] socket with opened connection                       *
- *     error       - [OUT] dynamically allocated memory with error message    *
- *     tls_connect - [IN] how to connect. Allowed values:                     *
- *                        ZBX_TCP_SEC_TLS_CERT, ZBX_TCP_SEC_TLS_PSK.          *
- *     tls_arg1    - [IN] required issuer of peer certificate (may be NULL    *
- *                        or empty string if not important) or PSK identity   *
- *                        to connect with depending on value of               *
- *                        'tls_connect'.                                      *
- *     tls_arg2    - [IN] required subject of peer certificate (may be NULL   *
- *                        or empty string if not important) or PSK            *
- *                        (in hex-string) to connect with depending on value  *
- *                        of 'tls_connect'.                                   *
+ *     s - [IN] socket with TLS context created by zbx_tls_connect_nb()       *
+ *                                                                            *
+ * Comments:                                                                  *
+ *     Used when handshake has failed or has not finished in time, there is   *
+ *     no established TLS session to close in such case.                      *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_tls_connect_cancel(zbx_socket_t *s)
+{
+	if (NULL == s->tls_ctx)
+		return;
+#if defined(HAVE_POLARSSL)
+	if (NULL != s->tls_ctx->ctx)
+	{
+		ssl_free(s->tls_ctx->ctx);
+		zbx_free(s->tls_ctx->ctx);
+	}
+#elif defined(HAVE_GNUTLS)
+	if (NULL != s->tls_ctx->ctx)
+	{
+		gnutls_credentials_clear(s->tls_ctx->ctx);
+		gnutls_deinit(s->tls_ctx->ctx);
+	}
+
+	if (NULL != s->tls_ctx->psk_client_creds)
+		gnutls_psk_free_client_credentials(s->tls_ctx->psk_client_creds);
+#elif defined(HAVE_OPENSSL)
+	if (NULL != s->tls_ctx->ctx)
+		SSL_free(s->tls_ctx->ctx);
+
+	zbx_tls_free_conn_psk(s->tls_ctx);
+#endif
+	zbx_free(s->tls_ctx);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_tls_connect_setup                                            *
+ *                                                                            *
+ * Purpose: create TLS context for an outgoing connection                     *
+ *                                                                            *
+ * Parameters: see zbx_tls_connect()                                          *
  *                                                                            *
  * Return value:                                                              *
- *     SUCCEED - successful TLS handshake with a valid certificate or PSK     *
- *     FAIL - an error occurred                                               *
+ *     SUCCEED - TLS context is ready for handshake                           *
+ *     FAIL - an error occurred, TLS context is not created                   *
  *                                                                            *
  ******************************************************************************/
 #if defined(HAVE_POLARSSL)
-int	zbx_tls_connect(zbx_socket_t *s, unsigned int tls_connect, const char *tls_arg1, const char *tls_arg2,
-		char **error)
+static int	zbx_tls_connect_setup(zbx_socket_t *s, unsigned int tls_connect, const char *tls_arg1,
+		const char *tls_arg2, char **error)
 {
-	const char	*__function_name = "zbx_tls_connect";
-	int		ret = FAIL, res;
-#if defined(_WINDOWS)
-	double		sec;
-#endif
+	const char	*__function_name = "zbx_tls_connect_setup";
+	int		res;
+
 	if (ZBX_TCP_SEC_TLS_CERT == tls_connect)
 	{
 		zabbix_log(LOG_LEVEL_DEBUG, "In %s(): issuer:\"%s\" subject:\"%s\"", __function_name,
@@ -3671,7 +3741,7 @@ int	zbx_tls_connect(zbx_socket_t *s, unsigned int tls_connect, const char *tls_a
 		{
 			*error = zbx_strdup(*error, "cannot connect with TLS and certificate: no valid certificate"
 					" loaded");
-			goto out1;
+			return FAIL;
 		}
 	}
 	else if (ZBX_TCP_SEC_TLS_PSK == tls_connect)
@@ -3682,14 +3752,14 @@ int	zbx_tls_connect(zbx_socket_t *s, unsigned int tls_connect, const char *tls_a
 		if (NULL == ciphersuites_psk)
 		{
 			*error = zbx_strdup(*error, "cannot connect with TLS and PSK: no valid PSK loaded");
-			goto out1;
+			return FAIL;
 		}
 	}
 	else
 	{
 		*error = zbx_strdup(*error, "invalid connection parameters");
 		THIS_SHOULD_NEVER_HAPPEN;
-		goto out1;
+		return FAIL;
 	}
 
 	/* set up TLS context */
@@ -3788,95 +3858,20 @@ int	zbx_tls_connect(zbx_socket_t *s, unsigned int tls_connect, const char *tls_a
 		}
 	}
 
-#if defined(_WINDOWS)
-	zbx_alarm_flag_clear();
-	sec = zbx_time();
-#endif
-	while (0 != (res = ssl_handshake(s->tls_ctx->ctx)))
-	{
-#if defined(_WINDOWS)
-		if (s->timeout < zbx_time() - sec)
-			zbx_alarm_flag_set();
-#endif
-		if (SUCCEED == zbx_alarm_timed_out())
-		{
-			*error = zbx_strdup(*error, "ssl_handshake() timed out");
-			goto out;
-		}
-
-		if (POLARSSL_ERR_NET_WANT_READ != res && POLARSSL_ERR_NET_WANT_WRITE != res)
-		{
-			if (POLARSSL_ERR_X509_CERT_VERIFY_FAILED == res)
-			{
-				/* Standard PolarSSL error message might not be very informative in this case. For */
-				/* example, if certificate validity starts in future, PolarSSL 1.3.9 would produce a */
-				/* message "X509 - Certificate verification failed, e.g. CRL, CA or signature check */
-				/* failed" which does not give a precise reason. Here we try to get more detailed */
-				/* reason why peer certificate was rejected by using some knowledge about PolarSSL */
-				/* internals. */
-				zbx_tls_cert_error_msg((unsigned int)s->tls_ctx->ctx->session_negotiate->verify_result,
-						error);
-				zbx_tls_close(s);
-				goto out1;
-			}
-
-			zbx_tls_error_msg(res, "ssl_handshake(): ", error);
-			goto out;
-		}
-	}
-
-	if (ZBX_TCP_SEC_TLS_CERT == tls_connect)
-	{
-		/* log peer certificate information for debugging */
-		zbx_log_peer_cert(__function_name, s->tls_ctx);
-
-		/* basic verification of peer certificate was done during handshake */
-
-		/* if required verify peer certificate Issuer and Subject */
-		if (SUCCEED != zbx_verify_issuer_subject(s->tls_ctx, tls_arg1, tls_arg2, error))
-		{
-			zbx_tls_close(s);
-			goto out1;
-		}
-	}
-	else	/* pre-shared key */
-	{
-		if (SUCCEED == zabbix_check_log_level(LOG_LEVEL_DEBUG))
-		{
-			/* special print: s->tls_ctx->ctx->psk_identity is not '\0'-terminated */
-			zabbix_log(LOG_LEVEL_DEBUG, "%s() PSK identity: \"%.*s\"", __function_name,
-					(int)s->tls_ctx->ctx->psk_identity_len, s->tls_ctx->ctx->psk_identity);
-		}
-	}
-
-	s->connection_type = tls_connect;
-
-	if (SUCCEED == zabbix_check_log_level(LOG_LEVEL_DEBUG))
-	{
-		zabbix_log(LOG_LEVEL_DEBUG, "End of %s():SUCCEED (established %s %s)", __function_name,
-				ssl_get_version(s->tls_ctx->ctx), ssl_get_ciphersuite(s->tls_ctx->ctx));
-	}
-
 	return SUCCEED;
 
 out:	/* an error occurred */
-	ssl_free(s->tls_ctx->ctx);
-	zbx_free(s->tls_ctx->ctx);
-	zbx_free(s->tls_ctx);
-out1:
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s error:'%s'", __function_name, zbx_result_string(ret),
-			ZBX_NULL2EMPTY_STR(*error));
-	return ret;
+	zbx_tls_connect_cancel(s);
+
+	return FAIL;
 }
 #elif defined(HAVE_GNUTLS)
-int	zbx_tls_connect(zbx_socket_t *s, unsigned int tls_connect, const char *tls_arg1, const char *tls_arg2,
-		char **error)
+static int	zbx_tls_connect_setup(zbx_socket_t *s, unsigned int tls_connect, const char *tls_arg1,
+		const char *tls_arg2, char **error)
 {
-	const char		*__function_name = "zbx_tls_connect";
-	int			ret = FAIL, res;
-#if defined(_WINDOWS)
-	double			sec;
-#endif
+	const char	*__function_name = "zbx_tls_connect_setup";
+	int		res;
+
 	if (ZBX_TCP_SEC_TLS_CERT == tls_connect)
 	{
 		zabbix_log(LOG_LEVEL_DEBUG, "In %s(): issuer:\"%s\" subject:\"%s\"", __function_name,
@@ -3891,7 +3886,7 @@ int	zbx_tls_connect(zbx_socket_t *s, unsigned int tls_connect, const char *tls_a
 	{
 		*error = zbx_strdup(*error, "invalid connection parameters");
 		THIS_SHOULD_NEVER_HAPPEN;
-		goto out1;
+		return FAIL;
 	}
 
 	/* set up TLS context */
@@ -4023,362 +4018,512 @@ int	zbx_tls_connect(zbx_socket_t *s, unsigned int tls_connect, const char *tls_a
 
 	gnutls_transport_set_int(s->tls_ctx->ctx, ZBX_SOCKET_TO_INT(s->socket));
 
-	/* TLS handshake */
+	return SUCCEED;
 
-#if defined(_WINDOWS)
-	zbx_alarm_flag_clear();
-	sec = zbx_time();
-#endif
-	while (GNUTLS_E_SUCCESS != (res = gnutls_handshake(s->tls_ctx->ctx)))
+out:	/* an error occurred */
+	zbx_tls_connect_cancel(s);
+
+	return FAIL;
+}
+#elif defined(HAVE_OPENSSL)
+static int	zbx_tls_connect_setup(zbx_socket_t *s, unsigned int tls_connect, const char *tls_arg1,
+		const char *tls_arg2, char **error)
+{
+	const char	*__function_name = "zbx_tls_connect_setup";
+	size_t		error_alloc = 0, error_offset = 0;
+
+	if (ZBX_TCP_SEC_TLS_CERT != tls_connect && ZBX_TCP_SEC_TLS_PSK != tls_connect)
 	{
-#if defined(_WINDOWS)
-		if (s->timeout < zbx_time() - sec)
-			zbx_alarm_flag_set();
-#endif
-		if (SUCCEED == zbx_alarm_timed_out())
+		*error = zbx_strdup(*error, "invalid connection parameters");
+		THIS_SHOULD_NEVER_HAPPEN;
+		return FAIL;
+	}
+
+	s->tls_ctx = zbx_malloc(s->tls_ctx, sizeof(zbx_tls_context_t));
+	s->tls_ctx->ctx = NULL;
+	s->tls_ctx->psk_identity = NULL;
+	s->tls_ctx->psk = NULL;
+	s->tls_ctx->psk_len = 0;
+
+	if (ZBX_TCP_SEC_TLS_CERT == tls_connect)
+	{
+		zabbix_log(LOG_LEVEL_DEBUG, "In %s(): issuer:\"%s\" subject:\"%s\"", __function_name,
+				ZBX_NULL2EMPTY_STR(tls_arg1), ZBX_NULL2EMPTY_STR(tls_arg2));
+
+		if (NULL == ctx_cert)
 		{
-			*error = zbx_strdup(*error, "gnutls_handshake() timed out");
+			*error = zbx_strdup(*error, "cannot connect with TLS and certificate: no valid certificate"
+					" loaded");
 			goto out;
 		}
 
-		if (GNUTLS_E_INTERRUPTED == res || GNUTLS_E_AGAIN == res)
+		if (NULL == (s->tls_ctx->ctx = SSL_new(ctx_cert)))
 		{
-			continue;
+			zbx_snprintf_alloc(error, &error_alloc, &error_offset, "cannot create connection context:");
+			zbx_tls_error_msg(error, &error_alloc, &error_offset);
+			goto out;
 		}
-		else if (GNUTLS_E_WARNING_ALERT_RECEIVED == res || GNUTLS_E_FATAL_ALERT_RECEIVED == res)
+	}
+	else
+	{
+		zabbix_log(LOG_LEVEL_DEBUG, "In %s(): psk_identity:\"%s\"", __function_name,
+				ZBX_NULL2EMPTY_STR(tls_arg1));
+
+		if (NULL == ctx_psk)
 		{
-			const char	*msg;
-			int		alert;
+			*error = zbx_strdup(*error, "cannot connect with TLS and PSK: no valid PSK loaded");
+			goto out;
+		}
 
-			/* server sent an alert to us */
-			alert = gnutls_alert_get(s->tls_ctx->ctx);
+		if (NULL == (s->tls_ctx->ctx = SSL_new(ctx_psk)))
+		{
+			zbx_snprintf_alloc(error, &error_alloc, &error_offset, "cannot create connection context:");
+			zbx_tls_error_msg(error, &error_alloc, &error_offset);
+			goto out;
+		}
 
-			if (NULL == (msg = gnutls_alert_get_name(alert)))
-				msg = "unknown";
+		if (NULL == tls_arg2)	/* PSK is not set from DB */
+		{
+			/* Set up PSK global variables from a configuration file (always in agentd and a case when */
+			/* active proxy connects to server). Here we set it only in case of active proxy */
+			/* because for other programs it has already been set in zbx_tls_init_child(). */
 
-			if (GNUTLS_E_WARNING_ALERT_RECEIVED == res)
+			if (0 != (program_type & ZBX_PROGRAM_TYPE_PROXY_ACTIVE))
 			{
-				zabbix_log(LOG_LEVEL_WARNING, "%s() gnutls_handshake() received a warning alert: %d"
-						" %s", __function_name, alert, msg);
-				continue;
-			}
-			else	/* GNUTLS_E_FATAL_ALERT_RECEIVED */
-			{
-				*error = zbx_dsprintf(*error, "%s(): gnutls_handshake() failed with fatal alert: %d %s",
-						__function_name, alert, msg);
-				goto out;
+				psk_identity_for_cb = my_psk_identity;
+				psk_identity_len_for_cb = my_psk_identity_len;
+				psk_for_cb = my_psk;
+				psk_len_for_cb = my_psk_len;
 			}
 		}
 		else
 		{
-			int	level;
-
-			/* log "peer has closed connection" case with debug level */
-			level = (GNUTLS_E_PREMATURE_TERMINATION == res ? LOG_LEVEL_DEBUG : LOG_LEVEL_WARNING);
+			/* PSK comes from a database (case for a server/proxy when it connects to an agent for */
+			/* passive checks, for a server when it connects to a passive proxy) */
 
-			if (SUCCEED == zabbix_check_log_level(level))
-			{
-				zabbix_log(level, "%s() gnutls_handshake() returned: %d %s",
-						__function_name, res, gnutls_strerror(res));
-			}
+			int	psk_len;
+			char	psk_buf[HOST_TLS_PSK_LEN / 2];
 
-			if (0 != gnutls_error_is_fatal(res))
+			if (0 >= (psk_len = zbx_psk_hex2bin((unsigned char *)tls_arg2, (unsigned char *)psk_buf,
+					sizeof(psk_buf))))
 			{
-				*error = zbx_dsprintf(*error, "%s(): gnutls_handshake() failed: %d %s",
-						__function_name, res, gnutls_strerror(res));
+				*error = zbx_strdup(*error, "invalid PSK");
 				goto out;
 			}
-		}
-	}
 
-	if (ZBX_TCP_SEC_TLS_CERT == tls_connect)
-	{
-		/* log peer certificate information for debugging */
-		zbx_log_peer_cert(__function_name, s->tls_ctx);
+			/* the handshake may span several calls, so the PSK is kept with the connection and passed */
+			/* to the client callback function through the application data of the connection */
+			s->tls_ctx->psk_identity = zbx_strdup(NULL, ZBX_NULL2EMPTY_STR(tls_arg1));
+			s->tls_ctx->psk = (char *)zbx_malloc(NULL, (size_t)psk_len);
+			memcpy(s->tls_ctx->psk, psk_buf, (size_t)psk_len);
+			s->tls_ctx->psk_len = (size_t)psk_len;
+			zbx_guaranteed_memset(psk_buf, 0, sizeof(psk_buf));
 
-		/* perform basic verification of peer certificate */
-		if (SUCCEED != zbx_verify_peer_cert(s->tls_ctx->ctx, error))
-		{
-			zbx_tls_close(s);
-			goto out1;
-		}
-
-		/* if required verify peer certificate Issuer and Subject */
-		if (SUCCEED != zbx_verify_issuer_subject(s->tls_ctx, tls_arg1, tls_arg2, error))
-		{
-			zbx_tls_close(s);
-			goto out1;
+			SSL_set_app_data(s->tls_ctx->ctx, s->tls_ctx);
 		}
 	}
 
-	s->connection_type = tls_connect;
-
-	if (SUCCEED == zabbix_check_log_level(LOG_LEVEL_DEBUG))
+	/* set our connected TCP socket to TLS context */
+	if (1 != SSL_set_fd(s->tls_ctx->ctx, s->socket))
 	{
-		zabbix_log(LOG_LEVEL_DEBUG, "End of %s():SUCCEED (established %s %s-%s-%s-" ZBX_FS_SIZE_T ")",
-				__function_name,
-				gnutls_protocol_get_name(gnutls_protocol_get_version(s->tls_ctx->ctx)),
-				gnutls_kx_get_name(gnutls_kx_get(s->tls_ctx->ctx)),
-				gnutls_cipher_get_name(gnutls_cipher_get(s->tls_ctx->ctx)),
-				gnutls_mac_get_name(gnutls_mac_get(s->tls_ctx->ctx)),
-				(zbx_fs_size_t)gnutls_mac_get_key_size(gnutls_mac_get(s->tls_ctx->ctx)));
+		*error = zbx_strdup(*error, "cannot set socket for TLS context");
+		goto out;
 	}
 
 	return SUCCEED;
 
 out:	/* an error occurred */
-	if (NULL != s->tls_ctx->ctx)
-	{
-		gnutls_credentials_clear(s->tls_ctx->ctx);
-		gnutls_deinit(s->tls_ctx->ctx);
-	}
+	zbx_tls_connect_cancel(s);
 
-	if (NULL != s->tls_ctx->psk_client_creds)
-		gnutls_psk_free_client_credentials(s->tls_ctx->psk_client_creds);
-
-	zbx_free(s->tls_ctx);
-out1:
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s error:'%s'", __function_name, zbx_result_string(ret),
-			ZBX_NULL2EMPTY_STR(*error));
-	return ret;
+	return FAIL;
 }
-#elif defined(HAVE_OPENSSL)
-int	zbx_tls_connect(zbx_socket_t *s, unsigned int tls_connect, const char *tls_arg1, const char *tls_arg2,
-		char **error)
-{
-	const char	*__function_name = "zbx_tls_connect";
-	int		ret = FAIL, res;
-	size_t		error_alloc = 0, error_offset = 0;
-#if defined(_WINDOWS)
-	double		sec;
 #endif
-	char		psk_buf[HOST_TLS_PSK_LEN / 2];
 
-	s->tls_ctx = zbx_malloc(s->tls_ctx, sizeof(zbx_tls_context_t));
-	s->tls_ctx->ctx = NULL;
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_tls_handshake                                                *
+ *                                                                            *
+ * Purpose: advance TLS handshake of an outgoing connection                   *
+ *                                                                            *
+ * Parameters:                                                                *
+ *     s     - [IN] socket with TLS context created by zbx_tls_connect_setup()*
+ *     error - [OUT] dynamically allocated memory with error message          *
+ *                                                                            *
+ * Return value:                                                              *
+ *     SUCCEED - handshake has finished                                       *
+ *     ZBX_TLS_WAIT_READ - handshake waits for the socket to become readable  *
+ *     ZBX_TLS_WAIT_WRITE - handshake waits for the socket to become writable *
+ *     FAIL - an error occurred, TLS context is freed                         *
+ *                                                                            *
+ ******************************************************************************/
+#if defined(HAVE_POLARSSL)
+static int	zbx_tls_handshake(zbx_socket_t *s, char **error)
+{
+	int	res;
 
-	if (ZBX_TCP_SEC_TLS_CERT == tls_connect)
-	{
-		zabbix_log(LOG_LEVEL_DEBUG, "In %s(): issuer:\"%s\" subject:\"%s\"", __function_name,
-				ZBX_NULL2EMPTY_STR(tls_arg1), ZBX_NULL2EMPTY_STR(tls_arg2));
+	if (0 == (res = ssl_handshake(s->tls_ctx->ctx)))
+		return SUCCEED;
 
-		if (NULL == ctx_cert)
-		{
-			*error = zbx_strdup(*error, "cannot connect with TLS and certificate: no valid certificate"
-					" loaded");
-			goto out;
-		}
+	if (POLARSSL_ERR_NET_WANT_READ == res)
+		return ZBX_TLS_WAIT_READ;
 
-		if (NULL == (s->tls_ctx->ctx = SSL_new(ctx_cert)))
-		{
-			zbx_snprintf_alloc(error, &error_alloc, &error_offset, "cannot create connection context:");
-			zbx_tls_error_msg(error, &error_alloc, &error_offset);
-			goto out;
-		}
-	}
-	else if (ZBX_TCP_SEC_TLS_PSK == tls_connect)
+	if (POLARSSL_ERR_NET_WANT_WRITE == res)
+		return ZBX_TLS_WAIT_WRITE;
+
+	if (POLARSSL_ERR_X509_CERT_VERIFY_FAILED == res)
 	{
-		zabbix_log(LOG_LEVEL_DEBUG, "In %s(): psk_identity:\"%s\"", __function_name,
-				ZBX_NULL2EMPTY_STR(tls_arg1));
+		/* Standard PolarSSL error message might not be very informative in this case. For */
+		/* example, if certificate validity starts in future, PolarSSL 1.3.9 would produce a */
+		/* message "X509 - Certificate verification failed, e.g. CRL, CA or signature check */
+		/* failed" which does not give a precise reason. Here we try to get more detailed */
+		/* reason why peer certificate was rejected by using some knowledge about PolarSSL */
+		/* internals. */
+		zbx_tls_cert_error_msg((unsigned int)s->tls_ctx->ctx->session_negotiate->verify_result, error);
+		zbx_tls_close(s);
+		return FAIL;
+	}
 
-		if (NULL == ctx_psk)
-		{
-			*error = zbx_strdup(*error, "cannot connect with TLS and PSK: no valid PSK loaded");
-			goto out;
-		}
+	zbx_tls_error_msg(res, "ssl_handshake(): ", error);
+	zbx_tls_connect_cancel(s);
 
-		if (NULL == (s->tls_ctx->ctx = SSL_new(ctx_psk)))
+	return FAIL;
+}
+#elif defined(HAVE_GNUTLS)
+static int	zbx_tls_handshake(zbx_socket_t *s, char **error)
+{
+	const char	*__function_name = "zbx_tls_handshake";
+	int		res;
+
+	while (GNUTLS_E_SUCCESS != (res = gnutls_handshake(s->tls_ctx->ctx)))
+	{
+		if (GNUTLS_E_INTERRUPTED == res || GNUTLS_E_AGAIN == res)
 		{
-			zbx_snprintf_alloc(error, &error_alloc, &error_offset, "cannot create connection context:");
-			zbx_tls_error_msg(error, &error_alloc, &error_offset);
-			goto out;
+			return 0 == gnutls_record_get_direction(s->tls_ctx->ctx) ? ZBX_TLS_WAIT_READ :
+					ZBX_TLS_WAIT_WRITE;
 		}
-
-		if (NULL == tls_arg2)	/* PSK is not set from DB */
+		else if (GNUTLS_E_WARNING_ALERT_RECEIVED == res || GNUTLS_E_FATAL_ALERT_RECEIVED == res)
 		{
-			/* Set up PSK global variables from a configuration file (always in agentd and a case when */
-			/* active proxy connects to server). Here we set it only in case of active proxy */
-			/* because for other programs it has already been set in zbx_tls_init_child(). */
+			const char	*msg;
+			int		alert;
 
-			if (0 != (program_type & ZBX_PROGRAM_TYPE_PROXY_ACTIVE))
+			/* server sent an alert to us */
+			alert = gnutls_alert_get(s->tls_ctx->ctx);
+
+			if (NULL == (msg = gnutls_alert_get_name(alert)))
+				msg = "unknown";
+
+			if (GNUTLS_E_WARNING_ALERT_RECEIVED == res)
 			{
-				psk_identity_for_cb = my_psk_identity;
-				psk_identity_len_for_cb = my_psk_identity_len;
-				psk_for_cb = my_psk;
-				psk_len_for_cb = my_psk_len;
+				zabbix_log(LOG_LEVEL_WARNING, "%s() gnutls_handshake() received a warning alert: %d"
+						" %s", __function_name, alert, msg);
+				continue;
+			}
+			else	/* GNUTLS_E_FATAL_ALERT_RECEIVED */
+			{
+				*error = zbx_dsprintf(*error, "%s(): gnutls_handshake() failed with fatal alert: %d %s",
+						__function_name, alert, msg);
+				goto out;
 			}
 		}
 		else
 		{
-			/* PSK comes from a database (case for a server/proxy when it connects to an agent for */
-			/* passive checks, for a server when it connects to a passive proxy) */
+			int	level;
 
-			int	psk_len;
+			/* log "peer has closed connection" case with debug level */
+			level = (GNUTLS_E_PREMATURE_TERMINATION == res ? LOG_LEVEL_DEBUG : LOG_LEVEL_WARNING);
 
-			if (0 >= (psk_len = zbx_psk_hex2bin((unsigned char *)tls_arg2, (unsigned char *)psk_buf,
-					sizeof(psk_buf))))
+			if (SUCCEED == zabbix_check_log_level(level))
 			{
-				*error = zbx_strdup(*error, "invalid PSK");
-				goto out;
+				zabbix_log(level, "%s() gnutls_handshake() returned: %d %s",
+						__function_name, res, gnutls_strerror(res));
 			}
 
-			/* some data reside in stack but it will be available at the time when a PSK client callback */
-			/* function copies the data into buffers provided by OpenSSL within the callback */
-			psk_identity_for_cb = tls_arg1;			/* string is on stack */
-			/* NULL check to silence analyzer warning */
-			psk_identity_len_for_cb = (NULL == tls_arg1 ? 0 : strlen(tls_arg1));
-			psk_for_cb = psk_buf;				/* buffer is on stack */
-			psk_len_for_cb = (size_t)psk_len;
+			if (0 != gnutls_error_is_fatal(res))
+			{
+				*error = zbx_dsprintf(*error, "%s(): gnutls_handshake() failed: %d %s",
+						__function_name, res, gnutls_strerror(res));
+				goto out;
+			}
 		}
 	}
-	else
-	{
-		*error = zbx_strdup(*error, "invalid connection parameters");
-		THIS_SHOULD_NEVER_HAPPEN;
-		goto out1;
-	}
 
-	/* set our connected TCP socket to TLS context */
-	if (1 != SSL_set_fd(s->tls_ctx->ctx, s->socket))
-	{
-		*error = zbx_strdup(*error, "cannot set socket for TLS context");
-		goto out;
-	}
+	return SUCCEED;
+out:
+	zbx_tls_connect_cancel(s);
 
-	/* TLS handshake */
+	return FAIL;
+}
+#elif defined(HAVE_OPENSSL)
+static int	zbx_tls_handshake(zbx_socket_t *s, char **error)
+{
+	int	res, result_code;
+	size_t	error_alloc = 0, error_offset = 0;
+	long	verify_result;
 
 	info_buf[0] = '\0';	/* empty buffer for zbx_openssl_info_cb() messages */
-#if defined(_WINDOWS)
-	zbx_alarm_flag_clear();
-	sec = zbx_time();
-#endif
-	if (1 != (res = SSL_connect(s->tls_ctx->ctx)))
-	{
-		int	result_code;
 
-#if defined(_WINDOWS)
-		if (s->timeout < zbx_time() - sec)
-			zbx_alarm_flag_set();
-#endif
-		if (SUCCEED == zbx_alarm_timed_out())
-		{
-			*error = zbx_strdup(*error, "SSL_connect() timed out");
-			goto out;
-		}
+	if (1 == (res = SSL_connect(s->tls_ctx->ctx)))
+		return SUCCEED;
 
-		if (ZBX_TCP_SEC_TLS_CERT == tls_connect)
-		{
-			long	verify_result;
+	result_code = SSL_get_error(s->tls_ctx->ctx, res);
 
-			/* In case of certificate error SSL_get_verify_result() provides more helpful diagnostics */
-			/* than other methods. Include it as first but continue with other diagnostics. */
-			if (X509_V_OK != (verify_result = SSL_get_verify_result(s->tls_ctx->ctx)))
-			{
-				zbx_snprintf_alloc(error, &error_alloc, &error_offset, "%s: ",
-						X509_verify_cert_error_string(verify_result));
-			}
-		}
+	switch (result_code)
+	{
+		case SSL_ERROR_NONE:		/* handshake successful */
+			return SUCCEED;
+		case SSL_ERROR_WANT_READ:
+			return ZBX_TLS_WAIT_READ;
+		case SSL_ERROR_WANT_WRITE:
+			return ZBX_TLS_WAIT_WRITE;
+	}
 
-		result_code = SSL_get_error(s->tls_ctx->ctx, res);
+	/* In case of certificate error SSL_get_verify_result() provides more helpful diagnostics */
+	/* than other methods. Include it as first but continue with other diagnostics. */
+	if (X509_V_OK != (verify_result = SSL_get_verify_result(s->tls_ctx->ctx)))
+	{
+		zbx_snprintf_alloc(error, &error_alloc, &error_offset, "%s: ",
+				X509_verify_cert_error_string(verify_result));
+	}
 
-		switch (result_code)
-		{
-			case SSL_ERROR_NONE:		/* handshake successful */
-				break;
-			case SSL_ERROR_ZERO_RETURN:
-				zbx_snprintf_alloc(error, &error_alloc, &error_offset,
-						"TLS connection has been closed during handshake");
-				goto out;
-			case SSL_ERROR_SYSCALL:
-				if (0 == ERR_peek_error())
+	switch (result_code)
+	{
+		case SSL_ERROR_ZERO_RETURN:
+			zbx_snprintf_alloc(error, &error_alloc, &error_offset,
+					"TLS connection has been closed during handshake");
+			break;
+		case SSL_ERROR_SYSCALL:
+			if (0 == ERR_peek_error())
+			{
+				if (0 == res)
 				{
-					if (0 == res)
-					{
-						zbx_snprintf_alloc(error, &error_alloc, &error_offset,
-								"connection closed by peer");
-					}
-					else if (-1 == res)
-					{
-						zbx_snprintf_alloc(error, &error_alloc, &error_offset, "SSL_connect()"
-								" I/O error: %s",
-								strerror_from_system(zbx_socket_last_error()));
-					}
-					else
-					{
-						/* "man SSL_get_error" describes only res == 0 and res == -1 for */
-						/* SSL_ERROR_SYSCALL case */
-						zbx_snprintf_alloc(error, &error_alloc, &error_offset, "SSL_connect()"
-								" returned undocumented code %d", res);
-					}
+					zbx_snprintf_alloc(error, &error_alloc, &error_offset,
+							"connection closed by peer");
+				}
+				else if (-1 == res)
+				{
+					zbx_snprintf_alloc(error, &error_alloc, &error_offset, "SSL_connect()"
+							" I/O error: %s",
+							strerror_from_system(zbx_socket_last_error()));
 				}
 				else
 				{
-					zbx_snprintf_alloc(error, &error_alloc, &error_offset, "SSL_connect() set"
-							" result code to SSL_ERROR_SYSCALL:");
-					zbx_tls_error_msg(error, &error_alloc, &error_offset);
-					zbx_snprintf_alloc(error, &error_alloc, &error_offset, "%s", info_buf);
+					/* "man SSL_get_error" describes only res == 0 and res == -1 for */
+					/* SSL_ERROR_SYSCALL case */
+					zbx_snprintf_alloc(error, &error_alloc, &error_offset, "SSL_connect()"
+							" returned undocumented code %d", res);
 				}
-				goto out;
-			case SSL_ERROR_SSL:
+			}
+			else
+			{
 				zbx_snprintf_alloc(error, &error_alloc, &error_offset, "SSL_connect() set"
-						" result code to SSL_ERROR_SSL:");
+						" result code to SSL_ERROR_SYSCALL:");
 				zbx_tls_error_msg(error, &error_alloc, &error_offset);
 				zbx_snprintf_alloc(error, &error_alloc, &error_offset, "%s", info_buf);
-				goto out;
-			default:
-				zbx_snprintf_alloc(error, &error_alloc, &error_offset, "SSL_connect() set result code"
-						" to %d", result_code);
-				zbx_tls_error_msg(error, &error_alloc, &error_offset);
-				zbx_snprintf_alloc(error, &error_alloc, &error_offset, "%s", info_buf);
-				goto out;
-		}
+			}
+			break;
+		case SSL_ERROR_SSL:
+			zbx_snprintf_alloc(error, &error_alloc, &error_offset, "SSL_connect() set"
+					" result code to SSL_ERROR_SSL:");
+			zbx_tls_error_msg(error, &error_alloc, &error_offset);
+			zbx_snprintf_alloc(error, &error_alloc, &error_offset, "%s", info_buf);
+			break;
+		default:
+			zbx_snprintf_alloc(error, &error_alloc, &error_offset, "SSL_connect() set result code"
+					" to %d", result_code);
+			zbx_tls_error_msg(error, &error_alloc, &error_offset);
+			zbx_snprintf_alloc(error, &error_alloc, &error_offset, "%s", info_buf);
 	}
 
+	zbx_tls_connect_cancel(s);
+
+	return FAIL;
+}
+#endif
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_tls_connect_verify                                           *
+ *                                                                            *
+ * Purpose: verify the peer of an outgoing connection after handshake         *
+ *                                                                            *
+ * Parameters: see zbx_tls_connect()                                          *
+ *                                                                            *
+ * Return value:                                                              *
+ *     SUCCEED - the connection is established                                *
+ *     FAIL - the peer is not accepted, TLS connection is closed              *
+ *                                                                            *
+ ******************************************************************************/
+static int	zbx_tls_connect_verify(zbx_socket_t *s, unsigned int tls_connect, const char *tls_arg1,
+		const char *tls_arg2, char **error)
+{
+	const char	*__function_name = "zbx_tls_connect_verify";
+
 	if (ZBX_TCP_SEC_TLS_CERT == tls_connect)
 	{
+#if defined(HAVE_OPENSSL)
 		long	verify_result;
-
+#endif
 		/* log peer certificate information for debugging */
 		zbx_log_peer_cert(__function_name, s->tls_ctx);
 
+#if defined(HAVE_GNUTLS)
+		/* perform basic verification of peer certificate */
+		if (SUCCEED != zbx_verify_peer_cert(s->tls_ctx->ctx, error))
+		{
+			zbx_tls_close(s);
+			return FAIL;
+		}
+#elif defined(HAVE_OPENSSL)
 		/* perform basic verification of peer certificate */
 		if (X509_V_OK != (verify_result = SSL_get_verify_result(s->tls_ctx->ctx)))
 		{
-			zbx_snprintf_alloc(error, &error_alloc, &error_offset, "%s",
-					X509_verify_cert_error_string(verify_result));
+			*error = zbx_strdup(*error, X509_verify_cert_error_string(verify_result));
 			zbx_tls_close(s);
-			goto out1;
+			return FAIL;
 		}
+#endif
+		/* basic verification of peer certificate was done during handshake with PolarSSL */
 
 		/* if required verify peer certificate Issuer and Subject */
 		if (SUCCEED != zbx_verify_issuer_subject(s->tls_ctx, tls_arg1, tls_arg2, error))
 		{
 			zbx_tls_close(s);
-			goto out1;
+			return FAIL;
 		}
 	}
-
+#if defined(HAVE_POLARSSL)
+	else	/* pre-shared key */
+	{
+		if (SUCCEED == zabbix_check_log_level(LOG_LEVEL_DEBUG))
+		{
+			/* special print: s->tls_ctx->ctx->psk_identity is not '\0'-terminated */
+			zabbix_log(LOG_LEVEL_DEBUG, "%s() PSK identity: \"%.*s\"", __function_name,
+					(int)s->tls_ctx->ctx->psk_identity_len, s->tls_ctx->ctx->psk_identity);
+		}
+	}
+#endif
 	s->connection_type = tls_connect;
 
 	if (SUCCEED == zabbix_check_log_level(LOG_LEVEL_DEBUG))
 	{
-		zabbix_log(LOG_LEVEL_DEBUG, "End of %s():SUCCEED (established %s %s)", __function_name,
+#if defined(HAVE_POLARSSL)
+		zabbix_log(LOG_LEVEL_DEBUG, "%s() established %s %s", __function_name,
+				ssl_get_version(s->tls_ctx->ctx), ssl_get_ciphersuite(s->tls_ctx->ctx));
+#elif defined(HAVE_GNUTLS)
+		zabbix_log(LOG_LEVEL_DEBUG, "%s() established %s %s-%s-%s-" ZBX_FS_SIZE_T, __function_name,
+				gnutls_protocol_get_name(gnutls_protocol_get_version(s->tls_ctx->ctx)),
+				gnutls_kx_get_name(gnutls_kx_get(s->tls_ctx->ctx)),
+				gnutls_cipher_get_name(gnutls_cipher_get(s->tls_ctx->ctx)),
+				gnutls_mac_get_name(gnutls_mac_get(s->tls_ctx->ctx)),
+				(zbx_fs_size_t)gnutls_mac_get_key_size(gnutls_mac_get(s->tls_ctx->ctx)));
+#elif defined(HAVE_OPENSSL)
+		zabbix_log(LOG_LEVEL_DEBUG, "%s() established %s %s", __function_name,
 				SSL_get_version(s->tls_ctx->ctx), SSL_get_cipher(s->tls_ctx->ctx));
+#endif
 	}
 
 	return SUCCEED;
+}
 
-out:	/* an error occurred */
-	if (NULL != s->tls_ctx->ctx)
-		SSL_free(s->tls_ctx->ctx);
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_tls_connect                                                  *
+ *                                                                            *
+ * Purpose: establish a TLS connection over an established TCP connection     *
+ *                                                                            *
+ * Parameters:                                                                *
+ *     s           - [IN] socket with opened connection                       *
+ *     error       - [OUT] dynamically allocated memory with error message    *
+ *     tls_connect - [IN] how to connect. Allowed values:                     *
+ *                        ZBX_TCP_SEC_TLS_CERT, ZBX_TCP_SEC_TLS_PSK.          *
+ *     tls_arg1    - [IN] required issuer of peer certificate (may be NULL    *
+ *                        or empty string if not important) or PSK identity   *
+ *                        to connect with depending on value of               *
+ *                        'tls_connect'.                                      *
+ *     tls_arg2    - [IN] required subject of peer certificate (may be NULL   *
+ *                        or empty string if not important) or PSK            *
+ *                        (in hex-string) to connect with depending on value  *
+ *                        of 'tls_connect'.                                   *
+ *                                                                            *
+ * Return value:                                                              *
+ *     SUCCEED - successful TLS handshake with a valid certificate or PSK     *
+ *     FAIL - an error occurred                                               *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_tls_connect(zbx_socket_t *s, unsigned int tls_connect, const char *tls_arg1, const char *tls_arg2,
+		char **error)
+{
+	const char	*__function_name = "zbx_tls_connect";
+	int		ret;
+#if defined(_WINDOWS)
+	double		sec;
+#endif
+	if (SUCCEED != (ret = zbx_tls_connect_setup(s, tls_connect, tls_arg1, tls_arg2, error)))
+		goto out;
 
-	zbx_free(s->tls_ctx);
-out1:
+#if defined(_WINDOWS)
+	zbx_alarm_flag_clear();
+	sec = zbx_time();
+#endif
+	while (SUCCEED != (ret = zbx_tls_handshake(s, error)))
+	{
+#if defined(_WINDOWS)
+		if (s->timeout < zbx_time() - sec)
+			zbx_alarm_flag_set();
+#endif
+		if (SUCCEED == zbx_alarm_timed_out())
+		{
+			zbx_tls_connect_cancel(s);
+			*error = zbx_strdup(*error, ZBX_TLS_HANDSHAKE_FUNC_NAME "() timed out");
+			ret = FAIL;
+			goto out;
+		}
+
+		if (FAIL == ret)
+			goto out;
+	}
+
+	ret = zbx_tls_connect_verify(s, tls_connect, tls_arg1, tls_arg2, error);
+out:
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s error:'%s'", __function_name, zbx_result_string(ret),
 			ZBX_NULL2EMPTY_STR(*error));
+
 	return ret;
 }
-#endif
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_tls_connect_nb                                               *
+ *                                                                            *
+ * Purpose: establish a TLS connection over a non-blocking TCP connection     *
+ *                                                                            *
+ * Parameters: see zbx_tls_connect()                                          *
+ *                                                                            *
+ * Return value:                                                              *
+ *     SUCCEED - successful TLS handshake with a valid certificate or PSK     *
+ *     ZBX_TLS_WAIT_READ - call again when the socket becomes readable        *
+ *     ZBX_TLS_WAIT_WRITE - call again when the socket becomes writable       *
+ *     FAIL - an error occurred                                               *
+ *                                                                            *
+ * Comments:                                                                  *
+ *     The first call creates TLS context, so 's->tls_ctx' must be NULL. If   *
+ *     the handshake is abandoned, free the context with                      *
+ *     zbx_tls_connect_cancel().                                              *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_tls_connect_nb(zbx_socket_t *s, unsigned int tls_connect, const char *tls_arg1, const char *tls_arg2,
+		char **error)
+{
+	int	ret;
+
+	if (NULL == s->tls_ctx && SUCCEED != zbx_tls_connect_setup(s, tls_connect, tls_arg1, tls_arg2, error))
+		return FAIL;
+
+	if (SUCCEED != (ret = zbx_tls_handshake(s, error)))
+		return ret;
+
+	return zbx_tls_connect_verify(s, tls_connect, tls_arg1, tls_arg2, error);
+}
 
 /******************************************************************************
  *                                                                            *
@@ -4891,6 +5036,9 @@ int	zbx_tls_accept(zbx_socket_t *s, unsigned int tls_accept, char **error)
 
 	s->tls_ctx = zbx_malloc(s->tls_ctx, sizeof(zbx_tls_context_t));
 	s->tls_ctx->ctx = NULL;
+	s->tls_ctx->psk_identity = NULL;
+	s->tls_ctx->psk = NULL;
+	s->tls_ctx->psk_len = 0;
 
 	incoming_connection_has_psk = 0;	/* assume certificate-based connection by default */
 
@@ -5202,6 +5350,73 @@ ssize_t	zbx_tls_write(zbx_socket_t *s, const char *buf, size_t len, char **error
 	return (ssize_t)res;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_tls_read_result                                              *
+ *                                                                            *
+ * Purpose: convert result of TLS library read function                      *
+ *                                                                            *
+ ******************************************************************************/
+#if defined(HAVE_POLARSSL)
+static ssize_t	zbx_tls_read_result(zbx_socket_t *s, int res, char **error)
+#elif defined(HAVE_GNUTLS)
+static ssize_t	zbx_tls_read_result(zbx_socket_t *s, ssize_t res, char **error)
+#elif defined(HAVE_OPENSSL)
+static ssize_t	zbx_tls_read_result(zbx_socket_t *s, int res, char **error)
+#endif
+{
+#if !defined(HAVE_OPENSSL)
+	ZBX_UNUSED(s);
+#endif
+#if defined(HAVE_POLARSSL)
+	if (0 > res)
+	{
+		char	err[128];	/* 128 bytes are enough for PolarSSL error messages */
+
+		polarssl_strerror(res, err, sizeof(err));
+		*error = zbx_dsprintf(*error, "ssl_read() failed: %s", err);
+
+		return ZBX_PROTO_ERROR;
+	}
+#elif defined(HAVE_GNUTLS)
+	if (0 > res)
+	{
+		/* in case of rehandshake a GNUTLS_E_REHANDSHAKE will be returned, deal with it as with error */
+		*error = zbx_dsprintf(*error, "gnutls_record_recv() failed: " ZBX_FS_SSIZE_T " %s",
+				(zbx_fs_ssize_t)res, gnutls_strerror(res));
+
+		return ZBX_PROTO_ERROR;
+	}
+#elif defined(HAVE_OPENSSL)
+	if (0 >= res)
+	{
+		int	result_code;
+
+		result_code = SSL_get_error(s->tls_ctx->ctx, res);
+
+		if (0 == res && SSL_ERROR_ZERO_RETURN == result_code)
+		{
+			*error = zbx_strdup(*error, "connection closed during read");
+		}
+		else
+		{
+			char	*err = NULL;
+			size_t	error_alloc = 0, error_offset = 0;
+
+			zbx_snprintf_alloc(&err, &error_alloc, &error_offset, "TLS read set result code to"
+					" %d:", result_code);
+			zbx_tls_error_msg(&err, &error_alloc, &error_offset);
+			*error = zbx_dsprintf(*error, "%s%s", err, info_buf);
+			zbx_free(err);
+		}
+
+		return ZBX_PROTO_ERROR;
+	}
+#endif
+
+	return (ssize_t)res;
+}
+
 ssize_t	zbx_tls_read(zbx_socket_t *s, char *buf, size_t len, char **error)
 {
 #if defined(_WINDOWS)
@@ -5237,53 +5452,67 @@ ssize_t	zbx_tls_read(zbx_socket_t *s, char *buf, size_t len, char **error)
 	}
 	while (SUCCEED == ZBX_TLS_WANT_READ(res));
 
+	return zbx_tls_read_result(s, res, error);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_tls_read_nb                                                  *
+ *                                                                            *
+ * Purpose: read from TLS connection over a non-blocking socket               *
+ *                                                                            *
+ * Return value:                                                              *
+ *     number of bytes read, 0 if the peer has closed the connection          *
+ *     ZBX_PROTO_ERROR - an error occurred, or no data is available yet and   *
+ *                       errno is set to EAGAIN (the error is not set then)   *
+ *                                                                            *
+ ******************************************************************************/
+ssize_t	zbx_tls_read_nb(zbx_socket_t *s, char *buf, size_t len, char **error)
+{
 #if defined(HAVE_POLARSSL)
-	if (0 > res)
-	{
-		char	err[128];	/* 128 bytes are enough for PolarSSL error messages */
+	int	res;
+#elif defined(HAVE_GNUTLS)
+	ssize_t	res;
+#elif defined(HAVE_OPENSSL)
+	int	res, result_code;
+#endif
 
-		polarssl_strerror(res, err, sizeof(err));
-		*error = zbx_dsprintf(*error, "ssl_read() failed: %s", err);
+#if defined(HAVE_OPENSSL)
+	info_buf[0] = '\0';	/* empty buffer for zbx_openssl_info_cb() messages */
+#endif
+	res = ZBX_TLS_READ(s->tls_ctx->ctx, buf, len);
 
+#if defined(HAVE_POLARSSL)
+	if (POLARSSL_ERR_NET_WANT_READ == res || POLARSSL_ERR_NET_WANT_WRITE == res)
+	{
+		errno = EAGAIN;
 		return ZBX_PROTO_ERROR;
 	}
+
+	if (POLARSSL_ERR_SSL_PEER_CLOSE_NOTIFY == res)
+		return 0;
 #elif defined(HAVE_GNUTLS)
-	if (0 > res)
+	if (GNUTLS_E_INTERRUPTED == res || GNUTLS_E_AGAIN == res)
 	{
-		/* in case of rehandshake a GNUTLS_E_REHANDSHAKE will be returned, deal with it as with error */
-		*error = zbx_dsprintf(*error, "gnutls_record_recv() failed: " ZBX_FS_SSIZE_T " %s",
-				(zbx_fs_ssize_t)res, gnutls_strerror(res));
-
+		errno = EAGAIN;
 		return ZBX_PROTO_ERROR;
 	}
 #elif defined(HAVE_OPENSSL)
 	if (0 >= res)
 	{
-		int	result_code;
-
 		result_code = SSL_get_error(s->tls_ctx->ctx, res);
 
-		if (0 == res && SSL_ERROR_ZERO_RETURN == result_code)
-		{
-			*error = zbx_strdup(*error, "connection closed during read");
-		}
-		else
+		if (SSL_ERROR_WANT_READ == result_code || SSL_ERROR_WANT_WRITE == result_code)
 		{
-			char	*err = NULL;
-			size_t	error_alloc = 0, error_offset = 0;
-
-			zbx_snprintf_alloc(&err, &error_alloc, &error_offset, "TLS read set result code to"
-					" %d:", result_code);
-			zbx_tls_error_msg(&err, &error_alloc, &error_offset);
-			*error = zbx_dsprintf(*error, "%s%s", err, info_buf);
-			zbx_free(err);
+			errno = EAGAIN;
+			return ZBX_PROTO_ERROR;
 		}
 
-		return ZBX_PROTO_ERROR;
+		if (0 == res && SSL_ERROR_ZERO_RETURN == result_code)
+			return 0;
 	}
 #endif
-
-	return (ssize_t)res;
+	return zbx_tls_read_result(s, res, error);
 }
 
 /******************************************************************************
@@ -5388,6 +5617,8 @@ void	zbx_tls_close(zbx_socket_t *s)
 
 		SSL_free(s->tls_ctx->ctx);
 	}
+
+	zbx_tls_free_conn_psk(s->tls_ctx);
 #endif
 	zbx_free(s->tls_ctx);
 }
@@ -27,6 +27,15 @@ int	zbx_tls_accept(zbx_socket_t *s, unsigned int tls_accept, char **error);
 ssize_t	zbx_tls_write(zbx_socket_t *s, const char *buf, size_t len, char **error);
 ssize_t	zbx_tls_read(zbx_socket_t *s, char *buf, size_t len, char **error);
 void	zbx_tls_close(zbx_socket_t *s);
+
+/* zbx_tls_connect_nb() return values besides SUCCEED and FAIL */
+#define ZBX_TLS_WAIT_READ	1
+#define ZBX_TLS_WAIT_WRITE	2
+
+int	zbx_tls_connect_nb(zbx_socket_t *s, unsigned int tls_connect, const char *tls_arg1, const char *tls_arg2,
+		char **error);
+void	zbx_tls_connect_cancel(zbx_socket_t *s);
+ssize_t	zbx_tls_read_nb(zbx_socket_t *s, char *buf, size_t len, char **error);
 #endif
 
 #if defined(HAVE_OPENSSL)
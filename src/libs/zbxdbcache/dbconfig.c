@@ -3047,6 +3047,60 @@ static void	DCsync_items(zbx_dbsync_t *sync, int flags)
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: dc_compile_expression                                            *
+ *                                                                            *
+ * Purpose: compiles trigger expression into configuration cache              *
+ *                                                                            *
+ * Parameters: triggerid  - [IN] the trigger identifier                       *
+ *             expression - [IN] the trigger expression as stored in database *
+ *             failed_num - [IN/OUT] the number of expressions that cannot be *
+ *                                   compiled                                 *
+ *                                                                            *
+ * Return value: The compiled expression or NULL if the expression cannot be  *
+ *               compiled.                                                    *
+ *                                                                            *
+ * Comments: User macros are expanded only when trigger is evaluated, so the  *
+ *           expressions containing them (and the other syntax not supported  *
+ *           by compiler) are not compiled and are evaluated from text.       *
+ *                                                                            *
+ ******************************************************************************/
+static zbx_eval_code_t	*dc_compile_expression(zbx_uint64_t triggerid, const char *expression, int *failed_num)
+{
+	zbx_eval_code_t	*code, *dc_code;
+
+	if (NULL == (code = zbx_eval_compile(expression)))
+	{
+		zabbix_log(LOG_LEVEL_DEBUG, "cannot compile expression \"%s\" of trigger " ZBX_FS_UI64
+				", it will be evaluated from text", expression, triggerid);
+		(*failed_num)++;
+		return NULL;
+	}
+
+	dc_code = (zbx_eval_code_t *)__config_mem_malloc_func(NULL, code->size);
+	memcpy(dc_code, code, code->size);
+	zbx_free(code);
+
+	return dc_code;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dc_trigger_free_code                                             *
+ *                                                                            *
+ * Purpose: frees compiled trigger expressions                                *
+ *                                                                            *
+ ******************************************************************************/
+static void	dc_trigger_free_code(ZBX_DC_TRIGGER *trigger)
+{
+	if (NULL != trigger->expression_code)
+		__config_mem_free_func(trigger->expression_code);
+
+	if (NULL != trigger->recovery_expression_code)
+		__config_mem_free_func(trigger->recovery_expression_code);
+}
+
 static void	DCsync_triggers(zbx_dbsync_t *sync)
 {
 	const char	*__function_name = "DCsync_triggers";
@@ -3057,7 +3111,7 @@ static void	DCsync_triggers(zbx_dbsync_t *sync)
 
 	ZBX_DC_TRIGGER	*trigger;
 
-	int		found, ret;
+	int		found, ret, failed_num = 0;
 	zbx_uint64_t	triggerid;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
@@ -3084,6 +3138,19 @@ static void	DCsync_triggers(zbx_dbsync_t *sync)
 		ZBX_STR2UCHAR(trigger->recovery_mode, row[10]);
 		ZBX_STR2UCHAR(trigger->correlation_mode, row[12]);
 
+		if (0 != found)
+			dc_trigger_free_code(trigger);
+
+		trigger->expression_code = dc_compile_expression(triggerid, trigger->expression, &failed_num);
+
+		if (TRIGGER_RECOVERY_MODE_RECOVERY_EXPRESSION == trigger->recovery_mode)
+		{
+			trigger->recovery_expression_code = dc_compile_expression(triggerid,
+					trigger->recovery_expression, &failed_num);
+		}
+		else
+			trigger->recovery_expression_code = NULL;
+
 		if (0 == found)
 		{
 			DCstrpool_replace(found, &trigger->error, row[3]);
@@ -3143,13 +3210,14 @@ static void	DCsync_triggers(zbx_dbsync_t *sync)
 			zbx_strpool_release(trigger->correlation_tag);
 
 			zbx_vector_ptr_destroy(&trigger->tags);
+			dc_trigger_free_code(trigger);
 
 			zbx_hashset_remove_direct(&config->triggers, trigger);
 		}
 		zbx_vector_uint64_destroy(&functionids);
 	}
 
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() not compiled expressions:%d", __function_name, failed_num);
 }
 
 static void	DCconfig_sort_triggers_topologically(void);
@@ -4696,6 +4764,7 @@ void	DCsync_configuration(unsigned char mode)
 				maintenance_period_sync, maintenance_tag_sync, maintenance_group_sync,
 				maintenance_host_sync, hgroup_host_sync;
 	zbx_uint64_t		update_flags = 0;
+	zbx_config_hk_t		hk;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
@@ -4737,11 +4806,20 @@ void	DCsync_configuration(unsigned char mode)
 	zbx_dbsync_init(&maintenance_group_sync, mode);
 	zbx_dbsync_init(&maintenance_host_sync, mode);
 
+	/* changelog must be read before the tables it tracks */
+	if (FAIL == zbx_dbsync_env_prepare(mode))
+		goto out;
+
 	sec = zbx_time();
 	if (FAIL == zbx_dbsync_compare_config(&config_sync))
 		goto out;
 	csec = zbx_time() - sec;
 
+	if (NULL != config->config)
+		hk = config->config->hk;
+	else
+		memset(&hk, 0, sizeof(hk));
+
 	/* sync global configuration settings */
 	START_SYNC;
 	sec = zbx_time();
@@ -4749,6 +4827,14 @@ void	DCsync_configuration(unsigned char mode)
 	csec2 = zbx_time() - sec;
 	FINISH_SYNC;
 
+	/* item history and trends settings depend on global housekeeping overrides */
+	if (hk.history_global != config->config->hk.history_global || hk.history != config->config->hk.history ||
+			hk.trends_global != config->config->hk.trends_global ||
+			hk.trends != config->config->hk.trends)
+	{
+		zbx_dbsync_env_full_compare();
+	}
+
 	/* sync macro related data, to support macro resolving during configuration sync */
 
 	sec = zbx_time();
@@ -4780,6 +4866,14 @@ void	DCsync_configuration(unsigned char mode)
 	hmsec2 = zbx_time() - sec;
 	FINISH_SYNC;
 
+	/* user macros are expanded in item and trigger columns, so any macro change can affect them */
+	if (0 != htmpl_sync.add_num + htmpl_sync.update_num + htmpl_sync.remove_num +
+			gmacro_sync.add_num + gmacro_sync.update_num + gmacro_sync.remove_num +
+			hmacro_sync.add_num + hmacro_sync.update_num + hmacro_sync.remove_num)
+	{
+		zbx_dbsync_env_full_compare();
+	}
+
 	/* sync host data to support host lookups when resolving macros during configuration sync */
 
 	sec = zbx_time();
@@ -5253,6 +5347,8 @@ void	DCsync_configuration(unsigned char mode)
 	config->sync_ts = time(NULL);
 
 	FINISH_SYNC;
+
+	zbx_dbsync_env_flush_changelog();
 out:
 	zbx_dbsync_clear(&config_sync);
 	zbx_dbsync_clear(&hosts_sync);
@@ -5288,6 +5384,28 @@ out:
 		DCdump_configuration();
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+
+	/* apply the changes made after the loaded configuration cache snapshot was written */
+	if (SUCCEED == zbx_dbsync_env_release_snapshot())
+		DCsync_configuration(ZBX_DBSYNC_UPDATE);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_dc_config_snapshot_write                                     *
+ *                                                                            *
+ * Purpose: writes configuration cache snapshot used to speed up the initial  *
+ *          configuration cache synchronization                               *
+ *                                                                            *
+ * Parameter: path - [IN] the snapshot file path                              *
+ *                                                                            *
+ * Return value: SUCCEED - the snapshot was written                           *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_dc_config_snapshot_write(const char *path)
+{
+	return zbx_dbsync_env_write_snapshot(path);
 }
 
 /******************************************************************************
@@ -6411,6 +6529,122 @@ static void	DCget_item(DC_ITEM *dst_item, const ZBX_DC_ITEM *src_item)
 	}
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: DCget_poll_item                                                  *
+ *                                                                            *
+ * Purpose: copies only the fields async agent and SNMP checks use            *
+ *                                                                            *
+ * Parameters: dst_item - [OUT] the item                                      *
+ *             src_item - [IN] the cached item                                *
+ *             src_host - [IN] the item host                                  *
+ *                                                                            *
+ * Comments: unlike DCget_item()/DCget_host() nothing is allocated and the    *
+ *           host error, IPMI, JMX, inventory and the fields of other item    *
+ *           types are left unset. The result can be freed with               *
+ *           DCconfig_clean_items() as usual.                                 *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCget_poll_item(DC_ITEM *dst_item, const ZBX_DC_ITEM *src_item, const ZBX_DC_HOST *src_host)
+{
+	const ZBX_DC_SNMPITEM	*snmpitem;
+	const ZBX_DC_INTERFACE	*dc_interface;
+	DC_HOST			*dst_host = &dst_item->host;
+
+	dst_host->hostid = src_host->hostid;
+	dst_host->proxy_hostid = src_host->proxy_hostid;
+	strscpy(dst_host->host, src_host->host);
+	zbx_strlcpy_utf8(dst_host->name, src_host->name, sizeof(dst_host->name));
+	dst_host->maintenance_status = src_host->maintenance_status;
+	dst_host->maintenance_type = src_host->maintenance_type;
+	dst_host->maintenance_from = src_host->maintenance_from;
+	dst_host->status = src_host->status;
+	dst_host->tls_connect = src_host->tls_connect;
+	dst_host->tls_accept = src_host->tls_accept;
+
+	dst_item->itemid = src_item->itemid;
+	dst_item->type = src_item->type;
+	dst_item->value_type = src_item->value_type;
+	strscpy(dst_item->key_orig, src_item->key);
+	dst_item->key = NULL;
+	dst_item->delay = NULL;
+	dst_item->nextcheck = src_item->nextcheck;
+	dst_item->state = src_item->state;
+	dst_item->lastclock = src_item->lastclock;
+	dst_item->flags = src_item->flags;
+	dst_item->status = src_item->status;
+	dst_item->units = NULL;
+	dst_item->error = NULL;
+
+	switch (src_item->type)
+	{
+		case ITEM_TYPE_ZABBIX:
+			dst_host->errors_from = src_host->errors_from;
+			dst_host->available = src_host->available;
+			dst_host->disable_until = src_host->disable_until;
+			strscpy(dst_host->error, src_host->error);
+#if defined(HAVE_POLARSSL) || defined(HAVE_GNUTLS) || defined(HAVE_OPENSSL)
+			switch (src_host->tls_connect)
+			{
+				case ZBX_TCP_SEC_TLS_CERT:
+					strscpy(dst_host->tls_issuer, src_host->tls_issuer);
+					strscpy(dst_host->tls_subject, src_host->tls_subject);
+					break;
+				case ZBX_TCP_SEC_TLS_PSK:
+					if (NULL == src_host->tls_dc_psk)
+					{
+						*dst_host->tls_psk_identity = '\0';
+						*dst_host->tls_psk = '\0';
+					}
+					else
+					{
+						strscpy(dst_host->tls_psk_identity, src_host->tls_dc_psk->tls_psk_identity);
+						strscpy(dst_host->tls_psk, src_host->tls_dc_psk->tls_psk);
+					}
+					break;
+			}
+#endif
+			break;
+		case ITEM_TYPE_SNMPv1:
+		case ITEM_TYPE_SNMPv2c:
+		case ITEM_TYPE_SNMPv3:
+			dst_host->snmp_errors_from = src_host->snmp_errors_from;
+			dst_host->snmp_available = src_host->snmp_available;
+			dst_host->snmp_disable_until = src_host->snmp_disable_until;
+			strscpy(dst_host->snmp_error, src_host->snmp_error);
+
+			snmpitem = (ZBX_DC_SNMPITEM *)zbx_hashset_search(&config->snmpitems, &src_item->itemid);
+
+			strscpy(dst_item->snmp_community_orig, snmpitem->snmp_community);
+			strscpy(dst_item->snmp_oid_orig, snmpitem->snmp_oid);
+			dst_item->snmp_community = NULL;
+			dst_item->snmp_oid = NULL;
+
+			if (ITEM_TYPE_SNMPv3 == src_item->type)
+			{
+				strscpy(dst_item->snmpv3_securityname_orig, snmpitem->snmpv3_securityname);
+				dst_item->snmpv3_securitylevel = snmpitem->snmpv3_securitylevel;
+				strscpy(dst_item->snmpv3_authpassphrase_orig, snmpitem->snmpv3_authpassphrase);
+				strscpy(dst_item->snmpv3_privpassphrase_orig, snmpitem->snmpv3_privpassphrase);
+				dst_item->snmpv3_authprotocol = snmpitem->snmpv3_authprotocol;
+				dst_item->snmpv3_privprotocol = snmpitem->snmpv3_privprotocol;
+				strscpy(dst_item->snmpv3_contextname_orig, snmpitem->snmpv3_contextname);
+				dst_item->snmpv3_securityname = NULL;
+				dst_item->snmpv3_authpassphrase = NULL;
+				dst_item->snmpv3_privpassphrase = NULL;
+				dst_item->snmpv3_contextname = NULL;
+			}
+			break;
+	}
+
+	dc_interface = (ZBX_DC_INTERFACE *)zbx_hashset_search(&config->interfaces, &src_item->interfaceid);
+
+	DCget_interface(&dst_item->interface, dc_interface);
+
+	if ('\0' != *src_item->port && SUCCEED == is_snmp_type(src_item->type))
+		strscpy(dst_item->interface.port_orig, src_item->port);
+}
+
 void	DCconfig_clean_items(DC_ITEM *items, int *errcodes, size_t num)
 {
 	size_t	i;
@@ -6460,6 +6694,19 @@ static void	DCget_function(DC_FUNCTION *dst_function, const ZBX_DC_FUNCTION *src
 	memcpy(dst_function->parameter, src_function->parameter, sz_parameter);
 }
 
+static zbx_eval_code_t	*DCget_eval_code(const zbx_eval_code_t *src_code)
+{
+	zbx_eval_code_t	*dst_code;
+
+	if (NULL == src_code)
+		return NULL;
+
+	dst_code = (zbx_eval_code_t *)zbx_malloc(NULL, src_code->size);
+	memcpy(dst_code, src_code, src_code->size);
+
+	return dst_code;
+}
+
 static void	DCget_trigger(DC_TRIGGER *dst_trigger, const ZBX_DC_TRIGGER *src_trigger)
 {
 	int	i;
@@ -6491,6 +6738,21 @@ static void	DCget_trigger(DC_TRIGGER *dst_trigger, const ZBX_DC_TRIGGER *src_tri
 	dst_trigger->expression = zbx_strdup(NULL, src_trigger->expression);
 	dst_trigger->recovery_expression = zbx_strdup(NULL, src_trigger->recovery_expression);
 
+	/* compiled expressions are used only if all required trigger expressions are compiled */
+	if (NULL != src_trigger->expression_code && (NULL != src_trigger->recovery_expression_code ||
+			TRIGGER_RECOVERY_MODE_RECOVERY_EXPRESSION != src_trigger->recovery_mode))
+	{
+		dst_trigger->expression_code = DCget_eval_code(src_trigger->expression_code);
+		dst_trigger->recovery_expression_code = DCget_eval_code(src_trigger->recovery_expression_code);
+	}
+	else
+	{
+		dst_trigger->expression_code = NULL;
+		dst_trigger->recovery_expression_code = NULL;
+	}
+
+	dst_trigger->function_values = NULL;
+
 	zbx_vector_ptr_create(&dst_trigger->tags);
 
 	if (0 != src_trigger->tags.values_num)
@@ -6526,6 +6788,9 @@ static void	DCclean_trigger(DC_TRIGGER *trigger)
 	zbx_free(trigger->recovery_expression_orig);
 	zbx_free(trigger->expression);
 	zbx_free(trigger->recovery_expression);
+	zbx_free(trigger->expression_code);
+	zbx_free(trigger->recovery_expression_code);
+	zbx_free(trigger->function_values);
 	zbx_free(trigger->description);
 	zbx_free(trigger->correlation_tag);
 
@@ -7567,9 +7832,11 @@ static void	dc_requeue_item(ZBX_DC_ITEM *dc_item, const ZBX_DC_HOST *dc_host, un
  * Parameters: dc_item   - [IN] the item to reque                             *
  *             dc_host   - [IN] item's host                                   *
  *             nextcheck - [IN] the scheduled time                            *
+ *             flags     - [IN] the poller type update flags, see             *
+ *                              DCitem_poller_type_update()                   *
  *                                                                            *
  ******************************************************************************/
-static void	dc_requeue_item_at(ZBX_DC_ITEM *dc_item, ZBX_DC_HOST *dc_host, int nextcheck)
+static void	dc_requeue_item_at(ZBX_DC_ITEM *dc_item, ZBX_DC_HOST *dc_host, int nextcheck, int flags)
 {
 	unsigned char	old_poller_type;
 	int		old_nextcheck;
@@ -7580,7 +7847,7 @@ static void	dc_requeue_item_at(ZBX_DC_ITEM *dc_item, ZBX_DC_HOST *dc_host, int n
 	dc_item->nextcheck = nextcheck;
 
 	old_poller_type = dc_item->poller_type;
-	DCitem_poller_type_update(dc_item, dc_host, ZBX_ITEM_COLLECTED);
+	DCitem_poller_type_update(dc_item, dc_host, flags);
 
 	DCupdate_item_queue(dc_item, old_poller_type, old_nextcheck);
 }
@@ -7612,16 +7879,7 @@ static void	dc_requeue_item_at(ZBX_DC_ITEM *dc_item, ZBX_DC_HOST *dc_host, int n
  ******************************************************************************/
 int	DCconfig_get_poller_items(unsigned char poller_type, DC_ITEM *items)
 {
-	const char		*__function_name = "DCconfig_get_poller_items";
-
-	int			now, num = 0, max_items;
-	zbx_binary_heap_t	*queue;
-
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s() poller_type:%d", __function_name, (int)poller_type);
-
-	now = time(NULL);
-
-	queue = &config->queues[poller_type];
+	int	max_items;
 
 	switch (poller_type)
 	{
@@ -7647,6 +7905,113 @@ int	DCconfig_get_poller_items(unsigned char poller_type, DC_ITEM *items)
 			max_items = 1;
 	}
 
+	return zbx_dc_get_poller_items(poller_type, items, max_items);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dc_get_poll_items                                                *
+ *                                                                            *
+ * Purpose: copies the items taken from an async poller queue                 *
+ *                                                                            *
+ * Parameters: items - [IN/OUT] the items with only itemid set on input       *
+ *             num   - [IN] the number of items                               *
+ *                                                                            *
+ * Return value: number of items copied                                       *
+ *                                                                            *
+ * Comments: the items removed by configuration sync since they were taken    *
+ *           from the queue are dropped, the rest are moved to the front of   *
+ *           the array. The dropped items that are still in the cache are     *
+ *           marked as not taken by poller, because they are never requeued.  *
+ *                                                                            *
+ ******************************************************************************/
+static int	dc_get_poll_items(DC_ITEM *items, int num)
+{
+	int			i, copied = 0;
+	const ZBX_DC_ITEM	*dc_item;
+	const ZBX_DC_HOST	*dc_host;
+	ZBX_DC_ITEM		*dropped_item;
+	zbx_vector_uint64_t	dropped_itemids;
+
+	zbx_vector_uint64_create(&dropped_itemids);
+
+	RDLOCK_CACHE;
+
+	for (i = 0; i < num; i++)
+	{
+		if (NULL == (dc_item = (ZBX_DC_ITEM *)zbx_hashset_search(&config->items, &items[i].itemid)))
+			continue;
+
+		if (NULL == (dc_host = (ZBX_DC_HOST *)zbx_hashset_search(&config->hosts, &dc_item->hostid)))
+		{
+			zbx_vector_uint64_append(&dropped_itemids, dc_item->itemid);
+			continue;
+		}
+
+		DCget_poll_item(&items[copied++], dc_item, dc_host);
+	}
+
+	UNLOCK_CACHE;
+
+	if (0 != dropped_itemids.values_num)
+	{
+		WRLOCK_CACHE;
+
+		for (i = 0; i < dropped_itemids.values_num; i++)
+		{
+			if (NULL == (dropped_item = (ZBX_DC_ITEM *)zbx_hashset_search(&config->items,
+					&dropped_itemids.values[i])))
+			{
+				continue;
+			}
+
+			if (ZBX_LOC_POLLER == dropped_item->location)
+				dropped_item->location = ZBX_LOC_NOWHERE;
+		}
+
+		UNLOCK_CACHE;
+	}
+
+	zbx_vector_uint64_destroy(&dropped_itemids);
+
+	return copied;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_dc_get_poller_items                                          *
+ *                                                                            *
+ * Purpose: Get array of due items for selected poller                        *
+ *                                                                            *
+ * Parameters: poller_type - [IN] poller type (ZBX_POLLER_TYPE_...)           *
+ *             items       - [OUT] array of items                             *
+ *             max_items   - [IN] the maximum number of items to get          *
+ *                                                                            *
+ * Return value: number of items in items array                               *
+ *                                                                            *
+ * Comments: async pollers use it to top up their in-flight window with as    *
+ *           many items as it has free slots. For them the write lock is held *
+ *           only to take the items from the queue, the fields the async      *
+ *           checks need are copied under the read lock by                    *
+ *           dc_get_poll_items(). See DCconfig_get_poller_items() for the     *
+ *           rest.                                                            *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_dc_get_poller_items(unsigned char poller_type, DC_ITEM *items, int max_items)
+{
+	const char		*__function_name = "zbx_dc_get_poller_items";
+
+	int			now, num = 0, async;
+	zbx_binary_heap_t	*queue;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() poller_type:%d max_items:%d", __function_name, (int)poller_type,
+			max_items);
+
+	now = time(NULL);
+
+	queue = &config->queues[poller_type];
+	async = (ZBX_POLLER_TYPE_ASYNC_AGENT == poller_type || ZBX_POLLER_TYPE_ASYNC_SNMP == poller_type);
+
 	WRLOCK_CACHE;
 
 	while (num < max_items && FAIL == zbx_binary_heap_empty(queue))
@@ -7727,6 +8092,14 @@ int	DCconfig_get_poller_items(unsigned char poller_type, DC_ITEM *items)
 
 		dc_item_prev = dc_item;
 		dc_item->location = ZBX_LOC_POLLER;
+
+		/* async pollers copy the items after the write lock is released */
+		if (0 != async)
+		{
+			items[num++].itemid = dc_item->itemid;
+			continue;
+		}
+
 		DCget_host(&items[num].host, dc_host);
 		DCget_item(&items[num], dc_item);
 		num++;
@@ -7749,6 +8122,9 @@ int	DCconfig_get_poller_items(unsigned char poller_type, DC_ITEM *items)
 	}
 	UNLOCK_CACHE;
 
+	if (0 != async && 0 != num)
+		num = dc_get_poll_items(items, num);
+
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%d", __function_name, num);
 
 	return num;
@@ -8122,6 +8498,54 @@ void	zbx_dc_requeue_unreachable_items(zbx_uint64_t *itemids, size_t itemids_num)
 	UNLOCK_CACHE;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_dc_requeue_deferred_items                                    *
+ *                                                                            *
+ * Purpose: returns items to the queue without polling them, to be taken     *
+ *          again at the specified time                                       *
+ *                                                                            *
+ * Parameters: itemids     - [IN] the item id array                           *
+ *             itemids_num - [IN] the number of values in itemids array       *
+ *             nextcheck   - [IN] the time the items are due again            *
+ *                                                                            *
+ * Comments: Used by async and unreachable pollers for the items the host     *
+ *           name of which is still being resolved. The item state and the    *
+ *           host availability are not changed.                               *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_dc_requeue_deferred_items(const zbx_uint64_t *itemids, size_t itemids_num, int nextcheck)
+{
+	size_t		i;
+	ZBX_DC_ITEM	*dc_item;
+	ZBX_DC_HOST	*dc_host;
+
+	WRLOCK_CACHE;
+
+	for (i = 0; i < itemids_num; i++)
+	{
+		if (NULL == (dc_item = (ZBX_DC_ITEM *)zbx_hashset_search(&config->items, &itemids[i])))
+			continue;
+
+		if (ZBX_LOC_POLLER == dc_item->location)
+			dc_item->location = ZBX_LOC_NOWHERE;
+
+		if (ITEM_STATUS_ACTIVE != dc_item->status)
+			continue;
+
+		if (NULL == (dc_host = (ZBX_DC_HOST *)zbx_hashset_search(&config->hosts, &dc_item->hostid)))
+			continue;
+
+		if (HOST_STATUS_MONITORED != dc_host->status)
+			continue;
+
+		/* the items of unreachable hosts stay with the unreachable poller */
+		dc_requeue_item_at(dc_item, dc_host, nextcheck, 0);
+	}
+
+	UNLOCK_CACHE;
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: DChost_get_agent_availability                                    *
@@ -11665,7 +12089,7 @@ void	zbx_dc_reschedule_items(const zbx_vector_uint64_t *itemids, int nextcheck,
 			proxy_hostid = 0;
 		}
 		else if (0 == (proxy_hostid = dc_host->proxy_hostid))
-			dc_requeue_item_at(dc_item, dc_host, nextcheck);
+			dc_requeue_item_at(dc_item, dc_host, nextcheck, ZBX_ITEM_COLLECTED);
 
 		if (NULL != proxy_hostids)
 			proxy_hostids[i] = proxy_hostid;
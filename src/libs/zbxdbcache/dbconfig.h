@@ -48,6 +48,10 @@ typedef struct
 	unsigned char		timer;			/* see ZBX_TRIGGER_TIMER_* defines       */
 
 	zbx_vector_ptr_t	tags;
+
+	/* compiled expressions, NULL if the expression cannot be compiled */
+	zbx_eval_code_t		*expression_code;
+	zbx_eval_code_t		*recovery_expression_code;
 }
 ZBX_DC_TRIGGER;
 
@@ -27,15 +27,80 @@
 #include "dbconfig.h"
 #include "dbsync.h"
 
+/* the configuration objects tracked by changelog table, must match the changelog triggers in database schema */
+#define ZBX_DBSYNC_OBJ_ITEM		1
+#define ZBX_DBSYNC_OBJ_ITEM_PREPROC	2
+#define ZBX_DBSYNC_OBJ_FUNCTION		3
+#define ZBX_DBSYNC_OBJ_TRIGGER		4
+#define ZBX_DBSYNC_OBJ_COUNT		4
+
+/* the changelog table availability */
+#define ZBX_DBSYNC_CHANGELOG_UNKNOWN	0
+#define ZBX_DBSYNC_CHANGELOG_MISSING	1
+#define ZBX_DBSYNC_CHANGELOG_AVAILABLE	2
+
+/* the processed changelog records are removed when they get older than this (seconds) */
+#define ZBX_DBSYNC_CHANGELOG_MAX_AGE	600
+
+/* the records not included in configuration cache snapshot are kept at most this long (seconds), */
+/* after that the snapshot is removed, because it cannot be loaded without them                    */
+#define ZBX_DBSYNC_CHANGELOG_SNAPSHOT_MAX_AGE	(ZBX_DBSYNC_CHANGELOG_MAX_AGE * 6)
+
+/* the changelog record removal batch size */
+#define ZBX_DBSYNC_CHANGELOG_BATCH_SIZE	1000
+
+extern char	*CONFIG_CONFCACHE_SNAPSHOT_FILE;
+
 typedef struct
 {
-	zbx_hashset_t	strpool;
-	ZBX_DC_CONFIG	*cache;
+	zbx_hashset_t		strpool;
+	ZBX_DC_CONFIG		*cache;
+
+	/* SUCCEED - items, item preprocessing, functions and triggers are compared only for */
+	/*           the objects referenced by changelog and for the objects of changed hosts */
+	/* FAIL    - the whole tables are compared                                            */
+	int			changelog_sync;
+
+	/* the changelog records read during this synchronization, (changelogid, clock) pairs */
+	zbx_vector_uint64_pair_t	changelog;
+
+	/* the identifiers of changelog objects, indexed by ZBX_DBSYNC_OBJ_* - 1 */
+	zbx_vector_uint64_t	changed_ids[ZBX_DBSYNC_OBJ_COUNT];
+
+	/* the added, updated and removed hosts */
+	zbx_vector_uint64_t	hostids;
+
+	/* the items that might have been changed, used to find affected functions and preprocessing */
+	zbx_vector_uint64_t	itemids;
+
+	/* the triggers that might have been changed, collected during function comparison */
+	zbx_vector_uint64_t	triggerids;
 }
 zbx_dbsync_env_t;
 
 static zbx_dbsync_env_t	dbsync_env;
 
+/* the changelog records already applied to configuration cache, kept until removed from database */
+static zbx_hashset_t	dbsync_changelog;
+static int		dbsync_changelog_state = ZBX_DBSYNC_CHANGELOG_UNKNOWN;
+static int		dbsync_changelog_prune_time = 0;
+
+/* the tracked tables must be compared fully, because the last synchronization has failed or */
+/* not all rows could be loaded from configuration cache snapshot                            */
+static unsigned char	dbsync_full_compare = 1;
+
+/* the configuration cache snapshot used by the initial synchronization */
+static zbx_dbsync_snapshot_t	*dbsync_snapshot = NULL;
+
+/* the changelog records included in the last written or loaded snapshot, sorted */
+static zbx_vector_uint64_t	dbsync_snapshot_changelog;
+
+/* the snapshot file was removed because of too old changelog records, until the next snapshot is written */
+static unsigned char		dbsync_snapshot_removed = 0;
+
+/* the objects missing from the loaded snapshot, indexed by ZBX_DBSYNC_OBJ_* - 1 */
+static zbx_vector_uint64_t	dbsync_snapshot_ids[ZBX_DBSYNC_OBJ_COUNT];
+
 /* string pool support */
 
 #define REFCOUNT_FIELD_SIZE	sizeof(zbx_uint32_t)
@@ -244,69 +309,813 @@ static void	dbsync_prepare(zbx_dbsync_t *sync, int columns_num, zbx_dbsync_prepr
  *           doing more precise (and resource intense) checks.                *
  *                                                                            *
  ******************************************************************************/
-static int	dbsync_check_row_macros(char **row, int column)
+static int	dbsync_check_row_macros(char **row, int column)
+{
+	if (NULL != strstr(row[column], "{$"))
+		return SUCCEED;
+
+	return FAIL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_preproc_row                                               *
+ *                                                                            *
+ * Purpose: applies necessary pre-processing before row is compared/used      *
+ *                                                                            *
+ * Parameter: sync - [IN] the changeset                                       *
+ *            row  - [IN/OUT] the data row                                    *
+ *                                                                            *
+ * Return value: the resulting row                                            *
+ *                                                                            *
+ ******************************************************************************/
+static char	**dbsync_preproc_row(zbx_dbsync_t *sync, char **row)
+{
+	int	i;
+
+	if (NULL == sync->preproc_row_func)
+		return row;
+
+	/* free the resources allocated by last preprocessing call */
+	zbx_vector_ptr_clear_ext(&sync->columns, zbx_ptr_free);
+
+	/* copy the original data */
+	memcpy(sync->row, row, sizeof(char *) * sync->columns_num);
+
+	sync->row = sync->preproc_row_func(sync->row);
+
+	for (i = 0; i < sync->columns_num; i++)
+	{
+		if (sync->row[i] != row[i])
+			zbx_vector_ptr_append(&sync->columns, sync->row[i]);
+	}
+
+	return sync->row;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_dbsync_init_env                                              *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_dbsync_init_env(ZBX_DC_CONFIG *cache)
+{
+	int	i;
+
+	dbsync_env.cache = cache;
+	zbx_hashset_create(&dbsync_env.strpool, 100, dbsync_strpool_hash_func, dbsync_strpool_compare_func);
+
+	dbsync_env.changelog_sync = FAIL;
+	zbx_vector_uint64_pair_create(&dbsync_env.changelog);
+
+	for (i = 0; i < ZBX_DBSYNC_OBJ_COUNT; i++)
+		zbx_vector_uint64_create(&dbsync_env.changed_ids[i]);
+
+	zbx_vector_uint64_create(&dbsync_env.hostids);
+	zbx_vector_uint64_create(&dbsync_env.itemids);
+	zbx_vector_uint64_create(&dbsync_env.triggerids);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_env_release                                               *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_dbsync_free_env(void)
+{
+	int	i;
+
+	zbx_vector_uint64_destroy(&dbsync_env.triggerids);
+	zbx_vector_uint64_destroy(&dbsync_env.itemids);
+	zbx_vector_uint64_destroy(&dbsync_env.hostids);
+
+	for (i = 0; i < ZBX_DBSYNC_OBJ_COUNT; i++)
+		zbx_vector_uint64_destroy(&dbsync_env.changed_ids[i]);
+
+	zbx_vector_uint64_pair_destroy(&dbsync_env.changelog);
+
+	zbx_hashset_destroy(&dbsync_env.strpool);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_snapshot_check_changelog                                  *
+ *                                                                            *
+ * Purpose: checks if changelog still has all changes made after the          *
+ *          configuration cache snapshot was written                          *
+ *                                                                            *
+ * Parameter: snapshot - [IN] the loaded snapshot                             *
+ *                                                                            *
+ * Return value: SUCCEED - the changes can be applied from changelog          *
+ *               FAIL    - some changes could have been removed from          *
+ *                         changelog or database query failed                 *
+ *                                                                            *
+ * Comments: The newest changelog record included in snapshot is not removed  *
+ *           while the snapshot is used, see dbsync_prune_changelog(). Other  *
+ *           servers (or this server without snapshot configured) remove the  *
+ *           old records in creation order, so if that record is still        *
+ *           present, all newer records are present too.                      *
+ *           If changelog was empty when the snapshot was written, the newer  *
+ *           records cannot be removed only until they get old enough.        *
+ *                                                                            *
+ ******************************************************************************/
+static int	dbsync_snapshot_check_changelog(const zbx_dbsync_snapshot_t *snapshot)
+{
+	DB_RESULT	result;
+	zbx_uint64_t	changelogid;
+	int		timestamp, ret = FAIL;
+
+	zbx_dbsync_snapshot_get_newest(snapshot, &changelogid, &timestamp);
+
+	if (0 == changelogid)
+		return ZBX_DBSYNC_CHANGELOG_MAX_AGE >= time(NULL) - timestamp ? SUCCEED : FAIL;
+
+	if (NULL == (result = DBselect("select changelogid from changelog where changelogid=" ZBX_FS_UI64,
+			changelogid)))
+	{
+		return FAIL;
+	}
+
+	if (NULL != DBfetch(result))
+		ret = SUCCEED;
+
+	DBfree_result(result);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_dbsync_env_prepare                                           *
+ *                                                                            *
+ * Purpose: reads the new changelog records and decides if the tracked        *
+ *          tables can be synchronized incrementally                          *
+ *                                                                            *
+ * Parameter: mode - [IN] the synchronization mode (see ZBX_DBSYNC_* defines) *
+ *                                                                            *
+ * Return value: SUCCEED - the changelog was read successfully or it is not   *
+ *                         available                                          *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ * Comments: The changelog must be read before any of the tracked tables so   *
+ *           that changes committed in between are either picked up by this   *
+ *           or by the next synchronization.                                  *
+ *           In initial synchronization mode the records are read only to be  *
+ *           marked as processed, the tables are always loaded fully.         *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_dbsync_env_prepare(unsigned char mode)
+{
+	const char		*__function_name = "zbx_dbsync_env_prepare";
+
+	DB_RESULT		result;
+	DB_ROW			row;
+	zbx_uint64_t		changelogid, objectid;
+	zbx_uint64_pair_t	pair;
+	int			object, i;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() mode:%d", __function_name, (int)mode);
+
+	if (ZBX_DBSYNC_CHANGELOG_UNKNOWN == dbsync_changelog_state)
+	{
+		if (SUCCEED == DBtable_exists("changelog"))
+		{
+			zbx_hashset_create(&dbsync_changelog, 1000, ZBX_DEFAULT_UINT64_HASH_FUNC,
+					ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+			zbx_vector_uint64_create(&dbsync_snapshot_changelog);
+
+			for (i = 0; i < ZBX_DBSYNC_OBJ_COUNT; i++)
+				zbx_vector_uint64_create(&dbsync_snapshot_ids[i]);
+
+			dbsync_changelog_state = ZBX_DBSYNC_CHANGELOG_AVAILABLE;
+		}
+		else
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "changelog table is not found, configuration cache will be"
+					" synchronized by comparing the whole item and trigger tables");
+			dbsync_changelog_state = ZBX_DBSYNC_CHANGELOG_MISSING;
+		}
+	}
+
+	if (ZBX_DBSYNC_CHANGELOG_AVAILABLE != dbsync_changelog_state)
+		goto out;
+
+	if (ZBX_DBSYNC_INIT == mode && NULL != CONFIG_CONFCACHE_SNAPSHOT_FILE &&
+			SUCCEED == zbx_dbsync_snapshot_load(&dbsync_snapshot, CONFIG_CONFCACHE_SNAPSHOT_FILE))
+	{
+		if (SUCCEED == dbsync_snapshot_check_changelog(dbsync_snapshot))
+		{
+			zbx_vector_uint64_clear(&dbsync_snapshot_changelog);
+			zbx_dbsync_snapshot_get_changelog(dbsync_snapshot, &dbsync_snapshot_changelog);
+		}
+		else
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot use configuration cache snapshot file \"%s\": changelog"
+					" does not have all changes made after it was written",
+					CONFIG_CONFCACHE_SNAPSHOT_FILE);
+
+			zbx_dbsync_snapshot_free(dbsync_snapshot);
+			dbsync_snapshot = NULL;
+		}
+	}
+
+	if (NULL == (result = DBselect("select changelogid,object,objectid,clock from changelog")))
+	{
+		zabbix_log(LOG_LEVEL_DEBUG, "End of %s():FAIL", __function_name);
+		return FAIL;
+	}
+
+	while (NULL != (row = DBfetch(result)))
+	{
+		ZBX_STR2UINT64(changelogid, row[0]);
+
+		if (NULL != zbx_hashset_search(&dbsync_changelog, &changelogid))
+			continue;
+
+		/* the changes not included in snapshot are applied by the next synchronization */
+		if (NULL != dbsync_snapshot && FAIL == zbx_vector_uint64_bsearch(&dbsync_snapshot_changelog,
+				changelogid, ZBX_DEFAULT_UINT64_COMPARE_FUNC))
+		{
+			continue;
+		}
+
+		pair.first = changelogid;
+		pair.second = (zbx_uint64_t)atoi(row[3]);
+		zbx_vector_uint64_pair_append(&dbsync_env.changelog, pair);
+
+		object = atoi(row[1]);
+
+		if (ZBX_DBSYNC_OBJ_ITEM > object || ZBX_DBSYNC_OBJ_COUNT < object)
+			continue;
+
+		ZBX_STR2UINT64(objectid, row[2]);
+		zbx_vector_uint64_append(&dbsync_env.changed_ids[object - 1], objectid);
+	}
+	DBfree_result(result);
+
+	for (i = 0; i < ZBX_DBSYNC_OBJ_COUNT; i++)
+	{
+		/* the objects added after the loaded snapshot was written */
+		zbx_vector_uint64_append_array(&dbsync_env.changed_ids[i], dbsync_snapshot_ids[i].values,
+				dbsync_snapshot_ids[i].values_num);
+
+		zbx_vector_uint64_sort(&dbsync_env.changed_ids[i], ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+		zbx_vector_uint64_uniq(&dbsync_env.changed_ids[i], ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+	}
+
+	if (ZBX_DBSYNC_UPDATE == mode && 0 == dbsync_full_compare)
+		dbsync_env.changelog_sync = SUCCEED;
+out:
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() records:%d incremental:%s", __function_name,
+			dbsync_env.changelog.values_num, zbx_result_string(dbsync_env.changelog_sync));
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_dbsync_env_full_compare                                      *
+ *                                                                            *
+ * Purpose: forces the tracked tables to be compared fully during this        *
+ *          synchronization                                                   *
+ *                                                                            *
+ * Comments: Used when the changes not tracked by changelog (user macros,     *
+ *           templates, housekeeping settings) might affect any item or       *
+ *           trigger.                                                         *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_dbsync_env_full_compare(void)
+{
+	dbsync_env.changelog_sync = FAIL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_prune_changelog                                           *
+ *                                                                            *
+ * Purpose: removes old processed records from changelog table                *
+ *                                                                            *
+ * Comments: Only the records already applied to configuration cache are      *
+ *           removed, so records committed by long transactions are kept      *
+ *           until they are processed. The records not included in snapshot   *
+ *           are kept for loading it, but if snapshot writing keeps failing   *
+ *           they are removed anyway together with the outdated snapshot.     *
+ *           The newest processed record and the newest record included in   *
+ *           snapshot are always kept, so a snapshot loaded later can check   *
+ *           if the changes made after it was written are still in changelog. *
+ *                                                                            *
+ ******************************************************************************/
+static void	dbsync_prune_changelog(int now)
+{
+	const char		*__function_name = "dbsync_prune_changelog";
+
+	zbx_hashset_iter_t	iter;
+	zbx_uint64_pair_t	*pair;
+	zbx_vector_uint64_t	changelogids;
+	zbx_uint64_t		newestid = 0, snapshotid = 0;
+	char			*sql = NULL;
+	size_t			sql_alloc = 0, sql_offset;
+	int			i, j, batch_num, removed_num = 0, snapshot_expired = 0;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+
+	zbx_vector_uint64_create(&changelogids);
+
+	zbx_hashset_iter_reset(&dbsync_changelog, &iter);
+	while (NULL != (pair = (zbx_uint64_pair_t *)zbx_hashset_iter_next(&iter)))
+	{
+		if (newestid < pair->first)
+			newestid = pair->first;
+	}
+
+	if (NULL != CONFIG_CONFCACHE_SNAPSHOT_FILE && 0 == dbsync_snapshot_removed &&
+			0 != dbsync_snapshot_changelog.values_num)
+	{
+		snapshotid = dbsync_snapshot_changelog.values[dbsync_snapshot_changelog.values_num - 1];
+	}
+
+	zbx_hashset_iter_reset(&dbsync_changelog, &iter);
+	while (NULL != (pair = (zbx_uint64_pair_t *)zbx_hashset_iter_next(&iter)))
+	{
+		if (newestid == pair->first || snapshotid == pair->first)
+			continue;
+
+		if ((zbx_uint64_t)(now - ZBX_DBSYNC_CHANGELOG_MAX_AGE) > pair->second)
+		{
+			/* the changes not included in snapshot must be kept for loading it after restart */
+			if (NULL != CONFIG_CONFCACHE_SNAPSHOT_FILE && 0 == dbsync_snapshot_removed &&
+					FAIL == zbx_vector_uint64_bsearch(&dbsync_snapshot_changelog, pair->first,
+					ZBX_DEFAULT_UINT64_COMPARE_FUNC))
+			{
+				if ((zbx_uint64_t)(now - ZBX_DBSYNC_CHANGELOG_SNAPSHOT_MAX_AGE) <= pair->second)
+					continue;
+
+				snapshot_expired = 1;
+			}
+
+			zbx_vector_uint64_append(&changelogids, pair->first);
+		}
+	}
+
+	/* the snapshot must not be loaded without the removed records, the next start loads the database */
+	if (0 != snapshot_expired)
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "configuration cache snapshot was not written for more than %d seconds,"
+				" removing snapshot file \"%s\"", ZBX_DBSYNC_CHANGELOG_SNAPSHOT_MAX_AGE,
+				CONFIG_CONFCACHE_SNAPSHOT_FILE);
+
+		if (0 != unlink(CONFIG_CONFCACHE_SNAPSHOT_FILE) && ENOENT != errno)
+		{
+			/* the records are kept while the snapshot exists, the removal is retried with next pruning */
+			zabbix_log(LOG_LEVEL_WARNING, "cannot remove configuration cache snapshot file \"%s\": %s",
+					CONFIG_CONFCACHE_SNAPSHOT_FILE, zbx_strerror(errno));
+			zbx_vector_uint64_clear(&changelogids);
+		}
+		else
+		{
+			zbx_vector_uint64_clear(&dbsync_snapshot_changelog);
+			dbsync_snapshot_removed = 1;
+		}
+	}
+
+	zbx_vector_uint64_sort(&changelogids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+	for (i = 0; i < changelogids.values_num; i += batch_num)
+	{
+		batch_num = MIN(changelogids.values_num - i, ZBX_DBSYNC_CHANGELOG_BATCH_SIZE);
+
+		sql_offset = 0;
+		zbx_strcpy_alloc(&sql, &sql_alloc, &sql_offset, "delete from changelog where");
+		DBadd_condition_alloc(&sql, &sql_alloc, &sql_offset, "changelogid", changelogids.values + i,
+				batch_num);
+
+		/* keep the records in processed list if they were not removed, so the removal can be retried */
+		if (ZBX_DB_OK > DBexecute("%s", sql))
+			break;
+
+		for (j = i; j < i + batch_num; j++)
+			zbx_hashset_remove(&dbsync_changelog, &changelogids.values[j]);
+
+		removed_num += batch_num;
+	}
+
+	zbx_free(sql);
+	zbx_vector_uint64_destroy(&changelogids);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() removed:%d", __function_name, removed_num);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_dbsync_env_flush_changelog                                   *
+ *                                                                            *
+ * Purpose: marks the changelog records read by this synchronization as       *
+ *          processed and removes old processed records                       *
+ *                                                                            *
+ * Comments: Must be called only after the configuration cache has been       *
+ *           successfully updated.                                            *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_dbsync_env_flush_changelog(void)
+{
+	int	i, now;
+
+	if (ZBX_DBSYNC_CHANGELOG_AVAILABLE != dbsync_changelog_state)
+		return;
+
+	dbsync_full_compare = 0;
+
+	for (i = 0; i < ZBX_DBSYNC_OBJ_COUNT; i++)
+		zbx_vector_uint64_clear(&dbsync_snapshot_ids[i]);
+
+	for (i = 0; i < dbsync_env.changelog.values_num; i++)
+	{
+		zbx_hashset_insert(&dbsync_changelog, &dbsync_env.changelog.values[i],
+				sizeof(dbsync_env.changelog.values[i]));
+	}
+
+	now = (int)time(NULL);
+
+	if (ZBX_DBSYNC_CHANGELOG_MAX_AGE / 10 <= now - dbsync_changelog_prune_time)
+	{
+		dbsync_prune_changelog(now);
+		dbsync_changelog_prune_time = now;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_is_changed_id                                             *
+ *                                                                            *
+ * Purpose: checks if the identifier is in sorted list of changed objects     *
+ *                                                                            *
+ ******************************************************************************/
+static int	dbsync_is_changed_id(const zbx_vector_uint64_t *ids, zbx_uint64_t id)
+{
+	if (0 == ids->values_num)
+		return FAIL;
+
+	return FAIL == zbx_vector_uint64_bsearch(ids, id, ZBX_DEFAULT_UINT64_COMPARE_FUNC) ? FAIL : SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_add_changed_condition                                     *
+ *                                                                            *
+ * Purpose: appends changed object condition to the sql filter, the           *
+ *          conditions are joined with 'or' in a single 'and (...)' block     *
+ *                                                                            *
+ * Parameter: sql        - [IN/OUT] the sql query                             *
+ *            sql_alloc  - [IN/OUT] the sql query buffer size                 *
+ *            sql_offset - [IN/OUT] the sql query length                      *
+ *            cond_num   - [IN/OUT] the number of conditions added            *
+ *            fieldname  - [IN] the field name                                *
+ *            ids        - [IN] the sorted object identifiers                 *
+ *                                                                            *
+ ******************************************************************************/
+static void	dbsync_add_changed_condition(char **sql, size_t *sql_alloc, size_t *sql_offset, int *cond_num,
+		const char *fieldname, const zbx_vector_uint64_t *ids)
+{
+	if (0 == ids->values_num)
+		return;
+
+	zbx_strcpy_alloc(sql, sql_alloc, sql_offset, 0 == (*cond_num)++ ? " and (" : " or");
+	DBadd_condition_alloc(sql, sql_alloc, sql_offset, fieldname, ids->values, ids->values_num);
+}
+
+#define ZBX_DBSYNC_ITEM_COLUMNS										\
+		"i.itemid,i.hostid,i.status,i.type,i.value_type,i.key_,"				\
+		"i.snmp_community,i.snmp_oid,i.port,i.snmpv3_securityname,i.snmpv3_securitylevel,"	\
+		"i.snmpv3_authpassphrase,i.snmpv3_privpassphrase,i.ipmi_sensor,i.delay,"		\
+		"i.trapper_hosts,i.logtimefmt,i.params,i.state,i.authtype,i.username,i.password,"	\
+		"i.publickey,i.privatekey,i.flags,i.interfaceid,i.snmpv3_authprotocol,"			\
+		"i.snmpv3_privprotocol,i.snmpv3_contextname,i.lastlogsize,i.mtime,"			\
+		"i.history,i.trends,i.inventory_link,i.valuemapid,i.units,i.error,i.jmx_endpoint,"	\
+		"i.master_itemid,i.timeout,i.url,i.query_fields,i.posts,i.status_codes,"		\
+		"i.follow_redirects,i.post_type,i.http_proxy,i.headers,i.retrieve_mode,"		\
+		"i.request_method,i.output_format,i.ssl_cert_file,i.ssl_key_file,i.ssl_key_password,"	\
+		"i.verify_peer,i.verify_host,i.allow_traps"
+
+#define ZBX_DBSYNC_TRIGGER_COLUMNS									\
+		"t.triggerid,t.description,t.expression,t.error,t.priority,t.type,t.value,"		\
+		"t.state,t.lastchange,t.status,t.recovery_mode,t.recovery_expression,"			\
+		"t.correlation_mode,t.correlation_tag"
+
+#define ZBX_DBSYNC_FUNCTION_COLUMNS	"i.itemid,f.functionid,f.name,f.parameter,t.triggerid"
+
+#define ZBX_DBSYNC_ITEM_PREPROC_COLUMNS	"pp.item_preprocid,pp.itemid,pp.type,pp.params,pp.step,i.hostid"
+
+/* the object ids followed by runtime columns, which are not tracked by changelog */
+#define ZBX_DBSYNC_ITEM_REFRESH_COLUMNS		"i.itemid,i.state,i.lastlogsize,i.mtime,i.error"
+#define ZBX_DBSYNC_TRIGGER_REFRESH_COLUMNS	"t.triggerid,t.error,t.value,t.state,t.lastchange"
+#define ZBX_DBSYNC_FUNCTION_REFRESH_COLUMNS	"f.functionid"
+#define ZBX_DBSYNC_ITEM_PREPROC_REFRESH_COLUMNS	"pp.item_preprocid"
+
+/* the indexes of runtime columns in item and trigger rows */
+static const int	dbsync_item_refresh_index[] = {18, 29, 30, 36};
+static const int	dbsync_trigger_refresh_index[] = {3, 6, 7, 8};
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_item_sql                                                  *
+ *                                                                            *
+ * Purpose: builds the query of items cached in configuration cache           *
+ *                                                                            *
+ * Parameter: sql        - [IN/OUT] the sql query                             *
+ *            sql_alloc  - [IN/OUT] the sql query buffer size                 *
+ *            sql_offset - [IN/OUT] the sql query length                      *
+ *            columns    - [IN] the selected columns                          *
+ *                                                                            *
+ ******************************************************************************/
+static void	dbsync_item_sql(char **sql, size_t *sql_alloc, size_t *sql_offset, const char *columns)
+{
+	zbx_snprintf_alloc(sql, sql_alloc, sql_offset,
+			"select %s"
+			" from items i,hosts h"
+			" where i.hostid=h.hostid"
+				" and h.status in (%d,%d)"
+				" and i.flags<>%d",
+			columns, HOST_STATUS_MONITORED, HOST_STATUS_NOT_MONITORED,
+			ZBX_FLAG_DISCOVERY_PROTOTYPE);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_trigger_sql                                               *
+ *                                                                            *
+ * Purpose: builds the query of triggers cached in configuration cache        *
+ *                                                                            *
+ * Parameter: sql        - [IN/OUT] the sql query                             *
+ *            sql_alloc  - [IN/OUT] the sql query buffer size                 *
+ *            sql_offset - [IN/OUT] the sql query length                      *
+ *            columns    - [IN] the selected columns                          *
+ *                                                                            *
+ ******************************************************************************/
+static void	dbsync_trigger_sql(char **sql, size_t *sql_alloc, size_t *sql_offset, const char *columns)
+{
+	zbx_snprintf_alloc(sql, sql_alloc, sql_offset,
+			"select distinct %s"
+			" from hosts h,items i,functions f,triggers t"
+			" where h.hostid=i.hostid"
+				" and i.itemid=f.itemid"
+				" and f.triggerid=t.triggerid"
+				" and h.status in (%d,%d)"
+				" and t.flags<>%d",
+			columns, HOST_STATUS_MONITORED, HOST_STATUS_NOT_MONITORED,
+			ZBX_FLAG_DISCOVERY_PROTOTYPE);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_function_sql                                              *
+ *                                                                            *
+ * Purpose: builds the query of functions cached in configuration cache       *
+ *                                                                            *
+ * Parameter: sql        - [IN/OUT] the sql query                             *
+ *            sql_alloc  - [IN/OUT] the sql query buffer size                 *
+ *            sql_offset - [IN/OUT] the sql query length                      *
+ *            columns    - [IN] the selected columns                          *
+ *                                                                            *
+ ******************************************************************************/
+static void	dbsync_function_sql(char **sql, size_t *sql_alloc, size_t *sql_offset, const char *columns)
+{
+	zbx_snprintf_alloc(sql, sql_alloc, sql_offset,
+			"select %s"
+			" from hosts h,items i,functions f,triggers t"
+			" where h.hostid=i.hostid"
+				" and i.itemid=f.itemid"
+				" and f.triggerid=t.triggerid"
+				" and h.status in (%d,%d)"
+				" and t.flags<>%d",
+			columns, HOST_STATUS_MONITORED, HOST_STATUS_NOT_MONITORED,
+			ZBX_FLAG_DISCOVERY_PROTOTYPE);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_item_preproc_sql                                          *
+ *                                                                            *
+ * Purpose: builds the query of item preprocessing steps cached in            *
+ *          configuration cache                                               *
+ *                                                                            *
+ * Parameter: sql        - [IN/OUT] the sql query                             *
+ *            sql_alloc  - [IN/OUT] the sql query buffer size                 *
+ *            sql_offset - [IN/OUT] the sql query length                      *
+ *            columns    - [IN] the selected columns                          *
+ *                                                                            *
+ ******************************************************************************/
+static void	dbsync_item_preproc_sql(char **sql, size_t *sql_alloc, size_t *sql_offset, const char *columns)
+{
+	zbx_snprintf_alloc(sql, sql_alloc, sql_offset,
+			"select %s"
+			" from item_preproc pp,items i,hosts h"
+			" where pp.itemid=i.itemid"
+				" and i.hostid=h.hostid"
+				" and h.status in (%d,%d)"
+				" and i.flags<>%d",
+			columns, HOST_STATUS_MONITORED, HOST_STATUS_NOT_MONITORED, ZBX_FLAG_DISCOVERY_PROTOTYPE);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_snapshot_source_init                                      *
+ *                                                                            *
+ * Purpose: initializes the queries of table stored in configuration cache    *
+ *          snapshot                                                          *
+ *                                                                            *
+ * Parameter: source - [OUT] the table queries                                *
+ *            object - [IN] the tracked object (see ZBX_DBSYNC_OBJ_* defines) *
+ *                                                                            *
+ ******************************************************************************/
+static void	dbsync_snapshot_source_init(zbx_dbsync_snapshot_source_t *source, int object)
+{
+	size_t	sql_alloc = 0, sql_offset = 0, refresh_alloc = 0, refresh_offset = 0;
+
+	memset(source, 0, sizeof(zbx_dbsync_snapshot_source_t));
+
+	switch (object)
+	{
+		case ZBX_DBSYNC_OBJ_ITEM:
+			source->name = "items";
+			source->column = "i.itemid";
+			source->columns_num = 57;
+			source->refresh_index = dbsync_item_refresh_index;
+			source->refresh_num = ARRSIZE(dbsync_item_refresh_index);
+			dbsync_item_sql(&source->sql, &sql_alloc, &sql_offset, ZBX_DBSYNC_ITEM_COLUMNS);
+			dbsync_item_sql(&source->refresh_sql, &refresh_alloc, &refresh_offset,
+					ZBX_DBSYNC_ITEM_REFRESH_COLUMNS);
+			break;
+		case ZBX_DBSYNC_OBJ_ITEM_PREPROC:
+			source->name = "item_preproc";
+			source->column = "pp.item_preprocid";
+			source->columns_num = 6;
+			dbsync_item_preproc_sql(&source->sql, &sql_alloc, &sql_offset, ZBX_DBSYNC_ITEM_PREPROC_COLUMNS);
+			dbsync_item_preproc_sql(&source->refresh_sql, &refresh_alloc, &refresh_offset,
+					ZBX_DBSYNC_ITEM_PREPROC_REFRESH_COLUMNS);
+			break;
+		case ZBX_DBSYNC_OBJ_FUNCTION:
+			source->name = "functions";
+			source->column = "f.functionid";
+			source->column_index = 1;
+			source->columns_num = 5;
+			dbsync_function_sql(&source->sql, &sql_alloc, &sql_offset, ZBX_DBSYNC_FUNCTION_COLUMNS);
+			dbsync_function_sql(&source->refresh_sql, &refresh_alloc, &refresh_offset,
+					ZBX_DBSYNC_FUNCTION_REFRESH_COLUMNS);
+			break;
+		case ZBX_DBSYNC_OBJ_TRIGGER:
+			source->name = "triggers";
+			source->column = "t.triggerid";
+			source->columns_num = 14;
+			source->refresh_index = dbsync_trigger_refresh_index;
+			source->refresh_num = ARRSIZE(dbsync_trigger_refresh_index);
+			dbsync_trigger_sql(&source->sql, &sql_alloc, &sql_offset, ZBX_DBSYNC_TRIGGER_COLUMNS);
+			dbsync_trigger_sql(&source->refresh_sql, &refresh_alloc, &refresh_offset,
+					ZBX_DBSYNC_TRIGGER_REFRESH_COLUMNS);
+			break;
+		default:
+			THIS_SHOULD_NEVER_HAPPEN;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_snapshot_source_clear                                     *
+ *                                                                            *
+ ******************************************************************************/
+static void	dbsync_snapshot_source_clear(zbx_dbsync_snapshot_source_t *source)
 {
-	if (NULL != strstr(row[column], "{$"))
-		return SUCCEED;
-
-	return FAIL;
+	zbx_free(source->sql);
+	zbx_free(source->refresh_sql);
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: dbsync_preproc_row                                               *
+ * Function: dbsync_snapshot_open                                             *
  *                                                                            *
- * Purpose: applies necessary pre-processing before row is compared/used      *
+ * Purpose: starts reading the initial changeset from configuration cache     *
+ *          snapshot                                                          *
  *                                                                            *
- * Parameter: sync - [IN] the changeset                                       *
- *            row  - [IN/OUT] the data row                                    *
+ * Parameter: sync   - [IN/OUT] the changeset                                 *
+ *            object - [IN] the tracked object (see ZBX_DBSYNC_OBJ_* defines) *
  *                                                                            *
- * Return value: the resulting row                                            *
+ * Return value: SUCCEED - the rows will be read from snapshot                *
+ *               FAIL    - the snapshot is not loaded or does not have the    *
+ *                         table, the rows must be read from database         *
  *                                                                            *
  ******************************************************************************/
-static char	**dbsync_preproc_row(zbx_dbsync_t *sync, char **row)
+static int	dbsync_snapshot_open(zbx_dbsync_t *sync, int object)
 {
-	int	i;
-
-	if (NULL == sync->preproc_row_func)
-		return row;
-
-	/* free the resources allocated by last preprocessing call */
-	zbx_vector_ptr_clear_ext(&sync->columns, zbx_ptr_free);
+	zbx_dbsync_snapshot_source_t	source;
+	int				ret;
 
-	/* copy the original data */
-	memcpy(sync->row, row, sizeof(char *) * sync->columns_num);
+	if (NULL == dbsync_snapshot)
+		return FAIL;
 
-	sync->row = sync->preproc_row_func(sync->row);
+	dbsync_snapshot_source_init(&source, object);
+	ret = zbx_dbsync_snapshot_open(dbsync_snapshot, &sync->snapshot, &source, &dbsync_snapshot_ids[object - 1]);
+	dbsync_snapshot_source_clear(&source);
 
-	for (i = 0; i < sync->columns_num; i++)
+	if (SUCCEED != ret)
 	{
-		if (sync->row[i] != row[i])
-			zbx_vector_ptr_append(&sync->columns, sync->row[i]);
+		zabbix_log(LOG_LEVEL_WARNING, "cannot use configuration cache snapshot for \"%s\" table,"
+				" loading it from database", source.name);
 	}
 
-	return sync->row;
+	return ret;
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: zbx_dbsync_init_env                                              *
+ * Function: zbx_dbsync_env_release_snapshot                                  *
+ *                                                                            *
+ * Purpose: frees the configuration cache snapshot used by the initial        *
+ *          synchronization                                                   *
+ *                                                                            *
+ * Return value: SUCCEED - the snapshot was used, the changes made after it   *
+ *                         was written must be synchronized                   *
+ *               FAIL    - the snapshot was not used                          *
  *                                                                            *
  ******************************************************************************/
-void	zbx_dbsync_init_env(ZBX_DC_CONFIG *cache)
+int	zbx_dbsync_env_release_snapshot(void)
 {
-	dbsync_env.cache = cache;
-	zbx_hashset_create(&dbsync_env.strpool, 100, dbsync_strpool_hash_func, dbsync_strpool_compare_func);
+	if (NULL == dbsync_snapshot)
+		return FAIL;
+
+	zbx_dbsync_snapshot_free(dbsync_snapshot);
+	dbsync_snapshot = NULL;
+
+	return SUCCEED;
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: dbsync_env_release                                               *
+ * Function: zbx_dbsync_env_write_snapshot                                    *
+ *                                                                            *
+ * Purpose: writes the tracked tables into configuration cache snapshot       *
+ *                                                                            *
+ * Parameter: path - [IN] the snapshot file path                              *
+ *                                                                            *
+ * Return value: SUCCEED - the snapshot was written                           *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ * Comments: The snapshot can be loaded only together with changelog, so it   *
+ *           is not written if changelog is not available.                    *
  *                                                                            *
  ******************************************************************************/
-void	zbx_dbsync_free_env(void)
+int	zbx_dbsync_env_write_snapshot(const char *path)
 {
-	zbx_hashset_destroy(&dbsync_env.strpool);
+	const char			*__function_name = "zbx_dbsync_env_write_snapshot";
+
+	DB_RESULT			result;
+	DB_ROW				row;
+	zbx_vector_uint64_t		changelogids;
+	zbx_uint64_t			changelogid;
+	zbx_dbsync_snapshot_source_t	sources[ZBX_DBSYNC_OBJ_COUNT];
+	int				i, ret = FAIL;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() path:'%s'", __function_name, path);
+
+	if (ZBX_DBSYNC_CHANGELOG_AVAILABLE != dbsync_changelog_state)
+		goto out;
+
+	zbx_vector_uint64_create(&changelogids);
+
+	/* the changelog must be read before the tables, so the listed changes are included in snapshot */
+	if (NULL == (result = DBselect("select changelogid from changelog")))
+		goto clean;
+
+	while (NULL != (row = DBfetch(result)))
+	{
+		ZBX_STR2UINT64(changelogid, row[0]);
+		zbx_vector_uint64_append(&changelogids, changelogid);
+	}
+	DBfree_result(result);
+
+	zbx_vector_uint64_sort(&changelogids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+	for (i = 0; i < ZBX_DBSYNC_OBJ_COUNT; i++)
+		dbsync_snapshot_source_init(&sources[i], i + 1);
+
+	ret = zbx_dbsync_snapshot_write(path, &changelogids, sources, ZBX_DBSYNC_OBJ_COUNT);
+
+	for (i = 0; i < ZBX_DBSYNC_OBJ_COUNT; i++)
+		dbsync_snapshot_source_clear(&sources[i]);
+
+	/* the listed changelog records are not needed to load the new snapshot and can be pruned */
+	if (SUCCEED == ret)
+	{
+		zbx_vector_uint64_clear(&dbsync_snapshot_changelog);
+		zbx_vector_uint64_append_array(&dbsync_snapshot_changelog, changelogids.values,
+				changelogids.values_num);
+		dbsync_snapshot_removed = 0;
+	}
+clean:
+	zbx_vector_uint64_destroy(&changelogids);
+out:
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(ret));
+
+	return ret;
 }
 
 /******************************************************************************
@@ -335,7 +1144,11 @@ void	zbx_dbsync_init(zbx_dbsync_t *sync, unsigned char mode)
 		sync->row_index = 0;
 	}
 	else
+	{
 		sync->dbresult = NULL;
+		sync->loader = NULL;
+		sync->snapshot = NULL;
+	}
 }
 
 /******************************************************************************
@@ -379,6 +1192,25 @@ void	zbx_dbsync_clear(zbx_dbsync_t *sync)
 	{
 		DBfree_result(sync->dbresult);
 		sync->dbresult = NULL;
+
+		if (NULL != sync->loader)
+		{
+			zbx_dbsync_loader_close(sync->loader);
+			sync->loader = NULL;
+		}
+
+		if (NULL != sync->snapshot)
+		{
+			/* the rows not read from snapshot are loaded by the next full synchronization */
+			if (SUCCEED != zbx_dbsync_snapshot_close(sync->snapshot))
+			{
+				zabbix_log(LOG_LEVEL_WARNING, "cannot read configuration cache snapshot rows,"
+						" the tracked tables will be compared fully");
+				dbsync_full_compare = 1;
+			}
+
+			sync->snapshot = NULL;
+		}
 	}
 }
 
@@ -417,7 +1249,14 @@ int	zbx_dbsync_next(zbx_dbsync_t *sync, zbx_uint64_t *rowid, char ***row, unsign
 	{
 		char	**dbrow;
 
-		if (NULL == (dbrow = DBfetch(sync->dbresult)))
+		if (NULL != sync->snapshot)
+			dbrow = zbx_dbsync_snapshot_fetch(sync->snapshot);
+		else if (NULL != sync->loader)
+			dbrow = zbx_dbsync_loader_fetch(sync->loader);
+		else
+			dbrow = DBfetch(sync->dbresult);
+
+		if (NULL == dbrow)
 		{
 			*row = NULL;
 			return FAIL;
@@ -616,6 +1455,7 @@ int	zbx_dbsync_compare_hosts(zbx_dbsync_t *sync)
 	zbx_hashset_iter_t	iter;
 	zbx_uint64_t		rowid;
 	ZBX_DC_HOST		*host;
+	int			i;
 
 #if defined(HAVE_POLARSSL) || defined(HAVE_GNUTLS) || defined(HAVE_OPENSSL)
 	if (NULL == (result = DBselect(
@@ -692,6 +1532,12 @@ int	zbx_dbsync_compare_hosts(zbx_dbsync_t *sync)
 			dbsync_add_row(sync, host->hostid, ZBX_DBSYNC_ROW_REMOVE, NULL);
 	}
 
+	/* remember changed hosts so their items and triggers are compared during changelog based sync */
+	for (i = 0; i < sync->rows.values_num; i++)
+		zbx_vector_uint64_append(&dbsync_env.hostids, ((zbx_dbsync_row_t *)sync->rows.values[i])->rowid);
+
+	zbx_vector_uint64_sort(&dbsync_env.hostids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
 	zbx_hashset_destroy(&ids);
 	DBfree_result(result);
 
@@ -1695,6 +2541,52 @@ static char	**dbsync_item_preproc_row(char **row)
 #undef ZBX_DBSYNC_ITEM_COLUMN_TRENDS
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_add_dependent_items                                       *
+ *                                                                            *
+ * Purpose: adds cached dependent items of the specified items                *
+ *                                                                            *
+ * Parameter: itemids - [IN/OUT] the sorted item identifiers                  *
+ *                                                                            *
+ * Comments: Dependent items can be removed by foreign key cascade, which     *
+ *           does not fire changelog triggers on all databases.               *
+ *                                                                            *
+ ******************************************************************************/
+static void	dbsync_add_dependent_items(zbx_vector_uint64_t *itemids)
+{
+	zbx_hashset_iter_t	iter;
+	ZBX_DC_DEPENDENTITEM	*depitem;
+	zbx_vector_uint64_t	depitemids;
+
+	if (0 == itemids->values_num)
+		return;
+
+	zbx_vector_uint64_create(&depitemids);
+
+	/* repeat until no more dependent items are found to cover multiple dependency levels */
+	do
+	{
+		zbx_vector_uint64_clear(&depitemids);
+
+		zbx_hashset_iter_reset(&dbsync_env.cache->dependentitems, &iter);
+		while (NULL != (depitem = (ZBX_DC_DEPENDENTITEM *)zbx_hashset_iter_next(&iter)))
+		{
+			if (SUCCEED == dbsync_is_changed_id(itemids, depitem->master_itemid) &&
+					FAIL == dbsync_is_changed_id(itemids, depitem->itemid))
+			{
+				zbx_vector_uint64_append(&depitemids, depitem->itemid);
+			}
+		}
+
+		zbx_vector_uint64_append_array(itemids, depitemids.values, depitemids.values_num);
+		zbx_vector_uint64_sort(itemids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+	}
+	while (0 != depitemids.values_num);
+
+	zbx_vector_uint64_destroy(&depitemids);
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: zbx_dbsync_compare_items                                         *
@@ -1714,32 +2606,72 @@ int	zbx_dbsync_compare_items(zbx_dbsync_t *sync)
 	DB_RESULT		result;
 	zbx_hashset_t		ids;
 	zbx_hashset_iter_t	iter;
-	zbx_uint64_t		rowid;
+	zbx_uint64_t		rowid, *pid;
 	ZBX_DC_ITEM		*item;
-	char			**row;
+	char			**row, *sql = NULL;
+	size_t			sql_alloc = 0, sql_offset = 0;
+	int			i, cond_num = 0, changelog_sync;
+	zbx_vector_uint64_t	*changed_itemids = &dbsync_env.changed_ids[ZBX_DBSYNC_OBJ_ITEM - 1];
 
-	if (NULL == (result = DBselect(
-			"select i.itemid,i.hostid,i.status,i.type,i.value_type,i.key_,"
-				"i.snmp_community,i.snmp_oid,i.port,i.snmpv3_securityname,i.snmpv3_securitylevel,"
-				"i.snmpv3_authpassphrase,i.snmpv3_privpassphrase,i.ipmi_sensor,i.delay,"
-				"i.trapper_hosts,i.logtimefmt,i.params,i.state,i.authtype,i.username,i.password,"
-				"i.publickey,i.privatekey,i.flags,i.interfaceid,i.snmpv3_authprotocol,"
-				"i.snmpv3_privprotocol,i.snmpv3_contextname,i.lastlogsize,i.mtime,"
-				"i.history,i.trends,i.inventory_link,i.valuemapid,i.units,i.error,i.jmx_endpoint,"
-				"i.master_itemid,i.timeout,i.url,i.query_fields,i.posts,i.status_codes,"
-				"i.follow_redirects,i.post_type,i.http_proxy,i.headers,i.retrieve_mode,"
-				"i.request_method,i.output_format,i.ssl_cert_file,i.ssl_key_file,i.ssl_key_password,"
-				"i.verify_peer,i.verify_host,i.allow_traps"
-			" from items i,hosts h"
-			" where i.hostid=h.hostid"
-				" and h.status in (%d,%d)"
-				" and i.flags<>%d",
-			HOST_STATUS_MONITORED, HOST_STATUS_NOT_MONITORED,
-			ZBX_FLAG_DISCOVERY_PROTOTYPE)))
+	if (ZBX_DBSYNC_INIT == sync->mode && SUCCEED == dbsync_snapshot_open(sync, ZBX_DBSYNC_OBJ_ITEM))
 	{
-		return FAIL;
+		dbsync_prepare(sync, 57, dbsync_item_preproc_row);
+		return SUCCEED;
+	}
+
+	dbsync_item_sql(&sql, &sql_alloc, &sql_offset, ZBX_DBSYNC_ITEM_COLUMNS);
+
+	changelog_sync = (ZBX_DBSYNC_UPDATE == sync->mode ? dbsync_env.changelog_sync : FAIL);
+
+	if (SUCCEED == changelog_sync)
+	{
+		/* the cached items of changed hosts might be removed or updated */
+		if (0 != dbsync_env.hostids.values_num)
+		{
+			zbx_hashset_iter_reset(&dbsync_env.cache->items, &iter);
+			while (NULL != (item = (ZBX_DC_ITEM *)zbx_hashset_iter_next(&iter)))
+			{
+				if (SUCCEED == dbsync_is_changed_id(&dbsync_env.hostids, item->hostid))
+					zbx_vector_uint64_append(&dbsync_env.itemids, item->itemid);
+			}
+		}
+
+		zbx_vector_uint64_append_array(&dbsync_env.itemids, changed_itemids->values,
+				changed_itemids->values_num);
+		zbx_vector_uint64_sort(&dbsync_env.itemids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+		zbx_vector_uint64_uniq(&dbsync_env.itemids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+		dbsync_add_dependent_items(&dbsync_env.itemids);
+
+		dbsync_add_changed_condition(&sql, &sql_alloc, &sql_offset, &cond_num, "i.itemid", changed_itemids);
+		dbsync_add_changed_condition(&sql, &sql_alloc, &sql_offset, &cond_num, "i.hostid",
+				&dbsync_env.hostids);
+
+		/* nothing has changed, skip the database query */
+		if (0 == cond_num)
+		{
+			zbx_free(sql);
+			dbsync_prepare(sync, 57, dbsync_item_preproc_row);
+			return SUCCEED;
+		}
+
+		zbx_chrcpy_alloc(&sql, &sql_alloc, &sql_offset, ')');
+	}
+
+	if (ZBX_DBSYNC_INIT == sync->mode && SUCCEED == zbx_dbsync_loader_open(&sync->loader, sql, "items",
+			"itemid", "i.itemid", 0, 57))
+	{
+		zbx_free(sql);
+		dbsync_prepare(sync, 57, dbsync_item_preproc_row);
+		return SUCCEED;
 	}
 
+	result = DBselect("%s", sql);
+	zbx_free(sql);
+
+	if (NULL == result)
+		return FAIL;
+
 	dbsync_prepare(sync, 57, dbsync_item_preproc_row);
 
 	if (ZBX_DBSYNC_INIT == sync->mode)
@@ -1748,7 +2680,8 @@ int	zbx_dbsync_compare_items(zbx_dbsync_t *sync)
 		return SUCCEED;
 	}
 
-	zbx_hashset_create(&ids, dbsync_env.cache->items.num_data, ZBX_DEFAULT_UINT64_HASH_FUNC,
+	zbx_hashset_create(&ids, SUCCEED == changelog_sync ? (size_t)dbsync_env.itemids.values_num :
+			(size_t)dbsync_env.cache->items.num_data, ZBX_DEFAULT_UINT64_HASH_FUNC,
 			ZBX_DEFAULT_UINT64_COMPARE_FUNC);
 
 	while (NULL != (dbrow = DBfetch(result)))
@@ -1769,11 +2702,35 @@ int	zbx_dbsync_compare_items(zbx_dbsync_t *sync)
 			dbsync_add_row(sync, rowid, tag, row);
 	}
 
-	zbx_hashset_iter_reset(&dbsync_env.cache->items, &iter);
-	while (NULL != (item = (ZBX_DC_ITEM *)zbx_hashset_iter_next(&iter)))
+	if (SUCCEED == changelog_sync)
+	{
+		for (i = 0; i < dbsync_env.itemids.values_num; i++)
+		{
+			rowid = dbsync_env.itemids.values[i];
+
+			if (NULL != zbx_hashset_search(&ids, &rowid))
+				continue;
+
+			if (NULL != zbx_hashset_search(&dbsync_env.cache->items, &rowid))
+				dbsync_add_row(sync, rowid, ZBX_DBSYNC_ROW_REMOVE, NULL);
+		}
+
+		/* the items added to changed hosts must be tracked too */
+		zbx_hashset_iter_reset(&ids, &iter);
+		while (NULL != (pid = (zbx_uint64_t *)zbx_hashset_iter_next(&iter)))
+			zbx_vector_uint64_append(&dbsync_env.itemids, *pid);
+
+		zbx_vector_uint64_sort(&dbsync_env.itemids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+		zbx_vector_uint64_uniq(&dbsync_env.itemids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+	}
+	else
 	{
-		if (NULL == zbx_hashset_search(&ids, &item->itemid))
-			dbsync_add_row(sync, item->itemid, ZBX_DBSYNC_ROW_REMOVE, NULL);
+		zbx_hashset_iter_reset(&dbsync_env.cache->items, &iter);
+		while (NULL != (item = (ZBX_DC_ITEM *)zbx_hashset_iter_next(&iter)))
+		{
+			if (NULL == zbx_hashset_search(&ids, &item->itemid))
+				dbsync_add_row(sync, item->itemid, ZBX_DBSYNC_ROW_REMOVE, NULL);
+		}
 	}
 
 	zbx_hashset_destroy(&ids);
@@ -1911,24 +2868,50 @@ int	zbx_dbsync_compare_triggers(zbx_dbsync_t *sync)
 	zbx_hashset_iter_t	iter;
 	zbx_uint64_t		rowid;
 	ZBX_DC_TRIGGER		*trigger;
-	char			**row;
+	char			**row, *sql = NULL;
+	size_t			sql_alloc = 0, sql_offset = 0;
+	int			i, cond_num = 0, changelog_sync;
 
-	if (NULL == (result = DBselect(
-			"select distinct t.triggerid,t.description,t.expression,t.error,t.priority,t.type,t.value,"
-				"t.state,t.lastchange,t.status,t.recovery_mode,t.recovery_expression,"
-				"t.correlation_mode,t.correlation_tag"
-			" from hosts h,items i,functions f,triggers t"
-			" where h.hostid=i.hostid"
-				" and i.itemid=f.itemid"
-				" and f.triggerid=t.triggerid"
-				" and h.status in (%d,%d)"
-				" and t.flags<>%d",
-			HOST_STATUS_MONITORED, HOST_STATUS_NOT_MONITORED,
-			ZBX_FLAG_DISCOVERY_PROTOTYPE)))
+	if (ZBX_DBSYNC_INIT == sync->mode && SUCCEED == dbsync_snapshot_open(sync, ZBX_DBSYNC_OBJ_TRIGGER))
 	{
-		return FAIL;
+		dbsync_prepare(sync, 14, dbsync_trigger_preproc_row);
+		return SUCCEED;
+	}
+
+	dbsync_trigger_sql(&sql, &sql_alloc, &sql_offset, ZBX_DBSYNC_TRIGGER_COLUMNS);
+
+	changelog_sync = (ZBX_DBSYNC_UPDATE == sync->mode ? dbsync_env.changelog_sync : FAIL);
+
+	if (SUCCEED == changelog_sync)
+	{
+		/* the changed triggers and triggers of changed functions were collected by function comparison */
+		dbsync_add_changed_condition(&sql, &sql_alloc, &sql_offset, &cond_num, "t.triggerid",
+				&dbsync_env.triggerids);
+
+		if (0 == cond_num)
+		{
+			zbx_free(sql);
+			dbsync_prepare(sync, 14, dbsync_trigger_preproc_row);
+			return SUCCEED;
+		}
+
+		zbx_chrcpy_alloc(&sql, &sql_alloc, &sql_offset, ')');
+	}
+
+	if (ZBX_DBSYNC_INIT == sync->mode && SUCCEED == zbx_dbsync_loader_open(&sync->loader, sql, "triggers",
+			"triggerid", "t.triggerid", 0, 14))
+	{
+		zbx_free(sql);
+		dbsync_prepare(sync, 14, dbsync_trigger_preproc_row);
+		return SUCCEED;
 	}
 
+	result = DBselect("%s", sql);
+	zbx_free(sql);
+
+	if (NULL == result)
+		return FAIL;
+
 	dbsync_prepare(sync, 14, dbsync_trigger_preproc_row);
 
 	if (ZBX_DBSYNC_INIT == sync->mode)
@@ -1937,7 +2920,8 @@ int	zbx_dbsync_compare_triggers(zbx_dbsync_t *sync)
 		return SUCCEED;
 	}
 
-	zbx_hashset_create(&ids, dbsync_env.cache->triggers.num_data, ZBX_DEFAULT_UINT64_HASH_FUNC,
+	zbx_hashset_create(&ids, SUCCEED == changelog_sync ? (size_t)dbsync_env.triggerids.values_num :
+			(size_t)dbsync_env.cache->triggers.num_data, ZBX_DEFAULT_UINT64_HASH_FUNC,
 			ZBX_DEFAULT_UINT64_COMPARE_FUNC);
 
 	while (NULL != (dbrow = DBfetch(result)))
@@ -1958,11 +2942,27 @@ int	zbx_dbsync_compare_triggers(zbx_dbsync_t *sync)
 		}
 	}
 
-	zbx_hashset_iter_reset(&dbsync_env.cache->triggers, &iter);
-	while (NULL != (trigger = (ZBX_DC_TRIGGER *)zbx_hashset_iter_next(&iter)))
+	if (SUCCEED == changelog_sync)
+	{
+		for (i = 0; i < dbsync_env.triggerids.values_num; i++)
+		{
+			rowid = dbsync_env.triggerids.values[i];
+
+			if (NULL != zbx_hashset_search(&ids, &rowid))
+				continue;
+
+			if (NULL != zbx_hashset_search(&dbsync_env.cache->triggers, &rowid))
+				dbsync_add_row(sync, rowid, ZBX_DBSYNC_ROW_REMOVE, NULL);
+		}
+	}
+	else
 	{
-		if (NULL == zbx_hashset_search(&ids, &trigger->triggerid))
-			dbsync_add_row(sync, trigger->triggerid, ZBX_DBSYNC_ROW_REMOVE, NULL);
+		zbx_hashset_iter_reset(&dbsync_env.cache->triggers, &iter);
+		while (NULL != (trigger = (ZBX_DC_TRIGGER *)zbx_hashset_iter_next(&iter)))
+		{
+			if (NULL == zbx_hashset_search(&ids, &trigger->triggerid))
+				dbsync_add_row(sync, trigger->triggerid, ZBX_DBSYNC_ROW_REMOVE, NULL);
+		}
 	}
 
 	zbx_hashset_destroy(&ids);
@@ -2110,23 +3110,62 @@ int	zbx_dbsync_compare_functions(zbx_dbsync_t *sync)
 	DB_RESULT		result;
 	zbx_hashset_t		ids;
 	zbx_hashset_iter_t	iter;
-	zbx_uint64_t		rowid;
+	zbx_uint64_t		rowid, triggerid;
 	ZBX_DC_FUNCTION		*function;
+	char			*sql = NULL;
+	size_t			sql_alloc = 0, sql_offset = 0;
+	int			cond_num = 0, changelog_sync;
+	zbx_vector_uint64_t	*changed_functionids = &dbsync_env.changed_ids[ZBX_DBSYNC_OBJ_FUNCTION - 1],
+				*changed_triggerids = &dbsync_env.changed_ids[ZBX_DBSYNC_OBJ_TRIGGER - 1];
 
-	if (NULL == (result = DBselect(
-			"select i.itemid,f.functionid,f.name,f.parameter,t.triggerid"
-			" from hosts h,items i,functions f,triggers t"
-			" where h.hostid=i.hostid"
-				" and i.itemid=f.itemid"
-				" and f.triggerid=t.triggerid"
-				" and h.status in (%d,%d)"
-				" and t.flags<>%d",
-			HOST_STATUS_MONITORED, HOST_STATUS_NOT_MONITORED,
-			ZBX_FLAG_DISCOVERY_PROTOTYPE)))
+	if (ZBX_DBSYNC_INIT == sync->mode && SUCCEED == dbsync_snapshot_open(sync, ZBX_DBSYNC_OBJ_FUNCTION))
 	{
-		return FAIL;
+		dbsync_prepare(sync, 5, NULL);
+		return SUCCEED;
+	}
+
+	dbsync_function_sql(&sql, &sql_alloc, &sql_offset, ZBX_DBSYNC_FUNCTION_COLUMNS);
+
+	changelog_sync = (ZBX_DBSYNC_UPDATE == sync->mode ? dbsync_env.changelog_sync : FAIL);
+
+	if (SUCCEED == changelog_sync)
+	{
+		dbsync_add_changed_condition(&sql, &sql_alloc, &sql_offset, &cond_num, "f.functionid",
+				changed_functionids);
+		dbsync_add_changed_condition(&sql, &sql_alloc, &sql_offset, &cond_num, "f.itemid",
+				&dbsync_env.changed_ids[ZBX_DBSYNC_OBJ_ITEM - 1]);
+		dbsync_add_changed_condition(&sql, &sql_alloc, &sql_offset, &cond_num, "f.triggerid",
+				changed_triggerids);
+		dbsync_add_changed_condition(&sql, &sql_alloc, &sql_offset, &cond_num, "i.hostid",
+				&dbsync_env.hostids);
+
+		zbx_vector_uint64_append_array(&dbsync_env.triggerids, changed_triggerids->values,
+				changed_triggerids->values_num);
+
+		if (0 == cond_num)
+		{
+			zbx_free(sql);
+			dbsync_prepare(sync, 5, NULL);
+			return SUCCEED;
+		}
+
+		zbx_chrcpy_alloc(&sql, &sql_alloc, &sql_offset, ')');
+	}
+
+	if (ZBX_DBSYNC_INIT == sync->mode && SUCCEED == zbx_dbsync_loader_open(&sync->loader, sql, "functions",
+			"functionid", "f.functionid", 1, 5))
+	{
+		zbx_free(sql);
+		dbsync_prepare(sync, 5, NULL);
+		return SUCCEED;
 	}
 
+	result = DBselect("%s", sql);
+	zbx_free(sql);
+
+	if (NULL == result)
+		return FAIL;
+
 	dbsync_prepare(sync, 5, NULL);
 
 	if (ZBX_DBSYNC_INIT == sync->mode)
@@ -2135,8 +3174,8 @@ int	zbx_dbsync_compare_functions(zbx_dbsync_t *sync)
 		return SUCCEED;
 	}
 
-	zbx_hashset_create(&ids, dbsync_env.cache->functions.num_data, ZBX_DEFAULT_UINT64_HASH_FUNC,
-			ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+	zbx_hashset_create(&ids, SUCCEED == changelog_sync ? 100 : (size_t)dbsync_env.cache->functions.num_data,
+			ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
 
 	while (NULL != (dbrow = DBfetch(result)))
 	{
@@ -2152,15 +3191,37 @@ int	zbx_dbsync_compare_functions(zbx_dbsync_t *sync)
 
 		if (ZBX_DBSYNC_ROW_NONE != tag)
 			dbsync_add_row(sync, rowid, tag, dbrow);
+
+		if (SUCCEED == changelog_sync)
+		{
+			ZBX_STR2UINT64(triggerid, dbrow[4]);
+			zbx_vector_uint64_append(&dbsync_env.triggerids, triggerid);
+		}
 	}
 
 	zbx_hashset_iter_reset(&dbsync_env.cache->functions, &iter);
 	while (NULL != (function = (ZBX_DC_FUNCTION *)zbx_hashset_iter_next(&iter)))
 	{
+		if (SUCCEED == changelog_sync)
+		{
+			/* during changelog based sync only the functions of changed objects can be removed */
+			if (FAIL == dbsync_is_changed_id(changed_functionids, function->functionid) &&
+					FAIL == dbsync_is_changed_id(&dbsync_env.itemids, function->itemid) &&
+					FAIL == dbsync_is_changed_id(changed_triggerids, function->triggerid))
+			{
+				continue;
+			}
+
+			zbx_vector_uint64_append(&dbsync_env.triggerids, function->triggerid);
+		}
+
 		if (NULL == zbx_hashset_search(&ids, &function->functionid))
 			dbsync_add_row(sync, function->functionid, ZBX_DBSYNC_ROW_REMOVE, NULL);
 	}
 
+	zbx_vector_uint64_sort(&dbsync_env.triggerids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+	zbx_vector_uint64_uniq(&dbsync_env.triggerids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
 	zbx_hashset_destroy(&ids);
 	DBfree_result(result);
 
@@ -3198,21 +4259,56 @@ int	zbx_dbsync_compare_item_preprocs(zbx_dbsync_t *sync)
 	zbx_hashset_iter_t	iter;
 	zbx_uint64_t		rowid;
 	zbx_dc_preproc_op_t	*preproc;
-	char			**row;
+	char			**row, *sql = NULL;
+	size_t			sql_alloc = 0, sql_offset = 0;
+	int			cond_num = 0, changelog_sync;
+	zbx_vector_uint64_t	*changed_preprocids = &dbsync_env.changed_ids[ZBX_DBSYNC_OBJ_ITEM_PREPROC - 1];
 
-	if (NULL == (result = DBselect(
-			"select pp.item_preprocid,pp.itemid,pp.type,pp.params,pp.step,i.hostid"
-			" from item_preproc pp,items i,hosts h"
-			" where pp.itemid=i.itemid"
-				" and i.hostid=h.hostid"
-				" and h.status in (%d,%d)"
-				" and i.flags<>%d"
-			" order by pp.itemid",
-			HOST_STATUS_MONITORED, HOST_STATUS_NOT_MONITORED, ZBX_FLAG_DISCOVERY_PROTOTYPE)))
+	if (ZBX_DBSYNC_INIT == sync->mode && SUCCEED == dbsync_snapshot_open(sync, ZBX_DBSYNC_OBJ_ITEM_PREPROC))
 	{
-		return FAIL;
+		dbsync_prepare(sync, 6, dbsync_item_pp_preproc_row);
+		return SUCCEED;
+	}
+
+	dbsync_item_preproc_sql(&sql, &sql_alloc, &sql_offset, ZBX_DBSYNC_ITEM_PREPROC_COLUMNS);
+
+	changelog_sync = (ZBX_DBSYNC_UPDATE == sync->mode ? dbsync_env.changelog_sync : FAIL);
+
+	if (SUCCEED == changelog_sync)
+	{
+		dbsync_add_changed_condition(&sql, &sql_alloc, &sql_offset, &cond_num, "pp.item_preprocid",
+				changed_preprocids);
+		dbsync_add_changed_condition(&sql, &sql_alloc, &sql_offset, &cond_num, "pp.itemid",
+				&dbsync_env.changed_ids[ZBX_DBSYNC_OBJ_ITEM - 1]);
+		dbsync_add_changed_condition(&sql, &sql_alloc, &sql_offset, &cond_num, "i.hostid",
+				&dbsync_env.hostids);
+
+		if (0 == cond_num)
+		{
+			zbx_free(sql);
+			dbsync_prepare(sync, 6, dbsync_item_pp_preproc_row);
+			return SUCCEED;
+		}
+
+		zbx_chrcpy_alloc(&sql, &sql_alloc, &sql_offset, ')');
+	}
+
+	if (ZBX_DBSYNC_INIT == sync->mode && SUCCEED == zbx_dbsync_loader_open(&sync->loader, sql, "item_preproc",
+			"item_preprocid", "pp.item_preprocid", 0, 6))
+	{
+		zbx_free(sql);
+		dbsync_prepare(sync, 6, dbsync_item_pp_preproc_row);
+		return SUCCEED;
 	}
 
+	zbx_strcpy_alloc(&sql, &sql_alloc, &sql_offset, " order by pp.itemid");
+
+	result = DBselect("%s", sql);
+	zbx_free(sql);
+
+	if (NULL == result)
+		return FAIL;
+
 	dbsync_prepare(sync, 6, dbsync_item_pp_preproc_row);
 
 	if (ZBX_DBSYNC_INIT == sync->mode)
@@ -3247,6 +4343,14 @@ int	zbx_dbsync_compare_item_preprocs(zbx_dbsync_t *sync)
 	zbx_hashset_iter_reset(&dbsync_env.cache->preprocops, &iter);
 	while (NULL != (preproc = (zbx_dc_preproc_op_t *)zbx_hashset_iter_next(&iter)))
 	{
+		/* during changelog based sync only the preprocessing of changed items can be removed */
+		if (SUCCEED == changelog_sync &&
+				FAIL == dbsync_is_changed_id(changed_preprocids, preproc->item_preprocid) &&
+				FAIL == dbsync_is_changed_id(&dbsync_env.itemids, preproc->itemid))
+		{
+			continue;
+		}
+
 		if (NULL == zbx_hashset_search(&ids, &preproc->item_preprocid))
 			dbsync_add_row(sync, preproc->item_preprocid, ZBX_DBSYNC_ROW_REMOVE, NULL);
 	}
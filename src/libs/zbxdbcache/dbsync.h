@@ -76,6 +76,35 @@ typedef struct
 }
 zbx_dbsync_row_t;
 
+typedef struct zbx_dbsync_loader zbx_dbsync_loader_t;
+typedef struct zbx_dbsync_snapshot zbx_dbsync_snapshot_t;
+typedef struct zbx_dbsync_snapshot_table zbx_dbsync_snapshot_table_t;
+
+/* the configuration table stored in configuration cache snapshot */
+typedef struct
+{
+	/* the table name */
+	const char	*name;
+
+	/* the table query with 'where' clause, without ordering */
+	char		*sql;
+
+	/* the object id column in query and its index in the query rows */
+	const char	*column;
+	int		column_index;
+
+	/* the number of columns in query rows */
+	int		columns_num;
+
+	/* the query of object ids followed by runtime columns, which are not tracked by changelog */
+	char		*refresh_sql;
+
+	/* the indexes of runtime columns in table query rows */
+	const int	*refresh_index;
+	int		refresh_num;
+}
+zbx_dbsync_snapshot_source_t;
+
 struct zbx_dbsync
 {
 	/* the synchronization mode (see ZBX_DBSYNC_* defines) */
@@ -93,6 +122,12 @@ struct zbx_dbsync
 	/* the database result set for ZBX_DBSYNC_ALL mode */
 	DB_RESULT			dbresult;
 
+	/* the parallel loader used instead of database result set in ZBX_DBSYNC_INIT mode */
+	zbx_dbsync_loader_t		*loader;
+
+	/* the configuration cache snapshot table used instead of database in ZBX_DBSYNC_INIT mode */
+	zbx_dbsync_snapshot_table_t	*snapshot;
+
 	/* the row preprocessing function */
 	zbx_dbsync_preproc_row_func_t	preproc_row_func;
 
@@ -110,11 +145,33 @@ struct zbx_dbsync
 
 void	zbx_dbsync_init_env(ZBX_DC_CONFIG *cache);
 void	zbx_dbsync_free_env(void);
+int	zbx_dbsync_env_prepare(unsigned char mode);
+void	zbx_dbsync_env_full_compare(void);
+void	zbx_dbsync_env_flush_changelog(void);
+int	zbx_dbsync_env_release_snapshot(void);
+int	zbx_dbsync_env_write_snapshot(const char *path);
 
 void	zbx_dbsync_init(zbx_dbsync_t *sync, unsigned char mode);
 void	zbx_dbsync_clear(zbx_dbsync_t *sync);
 int	zbx_dbsync_next(zbx_dbsync_t *sync, zbx_uint64_t *rowid, char ***rows, unsigned char *tag);
 
+int	zbx_dbsync_loader_open(zbx_dbsync_loader_t **loader, const char *sql, const char *table, const char *field,
+		const char *column, int column_index, int columns_num);
+DB_ROW	zbx_dbsync_loader_fetch(zbx_dbsync_loader_t *loader);
+void	zbx_dbsync_loader_close(zbx_dbsync_loader_t *loader);
+
+int	zbx_dbsync_snapshot_write(const char *path, const zbx_vector_uint64_t *changelogids,
+		const zbx_dbsync_snapshot_source_t *sources, int sources_num);
+int	zbx_dbsync_snapshot_load(zbx_dbsync_snapshot_t **snapshot, const char *path);
+void	zbx_dbsync_snapshot_free(zbx_dbsync_snapshot_t *snapshot);
+void	zbx_dbsync_snapshot_get_changelog(const zbx_dbsync_snapshot_t *snapshot, zbx_vector_uint64_t *changelogids);
+void	zbx_dbsync_snapshot_get_newest(const zbx_dbsync_snapshot_t *snapshot, zbx_uint64_t *changelogid,
+		int *timestamp);
+int	zbx_dbsync_snapshot_open(const zbx_dbsync_snapshot_t *snapshot, zbx_dbsync_snapshot_table_t **table,
+		const zbx_dbsync_snapshot_source_t *source, zbx_vector_uint64_t *new_ids);
+DB_ROW	zbx_dbsync_snapshot_fetch(zbx_dbsync_snapshot_table_t *table);
+int	zbx_dbsync_snapshot_close(zbx_dbsync_snapshot_table_t *table);
+
 int	zbx_dbsync_compare_config(zbx_dbsync_t *sync);
 int	zbx_dbsync_compare_hosts(zbx_dbsync_t *sync);
 int	zbx_dbsync_compare_host_inventory(zbx_dbsync_t *sync);
@@ -0,0 +1,715 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2018 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "common.h"
+#include "log.h"
+#include "db.h"
+#include "dbcache.h"
+#include "threads.h"
+#include "mutexs.h"
+
+#define ZBX_DBCONFIG_IMPL
+#include "dbconfig.h"
+#include "dbsync.h"
+
+/*
+ * The configuration loader splits a table query into object id range chunks. The chunks are
+ * fetched by short-lived child processes, each over its own database connection, and streamed
+ * back to the configuration syncer through pipes. Chunk N is fetched by worker N % workers_num,
+ * so the rows are read in the ascending chunk order while the other workers are already
+ * running queries for the following chunks.
+ *
+ * Rows are transferred as:
+ *   <size:uint32><column 1>...<column N>
+ * where each column is encoded as:
+ *   <length:uint32><value with terminating zero> or <ZBX_DBSYNC_LOADER_NULL> for NULL values.
+ * The end of chunk is marked by zero size and worker failure by ZBX_DBSYNC_LOADER_ERROR size.
+ *
+ * If a worker fails, the rest of its chunks (starting with the last received object id of the
+ * current chunk) are loaded over the main database connection.
+ */
+
+extern int	CONFIG_CONFLOADER_FORKS;
+
+#define ZBX_DBSYNC_LOADER_CHUNKS_PER_WORKER	4
+#define ZBX_DBSYNC_LOADER_CHUNK_MIN		10000
+#define ZBX_DBSYNC_LOADER_CHUNK_MAX		100000
+#define ZBX_DBSYNC_LOADER_BUFFER_SIZE		(64 * ZBX_KIBIBYTE)
+
+#define ZBX_DBSYNC_LOADER_END			0
+#define ZBX_DBSYNC_LOADER_ERROR			0xffffffff
+#define ZBX_DBSYNC_LOADER_NULL			0xffffffff
+
+typedef struct
+{
+	pid_t	pid;
+
+	/* the read end of worker pipe, -1 if the worker has failed or was not started */
+	int	fd;
+
+	char	*buf;
+	size_t	buf_offset;
+	size_t	buf_size;
+}
+zbx_dbsync_worker_t;
+
+struct zbx_dbsync_loader
+{
+	/* the table query without chunk conditions and ordering */
+	char			*sql;
+
+	/* the object id column used to split query in chunks and its index in the returned rows */
+	char			*column;
+	int			column_index;
+	int			columns_num;
+
+	zbx_uint64_t		min_id;
+	zbx_uint64_t		chunk_size;
+	int			chunks_num;
+
+	/* the chunk being read */
+	int			chunk_index;
+
+	/* the last object id read from the current chunk */
+	zbx_uint64_t		last_id;
+	int			last_id_set;
+
+	/* the current chunk result set when it's loaded over the main database connection */
+	DB_RESULT		result;
+
+	zbx_dbsync_worker_t	*workers;
+	int			workers_num;
+
+	/* the current row data received from worker */
+	char			*data;
+	size_t			data_alloc;
+	char			**row;
+
+	/* the next opened loader */
+	struct zbx_dbsync_loader	*next;
+};
+
+/* the number of opened loaders, the SIGCHLD handler is restored after the last loader is closed */
+static int			loaders_num = 0;
+static struct sigaction		loaders_sigchld;
+
+/* the opened loaders, the forked workers close the pipes of all of them */
+static zbx_dbsync_loader_t	*loaders = NULL;
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_loader_chunk_sql                                          *
+ *                                                                            *
+ * Purpose: creates query to fetch the specified chunk                        *
+ *                                                                            *
+ * Parameters: loader  - [IN] the configuration loader                        *
+ *             chunk   - [IN] the chunk index                                 *
+ *             from_id - [IN] the first object id to fetch                    *
+ *                                                                            *
+ * Return value: the chunk query, must be freed by the caller                 *
+ *                                                                            *
+ * Comments: The last chunk is not limited by the maximum object id to        *
+ *           include objects created during the load.                         *
+ *                                                                            *
+ ******************************************************************************/
+static char	*dbsync_loader_chunk_sql(const zbx_dbsync_loader_t *loader, int chunk, zbx_uint64_t from_id)
+{
+	char	*sql = NULL;
+	size_t	sql_alloc = 0, sql_offset = 0;
+
+	zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, "%s and %s>=" ZBX_FS_UI64, loader->sql, loader->column,
+			from_id);
+
+	if (chunk != loader->chunks_num - 1)
+	{
+		zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, " and %s<" ZBX_FS_UI64, loader->column,
+				loader->min_id + (zbx_uint64_t)(chunk + 1) * loader->chunk_size);
+	}
+
+	zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, " order by %s", loader->column);
+
+	return sql;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_loader_append                                             *
+ *                                                                            *
+ * Purpose: appends binary data to worker output buffer                       *
+ *                                                                            *
+ ******************************************************************************/
+static void	dbsync_loader_append(char **buf, size_t *buf_alloc, size_t *buf_offset, const void *data, size_t size)
+{
+	if (*buf_alloc < *buf_offset + size)
+	{
+		while (*buf_alloc < *buf_offset + size)
+			*buf_alloc *= 2;
+
+		*buf = (char *)zbx_realloc(*buf, *buf_alloc);
+	}
+
+	memcpy(*buf + *buf_offset, data, size);
+	*buf_offset += size;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_loader_write                                              *
+ *                                                                            *
+ * Purpose: writes worker output buffer to pipe                               *
+ *                                                                            *
+ ******************************************************************************/
+static int	dbsync_loader_write(int fd, const char *buf, size_t size)
+{
+	ssize_t	n;
+
+	while (0 != size)
+	{
+		if (-1 == (n = write(fd, buf, size)))
+		{
+			if (EINTR == errno)
+				continue;
+
+			return FAIL;
+		}
+
+		buf += n;
+		size -= (size_t)n;
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_loader_worker                                             *
+ *                                                                            *
+ * Purpose: fetches the worker chunks and writes the rows to pipe             *
+ *                                                                            *
+ * Parameters: loader - [IN] the configuration loader                         *
+ *             worker - [IN] the worker index                                 *
+ *             fd     - [IN] the write end of worker pipe                     *
+ *                                                                            *
+ * Comments: This function is executed in the forked worker process and      *
+ *           never returns.                                                   *
+ *                                                                            *
+ ******************************************************************************/
+static void	dbsync_loader_worker(const zbx_dbsync_loader_t *loader, int worker, int fd)
+{
+	DB_RESULT	result;
+	DB_ROW		row;
+	char		*sql, *buf;
+	size_t		buf_alloc = ZBX_DBSYNC_LOADER_BUFFER_SIZE * 2, buf_offset = 0, size_offset;
+	zbx_uint32_t	size, len;
+	int		chunk, i;
+
+	buf = (char *)zbx_malloc(NULL, buf_alloc);
+
+	if (ZBX_DB_OK != DBconnect(ZBX_DB_CONNECT_ONCE))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "configuration loader #%d cannot connect to the database", worker + 1);
+		goto fail;
+	}
+
+	for (chunk = worker; chunk < loader->chunks_num; chunk += loader->workers_num)
+	{
+		sql = dbsync_loader_chunk_sql(loader, chunk, loader->min_id + (zbx_uint64_t)chunk * loader->chunk_size);
+		result = DBselect("%s", sql);
+		zbx_free(sql);
+
+		if (NULL == result)
+			goto fail;
+
+		while (NULL != (row = DBfetch(result)))
+		{
+			size_offset = buf_offset;
+			size = 0;
+			dbsync_loader_append(&buf, &buf_alloc, &buf_offset, &size, sizeof(size));
+
+			for (i = 0; i < loader->columns_num; i++)
+			{
+				if (NULL == row[i])
+				{
+					len = ZBX_DBSYNC_LOADER_NULL;
+					dbsync_loader_append(&buf, &buf_alloc, &buf_offset, &len, sizeof(len));
+					continue;
+				}
+
+				len = (zbx_uint32_t)strlen(row[i]);
+				dbsync_loader_append(&buf, &buf_alloc, &buf_offset, &len, sizeof(len));
+				dbsync_loader_append(&buf, &buf_alloc, &buf_offset, row[i], (size_t)len + 1);
+			}
+
+			size = (zbx_uint32_t)(buf_offset - size_offset - sizeof(size));
+			memcpy(buf + size_offset, &size, sizeof(size));
+
+			if (ZBX_DBSYNC_LOADER_BUFFER_SIZE <= buf_offset)
+			{
+				if (SUCCEED != dbsync_loader_write(fd, buf, buf_offset))
+					exit(EXIT_FAILURE);
+
+				buf_offset = 0;
+			}
+		}
+		DBfree_result(result);
+
+		size = ZBX_DBSYNC_LOADER_END;
+		dbsync_loader_append(&buf, &buf_alloc, &buf_offset, &size, sizeof(size));
+
+		if (SUCCEED != dbsync_loader_write(fd, buf, buf_offset))
+			exit(EXIT_FAILURE);
+
+		buf_offset = 0;
+	}
+
+	DBclose();
+	exit(EXIT_SUCCESS);
+fail:
+	size = ZBX_DBSYNC_LOADER_ERROR;
+	dbsync_loader_append(&buf, &buf_alloc, &buf_offset, &size, sizeof(size));
+	dbsync_loader_write(fd, buf, buf_offset);
+
+	exit(EXIT_FAILURE);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_loader_read                                               *
+ *                                                                            *
+ * Purpose: reads the specified number of bytes from worker pipe              *
+ *                                                                            *
+ * Return value: SUCCEED - the data was read successfully                     *
+ *               FAIL    - the worker has exited or read error occurred       *
+ *                                                                            *
+ ******************************************************************************/
+static int	dbsync_loader_read(zbx_dbsync_worker_t *worker, char *data, size_t size)
+{
+	ssize_t	n;
+	size_t	len;
+
+	while (0 != size)
+	{
+		if (worker->buf_offset == worker->buf_size)
+		{
+			if (-1 == (n = read(worker->fd, worker->buf, ZBX_DBSYNC_LOADER_BUFFER_SIZE)))
+			{
+				if (EINTR == errno)
+					continue;
+
+				return FAIL;
+			}
+
+			if (0 == n)
+				return FAIL;
+
+			worker->buf_offset = 0;
+			worker->buf_size = (size_t)n;
+		}
+
+		if (size < (len = worker->buf_size - worker->buf_offset))
+			len = size;
+
+		memcpy(data, worker->buf + worker->buf_offset, len);
+		worker->buf_offset += len;
+		data += len;
+		size -= len;
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_loader_read_row                                           *
+ *                                                                            *
+ * Purpose: reads the next row of the current chunk from worker pipe          *
+ *                                                                            *
+ * Parameters: loader - [IN] the configuration loader                         *
+ *             worker - [IN] the worker                                       *
+ *             row    - [OUT] the row, NULL at the end of chunk               *
+ *                                                                            *
+ * Return value: SUCCEED - the row or end of chunk was read                   *
+ *               FAIL    - the worker has failed                              *
+ *                                                                            *
+ ******************************************************************************/
+static int	dbsync_loader_read_row(zbx_dbsync_loader_t *loader, zbx_dbsync_worker_t *worker, DB_ROW *row)
+{
+	zbx_uint32_t	size, len;
+	size_t		offset = 0;
+	int		i;
+
+	if (SUCCEED != dbsync_loader_read(worker, (char *)&size, sizeof(size)) || ZBX_DBSYNC_LOADER_ERROR == size)
+		return FAIL;
+
+	if (ZBX_DBSYNC_LOADER_END == size)
+	{
+		*row = NULL;
+		return SUCCEED;
+	}
+
+	if (loader->data_alloc < size)
+	{
+		loader->data_alloc = size;
+		loader->data = (char *)zbx_realloc(loader->data, loader->data_alloc);
+	}
+
+	if (SUCCEED != dbsync_loader_read(worker, loader->data, size))
+		return FAIL;
+
+	for (i = 0; i < loader->columns_num; i++)
+	{
+		if (size < offset + sizeof(len))
+			return FAIL;
+
+		memcpy(&len, loader->data + offset, sizeof(len));
+		offset += sizeof(len);
+
+		if (ZBX_DBSYNC_LOADER_NULL == len)
+		{
+			loader->row[i] = NULL;
+			continue;
+		}
+
+		if (size < offset + (size_t)len + 1)
+			return FAIL;
+
+		loader->row[i] = loader->data + offset;
+		offset += (size_t)len + 1;
+	}
+
+	*row = loader->row;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_loader_stop_worker                                        *
+ *                                                                            *
+ * Purpose: closes worker pipe and waits for the worker process to exit       *
+ *                                                                            *
+ * Comments: The worker is killed, it might be blocked in a database query or *
+ *           pipe write and the signal handlers it has inherited from the     *
+ *           parent process must not be run in it.                            *
+ *                                                                            *
+ ******************************************************************************/
+static void	dbsync_loader_stop_worker(zbx_dbsync_worker_t *worker)
+{
+	if (-1 != worker->fd)
+	{
+		close(worker->fd);
+		worker->fd = -1;
+	}
+
+	if (-1 == worker->pid)
+		return;
+
+	kill(worker->pid, SIGKILL);
+
+	while (-1 == waitpid(worker->pid, NULL, 0) && EINTR == errno)
+		;
+
+	worker->pid = -1;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_loader_close_pipes                                        *
+ *                                                                            *
+ * Purpose: closes the worker pipes of all opened loaders in a forked worker  *
+ *                                                                            *
+ * Comments: Otherwise a worker would keep open the pipes of the workers      *
+ *           started before it and the parent would not see their end of      *
+ *           file if they failed.                                             *
+ *                                                                            *
+ ******************************************************************************/
+static void	dbsync_loader_close_pipes(void)
+{
+	zbx_dbsync_loader_t	*loader;
+	int			i;
+
+	for (loader = loaders; NULL != loader; loader = loader->next)
+	{
+		for (i = 0; i < loader->workers_num; i++)
+		{
+			if (-1 != loader->workers[i].fd)
+				close(loader->workers[i].fd);
+		}
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_dbsync_loader_open                                           *
+ *                                                                            *
+ * Purpose: starts parallel configuration loading                             *
+ *                                                                            *
+ * Parameters: loader       - [OUT] the configuration loader                  *
+ *             sql          - [IN] the table query with 'where' clause,       *
+ *                                 without ordering                           *
+ *             table        - [IN] the table to split in chunks               *
+ *             field        - [IN] the table object id field                  *
+ *             column       - [IN] the object id column in query              *
+ *             column_index - [IN] the object id column index in query rows   *
+ *             columns_num  - [IN] the number of columns in query rows        *
+ *                                                                            *
+ * Return value: SUCCEED - the loader was started                             *
+ *               FAIL    - parallel loading is disabled or is not worth it,   *
+ *                         the query must be executed over the main database  *
+ *                         connection                                         *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_dbsync_loader_open(zbx_dbsync_loader_t **loader, const char *sql, const char *table, const char *field,
+		const char *column, int column_index, int columns_num)
+{
+	const char		*__function_name = "zbx_dbsync_loader_open";
+
+	DB_RESULT		result;
+	DB_ROW			row;
+	zbx_uint64_t		min_id, max_id, chunk_size;
+	zbx_dbsync_loader_t	*ldr;
+	zbx_dbsync_worker_t	*worker;
+	int			i, fds[2], ret = FAIL, started = 0;
+	struct sigaction	phan;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() table:%s", __function_name, table);
+
+	if (0 == CONFIG_CONFLOADER_FORKS)
+		goto out;
+
+	if (NULL == (result = DBselect("select min(%s),max(%s) from %s", field, field, table)))
+		goto out;
+
+	if (NULL == (row = DBfetch(result)) || SUCCEED == DBis_null(row[0]) || SUCCEED == DBis_null(row[1]))
+	{
+		DBfree_result(result);
+		goto out;
+	}
+
+	ZBX_STR2UINT64(min_id, row[0]);
+	ZBX_STR2UINT64(max_id, row[1]);
+	DBfree_result(result);
+
+	chunk_size = (max_id - min_id) / (zbx_uint64_t)(CONFIG_CONFLOADER_FORKS * ZBX_DBSYNC_LOADER_CHUNKS_PER_WORKER);
+
+	if (ZBX_DBSYNC_LOADER_CHUNK_MIN > chunk_size)
+		chunk_size = ZBX_DBSYNC_LOADER_CHUNK_MIN;
+	else if (ZBX_DBSYNC_LOADER_CHUNK_MAX < chunk_size)
+		chunk_size = ZBX_DBSYNC_LOADER_CHUNK_MAX;
+
+	/* a single chunk is loaded faster over the main connection */
+	if (chunk_size > max_id - min_id)
+		goto out;
+
+	ldr = (zbx_dbsync_loader_t *)zbx_malloc(NULL, sizeof(zbx_dbsync_loader_t));
+	ldr->sql = zbx_strdup(NULL, sql);
+	ldr->column = zbx_strdup(NULL, column);
+	ldr->column_index = column_index;
+	ldr->columns_num = columns_num;
+	ldr->min_id = min_id;
+	ldr->chunk_size = chunk_size;
+	ldr->chunks_num = (int)((max_id - min_id) / chunk_size + 1);
+	ldr->chunk_index = 0;
+	ldr->last_id_set = 0;
+	ldr->result = NULL;
+	ldr->data = NULL;
+	ldr->data_alloc = 0;
+	ldr->row = (char **)zbx_malloc(NULL, sizeof(char *) * columns_num);
+	ldr->workers_num = MIN(CONFIG_CONFLOADER_FORKS, ldr->chunks_num);
+	ldr->workers = (zbx_dbsync_worker_t *)zbx_malloc(NULL, sizeof(zbx_dbsync_worker_t) * ldr->workers_num);
+	ldr->next = loaders;
+	loaders = ldr;
+
+	/* the main process exits on SIGCHLD, ignore the loader workers exiting */
+	if (0 == loaders_num++)
+	{
+		sigemptyset(&phan.sa_mask);
+		phan.sa_flags = 0;
+		phan.sa_handler = SIG_DFL;
+		sigaction(SIGCHLD, &phan, &loaders_sigchld);
+	}
+
+	for (i = 0; i < ldr->workers_num; i++)
+	{
+		worker = &ldr->workers[i];
+		worker->pid = -1;
+		worker->fd = -1;
+		worker->buf = NULL;
+		worker->buf_offset = 0;
+		worker->buf_size = 0;
+	}
+
+	for (i = 0; i < ldr->workers_num; i++)
+	{
+		worker = &ldr->workers[i];
+
+		/* the chunks of workers that were not started are loaded over the main connection */
+		if (started != i)
+			continue;
+
+		if (-1 == pipe(fds))
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot create configuration loader pipe: %s",
+					zbx_strerror(errno));
+			continue;
+		}
+
+		if (-1 == (worker->pid = zbx_child_fork()))
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot fork configuration loader: %s", zbx_strerror(errno));
+			close(fds[0]);
+			close(fds[1]);
+			continue;
+		}
+
+		if (0 == worker->pid)
+		{
+			close(fds[0]);
+			dbsync_loader_close_pipes();
+			dbsync_loader_worker(ldr, i, fds[1]);
+		}
+
+		close(fds[1]);
+		worker->fd = fds[0];
+		worker->buf = (char *)zbx_malloc(NULL, ZBX_DBSYNC_LOADER_BUFFER_SIZE);
+		started++;
+	}
+
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() loading %d chunks of " ZBX_FS_UI64 " ids over %d connections",
+			__function_name, ldr->chunks_num, chunk_size, started);
+
+	*loader = ldr;
+	ret = SUCCEED;
+out:
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(ret));
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_dbsync_loader_fetch                                          *
+ *                                                                            *
+ * Purpose: gets the next row from configuration loader                       *
+ *                                                                            *
+ * Return value: the row or NULL if there are no more rows                    *
+ *                                                                            *
+ * Comments: The returned row is valid until the next call.                   *
+ *                                                                            *
+ ******************************************************************************/
+DB_ROW	zbx_dbsync_loader_fetch(zbx_dbsync_loader_t *loader)
+{
+	zbx_dbsync_worker_t	*worker;
+	zbx_uint64_t		from_id;
+	DB_ROW			row;
+	char			*sql;
+
+	while (loader->chunk_index < loader->chunks_num)
+	{
+		if (NULL != loader->result)
+		{
+			if (NULL != (row = DBfetch(loader->result)))
+				return row;
+
+			DBfree_result(loader->result);
+			loader->result = NULL;
+			goto next;
+		}
+
+		worker = &loader->workers[loader->chunk_index % loader->workers_num];
+
+		if (-1 != worker->fd)
+		{
+			if (SUCCEED == dbsync_loader_read_row(loader, worker, &row))
+			{
+				if (NULL == row)
+					goto next;
+
+				ZBX_STR2UINT64(loader->last_id, row[loader->column_index]);
+				loader->last_id_set = 1;
+
+				return row;
+			}
+
+			zabbix_log(LOG_LEVEL_WARNING, "configuration loader #%d has failed, loading the rest of its"
+					" data over the main database connection",
+					loader->chunk_index % loader->workers_num + 1);
+
+			dbsync_loader_stop_worker(worker);
+		}
+
+		if (0 != loader->last_id_set)
+			from_id = loader->last_id + 1;
+		else
+			from_id = loader->min_id + (zbx_uint64_t)loader->chunk_index * loader->chunk_size;
+
+		sql = dbsync_loader_chunk_sql(loader, loader->chunk_index, from_id);
+		loader->result = DBselect("%s", sql);
+		zbx_free(sql);
+
+		if (NULL == loader->result)
+		{
+			loader->chunk_index = loader->chunks_num;
+			break;
+		}
+
+		continue;
+next:
+		loader->chunk_index++;
+		loader->last_id_set = 0;
+	}
+
+	return NULL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_dbsync_loader_close                                          *
+ *                                                                            *
+ * Purpose: stops the loader workers and frees the loader                     *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_dbsync_loader_close(zbx_dbsync_loader_t *loader)
+{
+	zbx_dbsync_loader_t	**prev;
+	int			i;
+
+	for (prev = &loaders; *prev != loader; prev = &(*prev)->next)
+		;
+
+	*prev = loader->next;
+
+	for (i = 0; i < loader->workers_num; i++)
+	{
+		dbsync_loader_stop_worker(&loader->workers[i]);
+		zbx_free(loader->workers[i].buf);
+	}
+
+	if (0 == --loaders_num)
+		sigaction(SIGCHLD, &loaders_sigchld, NULL);
+
+	DBfree_result(loader->result);
+
+	zbx_free(loader->workers);
+	zbx_free(loader->row);
+	zbx_free(loader->data);
+	zbx_free(loader->column);
+	zbx_free(loader->sql);
+	zbx_free(loader);
+}
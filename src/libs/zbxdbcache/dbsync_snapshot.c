@@ -0,0 +1,883 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2018 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "common.h"
+#include "log.h"
+#include "db.h"
+#include "dbcache.h"
+#include "mutexs.h"
+
+#define ZBX_DBCONFIG_IMPL
+#include "dbconfig.h"
+#include "dbsync.h"
+
+#include <sys/mman.h>
+
+/*
+ * The configuration cache snapshot file keeps the rows of the largest configuration tables, so
+ * the initial configuration sync can read them from the file instead of the database. The file
+ * contains the header:
+ *   <magic:8><version:uint32><database version:uint32><write time:uint64><newest changelogid:uint64>
+ *   <changelog records:uint32><changelogid 1:uint64>...<changelogid N:uint64><tables:uint32>
+ * followed by tables:
+ *   <name><columns:uint32><rows:uint64><size:uint64><row 1>...<row N>
+ * where size is the size of the row data. The table name and row columns are encoded as:
+ *   <length:uint32><value with terminating zero> or <ZBX_DBSYNC_SNAPSHOT_NULL> for NULL values.
+ * The rows are stored in ascending object id order.
+ *
+ * The changelog records are the records present in changelog table before the tables were read,
+ * so their changes are included in the snapshot. All other changelog records must be applied
+ * after the snapshot is loaded. The newest of the included records (or 0 if changelog was empty)
+ * is kept in changelog while the snapshot is used, so its absence when loading shows that the
+ * changes made after the snapshot was written could have been removed from changelog.
+ *
+ * When loading, the snapshot rows are joined with a query of object ids and runtime columns
+ * (state, error, trigger value and so on), which are not tracked by changelog. The rows of
+ * removed objects are skipped and the ids of objects missing from the snapshot are collected, so
+ * they can be loaded from the database together with the changelog records.
+ *
+ * All numbers are stored in host byte order, files written on different architectures are
+ * rejected by magic/version check.
+ */
+
+#define ZBX_DBSYNC_SNAPSHOT_MAGIC	"ZBXCCS\x01\x02"
+#define ZBX_DBSYNC_SNAPSHOT_VERSION	2
+#define ZBX_DBSYNC_SNAPSHOT_NULL	0xffffffff
+
+/* the number of rows fetched by one query */
+#define ZBX_DBSYNC_SNAPSHOT_CHUNK	10000
+
+typedef struct
+{
+	const char	*name;
+	int		columns_num;
+	zbx_uint64_t	rows_num;
+	const char	*data;
+	size_t		size;
+}
+zbx_dbsync_snapshot_data_t;
+
+struct zbx_dbsync_snapshot
+{
+	void				*data;
+	size_t				size;
+
+	zbx_uint64_t			timestamp;
+
+	/* the newest changelog record included in snapshot */
+	zbx_uint64_t			changelogid;
+
+	/* the changelog records included in snapshot, sorted */
+	zbx_vector_uint64_t		changelogids;
+
+	zbx_dbsync_snapshot_data_t	*tables;
+	int				tables_num;
+};
+
+/* the table query fetched in chunks ordered by object id */
+typedef struct
+{
+	const char	*sql;
+	const char	*column;
+	int		column_index;
+
+	zbx_uint64_t	last_id;
+	DB_RESULT	result;
+	int		rows_num;
+	unsigned char	eof;
+}
+zbx_dbsync_snapshot_query_t;
+
+struct zbx_dbsync_snapshot_table
+{
+	/* the snapshot rows */
+	const char			*data;
+	size_t				size;
+	size_t				offset;
+	int				columns_num;
+	int				id_index;
+	char				**row;
+
+	/* the object ids and runtime columns read from database */
+	zbx_dbsync_snapshot_query_t	query;
+	char				*refresh_sql;
+	const int			*refresh_index;
+	int				refresh_num;
+	DB_ROW				dbrow;
+	zbx_uint64_t			dbrow_id;
+
+	/* the ids of objects missing from snapshot */
+	zbx_vector_uint64_t		*new_ids;
+
+	/* the database row must be fetched before reading the next snapshot row */
+	unsigned char			refresh_pending;
+
+	/* SUCCEED - all rows were read, FAIL - database query failed */
+	int				ret;
+};
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_snapshot_query_fetch                                      *
+ *                                                                            *
+ * Purpose: gets the next row of chunked query                                *
+ *                                                                            *
+ * Parameters: query - [IN] the query                                         *
+ *             row   - [OUT] the row or NULL if there are no more rows        *
+ *                                                                            *
+ * Return value: SUCCEED - the row was fetched or there are no more rows      *
+ *               FAIL    - database query failed                              *
+ *                                                                            *
+ * Comments: The returned row is valid until the next call.                   *
+ *                                                                            *
+ ******************************************************************************/
+static int	dbsync_snapshot_query_fetch(zbx_dbsync_snapshot_query_t *query, DB_ROW *row)
+{
+	char	*sql = NULL;
+	size_t	sql_alloc = 0, sql_offset = 0;
+
+	while (0 == query->eof)
+	{
+		if (NULL != query->result)
+		{
+			if (NULL != (*row = DBfetch(query->result)))
+			{
+				ZBX_STR2UINT64(query->last_id, (*row)[query->column_index]);
+				query->rows_num++;
+
+				return SUCCEED;
+			}
+
+			DBfree_result(query->result);
+			query->result = NULL;
+
+			if (ZBX_DBSYNC_SNAPSHOT_CHUNK > query->rows_num)
+			{
+				query->eof = 1;
+				break;
+			}
+		}
+
+		zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, "%s and %s>" ZBX_FS_UI64 " order by %s",
+				query->sql, query->column, query->last_id, query->column);
+
+		query->result = DBselectN(sql, ZBX_DBSYNC_SNAPSHOT_CHUNK);
+		query->rows_num = 0;
+		zbx_free(sql);
+
+		if (NULL == query->result)
+		{
+			query->eof = 1;
+			*row = NULL;
+
+			return FAIL;
+		}
+	}
+
+	*row = NULL;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_snapshot_query_clear                                      *
+ *                                                                            *
+ ******************************************************************************/
+static void	dbsync_snapshot_query_clear(zbx_dbsync_snapshot_query_t *query)
+{
+	DBfree_result(query->result);
+	query->result = NULL;
+	query->eof = 1;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_snapshot_db_version                                       *
+ *                                                                            *
+ * Purpose: gets the mandatory database version                               *
+ *                                                                            *
+ * Return value: the database version or -1 if it cannot be read              *
+ *                                                                            *
+ ******************************************************************************/
+static int	dbsync_snapshot_db_version(void)
+{
+	DB_RESULT	result;
+	DB_ROW		row;
+	int		version = -1;
+
+	if (NULL == (result = DBselect("select mandatory from dbversion")))
+		return -1;
+
+	if (NULL != (row = DBfetch(result)))
+		version = atoi(row[0]);
+
+	DBfree_result(result);
+
+	return version;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_snapshot_write_column                                     *
+ *                                                                            *
+ ******************************************************************************/
+static void	dbsync_snapshot_write_column(FILE *file, const char *value)
+{
+	zbx_uint32_t	len;
+
+	if (NULL == value)
+	{
+		len = ZBX_DBSYNC_SNAPSHOT_NULL;
+		fwrite(&len, sizeof(len), 1, file);
+		return;
+	}
+
+	len = (zbx_uint32_t)strlen(value);
+	fwrite(&len, sizeof(len), 1, file);
+	fwrite(value, (size_t)len + 1, 1, file);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_snapshot_write_table                                      *
+ *                                                                            *
+ * Purpose: writes the table rows to snapshot file                            *
+ *                                                                            *
+ * Parameters: file   - [IN] the snapshot file                                *
+ *             source - [IN] the table query                                  *
+ *                                                                            *
+ * Return value: SUCCEED - the table was written                              *
+ *               FAIL    - database or file write error                       *
+ *                                                                            *
+ ******************************************************************************/
+static int	dbsync_snapshot_write_table(FILE *file, const zbx_dbsync_snapshot_source_t *source)
+{
+	const char			*__function_name = "dbsync_snapshot_write_table";
+
+	zbx_dbsync_snapshot_query_t	query;
+	DB_ROW				row;
+	zbx_uint32_t			columns_num = (zbx_uint32_t)source->columns_num;
+	zbx_uint64_t			rows_num = 0, size;
+	long				header_offset, data_offset, end_offset;
+	int				i, ret;
+
+	dbsync_snapshot_write_column(file, source->name);
+	fwrite(&columns_num, sizeof(columns_num), 1, file);
+
+	if (-1 == (header_offset = ftell(file)))
+		return FAIL;
+
+	/* the number of rows and data size are updated after the rows are written */
+	fwrite(&rows_num, sizeof(rows_num), 1, file);
+	fwrite(&rows_num, sizeof(rows_num), 1, file);
+
+	if (-1 == (data_offset = ftell(file)))
+		return FAIL;
+
+	memset(&query, 0, sizeof(query));
+	query.sql = source->sql;
+	query.column = source->column;
+	query.column_index = source->column_index;
+
+	while (SUCCEED == (ret = dbsync_snapshot_query_fetch(&query, &row)) && NULL != row)
+	{
+		for (i = 0; i < source->columns_num; i++)
+			dbsync_snapshot_write_column(file, row[i]);
+
+		rows_num++;
+	}
+
+	dbsync_snapshot_query_clear(&query);
+
+	if (SUCCEED != ret || 0 != ferror(file) || -1 == (end_offset = ftell(file)))
+		return FAIL;
+
+	size = (zbx_uint64_t)(end_offset - data_offset);
+
+	if (0 != fseek(file, header_offset, SEEK_SET))
+		return FAIL;
+
+	fwrite(&rows_num, sizeof(rows_num), 1, file);
+	fwrite(&size, sizeof(size), 1, file);
+
+	if (0 != fseek(file, end_offset, SEEK_SET))
+		return FAIL;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() table:%s rows:" ZBX_FS_UI64, __function_name, source->name, rows_num);
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_dbsync_snapshot_write                                        *
+ *                                                                            *
+ * Purpose: writes configuration cache snapshot file                          *
+ *                                                                            *
+ * Parameters: path         - [IN] the snapshot file path                     *
+ *             changelogids - [IN] the sorted changelog records present in    *
+ *                                 database before the tables are read        *
+ *             sources      - [IN] the table queries                          *
+ *             sources_num  - [IN] the number of tables                       *
+ *                                                                            *
+ * Return value: SUCCEED - the snapshot was written                           *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ * Comments: The snapshot is written to a temporary file, which is renamed    *
+ *           to the target path when complete.                                *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_dbsync_snapshot_write(const char *path, const zbx_vector_uint64_t *changelogids,
+		const zbx_dbsync_snapshot_source_t *sources, int sources_num)
+{
+	const char	*__function_name = "zbx_dbsync_snapshot_write";
+
+	FILE		*file;
+	char		*path_tmp;
+	zbx_uint32_t	version = ZBX_DBSYNC_SNAPSHOT_VERSION, db_version, num;
+	zbx_uint64_t	timestamp, changelogid;
+	int		i, ret = FAIL, version_db;
+	double		sec;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() path:'%s'", __function_name, path);
+
+	sec = zbx_time();
+	path_tmp = zbx_dsprintf(NULL, "%s.tmp", path);
+
+	if (-1 == (version_db = dbsync_snapshot_db_version()))
+		goto out;
+
+	if (NULL == (file = fopen(path_tmp, "w")))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot create configuration cache snapshot file \"%s\": %s", path_tmp,
+				zbx_strerror(errno));
+		goto out;
+	}
+
+	db_version = (zbx_uint32_t)version_db;
+	timestamp = (zbx_uint64_t)time(NULL);
+	num = (zbx_uint32_t)changelogids->values_num;
+	changelogid = (0 != num ? changelogids->values[num - 1] : 0);
+
+	fwrite(ZBX_DBSYNC_SNAPSHOT_MAGIC, ZBX_CONST_STRLEN(ZBX_DBSYNC_SNAPSHOT_MAGIC), 1, file);
+	fwrite(&version, sizeof(version), 1, file);
+	fwrite(&db_version, sizeof(db_version), 1, file);
+	fwrite(&timestamp, sizeof(timestamp), 1, file);
+	fwrite(&changelogid, sizeof(changelogid), 1, file);
+	fwrite(&num, sizeof(num), 1, file);
+
+	if (0 != changelogids->values_num)
+		fwrite(changelogids->values, sizeof(zbx_uint64_t), (size_t)changelogids->values_num, file);
+
+	num = (zbx_uint32_t)sources_num;
+	fwrite(&num, sizeof(num), 1, file);
+
+	for (i = 0; i < sources_num; i++)
+	{
+		if (SUCCEED != dbsync_snapshot_write_table(file, &sources[i]))
+			break;
+	}
+
+	if (i == sources_num && 0 == ferror(file) && 0 == fflush(file) && 0 == fsync(fileno(file)))
+		ret = SUCCEED;
+
+	if (0 != fclose(file))
+		ret = FAIL;
+
+	if (SUCCEED != ret)
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot write configuration cache snapshot file \"%s\"", path_tmp);
+		unlink(path_tmp);
+		goto out;
+	}
+
+	if (0 != rename(path_tmp, path))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot rename configuration cache snapshot file \"%s\" to \"%s\": %s",
+				path_tmp, path, zbx_strerror(errno));
+		unlink(path_tmp);
+		ret = FAIL;
+		goto out;
+	}
+
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() written in " ZBX_FS_DBL " sec", __function_name, zbx_time() - sec);
+out:
+	zbx_free(path_tmp);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(ret));
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_snapshot_read                                             *
+ *                                                                            *
+ ******************************************************************************/
+static int	dbsync_snapshot_read(const char *data, size_t size, size_t *offset, void *value, size_t value_size)
+{
+	if (size - *offset < value_size)
+		return FAIL;
+
+	memcpy(value, data + *offset, value_size);
+	*offset += value_size;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_snapshot_read_column                                      *
+ *                                                                            *
+ * Purpose: reads column value                                                *
+ *                                                                            *
+ * Parameters: data   - [IN] the snapshot data                                *
+ *             size   - [IN] the snapshot data size                           *
+ *             offset - [IN/OUT] the read offset                              *
+ *             value  - [OUT] the value pointing at snapshot data, optional   *
+ *                                                                            *
+ * Return value: SUCCEED - the value was read                                 *
+ *               FAIL    - the data is corrupted                              *
+ *                                                                            *
+ ******************************************************************************/
+static int	dbsync_snapshot_read_column(const char *data, size_t size, size_t *offset, const char **value)
+{
+	zbx_uint32_t	len;
+
+	if (SUCCEED != dbsync_snapshot_read(data, size, offset, &len, sizeof(len)))
+		return FAIL;
+
+	if (ZBX_DBSYNC_SNAPSHOT_NULL == len)
+	{
+		if (NULL != value)
+			*value = NULL;
+
+		return SUCCEED;
+	}
+
+	if (size - *offset < (size_t)len + 1 || '\0' != data[*offset + len])
+		return FAIL;
+
+	if (NULL != value)
+		*value = data + *offset;
+
+	*offset += (size_t)len + 1;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_snapshot_read_table                                       *
+ *                                                                            *
+ * Purpose: reads table header and checks its rows                            *
+ *                                                                            *
+ ******************************************************************************/
+static int	dbsync_snapshot_read_table(const char *data, size_t size, size_t *offset,
+		zbx_dbsync_snapshot_data_t *table)
+{
+	zbx_uint32_t	columns_num;
+	zbx_uint64_t	data_size, row;
+	size_t		row_offset = 0;
+	int		i;
+
+	if (SUCCEED != dbsync_snapshot_read_column(data, size, offset, &table->name) || NULL == table->name ||
+			SUCCEED != dbsync_snapshot_read(data, size, offset, &columns_num, sizeof(columns_num)) ||
+			SUCCEED != dbsync_snapshot_read(data, size, offset, &table->rows_num,
+					sizeof(table->rows_num)) ||
+			SUCCEED != dbsync_snapshot_read(data, size, offset, &data_size, sizeof(data_size)) ||
+			size - *offset < data_size)
+	{
+		return FAIL;
+	}
+
+	table->columns_num = (int)columns_num;
+	table->data = data + *offset;
+	table->size = (size_t)data_size;
+	*offset += table->size;
+
+	/* check the rows, so the configuration is not loaded partially */
+	for (row = 0; row < table->rows_num; row++)
+	{
+		for (i = 0; i < table->columns_num; i++)
+		{
+			if (SUCCEED != dbsync_snapshot_read_column(table->data, table->size, &row_offset, NULL))
+				return FAIL;
+		}
+	}
+
+	return row_offset == table->size ? SUCCEED : FAIL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_dbsync_snapshot_load                                         *
+ *                                                                            *
+ * Purpose: loads configuration cache snapshot file                           *
+ *                                                                            *
+ * Parameters: snapshot - [OUT] the loaded snapshot                           *
+ *             path     - [IN] the snapshot file path                         *
+ *                                                                            *
+ * Return value: SUCCEED - the snapshot was loaded                            *
+ *               FAIL    - the snapshot file is missing, corrupted or was     *
+ *                         written for another database version               *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_dbsync_snapshot_load(zbx_dbsync_snapshot_t **snapshot, const char *path)
+{
+	const char		*__function_name = "zbx_dbsync_snapshot_load";
+
+	int			fd, i, ret = FAIL;
+	struct stat		st;
+	void			*data;
+	const char		*ptr;
+	size_t			offset, size;
+	zbx_uint32_t		version, db_version, num;
+	zbx_uint64_t		timestamp, changelogid;
+	zbx_dbsync_snapshot_t	*ss;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() path:'%s'", __function_name, path);
+
+	if (-1 == (fd = open(path, O_RDONLY)))
+	{
+		if (ENOENT != errno)
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot open configuration cache snapshot file \"%s\": %s", path,
+					zbx_strerror(errno));
+		}
+		goto out;
+	}
+
+	if (0 != fstat(fd, &st) || 0 == st.st_size)
+	{
+		close(fd);
+		goto out;
+	}
+
+	/* the rows are passed to configuration sync, which might modify column values in place */
+	if (MAP_FAILED == (data = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot map configuration cache snapshot file \"%s\": %s", path,
+				zbx_strerror(errno));
+		close(fd);
+		goto out;
+	}
+
+	close(fd);
+
+	ptr = (const char *)data;
+	size = (size_t)st.st_size;
+	offset = ZBX_CONST_STRLEN(ZBX_DBSYNC_SNAPSHOT_MAGIC);
+
+	if (size < offset || 0 != memcmp(ptr, ZBX_DBSYNC_SNAPSHOT_MAGIC, offset) ||
+			SUCCEED != dbsync_snapshot_read(ptr, size, &offset, &version, sizeof(version)) ||
+			ZBX_DBSYNC_SNAPSHOT_VERSION != version ||
+			SUCCEED != dbsync_snapshot_read(ptr, size, &offset, &db_version, sizeof(db_version)) ||
+			SUCCEED != dbsync_snapshot_read(ptr, size, &offset, &timestamp, sizeof(timestamp)) ||
+			SUCCEED != dbsync_snapshot_read(ptr, size, &offset, &changelogid, sizeof(changelogid)) ||
+			SUCCEED != dbsync_snapshot_read(ptr, size, &offset, &num, sizeof(num)) ||
+			(size - offset) / sizeof(zbx_uint64_t) < num)
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot load configuration cache snapshot file \"%s\": incompatible"
+				" file format", path);
+		munmap(data, size);
+		goto out;
+	}
+
+	if ((int)db_version != dbsync_snapshot_db_version())
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot load configuration cache snapshot file \"%s\": it was written"
+				" for another database version", path);
+		munmap(data, size);
+		goto out;
+	}
+
+	ss = (zbx_dbsync_snapshot_t *)zbx_malloc(NULL, sizeof(zbx_dbsync_snapshot_t));
+	ss->data = data;
+	ss->size = size;
+	ss->timestamp = timestamp;
+	ss->changelogid = changelogid;
+	ss->tables = NULL;
+	ss->tables_num = 0;
+
+	zbx_vector_uint64_create(&ss->changelogids);
+	zbx_vector_uint64_reserve(&ss->changelogids, num);
+
+	for (i = 0; i < (int)num; i++)
+	{
+		zbx_uint64_t	changelogid;
+
+		if (SUCCEED != dbsync_snapshot_read(ptr, size, &offset, &changelogid, sizeof(changelogid)))
+			goto fail;
+
+		zbx_vector_uint64_append(&ss->changelogids, changelogid);
+	}
+
+	zbx_vector_uint64_sort(&ss->changelogids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+	if (0 != ss->changelogids.values_num &&
+			changelogid != ss->changelogids.values[ss->changelogids.values_num - 1])
+	{
+		goto fail;
+	}
+
+	if (SUCCEED != dbsync_snapshot_read(ptr, size, &offset, &num, sizeof(num)) || 0 == num)
+		goto fail;
+
+	ss->tables = (zbx_dbsync_snapshot_data_t *)zbx_malloc(NULL, sizeof(zbx_dbsync_snapshot_data_t) * num);
+
+	for (ss->tables_num = 0; ss->tables_num < (int)num; ss->tables_num++)
+	{
+		if (SUCCEED != dbsync_snapshot_read_table(ptr, size, &offset, &ss->tables[ss->tables_num]))
+			goto fail;
+	}
+
+	if (offset != size)
+		goto fail;
+
+	*snapshot = ss;
+	ret = SUCCEED;
+
+	zabbix_log(LOG_LEVEL_INFORMATION, "loaded configuration cache snapshot written %d seconds ago",
+			(int)(time(NULL) - (time_t)timestamp));
+	goto out;
+fail:
+	zabbix_log(LOG_LEVEL_WARNING, "cannot load configuration cache snapshot file \"%s\": file is corrupted",
+			path);
+	zbx_dbsync_snapshot_free(ss);
+out:
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(ret));
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_dbsync_snapshot_free                                         *
+ *                                                                            *
+ * Purpose: unmaps snapshot file and frees snapshot                           *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_dbsync_snapshot_free(zbx_dbsync_snapshot_t *snapshot)
+{
+	munmap(snapshot->data, snapshot->size);
+	zbx_vector_uint64_destroy(&snapshot->changelogids);
+	zbx_free(snapshot->tables);
+	zbx_free(snapshot);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_dbsync_snapshot_get_changelog                                *
+ *                                                                            *
+ * Purpose: gets the changelog records included in snapshot                  *
+ *                                                                            *
+ * Parameters: snapshot     - [IN] the snapshot                               *
+ *             changelogids - [OUT] the sorted changelog record ids           *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_dbsync_snapshot_get_changelog(const zbx_dbsync_snapshot_t *snapshot, zbx_vector_uint64_t *changelogids)
+{
+	zbx_vector_uint64_append_array(changelogids, snapshot->changelogids.values,
+			snapshot->changelogids.values_num);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_dbsync_snapshot_get_newest                                   *
+ *                                                                            *
+ * Purpose: gets the newest changelog record included in snapshot and the     *
+ *          snapshot write time                                               *
+ *                                                                            *
+ * Parameters: snapshot    - [IN] the snapshot                                *
+ *             changelogid - [OUT] the newest changelog record id or 0 if     *
+ *                                 changelog was empty                        *
+ *             timestamp   - [OUT] the snapshot write time                    *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_dbsync_snapshot_get_newest(const zbx_dbsync_snapshot_t *snapshot, zbx_uint64_t *changelogid,
+		int *timestamp)
+{
+	*changelogid = snapshot->changelogid;
+	*timestamp = (int)snapshot->timestamp;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: dbsync_snapshot_refresh_next                                     *
+ *                                                                            *
+ * Purpose: fetches the next object id and runtime columns from database      *
+ *                                                                            *
+ ******************************************************************************/
+static void	dbsync_snapshot_refresh_next(zbx_dbsync_snapshot_table_t *table)
+{
+	if (SUCCEED != dbsync_snapshot_query_fetch(&table->query, &table->dbrow))
+		table->ret = FAIL;
+
+	if (NULL != table->dbrow)
+		table->dbrow_id = table->query.last_id;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_dbsync_snapshot_open                                         *
+ *                                                                            *
+ * Purpose: starts reading table rows from snapshot                           *
+ *                                                                            *
+ * Parameters: snapshot - [IN] the snapshot                                   *
+ *             table    - [OUT] the snapshot table reader                     *
+ *             source   - [IN] the table queries                              *
+ *             new_ids  - [OUT] the ids of objects missing from snapshot      *
+ *                                                                            *
+ * Return value: SUCCEED - the table rows can be read from snapshot           *
+ *               FAIL    - the table is not in snapshot, has other columns or *
+ *                         the database query failed                          *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_dbsync_snapshot_open(const zbx_dbsync_snapshot_t *snapshot, zbx_dbsync_snapshot_table_t **table,
+		const zbx_dbsync_snapshot_source_t *source, zbx_vector_uint64_t *new_ids)
+{
+	int				i;
+	zbx_dbsync_snapshot_table_t	*tbl;
+
+	for (i = 0; i < snapshot->tables_num; i++)
+	{
+		if (0 == strcmp(snapshot->tables[i].name, source->name))
+			break;
+	}
+
+	if (i == snapshot->tables_num || source->columns_num != snapshot->tables[i].columns_num)
+		return FAIL;
+
+	tbl = (zbx_dbsync_snapshot_table_t *)zbx_malloc(NULL, sizeof(zbx_dbsync_snapshot_table_t));
+	memset(tbl, 0, sizeof(zbx_dbsync_snapshot_table_t));
+
+	tbl->data = snapshot->tables[i].data;
+	tbl->size = snapshot->tables[i].size;
+	tbl->columns_num = source->columns_num;
+	tbl->id_index = source->column_index;
+	tbl->row = (char **)zbx_malloc(NULL, sizeof(char *) * source->columns_num);
+
+	tbl->refresh_sql = zbx_strdup(NULL, source->refresh_sql);
+	tbl->refresh_index = source->refresh_index;
+	tbl->refresh_num = source->refresh_num;
+	tbl->query.sql = tbl->refresh_sql;
+	tbl->query.column = source->column;
+	tbl->new_ids = new_ids;
+	tbl->ret = SUCCEED;
+
+	/* fall back to database if the object ids cannot be read */
+	dbsync_snapshot_refresh_next(tbl);
+
+	if (SUCCEED != tbl->ret)
+	{
+		zbx_dbsync_snapshot_close(tbl);
+		return FAIL;
+	}
+
+	*table = tbl;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_dbsync_snapshot_fetch                                        *
+ *                                                                            *
+ * Purpose: gets the next table row from snapshot                             *
+ *                                                                            *
+ * Return value: the row or NULL if there are no more rows                    *
+ *                                                                            *
+ * Comments: The returned row is valid until the next call.                   *
+ *           The rows of objects removed from database are skipped, the       *
+ *           runtime columns are taken from database.                         *
+ *                                                                            *
+ ******************************************************************************/
+DB_ROW	zbx_dbsync_snapshot_fetch(zbx_dbsync_snapshot_table_t *table)
+{
+	zbx_uint64_t	id;
+	int		i;
+
+	/* the runtime columns of the last returned row were pointing at the current database row */
+	if (0 != table->refresh_pending)
+	{
+		dbsync_snapshot_refresh_next(table);
+		table->refresh_pending = 0;
+	}
+
+	while (table->offset < table->size && SUCCEED == table->ret)
+	{
+		for (i = 0; i < table->columns_num; i++)
+		{
+			dbsync_snapshot_read_column(table->data, table->size, &table->offset,
+					(const char **)&table->row[i]);
+		}
+
+		ZBX_STR2UINT64(id, table->row[table->id_index]);
+
+		/* the objects added after the snapshot was written */
+		while (NULL != table->dbrow && table->dbrow_id < id)
+		{
+			zbx_vector_uint64_append(table->new_ids, table->dbrow_id);
+			dbsync_snapshot_refresh_next(table);
+		}
+
+		/* the object was removed after the snapshot was written */
+		if (NULL == table->dbrow || table->dbrow_id != id)
+			continue;
+
+		for (i = 0; i < table->refresh_num; i++)
+			table->row[table->refresh_index[i]] = table->dbrow[i + 1];
+
+		table->refresh_pending = 1;
+
+		return table->row;
+	}
+
+	while (NULL != table->dbrow)
+	{
+		zbx_vector_uint64_append(table->new_ids, table->dbrow_id);
+		dbsync_snapshot_refresh_next(table);
+	}
+
+	return NULL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_dbsync_snapshot_close                                        *
+ *                                                                            *
+ * Purpose: stops reading table rows from snapshot                            *
+ *                                                                            *
+ * Return value: SUCCEED - the table was read successfully                    *
+ *               FAIL    - the database query failed, not all rows were read  *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_dbsync_snapshot_close(zbx_dbsync_snapshot_table_t *table)
+{
+	int	ret = table->ret;
+
+	dbsync_snapshot_query_clear(&table->query);
+	zbx_free(table->refresh_sql);
+	zbx_free(table->row);
+	zbx_free(table);
+
+	return ret;
+}
@@ -28,6 +28,8 @@
 
 #include "vectorimpl.h"
 
+#include <sys/mman.h>
+
 /*
  * The cache (zbx_vc_cache_t) is organized as a hashset of item records (zbx_vc_item_t).
  *
@@ -52,6 +54,24 @@
  *
  * The low memory mode can't be turned off - it will persist until server is rebooted.
  * In low memory mode a warning message is written into log every 5 minutes.
+ *
+ * To reduce lock contention between history syncers the cache is partitioned by itemid
+ * into stripes (zbx_vc_stripe_t). Each stripe has its own lock, item hashset and string
+ * pool, so requests for items in different stripes do not block each other. All stripes
+ * allocate from the same shared memory segment, protected by a separate allocator lock
+ * that is taken only for the duration of allocation. So a busy stripe can use the space
+ * not needed by other stripes. When the cache runs out of memory the items are dropped
+ * by their weight across the stripe of the requesting item and all other stripes that
+ * can be locked without waiting, as described above. The cache functions operate on the
+ * currently selected stripe (vc_cache), which is chosen by vc_stripe_select() before
+ * locking.
+ *
+ * For time based sum/avg/min/max/count requests the item keeps aggregates (zbx_vc_aggr_t)
+ * that are updated whenever a new value is added to the item cache. When requested, only
+ * the values that left the time window since the last request are removed from aggregate.
+ * The values are kept in aggregate for a minute after leaving the window, so requests with
+ * slightly older window end can be served too. Older requests recreate the aggregate from
+ * cached values.
  */
 
 /* the period of low memory warning messages */
@@ -60,9 +80,31 @@
 /* time period after which value cache will switch back to normal mode */
 #define ZBX_VC_LOW_MEMORY_RESET_PERIOD		SEC_PER_DAY
 
+/* the minimum cache size per stripe, used to calculate the number of stripes */
+#define ZBX_VC_STRIPE_MIN_SIZE			(8 * ZBX_MEBIBYTE)
+
+/* the value cache stripe */
+typedef struct
+{
+	/* the stripe lock */
+	zbx_mutex_t		lock;
+
+	/* the stripe cache data, see zbx_vc_cache_t */
+	struct zbx_vc_cache	*cache;
+}
+zbx_vc_stripe_t;
+
+static zbx_vc_stripe_t	vc_stripes[ZBX_MUTEX_VALUECACHE_NUM];
+static int		vc_stripes_num = 0;
+
+/* the currently selected stripe */
+static zbx_vc_stripe_t	*vc_stripe = &vc_stripes[0];
+
+/* the value cache shared memory segment, used by all stripes */
 static zbx_mem_info_t	*vc_mem = NULL;
 
-static zbx_mutex_t	vc_lock = ZBX_MUTEX_NULL;
+/* the value cache shared memory segment lock */
+static zbx_mutex_t	vc_mem_lock = ZBX_MUTEX_NULL;
 
 /* flag indicating that the cache was explicitly locked by this process */
 static int	vc_locked = 0;
@@ -77,7 +119,7 @@ static int	vc_state = ZBX_VC_DISABLED;
 /* the value cache size */
 extern zbx_uint64_t	CONFIG_VALUE_CACHE_SIZE;
 
-ZBX_MEM_FUNC_IMPL(__vc, vc_mem)
+ZBX_MEM_FUNC_DECL(__vc)
 
 #define VC_STRPOOL_INIT_SIZE	(1000)
 #define VC_ITEMS_INIT_SIZE	(1000)
@@ -109,11 +151,20 @@ typedef struct zbx_vc_chunk
 	/* the number of item value slots in chunk */
 	int			slots_num;
 
-	/* the item value data */
+	/* the size of compressed value data or 0 if chunk is not compressed */
+	int			compressed_size;
+
+	/* the compressed chunk identifier, used to cache decoded values */
+	zbx_uint64_t		compressed_id;
+
+	/* the item value data or compressed value data stream */
 	zbx_history_record_t	slots[1];
 }
 zbx_vc_chunk_t;
 
+/* the number of decoded compressed chunks cached by each process */
+#define ZBX_VC_DECODED_CHUNKS		4
+
 /* min/max number number of item history values to store in chunk */
 
 #define ZBX_VC_MIN_CHUNK_RECORDS	2
@@ -122,6 +173,49 @@ zbx_vc_chunk_t;
 #define ZBX_VC_MAX_CHUNK_RECORDS	((64 * ZBX_KIBIBYTE - sizeof(zbx_vc_chunk_t)) / \
 		sizeof(zbx_history_record_t) + 1)
 
+/* the incremental aggregate of item values in a sliding time window */
+typedef struct zbx_vc_aggr
+{
+	/* the next aggregate of the same item */
+	struct zbx_vc_aggr	*next;
+
+	/* the aggregate function (ZBX_VC_AGGR_*) */
+	unsigned char		func;
+
+	/* the window size in seconds */
+	int			seconds;
+
+	/* the last time the aggregate was requested */
+	int			last_accessed;
+
+	/* the aggregate contains all item values newer than this timestamp */
+	zbx_timespec_t		start;
+
+	/* The ring buffer of values in ascending timestamp order. For min/max */
+	/* functions it holds only the values that can still become the result */
+	/* (monotonic deque), for other functions all values in the window.   */
+	zbx_history_record_t	*values;
+	int			values_alloc;
+	int			values_first;
+	int			values_num;
+
+	/* the running sum of values and its rounding error compensation */
+	history_value_t		sum;
+	double			sum_error;
+
+	/* the number of values removed since the running sum was last recalculated */
+	int			sum_removed;
+}
+zbx_vc_aggr_t;
+
+/* the initial number of values in aggregate ring buffer */
+#define ZBX_VC_AGGR_VALUES_INIT		16
+
+/* The period values are kept in aggregate after leaving the requested window, so */
+/* requests with slightly older window end (for example, when triggers are        */
+/* evaluated by timer and by new values) do not require recreating aggregate.     */
+#define ZBX_VC_AGGR_KEEP_PERIOD		SEC_PER_MIN
+
 /* the item operational state flags */
 #define ZBX_ITEM_STATE_CLEAN_PENDING	1
 #define ZBX_ITEM_STATE_REMOVE_PENDING	2
@@ -184,11 +278,14 @@ typedef struct
 
 	/* the first (oldest) chunk of item history data              */
 	zbx_vc_chunk_t	*tail;
+
+	/* the incremental window aggregates of item values           */
+	zbx_vc_aggr_t	*aggrs;
 }
 zbx_vc_item_t;
 
 /* the value cache data  */
-typedef struct
+typedef struct zbx_vc_cache
 {
 	/* the number of cache hits, used for statistics */
 	zbx_uint64_t	hits;
@@ -196,6 +293,20 @@ typedef struct
 	/* the number of cache misses, used for statistics */
 	zbx_uint64_t	misses;
 
+	/* the cached items */
+	zbx_hashset_t	items;
+
+	/* the string pool for str, text and log item values */
+	zbx_hashset_t	strpool;
+
+	/* the last compressed chunk identifier */
+	zbx_uint64_t	compressed_id;
+}
+zbx_vc_cache_t;
+
+/* the value cache data shared by all stripes, protected by the memory segment lock */
+typedef struct
+{
 	/* value cache operating mode - see ZBX_VC_MODE_* defines */
 	int		mode;
 
@@ -207,14 +318,8 @@ typedef struct
 
 	/* the minimum number of bytes to be freed when cache runs out of space */
 	size_t		min_free_request;
-
-	/* the cached items */
-	zbx_hashset_t	items;
-
-	/* the string pool for str, text and log item values */
-	zbx_hashset_t	strpool;
 }
-zbx_vc_cache_t;
+zbx_vc_shared_t;
 
 /* the item weight data, used to determine if item can be removed from cache */
 typedef struct
@@ -222,6 +327,9 @@ typedef struct
 	/* a pointer to the value cache item */
 	zbx_vc_item_t	*item;
 
+	/* the index of the stripe storing the item */
+	int		stripe;
+
 	/* the item 'weight' - <number of hits> / <number of cache records> */
 	double		weight;
 }
@@ -230,9 +338,12 @@ zbx_vc_item_weight_t;
 ZBX_VECTOR_DECL(vc_itemweight, zbx_vc_item_weight_t)
 ZBX_VECTOR_IMPL(vc_itemweight, zbx_vc_item_weight_t)
 
-/* the value cache */
+/* the value cache data of the currently selected stripe */
 static zbx_vc_cache_t	*vc_cache = NULL;
 
+/* the value cache data shared by all stripes */
+static zbx_vc_shared_t	*vc_shared = NULL;
+
 /* function prototypes */
 static void	vc_history_record_copy(zbx_history_record_t *dst, const zbx_history_record_t *src, int value_type);
 static void	vc_history_record_vector_clean(zbx_vector_history_record_t *vector, int value_type);
@@ -241,33 +352,114 @@ static size_t	vch_item_free_cache(zbx_vc_item_t *item);
 static size_t	vch_item_free_chunk(zbx_vc_item_t *item, zbx_vc_chunk_t *chunk);
 static int	vch_item_add_values_at_tail(zbx_vc_item_t *item, const zbx_history_record_t *values, int values_num);
 static void	vch_item_clean_cache(zbx_vc_item_t *item);
+static size_t	vch_aggr_free(zbx_vc_aggr_t *aggr);
+static size_t	vch_item_free_aggrs(zbx_vc_item_t *item);
+static void	vch_item_update_aggrs(zbx_vc_item_t *item, const zbx_history_record_t *value);
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vc_get_stripe                                                    *
+ *                                                                            *
+ * Purpose: gets index of the stripe storing the specified item               *
+ *                                                                            *
+ * Parameters: itemid - [IN] the item id                                      *
+ *                                                                            *
+ * Return value: the stripe index                                             *
+ *                                                                            *
+ ******************************************************************************/
+static int	vc_get_stripe(zbx_uint64_t itemid)
+{
+	if (1 >= vc_stripes_num)
+		return 0;
+
+	return (int)(ZBX_DEFAULT_UINT64_HASH_FUNC(&itemid) % (zbx_hash_t)vc_stripes_num);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vc_stripe_select                                                 *
+ *                                                                            *
+ * Purpose: selects the stripe the cache functions will operate on            *
+ *                                                                            *
+ * Parameters: stripe - [IN] the stripe index                                 *
+ *                                                                            *
+ * Comments: The stripe must be selected before locking it with vc_try_lock() *
+ *           and must not be changed until it is unlocked.                    *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_stripe_select(int stripe)
+{
+	vc_stripe = &vc_stripes[stripe];
+	vc_cache = vc_stripe->cache;
+}
 
 /******************************************************************************
  *                                                                            *
  * Function: vc_try_lock                                                      *
  *                                                                            *
- * Purpose: locks the cache unless it was explicitly locked externally with   *
- *          zbx_vc_lock() call.                                               *
+ * Purpose: locks the selected cache stripe unless the cache was explicitly   *
+ *          locked externally with zbx_vc_lock() call.                        *
  *                                                                            *
  ******************************************************************************/
 static void	vc_try_lock(void)
 {
 	if (ZBX_VC_ENABLED == vc_state && 0 == vc_locked)
-		zbx_mutex_lock(vc_lock);
+		zbx_mutex_lock(vc_stripe->lock);
 }
 
 /******************************************************************************
  *                                                                            *
  * Function: vc_try_unlock                                                    *
  *                                                                            *
- * Purpose: unlocks the cache locked by vc_try_lock() function unless it was  *
- *          explicitly locked externally with zbx_vc_lock() call.             *
+ * Purpose: unlocks the cache stripe locked by vc_try_lock() function unless  *
+ *          the cache was explicitly locked externally with zbx_vc_lock()     *
+ *          call.                                                             *
  *                                                                            *
  ******************************************************************************/
 static void	vc_try_unlock(void)
 {
 	if (ZBX_VC_ENABLED == vc_state && 0 == vc_locked)
-		zbx_mutex_unlock(vc_lock);
+		zbx_mutex_unlock(vc_stripe->lock);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: __vc_mem_malloc_func, __vc_mem_realloc_func, __vc_mem_free_func  *
+ *                                                                            *
+ * Purpose: value cache memory allocation functions                           *
+ *                                                                            *
+ * Comments: The shared memory segment is used by all stripes, so it is       *
+ *           locked with a separate lock for the duration of allocation. This *
+ *           lock must not be held while locking the stripes.                 *
+ *                                                                            *
+ ******************************************************************************/
+static void	*__vc_mem_malloc_func(void *old, size_t size)
+{
+	void	*ptr;
+
+	zbx_mutex_lock(vc_mem_lock);
+	ptr = zbx_mem_malloc(vc_mem, old, size);
+	zbx_mutex_unlock(vc_mem_lock);
+
+	return ptr;
+}
+
+static void	*__vc_mem_realloc_func(void *old, size_t size)
+{
+	void	*ptr;
+
+	zbx_mutex_lock(vc_mem_lock);
+	ptr = zbx_mem_realloc(vc_mem, old, size);
+	zbx_mutex_unlock(vc_mem_lock);
+
+	return ptr;
+}
+
+static void	__vc_mem_free_func(void *ptr)
+{
+	zbx_mutex_lock(vc_mem_lock);
+	zbx_mem_free(vc_mem, ptr);
+	zbx_mutex_unlock(vc_mem_lock);
 }
 
 /*********************************************************************************
@@ -669,26 +861,42 @@ static void	vc_update_statistics(zbx_vc_item_t *item, int hits, int misses)
  ******************************************************************************/
 static void	vc_warn_low_memory(void)
 {
-	int	now;
+	int	now, warning = 0;
 
 	now = time(NULL);
 
-	if (now - vc_cache->mode_time > ZBX_VC_LOW_MEMORY_RESET_PERIOD)
+	zbx_mutex_lock(vc_mem_lock);
+
+	if (now - vc_shared->mode_time > ZBX_VC_LOW_MEMORY_RESET_PERIOD)
+	{
+		vc_shared->mode = ZBX_VC_MODE_NORMAL;
+		vc_shared->mode_time = now;
+		warning = 1;
+	}
+	else if (now - vc_shared->last_warning_time > ZBX_VC_LOW_MEMORY_WARNING_PERIOD)
 	{
-		vc_cache->mode = ZBX_VC_MODE_NORMAL;
-		vc_cache->mode_time = now;
+		vc_shared->last_warning_time = now;
+		warning = 2;
+	}
 
+	zbx_mutex_unlock(vc_mem_lock);
+
+	if (1 == warning)
+	{
 		zabbix_log(LOG_LEVEL_WARNING, "value cache has been switched from low memory to normal operation mode");
 	}
-	else if (now - vc_cache->last_warning_time > ZBX_VC_LOW_MEMORY_WARNING_PERIOD)
+	else if (2 == warning)
 	{
-		vc_cache->last_warning_time = now;
-
 		zabbix_log(LOG_LEVEL_WARNING, "value cache is fully used: please increase ValueCacheSize"
 				" configuration parameter");
 	}
 }
 
+/* the stripe lock state during space release */
+#define ZBX_VC_STRIPE_BUSY	0
+#define ZBX_VC_STRIPE_LOCKED	1
+#define ZBX_VC_STRIPE_HELD	2
+
 /******************************************************************************
  *                                                                            *
  * Function: vc_release_space                                                 *
@@ -705,59 +913,91 @@ static void	vc_warn_low_memory(void)
  *           vc_free_space() attempts to free at least min_free_request       *
  *           bytes of space to reduce number of space release requests.       *
  *                                                                            *
+ *           The items are dropped from the selected stripe and from all      *
+ *           other stripes that are not locked by other processes. Waiting    *
+ *           for the other stripes while holding the selected stripe lock     *
+ *           could lead to deadlock, so busy stripes are skipped.             *
+ *                                                                            *
  ******************************************************************************/
 static void	vc_release_space(zbx_vc_item_t *source_item, size_t space)
 {
 	zbx_hashset_iter_t		iter;
 	zbx_vc_item_t			*item;
-	int				timestamp, i;
+	int				timestamp, i, stripe, source_stripe, locked[ZBX_MUTEX_VALUECACHE_NUM];
 	size_t				freed = 0;
 	zbx_vector_vc_itemweight_t	items;
 
 	timestamp = time(NULL) - ZBX_VC_ITEM_EXPIRE_PERIOD;
+	source_stripe = (int)(vc_stripe - vc_stripes);
 
 	/* reserve at least min_free_request bytes to avoid spamming with free space requests */
-	if (space < vc_cache->min_free_request)
-		space = vc_cache->min_free_request;
+	if (space < vc_shared->min_free_request)
+		space = vc_shared->min_free_request;
 
-	/* first remove items with the last accessed time older than a day */
-	zbx_hashset_iter_reset(&vc_cache->items, &iter);
+	for (stripe = 0; stripe < vc_stripes_num; stripe++)
+	{
+		if (stripe == source_stripe || ZBX_VC_ENABLED != vc_state || 0 != vc_locked)
+			locked[stripe] = ZBX_VC_STRIPE_HELD;
+		else if (SUCCEED == zbx_mutex_trylock(vc_stripes[stripe].lock))
+			locked[stripe] = ZBX_VC_STRIPE_LOCKED;
+		else
+			locked[stripe] = ZBX_VC_STRIPE_BUSY;
+	}
 
-	while (NULL != (item = (zbx_vc_item_t *)zbx_hashset_iter_next(&iter)))
+	/* first remove items with the last accessed time older than a day */
+	for (stripe = 0; stripe < vc_stripes_num; stripe++)
 	{
-		if (0 == item->refcount && source_item != item && item->last_accessed < timestamp)
+		if (ZBX_VC_STRIPE_BUSY == locked[stripe])
+			continue;
+
+		vc_stripe_select(stripe);
+		zbx_hashset_iter_reset(&vc_cache->items, &iter);
+
+		while (NULL != (item = (zbx_vc_item_t *)zbx_hashset_iter_next(&iter)))
 		{
-			freed += vch_item_free_cache(item) + sizeof(zbx_vc_item_t);
-			zbx_hashset_iter_remove(&iter);
+			if (0 == item->refcount && source_item != item && item->last_accessed < timestamp)
+			{
+				freed += vch_item_free_cache(item) + sizeof(zbx_vc_item_t);
+				zbx_hashset_iter_remove(&iter);
+			}
 		}
 	}
 
 	if (freed >= space)
-		return;
+		goto out;
 
 	/* failed to free enough space by removing old items, entering low memory mode */
-	vc_cache->mode = ZBX_VC_MODE_LOWMEM;
-	vc_cache->mode_time = time(NULL);
+	zbx_mutex_lock(vc_mem_lock);
+	vc_shared->mode = ZBX_VC_MODE_LOWMEM;
+	vc_shared->mode_time = time(NULL);
+	zbx_mutex_unlock(vc_mem_lock);
 
 	vc_warn_low_memory();
 
 	/* remove items with least hits/size ratio */
 	zbx_vector_vc_itemweight_create(&items);
 
-	zbx_hashset_iter_reset(&vc_cache->items, &iter);
-
-	while (NULL != (item = (zbx_vc_item_t *)zbx_hashset_iter_next(&iter)))
+	for (stripe = 0; stripe < vc_stripes_num; stripe++)
 	{
-		/* don't remove the item that requested the space and also keep */
-		/* items currently being accessed                               */
-		if (0 == item->refcount)
+		if (ZBX_VC_STRIPE_BUSY == locked[stripe])
+			continue;
+
+		vc_stripe_select(stripe);
+		zbx_hashset_iter_reset(&vc_cache->items, &iter);
+
+		while (NULL != (item = (zbx_vc_item_t *)zbx_hashset_iter_next(&iter)))
 		{
-			zbx_vc_item_weight_t	weight = {.item = item};
+			/* don't remove the item that requested the space and also keep */
+			/* items currently being accessed                               */
+			if (0 == item->refcount)
+			{
+				zbx_vc_item_weight_t	weight = {.item = item, .stripe = stripe};
 
-			if (0 < item->values_total)
-				weight.weight = (double)item->hits / item->values_total;
+				if (0 < item->values_total)
+					weight.weight = (double)item->hits / item->values_total;
 
-			zbx_vector_vc_itemweight_append_ptr(&items, &weight);
+				zbx_vector_vc_itemweight_append_ptr(&items, &weight);
+			}
 		}
 	}
 
@@ -766,11 +1006,20 @@ static void	vc_release_space(zbx_vc_item_t *source_item, size_t space)
 	for (i = 0; i < items.values_num && freed < space; i++)
 	{
 		item = items.values[i].item;
+		vc_stripe_select(items.values[i].stripe);
 
 		freed += vch_item_free_cache(item) + sizeof(zbx_vc_item_t);
 		zbx_hashset_remove_direct(&vc_cache->items, item);
 	}
 	zbx_vector_vc_itemweight_destroy(&items);
+out:
+	for (stripe = 0; stripe < vc_stripes_num; stripe++)
+	{
+		if (ZBX_VC_STRIPE_LOCKED == locked[stripe])
+			zbx_mutex_unlock(vc_stripes[stripe].lock);
+	}
+
+	vc_stripe_select(source_stripe);
 }
 
 /******************************************************************************
@@ -1179,1542 +1428,3572 @@ static void	vc_item_update_db_cached_from(zbx_vc_item_t *item, int timestamp)
  *
  * After adding a new chunk, the older chunks (outside the largest request
  * range) are automatically removed from cache.
+ *
+ * Filled chunks of numeric (float and unsigned) items, except the head chunk,
+ * are compressed. The timestamp seconds are stored as delta-of-delta values,
+ * nanoseconds are stored only when changed and values are stored as XOR with
+ * the previous value (Gorilla encoding). The compressed chunks are decoded into
+ * process local memory on access with vch_chunk_slots(). Compressed chunks are
+ * never modified except their first value index - when values are inserted
+ * into compressed chunk it is decompressed first.
  */
 
+/* the bit stream used to encode/decode compressed chunks */
+typedef struct
+{
+	unsigned char	*data;
+	size_t		offset;		/* the offset in bits */
+}
+zbx_vc_bitstream_t;
+
+/* the process local cache of decoded chunks */
+typedef struct
+{
+	const zbx_vc_chunk_t	*chunk;
+	zbx_uint64_t		compressed_id;
+	zbx_history_record_t	*slots;
+	int			slots_alloc;
+}
+zbx_vc_decoded_chunk_t;
+
+static zbx_vc_decoded_chunk_t	vc_decoded[ZBX_VC_DECODED_CHUNKS];
+static int			vc_decoded_next = 0;
+
 /******************************************************************************
  *                                                                            *
- * Function: vch_item_update_range                                            *
+ * Function: vc_bits_write                                                    *
  *                                                                            *
- * Purpose: updates item range with current request range                     *
+ * Purpose: writes the lowest bits of value into bit stream                   *
  *                                                                            *
- * Parameters: item   - [IN] the item                                         *
- *             range  - [IN] the request range                                *
- *             now    - [IN] the current timestamp                            *
+ * Comments: the stream data must be zero initialized                         *
  *                                                                            *
  ******************************************************************************/
-static void	vch_item_update_range(zbx_vc_item_t *item, int range, int now)
+static void	vc_bits_write(zbx_vc_bitstream_t *bs, zbx_uint64_t value, int bits)
 {
-	int	hour, diff;
-
-	if (VC_MIN_RANGE > range)
-		range = VC_MIN_RANGE;
-
-	if (item->daily_range < range)
-		item->daily_range = range;
-
-	hour = (now / SEC_PER_HOUR) & 0xff;
-
-	if (0 > (diff = hour - item->range_sync_hour))
-		diff += 0xff;
+	int	free_bits, n;
 
-	if (item->active_range < item->daily_range || ZBX_VC_RANGE_SYNC_PERIOD < diff)
+	while (0 < bits)
 	{
-		item->active_range = item->daily_range;
-		item->daily_range = range;
-		item->range_sync_hour = hour;
+		free_bits = 8 - (int)(bs->offset & 7);
+		n = MIN(free_bits, bits);
+		bits -= n;
+
+		bs->data[bs->offset >> 3] |= (unsigned char)(((value >> bits) & ((1 << n) - 1)) << (free_bits - n));
+		bs->offset += n;
 	}
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: vch_item_chunk_slot_count                                        *
- *                                                                            *
- * Purpose: calculates optimal number of slots for an item data chunk         *
- *                                                                            *
- * Parameters:  item        - [IN] the item                                   *
- *              values_new  - [IN] the number of values to be added           *
- *                                                                            *
- * Return value: the number of slots for a new item data chunk                *
+ * Function: vc_bits_read                                                     *
  *                                                                            *
- * Comments: From size perspective the optimal slot count per chunk is        *
- *           approximately square root of the number of cached values.        *
- *           Still creating too many chunks might affect timeshift request    *
- *           performance, so don't try creating more than 32 chunks unless    *
- *           the calculated slot count exceeds the maximum limit.             *
+ * Purpose: reads the specified number of bits from bit stream                *
  *                                                                            *
  ******************************************************************************/
-static int	vch_item_chunk_slot_count(zbx_vc_item_t *item, int values_new)
+static zbx_uint64_t	vc_bits_read(zbx_vc_bitstream_t *bs, int bits)
 {
-	int	nslots, values;
+	zbx_uint64_t	value = 0;
+	int		avail_bits, n;
 
-	values = item->values_total + values_new;
-
-	nslots = zbx_isqrt32(values);
-
-	if ((values + nslots - 1) / nslots + 1 > 32)
-		nslots = values / 32;
+	while (0 < bits)
+	{
+		avail_bits = 8 - (int)(bs->offset & 7);
+		n = MIN(avail_bits, bits);
+		bits -= n;
 
-	if (nslots > (int)ZBX_VC_MAX_CHUNK_RECORDS)
-		nslots = ZBX_VC_MAX_CHUNK_RECORDS;
-	if (nslots < (int)ZBX_VC_MIN_CHUNK_RECORDS)
-		nslots = ZBX_VC_MIN_CHUNK_RECORDS;
+		value = (value << n) | ((bs->data[bs->offset >> 3] >> (avail_bits - n)) & ((1 << n) - 1));
+		bs->offset += n;
+	}
 
-	return nslots;
+	return value;
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: vch_item_add_chunk                                               *
- *                                                                            *
- * Purpose: adds a new data chunk at the end of item's history data list      *
- *                                                                            *
- * Parameters: item          - [IN/OUT] the item to add chunk to              *
- *             nslots        - [IN] the number of slots in the new chunk      *
- *             insert_before - [IN] the target chunk before which the new     *
- *                             chunk must be inserted. If this value is NULL  *
- *                             then the new chunk is appended at the end of   *
- *                             chunk list (making it the newest chunk).       *
+ * Function: vc_bits_clz64                                                    *
  *                                                                            *
- * Return value:  SUCCEED - the chunk was added successfully                  *
- *                FAIL - failed to create a new chunk (not enough memory)     *
+ * Purpose: counts leading zero bits of non zero value                        *
  *                                                                            *
  ******************************************************************************/
-static int	vch_item_add_chunk(zbx_vc_item_t *item, int nslots, zbx_vc_chunk_t *insert_before)
+static int	vc_bits_clz64(zbx_uint64_t value)
 {
-	zbx_vc_chunk_t	*chunk;
-	int		chunk_size;
+	int	n = 0;
 
-	chunk_size = sizeof(zbx_vc_chunk_t) + sizeof(zbx_history_record_t) * (nslots - 1);
+	while (0 == (value & __UINT64_C(0xff00000000000000)))
+	{
+		value <<= 8;
+		n += 8;
+	}
 
-	if (NULL == (chunk = (zbx_vc_chunk_t *)vc_item_malloc(item, chunk_size)))
-		return FAIL;
+	while (0 == (value & __UINT64_C(0x8000000000000000)))
+	{
+		value <<= 1;
+		n++;
+	}
 
-	memset(chunk, 0, sizeof(zbx_vc_chunk_t));
-	chunk->slots_num = nslots;
+	return n;
+}
 
-	chunk->next = insert_before;
+/******************************************************************************
+ *                                                                            *
+ * Function: vc_bits_ctz64                                                    *
+ *                                                                            *
+ * Purpose: counts trailing zero bits of non zero value                       *
+ *                                                                            *
+ ******************************************************************************/
+static int	vc_bits_ctz64(zbx_uint64_t value)
+{
+	int	n = 0;
 
-	if (NULL == insert_before)
+	while (0 == (value & 0xff))
 	{
-		chunk->prev = item->head;
-
-		if (NULL != item->head)
-			item->head->next = chunk;
-		else
-			item->tail = chunk;
-
-		item->head = chunk;
+		value >>= 8;
+		n += 8;
 	}
-	else
-	{
-		chunk->prev = insert_before->prev;
-		insert_before->prev = chunk;
 
-		if (item->tail == insert_before)
-			item->tail = chunk;
-		else
-			chunk->prev->next = chunk;
+	while (0 == (value & 1))
+	{
+		value >>= 1;
+		n++;
 	}
 
-	return SUCCEED;
+	return n;
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: vch_chunk_find_last_value_before                                 *
- *                                                                            *
- * Purpose: find the index of the last value in chunk with timestamp less or  *
- *          equal to the specified timestamp.                                 *
+ * Function: vc_history_value_bits                                            *
  *                                                                            *
- * Parameters:  chunk - [IN] the chunk                                        *
- *              ts    - [IN] the target timestamp                             *
- *                                                                            *
- * Return value: The index of the last value in chunk with timestamp less or  *
- *               equal to the specified timestamp.                            *
- *               -1 is returned in the case of failure (meaning that all      *
- *               values have timestamps greater than the target timestamp).   *
+ * Purpose: gets raw bits of numeric history value                            *
  *                                                                            *
  ******************************************************************************/
-static int	vch_chunk_find_last_value_before(const zbx_vc_chunk_t *chunk, const zbx_timespec_t *ts)
+static zbx_uint64_t	vc_history_value_bits(const history_value_t *value, int value_type)
 {
-	int	start = chunk->first_value, end = chunk->last_value, middle;
+	zbx_uint64_t	bits;
 
-	/* check if the last value timestamp is already greater or equal to the specified timestamp */
-	if (0 >= zbx_timespec_compare(&chunk->slots[end].timestamp, ts))
-		return end;
+	if (ITEM_VALUE_TYPE_FLOAT == value_type)
+		memcpy(&bits, &value->dbl, sizeof(bits));
+	else
+		bits = value->ui64;
 
-	/* chunk contains only one value, which did not pass the above check, return failure */
-	if (start == end)
-		return -1;
+	return bits;
+}
 
-	/* perform value lookup using binary search */
-	while (start != end)
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_chunk_encode                                                 *
+ *                                                                            *
+ * Purpose: encodes numeric history values                                    *
+ *                                                                            *
+ * Parameters: values     - [IN] the values in ascending timestamp order      *
+ *             values_num - [IN] the number of values                         *
+ *             value_type - [IN] the value type                               *
+ *             data       - [OUT] the encoded data, must be zero initialized  *
+ *                                and large enough (see comments)             *
+ *                                                                            *
+ * Return value: the encoded data size in bytes                               *
+ *                                                                            *
+ * Comments: The first value is written as is in 16 bytes - 32 bits of       *
+ *           seconds, 30 bits of nanoseconds and 64 bits of value. Each next  *
+ *           value takes up to 145 bits, so 19 bytes per value are enough.   *
+ *                                                                            *
+ *           Seconds are encoded as delta-of-delta (dod) value:               *
+ *             '0'                    - dod is zero                           *
+ *             '10'   + 7 bits        - zigzag encoded dod fits 7 bits        *
+ *             '110'  + 9 bits        - zigzag encoded dod fits 9 bits        *
+ *             '1110' + 12 bits       - zigzag encoded dod fits 12 bits       *
+ *             '1111' + 32 bits       - zigzag encoded dod                    *
+ *           Nanoseconds:                                                     *
+ *             '0'                    - same as previous                      *
+ *             '1' + 30 bits          - new value                             *
+ *           Values are XOR'ed with the previous value:                       *
+ *             '0'                    - same as previous                      *
+ *             '10' + meaningful bits - leading and trailing zero counts are  *
+ *                                      not less than of previous value       *
+ *             '11' + 6 bits leading zero count + 6 bits meaningful bit count *
+ *                  - 1 + meaningful bits                                     *
+ *                                                                            *
+ ******************************************************************************/
+static size_t	vch_chunk_encode(const zbx_history_record_t *values, int values_num, int value_type,
+		unsigned char *data)
+{
+	zbx_vc_bitstream_t	bs = {data, 0};
+	zbx_uint64_t		value, prev_value, xor_value;
+	zbx_uint32_t		dod_zz;
+	int			i, delta, prev_delta = 0, dod, prev_ns, leading, trailing, prev_leading = -1,
+				prev_trailing = 0, meaningful;
+
+	vc_bits_write(&bs, (zbx_uint32_t)values[0].timestamp.sec, 32);
+	vc_bits_write(&bs, (zbx_uint32_t)values[0].timestamp.ns, 30);
+	vc_bits_write(&bs, prev_value = vc_history_value_bits(&values[0].value, value_type), 64);
+	prev_ns = values[0].timestamp.ns;
+
+	for (i = 1; i < values_num; i++)
 	{
-		middle = start + (end - start) / 2;
+		delta = values[i].timestamp.sec - values[i - 1].timestamp.sec;
+		dod = delta - prev_delta;
+		prev_delta = delta;
+		dod_zz = ((zbx_uint32_t)dod << 1) ^ (zbx_uint32_t)(dod >> 31);
+
+		if (0 == dod_zz)
+			vc_bits_write(&bs, 0, 1);
+		else if (dod_zz < (1 << 7))
+			vc_bits_write(&bs, (2 << 7) | dod_zz, 2 + 7);
+		else if (dod_zz < (1 << 9))
+			vc_bits_write(&bs, (6 << 9) | dod_zz, 3 + 9);
+		else if (dod_zz < (1 << 12))
+			vc_bits_write(&bs, (14 << 12) | dod_zz, 4 + 12);
+		else
+			vc_bits_write(&bs, ((zbx_uint64_t)15 << 32) | dod_zz, 4 + 32);
+
+		if (values[i].timestamp.ns == prev_ns)
+			vc_bits_write(&bs, 0, 1);
+		else
+			vc_bits_write(&bs, (1 << 30) | (zbx_uint32_t)(prev_ns = values[i].timestamp.ns), 1 + 30);
 
-		if (0 < zbx_timespec_compare(&chunk->slots[middle].timestamp, ts))
+		value = vc_history_value_bits(&values[i].value, value_type);
+
+		if (0 == (xor_value = value ^ prev_value))
 		{
-			end = middle;
+			vc_bits_write(&bs, 0, 1);
 			continue;
 		}
 
-		if (0 >= zbx_timespec_compare(&chunk->slots[middle + 1].timestamp, ts))
+		prev_value = value;
+		leading = vc_bits_clz64(xor_value);
+		trailing = vc_bits_ctz64(xor_value);
+
+		if (-1 != prev_leading && leading >= prev_leading && trailing >= prev_trailing)
 		{
-			start = middle;
+			vc_bits_write(&bs, 2, 2);
+			vc_bits_write(&bs, xor_value >> prev_trailing, 64 - prev_leading - prev_trailing);
 			continue;
 		}
 
-		return middle;
+		meaningful = 64 - leading - trailing;
+		vc_bits_write(&bs, 3, 2);
+		vc_bits_write(&bs, leading, 6);
+		vc_bits_write(&bs, meaningful - 1, 6);
+		vc_bits_write(&bs, xor_value >> trailing, meaningful);
+
+		prev_leading = leading;
+		prev_trailing = trailing;
 	}
 
-	return -1;
+	return (bs.offset + 7) >> 3;
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: vch_item_get_last_value                                          *
- *                                                                            *
- * Purpose: gets the chunk and index of the last value with a timestamp less  *
- *          or equal to the specified timestamp                               *
- *                                                                            *
- * Parameters:  item          - [IN] the item                                 *
- *              ts            - [IN] the target timestamp                     *
- *                                   (NULL - current time)                    *
- *              pchunk        - [OUT] the chunk containing the target value   *
- *              pindex        - [OUT] the index of the target value           *
+ * Function: vch_chunk_decode                                                 *
  *                                                                            *
- * Return value: SUCCEED - the last value was found successfully              *
- *               FAIL - all values in cache have timestamps greater than the  *
- *                      target (timeshift) timestamp.                         *
+ * Purpose: decodes values of compressed chunk                                *
  *                                                                            *
- * Comments: If end_timestamp value is 0, then simply the last item value in  *
- *           cache is returned.                                               *
+ * Parameters: chunk      - [IN] the compressed chunk                         *
+ *             value_type - [IN] the value type                               *
+ *             values     - [OUT] the decoded values (slots_num values)       *
  *                                                                            *
  ******************************************************************************/
-static int	vch_item_get_last_value(const zbx_vc_item_t *item, const zbx_timespec_t *ts, zbx_vc_chunk_t **pchunk,
-		int *pindex)
+static void	vch_chunk_decode(const zbx_vc_chunk_t *chunk, int value_type, zbx_history_record_t *values)
 {
-	zbx_vc_chunk_t	*chunk = item->head;
-	int		index;
-
-	if (NULL == chunk)
-		return FAIL;
+	zbx_vc_bitstream_t	bs = {(unsigned char *)chunk->slots, 0};
+	zbx_uint64_t		value, xor_value;
+	zbx_uint32_t		dod_zz;
+	int			i, delta = 0, leading = 0, trailing = 0, meaningful;
 
-	index = chunk->last_value;
+	values[0].timestamp.sec = (int)vc_bits_read(&bs, 32);
+	values[0].timestamp.ns = (int)vc_bits_read(&bs, 30);
+	value = vc_bits_read(&bs, 64);
 
-	if (0 < zbx_timespec_compare(&chunk->slots[index].timestamp, ts))
+	for (i = 0; i < chunk->slots_num; i++)
 	{
-		while (0 < zbx_timespec_compare(&chunk->slots[chunk->first_value].timestamp, ts))
+		if (0 != i)
 		{
-			chunk = chunk->prev;
-			/* there are no values for requested range, return failure */
-			if (NULL == chunk)
-				return FAIL;
+			if (0 == vc_bits_read(&bs, 1))
+				dod_zz = 0;
+			else if (0 == vc_bits_read(&bs, 1))
+				dod_zz = (zbx_uint32_t)vc_bits_read(&bs, 7);
+			else if (0 == vc_bits_read(&bs, 1))
+				dod_zz = (zbx_uint32_t)vc_bits_read(&bs, 9);
+			else if (0 == vc_bits_read(&bs, 1))
+				dod_zz = (zbx_uint32_t)vc_bits_read(&bs, 12);
+			else
+				dod_zz = (zbx_uint32_t)vc_bits_read(&bs, 32);
+
+			delta += (int)((dod_zz >> 1) ^ (~(dod_zz & 1) + 1));
+			values[i].timestamp.sec = values[i - 1].timestamp.sec + delta;
+
+			if (0 == vc_bits_read(&bs, 1))
+				values[i].timestamp.ns = values[i - 1].timestamp.ns;
+			else
+				values[i].timestamp.ns = (int)vc_bits_read(&bs, 30);
+
+			if (0 != vc_bits_read(&bs, 1))
+			{
+				if (0 != vc_bits_read(&bs, 1))
+				{
+					leading = (int)vc_bits_read(&bs, 6);
+					meaningful = (int)vc_bits_read(&bs, 6) + 1;
+					trailing = 64 - leading - meaningful;
+				}
+
+				xor_value = vc_bits_read(&bs, 64 - leading - trailing) << trailing;
+				value ^= xor_value;
+			}
 		}
-		index = vch_chunk_find_last_value_before(chunk, ts);
+
+		if (ITEM_VALUE_TYPE_FLOAT == value_type)
+			memcpy(&values[i].value.dbl, &value, sizeof(value));
+		else
+			values[i].value.ui64 = value;
 	}
+}
 
-	*pchunk = chunk;
-	*pindex = index;
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_chunk_size                                                   *
+ *                                                                            *
+ * Purpose: gets the allocated chunk size                                     *
+ *                                                                            *
+ ******************************************************************************/
+static size_t	vch_chunk_size(const zbx_vc_chunk_t *chunk)
+{
+	if (0 != chunk->compressed_size)
+		return sizeof(zbx_vc_chunk_t) - sizeof(zbx_history_record_t) + chunk->compressed_size;
 
-	return SUCCEED;
+	return sizeof(zbx_vc_chunk_t) + (chunk->slots_num - 1) * sizeof(zbx_history_record_t);
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: vch_item_copy_value                                              *
+ * Function: vch_chunk_slots                                                  *
  *                                                                            *
- * Purpose: copies value in the specified item's chunk slot                   *
+ * Purpose: gets chunk value slots                                            *
  *                                                                            *
- * Parameters: chunk        - [IN/OUT] the target chunk                       *
- *             index        - [IN] the target slot                            *
- *             source_value - [IN] the value to copy                          *
+ * Parameters: item  - [IN] the chunk owner item                              *
+ *             chunk - [IN] the chunk                                         *
  *                                                                            *
- * Return value: SUCCEED - the value was copied successfully                  *
- *               FAIL    - the value copying failed (not enough space for     *
- *                         string, text or log type data)                     *
+ * Return value: the chunk value slots                                        *
  *                                                                            *
- * Comments: This function is used to copy data to cache. The contents of     *
- *           str, text and log type values are stored in cache string pool.   *
+ * Comments: Compressed chunks are decoded into process local memory. The     *
+ *           returned slots of compressed chunk stay valid until              *
+ *           ZBX_VC_DECODED_CHUNKS other compressed chunks are accessed and   *
+ *           must not be modified.                                            *
  *                                                                            *
  ******************************************************************************/
-static int	vch_item_copy_value(zbx_vc_item_t *item, zbx_vc_chunk_t *chunk, int index,
-		const zbx_history_record_t *source_value)
+static zbx_history_record_t	*vch_chunk_slots(const zbx_vc_item_t *item, const zbx_vc_chunk_t *chunk)
 {
-	zbx_history_record_t	*value;
-	int			ret = FAIL;
+	zbx_vc_decoded_chunk_t	*decoded;
+	int			i;
 
-	value = &chunk->slots[index];
+	if (0 == chunk->compressed_size)
+		return (zbx_history_record_t *)chunk->slots;
 
-	switch (item->value_type)
+	for (i = 0; i < ZBX_VC_DECODED_CHUNKS; i++)
 	{
-		case ITEM_VALUE_TYPE_STR:
-		case ITEM_VALUE_TYPE_TEXT:
-			if (NULL == (value->value.str = vc_item_strdup(item, source_value->value.str)))
-				goto out;
-			break;
-		case ITEM_VALUE_TYPE_LOG:
-			if (NULL == (value->value.log = vc_item_logdup(item, source_value->value.log)))
-				goto out;
-			break;
-		default:
-			value->value = source_value->value;
+		if (vc_decoded[i].chunk == chunk && vc_decoded[i].compressed_id == chunk->compressed_id)
+			return vc_decoded[i].slots;
 	}
-	value->timestamp = source_value->timestamp;
 
-	ret = SUCCEED;
-out:
-	return ret;
+	decoded = &vc_decoded[vc_decoded_next];
+	vc_decoded_next = (vc_decoded_next + 1) % ZBX_VC_DECODED_CHUNKS;
+
+	if (decoded->slots_alloc < chunk->slots_num)
+	{
+		decoded->slots_alloc = chunk->slots_num;
+		decoded->slots = (zbx_history_record_t *)zbx_realloc(decoded->slots,
+				sizeof(zbx_history_record_t) * decoded->slots_alloc);
+	}
+
+	vch_chunk_decode(chunk, item->value_type, decoded->slots);
+	decoded->chunk = chunk;
+	decoded->compressed_id = chunk->compressed_id;
+
+	return decoded->slots;
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: vch_item_copy_values_at_tail                                     *
+ * Function: vch_item_replace_chunk                                           *
  *                                                                            *
- * Purpose: copies values at the beginning of item tail chunk                 *
+ * Purpose: replaces chunk in item chunk list                                 *
  *                                                                            *
- * Parameters: item       - [IN/OUT] the target item                          *
- *             values     - [IN] the values to copy                           *
- *             values_num - [IN] the number of values to copy                 *
+ ******************************************************************************/
+static void	vch_item_replace_chunk(zbx_vc_item_t *item, zbx_vc_chunk_t *chunk, zbx_vc_chunk_t *new_chunk)
+{
+	if (NULL != chunk->next)
+		chunk->next->prev = new_chunk;
+	else
+		item->head = new_chunk;
+
+	if (NULL != chunk->prev)
+		chunk->prev->next = new_chunk;
+	else
+		item->tail = new_chunk;
+
+	__vc_mem_free_func(chunk);
+}
+
+/******************************************************************************
  *                                                                            *
- * Return value: SUCCEED - the values were copied successfully                *
- *               FAIL    - the value copying failed (not enough space for     *
- *                         string, text or log type data)                     *
+ * Function: vch_item_compress_chunk                                          *
  *                                                                            *
- * Comments: This function is used to copy data to cache. The contents of     *
- *           str, text and log type values are stored in cache string pool.   *
+ * Purpose: compresses filled chunk of numeric item                           *
+ *                                                                            *
+ * Parameters: item  - [IN] the chunk owner item                              *
+ *             chunk - [IN] the chunk to compress                             *
+ *                                                                            *
+ * Comments: The head chunk is not compressed as new values are added to it.  *
+ *           The chunk is left uncompressed if there is not enough memory or  *
+ *           compression does not reduce its size.                            *
  *                                                                            *
  ******************************************************************************/
-static int	vch_item_copy_values_at_tail(zbx_vc_item_t *item, const zbx_history_record_t *values, int values_num)
+static void	vch_item_compress_chunk(zbx_vc_item_t *item, zbx_vc_chunk_t *chunk)
 {
-	int	i, ret = FAIL, first_value = item->tail->first_value;
+	static unsigned char	*data = NULL;
+	static size_t		data_alloc = 0;
+	size_t			data_size;
+	int			values_num;
+	zbx_vc_chunk_t		*new_chunk;
 
-	switch (item->value_type)
-	{
-		case ITEM_VALUE_TYPE_STR:
-		case ITEM_VALUE_TYPE_TEXT:
-			for (i = values_num - 1; i >= 0; i--)
-			{
-				zbx_history_record_t	*value = &item->tail->slots[item->tail->first_value - 1];
+	if (ITEM_VALUE_TYPE_FLOAT != item->value_type && ITEM_VALUE_TYPE_UINT64 != item->value_type)
+		return;
 
-				if (NULL == (value->value.str = vc_item_strdup(item, values[i].value.str)))
-					goto out;
+	if (NULL == chunk || item->head == chunk || 0 != chunk->compressed_size)
+		return;
 
-				value->timestamp = values[i].timestamp;
-				item->tail->first_value--;
-			}
-			ret = SUCCEED;
+	values_num = chunk->last_value - chunk->first_value + 1;
 
-			break;
-		case ITEM_VALUE_TYPE_LOG:
-			for (i = values_num - 1; i >= 0; i--)
-			{
-				zbx_history_record_t	*value = &item->tail->slots[item->tail->first_value - 1];
+	if (data_alloc < (size_t)values_num * 19)
+	{
+		data_alloc = (size_t)values_num * 19;
+		data = (unsigned char *)zbx_realloc(data, data_alloc);
+	}
 
-				if (NULL == (value->value.log = vc_item_logdup(item, values[i].value.log)))
-					goto out;
+	memset(data, 0, data_alloc);
+	data_size = vch_chunk_encode(chunk->slots + chunk->first_value, values_num, item->value_type, data);
 
-				value->timestamp = values[i].timestamp;
-				item->tail->first_value--;
-			}
-			ret = SUCCEED;
+	if (data_size >= values_num * sizeof(zbx_history_record_t))
+		return;
 
-			break;
-		default:
-			memcpy(&item->tail->slots[item->tail->first_value - values_num], values,
-					values_num * sizeof(zbx_history_record_t));
-			item->tail->first_value -= values_num;
-			ret = SUCCEED;
+	/* compressed chunks are optional, don't try to free cache space for them */
+	if (NULL == (new_chunk = (zbx_vc_chunk_t *)__vc_mem_malloc_func(NULL,
+			sizeof(zbx_vc_chunk_t) - sizeof(zbx_history_record_t) + data_size)))
+	{
+		return;
 	}
-out:
-	item->values_total += first_value - item->tail->first_value;
 
-	return ret;
+	new_chunk->prev = chunk->prev;
+	new_chunk->next = chunk->next;
+	new_chunk->first_value = 0;
+	new_chunk->last_value = values_num - 1;
+	new_chunk->slots_num = values_num;
+	new_chunk->compressed_size = (int)data_size;
+	new_chunk->compressed_id = ++vc_cache->compressed_id;
+	memcpy(new_chunk->slots, data, data_size);
+
+	vch_item_replace_chunk(item, chunk, new_chunk);
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: vch_item_free_chunk                                              *
+ * Function: vch_item_decompress_chunk                                        *
  *                                                                            *
- * Purpose: frees chunk and all resources allocated to store its values       *
+ * Purpose: decompresses chunk so its values can be modified                  *
  *                                                                            *
- * Parameters: item    - [IN] the chunk owner item                            *
- *             chunk   - [IN] the chunk to free                               *
+ * Parameters: item  - [IN] the chunk owner item                              *
+ *             chunk - [IN] the chunk to decompress                           *
  *                                                                            *
- * Return value: the number of bytes freed                                    *
+ * Return value: the decompressed chunk or NULL if there is not enough memory *
  *                                                                            *
  ******************************************************************************/
-static size_t	vch_item_free_chunk(zbx_vc_item_t *item, zbx_vc_chunk_t *chunk)
+static zbx_vc_chunk_t	*vch_item_decompress_chunk(zbx_vc_item_t *item, zbx_vc_chunk_t *chunk)
 {
-	size_t	freed;
+	zbx_vc_chunk_t	*new_chunk;
 
-	freed = sizeof(zbx_vc_chunk_t) + (chunk->slots_num - 1) * sizeof(zbx_history_record_t);
-	freed += vc_item_free_values(item, chunk->slots, chunk->first_value, chunk->last_value);
+	if (0 == chunk->compressed_size)
+		return chunk;
 
-	__vc_mem_free_func(chunk);
+	if (NULL == (new_chunk = (zbx_vc_chunk_t *)vc_item_malloc(item, sizeof(zbx_vc_chunk_t) +
+			(chunk->slots_num - 1) * sizeof(zbx_history_record_t))))
+	{
+		return NULL;
+	}
 
-	return freed;
+	new_chunk->prev = chunk->prev;
+	new_chunk->next = chunk->next;
+	new_chunk->first_value = chunk->first_value;
+	new_chunk->last_value = chunk->last_value;
+	new_chunk->slots_num = chunk->slots_num;
+	new_chunk->compressed_size = 0;
+	new_chunk->compressed_id = 0;
+	memcpy(new_chunk->slots, vch_chunk_slots(item, chunk), chunk->slots_num * sizeof(zbx_history_record_t));
+
+	vch_item_replace_chunk(item, chunk, new_chunk);
+
+	return new_chunk;
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: vch_item_remove_chunk                                            *
+ * Function: vch_item_update_range                                            *
  *                                                                            *
- * Purpose: removes item history data chunk                                   *
+ * Purpose: updates item range with current request range                     *
  *                                                                            *
- * Parameters: item    - [IN ] the chunk owner item                           *
- *             chunk   - [IN] the chunk to remove                             *
+ * Parameters: item   - [IN] the item                                         *
+ *             range  - [IN] the request range                                *
+ *             now    - [IN] the current timestamp                            *
  *                                                                            *
  ******************************************************************************/
-static void	vch_item_remove_chunk(zbx_vc_item_t *item, zbx_vc_chunk_t *chunk)
+static void	vch_item_update_range(zbx_vc_item_t *item, int range, int now)
 {
-	if (NULL != chunk->next)
-		chunk->next->prev = chunk->prev;
+	int	hour, diff;
 
-	if (NULL != chunk->prev)
-		chunk->prev->next = chunk->next;
+	if (VC_MIN_RANGE > range)
+		range = VC_MIN_RANGE;
 
-	if (chunk == item->head)
-		item->head = chunk->prev;
+	if (item->daily_range < range)
+		item->daily_range = range;
 
-	if (chunk == item->tail)
-		item->tail = chunk->next;
+	hour = (now / SEC_PER_HOUR) & 0xff;
 
-	vch_item_free_chunk(item, chunk);
+	if (0 > (diff = hour - item->range_sync_hour))
+		diff += 0xff;
+
+	if (item->active_range < item->daily_range || ZBX_VC_RANGE_SYNC_PERIOD < diff)
+	{
+		item->active_range = item->daily_range;
+		item->daily_range = range;
+		item->range_sync_hour = hour;
+	}
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: vch_item_clean_cache                                             *
+ * Function: vch_item_chunk_slot_count                                        *
  *                                                                            *
- * Purpose: removes item history data that are outside (older) the maximum    *
- *          request range                                                     *
+ * Purpose: calculates optimal number of slots for an item data chunk         *
  *                                                                            *
- * Parameters:  item   - [IN] the target item                                 *
+ * Parameters:  item        - [IN] the item                                   *
+ *              values_new  - [IN] the number of values to be added           *
+ *                                                                            *
+ * Return value: the number of slots for a new item data chunk                *
+ *                                                                            *
+ * Comments: From size perspective the optimal slot count per chunk is        *
+ *           approximately square root of the number of cached values.        *
+ *           Still creating too many chunks might affect timeshift request    *
+ *           performance, so don't try creating more than 32 chunks unless    *
+ *           the calculated slot count exceeds the maximum limit.             *
  *                                                                            *
  ******************************************************************************/
-static void	vch_item_clean_cache(zbx_vc_item_t *item)
+static int	vch_item_chunk_slot_count(zbx_vc_item_t *item, int values_new)
 {
-	zbx_vc_chunk_t	*next;
+	int	nslots, values;
 
-	if (0 != item->active_range)
-	{
-		zbx_vc_chunk_t	*tail = item->tail;
-		zbx_vc_chunk_t	*chunk = tail;
-		int		timestamp;
+	values = item->values_total + values_new;
 
-		timestamp = time(NULL) - item->active_range;
+	nslots = zbx_isqrt32(values);
 
-		/* try to remove chunks with all history values older than maximum request range */
-		while (NULL != chunk && chunk->slots[chunk->last_value].timestamp.sec < timestamp &&
-				chunk->slots[chunk->last_value].timestamp.sec !=
-						item->head->slots[item->head->last_value].timestamp.sec)
-		{
-			/* don't remove the head chunk */
-			if (NULL == (next = chunk->next))
-				break;
+	if ((values + nslots - 1) / nslots + 1 > 32)
+		nslots = values / 32;
 
-			/* Values with the same timestamps (seconds resolution) always should be either   */
-			/* kept in cache or removed together. There should not be a case when one of them */
-			/* is in cache and the second is dropped.                                         */
-			/* Here we are handling rare case, when the last value of first chunk has the     */
-			/* same timestamp (seconds resolution) as the first value in the second chunk.    */
-			/* In this case increase the first value index of the next chunk until the first  */
-			/* value timestamp is greater.                                                    */
-
-			if (next->slots[next->first_value].timestamp.sec != next->slots[next->last_value].timestamp.sec)
-			{
-				while (next->slots[next->first_value].timestamp.sec ==
-						chunk->slots[chunk->last_value].timestamp.sec)
-				{
-					vc_item_free_values(item, next->slots, next->first_value, next->first_value);
-					next->first_value++;
-				}
-			}
-
-			/* set the database cached from timestamp to the last (oldest) removed value timestamp + 1 */
-			item->db_cached_from = chunk->slots[chunk->last_value].timestamp.sec + 1;
-
-			vch_item_remove_chunk(item, chunk);
-
-			chunk = next;
-		}
+	if (nslots > (int)ZBX_VC_MAX_CHUNK_RECORDS)
+		nslots = ZBX_VC_MAX_CHUNK_RECORDS;
+	if (nslots < (int)ZBX_VC_MIN_CHUNK_RECORDS)
+		nslots = ZBX_VC_MIN_CHUNK_RECORDS;
 
-		/* reset the status flags if data was removed from cache */
-		if (tail != item->tail)
-			item->status = 0;
-	}
+	return nslots;
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: vch_item_remove_values                                           *
+ * Function: vch_item_add_chunk                                               *
  *                                                                            *
- * Purpose: removes item history data that are older than the specified       *
- *          timestamp                                                         *
+ * Purpose: adds a new data chunk at the end of item's history data list      *
  *                                                                            *
- * Parameters:  item      - [IN] the target item                              *
- *              timestamp - [IN] the timestamp (number of seconds since the   *
- *                               Epoch)                                       *
+ * Parameters: item          - [IN/OUT] the item to add chunk to              *
+ *             nslots        - [IN] the number of slots in the new chunk      *
+ *             insert_before - [IN] the target chunk before which the new     *
+ *                             chunk must be inserted. If this value is NULL  *
+ *                             then the new chunk is appended at the end of   *
+ *                             chunk list (making it the newest chunk).       *
+ *                                                                            *
+ * Return value:  SUCCEED - the chunk was added successfully                  *
+ *                FAIL - failed to create a new chunk (not enough memory)     *
  *                                                                            *
  ******************************************************************************/
-static void	vch_item_remove_values(zbx_vc_item_t *item, int timestamp)
+static int	vch_item_add_chunk(zbx_vc_item_t *item, int nslots, zbx_vc_chunk_t *insert_before)
 {
-	zbx_vc_chunk_t	*chunk = item->tail;
+	zbx_vc_chunk_t	*chunk;
+	int		chunk_size;
 
-	if (ZBX_ITEM_STATUS_CACHED_ALL == item->status)
-		item->status = 0;
+	chunk_size = sizeof(zbx_vc_chunk_t) + sizeof(zbx_history_record_t) * (nslots - 1);
 
-	/* try to remove chunks with all history values older than the timestamp */
-	while (chunk->slots[chunk->first_value].timestamp.sec < timestamp)
-	{
-		zbx_vc_chunk_t	*next;
+	if (NULL == (chunk = (zbx_vc_chunk_t *)vc_item_malloc(item, chunk_size)))
+		return FAIL;
 
-		/* If chunk contains values with timestamp greater or equal - remove */
-		/* only the values with less timestamp. Otherwise remove the while   */
-		/* chunk and check next one.                                         */
-		if (chunk->slots[chunk->last_value].timestamp.sec >= timestamp)
-		{
-			while (chunk->slots[chunk->first_value].timestamp.sec < timestamp)
-			{
-				vc_item_free_values(item, chunk->slots, chunk->first_value, chunk->first_value);
-				chunk->first_value++;
-			}
+	memset(chunk, 0, sizeof(zbx_vc_chunk_t));
+	chunk->slots_num = nslots;
 
-			break;
-		}
+	chunk->next = insert_before;
 
-		next = chunk->next;
-		vch_item_remove_chunk(item, chunk);
+	if (NULL == insert_before)
+	{
+		chunk->prev = item->head;
 
-		/* empty items must be removed to avoid situation when a new value is added to cache */
-		/* while other values with matching timestamp seconds are not cached                 */
-		if (NULL == next)
-		{
-			item->state |= ZBX_ITEM_STATE_REMOVE_PENDING;
-			break;
-		}
+		if (NULL != item->head)
+			item->head->next = chunk;
+		else
+			item->tail = chunk;
 
-		chunk = next;
+		item->head = chunk;
+	}
+	else
+	{
+		chunk->prev = insert_before->prev;
+		insert_before->prev = chunk;
+
+		if (item->tail == insert_before)
+			item->tail = chunk;
+		else
+			chunk->prev->next = chunk;
 	}
+
+	return SUCCEED;
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: vch_item_add_value_at_head                                       *
- *                                                                            *
- * Purpose: adds one item history value at the end of current item's history  *
- *          data                                                              *
+ * Function: vch_chunk_find_last_value_before                                 *
  *                                                                            *
- * Parameters:  item   - [IN] the item to add history data to                 *
- *              value  - [IN] the item history data value                     *
+ * Purpose: find the index of the last value in chunk with timestamp less or  *
+ *          equal to the specified timestamp.                                 *
  *                                                                            *
- * Return value: SUCCEED - the history data value was added successfully      *
- *               FAIL - failed to add history data value (not enough memory)  *
+ * Parameters:  item  - [IN] the chunk owner item                             *
+ *              chunk - [IN] the chunk                                        *
+ *              ts    - [IN] the target timestamp                             *
  *                                                                            *
- * Comments: In the case of failure the item will be removed from cache       *
- *           later.                                                           *
+ * Return value: The index of the last value in chunk with timestamp less or  *
+ *               equal to the specified timestamp.                            *
+ *               -1 is returned in the case of failure (meaning that all      *
+ *               values have timestamps greater than the target timestamp).   *
  *                                                                            *
  ******************************************************************************/
-static int	vch_item_add_value_at_head(zbx_vc_item_t *item, const zbx_history_record_t *value)
+static int	vch_chunk_find_last_value_before(const zbx_vc_item_t *item, const zbx_vc_chunk_t *chunk,
+		const zbx_timespec_t *ts)
 {
-	int		ret = FAIL, index, sindex, nslots = 0;
-	zbx_vc_chunk_t	*head = item->head, *chunk, *schunk;
-
-	if (NULL != item->head &&
-			0 < zbx_history_record_compare_asc_func(&item->head->slots[item->head->last_value], value))
-	{
-		if (0 < zbx_history_record_compare_asc_func(&item->tail->slots[item->tail->first_value], value))
-		{
-			/* If the added value has the same or older timestamp as the first value in cache */
-			/* we can't add it to keep cache consistency. Additionally we must make sure no   */
-			/* values with matching timestamp seconds are kept in cache.                      */
-			vch_item_remove_values(item, value->timestamp.sec + 1);
-
-			/* if the value is newer than the database cached from timestamp we must */
-			/* adjust the cached from timestamp to exclude this value                */
-			if (item->db_cached_from <= value->timestamp.sec)
-				item->db_cached_from = value->timestamp.sec + 1;
-
-			ret = SUCCEED;
-			goto out;
-		}
+	int			start = chunk->first_value, end = chunk->last_value, middle;
+	zbx_history_record_t	*slots;
 
-		sindex = item->head->last_value;
-		schunk = item->head;
+	slots = vch_chunk_slots(item, chunk);
 
-		if (0 == item->head->slots_num - item->head->last_value - 1)
-		{
-			if (FAIL == vch_item_add_chunk(item, vch_item_chunk_slot_count(item, 1), NULL))
-				goto out;
-		}
-		else
-			item->head->last_value++;
+	/* check if the last value timestamp is already greater or equal to the specified timestamp */
+	if (0 >= zbx_timespec_compare(&slots[end].timestamp, ts))
+		return end;
 
-		item->values_total++;
+	/* chunk contains only one value, which did not pass the above check, return failure */
+	if (start == end)
+		return -1;
 
-		chunk = item->head;
-		index = item->head->last_value;
+	/* perform value lookup using binary search */
+	while (start != end)
+	{
+		middle = start + (end - start) / 2;
 
-		do
+		if (0 < zbx_timespec_compare(&slots[middle].timestamp, ts))
 		{
-			chunk->slots[index] = schunk->slots[sindex];
-
-			chunk = schunk;
-			index = sindex;
-
-			if (--sindex < schunk->first_value)
-			{
-				if (NULL == (schunk = schunk->prev))
-				{
-					memset(&chunk->slots[index], 0, sizeof(zbx_vc_chunk_t));
-					THIS_SHOULD_NEVER_HAPPEN;
-
-					goto out;
-				}
-
-				sindex = schunk->last_value;
-			}
+			end = middle;
+			continue;
 		}
-		while (0 < zbx_timespec_compare(&schunk->slots[sindex].timestamp, &value->timestamp));
-	}
-	else
-	{
-		/* find the number of free slots on the right side in last (head) chunk */
-		if (NULL != item->head)
-			nslots = item->head->slots_num - item->head->last_value - 1;
 
-		if (0 == nslots)
+		if (0 >= zbx_timespec_compare(&slots[middle + 1].timestamp, ts))
 		{
-			if (FAIL == vch_item_add_chunk(item, vch_item_chunk_slot_count(item, 1), NULL))
-				goto out;
+			start = middle;
+			continue;
 		}
-		else
-			item->head->last_value++;
-
-		item->values_total++;
 
-		chunk = item->head;
-		index = item->head->last_value;
+		return middle;
 	}
 
-	if (SUCCEED != vch_item_copy_value(item, chunk, index, value))
-		goto out;
-
-	/* try to remove old (unused) chunks if a new chunk was added */
-	if (head != item->head)
-		item->state |= ZBX_ITEM_STATE_CLEAN_PENDING;
-
-	ret = SUCCEED;
-out:
-	return ret;
+	return -1;
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: vch_item_add_values_at_tail                                      *
+ * Function: vch_item_get_last_value                                          *
  *                                                                            *
- * Purpose: adds item history values at the beginning of current item's       *
- *          history data                                                      *
+ * Purpose: gets the chunk and index of the last value with a timestamp less  *
+ *          or equal to the specified timestamp                               *
  *                                                                            *
- * Parameters:  item   - [IN] the item to add history data to                 *
- *              values - [IN] the item history data values                    *
- *              num    - [IN] the number of history data values to add        *
+ * Parameters:  item          - [IN] the item                                 *
+ *              ts            - [IN] the target timestamp                     *
+ *                                   (NULL - current time)                    *
+ *              pchunk        - [OUT] the chunk containing the target value   *
+ *              pindex        - [OUT] the index of the target value           *
  *                                                                            *
- * Return value: SUCCEED - the history data values were added successfully    *
- *               FAIL - failed to add history data values (not enough memory) *
+ * Return value: SUCCEED - the last value was found successfully              *
+ *               FAIL - all values in cache have timestamps greater than the  *
+ *                      target (timeshift) timestamp.                         *
  *                                                                            *
- * Comments: In the case of failure the item is removed from cache.           *
- *           Overlapping values (by timestamp seconds) are ignored.           *
+ * Comments: If end_timestamp value is 0, then simply the last item value in  *
+ *           cache is returned.                                               *
  *                                                                            *
  ******************************************************************************/
-static int	vch_item_add_values_at_tail(zbx_vc_item_t *item, const zbx_history_record_t *values, int values_num)
+static int	vch_item_get_last_value(const zbx_vc_item_t *item, const zbx_timespec_t *ts, zbx_vc_chunk_t **pchunk,
+		int *pindex)
 {
-	int 	count = values_num, ret = FAIL;
+	zbx_vc_chunk_t	*chunk = item->head;
+	int		index;
 
-	/* skip values already added to the item cache by another process */
-	if (NULL != item->tail)
-	{
-		int	sec = item->tail->slots[item->tail->first_value].timestamp.sec;
+	if (NULL == chunk)
+		return FAIL;
 
-		while (--count >= 0 && values[count].timestamp.sec >= sec)
-			;
-		++count;
-	}
+	index = chunk->last_value;
 
-	while (0 != count)
+	if (0 < zbx_timespec_compare(&vch_chunk_slots(item, chunk)[index].timestamp, ts))
 	{
-		int	copy_slots, nslots = 0;
-
-		/* find the number of free slots on the left side in first (tail) chunk */
-		if (NULL != item->tail)
-			nslots = item->tail->first_value;
-
-		if (0 == nslots)
+		while (0 < zbx_timespec_compare(&vch_chunk_slots(item, chunk)[chunk->first_value].timestamp, ts))
 		{
-			nslots = vch_item_chunk_slot_count(item, count);
-
-			if (FAIL == vch_item_add_chunk(item, nslots, item->tail))
-				goto out;
-
-			item->tail->last_value = nslots - 1;
-			item->tail->first_value = nslots;
+			chunk = chunk->prev;
+			/* there are no values for requested range, return failure */
+			if (NULL == chunk)
+				return FAIL;
 		}
-
-		/* copy values to chunk */
-		copy_slots = MIN(nslots, count);
-		count -= copy_slots;
-
-		if (FAIL == vch_item_copy_values_at_tail(item, values + count, copy_slots))
-			goto out;
+		index = vch_chunk_find_last_value_before(item, chunk, ts);
 	}
 
-	ret = SUCCEED;
-out:
-	return ret;
+	*pchunk = chunk;
+	*pindex = index;
+
+	return SUCCEED;
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: vch_item_cache_values_by_time                                    *
+ * Function: vch_item_copy_value                                              *
  *                                                                            *
- * Purpose: cache item history data for the specified time period             *
+ * Purpose: copies value in the specified item's chunk slot                   *
  *                                                                            *
- * Parameters: item        - [IN] the item                                    *
- *             range_start - [IN] the interval start time                     *
+ * Parameters: chunk        - [IN/OUT] the target chunk                       *
+ *             index        - [IN] the target slot                            *
+ *             source_value - [IN] the value to copy                          *
  *                                                                            *
- * Return value:  >=0    - the number of values read from database            *
- *                FAIL   - an error occurred while trying to cache values     *
+ * Return value: SUCCEED - the value was copied successfully                  *
+ *               FAIL    - the value copying failed (not enough space for     *
+ *                         string, text or log type data)                     *
  *                                                                            *
- * Comments: This function checks if the requested value range is cached and  *
- *           updates cache from database if necessary.                        *
+ * Comments: This function is used to copy data to cache. The contents of     *
+ *           str, text and log type values are stored in cache string pool.   *
  *                                                                            *
  ******************************************************************************/
-static int	vch_item_cache_values_by_time(zbx_vc_item_t *item, int range_start)
+static int	vch_item_copy_value(zbx_vc_item_t *item, zbx_vc_chunk_t *chunk, int index,
+		const zbx_history_record_t *source_value)
 {
-	int	ret = SUCCEED, range_end;
-
-	if (ZBX_ITEM_STATUS_CACHED_ALL == item->status)
-		return SUCCEED;
+	zbx_history_record_t	*value;
+	int			ret = FAIL;
 
-	/* check if the requested period is in the cached range */
-	if (0 != item->db_cached_from && range_start >= item->db_cached_from)
-		return SUCCEED;
+	value = &chunk->slots[index];
 
-	/* find if the cache should be updated to cover the required range */
-	if (NULL != item->tail)
+	switch (item->value_type)
 	{
-		/* we need to get item values before the first cached value, but not including it */
-		range_end = item->tail->slots[item->tail->first_value].timestamp.sec - 1;
+		case ITEM_VALUE_TYPE_STR:
+		case ITEM_VALUE_TYPE_TEXT:
+			if (NULL == (value->value.str = vc_item_strdup(item, source_value->value.str)))
+				goto out;
+			break;
+		case ITEM_VALUE_TYPE_LOG:
+			if (NULL == (value->value.log = vc_item_logdup(item, source_value->value.log)))
+				goto out;
+			break;
+		default:
+			value->value = source_value->value;
 	}
-	else
-		range_end = time(NULL);
+	value->timestamp = source_value->timestamp;
 
-	/* update cache if necessary */
-	if (range_start < range_end)
-	{
-		zbx_vector_history_record_t	records;
+	ret = SUCCEED;
+out:
+	return ret;
+}
 
-		zbx_vector_history_record_create(&records);
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_item_copy_values_at_tail                                     *
+ *                                                                            *
+ * Purpose: copies values at the beginning of item tail chunk                 *
+ *                                                                            *
+ * Parameters: item       - [IN/OUT] the target item                          *
+ *             values     - [IN] the values to copy                           *
+ *             values_num - [IN] the number of values to copy                 *
+ *                                                                            *
+ * Return value: SUCCEED - the values were copied successfully                *
+ *               FAIL    - the value copying failed (not enough space for     *
+ *                         string, text or log type data)                     *
+ *                                                                            *
+ * Comments: This function is used to copy data to cache. The contents of     *
+ *           str, text and log type values are stored in cache string pool.   *
+ *                                                                            *
+ ******************************************************************************/
+static int	vch_item_copy_values_at_tail(zbx_vc_item_t *item, const zbx_history_record_t *values, int values_num)
+{
+	int	i, ret = FAIL, first_value = item->tail->first_value;
 
-		vc_try_unlock();
+	switch (item->value_type)
+	{
+		case ITEM_VALUE_TYPE_STR:
+		case ITEM_VALUE_TYPE_TEXT:
+			for (i = values_num - 1; i >= 0; i--)
+			{
+				zbx_history_record_t	*value = &item->tail->slots[item->tail->first_value - 1];
 
-		if (SUCCEED == (ret = vc_db_read_values_by_time(item->itemid, item->value_type, &records,
-				range_start, range_end)))
-		{
-			zbx_vector_history_record_sort(&records,
-					(zbx_compare_func_t)zbx_history_record_compare_asc_func);
-		}
+				if (NULL == (value->value.str = vc_item_strdup(item, values[i].value.str)))
+					goto out;
 
-		vc_try_lock();
+				value->timestamp = values[i].timestamp;
+				item->tail->first_value--;
+			}
+			ret = SUCCEED;
 
-		if (SUCCEED == ret)
-		{
-			if (0 < records.values_num)
-				ret = vch_item_add_values_at_tail(item, records.values, records.values_num);
+			break;
+		case ITEM_VALUE_TYPE_LOG:
+			for (i = values_num - 1; i >= 0; i--)
+			{
+				zbx_history_record_t	*value = &item->tail->slots[item->tail->first_value - 1];
 
-			/* when updating cache with time based request we can always reset status flags */
-			/* flag even if the requested period contains no data                           */
-			item->status = 0;
+				if (NULL == (value->value.log = vc_item_logdup(item, values[i].value.log)))
+					goto out;
 
-			if (SUCCEED == ret)
-			{
-				ret = records.values_num;
-				vc_item_update_db_cached_from(item, range_start);
+				value->timestamp = values[i].timestamp;
+				item->tail->first_value--;
 			}
+			ret = SUCCEED;
 
-		}
-		zbx_history_record_vector_destroy(&records, item->value_type);
+			break;
+		default:
+			memcpy(&item->tail->slots[item->tail->first_value - values_num], values,
+					values_num * sizeof(zbx_history_record_t));
+			item->tail->first_value -= values_num;
+			ret = SUCCEED;
 	}
+out:
+	item->values_total += first_value - item->tail->first_value;
 
 	return ret;
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: vch_item_cache_values_by_time_and_count                          *
- *                                                                            *
- * Purpose: cache the specified number of history data values for time period *
- *          since timestamp                                                   *
+ * Function: vch_item_free_chunk                                              *
  *                                                                            *
- * Parameters: item        - [IN] the item                                    *
- *             range_start - [IN] the interval start time                     *
- *             count       - [IN] the number of history values to retrieve    *
- *             ts          - [IN] the target timestamp                        *
+ * Purpose: frees chunk and all resources allocated to store its values       *
  *                                                                            *
- * Return value:  >=0    - the number of values read from database            *
- *                FAIL   - an error occurred while trying to cache values     *
+ * Parameters: item    - [IN] the chunk owner item                            *
+ *             chunk   - [IN] the chunk to free                               *
  *                                                                            *
- * Comments: This function checks if the requested number of values is cached *
- *           and updates cache from database if necessary.                    *
+ * Return value: the number of bytes freed                                    *
  *                                                                            *
  ******************************************************************************/
-static int	vch_item_cache_values_by_time_and_count(zbx_vc_item_t *item, int range_start, int count,
-		const zbx_timespec_t *ts)
+static size_t	vch_item_free_chunk(zbx_vc_item_t *item, zbx_vc_chunk_t *chunk)
 {
-	int	ret = SUCCEED, cached_records = 0, range_end;
+	size_t	freed;
 
-	if (ZBX_ITEM_STATUS_CACHED_ALL == item->status)
-		return SUCCEED;
+	freed = vch_chunk_size(chunk);
 
-	/* check if the requested period is in the cached range */
-	if (0 != item->db_cached_from && range_start >= item->db_cached_from)
-		return SUCCEED;
+	/* compressed chunks contain only numeric values that don't need to be freed */
+	freed += vc_item_free_values(item, chunk->slots, chunk->first_value, chunk->last_value);
 
-	/* find if the cache should be updated to cover the required count */
-	if (NULL != item->head)
-	{
-		zbx_vc_chunk_t	*chunk;
-		int		index;
+	__vc_mem_free_func(chunk);
 
-		if (SUCCEED == vch_item_get_last_value(item, ts, &chunk, &index))
-		{
-			cached_records = index - chunk->first_value + 1;
+	return freed;
+}
 
-			while (NULL != (chunk = chunk->prev) && cached_records < count)
-				cached_records += chunk->last_value - chunk->first_value + 1;
-		}
-	}
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_item_remove_chunk                                            *
+ *                                                                            *
+ * Purpose: removes item history data chunk                                   *
+ *                                                                            *
+ * Parameters: item    - [IN ] the chunk owner item                           *
+ *             chunk   - [IN] the chunk to remove                             *
+ *                                                                            *
+ ******************************************************************************/
+static void	vch_item_remove_chunk(zbx_vc_item_t *item, zbx_vc_chunk_t *chunk)
+{
+	if (NULL != chunk->next)
+		chunk->next->prev = chunk->prev;
 
-	/* update cache if necessary */
-	if (cached_records < count)
-	{
-		zbx_vector_history_record_t	records;
+	if (NULL != chunk->prev)
+		chunk->prev->next = chunk->next;
 
-		/* get the end timestamp to which (including) the values should be cached */
-		if (NULL != item->head)
-			range_end = item->tail->slots[item->tail->first_value].timestamp.sec - 1;
-		else
-			range_end = time(NULL);
+	if (chunk == item->head)
+		item->head = chunk->prev;
 
-		vc_try_unlock();
+	if (chunk == item->tail)
+		item->tail = chunk->next;
 
-		zbx_vector_history_record_create(&records);
+	vch_item_free_chunk(item, chunk);
+}
 
-		if (range_end > ts->sec)
-		{
-			ret = vc_db_read_values_by_time(item->itemid, item->value_type, &records, ts->sec + 1,
-					range_end);
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_item_clean_cache                                             *
+ *                                                                            *
+ * Purpose: removes item history data that are outside (older) the maximum    *
+ *          request range                                                     *
+ *                                                                            *
+ * Parameters:  item   - [IN] the target item                                 *
+ *                                                                            *
+ ******************************************************************************/
+static void	vch_item_clean_cache(zbx_vc_item_t *item)
+{
+	zbx_vc_chunk_t	*next;
+	zbx_vc_aggr_t	*aggr, **prev;
+	int		expire_timestamp;
 
-			range_end = ts->sec;
-		}
+	/* remove the aggregates that were not requested during the last day */
+	expire_timestamp = time(NULL) - ZBX_VC_ITEM_EXPIRE_PERIOD;
 
-		if (SUCCEED == ret && SUCCEED == (ret = vc_db_read_values_by_time_and_count(item->itemid,
-				item->value_type, &records, range_start, count - cached_records, range_end, ts)))
+	for (prev = &item->aggrs; NULL != (aggr = *prev);)
+	{
+		if (aggr->last_accessed < expire_timestamp)
 		{
-			zbx_vector_history_record_sort(&records,
-					(zbx_compare_func_t)zbx_history_record_compare_asc_func);
+			*prev = aggr->next;
+			vch_aggr_free(aggr);
 		}
+		else
+			prev = &aggr->next;
+	}
 
-		vc_try_lock();
+	if (0 != item->active_range)
+	{
+		zbx_vc_chunk_t		*tail = item->tail;
+		zbx_vc_chunk_t		*chunk = tail;
+		int			timestamp, last_sec, head_sec;
+		zbx_history_record_t	*next_slots;
 
-		if (SUCCEED == ret)
+		timestamp = time(NULL) - item->active_range;
+		head_sec = vch_chunk_slots(item, item->head)[item->head->last_value].timestamp.sec;
+
+		/* try to remove chunks with all history values older than maximum request range */
+		while (NULL != chunk && (last_sec = vch_chunk_slots(item, chunk)[chunk->last_value].timestamp.sec) <
+				timestamp && last_sec != head_sec)
 		{
-			if (0 < records.values_num)
-				ret = vch_item_add_values_at_tail(item, records.values, records.values_num);
+			/* don't remove the head chunk */
+			if (NULL == (next = chunk->next))
+				break;
 
-			if (SUCCEED == ret)
+			next_slots = vch_chunk_slots(item, next);
+
+			/* Values with the same timestamps (seconds resolution) always should be either   */
+			/* kept in cache or removed together. There should not be a case when one of them */
+			/* is in cache and the second is dropped.                                         */
+			/* Here we are handling rare case, when the last value of first chunk has the     */
+			/* same timestamp (seconds resolution) as the first value in the second chunk.    */
+			/* In this case increase the first value index of the next chunk until the first  */
+			/* value timestamp is greater.                                                    */
+
+			if (next_slots[next->first_value].timestamp.sec != next_slots[next->last_value].timestamp.sec)
 			{
-				ret = records.values_num;
-				if ((count <= records.values_num || 0 == range_start) && 0 != records.values_num)
+				while (next_slots[next->first_value].timestamp.sec == last_sec)
 				{
-					vc_item_update_db_cached_from(item,
-							item->tail->slots[item->tail->first_value].timestamp.sec);
+					vc_item_free_values(item, next->slots, next->first_value, next->first_value);
+					next->first_value++;
 				}
-				else if (0 != range_start)
-					vc_item_update_db_cached_from(item, range_start);
 			}
+
+			/* set the database cached from timestamp to the last (oldest) removed value timestamp + 1 */
+			item->db_cached_from = last_sec + 1;
+
+			vch_item_remove_chunk(item, chunk);
+
+			chunk = next;
 		}
 
-		zbx_history_record_vector_destroy(&records, item->value_type);
+		/* reset the status flags if data was removed from cache */
+		if (tail != item->tail)
+			item->status = 0;
 	}
-
-	return ret;
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: vch_item_get_values_by_time                                      *
+ * Function: vch_item_remove_values                                           *
  *                                                                            *
- * Purpose: retrieves item history data from cache                            *
+ * Purpose: removes item history data that are older than the specified       *
+ *          timestamp                                                         *
  *                                                                            *
- * Parameters: item      - [IN] the item                                      *
- *             values    - [OUT] the item history data stored time/value      *
- *                         pairs in undefined order                           *
- *             seconds   - [IN] the time period to retrieve data for          *
- *             ts        - [IN] the requested period end timestamp            *
+ * Parameters:  item      - [IN] the target item                              *
+ *              timestamp - [IN] the timestamp (number of seconds since the   *
+ *                               Epoch)                                       *
  *                                                                            *
  ******************************************************************************/
-static void	vch_item_get_values_by_time(zbx_vc_item_t *item, zbx_vector_history_record_t *values, int seconds,
-		const zbx_timespec_t *ts)
+static void	vch_item_remove_values(zbx_vc_item_t *item, int timestamp)
 {
-	int		index, now;
-	zbx_timespec_t	start = {ts->sec - seconds, ts->ns};
-	zbx_vc_chunk_t	*chunk;
+	zbx_vc_chunk_t		*chunk = item->tail;
+	zbx_history_record_t	*slots;
 
-	/* Check if maximum request range is not set and all data are cached.  */
-	/* Because that indicates there was a count based request with unknown */
-	/* range which might be greater than the current request range.        */
-	if (0 != item->active_range || ZBX_ITEM_STATUS_CACHED_ALL != item->status)
-	{
-		now = time(NULL);
-		/* add another second to include nanosecond shifts */
-		vch_item_update_range(item, seconds + now - ts->sec + 1, now);
-	}
+	if (ZBX_ITEM_STATUS_CACHED_ALL == item->status)
+		item->status = 0;
 
-	if (FAIL == vch_item_get_last_value(item, ts, &chunk, &index))
+	/* try to remove chunks with all history values older than the timestamp */
+	while ((slots = vch_chunk_slots(item, chunk))[chunk->first_value].timestamp.sec < timestamp)
 	{
-		/* Cache does not contain records for the specified timeshift & seconds range. */
-		/* Return empty vector with success.                                           */
-		return;
-	}
+		zbx_vc_chunk_t	*next;
 
-	/* fill the values vector with item history values until the start timestamp is reached */
-	while (0 < zbx_timespec_compare(&chunk->slots[chunk->last_value].timestamp, &start))
-	{
-		while (index >= chunk->first_value && 0 < zbx_timespec_compare(&chunk->slots[index].timestamp, &start))
-			vc_history_record_vector_append(values, item->value_type, &chunk->slots[index--]);
+		/* If chunk contains values with timestamp greater or equal - remove */
+		/* only the values with less timestamp. Otherwise remove the while   */
+		/* chunk and check next one.                                         */
+		if (slots[chunk->last_value].timestamp.sec >= timestamp)
+		{
+			while (slots[chunk->first_value].timestamp.sec < timestamp)
+			{
+				vc_item_free_values(item, chunk->slots, chunk->first_value, chunk->first_value);
+				chunk->first_value++;
+			}
 
-		if (NULL == (chunk = chunk->prev))
 			break;
+		}
 
-		index = chunk->last_value;
+		next = chunk->next;
+		vch_item_remove_chunk(item, chunk);
+
+		/* empty items must be removed to avoid situation when a new value is added to cache */
+		/* while other values with matching timestamp seconds are not cached                 */
+		if (NULL == next)
+		{
+			item->state |= ZBX_ITEM_STATE_REMOVE_PENDING;
+			break;
+		}
+
+		chunk = next;
 	}
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: vch_item_get_values_by_time_and_count                            *
+ * Function: vch_item_add_value_at_head                                       *
  *                                                                            *
- * Purpose: retrieves item history data from cache                            *
+ * Purpose: adds one item history value at the end of current item's history  *
+ *          data                                                              *
  *                                                                            *
- * Parameters: item      - [IN] the item                                      *
- *             values    - [OUT] the item history data stored time/value      *
- *                         pairs in undefined order, optional                 *
- *                         If null then cache is updated if necessary, but no *
- *                         values are returned. Used to ensure that cache     *
- *                         contains a value of the specified timestamp.       *
- *             seconds   - [IN] the time period                               *
- *             count     - [IN] the number of history values to retrieve      *
- *             timestamp - [IN] the target timestamp                          *
+ * Parameters:  item   - [IN] the item to add history data to                 *
+ *              value  - [IN] the item history data value                     *
+ *                                                                            *
+ * Return value: SUCCEED - the history data value was added successfully      *
+ *               FAIL - failed to add history data value (not enough memory)  *
+ *                                                                            *
+ * Comments: In the case of failure the item will be removed from cache       *
+ *           later.                                                           *
  *                                                                            *
  ******************************************************************************/
-static void	vch_item_get_values_by_time_and_count(zbx_vc_item_t *item, zbx_vector_history_record_t *values,
-		int seconds, int count, const zbx_timespec_t *ts)
+static int	vch_item_add_value_at_head(zbx_vc_item_t *item, const zbx_history_record_t *value)
 {
-	int		index, now, range_timestamp;
-	zbx_vc_chunk_t	*chunk;
-	zbx_timespec_t	start;
-
-	/* set start timestamp of the requested time period */
-	if (0 != seconds)
-	{
-		start.sec = ts->sec - seconds;
-		start.ns = ts->ns;
-	}
-	else
-	{
-		start.sec = 0;
-		start.ns = 0;
-	}
+	int		ret = FAIL, index, sindex, nslots = 0;
+	zbx_vc_chunk_t	*head = item->head, *chunk, *schunk;
 
-	if (FAIL == vch_item_get_last_value(item, ts, &chunk, &index))
-	{
-		/* return empty vector with success */
-		goto out;
-	}
+	vch_item_update_aggrs(item, value);
 
-	/* fill the values vector with item history values until the <count> values are read    */
-	/* or no more values within specified time period                                       */
-	/* fill the values vector with item history values until the start timestamp is reached */
-	while (0 < zbx_timespec_compare(&chunk->slots[chunk->last_value].timestamp, &start))
+	if (NULL != item->head && 0 < zbx_history_record_compare_asc_func(
+			&vch_chunk_slots(item, item->head)[item->head->last_value], value))
 	{
-		while (index >= chunk->first_value && 0 < zbx_timespec_compare(&chunk->slots[index].timestamp, &start))
+		if (0 < zbx_history_record_compare_asc_func(&vch_chunk_slots(item, item->tail)[item->tail->first_value],
+				value))
 		{
-			vc_history_record_vector_append(values, item->value_type, &chunk->slots[index--]);
+			/* If the added value has the same or older timestamp as the first value in cache */
+			/* we can't add it to keep cache consistency. Additionally we must make sure no   */
+			/* values with matching timestamp seconds are kept in cache.                      */
+			vch_item_remove_values(item, value->timestamp.sec + 1);
 
-			if (values->values_num == count)
+			/* if the value is newer than the database cached from timestamp we must */
+			/* adjust the cached from timestamp to exclude this value                */
+			if (item->db_cached_from <= value->timestamp.sec)
+				item->db_cached_from = value->timestamp.sec + 1;
+
+			ret = SUCCEED;
+			goto out;
+		}
+
+		/* the values newer than the added value are moved, so their chunks must be decompressed */
+		if (NULL == (schunk = vch_item_decompress_chunk(item, item->head)))
+			goto out;
+
+		sindex = schunk->last_value;
+		head = item->head;
+
+		if (0 == item->head->slots_num - item->head->last_value - 1)
+		{
+			if (FAIL == vch_item_add_chunk(item, vch_item_chunk_slot_count(item, 1), NULL))
 				goto out;
 		}
+		else
+			item->head->last_value++;
 
-		if (NULL == (chunk = chunk->prev))
-			break;
+		item->values_total++;
 
-		index = chunk->last_value;
+		chunk = item->head;
+		index = item->head->last_value;
+
+		do
+		{
+			chunk->slots[index] = schunk->slots[sindex];
+
+			chunk = schunk;
+			index = sindex;
+
+			if (--sindex < schunk->first_value)
+			{
+				if (NULL == (schunk = schunk->prev))
+				{
+					memset(&chunk->slots[index], 0, sizeof(zbx_vc_chunk_t));
+					THIS_SHOULD_NEVER_HAPPEN;
+
+					goto out;
+				}
+
+				if (NULL == (schunk = vch_item_decompress_chunk(item, schunk)))
+					goto out;
+
+				sindex = schunk->last_value;
+			}
+		}
+		while (0 < zbx_timespec_compare(&schunk->slots[sindex].timestamp, &value->timestamp));
 	}
-out:
-	if (count > values->values_num)
+	else
 	{
-		if (0 == seconds)
+		/* find the number of free slots on the right side in last (head) chunk */
+		if (NULL != item->head)
+			nslots = item->head->slots_num - item->head->last_value - 1;
+
+		if (0 == nslots)
 		{
-			/* not enough data in db to fulfill a count based request request */
-			item->active_range = 0;
-			item->daily_range = 0;
-			item->status = ZBX_ITEM_STATUS_CACHED_ALL;
-			return;
+			if (FAIL == vch_item_add_chunk(item, vch_item_chunk_slot_count(item, 1), NULL))
+				goto out;
 		}
-		/* not enough data in the requested period, set the range equal to the period plus */
-		/* one second to include nanosecond shifts                                         */
-		range_timestamp = ts->sec - seconds;
+		else
+			item->head->last_value++;
+
+		item->values_total++;
+
+		chunk = item->head;
+		index = item->head->last_value;
 	}
-	else
+
+	if (SUCCEED != vch_item_copy_value(item, chunk, index, value))
+		goto out;
+
+	/* try to remove old (unused) chunks if a new chunk was added */
+	if (head != item->head)
 	{
-		/* the requested number of values was retrieved, set the range to the oldest value timestamp */
-		range_timestamp = values->values[values->values_num - 1].timestamp.sec - 1;
+		vch_item_compress_chunk(item, item->head->prev);
+		item->state |= ZBX_ITEM_STATE_CLEAN_PENDING;
 	}
 
-	now = time(NULL);
-	vch_item_update_range(item, now - range_timestamp, now);
+	ret = SUCCEED;
+out:
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_item_add_values_at_tail                                      *
+ *                                                                            *
+ * Purpose: adds item history values at the beginning of current item's       *
+ *          history data                                                      *
+ *                                                                            *
+ * Parameters:  item   - [IN] the item to add history data to                 *
+ *              values - [IN] the item history data values                    *
+ *              num    - [IN] the number of history data values to add        *
+ *                                                                            *
+ * Return value: SUCCEED - the history data values were added successfully    *
+ *               FAIL - failed to add history data values (not enough memory) *
+ *                                                                            *
+ * Comments: In the case of failure the item is removed from cache.           *
+ *           Overlapping values (by timestamp seconds) are ignored.           *
+ *                                                                            *
+ ******************************************************************************/
+static int	vch_item_add_values_at_tail(zbx_vc_item_t *item, const zbx_history_record_t *values, int values_num)
+{
+	int 	count = values_num, ret = FAIL;
+
+	/* skip values already added to the item cache by another process */
+	if (NULL != item->tail)
+	{
+		int	sec = vch_chunk_slots(item, item->tail)[item->tail->first_value].timestamp.sec;
+
+		while (--count >= 0 && values[count].timestamp.sec >= sec)
+			;
+		++count;
+	}
+
+	while (0 != count)
+	{
+		int	copy_slots, nslots = 0;
+
+		/* find the number of free slots on the left side in first (tail) chunk */
+		if (NULL != item->tail && 0 == item->tail->compressed_size)
+			nslots = item->tail->first_value;
+
+		if (0 == nslots)
+		{
+			/* the filled tail chunk will not be modified anymore */
+			if (NULL != item->tail)
+				vch_item_compress_chunk(item, item->tail);
+
+			nslots = vch_item_chunk_slot_count(item, count);
+
+			if (FAIL == vch_item_add_chunk(item, nslots, item->tail))
+				goto out;
+
+			item->tail->last_value = nslots - 1;
+			item->tail->first_value = nslots;
+		}
+
+		/* copy values to chunk */
+		copy_slots = MIN(nslots, count);
+		count -= copy_slots;
+
+		if (FAIL == vch_item_copy_values_at_tail(item, values + count, copy_slots))
+			goto out;
+	}
+
+	if (0 == item->tail->first_value)
+		vch_item_compress_chunk(item, item->tail);
+
+	ret = SUCCEED;
+out:
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_item_cache_values_by_time                                    *
+ *                                                                            *
+ * Purpose: cache item history data for the specified time period             *
+ *                                                                            *
+ * Parameters: item        - [IN] the item                                    *
+ *             range_start - [IN] the interval start time                     *
+ *                                                                            *
+ * Return value:  >=0    - the number of values read from database            *
+ *                FAIL   - an error occurred while trying to cache values     *
+ *                                                                            *
+ * Comments: This function checks if the requested value range is cached and  *
+ *           updates cache from database if necessary.                        *
+ *                                                                            *
+ ******************************************************************************/
+static int	vch_item_cache_values_by_time(zbx_vc_item_t *item, int range_start)
+{
+	int	ret = SUCCEED, range_end;
+
+	if (ZBX_ITEM_STATUS_CACHED_ALL == item->status)
+		return SUCCEED;
+
+	/* check if the requested period is in the cached range */
+	if (0 != item->db_cached_from && range_start >= item->db_cached_from)
+		return SUCCEED;
+
+	/* find if the cache should be updated to cover the required range */
+	if (NULL != item->tail)
+	{
+		/* we need to get item values before the first cached value, but not including it */
+		range_end = vch_chunk_slots(item, item->tail)[item->tail->first_value].timestamp.sec - 1;
+	}
+	else
+		range_end = time(NULL);
+
+	/* update cache if necessary */
+	if (range_start < range_end)
+	{
+		zbx_vector_history_record_t	records;
+
+		zbx_vector_history_record_create(&records);
+
+		vc_try_unlock();
+
+		if (SUCCEED == (ret = vc_db_read_values_by_time(item->itemid, item->value_type, &records,
+				range_start, range_end)))
+		{
+			zbx_vector_history_record_sort(&records,
+					(zbx_compare_func_t)zbx_history_record_compare_asc_func);
+		}
+
+		vc_try_lock();
+
+		if (SUCCEED == ret)
+		{
+			if (0 < records.values_num)
+				ret = vch_item_add_values_at_tail(item, records.values, records.values_num);
+
+			/* when updating cache with time based request we can always reset status flags */
+			/* flag even if the requested period contains no data                           */
+			item->status = 0;
+
+			if (SUCCEED == ret)
+			{
+				ret = records.values_num;
+				vc_item_update_db_cached_from(item, range_start);
+			}
+
+		}
+		zbx_history_record_vector_destroy(&records, item->value_type);
+	}
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_item_cache_values_by_time_and_count                          *
+ *                                                                            *
+ * Purpose: cache the specified number of history data values for time period *
+ *          since timestamp                                                   *
+ *                                                                            *
+ * Parameters: item        - [IN] the item                                    *
+ *             range_start - [IN] the interval start time                     *
+ *             count       - [IN] the number of history values to retrieve    *
+ *             ts          - [IN] the target timestamp                        *
+ *                                                                            *
+ * Return value:  >=0    - the number of values read from database            *
+ *                FAIL   - an error occurred while trying to cache values     *
+ *                                                                            *
+ * Comments: This function checks if the requested number of values is cached *
+ *           and updates cache from database if necessary.                    *
+ *                                                                            *
+ ******************************************************************************/
+static int	vch_item_cache_values_by_time_and_count(zbx_vc_item_t *item, int range_start, int count,
+		const zbx_timespec_t *ts)
+{
+	int	ret = SUCCEED, cached_records = 0, range_end;
+
+	if (ZBX_ITEM_STATUS_CACHED_ALL == item->status)
+		return SUCCEED;
+
+	/* check if the requested period is in the cached range */
+	if (0 != item->db_cached_from && range_start >= item->db_cached_from)
+		return SUCCEED;
+
+	/* find if the cache should be updated to cover the required count */
+	if (NULL != item->head)
+	{
+		zbx_vc_chunk_t	*chunk;
+		int		index;
+
+		if (SUCCEED == vch_item_get_last_value(item, ts, &chunk, &index))
+		{
+			cached_records = index - chunk->first_value + 1;
+
+			while (NULL != (chunk = chunk->prev) && cached_records < count)
+				cached_records += chunk->last_value - chunk->first_value + 1;
+		}
+	}
+
+	/* update cache if necessary */
+	if (cached_records < count)
+	{
+		zbx_vector_history_record_t	records;
+
+		/* get the end timestamp to which (including) the values should be cached */
+		if (NULL != item->head)
+			range_end = vch_chunk_slots(item, item->tail)[item->tail->first_value].timestamp.sec - 1;
+		else
+			range_end = time(NULL);
+
+		vc_try_unlock();
+
+		zbx_vector_history_record_create(&records);
+
+		if (range_end > ts->sec)
+		{
+			ret = vc_db_read_values_by_time(item->itemid, item->value_type, &records, ts->sec + 1,
+					range_end);
+
+			range_end = ts->sec;
+		}
+
+		if (SUCCEED == ret && SUCCEED == (ret = vc_db_read_values_by_time_and_count(item->itemid,
+				item->value_type, &records, range_start, count - cached_records, range_end, ts)))
+		{
+			zbx_vector_history_record_sort(&records,
+					(zbx_compare_func_t)zbx_history_record_compare_asc_func);
+		}
+
+		vc_try_lock();
+
+		if (SUCCEED == ret)
+		{
+			if (0 < records.values_num)
+				ret = vch_item_add_values_at_tail(item, records.values, records.values_num);
+
+			if (SUCCEED == ret)
+			{
+				ret = records.values_num;
+				if ((count <= records.values_num || 0 == range_start) && 0 != records.values_num)
+				{
+					vc_item_update_db_cached_from(item,
+							vch_chunk_slots(item, item->tail)[item->tail->first_value].timestamp.sec);
+				}
+				else if (0 != range_start)
+					vc_item_update_db_cached_from(item, range_start);
+			}
+		}
+
+		zbx_history_record_vector_destroy(&records, item->value_type);
+	}
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_item_get_values_by_time                                      *
+ *                                                                            *
+ * Purpose: retrieves item history data from cache                            *
+ *                                                                            *
+ * Parameters: item      - [IN] the item                                      *
+ *             values    - [OUT] the item history data stored time/value      *
+ *                         pairs in undefined order                           *
+ *             seconds   - [IN] the time period to retrieve data for          *
+ *             ts        - [IN] the requested period end timestamp            *
+ *                                                                            *
+ ******************************************************************************/
+static void	vch_item_get_values_by_time(zbx_vc_item_t *item, zbx_vector_history_record_t *values, int seconds,
+		const zbx_timespec_t *ts)
+{
+	int		index, now;
+	zbx_timespec_t		start = {ts->sec - seconds, ts->ns};
+	zbx_vc_chunk_t		*chunk;
+	zbx_history_record_t	*slots;
+
+	/* Check if maximum request range is not set and all data are cached.  */
+	/* Because that indicates there was a count based request with unknown */
+	/* range which might be greater than the current request range.        */
+	if (0 != item->active_range || ZBX_ITEM_STATUS_CACHED_ALL != item->status)
+	{
+		now = time(NULL);
+		/* add another second to include nanosecond shifts */
+		vch_item_update_range(item, seconds + now - ts->sec + 1, now);
+	}
+
+	if (FAIL == vch_item_get_last_value(item, ts, &chunk, &index))
+	{
+		/* Cache does not contain records for the specified timeshift & seconds range. */
+		/* Return empty vector with success.                                           */
+		return;
+	}
+
+	/* fill the values vector with item history values until the start timestamp is reached */
+	while (0 < zbx_timespec_compare(&(slots = vch_chunk_slots(item, chunk))[chunk->last_value].timestamp, &start))
+	{
+		while (index >= chunk->first_value && 0 < zbx_timespec_compare(&slots[index].timestamp, &start))
+			vc_history_record_vector_append(values, item->value_type, &slots[index--]);
+
+		if (NULL == (chunk = chunk->prev))
+			break;
+
+		index = chunk->last_value;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_item_get_values_by_time_and_count                            *
+ *                                                                            *
+ * Purpose: retrieves item history data from cache                            *
+ *                                                                            *
+ * Parameters: item      - [IN] the item                                      *
+ *             values    - [OUT] the item history data stored time/value      *
+ *                         pairs in undefined order, optional                 *
+ *                         If null then cache is updated if necessary, but no *
+ *                         values are returned. Used to ensure that cache     *
+ *                         contains a value of the specified timestamp.       *
+ *             seconds   - [IN] the time period                               *
+ *             count     - [IN] the number of history values to retrieve      *
+ *             timestamp - [IN] the target timestamp                          *
+ *                                                                            *
+ ******************************************************************************/
+static void	vch_item_get_values_by_time_and_count(zbx_vc_item_t *item, zbx_vector_history_record_t *values,
+		int seconds, int count, const zbx_timespec_t *ts)
+{
+	int			index, now, range_timestamp;
+	zbx_vc_chunk_t		*chunk;
+	zbx_timespec_t		start;
+	zbx_history_record_t	*slots;
+
+	/* set start timestamp of the requested time period */
+	if (0 != seconds)
+	{
+		start.sec = ts->sec - seconds;
+		start.ns = ts->ns;
+	}
+	else
+	{
+		start.sec = 0;
+		start.ns = 0;
+	}
+
+	if (FAIL == vch_item_get_last_value(item, ts, &chunk, &index))
+	{
+		/* return empty vector with success */
+		goto out;
+	}
+
+	/* fill the values vector with item history values until the <count> values are read    */
+	/* or no more values within specified time period                                       */
+	/* fill the values vector with item history values until the start timestamp is reached */
+	while (0 < zbx_timespec_compare(&(slots = vch_chunk_slots(item, chunk))[chunk->last_value].timestamp, &start))
+	{
+		while (index >= chunk->first_value && 0 < zbx_timespec_compare(&slots[index].timestamp, &start))
+		{
+			vc_history_record_vector_append(values, item->value_type, &slots[index--]);
+
+			if (values->values_num == count)
+				goto out;
+		}
+
+		if (NULL == (chunk = chunk->prev))
+			break;
+
+		index = chunk->last_value;
+	}
+out:
+	if (count > values->values_num)
+	{
+		if (0 == seconds)
+		{
+			/* not enough data in db to fulfill a count based request request */
+			item->active_range = 0;
+			item->daily_range = 0;
+			item->status = ZBX_ITEM_STATUS_CACHED_ALL;
+			return;
+		}
+		/* not enough data in the requested period, set the range equal to the period plus */
+		/* one second to include nanosecond shifts                                         */
+		range_timestamp = ts->sec - seconds;
+	}
+	else
+	{
+		/* the requested number of values was retrieved, set the range to the oldest value timestamp */
+		range_timestamp = values->values[values->values_num - 1].timestamp.sec - 1;
+	}
+
+	now = time(NULL);
+	vch_item_update_range(item, now - range_timestamp, now);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_item_get_value_range                                         *
+ *                                                                            *
+ * Purpose: get item values for the specified range                           *
+ *                                                                            *
+ * Parameters: item      - [IN] the item                                      *
+ *             values    - [OUT] the item history data stored time/value      *
+ *                         pairs in undefined order, optional                 *
+ *                         If null then cache is updated if necessary, but no *
+ *                         values are returned. Used to ensure that cache     *
+ *                         contains a value of the specified timestamp.       *
+ *             seconds   - [IN] the time period to retrieve data for          *
+ *             count     - [IN] the number of history values to retrieve      *
+ *             ts        - [IN] the target timestamp                          *
+ *                                                                            *
+ * Return value:  SUCCEED - the item history data was retrieved successfully  *
+ *                FAIL    - the item history data was not retrieved           *
+ *                                                                            *
+ * Comments: This function returns data from cache if necessary updating it   *
+ *           from DB. If cache update was required and failed (not enough     *
+ *           memory to cache DB values), then this function also fails.       *
+ *                                                                            *
+ *           If <count> is set then value range is defined as <count> values  *
+ *           before <timestamp>. Otherwise the range is defined as <seconds>  *
+ *           seconds before <timestamp>.                                      *
+ *                                                                            *
+ ******************************************************************************/
+static int	vch_item_get_values(zbx_vc_item_t *item, zbx_vector_history_record_t *values, int seconds,
+		int count, const zbx_timespec_t *ts)
+{
+	int	ret, records_read, hits, misses, range_start;
+
+	zbx_vector_history_record_clear(values);
+
+	if (0 == count)
+	{
+		if (0 > (range_start = ts->sec - seconds))
+			range_start = 0;
+
+		if (FAIL == (ret = vch_item_cache_values_by_time(item, range_start)))
+			goto out;
+
+		records_read = ret;
+
+		vch_item_get_values_by_time(item, values, seconds, ts);
+
+		if (records_read > values->values_num)
+			records_read = values->values_num;
+	}
+	else
+	{
+		range_start = (0 == seconds ? 0 : ts->sec - seconds);
+
+		if (FAIL == (ret = vch_item_cache_values_by_time_and_count(item, range_start, count, ts)))
+			goto out;
+
+		records_read = ret;
+
+		vch_item_get_values_by_time_and_count(item, values, seconds, count, ts);
+
+		if (records_read > values->values_num)
+			records_read = values->values_num;
+	}
+
+	hits = values->values_num - records_read;
+	misses = records_read;
+
+	vc_update_statistics(item, hits, misses);
+
+	ret = SUCCEED;
+out:
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_aggr_value                                                   *
+ *                                                                            *
+ * Purpose: gets value from aggregate ring buffer                             *
+ *                                                                            *
+ * Parameters: aggr  - [IN] the aggregate                                     *
+ *             index - [IN] the value index, 0 being the oldest value         *
+ *                                                                            *
+ * Return value: the value                                                    *
+ *                                                                            *
+ ******************************************************************************/
+static zbx_history_record_t	*vch_aggr_value(const zbx_vc_aggr_t *aggr, int index)
+{
+	return &aggr->values[(aggr->values_first + index) % aggr->values_alloc];
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_aggr_free                                                    *
+ *                                                                            *
+ * Purpose: frees aggregate                                                   *
+ *                                                                            *
+ * Parameters: aggr - [IN] the aggregate                                      *
+ *                                                                            *
+ * Return value: the size of freed memory (bytes)                             *
+ *                                                                            *
+ ******************************************************************************/
+static size_t	vch_aggr_free(zbx_vc_aggr_t *aggr)
+{
+	size_t	freed = sizeof(zbx_vc_aggr_t);
+
+	if (NULL != aggr->values)
+	{
+		freed += aggr->values_alloc * sizeof(zbx_history_record_t);
+		__vc_mem_free_func(aggr->values);
+	}
+
+	__vc_mem_free_func(aggr);
+
+	return freed;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_item_free_aggrs                                              *
+ *                                                                            *
+ * Purpose: frees all aggregates of the item                                  *
+ *                                                                            *
+ * Parameters: item - [IN] the item                                           *
+ *                                                                            *
+ * Return value: the size of freed memory (bytes)                             *
+ *                                                                            *
+ ******************************************************************************/
+static size_t	vch_item_free_aggrs(zbx_vc_item_t *item)
+{
+	size_t		freed = 0;
+	zbx_vc_aggr_t	*aggr;
+
+	while (NULL != (aggr = item->aggrs))
+	{
+		item->aggrs = aggr->next;
+		freed += vch_aggr_free(aggr);
+	}
+
+	return freed;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_aggr_sum_is_dbl                                              *
+ *                                                                            *
+ * Purpose: checks if the aggregate running sum is kept as floating point     *
+ *          value                                                             *
+ *                                                                            *
+ * Comments: The sum of unsigned values is calculated as floating point value *
+ *           for average function, the same way as when values are scanned.   *
+ *                                                                            *
+ ******************************************************************************/
+static int	vch_aggr_sum_is_dbl(const zbx_vc_item_t *item, const zbx_vc_aggr_t *aggr)
+{
+	return ITEM_VALUE_TYPE_FLOAT == item->value_type || ZBX_VC_AGGR_AVG == aggr->func;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_aggr_sum_add                                                 *
+ *                                                                            *
+ * Purpose: adds value to (or subtracts from) aggregate floating point sum    *
+ *                                                                            *
+ * Parameters: aggr  - [IN/OUT] the aggregate                                 *
+ *             value - [IN] the value to add                                  *
+ *                                                                            *
+ * Comments: The rounding errors are accumulated separately (Neumaier         *
+ *           summation), so the sum does not drift when values are removed.  *
+ *                                                                            *
+ ******************************************************************************/
+static void	vch_aggr_sum_add(zbx_vc_aggr_t *aggr, double value)
+{
+	double	sum = aggr->sum.dbl + value;
+
+	if (fabs(aggr->sum.dbl) >= fabs(value))
+		aggr->sum_error += (aggr->sum.dbl - sum) + value;
+	else
+		aggr->sum_error += (value - sum) + aggr->sum.dbl;
+
+	aggr->sum.dbl = sum;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_aggr_sum_value                                               *
+ *                                                                            *
+ * Purpose: adds value to (or subtracts from) aggregate running sum           *
+ *                                                                            *
+ * Parameters: item   - [IN] the item                                         *
+ *             aggr   - [IN/OUT] the aggregate                                *
+ *             value  - [IN] the value                                        *
+ *             sign   - [IN] 1 - add value, -1 - subtract value               *
+ *                                                                            *
+ ******************************************************************************/
+static void	vch_aggr_sum_value(const zbx_vc_item_t *item, zbx_vc_aggr_t *aggr, const history_value_t *value,
+		int sign)
+{
+	if (0 == vch_aggr_sum_is_dbl(item, aggr))
+	{
+		if (0 < sign)
+			aggr->sum.ui64 += value->ui64;
+		else
+			aggr->sum.ui64 -= value->ui64;
+
+		return;
+	}
+
+	if (ITEM_VALUE_TYPE_FLOAT == item->value_type)
+		vch_aggr_sum_add(aggr, sign * value->dbl);
+	else
+		vch_aggr_sum_add(aggr, sign * (double)value->ui64);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_aggr_value_compare                                           *
+ *                                                                            *
+ * Purpose: compares two numeric values                                       *
+ *                                                                            *
+ * Return value: <0 - the first value is less than the second                 *
+ *               0  - the values are equal                                    *
+ *               >0 - the first value is greater than the second              *
+ *                                                                            *
+ ******************************************************************************/
+static int	vch_aggr_value_compare(const zbx_vc_item_t *item, const history_value_t *v1,
+		const history_value_t *v2)
+{
+	if (ITEM_VALUE_TYPE_FLOAT == item->value_type)
+	{
+		if (v1->dbl < v2->dbl)
+			return -1;
+
+		return v1->dbl > v2->dbl ? 1 : 0;
+	}
+
+	if (v1->ui64 < v2->ui64)
+		return -1;
+
+	return v1->ui64 > v2->ui64 ? 1 : 0;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_aggr_reserve                                                 *
+ *                                                                            *
+ * Purpose: ensures that aggregate ring buffer can hold the specified number  *
+ *          of values                                                         *
+ *                                                                            *
+ * Parameters: item       - [IN] the item                                     *
+ *             aggr       - [IN/OUT] the aggregate                            *
+ *             values_num - [IN] the number of values                         *
+ *                                                                            *
+ * Return value: SUCCEED - the ring buffer has enough space                   *
+ *               FAIL    - not enough memory                                  *
+ *                                                                            *
+ ******************************************************************************/
+static int	vch_aggr_reserve(zbx_vc_item_t *item, zbx_vc_aggr_t *aggr, int values_num)
+{
+	zbx_history_record_t	*values;
+	int			i, values_alloc;
+
+	if (values_num <= aggr->values_alloc)
+		return SUCCEED;
+
+	values_alloc = (0 == aggr->values_alloc ? ZBX_VC_AGGR_VALUES_INIT : aggr->values_alloc);
+
+	while (values_alloc < values_num)
+		values_alloc *= 2;
+
+	if (NULL == (values = (zbx_history_record_t *)vc_item_malloc(item,
+			values_alloc * sizeof(zbx_history_record_t))))
+	{
+		return FAIL;
+	}
+
+	for (i = 0; i < aggr->values_num; i++)
+		values[i] = *vch_aggr_value(aggr, i);
+
+	if (NULL != aggr->values)
+		__vc_mem_free_func(aggr->values);
+
+	aggr->values = values;
+	aggr->values_alloc = values_alloc;
+	aggr->values_first = 0;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_aggr_add_value                                               *
+ *                                                                            *
+ * Purpose: adds a value to aggregate                                         *
+ *                                                                            *
+ * Parameters: item   - [IN] the item                                         *
+ *             aggr   - [IN/OUT] the aggregate                                *
+ *             value  - [IN] the value                                        *
+ *                                                                            *
+ * Return value: SUCCEED - the value was added                                *
+ *               FAIL    - not enough memory                                  *
+ *                                                                            *
+ * Comments: Usually values are added in ascending order and are appended to  *
+ *           the end of ring buffer. Older values are inserted at their       *
+ *           position by timestamp.                                           *
+ *                                                                            *
+ ******************************************************************************/
+static int	vch_aggr_add_value(zbx_vc_item_t *item, zbx_vc_aggr_t *aggr, const zbx_history_record_t *value)
+{
+	zbx_history_record_t	*record;
+	int			index, removed = 0, sign, shift, i;
+
+	/* the aggregate is not requested for values older than its start */
+	if (0 >= zbx_timespec_compare(&value->timestamp, &aggr->start))
+		return SUCCEED;
+
+	if (aggr->values_num == aggr->values_alloc && SUCCEED != vch_aggr_reserve(item, aggr, aggr->values_num + 1))
+		return FAIL;
+
+	for (index = aggr->values_num; 0 < index; index--)
+	{
+		if (0 >= zbx_timespec_compare(&vch_aggr_value(aggr, index - 1)->timestamp, &value->timestamp))
+			break;
+	}
+
+	switch (aggr->func)
+	{
+		case ZBX_VC_AGGR_MIN:
+		case ZBX_VC_AGGR_MAX:
+			sign = (ZBX_VC_AGGR_MIN == aggr->func ? 1 : -1);
+
+			/* the value cannot be the result while a newer lesser (greater) or equal value is in window */
+			if (index < aggr->values_num && 0 >= sign * vch_aggr_value_compare(item,
+					&vch_aggr_value(aggr, index)->value, &value->value))
+			{
+				return SUCCEED;
+			}
+
+			/* older greater (lesser) or equal values cannot be the result while the new value is in window */
+			while (removed < index && 0 <= sign * vch_aggr_value_compare(item,
+					&vch_aggr_value(aggr, index - removed - 1)->value, &value->value))
+			{
+				removed++;
+			}
+			break;
+		case ZBX_VC_AGGR_SUM:
+		case ZBX_VC_AGGR_AVG:
+			vch_aggr_sum_value(item, aggr, &value->value, 1);
+			break;
+	}
+
+	/* move the newer values to make place for the new value */
+	if (0 < (shift = 1 - removed))
+	{
+		for (i = aggr->values_num - 1; i >= index; i--)
+			*vch_aggr_value(aggr, i + shift) = *vch_aggr_value(aggr, i);
+	}
+	else if (0 > shift)
+	{
+		for (i = index; i < aggr->values_num; i++)
+			*vch_aggr_value(aggr, i + shift) = *vch_aggr_value(aggr, i);
+	}
+
+	aggr->values_num += shift;
+
+	record = vch_aggr_value(aggr, index - removed);
+	record->timestamp = value->timestamp;
+
+	/* only timestamps of textual values are needed for counting */
+	if (ITEM_VALUE_TYPE_FLOAT == item->value_type || ITEM_VALUE_TYPE_UINT64 == item->value_type)
+		record->value = value->value;
+	else
+		memset(&record->value, 0, sizeof(record->value));
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_aggr_remove_values                                           *
+ *                                                                            *
+ * Purpose: removes values that cannot be requested anymore from aggregate    *
+ *                                                                            *
+ * Parameters: item   - [IN] the item                                         *
+ *             aggr   - [IN/OUT] the aggregate                                *
+ *             start  - [IN] the requested window start                       *
+ *                                                                            *
+ * Comments: The values are kept for ZBX_VC_AGGR_KEEP_PERIOD seconds after    *
+ *           leaving the window.                                              *
+ *                                                                            *
+ ******************************************************************************/
+static void	vch_aggr_remove_values(const zbx_vc_item_t *item, zbx_vc_aggr_t *aggr, const zbx_timespec_t *start)
+{
+	zbx_history_record_t	*value;
+	zbx_timespec_t		keep_start = {start->sec - ZBX_VC_AGGR_KEEP_PERIOD, start->ns};
+	int			i;
+
+	if (0 >= zbx_timespec_compare(&keep_start, &aggr->start))
+		return;
+
+	while (0 < aggr->values_num)
+	{
+		value = vch_aggr_value(aggr, 0);
+
+		if (0 < zbx_timespec_compare(&value->timestamp, &keep_start))
+			break;
+
+		if (ZBX_VC_AGGR_SUM == aggr->func || ZBX_VC_AGGR_AVG == aggr->func)
+		{
+			vch_aggr_sum_value(item, aggr, &value->value, -1);
+			aggr->sum_removed++;
+		}
+
+		aggr->values_first = (aggr->values_first + 1) % aggr->values_alloc;
+		aggr->values_num--;
+	}
+
+	/* recalculate floating point sum after the whole window has been replaced, */
+	/* so rounding errors of the removed values are not carried on              */
+	if (0 != aggr->sum_removed && aggr->sum_removed >= aggr->values_num && 0 != vch_aggr_sum_is_dbl(item, aggr))
+	{
+		aggr->sum.dbl = 0;
+		aggr->sum_error = 0;
+
+		for (i = 0; i < aggr->values_num; i++)
+			vch_aggr_sum_value(item, aggr, &vch_aggr_value(aggr, i)->value, 1);
+
+		aggr->sum_removed = 0;
+	}
+
+	aggr->start = keep_start;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_aggr_get_result                                              *
+ *                                                                            *
+ * Purpose: calculates aggregate function result for the requested window     *
+ *                                                                            *
+ * Parameters: item   - [IN] the item                                         *
+ *             aggr   - [IN] the aggregate                                    *
+ *             start  - [IN] the requested window start                       *
+ *             value  - [OUT] the result value, see zbx_vc_get_aggregate()    *
+ *             count  - [OUT] the number of values in window                  *
+ *                                                                            *
+ ******************************************************************************/
+static void	vch_aggr_get_result(const zbx_vc_item_t *item, const zbx_vc_aggr_t *aggr,
+		const zbx_timespec_t *start, history_value_t *value, int *count)
+{
+	zbx_vc_aggr_t		kept = {0};
+	zbx_history_record_t	*record;
+	int			i;
+
+	kept.func = aggr->func;
+
+	/* skip the values kept after leaving the window and sum them for subtraction */
+	for (i = 0; i < aggr->values_num; i++)
+	{
+		record = vch_aggr_value(aggr, i);
+
+		if (0 < zbx_timespec_compare(&record->timestamp, start))
+			break;
+
+		if (ZBX_VC_AGGR_SUM == aggr->func || ZBX_VC_AGGR_AVG == aggr->func)
+			vch_aggr_sum_value(item, &kept, &record->value, 1);
+	}
+
+	*count = aggr->values_num - i;
+
+	if (0 != vch_aggr_sum_is_dbl(item, aggr))
+	{
+		/* subtract kept values sum together with its rounding error */
+		vch_aggr_sum_add(&kept, -aggr->sum.dbl);
+		vch_aggr_sum_add(&kept, -aggr->sum_error);
+		kept.sum.dbl = -(kept.sum.dbl + kept.sum_error);
+	}
+	else
+		kept.sum.ui64 = aggr->sum.ui64 - kept.sum.ui64;
+
+	switch (aggr->func)
+	{
+		case ZBX_VC_AGGR_SUM:
+			*value = kept.sum;
+			break;
+		case ZBX_VC_AGGR_AVG:
+			if (0 != *count)
+				value->dbl = kept.sum.dbl / *count;
+			break;
+		case ZBX_VC_AGGR_MIN:
+		case ZBX_VC_AGGR_MAX:
+			if (0 != *count)
+				*value = vch_aggr_value(aggr, i)->value;
+			break;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_item_update_aggrs                                            *
+ *                                                                            *
+ * Purpose: adds a new item value to item aggregates                          *
+ *                                                                            *
+ * Parameters: item   - [IN] the item                                         *
+ *             value  - [IN] the new value                                    *
+ *                                                                            *
+ * Comments: If there is not enough memory the item aggregates are removed    *
+ *           and will be recreated when requested next time.                  *
+ *                                                                            *
+ ******************************************************************************/
+static void	vch_item_update_aggrs(zbx_vc_item_t *item, const zbx_history_record_t *value)
+{
+	zbx_vc_aggr_t	*aggr;
+
+	for (aggr = item->aggrs; NULL != aggr; aggr = aggr->next)
+	{
+		if (SUCCEED != vch_aggr_add_value(item, aggr, value))
+		{
+			vch_item_free_aggrs(item);
+			return;
+		}
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_item_has_values_after                                        *
+ *                                                                            *
+ * Purpose: checks if item cache contains values newer than the specified     *
+ *          timestamp                                                         *
+ *                                                                            *
+ ******************************************************************************/
+static int	vch_item_has_values_after(const zbx_vc_item_t *item, const zbx_timespec_t *ts)
+{
+	if (NULL == item->head)
+		return FAIL;
+
+	if (0 < zbx_timespec_compare(&vch_chunk_slots(item, item->head)[item->head->last_value].timestamp, ts))
+		return SUCCEED;
+
+	return FAIL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_item_create_aggr                                             *
+ *                                                                            *
+ * Purpose: creates item aggregate from the cached item values                *
+ *                                                                            *
+ * Parameters: item    - [IN] the item                                        *
+ *             func    - [IN] the aggregate function (ZBX_VC_AGGR_*)          *
+ *             seconds - [IN] the window size in seconds                      *
+ *             ts      - [IN] the window end timestamp                        *
+ *                                                                            *
+ * Return value: the created aggregate or NULL if values could not be         *
+ *               retrieved or cache has run out of memory                     *
+ *                                                                            *
+ ******************************************************************************/
+static zbx_vc_aggr_t	*vch_item_create_aggr(zbx_vc_item_t *item, int func, int seconds, const zbx_timespec_t *ts)
+{
+	zbx_vector_history_record_t	values;
+	zbx_vc_aggr_t			*aggr = NULL;
+	int				i;
+
+	zbx_history_record_vector_create(&values);
+
+	/* the cache is unlocked while values are read from database */
+	if (FAIL == vch_item_get_values(item, &values, seconds, 0, ts))
+		goto out;
+
+	/* values newer than the window end might have been added while cache was unlocked */
+	if (SUCCEED == vch_item_has_values_after(item, ts))
+		goto out;
+
+	for (aggr = item->aggrs; NULL != aggr; aggr = aggr->next)
+	{
+		/* the same aggregate was created by another process while cache was unlocked */
+		if (aggr->func == func && aggr->seconds == seconds)
+		{
+			aggr = NULL;
+			goto out;
+		}
+	}
+
+	if (NULL == (aggr = (zbx_vc_aggr_t *)vc_item_malloc(item, sizeof(zbx_vc_aggr_t))))
+		goto out;
+
+	memset(aggr, 0, sizeof(zbx_vc_aggr_t));
+	aggr->func = (unsigned char)func;
+	aggr->seconds = seconds;
+	aggr->start.sec = ts->sec - seconds;
+	aggr->start.ns = ts->ns;
+
+	if (SUCCEED != vch_aggr_reserve(item, aggr, values.values_num))
+	{
+		vch_aggr_free(aggr);
+		aggr = NULL;
+		goto out;
+	}
+
+	/* the values are returned in descending order, the space for them is already reserved */
+	for (i = values.values_num - 1; 0 <= i; i--)
+		vch_aggr_add_value(item, aggr, &values.values[i]);
+
+	aggr->next = item->aggrs;
+	item->aggrs = aggr;
+out:
+	zbx_history_record_vector_destroy(&values, item->value_type);
+
+	return aggr;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_item_get_aggr                                                *
+ *                                                                            *
+ * Purpose: finds item aggregate usable for the specified window or creates   *
+ *          a new one                                                         *
+ *                                                                            *
+ * Parameters: item    - [IN] the item                                        *
+ *             func    - [IN] the aggregate function (ZBX_VC_AGGR_*)          *
+ *             seconds - [IN] the window size in seconds                      *
+ *             ts      - [IN] the window end timestamp                        *
+ *                                                                            *
+ * Return value: the aggregate or NULL if it could not be created             *
+ *                                                                            *
+ ******************************************************************************/
+static zbx_vc_aggr_t	*vch_item_get_aggr(zbx_vc_item_t *item, int func, int seconds, const zbx_timespec_t *ts)
+{
+	zbx_vc_aggr_t	*aggr, **prev;
+	zbx_timespec_t	start = {ts->sec - seconds, ts->ns};
+
+	for (prev = &item->aggrs; NULL != (aggr = *prev); prev = &aggr->next)
+	{
+		if (aggr->func != func || aggr->seconds != seconds)
+			continue;
+
+		if (0 <= zbx_timespec_compare(&start, &aggr->start))
+			return aggr;
+
+		/* the window starts before the values kept in aggregate */
+		*prev = aggr->next;
+		vch_aggr_free(aggr);
+		break;
+	}
+
+	return vch_item_create_aggr(item, func, seconds, ts);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vch_item_free_cache                                              *
+ *                                                                            *
+ * Purpose: frees resources allocated for item history data                   *
+ *                                                                            *
+ * Parameters: item    - [IN] the item                                        *
+ *                                                                            *
+ * Return value: the size of freed memory (bytes)                             *
+ *                                                                            *
+ ******************************************************************************/
+static size_t	vch_item_free_cache(zbx_vc_item_t *item)
+{
+	size_t	freed = 0;
+
+	zbx_vc_chunk_t	*chunk = item->tail;
+
+	while (NULL != chunk)
+	{
+		zbx_vc_chunk_t	*next = chunk->next;
+
+		freed += vch_item_free_chunk(item, chunk);
+		chunk = next;
+	}
+	freed += vch_item_free_aggrs(item);
+
+	item->values_total = 0;
+	item->head = NULL;
+	item->tail = NULL;
+
+	return freed;
+}
+
+/******************************************************************************************************************
+ *                                                                                                                *
+ * Public API                                                                                                     *
+ *                                                                                                                *
+ ******************************************************************************************************************/
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_vc_init                                                      *
+ *                                                                            *
+ * Purpose: initializes value cache                                           *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_vc_init(char **error)
+{
+	const char	*__function_name = "zbx_vc_init";
+	zbx_uint64_t	size_reserved;
+	int		i, ret = FAIL;
+
+	if (0 == CONFIG_VALUE_CACHE_SIZE)
+		return SUCCEED;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+
+	/* split the cache into stripes of at least ZBX_VC_STRIPE_MIN_SIZE bytes */
+	if (ZBX_MUTEX_VALUECACHE_NUM < (vc_stripes_num = (int)(CONFIG_VALUE_CACHE_SIZE / ZBX_VC_STRIPE_MIN_SIZE)))
+		vc_stripes_num = ZBX_MUTEX_VALUECACHE_NUM;
+	else if (0 == vc_stripes_num)
+		vc_stripes_num = 1;
+
+	if (SUCCEED != zbx_mutex_create(&vc_mem_lock, ZBX_MUTEX_VALUECACHE_MEM, error))
+		goto out;
+
+	size_reserved = zbx_mem_required_size(1, "value cache size", "ValueCacheSize");
+
+	if (SUCCEED != zbx_mem_create(&vc_mem, CONFIG_VALUE_CACHE_SIZE, "value cache size", "ValueCacheSize", 1,
+			error))
+	{
+		goto out;
+	}
+
+	if (NULL == (vc_shared = (zbx_vc_shared_t *)__vc_mem_malloc_func(NULL, sizeof(zbx_vc_shared_t))))
+	{
+		*error = zbx_strdup(*error, "cannot allocate value cache header");
+		goto out;
+	}
+	memset(vc_shared, 0, sizeof(zbx_vc_shared_t));
+
+	/* the free space request should be 5% of cache size, but no more than 128KB */
+	vc_shared->min_free_request = ((CONFIG_VALUE_CACHE_SIZE - size_reserved) / 100) * 5;
+	if (vc_shared->min_free_request > 128 * ZBX_KIBIBYTE)
+		vc_shared->min_free_request = 128 * ZBX_KIBIBYTE;
+
+	for (i = 0; i < vc_stripes_num; i++)
+	{
+		if (SUCCEED != zbx_mutex_create(&vc_stripes[i].lock, ZBX_MUTEX_VALUECACHE + i, error))
+			goto out;
+
+		vc_stripe_select(i);
+
+		vc_cache = (zbx_vc_cache_t *)__vc_mem_malloc_func(NULL, sizeof(zbx_vc_cache_t));
+
+		if (NULL == vc_cache)
+		{
+			*error = zbx_strdup(*error, "cannot allocate value cache header");
+			goto out;
+		}
+		memset(vc_cache, 0, sizeof(zbx_vc_cache_t));
+		vc_stripes[i].cache = vc_cache;
+
+		zbx_hashset_create_ext(&vc_cache->items, VC_ITEMS_INIT_SIZE / vc_stripes_num,
+				ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC, NULL,
+				__vc_mem_malloc_func, __vc_mem_realloc_func, __vc_mem_free_func);
+
+		if (NULL == vc_cache->items.slots)
+		{
+			*error = zbx_strdup(*error, "cannot allocate value cache data storage");
+			goto out;
+		}
+
+		zbx_hashset_create_ext(&vc_cache->strpool, VC_STRPOOL_INIT_SIZE / vc_stripes_num,
+				vc_strpool_hash_func, vc_strpool_compare_func, NULL,
+				__vc_mem_malloc_func, __vc_mem_realloc_func, __vc_mem_free_func);
+
+		if (NULL == vc_cache->strpool.slots)
+		{
+			*error = zbx_strdup(*error, "cannot allocate string pool for value cache data storage");
+			goto out;
+		}
+	}
+
+	CONFIG_VALUE_CACHE_SIZE -= size_reserved;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() stripes:%d", __function_name, vc_stripes_num);
+
+	ret = SUCCEED;
+out:
+	zbx_vc_disable();
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_vc_destroy                                                   *
+ *                                                                            *
+ * Purpose: destroys value cache                                              *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_vc_destroy(void)
+{
+	const char	*__function_name = "zbx_vc_destroy";
+	int		i;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+
+	for (i = 0; i < vc_stripes_num; i++)
+	{
+		vc_stripe_select(i);
+
+		if (NULL == vc_cache)
+			continue;
+
+		zbx_mutex_destroy(&vc_stripe->lock);
+
+		zbx_hashset_destroy(&vc_cache->items);
+		zbx_hashset_destroy(&vc_cache->strpool);
+
+		__vc_mem_free_func(vc_cache);
+		vc_cache = vc_stripe->cache = NULL;
+	}
+
+	if (NULL != vc_shared)
+	{
+		__vc_mem_free_func(vc_shared);
+		vc_shared = NULL;
+
+		zbx_mutex_destroy(&vc_mem_lock);
+	}
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_vc_reset                                                     *
+ *                                                                            *
+ * Purpose: resets value cache                                                *
+ *                                                                            *
+ * Comments: All items and their historical data are removed,                 *
+ *           cache working mode, statistics reseted.                          *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_vc_reset(void)
+{
+	const char	*__function_name = "zbx_vc_clean";
+	int		i;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+
+	for (i = 0; i < vc_stripes_num; i++)
+	{
+		zbx_vc_item_t		*item;
+		zbx_hashset_iter_t	iter;
+
+		vc_stripe_select(i);
+
+		if (NULL == vc_cache)
+			continue;
+
+		vc_try_lock();
+
+		zbx_hashset_iter_reset(&vc_cache->items, &iter);
+		while (NULL != (item = (zbx_vc_item_t *)zbx_hashset_iter_next(&iter)))
+		{
+			vch_item_free_cache(item);
+			zbx_hashset_iter_remove(&iter);
+		}
+
+		vc_cache->hits = 0;
+		vc_cache->misses = 0;
+
+		vc_try_unlock();
+	}
+
+	if (NULL != vc_shared)
+	{
+		zbx_mutex_lock(vc_mem_lock);
+
+		vc_shared->min_free_request = 0;
+		vc_shared->mode = ZBX_VC_MODE_NORMAL;
+		vc_shared->mode_time = 0;
+		vc_shared->last_warning_time = 0;
+
+		zbx_mutex_unlock(vc_mem_lock);
+	}
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_vc_add_values                                                *
+ *                                                                            *
+ * Purpose: adds item values to the history and value cache                   *
+ *                                                                            *
+ * Parameters: history - [IN] item history values                             *
+ *                                                                            *
+ * Return value: SUCCEED - the values were added successfully                 *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_vc_add_values(zbx_vector_ptr_t *history)
+{
+	zbx_vc_item_t		*item;
+	int 			i, stripe, *stripes, stripe_values[ZBX_MUTEX_VALUECACHE_NUM] = {0};
+	ZBX_DC_HISTORY		*h;
+	time_t			expire_timestamp;
+
+	if (FAIL == zbx_history_add_values(history))
+		return FAIL;
+
+	if (ZBX_VC_DISABLED == vc_state || 0 == history->values_num)
+		return SUCCEED;
+
+	expire_timestamp = time(NULL) - ZBX_VC_ITEM_EXPIRE_PERIOD;
+
+	/* find the stripes of added values, so each stripe is locked only once */
+	stripes = (int *)zbx_malloc(NULL, sizeof(int) * history->values_num);
+
+	for (i = 0; i < history->values_num; i++)
+	{
+		h = (ZBX_DC_HISTORY *)history->values[i];
+		stripes[i] = vc_get_stripe(h->itemid);
+		stripe_values[stripes[i]]++;
+	}
+
+	for (stripe = 0; stripe < vc_stripes_num; stripe++)
+	{
+		if (0 == stripe_values[stripe])
+			continue;
+
+		vc_stripe_select(stripe);
+		vc_try_lock();
+
+		for (i = 0; i < history->values_num; i++)
+		{
+			if (stripe != stripes[i])
+				continue;
+
+			h = (ZBX_DC_HISTORY *)history->values[i];
+
+			if (NULL != (item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items, &h->itemid)))
+			{
+				zbx_history_record_t	record = {h->ts, h->value};
+
+				if (0 == (item->state & ZBX_ITEM_STATE_REMOVE_PENDING))
+				{
+					vc_item_addref(item);
+
+					/* If the new value type does not match the item's type in cache we can't  */
+					/* change the cache because other processes might still be accessing it    */
+					/* at the same time. The only thing that can be done - mark it for removal */
+					/* so it could be added later with new type.                               */
+					/* Also mark it for removal if the value adding failed. In this case we    */
+					/* won't have the latest data in cache - so the requests must go directly  */
+					/* to the database.                                                        */
+					if (item->value_type != h->value_type || item->last_accessed < expire_timestamp ||
+							FAIL == vch_item_add_value_at_head(item, &record))
+					{
+						item->state |= ZBX_ITEM_STATE_REMOVE_PENDING;
+					}
+
+					vc_item_release(item);
+				}
+			}
+		}
+
+		vc_try_unlock();
+	}
+
+	zbx_free(stripes);
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_vc_get_values                                                *
+ *                                                                            *
+ * Purpose: get item history data for the specified time period               *
+ *                                                                            *
+ * Parameters: itemid     - [IN] the item id                                  *
+ *             value_type - [IN] the item value type                          *
+ *             values     - [OUT] the item history data stored time/value     *
+ *                          pairs in descending order                         *
+ *             seconds    - [IN] the time period to retrieve data for         *
+ *             count      - [IN] the number of history values to retrieve     *
+ *             ts         - [IN] the period end timestamp                     *
+ *                                                                            *
+ * Return value:  SUCCEED - the item history data was retrieved successfully  *
+ *                FAIL    - the item history data was not retrieved           *
+ *                                                                            *
+ * Comments: If the data is not in cache, it's read from DB, so this function *
+ *           will always return the requested data, unless some error occurs. *
+ *                                                                            *
+ *           If <count> is set then value range is defined as <count> values  *
+ *           before <timestamp>. Otherwise the range is defined as <seconds>  *
+ *           seconds before <timestamp>.                                      *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_vc_get_values(zbx_uint64_t itemid, int value_type, zbx_vector_history_record_t *values, int seconds,
+		int count, const zbx_timespec_t *ts)
+{
+	const char	*__function_name = "zbx_vc_get_values";
+	zbx_vc_item_t	*item = NULL;
+	int 		ret = FAIL, cache_used = 1;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() itemid:" ZBX_FS_UI64 " value_type:%d seconds:%d count:%d sec:%d ns:%d",
+			__function_name, itemid, value_type, seconds, count, ts->sec, ts->ns);
+
+	vc_stripe_select(vc_get_stripe(itemid));
+	vc_try_lock();
+
+	if (ZBX_VC_DISABLED == vc_state)
+		goto out;
+
+	if (ZBX_VC_MODE_LOWMEM == vc_shared->mode)
+		vc_warn_low_memory();
+
+	if (NULL == (item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items, &itemid)))
+	{
+		if (ZBX_VC_MODE_NORMAL == vc_shared->mode)
+		{
+			zbx_vc_item_t   new_item = {.itemid = itemid, .value_type = value_type};
+
+			if (NULL == (item = (zbx_vc_item_t *)zbx_hashset_insert(&vc_cache->items, &new_item, sizeof(zbx_vc_item_t))))
+				goto out;
+		}
+		else
+			goto out;
+	}
+
+	vc_item_addref(item);
+
+	if (0 != (item->state & ZBX_ITEM_STATE_REMOVE_PENDING) || item->value_type != value_type)
+		goto out;
+
+	ret = vch_item_get_values(item, values, seconds, count, ts);
+out:
+	if (FAIL == ret)
+	{
+		if (NULL != item)
+			item->state |= ZBX_ITEM_STATE_REMOVE_PENDING;
+
+		cache_used = 0;
+
+		vc_try_unlock();
+
+		ret = vc_db_get_values(itemid, value_type, values, seconds, count, ts);
+
+		vc_try_lock();
+
+		if (SUCCEED == ret)
+			vc_update_statistics(NULL, 0, values->values_num);
+	}
+
+	if (NULL != item)
+		vc_item_release(item);
+
+	vc_try_unlock();
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s count:%d cached:%d",
+			__function_name, zbx_result_string(ret), values->values_num, cache_used);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_vc_get_value                                                 *
+ *                                                                            *
+ * Purpose: get the last history value with a timestamp less or equal to the  *
+ *          target timestamp                                                  *
+ *                                                                            *
+ * Parameters: itemid     - [IN] the item id                                  *
+ *             value_type - [IN] the item value type                          *
+ *             ts         - [IN] the target timestamp                         *
+ *             value      - [OUT] the value found                             *
+ *                                                                            *
+ * Return Value: SUCCEED - the item was retrieved                             *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ * Comments: Depending on the value type this function might allocate memory  *
+ *           to store value data. To free it use zbx_vc_history_value_clear() *
+ *           function.                                                        *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_vc_get_value(zbx_uint64_t itemid, int value_type, const zbx_timespec_t *ts, zbx_history_record_t *value)
+{
+	zbx_vector_history_record_t	values;
+	int				ret = FAIL;
+
+	zbx_history_record_vector_create(&values);
+
+	if (SUCCEED != zbx_vc_get_values(itemid, value_type, &values, ts->sec, 1, ts) || 0 == values.values_num)
+		goto out;
+
+	*value = values.values[0];
+
+	/* reset values vector size so the returned value is not cleared when destroying the vector */
+	values.values_num = 0;
+
+	ret = SUCCEED;
+out:
+	zbx_history_record_vector_destroy(&values, value_type);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_vc_get_aggregate                                             *
+ *                                                                            *
+ * Purpose: get aggregate of item values for the specified time period        *
+ *                                                                            *
+ * Parameters: itemid     - [IN] the item id                                  *
+ *             value_type - [IN] the item value type                          *
+ *             func       - [IN] the aggregate function (ZBX_VC_AGGR_*)       *
+ *             seconds    - [IN] the time period                              *
+ *             ts         - [IN] the period end timestamp                     *
+ *             value      - [OUT] the aggregate value:                        *
+ *                            ZBX_VC_AGGR_SUM - sum of item value type        *
+ *                            ZBX_VC_AGGR_AVG - floating point average        *
+ *                            ZBX_VC_AGGR_MIN, ZBX_VC_AGGR_MAX - the          *
+ *                                minimum/maximum value of item value type    *
+ *                            ZBX_VC_AGGR_COUNT - not used                    *
+ *             count      - [OUT] the number of values in period, for         *
+ *                          ZBX_VC_AGGR_MIN and ZBX_VC_AGGR_MAX functions     *
+ *                          only 0 value is exact (no values in period)       *
+ *                                                                            *
+ * Return value:  SUCCEED - the aggregate was retrieved successfully          *
+ *                FAIL    - the aggregate cannot be provided by cache, item   *
+ *                          values must be retrieved with zbx_vc_get_values() *
+ *                                                                            *
+ * Comments: The aggregate is updated incrementally as new values are added   *
+ *           to cache, so only the values leaving the period are processed    *
+ *           during request. Aggregates are available only for items already  *
+ *           being cached and for periods ending after the last cached value. *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_vc_get_aggregate(zbx_uint64_t itemid, int value_type, int func, int seconds, const zbx_timespec_t *ts,
+		history_value_t *value, int *count)
+{
+	const char	*__function_name = "zbx_vc_get_aggregate";
+	zbx_vc_item_t	*item = NULL;
+	zbx_vc_aggr_t	*aggr;
+	zbx_timespec_t	start = {ts->sec - seconds, ts->ns};
+	int		ret = FAIL;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() itemid:" ZBX_FS_UI64 " value_type:%d func:%d seconds:%d sec:%d ns:%d",
+			__function_name, itemid, value_type, func, seconds, ts->sec, ts->ns);
+
+	vc_stripe_select(vc_get_stripe(itemid));
+	vc_try_lock();
+
+	if (ZBX_VC_DISABLED == vc_state)
+		goto out;
+
+	if (NULL == (item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items, &itemid)))
+		goto out;
+
+	vc_item_addref(item);
+
+	if (0 != (item->state & ZBX_ITEM_STATE_REMOVE_PENDING) || item->value_type != value_type)
+		goto out;
+
+	/* aggregates include all values up to the last cached value */
+	if (SUCCEED == vch_item_has_values_after(item, ts))
+		goto out;
+
+	if (NULL == (aggr = vch_item_get_aggr(item, func, seconds, ts)))
+		goto out;
+
+	vch_aggr_remove_values(item, aggr, &start);
+	vch_aggr_get_result(item, aggr, &start, value, count);
+
+	aggr->last_accessed = time(NULL);
+	vc_update_statistics(item, *count, 0);
+
+	ret = SUCCEED;
+out:
+	if (NULL != item)
+		vc_item_release(item);
+
+	vc_try_unlock();
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(ret));
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_vc_get_statistics                                            *
+ *                                                                            *
+ * Purpose: retrieves usage cache statistics                                  *
+ *                                                                            *
+ * Parameters: stats     - [OUT] the cache usage statistics                   *
+ *                                                                            *
+ * Return value:  SUCCEED - the cache statistics were retrieved successfully  *
+ *                FAIL    - failed to retrieve cache statistics               *
+ *                          (cache was not initialized)                       *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_vc_get_statistics(zbx_vc_stats_t *stats)
+{
+	int	i;
+
+	if (ZBX_VC_DISABLED == vc_state)
+		return FAIL;
+
+	memset(stats, 0, sizeof(zbx_vc_stats_t));
+	stats->mode = ZBX_VC_MODE_NORMAL;
+
+	for (i = 0; i < vc_stripes_num; i++)
+	{
+		vc_stripe_select(i);
+		vc_try_lock();
+
+		stats->hits += vc_cache->hits;
+		stats->misses += vc_cache->misses;
+
+		vc_try_unlock();
+	}
+
+	zbx_mutex_lock(vc_mem_lock);
+
+	stats->mode = vc_shared->mode;
+	stats->total_size = vc_mem->total_size;
+	stats->free_size = vc_mem->free_size;
+
+	zbx_mutex_unlock(vc_mem_lock);
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_vc_lock                                                      *
+ *                                                                            *
+ * Purpose: locks the cache for batch usage                                   *
+ *                                                                            *
+ * Comments: Use zbx_vc_lock()/zbx_vc_unlock to explicitly lock/unlock cache  *
+ *           for batch usage. The cache is automatically locked during every  *
+ *           API call using the cache unless it was explicitly locked with    *
+ *           zbx_vc_lock() function by the same process.                      *
+ *                                                                            *
+ *           All cache stripes are locked in ascending order, so explicit     *
+ *           locking should be avoided where possible.                        *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_vc_lock(void)
+{
+	int	i;
+
+	for (i = 0; i < vc_stripes_num; i++)
+		zbx_mutex_lock(vc_stripes[i].lock);
+
+	vc_locked = 1;
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: vch_item_get_value_range                                         *
+ * Function: zbx_vc_unlock                                                    *
  *                                                                            *
- * Purpose: get item values for the specified range                           *
+ * Purpose: unlocks cache after it has been locked with zbx_vc_lock()         *
  *                                                                            *
- * Parameters: item      - [IN] the item                                      *
- *             values    - [OUT] the item history data stored time/value      *
- *                         pairs in undefined order, optional                 *
- *                         If null then cache is updated if necessary, but no *
- *                         values are returned. Used to ensure that cache     *
- *                         contains a value of the specified timestamp.       *
- *             seconds   - [IN] the time period to retrieve data for          *
- *             count     - [IN] the number of history values to retrieve      *
- *             ts        - [IN] the target timestamp                          *
+ * Comments: See zbx_vc_lock() function.                                      *
  *                                                                            *
- * Return value:  SUCCEED - the item history data was retrieved successfully  *
- *                FAIL    - the item history data was not retrieved           *
+ ******************************************************************************/
+void	zbx_vc_unlock(void)
+{
+	int	i;
+
+	vc_locked = 0;
+
+	for (i = vc_stripes_num - 1; i >= 0; i--)
+		zbx_mutex_unlock(vc_stripes[i].lock);
+}
+
+/******************************************************************************
  *                                                                            *
- * Comments: This function returns data from cache if necessary updating it   *
- *           from DB. If cache update was required and failed (not enough     *
- *           memory to cache DB values), then this function also fails.       *
+ * Function: zbx_vc_enable                                                    *
  *                                                                            *
- *           If <count> is set then value range is defined as <count> values  *
- *           before <timestamp>. Otherwise the range is defined as <seconds>  *
- *           seconds before <timestamp>.                                      *
+ * Purpose: enables value caching for current process                         *
  *                                                                            *
  ******************************************************************************/
-static int	vch_item_get_values(zbx_vc_item_t *item, zbx_vector_history_record_t *values, int seconds,
-		int count, const zbx_timespec_t *ts)
+void	zbx_vc_enable(void)
 {
-	int	ret, records_read, hits, misses, range_start;
-
-	zbx_vector_history_record_clear(values);
+	if (0 != vc_stripes_num)
+		vc_state = ZBX_VC_ENABLED;
+}
 
-	if (0 == count)
-	{
-		if (0 > (range_start = ts->sec - seconds))
-			range_start = 0;
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_vc_disable                                                   *
+ *                                                                            *
+ * Purpose: disables value caching for current process                        *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_vc_disable(void)
+{
+	vc_state = ZBX_VC_DISABLED;
+}
 
-		if (FAIL == (ret = vch_item_cache_values_by_time(item, range_start)))
-			goto out;
+/******************************************************************************************************************
+ *                                                                                                                *
+ * Value cache snapshots                                                                                          *
+ *                                                                                                                *
+ ******************************************************************************************************************/
 
-		records_read = ret;
+/*
+ * The value cache snapshot file is used to restore value cache after server restart without
+ * reading item history from history storage. The file contains the header:
+ *   <magic:8><version:uint32><flags:uint32><write time:uint64><items:uint64>
+ * followed by item records:
+ *   <itemid:uint64><value_type:uint8><status:uint8><range_sync_hour:uint8><reserved:uint8>
+ *   <active_range:int32><daily_range:int32><db_cached_from:int32><last_accessed:int32>
+ *   <hits:uint64><values:uint32><value 1>...<value N>
+ * where values are stored in ascending order as:
+ *   <sec:int32><ns:int32><value data>
+ * with value data encoded depending on item value type:
+ *   float     - <double>
+ *   uint      - <uint64>
+ *   str, text - <string>
+ *   log       - <timestamp:int32><logeventid:int32><severity:int32><source:string><value:string>
+ * and strings encoded as:
+ *   <length:uint32><characters with terminating zero> or <ZBX_VC_SNAPSHOT_NULL> for NULL strings.
+ *
+ * All numbers are stored in host byte order, files written on different architectures are
+ * rejected by magic/version check.
+ *
+ * If the snapshot was not written on shutdown, the values added to history after the snapshot
+ * was written are read from history storage when loading snapshot, with one query per batch of
+ * ZBX_VC_SNAPSHOT_READ_BATCH items of the same value type. After loading the shutdown
+ * flag is reset in snapshot file, so loading the same file after a crash will read the missing
+ * values too.
+ */
 
-		vch_item_get_values_by_time(item, values, seconds, ts);
+#define ZBX_VC_SNAPSHOT_MAGIC		"ZBXVCS\x01\x02"
+#define ZBX_VC_SNAPSHOT_VERSION		1
+#define ZBX_VC_SNAPSHOT_NULL		0xffffffff
 
-		if (records_read > values->values_num)
-			records_read = values->values_num;
-	}
-	else
-	{
-		range_start = (0 == seconds ? 0 : ts->sec - seconds);
+/* the header field offsets */
+#define ZBX_VC_SNAPSHOT_FLAGS_OFFSET	12
+#define ZBX_VC_SNAPSHOT_ITEMS_OFFSET	24
 
-		if (FAIL == (ret = vch_item_cache_values_by_time_and_count(item, range_start, count, ts)))
-			goto out;
+/* the number of items to read missing values for with one history query */
+#define ZBX_VC_SNAPSHOT_READ_BATCH	1000
 
-		records_read = ret;
+typedef struct
+{
+	const char	*data;
+	size_t		size;
+	size_t		offset;
+}
+zbx_vc_snapshot_reader_t;
 
-		vch_item_get_values_by_time_and_count(item, values, seconds, count, ts);
+/******************************************************************************
+ *                                                                            *
+ * Function: vc_snapshot_write_string                                         *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_snapshot_write_string(FILE *file, const char *str)
+{
+	zbx_uint32_t	len;
 
-		if (records_read > values->values_num)
-			records_read = values->values_num;
+	if (NULL == str)
+	{
+		len = ZBX_VC_SNAPSHOT_NULL;
+		fwrite(&len, sizeof(len), 1, file);
+		return;
 	}
 
-	hits = values->values_num - records_read;
-	misses = records_read;
-
-	vc_update_statistics(item, hits, misses);
-
-	ret = SUCCEED;
-out:
-	return ret;
+	len = (zbx_uint32_t)strlen(str);
+	fwrite(&len, sizeof(len), 1, file);
+	fwrite(str, len + 1, 1, file);
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: vch_item_free_cache                                              *
+ * Function: vc_snapshot_write_item                                           *
  *                                                                            *
- * Purpose: frees resources allocated for item history data                   *
+ * Purpose: writes item values to value cache snapshot file                   *
  *                                                                            *
- * Parameters: item    - [IN] the item                                        *
+ * Parameters: file - [IN] the snapshot file                                  *
+ *             item - [IN] the item                                           *
  *                                                                            *
- * Return value: the size of freed memory (bytes)                             *
+ * Return value: SUCCEED - the item was written                               *
+ *               FAIL    - the item has no values to write                    *
  *                                                                            *
  ******************************************************************************/
-static size_t	vch_item_free_cache(zbx_vc_item_t *item)
+static int	vc_snapshot_write_item(FILE *file, const zbx_vc_item_t *item)
 {
-	size_t	freed = 0;
+	const zbx_vc_chunk_t		*chunk;
+	const zbx_history_record_t	*slots, *value;
+	zbx_uint32_t			values_num = 0;
+	unsigned char			reserved = 0;
+	int				i;
 
-	zbx_vc_chunk_t	*chunk = item->tail;
+	for (chunk = item->tail; NULL != chunk; chunk = chunk->next)
+		values_num += (zbx_uint32_t)(chunk->last_value - chunk->first_value + 1);
 
-	while (NULL != chunk)
+	if (0 == values_num)
+		return FAIL;
+
+	fwrite(&item->itemid, sizeof(item->itemid), 1, file);
+	fwrite(&item->value_type, sizeof(item->value_type), 1, file);
+	fwrite(&item->status, sizeof(item->status), 1, file);
+	fwrite(&item->range_sync_hour, sizeof(item->range_sync_hour), 1, file);
+	fwrite(&reserved, sizeof(reserved), 1, file);
+	fwrite(&item->active_range, sizeof(item->active_range), 1, file);
+	fwrite(&item->daily_range, sizeof(item->daily_range), 1, file);
+	fwrite(&item->db_cached_from, sizeof(item->db_cached_from), 1, file);
+	fwrite(&item->last_accessed, sizeof(item->last_accessed), 1, file);
+	fwrite(&item->hits, sizeof(item->hits), 1, file);
+	fwrite(&values_num, sizeof(values_num), 1, file);
+
+	for (chunk = item->tail; NULL != chunk; chunk = chunk->next)
 	{
-		zbx_vc_chunk_t	*next = chunk->next;
+		slots = vch_chunk_slots(item, chunk);
 
-		freed += vch_item_free_chunk(item, chunk);
-		chunk = next;
+		for (i = chunk->first_value; i <= chunk->last_value; i++)
+		{
+			value = &slots[i];
+
+			fwrite(&value->timestamp.sec, sizeof(value->timestamp.sec), 1, file);
+			fwrite(&value->timestamp.ns, sizeof(value->timestamp.ns), 1, file);
+
+			switch (item->value_type)
+			{
+				case ITEM_VALUE_TYPE_FLOAT:
+					fwrite(&value->value.dbl, sizeof(value->value.dbl), 1, file);
+					break;
+				case ITEM_VALUE_TYPE_UINT64:
+					fwrite(&value->value.ui64, sizeof(value->value.ui64), 1, file);
+					break;
+				case ITEM_VALUE_TYPE_STR:
+				case ITEM_VALUE_TYPE_TEXT:
+					vc_snapshot_write_string(file, value->value.str);
+					break;
+				case ITEM_VALUE_TYPE_LOG:
+					fwrite(&value->value.log->timestamp, sizeof(value->value.log->timestamp), 1, file);
+					fwrite(&value->value.log->logeventid, sizeof(value->value.log->logeventid), 1,
+							file);
+					fwrite(&value->value.log->severity, sizeof(value->value.log->severity), 1, file);
+					vc_snapshot_write_string(file, value->value.log->source);
+					vc_snapshot_write_string(file, value->value.log->value);
+					break;
+			}
+		}
 	}
-	item->values_total = 0;
-	item->head = NULL;
-	item->tail = NULL;
 
-	return freed;
+	return SUCCEED;
 }
 
-/******************************************************************************************************************
- *                                                                                                                *
- * Public API                                                                                                     *
- *                                                                                                                *
- ******************************************************************************************************************/
-
 /******************************************************************************
  *                                                                            *
- * Function: zbx_vc_init                                                      *
+ * Function: zbx_vc_snapshot_write                                            *
  *                                                                            *
- * Purpose: initializes value cache                                           *
+ * Purpose: writes value cache contents to snapshot file                      *
+ *                                                                            *
+ * Parameters: path  - [IN] the snapshot file path                            *
+ *             flags - [IN] the snapshot flags (ZBX_VC_SNAPSHOT_* defines)    *
+ *                                                                            *
+ * Return value: SUCCEED - the snapshot was written                           *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ * Comments: The snapshot is written into temporary file which replaces the   *
+ *           snapshot file when it is complete. The stripes are locked only   *
+ *           while writing a single item, so value cache can be used during   *
+ *           snapshot writing.                                                *
  *                                                                            *
  ******************************************************************************/
-int	zbx_vc_init(char **error)
+int	zbx_vc_snapshot_write(const char *path, zbx_uint32_t flags)
 {
-	const char	*__function_name = "zbx_vc_init";
-	zbx_uint64_t	size_reserved;
-	int		ret = FAIL;
-
-	if (0 == CONFIG_VALUE_CACHE_SIZE)
-		return SUCCEED;
+	const char		*__function_name = "zbx_vc_snapshot_write";
+
+	FILE			*file;
+	char			*path_tmp;
+	zbx_uint32_t		version = ZBX_VC_SNAPSHOT_VERSION;
+	zbx_uint64_t		now, items_num = 0, itemid;
+	zbx_vector_uint64_t	itemids;
+	zbx_hashset_iter_t	iter;
+	zbx_vc_item_t		*item;
+	int			i, stripe, ret = FAIL;
+	double			sec;
 
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+	if (ZBX_VC_DISABLED == vc_state)
+		return FAIL;
 
-	if (SUCCEED != zbx_mutex_create(&vc_lock, ZBX_MUTEX_VALUECACHE, error))
-		goto out;
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() path:'%s' flags:%u", __function_name, path, flags);
 
-	size_reserved = zbx_mem_required_size(1, "value cache size", "ValueCacheSize");
+	sec = zbx_time();
+	path_tmp = zbx_dsprintf(NULL, "%s.tmp", path);
 
-	if (SUCCEED != zbx_mem_create(&vc_mem, CONFIG_VALUE_CACHE_SIZE, "value cache size", "ValueCacheSize", 1, error))
+	if (NULL == (file = fopen(path_tmp, "wb")))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot create value cache snapshot file \"%s\": %s", path_tmp,
+				zbx_strerror(errno));
 		goto out;
+	}
 
-	CONFIG_VALUE_CACHE_SIZE -= size_reserved;
+	now = (zbx_uint64_t)time(NULL);
+
+	fwrite(ZBX_VC_SNAPSHOT_MAGIC, ZBX_CONST_STRLEN(ZBX_VC_SNAPSHOT_MAGIC), 1, file);
+	fwrite(&version, sizeof(version), 1, file);
+	fwrite(&flags, sizeof(flags), 1, file);
+	fwrite(&now, sizeof(now), 1, file);
+	fwrite(&items_num, sizeof(items_num), 1, file);
 
-	vc_cache = (zbx_vc_cache_t *)__vc_mem_malloc_func(vc_cache, sizeof(zbx_vc_cache_t));
+	zbx_vector_uint64_create(&itemids);
 
-	if (NULL == vc_cache)
+	for (stripe = 0; stripe < vc_stripes_num; stripe++)
 	{
-		*error = zbx_strdup(*error, "cannot allocate value cache header");
-		goto out;
+		vc_stripe_select(stripe);
+
+		vc_try_lock();
+
+		zbx_hashset_iter_reset(&vc_cache->items, &iter);
+		while (NULL != (item = (zbx_vc_item_t *)zbx_hashset_iter_next(&iter)))
+			zbx_vector_uint64_append(&itemids, item->itemid);
+
+		vc_try_unlock();
+
+		for (i = 0; i < itemids.values_num; i++)
+		{
+			itemid = itemids.values[i];
+
+			vc_try_lock();
+
+			if (NULL != (item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items, &itemid)) &&
+					0 == (item->state & ZBX_ITEM_STATE_REMOVE_PENDING) &&
+					SUCCEED == vc_snapshot_write_item(file, item))
+			{
+				items_num++;
+			}
+
+			vc_try_unlock();
+		}
+
+		zbx_vector_uint64_clear(&itemids);
 	}
-	memset(vc_cache, 0, sizeof(zbx_vc_cache_t));
 
-	zbx_hashset_create_ext(&vc_cache->items, VC_ITEMS_INIT_SIZE,
-			ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC, NULL,
-			__vc_mem_malloc_func, __vc_mem_realloc_func, __vc_mem_free_func);
+	zbx_vector_uint64_destroy(&itemids);
 
-	if (NULL == vc_cache->items.slots)
+	if (0 != fseek(file, ZBX_VC_SNAPSHOT_ITEMS_OFFSET, SEEK_SET))
+		goto close;
+
+	fwrite(&items_num, sizeof(items_num), 1, file);
+
+	if (0 == ferror(file) && 0 == fflush(file) && 0 == fsync(fileno(file)))
+		ret = SUCCEED;
+close:
+	if (0 != fclose(file))
+		ret = FAIL;
+
+	if (SUCCEED != ret)
 	{
-		*error = zbx_strdup(*error, "cannot allocate value cache data storage");
+		zabbix_log(LOG_LEVEL_WARNING, "cannot write value cache snapshot file \"%s\": %s", path_tmp,
+				zbx_strerror(errno));
+		unlink(path_tmp);
 		goto out;
 	}
 
-	zbx_hashset_create_ext(&vc_cache->strpool, VC_STRPOOL_INIT_SIZE,
-			vc_strpool_hash_func, vc_strpool_compare_func, NULL,
-			__vc_mem_malloc_func, __vc_mem_realloc_func, __vc_mem_free_func);
-
-	if (NULL == vc_cache->strpool.slots)
+	if (0 != rename(path_tmp, path))
 	{
-		*error = zbx_strdup(*error, "cannot allocate string pool for value cache data storage");
+		zabbix_log(LOG_LEVEL_WARNING, "cannot rename value cache snapshot file \"%s\" to \"%s\": %s",
+				path_tmp, path, zbx_strerror(errno));
+		unlink(path_tmp);
+		ret = FAIL;
 		goto out;
 	}
 
-	/* the free space request should be 5% of cache size, but no more than 128KB */
-	vc_cache->min_free_request = (CONFIG_VALUE_CACHE_SIZE / 100) * 5;
-	if (vc_cache->min_free_request > 128 * ZBX_KIBIBYTE)
-		vc_cache->min_free_request = 128 * ZBX_KIBIBYTE;
-
-	ret = SUCCEED;
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() written " ZBX_FS_UI64 " items in " ZBX_FS_DBL " sec", __function_name,
+			items_num, zbx_time() - sec);
 out:
-	zbx_vc_disable();
+	zbx_free(path_tmp);
 
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(ret));
 
 	return ret;
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: zbx_vc_destroy                                                   *
+ * Function: vc_snapshot_read                                                 *
  *                                                                            *
- * Purpose: destroys value cache                                              *
+ ******************************************************************************/
+static int	vc_snapshot_read(zbx_vc_snapshot_reader_t *reader, void *data, size_t size)
+{
+	if (reader->size - reader->offset < size)
+		return FAIL;
+
+	memcpy(data, reader->data + reader->offset, size);
+	reader->offset += size;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vc_snapshot_read_string                                          *
+ *                                                                            *
+ * Purpose: reads string from snapshot, the returned string must be freed     *
  *                                                                            *
  ******************************************************************************/
-void	zbx_vc_destroy(void)
+static int	vc_snapshot_read_string(zbx_vc_snapshot_reader_t *reader, char **str)
 {
-	const char	*__function_name = "zbx_vc_destroy";
+	zbx_uint32_t	len;
 
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+	if (SUCCEED != vc_snapshot_read(reader, &len, sizeof(len)))
+		return FAIL;
 
-	if (NULL != vc_cache)
+	if (ZBX_VC_SNAPSHOT_NULL == len)
 	{
-		zbx_mutex_destroy(&vc_lock);
+		*str = NULL;
+		return SUCCEED;
+	}
 
-		zbx_hashset_destroy(&vc_cache->items);
-		zbx_hashset_destroy(&vc_cache->strpool);
+	if (reader->size - reader->offset <= len || '\0' != reader->data[reader->offset + len])
+		return FAIL;
 
-		__vc_mem_free_func(vc_cache);
-		vc_cache = NULL;
-	}
+	*str = zbx_strdup(NULL, reader->data + reader->offset);
+	reader->offset += len + 1;
 
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+	return SUCCEED;
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: zbx_vc_reset                                                     *
+ * Function: vc_snapshot_read_value                                           *
  *                                                                            *
- * Purpose: resets value cache                                                *
+ * Purpose: reads item value from snapshot                                    *
  *                                                                            *
- * Comments: All items and their historical data are removed,                 *
- *           cache working mode, statistics reseted.                          *
+ * Parameters: reader     - [IN] the snapshot reader                          *
+ *             value_type - [IN] the item value type                          *
+ *             values     - [OUT] the values vector to append the value to    *
+ *                                                                            *
+ * Return value: SUCCEED - the value was read                                 *
+ *               FAIL    - the snapshot data is corrupted                     *
  *                                                                            *
  ******************************************************************************/
-void	zbx_vc_reset(void)
+static int	vc_snapshot_read_value(zbx_vc_snapshot_reader_t *reader, int value_type,
+		zbx_vector_history_record_t *values)
 {
-	const char	*__function_name = "zbx_vc_clean";
+	zbx_history_record_t	record;
+	zbx_log_value_t		*log;
 
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+	if (SUCCEED != vc_snapshot_read(reader, &record.timestamp.sec, sizeof(record.timestamp.sec)) ||
+			SUCCEED != vc_snapshot_read(reader, &record.timestamp.ns, sizeof(record.timestamp.ns)))
+	{
+		return FAIL;
+	}
 
-	if (NULL != vc_cache)
+	switch (value_type)
 	{
-		zbx_vc_item_t		*item;
-		zbx_hashset_iter_t	iter;
+		case ITEM_VALUE_TYPE_FLOAT:
+			if (SUCCEED != vc_snapshot_read(reader, &record.value.dbl, sizeof(record.value.dbl)))
+				return FAIL;
+			break;
+		case ITEM_VALUE_TYPE_UINT64:
+			if (SUCCEED != vc_snapshot_read(reader, &record.value.ui64, sizeof(record.value.ui64)))
+				return FAIL;
+			break;
+		case ITEM_VALUE_TYPE_STR:
+		case ITEM_VALUE_TYPE_TEXT:
+			if (SUCCEED != vc_snapshot_read_string(reader, &record.value.str))
+				return FAIL;
 
-		vc_try_lock();
+			if (NULL == record.value.str)
+				record.value.str = zbx_strdup(NULL, "");
+			break;
+		case ITEM_VALUE_TYPE_LOG:
+			log = (zbx_log_value_t *)zbx_malloc(NULL, sizeof(zbx_log_value_t));
+			log->source = NULL;
+			log->value = NULL;
+			record.value.log = log;
+
+			if (SUCCEED != vc_snapshot_read(reader, &log->timestamp, sizeof(log->timestamp)) ||
+					SUCCEED != vc_snapshot_read(reader, &log->logeventid, sizeof(log->logeventid)) ||
+					SUCCEED != vc_snapshot_read(reader, &log->severity, sizeof(log->severity)) ||
+					SUCCEED != vc_snapshot_read_string(reader, &log->source) ||
+					SUCCEED != vc_snapshot_read_string(reader, &log->value))
+			{
+				vc_history_logfree(log);
+				return FAIL;
+			}
 
-		zbx_hashset_iter_reset(&vc_cache->items, &iter);
-		while (NULL != (item = (zbx_vc_item_t *)zbx_hashset_iter_next(&iter)))
-		{
-			vch_item_free_cache(item);
-			zbx_hashset_iter_remove(&iter);
-		}
+			if (NULL == log->value)
+				log->value = zbx_strdup(NULL, "");
+			break;
+		default:
+			return FAIL;
+	}
+
+	zbx_vector_history_record_append_ptr(values, &record);
 
-		vc_cache->hits = 0;
-		vc_cache->misses = 0;
-		vc_cache->min_free_request = 0;
-		vc_cache->mode = ZBX_VC_MODE_NORMAL;
-		vc_cache->mode_time = 0;
-		vc_cache->last_warning_time = 0;
+	return SUCCEED;
+}
 
-		vc_try_unlock();
-	}
+typedef struct
+{
+	zbx_uint64_t		itemid;
+	zbx_history_record_t	*record;
+}
+zbx_vc_snapshot_value_t;
 
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+static int	vc_snapshot_value_compare(const void *d1, const void *d2)
+{
+	const zbx_vc_snapshot_value_t	*v1 = (const zbx_vc_snapshot_value_t *)d1;
+	const zbx_vc_snapshot_value_t	*v2 = (const zbx_vc_snapshot_value_t *)d2;
+
+	ZBX_RETURN_IF_NOT_EQUAL(v1->itemid, v2->itemid);
+
+	return zbx_timespec_compare(&v1->record->timestamp, &v2->record->timestamp);
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: zbx_vc_add_values                                                *
+ * Function: vc_snapshot_read_missing_values                                  *
  *                                                                            *
- * Purpose: adds item values to the history and value cache                   *
+ * Purpose: reads item values added to history after the snapshot was        *
+ *          written                                                           *
  *                                                                            *
- * Parameters: history - [IN] item history values                             *
+ * Parameters: itemids    - [IN] the ids of items loaded from snapshot        *
+ *             value_type - [IN] the items value type                         *
+ *             timestamp  - [IN] the snapshot write time                      *
+ *             now        - [IN] the current time                             *
  *                                                                            *
- * Return value: SUCCEED - the values were added successfully                 *
- *               FAIL    - otherwise                                          *
+ * Return value: The number of values added to cache.                         *
+ *                                                                            *
+ * Comments: The history is read for batches of items, one query per batch.   *
+ *           The items that cannot get the latest values are removed from     *
+ *           cache.                                                           *
  *                                                                            *
  ******************************************************************************/
-int	zbx_vc_add_values(zbx_vector_ptr_t *history)
+static int	vc_snapshot_read_missing_values(const zbx_vector_uint64_t *itemids, int value_type, int timestamp,
+		int now)
 {
-	zbx_vc_item_t		*item;
-	int 			i;
-	ZBX_DC_HISTORY		*h;
-	time_t			expire_timestamp;
+	zbx_vector_history_record_t	records;
+	zbx_vector_uint64_t		value_itemids;
+	zbx_vc_snapshot_value_t		*values = NULL;
+	zbx_vc_item_t			*item = NULL;
+	zbx_timespec_t			last = {0, 0};
+	int				i, j, num, values_alloc = 0, added = 0;
 
-	if (FAIL == zbx_history_add_values(history))
-		return FAIL;
+	zbx_history_record_vector_create(&records);
+	zbx_vector_uint64_create(&value_itemids);
 
-	if (ZBX_VC_DISABLED == vc_state)
-		return SUCCEED;
+	for (i = 0; i < itemids->values_num; i += ZBX_VC_SNAPSHOT_READ_BATCH)
+	{
+		num = MIN(ZBX_VC_SNAPSHOT_READ_BATCH, itemids->values_num - i);
 
-	expire_timestamp = time(NULL) - ZBX_VC_ITEM_EXPIRE_PERIOD;
+		if (SUCCEED != zbx_history_get_values_multi(itemids->values + i, num, value_type, timestamp - 1, now,
+				&value_itemids, &records))
+		{
+			/* without the latest values the items cannot be cached */
+			for (j = i; j < i + num; j++)
+			{
+				vc_stripe_select(vc_get_stripe(itemids->values[j]));
 
-	vc_try_lock();
+				if (NULL != (item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items,
+						&itemids->values[j])))
+				{
+					vc_remove_item(item);
+				}
+			}
 
-	for (i = 0; i < history->values_num; i++)
-	{
-		h = (ZBX_DC_HISTORY *)history->values[i];
+			goto next;
+		}
+
+		if (values_alloc < records.values_num)
+		{
+			values_alloc = records.values_num;
+			values = (zbx_vc_snapshot_value_t *)zbx_realloc(values,
+					sizeof(zbx_vc_snapshot_value_t) * values_alloc);
+		}
 
-		if (NULL != (item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items, &h->itemid)))
+		for (j = 0; j < records.values_num; j++)
 		{
-			zbx_history_record_t	record = {h->ts, h->value};
+			values[j].itemid = value_itemids.values[j];
+			values[j].record = &records.values[j];
+		}
+
+		qsort(values, records.values_num, sizeof(zbx_vc_snapshot_value_t), vc_snapshot_value_compare);
 
-			if (0 == (item->state & ZBX_ITEM_STATE_REMOVE_PENDING))
+		for (j = 0; j < records.values_num; j++)
+		{
+			if (0 == j || values[j - 1].itemid != values[j].itemid)
 			{
-				vc_item_addref(item);
-
-				/* If the new value type does not match the item's type in cache we can't  */
-				/* change the cache because other processes might still be accessing it    */
-				/* at the same time. The only thing that can be done - mark it for removal */
-				/* so it could be added later with new type.                               */
-				/* Also mark it for removal if the value adding failed. In this case we    */
-				/* won't have the latest data in cache - so the requests must go directly  */
-				/* to the database.                                                        */
-				if (item->value_type != h->value_type || item->last_accessed < expire_timestamp ||
-						FAIL == vch_item_add_value_at_head(item, &record))
+				vc_stripe_select(vc_get_stripe(values[j].itemid));
+
+				if (NULL != (item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items,
+						&values[j].itemid)))
 				{
-					item->state |= ZBX_ITEM_STATE_REMOVE_PENDING;
+					last = vch_chunk_slots(item, item->head)[item->head->last_value].timestamp;
 				}
+			}
+
+			/* skip the values already stored in snapshot */
+			if (NULL == item || 0 >= zbx_timespec_compare(&values[j].record->timestamp, &last))
+				continue;
 
-				vc_item_release(item);
+			if (SUCCEED != vch_item_add_value_at_head(item, values[j].record))
+			{
+				vc_remove_item(item);
+				item = NULL;
+				continue;
 			}
+
+			added++;
 		}
+next:
+		vc_history_record_vector_clean(&records, value_type);
+		zbx_vector_uint64_clear(&value_itemids);
 	}
 
-	vc_try_unlock();
+	zbx_free(values);
+	zbx_vector_uint64_destroy(&value_itemids);
+	zbx_history_record_vector_destroy(&records, value_type);
 
-	return SUCCEED;
+	return added;
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: zbx_vc_get_values                                                *
- *                                                                            *
- * Purpose: get item history data for the specified time period               *
+ * Function: zbx_vc_snapshot_load                                             *
  *                                                                            *
- * Parameters: itemid     - [IN] the item id                                  *
- *             value_type - [IN] the item value type                          *
- *             values     - [OUT] the item history data stored time/value     *
- *                          pairs in descending order                         *
- *             seconds    - [IN] the time period to retrieve data for         *
- *             count      - [IN] the number of history values to retrieve     *
- *             ts         - [IN] the period end timestamp                     *
+ * Purpose: loads value cache contents from snapshot file                     *
  *                                                                            *
- * Return value:  SUCCEED - the item history data was retrieved successfully  *
- *                FAIL    - the item history data was not retrieved           *
+ * Parameters: path - [IN] the snapshot file path                             *
  *                                                                            *
- * Comments: If the data is not in cache, it's read from DB, so this function *
- *           will always return the requested data, unless some error occurs. *
+ * Return value: SUCCEED - the snapshot was loaded                            *
+ *               FAIL    - the snapshot file is missing, incompatible or was  *
+ *                         loaded partially                                   *
  *                                                                            *
- *           If <count> is set then value range is defined as <count> values  *
- *           before <timestamp>. Otherwise the range is defined as <seconds>  *
- *           seconds before <timestamp>.                                      *
+ * Comments: This function must be called before value cache is enabled and  *
+ *           worker processes are forked.                                     *
  *                                                                            *
  ******************************************************************************/
-int	zbx_vc_get_values(zbx_uint64_t itemid, int value_type, zbx_vector_history_record_t *values, int seconds,
-		int count, const zbx_timespec_t *ts)
+int	zbx_vc_snapshot_load(const char *path)
 {
-	const char	*__function_name = "zbx_vc_get_values";
-	zbx_vc_item_t	*item = NULL;
-	int 		ret = FAIL, cache_used = 1;
-
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s() itemid:" ZBX_FS_UI64 " value_type:%d seconds:%d count:%d sec:%d ns:%d",
-			__function_name, itemid, value_type, seconds, count, ts->sec, ts->ns);
-
-	vc_try_lock();
+	const char			*__function_name = "zbx_vc_snapshot_load";
+
+	int				fd, i, ret = FAIL, now, missing = 0;
+	struct stat			st;
+	void				*data;
+	zbx_vc_snapshot_reader_t	reader;
+	zbx_uint32_t			version, flags, values_num;
+	zbx_uint64_t			timestamp, items_num, loaded_num = 0, loaded_values = 0, index;
+	zbx_vc_item_t			item_local, *item;
+	zbx_vector_history_record_t	values;
+	zbx_vector_uint64_t		itemids[ITEM_VALUE_TYPE_MAX];
+	unsigned char			reserved;
+	double				sec;
 
-	if (ZBX_VC_DISABLED == vc_state)
-		goto out;
+	if (0 == vc_stripes_num)
+		return FAIL;
 
-	if (ZBX_VC_MODE_LOWMEM == vc_cache->mode)
-		vc_warn_low_memory();
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() path:'%s'", __function_name, path);
 
-	if (NULL == (item = (zbx_vc_item_t *)zbx_hashset_search(&vc_cache->items, &itemid)))
+	if (-1 == (fd = open(path, O_RDONLY)))
 	{
-		if (ZBX_VC_MODE_NORMAL == vc_cache->mode)
+		if (ENOENT != errno)
 		{
-			zbx_vc_item_t   new_item = {.itemid = itemid, .value_type = value_type};
-
-			if (NULL == (item = (zbx_vc_item_t *)zbx_hashset_insert(&vc_cache->items, &new_item, sizeof(zbx_vc_item_t))))
-				goto out;
+			zabbix_log(LOG_LEVEL_WARNING, "cannot open value cache snapshot file \"%s\": %s", path,
+					zbx_strerror(errno));
 		}
-		else
-			goto out;
+		goto out;
 	}
 
-	vc_item_addref(item);
-
-	if (0 != (item->state & ZBX_ITEM_STATE_REMOVE_PENDING) || item->value_type != value_type)
+	if (0 != fstat(fd, &st) || 0 == st.st_size)
+	{
+		close(fd);
 		goto out;
+	}
 
-	ret = vch_item_get_values(item, values, seconds, count, ts);
-out:
-	if (FAIL == ret)
+	if (MAP_FAILED == (data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)))
 	{
-		if (NULL != item)
-			item->state |= ZBX_ITEM_STATE_REMOVE_PENDING;
-
-		cache_used = 0;
+		zabbix_log(LOG_LEVEL_WARNING, "cannot map value cache snapshot file \"%s\": %s", path,
+				zbx_strerror(errno));
+		close(fd);
+		goto out;
+	}
 
-		vc_try_unlock();
+	close(fd);
 
-		ret = vc_db_get_values(itemid, value_type, values, seconds, count, ts);
+	sec = zbx_time();
+	now = (int)time(NULL);
 
-		vc_try_lock();
+	reader.data = (const char *)data;
+	reader.size = (size_t)st.st_size;
+	reader.offset = ZBX_CONST_STRLEN(ZBX_VC_SNAPSHOT_MAGIC);
 
-		if (SUCCEED == ret)
-			vc_update_statistics(NULL, 0, values->values_num);
+	if (reader.size < reader.offset || 0 != memcmp(reader.data, ZBX_VC_SNAPSHOT_MAGIC, reader.offset) ||
+			SUCCEED != vc_snapshot_read(&reader, &version, sizeof(version)) ||
+			ZBX_VC_SNAPSHOT_VERSION != version ||
+			SUCCEED != vc_snapshot_read(&reader, &flags, sizeof(flags)) ||
+			SUCCEED != vc_snapshot_read(&reader, &timestamp, sizeof(timestamp)) ||
+			SUCCEED != vc_snapshot_read(&reader, &items_num, sizeof(items_num)))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot load value cache snapshot file \"%s\": incompatible file format",
+				path);
+		goto unmap;
 	}
 
-	if (NULL != item)
-		vc_item_release(item);
+	zbx_history_record_vector_create(&values);
 
-	vc_try_unlock();
+	for (i = 0; i < ITEM_VALUE_TYPE_MAX; i++)
+		zbx_vector_uint64_create(&itemids[i]);
 
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s count:%d cached:%d",
-			__function_name, zbx_result_string(ret), values->values_num, cache_used);
+	for (index = 0; index < items_num; index++)
+	{
+		memset(&item_local, 0, sizeof(item_local));
+
+		if (SUCCEED != vc_snapshot_read(&reader, &item_local.itemid, sizeof(item_local.itemid)) ||
+				SUCCEED != vc_snapshot_read(&reader, &item_local.value_type,
+						sizeof(item_local.value_type)) ||
+				SUCCEED != vc_snapshot_read(&reader, &item_local.status, sizeof(item_local.status)) ||
+				SUCCEED != vc_snapshot_read(&reader, &item_local.range_sync_hour,
+						sizeof(item_local.range_sync_hour)) ||
+				SUCCEED != vc_snapshot_read(&reader, &reserved, sizeof(reserved)) ||
+				SUCCEED != vc_snapshot_read(&reader, &item_local.active_range,
+						sizeof(item_local.active_range)) ||
+				SUCCEED != vc_snapshot_read(&reader, &item_local.daily_range,
+						sizeof(item_local.daily_range)) ||
+				SUCCEED != vc_snapshot_read(&reader, &item_local.db_cached_from,
+						sizeof(item_local.db_cached_from)) ||
+				SUCCEED != vc_snapshot_read(&reader, &item_local.last_accessed,
+						sizeof(item_local.last_accessed)) ||
+				SUCCEED != vc_snapshot_read(&reader, &item_local.hits, sizeof(item_local.hits)) ||
+				SUCCEED != vc_snapshot_read(&reader, &values_num, sizeof(values_num)) ||
+				0 == values_num)
+		{
+			break;
+		}
 
-	return ret;
-}
+		for (i = 0; i < (int)values_num; i++)
+		{
+			if (SUCCEED != vc_snapshot_read_value(&reader, item_local.value_type, &values))
+				break;
+		}
 
-/******************************************************************************
- *                                                                            *
- * Function: zbx_vc_get_value                                                 *
- *                                                                            *
- * Purpose: get the last history value with a timestamp less or equal to the  *
- *          target timestamp                                                  *
- *                                                                            *
- * Parameters: itemid     - [IN] the item id                                  *
- *             value_type - [IN] the item value type                          *
- *             ts         - [IN] the target timestamp                         *
- *             value      - [OUT] the value found                             *
- *                                                                            *
- * Return Value: SUCCEED - the item was retrieved                             *
- *               FAIL    - otherwise                                          *
- *                                                                            *
- * Comments: Depending on the value type this function might allocate memory  *
- *           to store value data. To free it use zbx_vc_history_value_clear() *
- *           function.                                                        *
- *                                                                            *
- ******************************************************************************/
-int	zbx_vc_get_value(zbx_uint64_t itemid, int value_type, const zbx_timespec_t *ts, zbx_history_record_t *value)
-{
-	zbx_vector_history_record_t	values;
-	int				ret = FAIL;
+		if (i != (int)values_num)
+			break;
 
-	zbx_history_record_vector_create(&values);
+		vc_stripe_select(vc_get_stripe(item_local.itemid));
 
-	if (SUCCEED != zbx_vc_get_values(itemid, value_type, &values, ts->sec, 1, ts) || 0 == values.values_num)
-		goto out;
+		if (NULL == zbx_hashset_search(&vc_cache->items, &item_local.itemid))
+		{
+			if (NULL == (item = (zbx_vc_item_t *)zbx_hashset_insert(&vc_cache->items, &item_local,
+					sizeof(zbx_vc_item_t))))
+			{
+				vc_history_record_vector_clean(&values, item_local.value_type);
+				break;
+			}
 
-	*value = values.values[0];
+			if (SUCCEED != vch_item_add_values_at_tail(item, values.values, values.values_num))
+			{
+				vch_item_free_cache(item);
+				zbx_hashset_remove_direct(&vc_cache->items, item);
+				vc_history_record_vector_clean(&values, item_local.value_type);
+				break;
+			}
 
-	/* reset values vector size so the returned value is not cleared when destroying the vector */
-	values.values_num = 0;
+			/* the values added to history after the snapshot was written are read later in batches */
+			if (0 == (flags & ZBX_VC_SNAPSHOT_SHUTDOWN))
+				zbx_vector_uint64_append(&itemids[item_local.value_type], item_local.itemid);
 
-	ret = SUCCEED;
-out:
-	zbx_history_record_vector_destroy(&values, value_type);
+			loaded_num++;
+			loaded_values += values.values_num;
+		}
 
-	return ret;
-}
+		vc_history_record_vector_clean(&values, item_local.value_type);
+	}
 
-/******************************************************************************
- *                                                                            *
- * Function: zbx_vc_get_statistics                                            *
- *                                                                            *
- * Purpose: retrieves usage cache statistics                                  *
- *                                                                            *
- * Parameters: stats     - [OUT] the cache usage statistics                   *
- *                                                                            *
- * Return value:  SUCCEED - the cache statistics were retrieved successfully  *
- *                FAIL    - failed to retrieve cache statistics               *
- *                          (cache was not initialized)                       *
- *                                                                            *
- ******************************************************************************/
-int	zbx_vc_get_statistics(zbx_vc_stats_t *stats)
-{
-	if (ZBX_VC_DISABLED == vc_state)
-		return FAIL;
+	/* release the values of partially read item */
+	vc_history_record_vector_clean(&values, item_local.value_type);
+	zbx_vector_history_record_destroy(&values);
 
-	vc_try_lock();
+	for (i = 0; i < ITEM_VALUE_TYPE_MAX; i++)
+	{
+		if (0 != itemids[i].values_num)
+			missing += vc_snapshot_read_missing_values(&itemids[i], i, (int)timestamp, now);
 
-	stats->hits = vc_cache->hits;
-	stats->misses = vc_cache->misses;
-	stats->mode = vc_cache->mode;
+		zbx_vector_uint64_destroy(&itemids[i]);
+	}
 
-	stats->total_size = vc_mem->total_size;
-	stats->free_size = vc_mem->free_size;
+	if (index == items_num)
+		ret = SUCCEED;
 
-	vc_try_unlock();
+	zabbix_log(LOG_LEVEL_INFORMATION, "loaded value cache snapshot: " ZBX_FS_UI64 " of " ZBX_FS_UI64 " items, "
+			ZBX_FS_UI64 " values (%d read from history) in " ZBX_FS_DBL " sec", loaded_num, items_num,
+			loaded_values, missing, zbx_time() - sec);
 
-	return SUCCEED;
-}
+	if (SUCCEED != ret)
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "value cache snapshot file \"%s\" is corrupted or value cache is full",
+				path);
+	}
 
-/******************************************************************************
- *                                                                            *
- * Function: zbx_vc_lock                                                      *
- *                                                                            *
- * Purpose: locks the cache for batch usage                                   *
- *                                                                            *
- * Comments: Use zbx_vc_lock()/zbx_vc_unlock to explicitly lock/unlock cache  *
- *           for batch usage. The cache is automatically locked during every  *
- *           API call using the cache unless it was explicitly locked with    *
- *           zbx_vc_lock() function by the same process.                      *
- *                                                                            *
- ******************************************************************************/
-void	zbx_vc_lock(void)
-{
-	zbx_mutex_lock(vc_lock);
-	vc_locked = 1;
-}
+	/* the loaded snapshot does not contain the values added after server start */
+	if (0 != (flags & ZBX_VC_SNAPSHOT_SHUTDOWN) && -1 != (fd = open(path, O_WRONLY)))
+	{
+		flags &= ~ZBX_VC_SNAPSHOT_SHUTDOWN;
 
-/******************************************************************************
- *                                                                            *
- * Function: zbx_vc_unlock                                                    *
- *                                                                            *
- * Purpose: unlocks cache after it has been locked with zbx_vc_lock()         *
- *                                                                            *
- * Comments: See zbx_vc_lock() function.                                      *
- *                                                                            *
- ******************************************************************************/
-void	zbx_vc_unlock(void)
-{
-	vc_locked = 0;
-	zbx_mutex_unlock(vc_lock);
-}
+		if (sizeof(flags) != pwrite(fd, &flags, sizeof(flags), ZBX_VC_SNAPSHOT_FLAGS_OFFSET))
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot update value cache snapshot file \"%s\": %s", path,
+					zbx_strerror(errno));
+		}
 
-/******************************************************************************
- *                                                                            *
- * Function: zbx_vc_enable                                                    *
- *                                                                            *
- * Purpose: enables value caching for current process                         *
- *                                                                            *
- ******************************************************************************/
-void	zbx_vc_enable(void)
-{
-	if (NULL != vc_cache)
-		vc_state = ZBX_VC_ENABLED;
-}
+		close(fd);
+	}
+unmap:
+	munmap(data, (size_t)st.st_size);
+out:
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(ret));
 
-/******************************************************************************
- *                                                                            *
- * Function: zbx_vc_disable                                                   *
- *                                                                            *
- * Purpose: disables value caching for current process                        *
- *                                                                            *
- ******************************************************************************/
-void	zbx_vc_disable(void)
-{
-	vc_state = ZBX_VC_DISABLED;
+	return ret;
 }
 
 #ifdef HAVE_TESTS
@@ -49,6 +49,11 @@
  *   either zbx_history_record_vector_destroy() function (free the zbx_vc_get_values()
  *   call output) or zbx_history_record_clear() function (free the zbx_vc_get_value() call output).
  *
+ *   The sum, average, minimum and maximum of numeric item values and the number of item
+ *   values in a time period ending after the last cached value can be retrieved with
+ *   zbx_vc_get_aggregate() function without scanning the period values. If it fails the
+ *   values must be retrieved with zbx_vc_get_values() function.
+ *
  * Locking
  *
  *   The cache ensures synchronization between processes by using automatic locks whenever
@@ -103,6 +108,23 @@ int	zbx_vc_get_value(zbx_uint64_t itemid, int value_type, const zbx_timespec_t *
 
 int	zbx_vc_add_values(zbx_vector_ptr_t *history);
 
+/* the value cache aggregate functions */
+#define ZBX_VC_AGGR_SUM		0
+#define ZBX_VC_AGGR_AVG		1
+#define ZBX_VC_AGGR_MIN		2
+#define ZBX_VC_AGGR_MAX		3
+#define ZBX_VC_AGGR_COUNT	4
+
+int	zbx_vc_get_aggregate(zbx_uint64_t itemid, int value_type, int func, int seconds, const zbx_timespec_t *ts,
+		history_value_t *value, int *count);
+
 int	zbx_vc_get_statistics(zbx_vc_stats_t *stats);
 
+/* the value cache snapshot was written on shutdown after flushing history cache */
+#define ZBX_VC_SNAPSHOT_SHUTDOWN	0x01
+
+int	zbx_vc_snapshot_write(const char *path, zbx_uint32_t flags);
+
+int	zbx_vc_snapshot_load(const char *path);
+
 #endif	/* ZABBIX_VALUECACHE_H */
@@ -2866,6 +2866,47 @@ int	zbx_sql_add_host_availability(char **sql, size_t *sql_alloc, size_t *sql_off
 	return SUCCEED;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_db_update_hosts_availability                                 *
+ *                                                                            *
+ * Purpose: writes host availability changes into database in one            *
+ *          transaction                                                       *
+ *                                                                            *
+ * Parameters: hosts - [IN] the host availability data                        *
+ *                          (zbx_host_availability_t *)                       *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_db_update_hosts_availability(const zbx_vector_ptr_t *hosts)
+{
+	char	*sql_buf = NULL;
+	size_t	sql_buf_alloc = 0, sql_buf_offset = 0;
+	int	i;
+
+	DBbegin();
+	DBbegin_multiple_update(&sql_buf, &sql_buf_alloc, &sql_buf_offset);
+
+	for (i = 0; i < hosts->values_num; i++)
+	{
+		if (SUCCEED == zbx_sql_add_host_availability(&sql_buf, &sql_buf_alloc, &sql_buf_offset,
+				(zbx_host_availability_t *)hosts->values[i]))
+		{
+			zbx_strcpy_alloc(&sql_buf, &sql_buf_alloc, &sql_buf_offset, ";\n");
+		}
+
+		DBexecute_overflowed_sql(&sql_buf, &sql_buf_alloc, &sql_buf_offset);
+	}
+
+	DBend_multiple_update(&sql_buf, &sql_buf_alloc, &sql_buf_offset);
+
+	if (16 < sql_buf_offset)
+		DBexecute("%s", sql_buf);
+
+	DBcommit();
+
+	zbx_free(sql_buf);
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: DBget_user_by_active_session                                     *
@@ -2019,6 +2019,17 @@ const ZBX_TABLE	tables[] = {
 		},
 		NULL
 	},
+	{"changelog",	"changelogid",	0,
+		{
+		{"changelogid",	NULL,	NULL,	NULL,	0,	ZBX_TYPE_UINT,	ZBX_NOTNULL,	0},
+		{"object",	"0",	NULL,	NULL,	0,	ZBX_TYPE_INT,	ZBX_NOTNULL,	0},
+		{"objectid",	NULL,	NULL,	NULL,	0,	ZBX_TYPE_ID,	ZBX_NOTNULL,	0},
+		{"operation",	"0",	NULL,	NULL,	0,	ZBX_TYPE_INT,	ZBX_NOTNULL,	0},
+		{"clock",	"0",	NULL,	NULL,	0,	ZBX_TYPE_INT,	ZBX_NOTNULL,	0},
+		{0}
+		},
+		NULL
+	},
 	{"dbversion",	"",	0,
 		{
 		{"mandatory",	"0",	NULL,	NULL,	0,	ZBX_TYPE_INT,	ZBX_NOTNULL,	0},
@@ -3792,11 +3803,31 @@ value varchar(255) DEFAULT '' NOT NULL,\n\
 PRIMARY KEY (maintenancetagid)\n\
 );\n\
 CREATE INDEX maintenance_tag_1 ON maintenance_tag (maintenanceid);\n\
+CREATE TABLE changelog (\n\
+changelogid integer  NOT NULL PRIMARY KEY AUTOINCREMENT,\n\
+object integer DEFAULT '0' NOT NULL,\n\
+objectid bigint  NOT NULL,\n\
+operation integer DEFAULT '0' NOT NULL,\n\
+clock integer DEFAULT '0' NOT NULL\n\
+);\n\
+CREATE INDEX changelog_1 ON changelog (clock);\n\
 CREATE TABLE dbversion (\n\
 mandatory integer DEFAULT '0' NOT NULL,\n\
 optional integer DEFAULT '0' NOT NULL\n\
 );\n\
-INSERT INTO dbversion VALUES ('4000000','4000000');\n\
+INSERT INTO dbversion VALUES ('4000000','4000003');\n\
+CREATE TRIGGER items_insert AFTER INSERT ON items FOR EACH ROW BEGIN INSERT INTO changelog (object,objectid,operation,clock) VALUES (1,new.itemid,1,cast(strftime('%s','now') as integer)); END;\n\
+CREATE TRIGGER items_update AFTER UPDATE OF hostid,status,type,value_type,key_,snmp_community,snmp_oid,port,snmpv3_securityname,snmpv3_securitylevel,snmpv3_authpassphrase,snmpv3_privpassphrase,ipmi_sensor,delay,trapper_hosts,logtimefmt,params,authtype,username,password,publickey,privatekey,flags,interfaceid,snmpv3_authprotocol,snmpv3_privprotocol,snmpv3_contextname,history,trends,inventory_link,valuemapid,units,jmx_endpoint,master_itemid,timeout,url,query_fields,posts,status_codes,follow_redirects,post_type,http_proxy,headers,retrieve_mode,request_method,output_format,ssl_cert_file,ssl_key_file,ssl_key_password,verify_peer,verify_host,allow_traps ON items FOR EACH ROW BEGIN INSERT INTO changelog (object,objectid,operation,clock) VALUES (1,new.itemid,2,cast(strftime('%s','now') as integer)); END;\n\
+CREATE TRIGGER items_delete AFTER DELETE ON items FOR EACH ROW BEGIN INSERT INTO changelog (object,objectid,operation,clock) VALUES (1,old.itemid,3,cast(strftime('%s','now') as integer)); END;\n\
+CREATE TRIGGER item_preproc_insert AFTER INSERT ON item_preproc FOR EACH ROW BEGIN INSERT INTO changelog (object,objectid,operation,clock) VALUES (2,new.item_preprocid,1,cast(strftime('%s','now') as integer)); END;\n\
+CREATE TRIGGER item_preproc_update AFTER UPDATE ON item_preproc FOR EACH ROW BEGIN INSERT INTO changelog (object,objectid,operation,clock) VALUES (2,new.item_preprocid,2,cast(strftime('%s','now') as integer)); END;\n\
+CREATE TRIGGER item_preproc_delete AFTER DELETE ON item_preproc FOR EACH ROW BEGIN INSERT INTO changelog (object,objectid,operation,clock) VALUES (2,old.item_preprocid,3,cast(strftime('%s','now') as integer)); END;\n\
+CREATE TRIGGER functions_insert AFTER INSERT ON functions FOR EACH ROW BEGIN INSERT INTO changelog (object,objectid,operation,clock) VALUES (3,new.functionid,1,cast(strftime('%s','now') as integer)); END;\n\
+CREATE TRIGGER functions_update AFTER UPDATE ON functions FOR EACH ROW BEGIN INSERT INTO changelog (object,objectid,operation,clock) VALUES (3,new.functionid,2,cast(strftime('%s','now') as integer)); END;\n\
+CREATE TRIGGER functions_delete AFTER DELETE ON functions FOR EACH ROW BEGIN INSERT INTO changelog (object,objectid,operation,clock) VALUES (3,old.functionid,3,cast(strftime('%s','now') as integer)); END;\n\
+CREATE TRIGGER triggers_insert AFTER INSERT ON triggers FOR EACH ROW BEGIN INSERT INTO changelog (object,objectid,operation,clock) VALUES (4,new.triggerid,1,cast(strftime('%s','now') as integer)); END;\n\
+CREATE TRIGGER triggers_update AFTER UPDATE OF description,expression,priority,type,status,recovery_mode,recovery_expression,correlation_mode,correlation_tag,flags ON triggers FOR EACH ROW BEGIN INSERT INTO changelog (object,objectid,operation,clock) VALUES (4,new.triggerid,2,cast(strftime('%s','now') as integer)); END;\n\
+CREATE TRIGGER triggers_delete AFTER DELETE ON triggers FOR EACH ROW BEGIN INSERT INTO changelog (object,objectid,operation,clock) VALUES (4,old.triggerid,3,cast(strftime('%s','now') as integer)); END;\n\
 ";
 const char	*const db_schema_fkeys[] = {
 	NULL
@@ -27,11 +27,270 @@
 
 #ifndef HAVE_SQLITE3
 
+/* the configuration changes tracked by changelog table, object values must match ZBX_DBSYNC_OBJ_* */
+typedef struct
+{
+	const char	*table;
+	const char	*recid;
+	int		object;
+	const char	*fields;	/* the fields tracked on update, NULL - all fields */
+}
+zbx_dbpatch_changelog_t;
+
+static const zbx_dbpatch_changelog_t	changelog_tables[] = {
+	{"items", "itemid", 1,
+		"hostid,status,type,value_type,key_,snmp_community,snmp_oid,port,snmpv3_securityname,"
+		"snmpv3_securitylevel,snmpv3_authpassphrase,snmpv3_privpassphrase,ipmi_sensor,delay,"
+		"trapper_hosts,logtimefmt,params,authtype,username,password,publickey,privatekey,flags,"
+		"interfaceid,snmpv3_authprotocol,snmpv3_privprotocol,snmpv3_contextname,history,trends,"
+		"inventory_link,valuemapid,units,jmx_endpoint,master_itemid,timeout,url,query_fields,posts,"
+		"status_codes,follow_redirects,post_type,http_proxy,headers,retrieve_mode,request_method,"
+		"output_format,ssl_cert_file,ssl_key_file,ssl_key_password,verify_peer,verify_host,allow_traps"},
+	{"item_preproc", "item_preprocid", 2, NULL},
+	{"functions", "functionid", 3, NULL},
+	{"triggers", "triggerid", 4,
+		"description,expression,priority,type,status,recovery_mode,recovery_expression,correlation_mode,"
+		"correlation_tag,flags"},
+	{NULL}
+};
+
+#if defined(HAVE_MYSQL)
+#	define ZBX_CHANGELOG_CLOCK	"unix_timestamp()"
+#elif defined(HAVE_POSTGRESQL)
+#	define ZBX_CHANGELOG_CLOCK	"cast(extract(epoch from now()) as integer)"
+#elif defined(HAVE_ORACLE)
+#	define ZBX_CHANGELOG_CLOCK	"round((cast(sys_extract_utc(systimestamp) as date)-date'1970-01-01')*86400)"
+#elif defined(HAVE_IBM_DB2)
+#	define ZBX_CHANGELOG_CLOCK	"(days(current timestamp-current timezone)-days('1970-01-01'))*86400" \
+					"+midnight_seconds(current timestamp-current timezone)"
+#endif
+
+#define ZBX_CHANGELOG_INSERT	"insert into changelog (object,objectid,operation,clock)"
+
 static int	DBpatch_4000000(void)
 {
 	return SUCCEED;
 }
 
+static int	DBpatch_4000001(void)
+{
+	const char	*sql[] = {
+#if defined(HAVE_MYSQL)
+		"create table changelog ("
+			"changelogid bigint unsigned not null auto_increment,"
+			"object integer default '0' not null,"
+			"objectid bigint unsigned not null,"
+			"operation integer default '0' not null,"
+			"clock integer default '0' not null,"
+			"primary key (changelogid)"
+		") engine=innodb",
+#elif defined(HAVE_POSTGRESQL)
+		"create table changelog ("
+			"changelogid bigserial not null,"
+			"object integer default '0' not null,"
+			"objectid bigint not null,"
+			"operation integer default '0' not null,"
+			"clock integer default '0' not null,"
+			"primary key (changelogid)"
+		")",
+#elif defined(HAVE_ORACLE)
+		"create table changelog ("
+			"changelogid number(20) not null,"
+			"object number(10) default '0' not null,"
+			"objectid number(20) not null,"
+			"operation number(10) default '0' not null,"
+			"clock number(10) default '0' not null,"
+			"primary key (changelogid)"
+		")",
+		"create sequence changelog_seq start with 1 increment by 1 nomaxvalue",
+		"create trigger changelog_tr before insert on changelog for each row\n"
+		"begin\n"
+			"select changelog_seq.nextval into :new.changelogid from dual;\n"
+		"end;",
+#elif defined(HAVE_IBM_DB2)
+		"create table changelog ("
+			"changelogid bigint not null generated always as identity (start with 1 increment by 1),"
+			"object integer default '0' not null,"
+			"objectid bigint not null,"
+			"operation integer default '0' not null,"
+			"clock integer default '0' not null,"
+			"primary key (changelogid)"
+		")",
+#endif
+		NULL
+	};
+	int		i;
+
+	for (i = 0; NULL != sql[i]; i++)
+	{
+		if (ZBX_DB_OK > DBexecute("%s", sql[i]))
+			return FAIL;
+	}
+
+	return SUCCEED;
+}
+
+static int	DBpatch_4000002(void)
+{
+	return DBcreate_index("changelog", "changelog_1", "clock", 0);
+}
+
+#if defined(HAVE_MYSQL)
+/******************************************************************************
+ *                                                                            *
+ * Function: DBpatch_changelog_mysql_condition                                *
+ *                                                                            *
+ * Purpose: creates condition matching rows with any of the specified fields  *
+ *          changed                                                           *
+ *                                                                            *
+ ******************************************************************************/
+static void	DBpatch_changelog_mysql_condition(char **sql, size_t *sql_alloc, size_t *sql_offset,
+		const char *fields)
+{
+	const char	*ptr;
+	size_t		len;
+
+	zbx_strcpy_alloc(sql, sql_alloc, sql_offset, "not (");
+
+	for (ptr = fields; '\0' != *ptr; ptr += len + (',' == ptr[len] ? 1 : 0))
+	{
+		len = strcspn(ptr, ",");
+
+		if (ptr != fields)
+			zbx_strcpy_alloc(sql, sql_alloc, sql_offset, " and ");
+
+		zbx_snprintf_alloc(sql, sql_alloc, sql_offset, "new.%.*s<=>old.%.*s", (int)len, ptr, (int)len, ptr);
+	}
+
+	zbx_chrcpy_alloc(sql, sql_alloc, sql_offset, ')');
+}
+#endif
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DBpatch_changelog_triggers_sql                                   *
+ *                                                                            *
+ * Purpose: creates sql statements recording table changes in changelog      *
+ *                                                                            *
+ ******************************************************************************/
+static void	DBpatch_changelog_triggers_sql(const zbx_dbpatch_changelog_t *cl, zbx_vector_str_t *statements)
+{
+	char	*update;
+#if defined(HAVE_MYSQL)
+	char	*sql = NULL;
+	size_t	sql_alloc = 0, sql_offset = 0;
+#endif
+	if (NULL != cl->fields)
+		update = zbx_dsprintf(NULL, "update of %s", cl->fields);
+	else
+		update = zbx_strdup(NULL, "update");
+#if defined(HAVE_MYSQL)
+	zbx_vector_str_append(statements, zbx_dsprintf(NULL,
+			"create trigger %s_insert after insert on %s for each row "
+			ZBX_CHANGELOG_INSERT " values (%d,new.%s,1," ZBX_CHANGELOG_CLOCK ")",
+			cl->table, cl->table, cl->object, cl->recid));
+
+	zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, "create trigger %s_update after update on %s for each row ",
+			cl->table, cl->table);
+
+	if (NULL != cl->fields)
+	{
+		/* MySQL triggers cannot be limited to updates of specific columns */
+		zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset,
+				ZBX_CHANGELOG_INSERT " select %d,new.%s,2," ZBX_CHANGELOG_CLOCK " from dual where ",
+				cl->object, cl->recid);
+		DBpatch_changelog_mysql_condition(&sql, &sql_alloc, &sql_offset, cl->fields);
+	}
+	else
+	{
+		zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset,
+				ZBX_CHANGELOG_INSERT " values (%d,new.%s,2," ZBX_CHANGELOG_CLOCK ")",
+				cl->object, cl->recid);
+	}
+	zbx_vector_str_append(statements, sql);
+
+	zbx_vector_str_append(statements, zbx_dsprintf(NULL,
+			"create trigger %s_delete after delete on %s for each row "
+			ZBX_CHANGELOG_INSERT " values (%d,old.%s,3," ZBX_CHANGELOG_CLOCK ")",
+			cl->table, cl->table, cl->object, cl->recid));
+#elif defined(HAVE_POSTGRESQL)
+	zbx_vector_str_append(statements, zbx_dsprintf(NULL,
+			"create function changelog_%s_op() returns trigger as $$\n"
+			"begin\n"
+				"if tg_op = 'DELETE' then\n"
+					ZBX_CHANGELOG_INSERT " values (%d,old.%s,3," ZBX_CHANGELOG_CLOCK ");\n"
+					"return old;\n"
+				"end if;\n"
+				ZBX_CHANGELOG_INSERT " values (%d,new.%s,"
+						"case when tg_op = 'INSERT' then 1 else 2 end," ZBX_CHANGELOG_CLOCK ");\n"
+				"return new;\n"
+			"end;\n"
+			"$$ language plpgsql",
+			cl->table, cl->object, cl->recid, cl->object, cl->recid));
+
+	zbx_vector_str_append(statements, zbx_dsprintf(NULL,
+			"create trigger %s_changelog after insert or delete or %s on %s"
+			" for each row execute procedure changelog_%s_op()",
+			cl->table, update, cl->table, cl->table));
+#elif defined(HAVE_ORACLE)
+	zbx_vector_str_append(statements, zbx_dsprintf(NULL,
+			"create trigger %s_changelog after insert or delete or %s on %s for each row\n"
+			"begin\n"
+				"if inserting then\n"
+					ZBX_CHANGELOG_INSERT " values (%d,:new.%s,1," ZBX_CHANGELOG_CLOCK ");\n"
+				"elsif updating then\n"
+					ZBX_CHANGELOG_INSERT " values (%d,:new.%s,2," ZBX_CHANGELOG_CLOCK ");\n"
+				"else\n"
+					ZBX_CHANGELOG_INSERT " values (%d,:old.%s,3," ZBX_CHANGELOG_CLOCK ");\n"
+				"end if;\n"
+			"end;",
+			cl->table, update, cl->table, cl->object, cl->recid, cl->object, cl->recid, cl->object,
+			cl->recid));
+#elif defined(HAVE_IBM_DB2)
+	zbx_vector_str_append(statements, zbx_dsprintf(NULL,
+			"create trigger %s_insert after insert on %s referencing new as n for each row mode db2sql "
+			ZBX_CHANGELOG_INSERT " values (%d,n.%s,1," ZBX_CHANGELOG_CLOCK ")",
+			cl->table, cl->table, cl->object, cl->recid));
+
+	zbx_vector_str_append(statements, zbx_dsprintf(NULL,
+			"create trigger %s_update after %s on %s referencing new as n for each row mode db2sql "
+			ZBX_CHANGELOG_INSERT " values (%d,n.%s,2," ZBX_CHANGELOG_CLOCK ")",
+			cl->table, update, cl->table, cl->object, cl->recid));
+
+	zbx_vector_str_append(statements, zbx_dsprintf(NULL,
+			"create trigger %s_delete after delete on %s referencing old as o for each row mode db2sql "
+			ZBX_CHANGELOG_INSERT " values (%d,o.%s,3," ZBX_CHANGELOG_CLOCK ")",
+			cl->table, cl->table, cl->object, cl->recid));
+#endif
+	zbx_free(update);
+}
+
+static int	DBpatch_4000003(void)
+{
+	const zbx_dbpatch_changelog_t	*cl;
+	zbx_vector_str_t		statements;
+	int				i, ret = SUCCEED;
+
+	zbx_vector_str_create(&statements);
+
+	for (cl = changelog_tables; NULL != cl->table; cl++)
+		DBpatch_changelog_triggers_sql(cl, &statements);
+
+	for (i = 0; i < statements.values_num; i++)
+	{
+		if (ZBX_DB_OK > DBexecute("%s", statements.values[i]))
+		{
+			ret = FAIL;
+			break;
+		}
+	}
+
+	zbx_vector_str_clear_ext(&statements, zbx_str_free);
+	zbx_vector_str_destroy(&statements);
+
+	return ret;
+}
+
 #endif
 
 DBPATCH_START(4000)
@@ -39,5 +298,8 @@ DBPATCH_START(4000)
 /* version, duplicates flag, mandatory flag */
 
 DBPATCH_ADD(4000000, 0, 1)
+DBPATCH_ADD(4000001, 0, 0)
+DBPATCH_ADD(4000002, 0, 0)
+DBPATCH_ADD(4000003, 0, 0)
 
 DBPATCH_END()
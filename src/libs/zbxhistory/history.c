@@ -129,8 +129,8 @@ int	zbx_history_add_values(const zbx_vector_ptr_t *history)
 	{
 		zbx_history_iface_t	*writer = &history_ifaces[i];
 
-		if (0 != (flags & (1 << i)))
-			ret = writer->flush(writer);
+		if (0 != (flags & (1 << i)) && SUCCEED != writer->flush(writer))
+			ret = FAIL;
 	}
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
@@ -191,6 +191,65 @@ int	zbx_history_get_values(zbx_uint64_t itemid, int value_type, int start, int c
 	return ret;
 }
 
+/************************************************************************************
+ *                                                                                  *
+ * Function: zbx_history_get_values_multi                                           *
+ *                                                                                  *
+ * Purpose: gets values of several items from history storage                      *
+ *                                                                                  *
+ * Parameters:  itemids       - [IN] the itemids, all of the same value type        *
+ *              itemids_num   - [IN] the number of itemids                          *
+ *              value_type    - [IN] the items value type                           *
+ *              start         - [IN] the period start timestamp                     *
+ *              end           - [IN] the period end timestamp                       *
+ *              value_itemids - [OUT] the itemids of the read values                *
+ *              values        - [OUT] the item history data values                  *
+ *                                                                                  *
+ * Return value: SUCCEED - the history data were read successfully                  *
+ *               FAIL - otherwise                                                   *
+ *                                                                                  *
+ * Comments: This function reads all values from ]<start>,<end>] interval. The      *
+ *           value_itemids vector gets the itemid of every value appended to the    *
+ *           values vector. The values are not sorted.                              *
+ *           Storage backends that cannot read several items at once are queried    *
+ *           item by item.                                                          *
+ *                                                                                  *
+ ************************************************************************************/
+int	zbx_history_get_values_multi(const zbx_uint64_t *itemids, int itemids_num, int value_type, int start,
+		int end, zbx_vector_uint64_t *value_itemids, zbx_vector_history_record_t *values)
+{
+	const char		*__function_name = "zbx_history_get_values_multi";
+	int			i, ret = SUCCEED, pos;
+	zbx_history_iface_t	*writer = &history_ifaces[value_type];
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() items:%d value_type:%d start:%d end:%d", __function_name, itemids_num,
+			value_type, start, end);
+
+	pos = values->values_num;
+
+	if (NULL != writer->get_values_multi)
+	{
+		ret = writer->get_values_multi(writer, itemids, itemids_num, start, end, value_itemids, values);
+	}
+	else
+	{
+		for (i = 0; i < itemids_num && SUCCEED == ret; i++)
+		{
+			int	num = values->values_num;
+
+			ret = writer->get_values(writer, itemids[i], start, 0, end, values);
+
+			for (; num < values->values_num; num++)
+				zbx_vector_uint64_append(value_itemids, itemids[i]);
+		}
+	}
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s values:%d", __function_name, zbx_result_string(ret),
+			values->values_num - pos);
+
+	return ret;
+}
+
 /************************************************************************************
  *                                                                                  *
  * Function: zbx_history_requires_trends                                            *
@@ -23,12 +23,25 @@
 #define ZBX_HISTORY_IFACE_SQL		0
 #define ZBX_HISTORY_IFACE_ELASTIC	1
 
+/* the clickhouse batches are posted by the history writer process */
+#define ZBX_IPC_SERVICE_HISTWRITER	"histwriter"
+
+#define ZBX_IPC_HISTWRITER_VALUES	1	/* INSERT ... VALUES statement */
+#define ZBX_IPC_HISTWRITER_ROWBINARY	2	/* RowBinary rows */
+
+/* the batches the history writer cannot post yet are spooled to HistoryStorageSpoolDir */
+#define ZBX_HISTORY_SPOOL_PREFIX		"clickhouse."
+#define ZBX_HISTORY_SPOOL_DEFLATE_SUFFIX	".deflate"
+
 typedef struct zbx_history_iface zbx_history_iface_t;
 
 typedef void (*zbx_history_destroy_func_t)(struct zbx_history_iface *hist);
 typedef int (*zbx_history_add_values_func_t)(struct zbx_history_iface *hist, const zbx_vector_ptr_t *history);
 typedef int (*zbx_history_get_values_func_t)(struct zbx_history_iface *hist, zbx_uint64_t itemid, int start,
 		int count, int end, zbx_vector_history_record_t *values);
+typedef int (*zbx_history_get_values_multi_func_t)(struct zbx_history_iface *hist, const zbx_uint64_t *itemids,
+		int itemids_num, int start, int end, zbx_vector_uint64_t *value_itemids,
+		zbx_vector_history_record_t *values);
 typedef int (*zbx_history_flush_func_t)(struct zbx_history_iface *hist);
 
 struct zbx_history_iface
@@ -40,6 +53,8 @@ struct zbx_history_iface
 	zbx_history_destroy_func_t	destroy;
 	zbx_history_add_values_func_t	add_values;
 	zbx_history_get_values_func_t	get_values;
+	/* optional, zbx_history_get_values_multi() falls back to get_values if not set */
+	zbx_history_get_values_multi_func_t	get_values_multi;
 	zbx_history_flush_func_t	flush;
 };
 
@@ -51,5 +66,19 @@ int	zbx_history_elastic_init(zbx_history_iface_t *hist, unsigned char value_type
 
 /* clickhouse hist */
 int	zbx_history_clickhouse_init(zbx_history_iface_t *hist, unsigned char value_type, char **error);
+int	zbx_history_spool_write(const char *dir, zbx_uint32_t code, unsigned char deflated, const char *data,
+		size_t size, char **path, char **error);
+int	zbx_history_spool_read(const char *path, zbx_uint32_t *code, unsigned char *deflated, char **data,
+		size_t *size, char **error);
+
+/* HTTP storage helpers */
+#define ZBX_HISTORY_CONTENT_ENCODING	"Content-Encoding: deflate"
+
+int	zbx_history_compress(const char *in, size_t size_in, char **out, size_t *size_out);
+
+#ifdef HAVE_LIBCURL
+CURL	*zbx_history_curl_get(void);
+void	zbx_history_curl_release(CURL *handle);
+#endif
 
 #endif
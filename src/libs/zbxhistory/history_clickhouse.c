@@ -26,6 +26,7 @@
 #include "dbcache.h"
 #include "zbxhistory.h"
 #include "zbxself.h"
+#include "zbxipcservice.h"
 #include "history.h"
 #include <stdio.h>
 #include <string.h>
@@ -33,36 +34,53 @@
 /* curl_multi_wait() is supported starting with version 7.28.0 (0x071c00) */
 #if defined(HAVE_LIBCURL) && LIBCURL_VERSION_NUM >= 0x071c00
 
-#define		ZBX_HISTORY_STORAGE_DOWN	10000 /* Timeout in milliseconds */
 #define		MAX_HISTORY_CLICKHOUSE_FIELDS	5 /* How many fields to parse from clickhouse output */
 
+#define		ZBX_CLICKHOUSE_FORMAT_VALUES	0	/* INSERT ... VALUES text statement */
+#define		ZBX_CLICKHOUSE_FORMAT_ROWBINARY	1	/* RowBinary rows, the statement is passed in the URL */
+
+/* the size of RowBinary row without value_str: day, itemid, clock, ns, value, value_dbl, value_str length */
+#define		ZBX_CLICKHOUSE_ROW_FIXED_SIZE	(2 + 8 + 4 + 4 + 8 + 8 + 1)
+
 //const char	*value_type_str[] = {"dbl", "str", "log", "uint", "text"};
 
 extern char	*CONFIG_HISTORY_STORAGE_URL;
 extern char *CONFIG_HISTORY_STORAGE_TABLE_NAME;
+extern char	*CONFIG_HISTORY_STORAGE_FORMAT;
+extern char	*CONFIG_HISTORY_STORAGE_SPOOL_DIR;
+extern zbx_uint64_t	CONFIG_HISTORY_STORAGE_SPOOL_SIZE;
 
 typedef struct
 {
 	char	*base_url;
 
-//post_url  here from elastics where it was used for scrolling of data search results, 
-//post_url might be used to use some clickhouse options, so i've decided to leave it
-	//char	*post_url;
 	char	*buf;
+	size_t	buf_alloc;
+	size_t	buf_offset;
+	int	format;
 	CURL	*handle;
 }
 zbx_clickhouse_data_t;
 
+#ifdef HAVE_IPCSERVICE
+/* the connection to the history writer process, see history_writer_thread() */
+static zbx_ipc_socket_t	writer_socket = {-1};
+#endif
+
+/* the batches kept in memory while the writer is not reachable and there is no spool directory */
+#define		ZBX_CLICKHOUSE_PENDING_MAX	(16 * ZBX_MEBIBYTE)
+
 typedef struct
 {
-	unsigned char		initialized;
-	zbx_vector_ptr_t	ifaces;
-
-	CURLM			*handle;
+	char		*data;
+	size_t		size;
+	zbx_uint32_t	code;
 }
-zbx_clickhouse_writer_t;
+zbx_clickhouse_batch_t;
 
-static zbx_clickhouse_writer_t	writer;
+static zbx_vector_ptr_t	pending_batches;
+static size_t		pending_size = 0;
+static unsigned int	spool_seq = 0;
 
 typedef struct
 {
@@ -85,20 +103,6 @@ static size_t	curl_write_cb(void *ptr, size_t size, size_t nmemb, void *userdata
 	return r_size;
 }
 
-/************************************************************************************
- *                                                                                  *
- * Comments: stub function for avoiding LibCURL to print on the standard output.    *
- *           In case of success, elasticsearch return a JSON, but the HTTP error    *
- *           code is enough                                                         *
- *                                                                                  *
- ************************************************************************************/
-static size_t	curl_write_send_cb(void *ptr, size_t size, size_t nmemb, void *userdata)
-{
-	ZBX_UNUSED(ptr);
-	ZBX_UNUSED(userdata);
-	return size * nmemb;
-}
-
 static history_value_t	history_str2value(char *str, unsigned char value_type)
 {
 	history_value_t	value;
@@ -181,15 +185,12 @@ static void	clickhouse_close(zbx_history_iface_t *hist)
 {
 	zbx_clickhouse_data_t	*data = hist->data;
 
-	zbx_free(data->buf);
-	//zbx_free(data->post_url);
+	/* the buffer is kept for the next batch, it is freed by clickhouse_destroy() */
+	data->buf_offset = 0;
 
 	if (NULL != data->handle)
 	{
-		if (NULL != writer.handle)
-			curl_multi_remove_handle(writer.handle, data->handle);
-
-		curl_easy_cleanup(data->handle);
+		zbx_history_curl_release(data->handle);
 		data->handle = NULL;
 	}
 }
@@ -204,192 +205,290 @@ static void	clickhouse_close(zbx_history_iface_t *hist)
 
 /************************************************************************************
  *                                                                                  *
- * Function: clickhouse_writer_init                                                    *
+ * Function: zbx_history_spool_write                                                *
+ *                                                                                  *
+ * Purpose: writes clickhouse history batch to the spool directory                  *
+ *                                                                                  *
+ * Parameters: dir      - [IN] the spool directory                                  *
+ *             code     - [IN] the batch format, ZBX_IPC_HISTWRITER_* message code  *
+ *             deflated - [IN] 1 if the batch is compressed, 0 otherwise            *
+ *             data     - [IN] the batch                                            *
+ *             size     - [IN] the batch size                                       *
+ *             path     - [OUT] the spool file path, optional                       *
+ *             error    - [OUT] the error message                                   *
+ *                                                                                  *
+ * Return value: SUCCEED - the batch was spooled                                    *
+ *               FAIL    - the spool file could not be written                      *
  *                                                                                  *
- * Purpose: initializes clickhouse writer for a new batch of history values            *
+ * Comments: The file is written under a hidden name and renamed when complete, so  *
+ *           the history writer never replays a partial batch. The names sort in    *
+ *           the order the batches were spooled, also across processes.             *
  *                                                                                  *
  ************************************************************************************/
-static void	clickhouse_writer_init()
+int	zbx_history_spool_write(const char *dir, zbx_uint32_t code, unsigned char deflated, const char *data,
+		size_t size, char **path, char **error)
 {
-	if (0 != writer.initialized)
-		return;
+	char	*name, *tmp_path, *file_path;
+	int	fd, ret = FAIL;
+	ssize_t	written;
+
+	name = zbx_dsprintf(NULL, ZBX_HISTORY_SPOOL_PREFIX "%010d.%010d.%06u.%s%s", (int)time(NULL), (int)getpid(),
+			spool_seq++ % 1000000, ZBX_IPC_HISTWRITER_ROWBINARY == code ? "rowbinary" : "values",
+			0 != deflated ? ZBX_HISTORY_SPOOL_DEFLATE_SUFFIX : "");
+	tmp_path = zbx_dsprintf(NULL, "%s/.%s", dir, name);
+	file_path = zbx_dsprintf(NULL, "%s/%s", dir, name);
+	zbx_free(name);
+
+	if (-1 == (fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR)))
+	{
+		*error = zbx_dsprintf(*error, "cannot create history spool file \"%s\": %s", tmp_path,
+				zbx_strerror(errno));
+		goto out;
+	}
+
+	written = write(fd, data, size);
+	close(fd);
 
-	zbx_vector_ptr_create(&writer.ifaces);
+	if (written != (ssize_t)size)
+	{
+		*error = zbx_dsprintf(*error, "cannot write history spool file \"%s\": %s", tmp_path,
+				-1 == written ? zbx_strerror(errno) : "short write");
+		unlink(tmp_path);
+		goto out;
+	}
+
+	if (0 != rename(tmp_path, file_path))
+	{
+		*error = zbx_dsprintf(*error, "cannot rename history spool file \"%s\": %s", tmp_path,
+				zbx_strerror(errno));
+		unlink(tmp_path);
+		goto out;
+	}
 
-	if (NULL == (writer.handle = curl_multi_init()))
+	if (NULL != path)
 	{
-		zbx_error("Cannot initialize cURL multi session");
-		exit(EXIT_FAILURE);
+		*path = file_path;
+		file_path = NULL;
 	}
 
-	writer.initialized = 1;
+	ret = SUCCEED;
+out:
+	zbx_free(file_path);
+	zbx_free(tmp_path);
+
+	return ret;
 }
 
 /************************************************************************************
  *                                                                                  *
- * Function: clickhouse_writer_release                                                 *
+ * Function: zbx_history_spool_read                                                 *
+ *                                                                                  *
+ * Purpose: reads clickhouse history batch from spool file                          *
  *                                                                                  *
- * Purpose: releases initialized clickhouse writer by freeing allocated resources and  *
- *          setting its state to uninitialized.                                     *
+ * Parameters: path     - [IN] the spool file path                                  *
+ *             code     - [OUT] the batch format, ZBX_IPC_HISTWRITER_* message code *
+ *             deflated - [OUT] 1 if the batch is compressed, 0 otherwise           *
+ *             data     - [OUT] the batch                                           *
+ *             size     - [OUT] the batch size                                      *
+ *             error    - [OUT] the error message                                   *
+ *                                                                                  *
+ * Return value: SUCCEED - the batch was read                                       *
+ *               FAIL    - the file could not be read                               *
+ *                                                                                  *
+ * Comments: the format of the batch is taken from the file name, see               *
+ *           zbx_history_spool_write()                                              *
  *                                                                                  *
  ************************************************************************************/
-static void	clickhouse_writer_release()
+int	zbx_history_spool_read(const char *path, zbx_uint32_t *code, unsigned char *deflated, char **data,
+		size_t *size, char **error)
 {
-	int	i;
+	const char	*name;
+	int		fd;
+	zbx_stat_t	st;
+	ssize_t		nbytes;
+
+	if (-1 == (fd = open(path, O_RDONLY)))
+	{
+		*error = zbx_dsprintf(*error, "cannot open history spool file \"%s\": %s", path, zbx_strerror(errno));
+		return FAIL;
+	}
+
+	if (0 != fstat(fd, &st))
+	{
+		*error = zbx_dsprintf(*error, "cannot stat history spool file \"%s\": %s", path, zbx_strerror(errno));
+		close(fd);
+		return FAIL;
+	}
+
+	*size = (size_t)st.st_size;
+	*data = (char *)zbx_malloc(NULL, MAX(*size, 1));
+	nbytes = read(fd, *data, *size);
+	close(fd);
 
-	for (i = 0; i < writer.ifaces.values_num; i++)
-		clickhouse_close(writer.ifaces.values[i]);
+	if (nbytes != (ssize_t)*size)
+	{
+		*error = zbx_dsprintf(*error, "cannot read history spool file \"%s\": %s", path,
+				-1 == nbytes ? zbx_strerror(errno) : "short read");
+		zbx_free(*data);
+		return FAIL;
+	}
 
-	curl_multi_cleanup(writer.handle);
-	writer.handle = NULL;
+	if (NULL == (name = strrchr(path, '/')))
+		name = path;
 
-	zbx_vector_ptr_destroy(&writer.ifaces);
+	*code = (NULL != strstr(name, ".rowbinary") ? ZBX_IPC_HISTWRITER_ROWBINARY : ZBX_IPC_HISTWRITER_VALUES);
+	*deflated = (NULL != strstr(name, ZBX_HISTORY_SPOOL_DEFLATE_SUFFIX) ? 1 : 0);
 
-	writer.initialized = 0;
+	return SUCCEED;
 }
 
 /************************************************************************************
  *                                                                                  *
- * Function: clickhouse_writer_add_iface                                               *
+ * Function: clickhouse_batch_keep                                                  *
  *                                                                                  *
- * Purpose: adds history storage interface to be flushed later                      *
+ * Purpose: keeps the batch that could not be passed to the history writer          *
  *                                                                                  *
- * Parameters: db_insert - [IN] bulk insert data                                    *
+ * Return value: SUCCEED - the batch was spooled or kept in memory to be sent later *
+ *               FAIL - the batch was dropped                                       *
+ *                                                                                  *
+ * Comments: The batch is spooled where the writer replays it from. Without spool   *
+ *           directory it waits in memory for the next flush.                       *
  *                                                                                  *
  ************************************************************************************/
-static void	clickhouse_writer_add_iface(zbx_history_iface_t *hist)
+static int	clickhouse_batch_keep(zbx_uint32_t code, const char *data, size_t size)
 {
-	zbx_clickhouse_data_t	*data = hist->data;
+	zbx_clickhouse_batch_t	*batch;
+	char			*error = NULL;
 
-	clickhouse_writer_init();
+	if (NULL != CONFIG_HISTORY_STORAGE_SPOOL_DIR)
+	{
+		if (SUCCEED == zbx_history_spool_write(CONFIG_HISTORY_STORAGE_SPOOL_DIR, code, 0, data, size, NULL,
+				&error))
+		{
+			return SUCCEED;
+		}
 
-	if (NULL == (data->handle = curl_easy_init()))
+		zabbix_log(LOG_LEVEL_WARNING, "%s", error);
+		zbx_free(error);
+	}
+	else if (ZBX_CLICKHOUSE_PENDING_MAX >= pending_size + size)
 	{
-		zabbix_log(LOG_LEVEL_ERR, "cannot initialize cURL session");
-		return;
+		batch = (zbx_clickhouse_batch_t *)zbx_malloc(NULL, sizeof(zbx_clickhouse_batch_t));
+		batch->data = (char *)zbx_malloc(NULL, MAX(size, 1));
+		memcpy(batch->data, data, size);
+		batch->size = size;
+		batch->code = code;
+
+		zbx_vector_ptr_append(&pending_batches, batch);
+		pending_size += size;
+
+		return SUCCEED;
 	}
 
-	//curl_easy_setopt(data->handle, CURLOPT_URL, data->post_url);
-	curl_easy_setopt(data->handle, CURLOPT_URL, data->base_url);
-	curl_easy_setopt(data->handle, CURLOPT_POST, 1);
-	curl_easy_setopt(data->handle, CURLOPT_POSTFIELDS, data->buf);
-	curl_easy_setopt(data->handle, CURLOPT_WRITEFUNCTION, curl_write_send_cb);
-	curl_easy_setopt(data->handle, CURLOPT_FAILONERROR, 1L);
+	zabbix_log(LOG_LEVEL_WARNING, "history writer is not available, dropping " ZBX_FS_SIZE_T " bytes of history",
+			(zbx_fs_size_t)size);
 
-	curl_multi_add_handle(writer.handle, data->handle);
+	return FAIL;
+}
 
-	zbx_vector_ptr_append(&writer.ifaces, hist);
+static void	clickhouse_batch_free(zbx_clickhouse_batch_t *batch)
+{
+	zbx_free(batch->data);
+	zbx_free(batch);
 }
 
 /************************************************************************************
  *                                                                                  *
- * Function: clickhouse_writer_flush                                                   *
+ * Function: clickhouse_writer_write                                                *
+ *                                                                                  *
+ * Purpose: writes batch to the history writer connection                           *
  *                                                                                  *
- * Purpose: posts historical data to clickhouse storage                                *
+ * Comments: the connection is opened on demand without waiting for the writer, it  *
+ *           is closed after write errors                                           *
+ *           The history writer is started only by server, which is always built    *
+ *           with IPC services. Without them the batch is kept or spooled by caller.*
  *                                                                                  *
  ************************************************************************************/
-static int	clickhouse_writer_flush()
+static int	clickhouse_writer_write(zbx_uint32_t code, const char *data, size_t size)
 {
-	const char		*__function_name = "clickhouse_writer_flush";
-
-	struct curl_slist	*curl_headers = NULL;
-	int			i, running, previous, msgnum;
-	CURLMsg			*msg;
-	zbx_vector_ptr_t	retries;
+#ifdef HAVE_IPCSERVICE
+	char	*error = NULL;
 
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
-
-	if (0 == writer.initialized)
-		return SUCCEED;
-
-	zbx_vector_ptr_create(&retries);
-
-	curl_headers = curl_slist_append(curl_headers, "Content-Type: application/x-ndjson");
-
-	for (i = 0; i < writer.ifaces.values_num; i++)
+	if (-1 == writer_socket.fd && FAIL == zbx_ipc_socket_open(&writer_socket, ZBX_IPC_SERVICE_HISTWRITER, 0,
+			&error))
 	{
-		zbx_history_iface_t	*hist = (zbx_history_iface_t *)writer.ifaces.values[i];
-		zbx_clickhouse_data_t	*data = hist->data;
-
-		curl_easy_setopt(data->handle, CURLOPT_HTTPHEADER, curl_headers);
-
-		zabbix_log(LOG_LEVEL_DEBUG, "sending %s", data->buf);
+		zabbix_log(LOG_LEVEL_WARNING, "cannot connect to history writer service: %s", error);
+		zbx_free(error);
+		return FAIL;
 	}
 
-try_again:
-	previous = 0;
-
-	do
+	if (FAIL == zbx_ipc_socket_write(&writer_socket, code, (const unsigned char *)data, (zbx_uint32_t)size))
 	{
-		int		fds;
-		CURLMcode	code;
-
-		if (CURLM_OK != (code = curl_multi_perform(writer.handle, &running)))
-		{
-			zabbix_log(LOG_LEVEL_ERR, "cannot perform on curl multi handle: %s", curl_multi_strerror(code));
-			break;
-		}
+		zabbix_log(LOG_LEVEL_WARNING, "cannot send history to history writer service");
+		zbx_ipc_socket_close(&writer_socket);
+		writer_socket.fd = -1;
+		return FAIL;
+	}
 
-		if (CURLM_OK != (code = curl_multi_wait(writer.handle, NULL, 0, ZBX_HISTORY_STORAGE_DOWN, &fds)))
-		{
-			zabbix_log(LOG_LEVEL_ERR, "cannot wait on curl multi handle: %s", curl_multi_strerror(code));
-			break;
-		}
+	return SUCCEED;
+#else
+	ZBX_UNUSED(code);
+	ZBX_UNUSED(data);
+	ZBX_UNUSED(size);
 
-		if (previous == running)
-			continue;
+	return FAIL;
+#endif
+}
 
-		while (NULL != (msg = curl_multi_info_read(writer.handle, &msgnum)))
-		{
-			/* If the error is due to malformed data, there is no sense on re-trying to send. */
-			/* That's why we actually check for transport and curl errors separately */
-			if (CURLE_HTTP_RETURNED_ERROR == msg->data.result)
-			{
-				long int	err;
+/************************************************************************************
+ *                                                                                  *
+ * Function: clickhouse_writer_send                                                 *
+ *                                                                                  *
+ * Purpose: passes the encoded batch to the history writer process                  *
+ *                                                                                  *
+ * Return value: SUCCEED - the batch was passed to the writer or kept to be sent    *
+ *                         later                                                    *
+ *               FAIL - the batch was dropped                                       *
+ *                                                                                  *
+ * Comments: The writer posts the batch to clickhouse, so the syncer does not wait  *
+ *           for the network. The batches kept in memory go first, so the writer    *
+ *           gets the values in order.                                              *
+ *                                                                                  *
+ ************************************************************************************/
+static int	clickhouse_writer_send(zbx_clickhouse_data_t *data)
+{
+	const char		*__function_name = "clickhouse_writer_send";
 
-				curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &err);
+	zbx_clickhouse_batch_t	*batch;
+	zbx_uint32_t		code;
+	int			ret = SUCCEED;
 
-				zabbix_log(LOG_LEVEL_ERR, "cannot send data to clickhouse, HTTP error %ld",  err);
-			}
-			else if (CURLE_OK != msg->data.result)
-			{
-				zabbix_log(LOG_LEVEL_WARNING, "%s: %s", "cannot send to clickhouse",
-						curl_easy_strerror(msg->data.result));
-
-				/* If the error is due to curl internal problems or unrelated */
-				/* problems with HTTP, we put the handle in a retry list and */
-				/* remove it from the current execution loop */
-				zbx_vector_ptr_append(&retries, msg->easy_handle);
-				curl_multi_remove_handle(writer.handle, msg->easy_handle);
-			}
-		}
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() size:" ZBX_FS_SIZE_T " pending:%d", __function_name,
+			(zbx_fs_size_t)data->buf_offset, pending_batches.values_num);
 
-		previous = running;
-	}
-	while (running);
+	code = (ZBX_CLICKHOUSE_FORMAT_ROWBINARY == data->format ? ZBX_IPC_HISTWRITER_ROWBINARY :
+			ZBX_IPC_HISTWRITER_VALUES);
 
-	/* We check if we have handles to retry. If yes, we put them back in the multi */
-	/* handle and go to the beginning of the do while() for try sending the data again */
-	/* after sleeping for ZBX_HISTORY_STORAGE_DOWN / 1000 (seconds) */
-	if (0 < retries.values_num)
+	while (0 != pending_batches.values_num)
 	{
-		for (i = 0; i < retries.values_num; i++)
-			curl_multi_add_handle(writer.handle, retries.values[i]);
+		batch = (zbx_clickhouse_batch_t *)pending_batches.values[0];
 
-		zbx_vector_ptr_clear(&retries);
+		if (SUCCEED != clickhouse_writer_write(batch->code, batch->data, batch->size))
+			break;
 
-		sleep(ZBX_HISTORY_STORAGE_DOWN / 1000);
-		goto try_again;
+		pending_size -= batch->size;
+		clickhouse_batch_free(batch);
+		zbx_vector_ptr_remove(&pending_batches, 0);
 	}
 
-	curl_slist_free_all(curl_headers);
+	if (0 != pending_batches.values_num || SUCCEED != clickhouse_writer_write(code, data->buf, data->buf_offset))
+		ret = clickhouse_batch_keep(code, data->buf, data->buf_offset);
 
-	zbx_vector_ptr_destroy(&retries);
+	data->buf_offset = 0;
 
-	clickhouse_writer_release();
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(ret));
 
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
-	return SUCCEED;
+	return ret;
 }
 
 /******************************************************************************************************************
@@ -413,6 +512,7 @@ static void	clickhouse_destroy(zbx_history_iface_t *hist)
 
 	clickhouse_close(hist);
 
+	zbx_free(data->buf);
 	zbx_free(data->base_url);
 	zbx_free(data);
 }
@@ -497,7 +597,7 @@ static int	clickhouse_get_values(zbx_history_iface_t *hist, zbx_uint64_t itemid,
 	//} 
 
 
-	if (NULL == (data->handle = curl_easy_init()))
+	if (NULL == (data->handle = zbx_history_curl_get()))
 	{
 		zabbix_log(LOG_LEVEL_ERR, "cannot initialize cURL session");
 		return FAIL;
@@ -641,6 +741,147 @@ out:
 	return SUCCEED;
 }
 
+/************************************************************************************
+ *                                                                                  *
+ * Function: clickhouse_values_add_string                                           *
+ *                                                                                  *
+ * Purpose: appends quoted and escaped string literal to the VALUES statement       *
+ *                                                                                  *
+ ************************************************************************************/
+static void	clickhouse_values_add_string(zbx_clickhouse_data_t *data, const char *str)
+{
+	const char	*ptr;
+
+	zbx_chrcpy_alloc(&data->buf, &data->buf_alloc, &data->buf_offset, '\'');
+
+	for (ptr = str; '\0' != *ptr; ptr++)
+	{
+		if ('\'' == *ptr || '\\' == *ptr)
+			zbx_chrcpy_alloc(&data->buf, &data->buf_alloc, &data->buf_offset, '\\');
+
+		zbx_chrcpy_alloc(&data->buf, &data->buf_alloc, &data->buf_offset, *ptr);
+	}
+
+	zbx_chrcpy_alloc(&data->buf, &data->buf_alloc, &data->buf_offset, '\'');
+}
+
+/************************************************************************************
+ *                                                                                  *
+ * Function: clickhouse_values_add                                                  *
+ *                                                                                  *
+ * Purpose: appends history value to the INSERT ... VALUES statement                *
+ *                                                                                  *
+ ************************************************************************************/
+static void	clickhouse_values_add(zbx_clickhouse_data_t *data, const ZBX_DC_HISTORY *h)
+{
+	zbx_snprintf_alloc(&data->buf, &data->buf_alloc, &data->buf_offset, "(CAST(%d as date),"
+			ZBX_FS_UI64 ",%d,%d,", h->ts.sec, h->itemid, h->ts.sec, h->ts.ns);
+
+	switch (h->value_type)
+	{
+		case ITEM_VALUE_TYPE_UINT64:
+			zbx_snprintf_alloc(&data->buf, &data->buf_alloc, &data->buf_offset, ZBX_FS_UI64 ",0,''),",
+					h->value.ui64);
+			break;
+		case ITEM_VALUE_TYPE_FLOAT:
+			zbx_snprintf_alloc(&data->buf, &data->buf_alloc, &data->buf_offset, "0," ZBX_FS_DBL ",''),",
+					h->value.dbl);
+			break;
+		default:
+			zbx_strcpy_alloc(&data->buf, &data->buf_alloc, &data->buf_offset, "0,0,");
+			clickhouse_values_add_string(data, h->value.str);
+			zbx_strcpy_alloc(&data->buf, &data->buf_alloc, &data->buf_offset, "),");
+	}
+}
+
+/************************************************************************************
+ *                                                                                  *
+ * Function: clickhouse_rowbinary_add_uint                                          *
+ *                                                                                  *
+ * Purpose: appends little endian unsigned integer of the specified size            *
+ *                                                                                  *
+ * Comments: the buffer must have been reserved by the caller                       *
+ *                                                                                  *
+ ************************************************************************************/
+static void	clickhouse_rowbinary_add_uint(zbx_clickhouse_data_t *data, zbx_uint64_t value, int size)
+{
+	unsigned char	*ptr = (unsigned char *)data->buf + data->buf_offset;
+	int		i;
+
+	for (i = 0; i < size; i++)
+	{
+		ptr[i] = (unsigned char)(value & 0xff);
+		value >>= 8;
+	}
+
+	data->buf_offset += size;
+}
+
+/************************************************************************************
+ *                                                                                  *
+ * Function: clickhouse_rowbinary_add                                               *
+ *                                                                                  *
+ * Purpose: appends history value as a RowBinary row                                *
+ *                                                                                  *
+ * Comments: the row layout is (day Date, itemid UInt64, clock DateTime, ns UInt32, *
+ *           value Int64, value_dbl Float64, value_str String)                      *
+ *                                                                                  *
+ ************************************************************************************/
+static void	clickhouse_rowbinary_add(zbx_clickhouse_data_t *data, const ZBX_DC_HISTORY *h)
+{
+	zbx_uint64_t	value = 0, value_dbl = 0;
+	const char	*str = "";
+	size_t		len = 0, size;
+
+	switch (h->value_type)
+	{
+		case ITEM_VALUE_TYPE_UINT64:
+			value = h->value.ui64;
+			break;
+		case ITEM_VALUE_TYPE_FLOAT:
+			/* Float64 is sent as its IEEE 754 bits */
+			memcpy(&value_dbl, &h->value.dbl, sizeof(value_dbl));
+			break;
+		default:
+			str = h->value.str;
+			len = strlen(str);
+	}
+
+	/* the length prefix takes up to 10 bytes, one of them is counted in the fixed size */
+	size = ZBX_CLICKHOUSE_ROW_FIXED_SIZE + 9 + len;
+
+	if (data->buf_alloc - data->buf_offset < size)
+	{
+		while (data->buf_alloc - data->buf_offset < size)
+			data->buf_alloc *= 2;
+
+		data->buf = (char *)zbx_realloc(data->buf, data->buf_alloc);
+	}
+
+	clickhouse_rowbinary_add_uint(data, (zbx_uint64_t)(h->ts.sec / SEC_PER_DAY), 2);
+	clickhouse_rowbinary_add_uint(data, h->itemid, 8);
+	clickhouse_rowbinary_add_uint(data, (zbx_uint64_t)h->ts.sec, 4);
+	clickhouse_rowbinary_add_uint(data, (zbx_uint64_t)h->ts.ns, 4);
+	clickhouse_rowbinary_add_uint(data, value, 8);
+	clickhouse_rowbinary_add_uint(data, value_dbl, 8);
+
+	/* String is prefixed by its length in unsigned LEB128 */
+	do
+	{
+		unsigned char	byte = len & 0x7f;
+
+		if (0 != (len >>= 7))
+			byte |= 0x80;
+
+		data->buf[data->buf_offset++] = (char)byte;
+	}
+	while (0 != len);
+
+	len = strlen(str);
+	memcpy(data->buf + data->buf_offset, str, len);
+	data->buf_offset += len;
+}
+
 /************************************************************************************
  *                                                                                  *
  * Function: clickhouse_add_values                                                     *
@@ -650,24 +891,44 @@ out:
  * Parameters:  hist    - [IN] the history storage interface                        *
  *              history - [IN] the history data vector (may have mixed value types) *
  *                                                                                  *
+ * Comments: RowBinary rows are written to the buffer reserved for the whole batch, *
+ *           the buffer is reused by the following batches                          *
+ *                                                                                  *
  ************************************************************************************/
 static int	clickhouse_add_values(zbx_history_iface_t *hist, const zbx_vector_ptr_t *history)
 {
 	const char	*__function_name = "clickhouse_add_values";
 
-	char *tmp_buffer=NULL;	
-	size_t tmp_alloc=0, tmp_offset=0;
-
 	zbx_clickhouse_data_t	*data = hist->data;
 	int			i, num = 0;
+	size_t			reserve;
 	ZBX_DC_HISTORY		*h;
 
-	size_t			buf_alloc = 0, buf_offset = 0;
-
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
-	
 
-	zbx_snprintf_alloc(&tmp_buffer,&tmp_alloc,&tmp_offset,"INSERT INTO %s VALUES ", CONFIG_HISTORY_STORAGE_TABLE_NAME );
+	data->buf_offset = 0;
+
+	if (ZBX_CLICKHOUSE_FORMAT_VALUES == data->format)
+	{
+		zbx_snprintf_alloc(&data->buf, &data->buf_alloc, &data->buf_offset, "INSERT INTO %s VALUES ",
+				CONFIG_HISTORY_STORAGE_TABLE_NAME);
+	}
+	else
+	{
+		/* string values are not known in advance, so only the fixed part of the rows is reserved */
+		reserve = history->values_num * ZBX_CLICKHOUSE_ROW_FIXED_SIZE;
+
+		if (data->buf_alloc < reserve)
+		{
+			data->buf_alloc = reserve;
+			data->buf = (char *)zbx_realloc(data->buf, data->buf_alloc);
+		}
+		else if (NULL == data->buf)
+		{
+			data->buf_alloc = ZBX_KIBIBYTE;
+			data->buf = (char *)zbx_malloc(NULL, data->buf_alloc);
+		}
+	}
 
 	for (i = 0; i < history->values_num; i++)
 	{
@@ -676,47 +937,34 @@ static int	clickhouse_add_values(zbx_history_iface_t *hist, const zbx_vector_ptr
 		if (hist->value_type != h->value_type)
 			continue;
 
-		
-		 if (ITEM_VALUE_TYPE_UINT64 == h->value_type) {
-		    //zabbix_log(LOG_LEVEL_DEBUG, "Parsing value as UIN64 type");
-		    zbx_snprintf_alloc(&tmp_buffer,&tmp_alloc,&tmp_offset,"(CAST(%d as date) ,%ld,%d,%d,%ld,0,''),",
-					h->ts.sec,h->itemid,h->ts.sec,h->ts.ns,h->value.ui64);
-		}
-
-		 if (ITEM_VALUE_TYPE_FLOAT == h->value_type) {
-		    //zabbix_log(LOG_LEVEL_DEBUG, "Parsing value as float type");
-		    zbx_snprintf_alloc(&tmp_buffer,&tmp_alloc,&tmp_offset,"(CAST(%d as date) ,%ld,%d,%d,0,%f,''),",
-					h->ts.sec,h->itemid,h->ts.sec,h->ts.ns,h->value.dbl);
-		}
-
-		 if (ITEM_VALUE_TYPE_STR == h->value_type || 
-		 	 ITEM_VALUE_TYPE_TEXT == h->value_type ) {
-		    //zabbix_log(LOG_LEVEL_DEBUG, "Parsing value as string or text type");
-		    zbx_snprintf_alloc(&tmp_buffer,&tmp_alloc,&tmp_offset,"(CAST(%d as date) ,%ld,%d,%d,0,0,'%s'),",
-					h->ts.sec,h->itemid,h->ts.sec,h->ts.ns,h->value.str);
-		}
-
+		/* log values are not stored in clickhouse */
 		if (ITEM_VALUE_TYPE_LOG == h->value_type)
-		{
-			const zbx_log_value_t	*log;
-			log = h->value.log;
-		}
+			continue;
+
+		if (ZBX_CLICKHOUSE_FORMAT_VALUES == data->format)
+			clickhouse_values_add(data, h);
+		else
+			clickhouse_rowbinary_add(data, h);
 
 		num++;
 	}
 
 	if (num > 0)
-	{ 
-		zbx_snprintf_alloc(&data->buf, &buf_alloc, &buf_offset, "%s\n", tmp_buffer);
-		zabbix_log(LOG_LEVEL_DEBUG, "will insert to clickhouse: %s",data->buf);
-	
-		//data->post_url = zbx_dsprintf(NULL, "%s", data->base_url);
-		clickhouse_writer_add_iface(hist);
+	{
+		if (ZBX_CLICKHOUSE_FORMAT_VALUES == data->format)
+		{
+			zbx_chrcpy_alloc(&data->buf, &data->buf_alloc, &data->buf_offset, '\n');
+			zabbix_log(LOG_LEVEL_DEBUG, "will insert to clickhouse: %s", data->buf);
+		}
+		else
+		{
+			zabbix_log(LOG_LEVEL_DEBUG, "will insert %d values to clickhouse in " ZBX_FS_SIZE_T " bytes",
+					num, (zbx_fs_size_t)data->buf_offset);
+		}
 	}
 
-	zbx_free(tmp_buffer);
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
-	
+
 	return num;
 }
 
@@ -728,15 +976,14 @@ static int	clickhouse_add_values(zbx_history_iface_t *hist, const zbx_vector_ptr
  *                                                                                  *
  * Parameters:  hist    - [IN] the history storage interface                        *
  *                                                                                  *
- * Comments: This function will try to flush the data until it succeeds or          *
- *           unrecoverable error occurs                                             *
+ * Comments: The data is handed over to the history writer process, which keeps   *
+ *           retrying and spools it to disk while clickhouse is not available.      *
+ *           See clickhouse_writer_send() for the writer not being available.       *
  *                                                                                  *
  ************************************************************************************/
 static int	clickhouse_flush(zbx_history_iface_t *hist)
 {
-	ZBX_UNUSED(hist);
-
-	return clickhouse_writer_flush();
+	return clickhouse_writer_send((zbx_clickhouse_data_t *)hist->data);
 }
 
 /************************************************************************************
@@ -756,6 +1003,21 @@ static int	clickhouse_flush(zbx_history_iface_t *hist)
 int	zbx_history_clickhouse_init(zbx_history_iface_t *hist, unsigned char value_type, char **error)
 {
 	zbx_clickhouse_data_t	*data;
+	int			format;
+
+	if (NULL == CONFIG_HISTORY_STORAGE_FORMAT || 0 == strcmp(CONFIG_HISTORY_STORAGE_FORMAT, "values"))
+	{
+		format = ZBX_CLICKHOUSE_FORMAT_VALUES;
+	}
+	else if (0 == strcmp(CONFIG_HISTORY_STORAGE_FORMAT, "rowbinary"))
+	{
+		format = ZBX_CLICKHOUSE_FORMAT_ROWBINARY;
+	}
+	else
+	{
+		*error = zbx_dsprintf(*error, "invalid HistoryStorageFormat \"%s\"", CONFIG_HISTORY_STORAGE_FORMAT);
+		return FAIL;
+	}
 
 	if (0 != curl_global_init(CURL_GLOBAL_ALL))
 	{
@@ -763,13 +1025,17 @@ int	zbx_history_clickhouse_init(zbx_history_iface_t *hist, unsigned char value_t
 		return FAIL;
 	}
 
+	/* the batches of all value types wait in one queue, so it is created with the first interface */
+	if (NULL == pending_batches.mem_free_func)
+		zbx_vector_ptr_create(&pending_batches);
+
 	data = zbx_malloc(NULL, sizeof(zbx_clickhouse_data_t));
 	memset(data, 0, sizeof(zbx_clickhouse_data_t));
 	data->base_url = zbx_strdup(NULL, CONFIG_HISTORY_STORAGE_URL);
 	zbx_rtrim(data->base_url, "/");
 	data->buf = NULL;
-	//data->post_url = NULL;
 	data->handle = NULL;
+	data->format = format;
 
 	hist->value_type = value_type;
 	hist->data = data;
@@ -777,6 +1043,7 @@ int	zbx_history_clickhouse_init(zbx_history_iface_t *hist, unsigned char value_t
 	hist->add_values = clickhouse_add_values;
 	hist->flush = clickhouse_flush;
 	hist->get_values = clickhouse_get_values;
+	hist->get_values_multi = NULL;
 	hist->requires_trends = 0;
 
 	return SUCCEED;
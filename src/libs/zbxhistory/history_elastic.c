@@ -42,10 +42,12 @@ extern int	CONFIG_HISTORY_STORAGE_PIPELINES;
 
 typedef struct
 {
-	char	*base_url;
-	char	*post_url;
-	char	*buf;
-	CURL	*handle;
+	char		*base_url;
+	char		*post_url;
+	char		*buf;
+	size_t		buf_size;
+	unsigned char	deflated;	/* buf holds the compressed bulk request */
+	CURL		*handle;
 }
 zbx_elastic_data_t;
 
@@ -229,13 +231,14 @@ static void	elastic_close(zbx_history_iface_t *hist)
 
 	zbx_free(data->buf);
 	zbx_free(data->post_url);
+	data->deflated = 0;
 
 	if (NULL != data->handle)
 	{
 		if (NULL != writer.handle)
 			curl_multi_remove_handle(writer.handle, data->handle);
 
-		curl_easy_cleanup(data->handle);
+		zbx_history_curl_release(data->handle);
 		data->handle = NULL;
 	}
 }
@@ -334,7 +337,8 @@ static void	elastic_writer_init(void)
 
 	zbx_vector_ptr_create(&writer.ifaces);
 
-	if (NULL == (writer.handle = curl_multi_init()))
+	/* the multi handle is kept between the batches, so are its connections */
+	if (NULL == writer.handle && NULL == (writer.handle = curl_multi_init()))
 	{
 		zbx_error("Cannot initialize cURL multi session");
 		exit(EXIT_FAILURE);
@@ -358,9 +362,6 @@ static void	elastic_writer_release(void)
 	for (i = 0; i < writer.ifaces.values_num; i++)
 		elastic_close((zbx_history_iface_t *)writer.ifaces.values[i]);
 
-	curl_multi_cleanup(writer.handle);
-	writer.handle = NULL;
-
 	zbx_vector_ptr_destroy(&writer.ifaces);
 
 	writer.initialized = 0;
@@ -378,17 +379,33 @@ static void	elastic_writer_release(void)
 static void	elastic_writer_add_iface(zbx_history_iface_t *hist)
 {
 	zbx_elastic_data_t	*data = (zbx_elastic_data_t *)hist->data;
+	char			*out;
+	size_t			out_size;
 
 	elastic_writer_init();
 
-	if (NULL == (data->handle = curl_easy_init()))
+	if (NULL == (data->handle = zbx_history_curl_get()))
 	{
 		zabbix_log(LOG_LEVEL_ERR, "cannot initialize cURL session");
 		return;
 	}
+
+	data->buf_size = strlen(data->buf);
+
+	if (SUCCEED == zbx_history_compress(data->buf, data->buf_size, &out, &out_size))
+	{
+		zabbix_log(LOG_LEVEL_DEBUG, "sending %s", data->buf);
+
+		zbx_free(data->buf);
+		data->buf = out;
+		data->buf_size = out_size;
+		data->deflated = 1;
+	}
+
 	curl_easy_setopt(data->handle, CURLOPT_URL, data->post_url);
 	curl_easy_setopt(data->handle, CURLOPT_POST, 1L);
 	curl_easy_setopt(data->handle, CURLOPT_POSTFIELDS, data->buf);
+	curl_easy_setopt(data->handle, CURLOPT_POSTFIELDSIZE, (long)data->buf_size);
 	curl_easy_setopt(data->handle, CURLOPT_WRITEFUNCTION, curl_write_cb);
 	curl_easy_setopt(data->handle, CURLOPT_WRITEDATA, &page_w[hist->value_type].page);
 	curl_easy_setopt(data->handle, CURLOPT_FAILONERROR, 1L);
@@ -415,7 +432,7 @@ static int	elastic_writer_flush(void)
 {
 	const char		*__function_name = "elastic_writer_flush";
 
-	struct curl_slist	*curl_headers = NULL;
+	struct curl_slist	*curl_headers = NULL, *curl_headers_deflate = NULL;
 	int			i, running, previous, msgnum;
 	CURLMsg			*msg;
 	zbx_vector_ptr_t	retries;
@@ -430,12 +447,20 @@ static int	elastic_writer_flush(void)
 	zbx_vector_ptr_create(&retries);
 
 	curl_headers = curl_slist_append(curl_headers, "Content-Type: application/x-ndjson");
+	curl_headers_deflate = curl_slist_append(curl_headers_deflate, "Content-Type: application/x-ndjson");
+	curl_headers_deflate = curl_slist_append(curl_headers_deflate, ZBX_HISTORY_CONTENT_ENCODING);
 
 	for (i = 0; i < writer.ifaces.values_num; i++)
 	{
 		zbx_history_iface_t	*hist = (zbx_history_iface_t *)writer.ifaces.values[i];
 		zbx_elastic_data_t	*data = (zbx_elastic_data_t *)hist->data;
 
+		if (0 != data->deflated)
+		{
+			(void)curl_easy_setopt(data->handle, CURLOPT_HTTPHEADER, curl_headers_deflate);
+			continue;
+		}
+
 		(void)curl_easy_setopt(data->handle, CURLOPT_HTTPHEADER, curl_headers);
 
 		zabbix_log(LOG_LEVEL_DEBUG, "sending %s", data->buf);
@@ -541,6 +566,7 @@ try_again:
 	}
 
 	curl_slist_free_all(curl_headers);
+	curl_slist_free_all(curl_headers_deflate);
 
 	zbx_vector_ptr_destroy(&retries);
 
@@ -613,7 +639,7 @@ static int	elastic_get_values(zbx_history_iface_t *hist, zbx_uint64_t itemid, in
 
 	ret = FAIL;
 
-	if (NULL == (data->handle = curl_easy_init()))
+	if (NULL == (data->handle = zbx_history_curl_get()))
 	{
 		zabbix_log(LOG_LEVEL_ERR, "cannot initialize cURL session");
 
@@ -949,6 +975,7 @@ int	zbx_history_elastic_init(zbx_history_iface_t *hist, unsigned char value_type
 	hist->add_values = elastic_add_values;
 	hist->flush = elastic_flush;
 	hist->get_values = elastic_get_values;
+	hist->get_values_multi = NULL;
 	hist->requires_trends = 0;
 
 	return SUCCEED;
@@ -0,0 +1,135 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2018 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+
+#include "common.h"
+#include "log.h"
+#include "zbxalgo.h"
+#include "zbxcompress.h"
+#include "zbxhistory.h"
+#include "history.h"
+
+#define ZBX_HISTORY_CURL_POOL_MAX	8	/* the idle handles kept for reuse */
+
+extern int	CONFIG_HISTORY_STORAGE_COMPRESS;
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_history_compress                                             *
+ *                                                                            *
+ * Purpose: compresses request body for HTTP history storage                  *
+ *                                                                            *
+ * Parameters: in       - [IN] the request body                               *
+ *             size_in  - [IN] the request body size                          *
+ *             out      - [OUT] the compressed body                           *
+ *             size_out - [OUT] the compressed body size                      *
+ *                                                                            *
+ * Return value: SUCCEED - the body was compressed, it must be sent with      *
+ *                         ZBX_HISTORY_CONTENT_ENCODING header                *
+ *               FAIL    - the body must be sent as is                        *
+ *                                                                            *
+ * Comments: zlib stream is what HTTP calls deflate. Nothing is compressed    *
+ *           if HistoryStorageCompress is off, zlib support was not compiled  *
+ *           in or the body does not get smaller.                             *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_history_compress(const char *in, size_t size_in, char **out, size_t *size_out)
+{
+	if (0 == CONFIG_HISTORY_STORAGE_COMPRESS)
+		return FAIL;
+
+	if (SUCCEED != zbx_compress(in, size_in, out, size_out))
+		return FAIL;
+
+	if (*size_out >= size_in)
+	{
+		zbx_free(*out);
+		return FAIL;
+	}
+
+	return SUCCEED;
+}
+
+#ifdef HAVE_LIBCURL
+
+static zbx_vector_ptr_t	curl_pool;
+static int		curl_pool_initialized = 0;
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_history_curl_get                                             *
+ *                                                                            *
+ * Purpose: gets curl handle for HTTP history storage request                 *
+ *                                                                            *
+ * Return value: the handle or NULL if it could not be created                *
+ *                                                                            *
+ * Comments: the handles are taken from the process pool when possible. A     *
+ *           reused handle keeps its connections and DNS cache, so requests   *
+ *           made with curl_easy_perform() do not connect again.              *
+ *           The handle must be returned by zbx_history_curl_release().       *
+ *                                                                            *
+ ******************************************************************************/
+CURL	*zbx_history_curl_get(void)
+{
+	CURL	*handle;
+
+	if (0 != curl_pool_initialized && 0 != curl_pool.values_num)
+	{
+		handle = (CURL *)curl_pool.values[curl_pool.values_num - 1];
+		zbx_vector_ptr_remove_noorder(&curl_pool, curl_pool.values_num - 1);
+	}
+	else if (NULL == (handle = curl_easy_init()))
+		return NULL;
+
+#if LIBCURL_VERSION_NUM >= 0x071900
+	/* idle connections are kept between the requests */
+	curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+#endif
+	return handle;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_history_curl_release                                         *
+ *                                                                            *
+ * Purpose: returns curl handle to the process pool                           *
+ *                                                                            *
+ * Comments: the handle must not be attached to a multi handle                *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_history_curl_release(CURL *handle)
+{
+	if (0 == curl_pool_initialized)
+	{
+		zbx_vector_ptr_create(&curl_pool);
+		curl_pool_initialized = 1;
+	}
+
+	if (ZBX_HISTORY_CURL_POOL_MAX <= curl_pool.values_num)
+	{
+		curl_easy_cleanup(handle);
+		return;
+	}
+
+	/* the options are reset, the connections and caches stay */
+	curl_easy_reset(handle);
+	zbx_vector_ptr_append(&curl_pool, handle);
+}
+
+#endif
@@ -650,6 +650,66 @@ static int	sql_get_values(zbx_history_iface_t *hist, zbx_uint64_t itemid, int st
 	return db_read_values_by_time_and_count(itemid, hist->value_type, values, end - start, count, end);
 }
 
+/************************************************************************************
+ *                                                                                  *
+ * Function: sql_get_values_multi                                                   *
+ *                                                                                  *
+ * Purpose: gets history data of several items from history storage                *
+ *                                                                                  *
+ * Parameters:  hist          - [IN] the history storage interface                  *
+ *              itemids       - [IN] the itemids                                    *
+ *              itemids_num   - [IN] the number of itemids                          *
+ *              start         - [IN] the period start timestamp                     *
+ *              end           - [IN] the period end timestamp                       *
+ *              value_itemids - [OUT] the itemids of the read values                *
+ *              values        - [OUT] the item history data values                  *
+ *                                                                                  *
+ * Return value: SUCCEED - the history data were read successfully                  *
+ *               FAIL - otherwise                                                   *
+ *                                                                                  *
+ * Comments: This function reads all values from ]<start>,<end>] interval with a    *
+ *           single query.                                                          *
+ *                                                                                  *
+ ************************************************************************************/
+static int	sql_get_values_multi(zbx_history_iface_t *hist, const zbx_uint64_t *itemids, int itemids_num,
+		int start, int end, zbx_vector_uint64_t *value_itemids, zbx_vector_history_record_t *values)
+{
+	char			*sql = NULL;
+	size_t	 		sql_alloc = 0, sql_offset = 0;
+	DB_RESULT		result;
+	DB_ROW			row;
+	zbx_vc_history_table_t	*table = &vc_history_tables[hist->value_type];
+
+	zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, "select itemid,clock,ns,%s from %s where",
+			table->fields, table->name);
+	DBadd_condition_alloc(&sql, &sql_alloc, &sql_offset, "itemid", itemids, itemids_num);
+	zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, " and clock>%d and clock<=%d", start, end);
+
+	result = DBselect("%s", sql);
+
+	zbx_free(sql);
+
+	if (NULL == result)
+		return FAIL;
+
+	while (NULL != (row = DBfetch(result)))
+	{
+		zbx_uint64_t		itemid;
+		zbx_history_record_t	value;
+
+		ZBX_STR2UINT64(itemid, row[0]);
+		value.timestamp.sec = atoi(row[1]);
+		value.timestamp.ns = atoi(row[2]);
+		table->rtov(&value.value, row + 3);
+
+		zbx_vector_uint64_append(value_itemids, itemid);
+		zbx_vector_history_record_append_ptr(values, &value);
+	}
+	DBfree_result(result);
+
+	return SUCCEED;
+}
+
 /************************************************************************************
  *                                                                                  *
  * Function: sql_add_values                                                         *
@@ -724,6 +784,7 @@ int	zbx_history_sql_init(zbx_history_iface_t *hist, unsigned char value_type, ch
 	hist->add_values = sql_add_values;
 	hist->flush = sql_flush;
 	hist->get_values = sql_get_values;
+	hist->get_values_multi = sql_get_values_multi;
 
 	switch (value_type)
 	{
@@ -0,0 +1,744 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2018 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "common.h"
+#include "comms.h"
+#include "log.h"
+#include "zbxalgo.h"
+
+#include "icmpengine.h"
+
+extern char	*CONFIG_SOURCE_IP;
+extern int	CONFIG_ICMP_PING_RATE;
+
+#define ZBX_ICMP_ECHO_REPLY		0
+#define ZBX_ICMP_ECHO_REQUEST		8
+#define ZBX_ICMP6_ECHO_REQUEST		128
+#define ZBX_ICMP6_ECHO_REPLY		129
+
+/* fping defaults for the item key parameters that are not set */
+#define ZBX_ICMP_DEFAULT_INTERVAL	1000
+#define ZBX_ICMP_DEFAULT_SIZE		56
+#define ZBX_ICMP_DEFAULT_TIMEOUT	500
+
+#define ZBX_ICMP_RCVBUF_SIZE		(4 * ZBX_MEBIBYTE)
+#define ZBX_ICMP_PACKET_SIZE		(64 * ZBX_KIBIBYTE + 128)
+
+typedef struct
+{
+	unsigned char	type;
+	unsigned char	code;
+	unsigned short	checksum;
+	unsigned short	id;
+	unsigned short	seq;
+}
+zbx_icmp_echo_t;
+
+typedef struct
+{
+	int		fd;
+	int		family;
+	/* raw IPv4 sockets return replies with the IP header */
+	int		ip_header;
+	/* datagram sockets get the identifier assigned by the kernel */
+	unsigned short	id;
+}
+zbx_icmp_socket_t;
+
+typedef struct
+{
+	ZBX_FPING_HOST		*host;
+	zbx_icmp_socket_t	*sock;
+	ZBX_SOCKADDR		addr;
+	socklen_t		addrlen;
+	double			next_send;
+}
+zbx_icmp_target_t;
+
+/* echo request waiting for the reply, the probeid is echoed back in the payload */
+typedef struct
+{
+	zbx_uint64_t	probeid;
+	int		target;
+	unsigned short	seq;
+	double		sent;
+}
+zbx_icmp_probe_t;
+
+static zbx_icmp_socket_t	icmp_sock4 = {-1};
+#ifdef HAVE_IPV6
+static zbx_icmp_socket_t	icmp_sock6 = {-1};
+#endif
+
+static zbx_hashset_t		icmp_probes;
+static zbx_uint64_t		icmp_next_probeid = 1, icmp_expire_probeid = 1;
+
+static zbx_icmp_target_t	*icmp_targets = NULL;
+static int			icmp_targets_alloc = 0;
+
+static unsigned char		icmp_packet[ZBX_ICMP_PACKET_SIZE];
+
+/******************************************************************************
+ *                                                                            *
+ * Function: icmp_checksum                                                    *
+ *                                                                            *
+ * Purpose: calculate the internet checksum of an ICMP packet                 *
+ *                                                                            *
+ * Return value: checksum in network byte order                               *
+ *                                                                            *
+ ******************************************************************************/
+static unsigned short	icmp_checksum(const unsigned char *buf, size_t len)
+{
+	unsigned int	sum = 0;
+
+	for (; 1 < len; len -= 2, buf += 2)
+		sum += (unsigned int)buf[0] << 8 | buf[1];
+
+	if (1 == len)
+		sum += (unsigned int)buf[0] << 8;
+
+	while (0 != (sum >> 16))
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return htons((unsigned short)~sum);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: icmp_socket_bind                                                 *
+ *                                                                            *
+ * Purpose: bind ICMP socket to the source address                            *
+ *                                                                            *
+ * Parameters: sock     - [IN] the socket                                     *
+ *             wildcard - [IN] bind to the wildcard address if SourceIP is    *
+ *                             not set or belongs to other address family     *
+ *                                                                            *
+ * Return value: SUCCEED - the socket was bound or did not need binding       *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ ******************************************************************************/
+static int	icmp_socket_bind(zbx_icmp_socket_t *sock, int wildcard)
+{
+	ZBX_SOCKADDR	addr;
+	socklen_t	addrlen;
+
+	memset(&addr, 0, sizeof(addr));
+
+	if (AF_INET == sock->family)
+	{
+		struct sockaddr_in	*in = (struct sockaddr_in *)&addr;
+
+		in->sin_family = AF_INET;
+		in->sin_addr.s_addr = htonl(INADDR_ANY);
+
+		if (NULL != CONFIG_SOURCE_IP && SUCCEED == is_ip4(CONFIG_SOURCE_IP))
+			in->sin_addr.s_addr = inet_addr(CONFIG_SOURCE_IP);
+		else if (0 == wildcard)
+			return SUCCEED;
+
+		addrlen = sizeof(struct sockaddr_in);
+	}
+#ifdef HAVE_IPV6
+	else
+	{
+		struct sockaddr_in6	*in6 = (struct sockaddr_in6 *)&addr;
+
+		in6->sin6_family = AF_INET6;
+		in6->sin6_addr = in6addr_any;
+
+		if (NULL != CONFIG_SOURCE_IP && SUCCEED == is_ip6(CONFIG_SOURCE_IP))
+			inet_pton(AF_INET6, CONFIG_SOURCE_IP, &in6->sin6_addr);
+		else if (0 == wildcard)
+			return SUCCEED;
+
+		addrlen = sizeof(struct sockaddr_in6);
+	}
+#endif
+	if (0 != bind(sock->fd, (struct sockaddr *)&addr, addrlen))
+		return FAIL;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: icmp_socket_open                                                 *
+ *                                                                            *
+ * Purpose: open ICMP socket of the specified address family                  *
+ *                                                                            *
+ * Parameters: sock   - [OUT] the socket                                      *
+ *             family - [IN] AF_INET or AF_INET6                              *
+ *                                                                            *
+ * Return value: SUCCEED - the socket was opened                              *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ * Comments: raw socket requires CAP_NET_RAW, without it unprivileged ICMP    *
+ *           datagram socket is used where the system permits it (Linux       *
+ *           net.ipv4.ping_group_range, macOS)                                *
+ *                                                                            *
+ ******************************************************************************/
+static int	icmp_socket_open(zbx_icmp_socket_t *sock, int family)
+{
+	const char	*__function_name = "icmp_socket_open";
+
+	int		protocol, rcvbuf = ZBX_ICMP_RCVBUF_SIZE, ret = FAIL;
+	ZBX_SOCKADDR	addr;
+	socklen_t	addrlen = sizeof(addr);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() family:%d", __function_name, family);
+
+#ifdef HAVE_IPV6
+	protocol = (AF_INET == family ? IPPROTO_ICMP : IPPROTO_ICMPV6);
+#else
+	protocol = IPPROTO_ICMP;
+#endif
+	sock->family = family;
+
+	if (-1 != (sock->fd = socket(family, SOCK_RAW, protocol)))
+	{
+		sock->ip_header = (AF_INET == family);
+		sock->id = (unsigned short)(getpid() & 0xffff);
+
+		if (SUCCEED != icmp_socket_bind(sock, 0))
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot bind ICMP socket to \"%s\": %s", CONFIG_SOURCE_IP,
+					zbx_strerror(errno));
+			goto out;
+		}
+	}
+	else if (-1 != (sock->fd = socket(family, SOCK_DGRAM, protocol)))
+	{
+		sock->ip_header = 0;
+
+		if (SUCCEED != icmp_socket_bind(sock, 1) ||
+				0 != getsockname(sock->fd, (struct sockaddr *)&addr, &addrlen))
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot bind ICMP socket: %s", zbx_strerror(errno));
+			goto out;
+		}
+
+#ifdef HAVE_IPV6
+		if (AF_INET6 == family)
+			sock->id = ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
+		else
+#endif
+			sock->id = ntohs(((struct sockaddr_in *)&addr)->sin_port);
+	}
+	else
+	{
+		zabbix_log(LOG_LEVEL_DEBUG, "cannot open ICMP socket: %s", zbx_strerror(errno));
+		goto out;
+	}
+
+	if (-1 == fcntl(sock->fd, F_SETFL, fcntl(sock->fd, F_GETFL) | O_NONBLOCK))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot set ICMP socket to non-blocking mode: %s", zbx_strerror(errno));
+		goto out;
+	}
+
+	/* replies of a large host group arrive in bursts */
+	if (0 != setsockopt(sock->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)))
+		zabbix_log(LOG_LEVEL_DEBUG, "cannot set ICMP socket receive buffer: %s", zbx_strerror(errno));
+
+	ret = SUCCEED;
+out:
+	if (SUCCEED != ret && -1 != sock->fd)
+	{
+		close(sock->fd);
+		sock->fd = -1;
+	}
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s fd:%d id:%hu", __function_name, zbx_result_string(ret),
+			sock->fd, sock->id);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: icmp_engine_init                                                 *
+ *                                                                            *
+ * Purpose: open the engine sockets on the first use                          *
+ *                                                                            *
+ * Return value: SUCCEED - at least one socket is available                   *
+ *               FAIL    - ICMP sockets cannot be opened by this process      *
+ *                                                                            *
+ ******************************************************************************/
+static int	icmp_engine_init(void)
+{
+	static int	initialized = 0, ret = FAIL;
+
+	if (0 != initialized)
+		return ret;
+
+	initialized = 1;
+
+	if (SUCCEED == icmp_socket_open(&icmp_sock4, AF_INET))
+		ret = SUCCEED;
+#ifdef HAVE_IPV6
+	if (SUCCEED == icmp_socket_open(&icmp_sock6, AF_INET6))
+		ret = SUCCEED;
+#endif
+	zbx_hashset_create(&icmp_probes, 1000, ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: icmp_target_resolve                                              *
+ *                                                                            *
+ * Purpose: resolve host address and pick the socket to ping it through       *
+ *                                                                            *
+ * Return value: SUCCEED - the host can be pinged                             *
+ *               FAIL    - the address cannot be resolved or there is no      *
+ *                         socket of its address family                       *
+ *                                                                            *
+ ******************************************************************************/
+static int	icmp_target_resolve(zbx_icmp_target_t *target, const char *addr)
+{
+#ifdef HAVE_IPV6
+	struct addrinfo	hints, *ai = NULL, *current;
+	int		ret = FAIL;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = PF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	if (0 != getaddrinfo(addr, NULL, &hints, &ai))
+		return FAIL;
+
+	for (current = ai; NULL != current; current = current->ai_next)
+	{
+		if (AF_INET == current->ai_family && -1 != icmp_sock4.fd)
+			target->sock = &icmp_sock4;
+		else if (AF_INET6 == current->ai_family && -1 != icmp_sock6.fd)
+			target->sock = &icmp_sock6;
+		else
+			continue;
+
+		memcpy(&target->addr, current->ai_addr, current->ai_addrlen);
+		target->addrlen = current->ai_addrlen;
+		ret = SUCCEED;
+		break;
+	}
+
+	freeaddrinfo(ai);
+
+	return ret;
+#else
+	struct sockaddr_in	*in = (struct sockaddr_in *)&target->addr;
+	struct hostent		*hp;
+
+	if (-1 == icmp_sock4.fd)
+		return FAIL;
+
+	memset(in, 0, sizeof(struct sockaddr_in));
+	in->sin_family = AF_INET;
+
+	if (SUCCEED == is_ip4(addr))
+	{
+		in->sin_addr.s_addr = inet_addr(addr);
+	}
+	else
+	{
+		if (NULL == (hp = gethostbyname(addr)))
+			return FAIL;
+
+		in->sin_addr = *(struct in_addr *)hp->h_addr;
+	}
+
+	target->sock = &icmp_sock4;
+	target->addrlen = sizeof(struct sockaddr_in);
+
+	return SUCCEED;
+#endif
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: icmp_target_match                                                *
+ *                                                                            *
+ * Purpose: check if the reply came from the pinged address                   *
+ *                                                                            *
+ * Comments: replies from other addresses (broadcast pings) are ignored the   *
+ *           same way as fping '[<- addr]' responses were                     *
+ *                                                                            *
+ ******************************************************************************/
+static int	icmp_target_match(const zbx_icmp_target_t *target, const ZBX_SOCKADDR *from)
+{
+#ifdef HAVE_IPV6
+	if (AF_INET6 == target->sock->family)
+	{
+		if (0 != memcmp(&((const struct sockaddr_in6 *)from)->sin6_addr,
+				&((const struct sockaddr_in6 *)&target->addr)->sin6_addr, sizeof(struct in6_addr)))
+		{
+			return FAIL;
+		}
+
+		return SUCCEED;
+	}
+#endif
+	if (((const struct sockaddr_in *)from)->sin_addr.s_addr !=
+			((const struct sockaddr_in *)&target->addr)->sin_addr.s_addr)
+	{
+		return FAIL;
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: icmp_send                                                        *
+ *                                                                            *
+ * Purpose: send echo request to the target                                   *
+ *                                                                            *
+ * Parameters: target  - [IN] the target                                      *
+ *             index   - [IN] the target index                                *
+ *             size    - [IN] the payload size                                *
+ *             now     - [IN] the current time                                *
+ *                                                                            *
+ * Return value: SUCCEED - the request was sent and is waiting for reply      *
+ *               FAIL    - sendto() failed, errno is set                      *
+ *                                                                            *
+ ******************************************************************************/
+static int	icmp_send(zbx_icmp_target_t *target, int index, int size, double now)
+{
+	zbx_icmp_echo_t		echo;
+	zbx_icmp_probe_t	probe_local;
+
+	probe_local.probeid = icmp_next_probeid;
+	probe_local.target = index;
+	probe_local.seq = (unsigned short)(icmp_next_probeid & 0xffff);
+	probe_local.sent = now;
+
+	memset(&echo, 0, sizeof(echo));
+	echo.id = htons(target->sock->id);
+	echo.seq = htons(probe_local.seq);
+
+#ifdef HAVE_IPV6
+	if (AF_INET6 == target->sock->family)
+	{
+		/* the kernel calculates ICMPv6 checksum over the pseudo-header */
+		echo.type = ZBX_ICMP6_ECHO_REQUEST;
+		memcpy(icmp_packet, &echo, sizeof(echo));
+		memcpy(icmp_packet + sizeof(echo), &probe_local.probeid, sizeof(probe_local.probeid));
+	}
+	else
+#endif
+	{
+		echo.type = ZBX_ICMP_ECHO_REQUEST;
+		memcpy(icmp_packet, &echo, sizeof(echo));
+		memcpy(icmp_packet + sizeof(echo), &probe_local.probeid, sizeof(probe_local.probeid));
+		echo.checksum = icmp_checksum(icmp_packet, sizeof(echo) + size);
+		memcpy(icmp_packet, &echo, sizeof(echo));
+	}
+
+	if (-1 == sendto(target->sock->fd, icmp_packet, sizeof(echo) + size, 0, (struct sockaddr *)&target->addr,
+			target->addrlen))
+	{
+		return FAIL;
+	}
+
+	zbx_hashset_insert(&icmp_probes, &probe_local, sizeof(probe_local));
+	icmp_next_probeid++;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: icmp_receive                                                     *
+ *                                                                            *
+ * Purpose: read all pending replies from the socket and update host          *
+ *          statistics                                                        *
+ *                                                                            *
+ ******************************************************************************/
+static void	icmp_receive(zbx_icmp_socket_t *sock)
+{
+	unsigned char		buf[ZBX_KIBIBYTE];
+	ZBX_SOCKADDR		from;
+	socklen_t		fromlen;
+	ssize_t			n;
+	size_t			offset;
+	zbx_icmp_echo_t		echo;
+	zbx_uint64_t		probeid;
+	zbx_icmp_probe_t	*probe;
+	ZBX_FPING_HOST		*host;
+	unsigned char		reply_type;
+	double			sec;
+
+#ifdef HAVE_IPV6
+	reply_type = (AF_INET == sock->family ? ZBX_ICMP_ECHO_REPLY : ZBX_ICMP6_ECHO_REPLY);
+#else
+	reply_type = ZBX_ICMP_ECHO_REPLY;
+#endif
+
+	for (;;)
+	{
+		fromlen = sizeof(from);
+
+		/* only the headers and probeid are needed, the rest of datagram is discarded */
+		if (-1 == (n = recvfrom(sock->fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &fromlen)))
+		{
+			if (EINTR == errno)
+				continue;
+
+			break;
+		}
+
+		offset = (0 != sock->ip_header && 0 < n ? (size_t)(buf[0] & 0x0f) * 4 : 0);
+
+		if ((size_t)n < offset + sizeof(echo) + sizeof(probeid))
+			continue;
+
+		memcpy(&echo, buf + offset, sizeof(echo));
+
+		if (reply_type != echo.type || sock->id != ntohs(echo.id))
+			continue;
+
+		memcpy(&probeid, buf + offset + sizeof(echo), sizeof(probeid));
+
+		/* late, duplicate and foreign replies have no pending probe */
+		if (NULL == (probe = (zbx_icmp_probe_t *)zbx_hashset_search(&icmp_probes, &probeid)))
+			continue;
+
+		if (probe->seq != ntohs(echo.seq) || SUCCEED != icmp_target_match(&icmp_targets[probe->target], &from))
+			continue;
+
+		sec = zbx_time() - probe->sent;
+		host = icmp_targets[probe->target].host;
+
+		if (0 == host->rcv || host->min > sec)
+			host->min = sec;
+		if (0 == host->rcv || host->max < sec)
+			host->max = sec;
+		host->sum += sec;
+		host->rcv++;
+
+		zbx_hashset_remove_direct(&icmp_probes, probe);
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: icmp_expire                                                      *
+ *                                                                            *
+ * Purpose: drop probes that did not get reply in time                        *
+ *                                                                            *
+ * Return value: the time when the oldest pending probe expires or 0 if there *
+ *               are no pending probes                                        *
+ *                                                                            *
+ * Comments: probes are sent in probeid order with the same timeout, so the   *
+ *           expired ones are always at the start of the probeid range        *
+ *                                                                            *
+ ******************************************************************************/
+static double	icmp_expire(double now, double timeout)
+{
+	zbx_icmp_probe_t	*probe;
+
+	for (; icmp_expire_probeid < icmp_next_probeid; icmp_expire_probeid++)
+	{
+		if (NULL == (probe = (zbx_icmp_probe_t *)zbx_hashset_search(&icmp_probes, &icmp_expire_probeid)))
+			continue;
+
+		if (probe->sent + timeout > now)
+			return probe->sent + timeout;
+
+		zbx_hashset_remove_direct(&icmp_probes, probe);
+	}
+
+	return 0;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: icmp_engine_ping                                                 *
+ *                                                                            *
+ * Purpose: ping hosts through in-process ICMP sockets                        *
+ *                                                                            *
+ * Parameters: hosts         - [IN/OUT] hosts to ping and their statistics    *
+ *             hosts_count   - [IN] the number of hosts                       *
+ *             count         - [IN] the number of requests per host           *
+ *             interval      - [IN] interval between requests to the same     *
+ *                                  host in milliseconds, 0 - default         *
+ *             size          - [IN] payload size, 0 - default                 *
+ *             timeout       - [IN] reply timeout in milliseconds, 0 -        *
+ *                                  default                                   *
+ *             error         - [OUT] the error message                        *
+ *             max_error_len - [IN] the error message buffer size             *
+ *                                                                            *
+ * Return value: SUCCEED      - the hosts were pinged                         *
+ *               NOTSUPPORTED - the ping failed                               *
+ *               FAIL         - ICMP sockets are not available for this       *
+ *                              process, external utilities must be used      *
+ *                                                                            *
+ * Comments: requests are sent round-robin over the hosts like fping does,    *
+ *           paced to IcmpPingRate packets per second in total, replies are   *
+ *           matched to requests by id/seq and the probeid carried in the     *
+ *           payload                                                          *
+ *                                                                            *
+ ******************************************************************************/
+int	icmp_engine_ping(ZBX_FPING_HOST *hosts, int hosts_count, int count, int interval, int size, int timeout,
+		char *error, int max_error_len)
+{
+	const char		*__function_name = "icmp_engine_ping";
+
+	int			i, pos, total, sent = 0, failed = 0, fd_max;
+	double			start, now, wait_until, expire_at, timeout_sec;
+	zbx_icmp_target_t	*target;
+	fd_set			fds;
+	struct timeval		tv;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() hosts_count:%d", __function_name, hosts_count);
+
+	if (SUCCEED != icmp_engine_init())
+		return FAIL;
+
+	if (0 == interval)
+		interval = ZBX_ICMP_DEFAULT_INTERVAL;
+	if (0 >= size)
+		size = ZBX_ICMP_DEFAULT_SIZE;
+	if (0 == timeout)
+		timeout = ZBX_ICMP_DEFAULT_TIMEOUT;
+
+	/* the payload carries probeid */
+	size = MIN(MAX(size, (int)sizeof(zbx_uint64_t)), ZBX_ICMP_PACKET_SIZE - (int)sizeof(zbx_icmp_echo_t));
+	timeout_sec = timeout / 1000.0;
+
+	if (icmp_targets_alloc < hosts_count)
+	{
+		icmp_targets_alloc = hosts_count;
+		icmp_targets = (zbx_icmp_target_t *)zbx_realloc(icmp_targets,
+				sizeof(zbx_icmp_target_t) * icmp_targets_alloc);
+	}
+
+	for (i = 0; i < hosts_count; i++)
+	{
+		target = &icmp_targets[i];
+		target->host = &hosts[i];
+		target->next_send = 0;
+
+		if (SUCCEED != icmp_target_resolve(target, hosts[i].addr))
+		{
+			zabbix_log(LOG_LEVEL_DEBUG, "%s() cannot resolve \"%s\"", __function_name, hosts[i].addr);
+			target->sock = NULL;
+			continue;
+		}
+
+		hosts[i].cnt = count;
+	}
+
+	icmp_expire_probeid = icmp_next_probeid;
+	total = count * hosts_count;
+	start = zbx_time();
+
+	for (pos = 0;;)
+	{
+		now = zbx_time();
+		wait_until = now + 1;
+
+		for (; pos < total; pos++)
+		{
+			target = &icmp_targets[pos % hosts_count];
+
+			if (NULL == target->sock)
+				continue;
+
+			if (target->next_send > now)
+			{
+				wait_until = MIN(wait_until, target->next_send);
+				break;
+			}
+
+			if (sent >= (now - start) * CONFIG_ICMP_PING_RATE + 1)
+			{
+				wait_until = MIN(wait_until, start + (double)sent / CONFIG_ICMP_PING_RATE);
+				break;
+			}
+
+			if (SUCCEED != icmp_send(target, pos % hosts_count, size, now))
+			{
+				if (EAGAIN == errno || EWOULDBLOCK == errno || ENOBUFS == errno || EINTR == errno)
+				{
+					/* socket buffer is full, retry shortly */
+					wait_until = MIN(wait_until, now + 0.001);
+					break;
+				}
+
+				/* the request is counted as lost, like fping does for unreachable networks */
+				if (0 == failed++)
+				{
+					zabbix_log(LOG_LEVEL_DEBUG, "%s() cannot send to \"%s\": %s", __function_name,
+							target->host->addr, zbx_strerror(errno));
+				}
+			}
+
+			sent++;
+			target->next_send = now + interval / 1000.0;
+		}
+
+		if (0 != (expire_at = icmp_expire(now, timeout_sec)))
+			wait_until = MIN(wait_until, expire_at);
+		else if (pos == total)
+			break;
+
+		FD_ZERO(&fds);
+		fd_max = -1;
+
+		if (-1 != icmp_sock4.fd)
+		{
+			FD_SET(icmp_sock4.fd, &fds);
+			fd_max = icmp_sock4.fd;
+		}
+#ifdef HAVE_IPV6
+		if (-1 != icmp_sock6.fd)
+		{
+			FD_SET(icmp_sock6.fd, &fds);
+			fd_max = MAX(fd_max, icmp_sock6.fd);
+		}
+#endif
+		wait_until = MAX(wait_until - now, 0);
+		tv.tv_sec = (long)wait_until;
+		tv.tv_usec = (long)((wait_until - tv.tv_sec) * 1000000);
+
+		if (-1 == select(fd_max + 1, &fds, NULL, NULL, &tv))
+		{
+			if (EINTR == errno)
+				continue;
+
+			zbx_snprintf(error, max_error_len, "cannot wait for ICMP replies: %s", zbx_strerror(errno));
+			zbx_hashset_clear(&icmp_probes);
+			return NOTSUPPORTED;
+		}
+
+		if (-1 != icmp_sock4.fd && FD_ISSET(icmp_sock4.fd, &fds))
+			icmp_receive(&icmp_sock4);
+#ifdef HAVE_IPV6
+		if (-1 != icmp_sock6.fd && FD_ISSET(icmp_sock6.fd, &fds))
+			icmp_receive(&icmp_sock6);
+#endif
+	}
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() sent:%d failed:%d " ZBX_FS_DBL " sec", __function_name, sent,
+			failed, zbx_time() - start);
+
+	return SUCCEED;
+}
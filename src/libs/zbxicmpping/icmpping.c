@@ -22,6 +22,8 @@
 #include "comms.h"
 #include "log.h"
 
+#include "icmpengine.h"
+
 extern char	*CONFIG_SOURCE_IP;
 extern char	*CONFIG_FPING_LOCATION;
 extern char	*CONFIG_NMAP_LOCATION;
@@ -31,6 +33,7 @@ extern char	*CONFIG_NMAP_PARAMS;
 extern char	*CONFIG_FPING6_LOCATION;
 #endif
 extern char	*CONFIG_TMPDIR;
+extern int	CONFIG_ICMP_PING_ENGINE;
 #define MAX_ICMP_NMAP_FIELDS		10
 
 /* old official fping (2.4b2_to_ipv6) did not support source IP address */
@@ -541,20 +544,43 @@ static int	process_ping(ZBX_FPING_HOST *hosts, int hosts_count, int count, int i
  *                                                                            *
  * Author: Alexei Vladishev                                                   *
  *                                                                            *
- * Comments: use external binary 'fping' to avoid superuser privileges        *
+ * Comments: hosts are pinged by the in-process ICMP engine, the external     *
+ *           'fping' binary is used if the engine is disabled or ICMP sockets *
+ *           cannot be opened without superuser privileges                    *
  *                                                                            *
  ******************************************************************************/
 int	do_ping(ZBX_FPING_HOST *hosts, int hosts_count, int count, int interval, int size, int timeout, char *error, int max_error_len)
 {
 	const char	*__function_name = "do_ping";
 
-	int	res;
+	static int	engine_warned = 0;
+	int		res;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s() hosts_count:%d", __function_name, hosts_count);
 
+	if (ZBX_ICMP_PING_ENGINE_NATIVE == CONFIG_ICMP_PING_ENGINE)
+	{
+		if (FAIL != (res = icmp_engine_ping(hosts, hosts_count, count, interval, size, timeout, error,
+				max_error_len)))
+		{
+			if (NOTSUPPORTED == res)
+				zabbix_log(LOG_LEVEL_ERR, "%s", error);
+
+			goto out;
+		}
+
+		if (0 == engine_warned)
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot open ICMP socket, falling back to \"%s\":"
+					" grant the CAP_NET_RAW capability or allow unprivileged ICMP sockets",
+					CONFIG_FPING_LOCATION);
+			engine_warned = 1;
+		}
+	}
+
 	if (NOTSUPPORTED == (res = process_ping(hosts, hosts_count, count, interval, size, timeout, error, max_error_len)))
 		zabbix_log(LOG_LEVEL_ERR, "%s", error);
-
+out:
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(res));
 
 	return res;
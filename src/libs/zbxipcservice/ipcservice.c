@@ -1026,6 +1026,27 @@ static void	ipc_service_timer_cb(evutil_socket_t fd, short what, void *arg)
 	ZBX_UNUSED(arg);
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: ipc_service_wakeup_cb                                            *
+ *                                                                            *
+ * Purpose: wakeup descriptor callback                                        *
+ *                                                                            *
+ * Comments: the descriptor is drained, the event loop returns after the      *
+ *           callback                                                         *
+ *                                                                            *
+ ******************************************************************************/
+static void	ipc_service_wakeup_cb(evutil_socket_t fd, short what, void *arg)
+{
+	char	buffer[64];
+
+	ZBX_UNUSED(what);
+	ZBX_UNUSED(arg);
+
+	while (0 < read(fd, buffer, sizeof(buffer)))
+		;
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: ipc_check_running_service                                        *
@@ -1061,7 +1082,8 @@ static int	ipc_check_running_service(const char *service_name)
  *                                                                            *
  * Parameters: csocket      - [OUT] the IPC socket to the service             *
  *             service_name - [IN] the IPC service name                       *
- *             timeout      - [IN] the connection timeout                     *
+ *             timeout      - [IN] the connection timeout in seconds, 0 - fail *
+ *                                 without retrying                           *
  *             error        - [OUT] the error message                         *
  *                                                                            *
  * Return value: SUCCEED - the socket was successfully opened                 *
@@ -1096,10 +1118,12 @@ int	zbx_ipc_socket_open(zbx_ipc_socket_t *csocket, const char *service_name, int
 
 	while (0 != connect(csocket->fd, (struct sockaddr*)&addr, sizeof(addr)))
 	{
-		if (time(NULL) - start > timeout)
+		if (0 == timeout || time(NULL) - start > timeout)
 		{
 			*error = zbx_dsprintf(*error, "Cannot connect to service \"%s\": %s.", service_name,
 					zbx_strerror(errno));
+			close(csocket->fd);
+			csocket->fd = -1;
 			goto out;
 		}
 
@@ -1491,6 +1515,7 @@ int	zbx_ipc_service_start(zbx_ipc_service_t *service, const char *service_name,
 	event_add(service->ev_listener, NULL);
 
 	service->ev_timer = event_new(service->ev, -1, 0, ipc_service_timer_cb, service);
+	service->ev_wakeup = NULL;
 
 	ret = SUCCEED;
 out:
@@ -1527,6 +1552,9 @@ void	zbx_ipc_service_close(zbx_ipc_service_t *service)
 	zbx_vector_ptr_destroy(&service->clients);
 	zbx_queue_ptr_destroy(&service->clients_recv);
 
+	if (NULL != service->ev_wakeup)
+		event_free(service->ev_wakeup);
+
 	event_free(service->ev_timer);
 	event_free(service->ev_listener);
 	event_base_free(service->ev);
@@ -1534,6 +1562,25 @@ void	zbx_ipc_service_close(zbx_ipc_service_t *service)
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_ipc_service_set_wakeup                                       *
+ *                                                                            *
+ * Purpose: sets descriptor that interrupts waiting for messages              *
+ *                                                                            *
+ * Parameters: service - [IN] the IPC service                                 *
+ *             fd      - [IN] the non-blocking descriptor (pipe read end)     *
+ *                                                                            *
+ * Comments: zbx_ipc_service_recv() returns without message when data is      *
+ *           written to the descriptor. The data is discarded.                *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_ipc_service_set_wakeup(zbx_ipc_service_t *service, int fd)
+{
+	service->ev_wakeup = event_new(service->ev, fd, EV_READ | EV_PERSIST, ipc_service_wakeup_cb, service);
+	event_add(service->ev_wakeup, NULL);
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: zbx_ipc_service_recv                                             *
@@ -1333,6 +1333,58 @@ int	zbx_jsonpath_next(const char *path, const char **pnext, zbx_strloc_t *loc, i
 	return SUCCEED;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: json_path_open_component                                         *
+ *                                                                            *
+ * Purpose: opens json path component in the current object                   *
+ *                                                                            *
+ * Parameters: object - [IN/OUT] the current object                           *
+ *             type   - [IN] the component type, see ZBX_JSONPATH_ defines    *
+ *             index  - [IN] the array index                                  *
+ *             name   - [IN] the member name                                  *
+ *             path   - [IN] the path starting with component (for errors)    *
+ *                                                                            *
+ * Return value: SUCCESS - processed successfully                             *
+ *               FAIL - an error occurred                                     *
+ *                                                                            *
+ ******************************************************************************/
+static int	json_path_open_component(struct zbx_json_parse *object, int type, int index, const char *name,
+		const char *path)
+{
+	const char	*p;
+
+	if (ZBX_JSONPATH_ARRAY_INDEX == type)
+	{
+		if ('[' != *object->start)
+			return FAIL;
+
+		for (p = NULL; NULL != (p = zbx_json_next(object, p)) && 0 != index; index--)
+			;
+
+		if (0 != index || NULL == p)
+		{
+			zbx_set_json_strerror("array index out of bounds starting with json path: \"%s\"", path);
+			return FAIL;
+		}
+	}
+	else
+	{
+		if (NULL == (p = zbx_json_pair_by_name(object, name)))
+		{
+			zbx_set_json_strerror("object not found starting with json path: \"%s\"", path);
+			return FAIL;
+		}
+	}
+
+	object->start = p;
+
+	if (NULL == (object->end = __zbx_json_rbracket(p)))
+		object->end = p + json_parse_value(p, NULL) - 1;
+
+	return SUCCEED;
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: zbx_json_path_open                                               *
@@ -1348,10 +1400,10 @@ int	zbx_jsonpath_next(const char *path, const char **pnext, zbx_strloc_t *loc, i
  ******************************************************************************/
 int	zbx_json_path_open(const struct zbx_json_parse *jp, const char *path, struct zbx_json_parse *out)
 {
-	const char		*p, *next = 0;
+	const char		*next = 0;
 	char			buffer[MAX_STRING_LEN];
 	zbx_strloc_t		loc;
-	int			type, index;
+	int			type, index = 0;
 	struct zbx_json_parse	object;
 
 	object = *jp;
@@ -1363,48 +1415,272 @@ int	zbx_json_path_open(const struct zbx_json_parse *jp, const char *path, struct
 
 		if (ZBX_JSONPATH_ARRAY_INDEX == type)
 		{
-			if ('[' != *object.start)
-				return FAIL;
-
 			if (FAIL == is_uint_n_range(path + loc.l, loc.r - loc.l + 1, &index, sizeof(index), 0,
 					0xFFFFFFFF))
 			{
 				return FAIL;
 			}
+		}
+		else
+			zbx_strlcpy(buffer, path + loc.l, loc.r - loc.l + 2);
 
-			for (p = NULL; NULL != (p = zbx_json_next(&object, p)) && 0 != index; index--)
-				;
+		if (FAIL == json_path_open_component(&object, type, index, buffer, path + loc.l))
+			return FAIL;
+	}
+	while ('\0' != *next);
 
-			if (0 != index || NULL == p)
+	*out = object;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_json_path_compile                                            *
+ *                                                                            *
+ * Purpose: parse json path for repeated use with zbx_json_path_open_compiled *
+ *                                                                            *
+ * Parameters: path     - [IN] the json path                                  *
+ *             compiled - [OUT] the parsed json path, must be cleared with    *
+ *                              zbx_json_path_clear() after successful        *
+ *                              compilation                                   *
+ *                                                                            *
+ * Return value: SUCCEED - the json path was parsed successfully              *
+ *               FAIL    - json path parsing error                            *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_json_path_compile(const char *path, zbx_json_path_t *compiled)
+{
+	const char			*next = 0;
+	zbx_strloc_t			loc;
+	int				type, components_alloc = 0;
+	zbx_json_path_component_t	*component;
+
+	compiled->path = zbx_strdup(NULL, path);
+	compiled->components = NULL;
+	compiled->components_num = 0;
+
+	do
+	{
+		if (FAIL == zbx_jsonpath_next(path, &next, &loc, &type))
+			goto fail;
+
+		if (compiled->components_num == components_alloc)
+		{
+			components_alloc += 4;
+			compiled->components = (zbx_json_path_component_t *)zbx_realloc(compiled->components,
+					sizeof(zbx_json_path_component_t) * components_alloc);
+		}
+
+		component = &compiled->components[compiled->components_num];
+		component->type = type;
+		component->offset = loc.l;
+		component->index = 0;
+		component->name = NULL;
+
+		if (ZBX_JSONPATH_ARRAY_INDEX == type)
+		{
+			if (FAIL == is_uint_n_range(path + loc.l, loc.r - loc.l + 1, &component->index,
+					sizeof(component->index), 0, 0xFFFFFFFF))
 			{
-				zbx_set_json_strerror("array index out of bounds starting with json path: \"%s\"",
-						path + loc.l);
-				return FAIL;
+				goto fail;
 			}
 		}
 		else
 		{
-			zbx_strlcpy(buffer, path + loc.l, loc.r - loc.l + 2);
-
-			if (NULL == (p = zbx_json_pair_by_name(&object, buffer)))
-			{
-				zbx_set_json_strerror("object not found starting with json path: \"%s\"", path + loc.l);
-				return FAIL;
-			}
+			component->name = (char *)zbx_malloc(NULL, loc.r - loc.l + 2);
+			zbx_strlcpy(component->name, path + loc.l, loc.r - loc.l + 2);
 		}
 
-		object.start = p;
-
-		if (NULL == (object.end = __zbx_json_rbracket(p)))
-			object.end = p + json_parse_value(p, NULL) - 1;
+		compiled->components_num++;
 	}
 	while ('\0' != *next);
 
+	return SUCCEED;
+fail:
+	zbx_json_path_clear(compiled);
+
+	return FAIL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_json_path_clear                                              *
+ *                                                                            *
+ * Purpose: free resources allocated by parsed json path                      *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_json_path_clear(zbx_json_path_t *compiled)
+{
+	int	i;
+
+	for (i = 0; i < compiled->components_num; i++)
+		zbx_free(compiled->components[i].name);
+
+	zbx_free(compiled->components);
+	zbx_free(compiled->path);
+	compiled->components_num = 0;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_json_path_open_compiled                                      *
+ *                                                                            *
+ * Purpose: opens an object by parsed json path                               *
+ *                                                                            *
+ * Return value: SUCCESS - processed successfully                             *
+ *               FAIL - an error occurred                                     *
+ *                                                                            *
+ * Comments: the same as zbx_json_path_open() without parsing the path        *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_json_path_open_compiled(const struct zbx_json_parse *jp, const zbx_json_path_t *compiled,
+		struct zbx_json_parse *out)
+{
+	int				i;
+	struct zbx_json_parse		object;
+	const zbx_json_path_component_t	*component;
+
+	object = *jp;
+
+	for (i = 0; i < compiled->components_num; i++)
+	{
+		component = &compiled->components[i];
+
+		if (FAIL == json_path_open_component(&object, component->type, component->index, component->name,
+				compiled->path + component->offset))
+		{
+			return FAIL;
+		}
+	}
+
 	*out = object;
 
 	return SUCCEED;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: json_path_open_multi                                             *
+ *                                                                            *
+ * Purpose: opens objects by multiple parsed json paths sharing the same      *
+ *          prefix up to the specified depth                                  *
+ *                                                                            *
+ * Parameters: object      - [IN] the object located by the common prefix     *
+ *             paths       - [IN] the parsed json paths                       *
+ *             queries     - [IN] indexes of the paths to open                *
+ *             queries_num - [IN] the number of paths to open                 *
+ *             depth       - [IN] the common prefix length in components      *
+ *             out         - [OUT] the opened objects                         *
+ *             ret         - [OUT] SUCCEED for the opened paths               *
+ *                                                                            *
+ * Comments: Members of each object are iterated once for all paths, the      *
+ *           paths matching the same member are resolved together            *
+ *           recursively.                                                     *
+ *                                                                            *
+ ******************************************************************************/
+static void	json_path_open_multi(const struct zbx_json_parse *object, const zbx_json_path_t * const *paths,
+		const int *queries, int queries_num, int depth, struct zbx_json_parse *out, int *ret)
+{
+	int				i, pending_num = 0, matched_num, index, *pending, *matched;
+	char				buffer[MAX_STRING_LEN];
+	const char			*p = NULL;
+	struct zbx_json_parse		sub;
+	const zbx_json_path_component_t	*component;
+
+	pending = (int *)zbx_malloc(NULL, sizeof(int) * queries_num * 2);
+	matched = pending + queries_num;
+
+	for (i = 0; i < queries_num; i++)
+	{
+		if (paths[queries[i]]->components_num == depth)
+		{
+			out[queries[i]] = *object;
+			ret[queries[i]] = SUCCEED;
+			continue;
+		}
+
+		component = &paths[queries[i]]->components[depth];
+
+		/* arrays can be opened only by index and objects only by name, */
+		/* other paths are left unresolved                              */
+		if (('[' == *object->start) == (ZBX_JSONPATH_ARRAY_INDEX == component->type))
+			pending[pending_num++] = queries[i];
+	}
+
+	for (index = 0; 0 != pending_num; index++)
+	{
+		if ('[' == *object->start)
+		{
+			if (NULL == (p = zbx_json_next(object, p)))
+				break;
+		}
+		else if (NULL == (p = zbx_json_pair_next(object, p, buffer, sizeof(buffer))))
+			break;
+
+		for (i = 0, matched_num = 0; i < pending_num; i++)
+		{
+			component = &paths[pending[i]]->components[depth];
+
+			if ('[' == *object->start ? index == component->index : 0 == strcmp(component->name, buffer))
+				matched[matched_num++] = pending[i];
+			else if (matched_num != 0)
+				pending[i - matched_num] = pending[i];
+		}
+
+		if (0 == matched_num)
+			continue;
+
+		pending_num -= matched_num;
+
+		sub.start = p;
+
+		if (NULL == (sub.end = __zbx_json_rbracket(p)))
+			sub.end = p + json_parse_value(p, NULL) - 1;
+
+		json_path_open_multi(&sub, paths, matched, matched_num, depth + 1, out, ret);
+	}
+
+	zbx_free(pending);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_json_path_open_multi                                         *
+ *                                                                            *
+ * Purpose: opens objects by multiple parsed json paths in one pass           *
+ *                                                                            *
+ * Parameters: jp        - [IN] the json data                                 *
+ *             paths     - [IN] the parsed json paths                         *
+ *             paths_num - [IN] the number of paths                           *
+ *             out       - [OUT] the opened objects                           *
+ *             ret       - [OUT] SUCCEED - the object was opened              *
+ *                               FAIL    - otherwise                          *
+ *                                                                            *
+ * Comments: Gives the same objects as zbx_json_path_open_compiled() for each *
+ *           path, but the json data is scanned once for all paths. Error     *
+ *           messages are not set, use zbx_json_path_open_compiled() to get   *
+ *           the error of a failed path.                                      *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_json_path_open_multi(const struct zbx_json_parse *jp, const zbx_json_path_t * const *paths, int paths_num,
+		struct zbx_json_parse *out, int *ret)
+{
+	int	i, *queries;
+
+	queries = (int *)zbx_malloc(NULL, sizeof(int) * paths_num);
+
+	for (i = 0; i < paths_num; i++)
+	{
+		queries[i] = i;
+		ret[i] = FAIL;
+	}
+
+	json_path_open_multi(jp, paths, queries, paths_num, 0, out, ret);
+
+	zbx_free(queries);
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: zbx_json_value_dyn                                               *
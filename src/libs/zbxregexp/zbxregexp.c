@@ -366,6 +366,34 @@ out:
 	return ptr;
 }
 
+/*********************************************************************************
+ *                                                                               *
+ * Function: regexp_sub_precompiled                                              *
+ *                                                                               *
+ * Purpose: substitute captured groups of precompiled regular expression match   *
+ *          in output template                                                   *
+ *                                                                               *
+ * Parameters: string          - [IN] the string to parse                        *
+ *             regexp          - [IN] the precompiled regular expression         *
+ *             output_template - [IN] the output string template                 *
+ *             out             - [OUT] the output value if the input string      *
+ *                                     matches the regular expression or NULL    *
+ *                                     otherwise                                 *
+ *                                                                               *
+ *********************************************************************************/
+static void	regexp_sub_precompiled(const char *string, const zbx_regexp_t *regexp, const char *output_template,
+		char **out)
+{
+#define MATCH_SIZE 10
+	zbx_regmatch_t	match[MATCH_SIZE];
+
+	zbx_free(*out);
+
+	if (ZBX_REGEXP_MATCH == regexp_exec(string, regexp, 0, MATCH_SIZE, match))
+		*out = regexp_sub_replace(string, output_template, match, MATCH_SIZE);
+#undef MATCH_SIZE
+}
+
 /*********************************************************************************
  *                                                                               *
  * Function: regexp_sub                                                          *
@@ -395,10 +423,8 @@ out:
  *********************************************************************************/
 static int	regexp_sub(const char *string, const char *pattern, const char *output_template, int flags, char **out)
 {
-#define MATCH_SIZE 10
 	const char	*error = NULL;
 	zbx_regexp_t	*regexp = NULL;
-	zbx_regmatch_t	 match[MATCH_SIZE];
 
 	if (NULL == string)
 	{
@@ -415,13 +441,9 @@ static int	regexp_sub(const char *string, const char *pattern, const char *outpu
 	if (FAIL == regexp_prepare(pattern, flags, &regexp, &error))
 		return FAIL;
 
-	zbx_free(*out);
-
-	if(ZBX_REGEXP_MATCH == regexp_exec(string, regexp, 0, MATCH_SIZE, match))
-		*out = regexp_sub_replace(string, output_template, match, MATCH_SIZE);
+	regexp_sub_precompiled(string, regexp, output_template, out);
 
 	return SUCCEED;
-#undef MATCH_SIZE
 }
 
 /*********************************************************************************
@@ -479,6 +501,58 @@ int	zbx_iregexp_sub(const char *string, const char *pattern, const char *output_
 	return regexp_sub(string, pattern, output_template, PCRE_CASELESS, out);
 }
 
+/*********************************************************************************
+ *                                                                               *
+ * Function: zbx_mregexp_sub_compile                                             *
+ *                                                                               *
+ * Purpose: compile regular expression for zbx_regexp_sub_precompiled() with the *
+ *          same options as used by zbx_mregexp_sub()                            *
+ *                                                                               *
+ * Parameters: pattern         - [IN] the regular expression                     *
+ *             output_template - [IN] the output string template                 *
+ *             regexp          - [OUT] the compiled regular expression           *
+ *             error           - [OUT] the error message                         *
+ *                                                                               *
+ * Return value: SUCCEED - the regular expression was compiled                   *
+ *               FAIL    - otherwise                                             *
+ *                                                                               *
+ *********************************************************************************/
+int	zbx_mregexp_sub_compile(const char *pattern, const char *output_template, zbx_regexp_t **regexp,
+		const char **error)
+{
+	int	flags = 0;
+
+#ifdef PCRE_NO_AUTO_CAPTURE
+	if (NULL == output_template || '\0' == *output_template)
+		flags |= PCRE_NO_AUTO_CAPTURE;
+#else
+	ZBX_UNUSED(output_template);
+#endif
+	return regexp_compile(pattern, flags, regexp, error);
+}
+
+/*********************************************************************************
+ *                                                                               *
+ * Function: zbx_regexp_sub_precompiled                                          *
+ *                                                                               *
+ * Purpose: the same as zbx_mregexp_sub() with precompiled regular expression    *
+ *                                                                               *
+ * Comments: use this function for better performance if many strings need to    *
+ *           be substituted with the same regular expression                     *
+ *                                                                               *
+ *********************************************************************************/
+void	zbx_regexp_sub_precompiled(const char *string, const zbx_regexp_t *regexp, const char *output_template,
+		char **out)
+{
+	if (NULL == string)
+	{
+		zbx_free(*out);
+		return;
+	}
+
+	regexp_sub_precompiled(string, regexp, output_template, out);
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: zbx_regexp_clean_expressions                                     *
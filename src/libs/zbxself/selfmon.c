@@ -100,6 +100,8 @@ extern int	CONFIG_SNMPTRAPPER_FORKS;
 extern int	CONFIG_PROXYPOLLER_FORKS;
 extern int	CONFIG_ESCALATOR_FORKS;
 extern int	CONFIG_HISTSYNCER_FORKS;
+extern int	CONFIG_HISTWRITER_FORKS;
+extern int	CONFIG_AVAILMAN_FORKS;
 extern int	CONFIG_DISCOVERER_FORKS;
 extern int	CONFIG_ALERTER_FORKS;
 extern int	CONFIG_TIMER_FORKS;
@@ -164,6 +166,10 @@ int	get_process_type_forks(unsigned char proc_type)
 			return CONFIG_ESCALATOR_FORKS;
 		case ZBX_PROCESS_TYPE_HISTSYNCER:
 			return CONFIG_HISTSYNCER_FORKS;
+		case ZBX_PROCESS_TYPE_HISTWRITER:
+			return CONFIG_HISTWRITER_FORKS;
+		case ZBX_PROCESS_TYPE_AVAILMAN:
+			return CONFIG_AVAILMAN_FORKS;
 		case ZBX_PROCESS_TYPE_DISCOVERER:
 			return CONFIG_DISCOVERER_FORKS;
 		case ZBX_PROCESS_TYPE_ALERTER:
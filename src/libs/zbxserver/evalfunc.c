@@ -586,13 +586,14 @@ static int	evaluate_COUNT(char *value, DC_ITEM *item, const char *parameters, co
 {
 	const char			*__function_name = "evaluate_COUNT";
 	int				arg1, op = OP_UNKNOWN, numeric_search, nparams, count = 0, i, ret = FAIL;
-	int				seconds = 0, nvalues = 0;
+	int				seconds = 0, nvalues = 0, count_values;
 	char				*arg2 = NULL, *arg2_2 = NULL, *arg3 = NULL, buf[ZBX_MAX_UINT64_LEN];
 	double				arg2_dbl;
 	zbx_uint64_t			arg2_ui64, arg2_2_ui64;
 	zbx_value_type_t		arg1_type;
 	zbx_vector_ptr_t		regexps;
 	zbx_vector_history_record_t	values;
+	history_value_t			result;
 	zbx_timespec_t			ts_end = *ts;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
@@ -779,15 +780,25 @@ static int	evaluate_COUNT(char *value, DC_ITEM *item, const char *parameters, co
 			THIS_SHOULD_NEVER_HAPPEN;
 	}
 
+	/* skip counting values one by one if both pattern and operator are empty or "" is searched in text values */
+	count_values = ((NULL != arg2 && '\0' != *arg2) || (NULL != arg3 && '\0' != *arg3 &&
+			OP_LIKE != op && OP_REGEXP != op && OP_IREGEXP != op));
+
+	if (0 == count_values && 0 != seconds && SUCCEED == zbx_vc_get_aggregate(item->itemid, item->value_type,
+			ZBX_VC_AGGR_COUNT, seconds, &ts_end, &result, &count))
+	{
+		zbx_snprintf(value, MAX_BUFFER_LEN, "%d", count);
+		ret = SUCCEED;
+		goto out;
+	}
+
 	if (FAIL == zbx_vc_get_values(item->itemid, item->value_type, &values, seconds, nvalues, &ts_end))
 	{
 		*error = zbx_strdup(*error, "cannot get values from value cache");
 		goto out;
 	}
 
-	/* skip counting values one by one if both pattern and operator are empty or "" is searched in text values */
-	if ((NULL != arg2 && '\0' != *arg2) || (NULL != arg3 && '\0' != *arg3 &&
-			OP_LIKE != op && OP_REGEXP != op && OP_IREGEXP != op))
+	if (0 != count_values)
 	{
 		switch (item->value_type)
 		{
@@ -890,7 +901,7 @@ out:
 static int	evaluate_SUM(char *value, DC_ITEM *item, const char *parameters, const zbx_timespec_t *ts, char **error)
 {
 	const char			*__function_name = "evaluate_SUM";
-	int				nparams, arg1, i, ret = FAIL, seconds = 0, nvalues = 0;
+	int				nparams, arg1, i, ret = FAIL, seconds = 0, nvalues = 0, count;
 	zbx_value_type_t		arg1_type;
 	zbx_vector_history_record_t	values;
 	history_value_t			result;
@@ -947,6 +958,14 @@ static int	evaluate_SUM(char *value, DC_ITEM *item, const char *parameters, cons
 			THIS_SHOULD_NEVER_HAPPEN;
 	}
 
+	if (0 != seconds && SUCCEED == zbx_vc_get_aggregate(item->itemid, item->value_type, ZBX_VC_AGGR_SUM, seconds,
+			&ts_end, &result, &count))
+	{
+		zbx_history_value2str(value, MAX_BUFFER_LEN, &result, item->value_type);
+		ret = SUCCEED;
+		goto out;
+	}
+
 	if (FAIL == zbx_vc_get_values(item->itemid, item->value_type, &values, seconds, nvalues, &ts_end))
 	{
 		*error = zbx_strdup(*error, "cannot get values from value cache");
@@ -994,9 +1013,10 @@ out:
 static int	evaluate_AVG(char *value, DC_ITEM *item, const char *parameters, const zbx_timespec_t *ts, char **error)
 {
 	const char			*__function_name = "evaluate_AVG";
-	int				nparams, arg1, ret = FAIL, i, seconds = 0, nvalues = 0;
+	int				nparams, arg1, ret = FAIL, i, seconds = 0, nvalues = 0, count;
 	zbx_value_type_t		arg1_type;
 	zbx_vector_history_record_t	values;
+	history_value_t			result;
 	zbx_timespec_t			ts_end = *ts;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
@@ -1050,6 +1070,23 @@ static int	evaluate_AVG(char *value, DC_ITEM *item, const char *parameters, cons
 			THIS_SHOULD_NEVER_HAPPEN;
 	}
 
+	if (0 != seconds && SUCCEED == zbx_vc_get_aggregate(item->itemid, item->value_type, ZBX_VC_AGGR_AVG, seconds,
+			&ts_end, &result, &count))
+	{
+		if (0 != count)
+		{
+			zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_DBL, result.dbl);
+			ret = SUCCEED;
+		}
+		else
+		{
+			zabbix_log(LOG_LEVEL_DEBUG, "result for AVG is empty");
+			*error = zbx_strdup(*error, "not enough data");
+		}
+
+		goto out;
+	}
+
 	if (FAIL == zbx_vc_get_values(item->itemid, item->value_type, &values, seconds, nvalues, &ts_end))
 	{
 		*error = zbx_strdup(*error, "cannot get values from value cache");
@@ -1182,9 +1219,10 @@ out:
 static int	evaluate_MIN(char *value, DC_ITEM *item, const char *parameters, const zbx_timespec_t *ts, char **error)
 {
 	const char			*__function_name = "evaluate_MIN";
-	int				nparams, arg1, i, ret = FAIL, seconds = 0, nvalues = 0;
+	int				nparams, arg1, i, ret = FAIL, seconds = 0, nvalues = 0, count;
 	zbx_value_type_t		arg1_type;
 	zbx_vector_history_record_t	values;
+	history_value_t			result;
 	zbx_timespec_t			ts_end = *ts;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
@@ -1238,6 +1276,23 @@ static int	evaluate_MIN(char *value, DC_ITEM *item, const char *parameters, cons
 			THIS_SHOULD_NEVER_HAPPEN;
 	}
 
+	if (0 != seconds && SUCCEED == zbx_vc_get_aggregate(item->itemid, item->value_type, ZBX_VC_AGGR_MIN, seconds,
+			&ts_end, &result, &count))
+	{
+		if (0 != count)
+		{
+			zbx_history_value2str(value, MAX_BUFFER_LEN, &result, item->value_type);
+			ret = SUCCEED;
+		}
+		else
+		{
+			zabbix_log(LOG_LEVEL_DEBUG, "result for MIN is empty");
+			*error = zbx_strdup(*error, "not enough data");
+		}
+
+		goto out;
+	}
+
 	if (FAIL == zbx_vc_get_values(item->itemid, item->value_type, &values, seconds, nvalues, &ts_end))
 	{
 		*error = zbx_strdup(*error, "cannot get values from value cache");
@@ -1297,9 +1352,10 @@ out:
 static int	evaluate_MAX(char *value, DC_ITEM *item, const char *parameters, const zbx_timespec_t *ts, char **error)
 {
 	const char			*__function_name = "evaluate_MAX";
-	int				nparams, arg1, ret = FAIL, i, seconds = 0, nvalues = 0;
+	int				nparams, arg1, ret = FAIL, i, seconds = 0, nvalues = 0, count;
 	zbx_value_type_t		arg1_type;
 	zbx_vector_history_record_t	values;
+	history_value_t			result;
 	zbx_timespec_t			ts_end = *ts;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
@@ -1353,6 +1409,23 @@ static int	evaluate_MAX(char *value, DC_ITEM *item, const char *parameters, cons
 			THIS_SHOULD_NEVER_HAPPEN;
 	}
 
+	if (0 != seconds && SUCCEED == zbx_vc_get_aggregate(item->itemid, item->value_type, ZBX_VC_AGGR_MAX, seconds,
+			&ts_end, &result, &count))
+	{
+		if (0 != count)
+		{
+			zbx_history_value2str(value, MAX_BUFFER_LEN, &result, item->value_type);
+			ret = SUCCEED;
+		}
+		else
+		{
+			zabbix_log(LOG_LEVEL_DEBUG, "result for MAX is empty");
+			*error = zbx_strdup(*error, "not enough data");
+		}
+
+		goto out;
+	}
+
 	if (FAIL == zbx_vc_get_values(item->itemid, item->value_type, &values, seconds, nvalues, &ts_end))
 	{
 		*error = zbx_strdup(*error, "cannot get values from value cache");
@@ -4316,6 +4316,21 @@ static void	zbx_extract_functionids(zbx_vector_uint64_t *functionids, zbx_vector
 		if (NULL != tr->new_error)
 			continue;
 
+		if (NULL != tr->expression_code)
+		{
+			zbx_vector_uint64_append_array(functionids, ZBX_EVAL_CODE_FUNCTIONIDS(tr->expression_code),
+					tr->expression_code->functionids_num);
+
+			if (NULL != tr->recovery_expression_code)
+			{
+				zbx_vector_uint64_append_array(functionids,
+						ZBX_EVAL_CODE_FUNCTIONIDS(tr->recovery_expression_code),
+						tr->recovery_expression_code->functionids_num);
+			}
+
+			continue;
+		}
+
 		values_num_save = functionids->values_num;
 
 		if (SUCCEED != extract_expression_functionids(functionids, tr->expression))
@@ -4421,11 +4436,22 @@ static void	zbx_link_triggers_with_functions(zbx_vector_ptr_t *triggers_func_pos
 		if (NULL != tr->new_error)
 			continue;
 
-		ev.value = tr->value;
+		if (NULL != tr->expression_code)
+		{
+			zbx_vector_uint64_append_array(&funcids, ZBX_EVAL_CODE_FUNCTIONIDS(tr->expression_code),
+					tr->expression_code->functionids_num);
+		}
+		else
+		{
+			ev.value = tr->value;
+
+			expand_trigger_macros(&ev, tr, NULL, 0);
 
-		expand_trigger_macros(&ev, tr, NULL, 0);
+			if (SUCCEED != extract_expression_functionids(&funcids, tr->expression))
+				zbx_vector_uint64_clear(&funcids);
+		}
 
-		if (SUCCEED == extract_expression_functionids(&funcids, tr->expression))
+		if (0 != funcids.values_num)
 		{
 			tr_func_pos = (zbx_trigger_func_position_t *)zbx_malloc(NULL, sizeof(zbx_trigger_func_position_t));
 			tr_func_pos->trigger = tr;
@@ -4519,8 +4545,10 @@ typedef struct
 	zbx_timespec_t	timespec;
 
 	/* output data */
-	char		*value;
-	char		*error;
+	char			*value;
+	char			*error;
+	zbx_eval_value_t	eval_value;	/* the value for compiled expressions */
+	int			numeric;	/* SUCCEED if value can be used in compiled expressions */
 }
 zbx_func_t;
 
@@ -4604,6 +4632,7 @@ static void	zbx_populate_function_items(const zbx_vector_uint64_t *functionids,
 
 	func_local.value = NULL;
 	func_local.error = NULL;
+	func_local.numeric = FAIL;
 
 	functions = (DC_FUNCTION *)zbx_malloc(functions, sizeof(DC_FUNCTION) * functionids->values_num);
 	errcodes = (int *)zbx_malloc(errcodes, sizeof(int) * functionids->values_num);
@@ -4652,6 +4681,39 @@ static void	zbx_populate_function_items(const zbx_vector_uint64_t *functionids,
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() ifuncs_num:%d", __function_name, ifuncs->num_data);
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: func_value_to_double                                             *
+ *                                                                            *
+ * Purpose: convert function value to the number it would be parsed into when *
+ *          substituted into trigger expression                               *
+ *                                                                            *
+ * Parameters: value  - [IN] the function value                               *
+ *             result - [OUT] the converted value                             *
+ *                                                                            *
+ * Return value: SUCCEED - the value was converted                            *
+ *               FAIL    - the value is not a suffixed number                 *
+ *                                                                            *
+ ******************************************************************************/
+static int	func_value_to_double(const char *value, double *result)
+{
+	const char	*ptr = value;
+
+	if (SUCCEED != is_double_suffix(value, ZBX_FLAG_DOUBLE_SUFFIX))
+		return FAIL;
+
+	if ('-' == *ptr)
+		ptr++;
+
+	if (HUGE_VAL == (*result = atof(ptr) * suffix2factor(ptr[strlen(ptr) - 1])))
+		return FAIL;
+
+	if ('-' == *value)
+		*result = -*result;
+
+	return SUCCEED;
+}
+
 static void	zbx_evaluate_item_functions(zbx_hashset_t *funcs, zbx_vector_ptr_t *unknown_msgs)
 {
 	const char	*__function_name = "zbx_evaluate_item_functions";
@@ -4762,6 +4824,8 @@ static void	zbx_evaluate_item_functions(zbx_hashset_t *funcs, zbx_vector_ptr_t *
 		if (0 == ret_unknown)
 		{
 			func->value = zbx_strdup(func->value, value);
+			func->eval_value.unknown_idx = -1;
+			func->numeric = func_value_to_double(value, &func->eval_value.value);
 		}
 		else
 		{
@@ -4769,6 +4833,9 @@ static void	zbx_evaluate_item_functions(zbx_hashset_t *funcs, zbx_vector_ptr_t *
 			/* ZBX_UNKNOWN0, ZBX_UNKNOWN1 etc. not wrapped in () */
 			func->value = zbx_dsprintf(func->value, ZBX_UNKNOWN_STR "%d",
 					unknown_msgs->values_num - 1);
+			func->eval_value.value = 0.0;
+			func->eval_value.unknown_idx = unknown_msgs->values_num - 1;
+			func->numeric = SUCCEED;
 		}
 	}
 
@@ -4845,20 +4912,80 @@ static int	substitute_expression_functions_results(zbx_hashset_t *ifuncs, char *
 	return SUCCEED;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: substitute_code_functions_values                                 *
+ *                                                                            *
+ * Purpose: get values of compiled expression functions                       *
+ *                                                                            *
+ * Parameters: ifuncs  - [IN] the functions indexed by functionid             *
+ *             code    - [IN] the compiled expression                         *
+ *             values  - [OUT] the function values                            *
+ *             numeric - [OUT] set to FAIL if a function value cannot be used *
+ *                             in compiled expression                         *
+ *             error   - [OUT] the error message                              *
+ *                                                                            *
+ * Return value: SUCCEED - the function values were retrieved                 *
+ *               FAIL    - failed to get function value                       *
+ *                                                                            *
+ ******************************************************************************/
+static int	substitute_code_functions_values(zbx_hashset_t *ifuncs, const zbx_eval_code_t *code,
+		zbx_eval_value_t *values, int *numeric, char **error)
+{
+	const zbx_uint64_t	*functionids = ZBX_EVAL_CODE_FUNCTIONIDS(code);
+	zbx_func_t		*func;
+	zbx_ifunc_t		*ifunc;
+	int			i;
+
+	for (i = 0; i < code->functionids_num; i++)
+	{
+		if (NULL == (ifunc = (zbx_ifunc_t *)zbx_hashset_search(ifuncs, &functionids[i])))
+		{
+			*error = zbx_dsprintf(*error, "Cannot obtain function"
+					" and item for functionid: " ZBX_FS_UI64, functionids[i]);
+			return FAIL;
+		}
+
+		func = ifunc->func;
+
+		if (NULL != func->error)
+		{
+			*error = zbx_strdup(*error, func->error);
+			return FAIL;
+		}
+
+		if (NULL == func->value)
+		{
+			*error = zbx_strdup(*error, "Unexpected error while processing a trigger expression");
+			return FAIL;
+		}
+
+		if (SUCCEED != func->numeric)
+			*numeric = FAIL;
+
+		values[i] = func->eval_value;
+	}
+
+	return SUCCEED;
+}
+
 static void	zbx_substitute_functions_results(zbx_hashset_t *ifuncs, zbx_vector_ptr_t *triggers)
 {
 	const char		*__function_name = "zbx_substitute_functions_results";
 
 	DC_TRIGGER		*tr;
+	DB_EVENT		event;
 	char			*out = NULL;
 	size_t			out_alloc = TRIGGER_EXPRESSION_LEN_MAX;
-	int			i;
+	int			i, values_num, numeric;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s() ifuncs_num:%d tr_num:%d",
 			__function_name, ifuncs->num_data, triggers->values_num);
 
 	out = (char *)zbx_malloc(out, out_alloc);
 
+	event.object = EVENT_OBJECT_TRIGGER;
+
 	for (i = 0; i < triggers->values_num; i++)
 	{
 		tr = (DC_TRIGGER *)triggers->values[i];
@@ -4866,6 +4993,40 @@ static void	zbx_substitute_functions_results(zbx_hashset_t *ifuncs, zbx_vector_p
 		if (NULL != tr->new_error)
 			continue;
 
+		if (NULL != tr->expression_code)
+		{
+			values_num = tr->expression_code->functionids_num;
+
+			if (NULL != tr->recovery_expression_code)
+				values_num += tr->recovery_expression_code->functionids_num;
+
+			tr->function_values = (zbx_eval_value_t *)zbx_malloc(tr->function_values,
+					sizeof(zbx_eval_value_t) * (0 != values_num ? values_num : 1));
+			numeric = SUCCEED;
+
+			if (SUCCEED != substitute_code_functions_values(ifuncs, tr->expression_code,
+					tr->function_values, &numeric, &tr->new_error) ||
+					(NULL != tr->recovery_expression_code && SUCCEED !=
+					substitute_code_functions_values(ifuncs, tr->recovery_expression_code,
+					tr->function_values + tr->expression_code->functionids_num, &numeric,
+					&tr->new_error)))
+			{
+				tr->new_value = TRIGGER_VALUE_UNKNOWN;
+				continue;
+			}
+
+			if (SUCCEED == numeric)
+				continue;
+
+			/* function values are not numbers, evaluate trigger expressions as text */
+			zbx_free(tr->expression_code);
+			zbx_free(tr->recovery_expression_code);
+			zbx_free(tr->function_values);
+
+			event.value = tr->value;
+			expand_trigger_macros(&event, tr, NULL, 0);
+		}
+
 		if( SUCCEED != substitute_expression_functions_results(ifuncs, tr->expression, &out, &out_alloc,
 				&tr->new_error))
 		{
@@ -4952,6 +5113,51 @@ empty:
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
 
+#define ZBX_TRIGGER_PROBLEM_EXPRESSION	0
+#define ZBX_TRIGGER_RECOVERY_EXPRESSION	1
+
+/******************************************************************************
+ *                                                                            *
+ * Function: evaluate_trigger_expression                                      *
+ *                                                                            *
+ * Purpose: evaluate trigger problem or recovery expression                   *
+ *                                                                            *
+ * Parameters: tr            - [IN] the trigger                               *
+ *             type          - [IN] the expression type:                      *
+ *                                  ZBX_TRIGGER_PROBLEM_EXPRESSION or         *
+ *                                  ZBX_TRIGGER_RECOVERY_EXPRESSION           *
+ *             value         - [OUT] the expression value                     *
+ *             error         - [OUT] the error message                        *
+ *             max_error_len - [IN] the error message buffer size             *
+ *             unknown_msgs  - [IN] the messages of unknown function values   *
+ *                                                                            *
+ * Return value: SUCCEED - the expression was evaluated successfully          *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ * Comments: Compiled expressions are evaluated with function values, other   *
+ *           expressions must have function values substituted as text.       *
+ *                                                                            *
+ ******************************************************************************/
+static int	evaluate_trigger_expression(const DC_TRIGGER *tr, int type, double *value, char *error,
+		size_t max_error_len, zbx_vector_ptr_t *unknown_msgs)
+{
+	if (NULL == tr->expression_code)
+	{
+		return evaluate(value, ZBX_TRIGGER_PROBLEM_EXPRESSION == type ? tr->expression : tr->recovery_expression,
+				error, max_error_len, unknown_msgs);
+	}
+
+	if (ZBX_TRIGGER_PROBLEM_EXPRESSION == type)
+	{
+		return zbx_eval_execute(value, tr->expression_code, tr->function_values, (double)tr->value, error,
+				max_error_len, unknown_msgs);
+	}
+
+	return zbx_eval_execute(value, tr->recovery_expression_code,
+			tr->function_values + tr->expression_code->functionids_num, (double)tr->value, error,
+			max_error_len, unknown_msgs);
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: evaluate_expressions                                             *
@@ -4983,6 +5189,10 @@ void	evaluate_expressions(zbx_vector_ptr_t *triggers)
 	{
 		tr = (DC_TRIGGER *)triggers->values[i];
 
+		/* compiled expressions contain only function and {TRIGGER.VALUE} macro tokens */
+		if (NULL != tr->expression_code)
+			continue;
+
 		event.value = tr->value;
 
 		if (SUCCEED != expand_trigger_macros(&event, tr, err, sizeof(err)))
@@ -5006,7 +5216,8 @@ void	evaluate_expressions(zbx_vector_ptr_t *triggers)
 		if (NULL != tr->new_error)
 			continue;
 
-		if (SUCCEED != evaluate(&expr_result, tr->expression, err, sizeof(err), &unknown_msgs))
+		if (SUCCEED != evaluate_trigger_expression(tr, ZBX_TRIGGER_PROBLEM_EXPRESSION, &expr_result, err,
+				sizeof(err), &unknown_msgs))
 		{
 			tr->new_error = zbx_strdup(tr->new_error, err);
 			tr->new_value = TRIGGER_VALUE_UNKNOWN;
@@ -5039,7 +5250,8 @@ void	evaluate_expressions(zbx_vector_ptr_t *triggers)
 			}
 
 			/* processing recovery expression mode */
-			if (SUCCEED != evaluate(&expr_result, tr->recovery_expression, err, sizeof(err), &unknown_msgs))
+			if (SUCCEED != evaluate_trigger_expression(tr, ZBX_TRIGGER_RECOVERY_EXPRESSION, &expr_result,
+					err, sizeof(err), &unknown_msgs))
 			{
 				tr->new_error = zbx_strdup(tr->new_error, err);
 				tr->new_value = TRIGGER_VALUE_UNKNOWN;
@@ -145,6 +145,8 @@ int	CONFIG_PINGER_FORKS		= 1;
 int	CONFIG_POLLER_FORKS		= 5;
 int	CONFIG_UNREACHABLE_POLLER_FORKS	= 1;
 int	CONFIG_ASYNC_POLLER_FORKS	= 2;
+int	CONFIG_ASYNC_AGENT_POLLER_FORKS	= 0;	/* not used in zabbix_proxy, required for linking */
+int	CONFIG_ASYNC_SNMP_POLLER_FORKS	= 0;	/* not used in zabbix_proxy, required for linking */
 int	CONFIG_HTTPPOLLER_FORKS		= 1;
 int	CONFIG_IPMIPOLLER_FORKS		= 0;
 int	CONFIG_TRAPPER_FORKS		= 5;
@@ -180,8 +182,12 @@ int	CONFIG_PROXYCONFIG_FREQUENCY	= SEC_PER_HOUR;
 int	CONFIG_PROXYDATA_FREQUENCY	= 1;
 
 int	CONFIG_HISTSYNCER_FORKS		= 4;
+int	CONFIG_HISTWRITER_FORKS		= 0;
+int	CONFIG_AVAILMAN_FORKS		= 0;	/* not used in zabbix_proxy, required for linking */
 int	CONFIG_HISTSYNCER_FREQUENCY	= 1;
 int	CONFIG_CONFSYNCER_FORKS		= 1;
+int	CONFIG_CONFLOADER_FORKS		= 0;	/* not used in zabbix_proxy, required for linking */
+char	*CONFIG_CONFCACHE_SNAPSHOT_FILE	= NULL;	/* not used in zabbix_proxy, required for linking */
 
 int	CONFIG_VMWARE_FORKS		= 0;
 int	CONFIG_VMWARE_FREQUENCY		= 60;
@@ -205,6 +211,8 @@ char	*CONFIG_EXTERNALSCRIPTS		= NULL;
 char	*CONFIG_TMPDIR			= NULL;
 char	*CONFIG_FPING_LOCATION		= NULL;
 char	*CONFIG_FPING6_LOCATION		= NULL;
+int	CONFIG_ICMP_PING_ENGINE		= 1;
+int	CONFIG_ICMP_PING_RATE		= 1000;
 char	*CONFIG_DBHOST			= NULL;
 char	*CONFIG_DBNAME			= NULL;
 char	*CONFIG_DBSCHEMA		= NULL;
@@ -265,6 +273,10 @@ char	*CONFIG_HISTORY_STORAGE_URL		= NULL;
 char	*CONFIG_HISTORY_STORAGE_OPTS		= NULL;
 char	*CONFIG_HISTORY_STORAGE_TYPE		= NULL;
 char	*CONFIG_HISTORY_STORAGE_TABLE_NAME		= NULL;
+char	*CONFIG_HISTORY_STORAGE_FORMAT		= NULL;
+int	CONFIG_HISTORY_STORAGE_COMPRESS		= 0;
+char	*CONFIG_HISTORY_STORAGE_SPOOL_DIR	= NULL;
+zbx_uint64_t	CONFIG_HISTORY_STORAGE_SPOOL_SIZE	= 0;
 
 
 char *CONFIG_NMAP_PARAMS = NULL;
@@ -648,6 +660,10 @@ static void	zbx_load_config(ZBX_TASK_EX *task)
 			PARM_OPT,	0,			0},
 		{"Fping6Location",		&CONFIG_FPING6_LOCATION,		TYPE_STRING,
 			PARM_OPT,	0,			0},
+		{"IcmpPingEngine",		&CONFIG_ICMP_PING_ENGINE,		TYPE_INT,
+			PARM_OPT,	0,			1},
+		{"IcmpPingRate",		&CONFIG_ICMP_PING_RATE,			TYPE_INT,
+			PARM_OPT,	1,			1000000},
 		{"Timeout",			&CONFIG_TIMEOUT,			TYPE_INT,
 			PARM_OPT,	1,			30},
 		{"TrapperTimeout",		&CONFIG_TRAPPER_TIMEOUT,		TYPE_INT,
@@ -25,8 +25,13 @@
 #include "log.h"
 #include "dbconfig.h"
 #include "dbcache.h"
+#include "../../libs/zbxdbcache/valuecache.h"
 
 extern int		CONFIG_CONFSYNCER_FREQUENCY;
+extern char		*CONFIG_CONFCACHE_SNAPSHOT_FILE;
+extern int		CONFIG_CONFCACHE_SNAPSHOT_FREQUENCY;
+extern char		*CONFIG_VALUE_CACHE_SNAPSHOT_FILE;
+extern int		CONFIG_VALUE_CACHE_SNAPSHOT_FREQUENCY;
 extern unsigned char	process_type, program_type;
 extern int		server_num, process_num;
 
@@ -62,6 +67,7 @@ static void	zbx_dbconfig_sigusr_handler(int flags)
 ZBX_THREAD_ENTRY(dbconfig_thread, args)
 {
 	double	sec = 0.0;
+	time_t	snapshot_time, config_snapshot_time;
 
 	process_type = ((zbx_thread_args_t *)args)->process_type;
 	server_num = ((zbx_thread_args_t *)args)->server_num;
@@ -82,6 +88,8 @@ ZBX_THREAD_ENTRY(dbconfig_thread, args)
 
 	DBconnect(ZBX_DB_CONNECT_NORMAL);
 
+	snapshot_time = config_snapshot_time = time(NULL);
+
 	for (;;)
 	{
 		sec = zbx_time();
@@ -95,6 +103,28 @@ ZBX_THREAD_ENTRY(dbconfig_thread, args)
 		dc_flush_history();	/* misconfigured items generate pseudo-historic values to become notsupported */
 		sec = zbx_time() - sec;
 
+		if (NULL != CONFIG_VALUE_CACHE_SNAPSHOT_FILE && 0 != CONFIG_VALUE_CACHE_SNAPSHOT_FREQUENCY &&
+				CONFIG_VALUE_CACHE_SNAPSHOT_FREQUENCY <= time(NULL) - snapshot_time)
+		{
+			zbx_setproctitle("%s [synced configuration in " ZBX_FS_DBL " sec, writing value cache snapshot]",
+					get_process_type_string(process_type), sec);
+
+			zbx_vc_snapshot_write(CONFIG_VALUE_CACHE_SNAPSHOT_FILE, 0);
+			snapshot_time = time(NULL);
+		}
+
+		if (NULL != CONFIG_CONFCACHE_SNAPSHOT_FILE &&
+				CONFIG_CONFCACHE_SNAPSHOT_FREQUENCY <= time(NULL) - config_snapshot_time)
+		{
+			zbx_setproctitle("%s [synced configuration in " ZBX_FS_DBL " sec,"
+					" writing configuration cache snapshot]", get_process_type_string(process_type), sec);
+
+			if (SUCCEED != zbx_dc_config_snapshot_write(CONFIG_CONFCACHE_SNAPSHOT_FILE))
+				zabbix_log(LOG_LEVEL_WARNING, "cannot write configuration cache snapshot");
+
+			config_snapshot_time = time(NULL);
+		}
+
 		zbx_setproctitle("%s [synced configuration in " ZBX_FS_DBL " sec, idle %d sec]",
 				get_process_type_string(process_type), sec, CONFIG_CONFSYNCER_FREQUENCY);
 
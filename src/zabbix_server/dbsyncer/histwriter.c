@@ -0,0 +1,846 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2018 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "common.h"
+
+#include "log.h"
+#include "daemon.h"
+#include "zbxself.h"
+#include "zbxalgo.h"
+#include "zbxipcservice.h"
+#include "zbxhistory.h"
+
+#include "histwriter.h"
+#include "../../libs/zbxhistory/history.h"
+
+extern unsigned char	process_type, program_type;
+extern int		server_num, process_num;
+
+/* curl_multi_wait() is supported starting with version 7.28.0 (0x071c00) */
+#if defined(HAVE_LIBCURL) && LIBCURL_VERSION_NUM >= 0x071c00
+
+extern char		*CONFIG_HISTORY_STORAGE_URL;
+extern char		*CONFIG_HISTORY_STORAGE_TABLE_NAME;
+extern char		*CONFIG_HISTORY_STORAGE_SPOOL_DIR;
+extern zbx_uint64_t	CONFIG_HISTORY_STORAGE_SPOOL_SIZE;
+
+#define ZBX_HISTWRITER_QUEUE_MAX	(64 * ZBX_MEBIBYTE)	/* the batches kept in memory before spooling */
+#define ZBX_HISTWRITER_SENDING_MAX	4			/* the batches posted at once */
+#define ZBX_HISTWRITER_BACKOFF_MAX	60			/* the longest pause after failures, seconds */
+#define ZBX_HISTWRITER_WAIT_MS		50			/* network wait between IPC checks */
+#define ZBX_HISTWRITER_POST_TIMEOUT	60			/* the longest single post, seconds */
+#define ZBX_HISTWRITER_SCAN_PERIOD	10			/* spool directory checks for new batches */
+
+/* history batch received from a history syncer */
+typedef struct
+{
+	char		*data;
+	size_t		size;
+	zbx_uint32_t	format;		/* ZBX_IPC_HISTWRITER_VALUES or ZBX_IPC_HISTWRITER_ROWBINARY */
+	unsigned char	deflated;
+	char		*path;		/* the spool file the batch was loaded from */
+	CURL		*handle;
+}
+zbx_histwriter_batch_t;
+
+/* spooled batch waiting to be replayed */
+typedef struct
+{
+	char		*path;
+	zbx_uint64_t	size;
+}
+zbx_histwriter_spool_t;
+
+typedef struct
+{
+	CURLM			*handle;
+	char			*url_values;
+	char			*url_rowbinary;
+	struct curl_slist	*headers_deflate;
+
+	zbx_queue_ptr_t		queue;		/* the received batches waiting to be posted */
+	size_t			queue_size;
+	zbx_vector_ptr_t	sending;	/* the batches being posted */
+
+	zbx_vector_ptr_t	spool;		/* the spooled batches, oldest first */
+	zbx_uint64_t		spool_size;
+	int			spool_sending;	/* the spooled batches being posted */
+	double			spool_scan_at;	/* the spool directory is checked for new batches after this time */
+
+	double			retry_at;	/* no posts are started before this time after a failure */
+	int			backoff;
+
+	zbx_uint64_t		sent_num;
+	zbx_uint64_t		spooled_num;
+	zbx_uint64_t		dropped_num;
+}
+zbx_histwriter_t;
+
+static volatile sig_atomic_t	histwriter_terminate = 0;
+
+static size_t	histwriter_discard_cb(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	ZBX_UNUSED(ptr);
+	ZBX_UNUSED(userdata);
+
+	return size * nmemb;
+}
+
+static int	histwriter_spool_compare(const void *d1, const void *d2)
+{
+	const zbx_histwriter_spool_t	*s1 = *(const zbx_histwriter_spool_t **)d1;
+	const zbx_histwriter_spool_t	*s2 = *(const zbx_histwriter_spool_t **)d2;
+
+	return strcmp(s1->path, s2->path);
+}
+
+static void	histwriter_batch_free(zbx_histwriter_batch_t *batch)
+{
+	zbx_free(batch->path);
+	zbx_free(batch->data);
+	zbx_free(batch);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: histwriter_spool_add                                             *
+ *                                                                            *
+ * Purpose: registers spool file to be replayed                               *
+ *                                                                            *
+ ******************************************************************************/
+static void	histwriter_spool_add(zbx_histwriter_t *writer, char *path, zbx_uint64_t size)
+{
+	zbx_histwriter_spool_t	*spool;
+
+	spool = (zbx_histwriter_spool_t *)zbx_malloc(NULL, sizeof(zbx_histwriter_spool_t));
+	spool->path = path;
+	spool->size = size;
+
+	zbx_vector_ptr_append(&writer->spool, spool);
+	writer->spool_size += size;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: histwriter_spool_remove                                          *
+ *                                                                            *
+ * Purpose: removes replayed spool file                                       *
+ *                                                                            *
+ ******************************************************************************/
+static void	histwriter_spool_remove(zbx_histwriter_t *writer, zbx_histwriter_batch_t *batch)
+{
+	if (0 != unlink(batch->path))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot remove history spool file \"%s\": %s", batch->path,
+				zbx_strerror(errno));
+	}
+
+	writer->spool_size -= MIN(writer->spool_size, batch->size);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: histwriter_spool_scan                                            *
+ *                                                                            *
+ * Purpose: picks up the batches spooled before the restart or by the history *
+ *          syncers while the writer was not reachable                        *
+ *                                                                            *
+ * Comments: the known batches must have been replayed, the spool list is     *
+ *           built anew                                                       *
+ *                                                                            *
+ ******************************************************************************/
+static void	histwriter_spool_scan(zbx_histwriter_t *writer)
+{
+	DIR		*dir;
+	struct dirent	*entry;
+	zbx_stat_t	st;
+	char		*path;
+
+	if (NULL == CONFIG_HISTORY_STORAGE_SPOOL_DIR)
+		return;
+
+	writer->spool_size = 0;
+
+	if (NULL == (dir = opendir(CONFIG_HISTORY_STORAGE_SPOOL_DIR)))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot open history spool directory \"%s\": %s",
+				CONFIG_HISTORY_STORAGE_SPOOL_DIR, zbx_strerror(errno));
+		return;
+	}
+
+	while (NULL != (entry = readdir(dir)))
+	{
+		if (0 != strncmp(entry->d_name, ZBX_HISTORY_SPOOL_PREFIX, ZBX_CONST_STRLEN(ZBX_HISTORY_SPOOL_PREFIX)))
+			continue;
+
+		path = zbx_dsprintf(NULL, "%s/%s", CONFIG_HISTORY_STORAGE_SPOOL_DIR, entry->d_name);
+
+		if (0 != zbx_stat(path, &st) || 0 == S_ISREG(st.st_mode))
+		{
+			zbx_free(path);
+			continue;
+		}
+
+		histwriter_spool_add(writer, path, (zbx_uint64_t)st.st_size);
+	}
+
+	closedir(dir);
+
+	zbx_vector_ptr_sort(&writer->spool, histwriter_spool_compare);
+
+	if (0 != writer->spool.values_num)
+	{
+		zabbix_log(LOG_LEVEL_INFORMATION, "found %d spooled history batches (" ZBX_FS_UI64 " bytes)",
+				writer->spool.values_num, writer->spool_size);
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: histwriter_spool_write                                           *
+ *                                                                            *
+ * Purpose: moves batch from memory to the spool directory                    *
+ *                                                                            *
+ * Return value: SUCCEED - the batch was spooled                              *
+ *               FAIL    - spooling is disabled, the spool is full or the     *
+ *                         file could not be written                          *
+ *                                                                            *
+ ******************************************************************************/
+static int	histwriter_spool_write(zbx_histwriter_t *writer, const zbx_histwriter_batch_t *batch)
+{
+	char	*path, *error = NULL;
+
+	if (NULL == CONFIG_HISTORY_STORAGE_SPOOL_DIR)
+		return FAIL;
+
+	if (writer->spool_size + batch->size > CONFIG_HISTORY_STORAGE_SPOOL_SIZE)
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "history spool is full");
+		return FAIL;
+	}
+
+	if (SUCCEED != zbx_history_spool_write(CONFIG_HISTORY_STORAGE_SPOOL_DIR, batch->format, batch->deflated,
+			batch->data, batch->size, &path, &error))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "%s", error);
+		zbx_free(error);
+		return FAIL;
+	}
+
+	histwriter_spool_add(writer, path, batch->size);
+	writer->spooled_num++;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: histwriter_spool_read                                            *
+ *                                                                            *
+ * Purpose: loads the oldest spooled batch                                    *
+ *                                                                            *
+ * Return value: the batch or NULL if the spool is empty                      *
+ *                                                                            *
+ ******************************************************************************/
+static zbx_histwriter_batch_t	*histwriter_spool_read(zbx_histwriter_t *writer)
+{
+	zbx_histwriter_spool_t	*spool;
+	zbx_histwriter_batch_t	*batch;
+	char			*error = NULL;
+
+	while (0 != writer->spool.values_num)
+	{
+		spool = (zbx_histwriter_spool_t *)writer->spool.values[0];
+		zbx_vector_ptr_remove(&writer->spool, 0);
+
+		batch = (zbx_histwriter_batch_t *)zbx_calloc(NULL, 1, sizeof(zbx_histwriter_batch_t));
+		batch->path = spool->path;
+		batch->size = spool->size;
+		zbx_free(spool);
+
+		if (SUCCEED == zbx_history_spool_read(batch->path, &batch->format, &batch->deflated, &batch->data,
+				&batch->size, &error))
+		{
+			return batch;
+		}
+
+		zabbix_log(LOG_LEVEL_WARNING, "%s, skipping it", error);
+		zbx_free(error);
+		histwriter_spool_remove(writer, batch);
+		histwriter_batch_free(batch);
+	}
+
+	return NULL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: histwriter_spool_return                                          *
+ *                                                                            *
+ * Purpose: puts replayed batch that could not be posted back to the spool    *
+ *                                                                            *
+ * Comments: the spool file is still on disk, only the memory copy is freed   *
+ *                                                                            *
+ ******************************************************************************/
+static void	histwriter_spool_return(zbx_histwriter_t *writer, zbx_histwriter_batch_t *batch)
+{
+	zbx_histwriter_spool_t	*spool;
+
+	spool = (zbx_histwriter_spool_t *)zbx_malloc(NULL, sizeof(zbx_histwriter_spool_t));
+	spool->path = batch->path;
+	spool->size = batch->size;
+	batch->path = NULL;
+
+	zbx_vector_ptr_append(&writer->spool, spool);
+	zbx_vector_ptr_sort(&writer->spool, histwriter_spool_compare);
+
+	histwriter_batch_free(batch);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: histwriter_spool_batch                                           *
+ *                                                                            *
+ * Purpose: moves fresh batch out of memory to the spool, the batch is        *
+ *          dropped if it cannot be spooled                                   *
+ *                                                                            *
+ ******************************************************************************/
+static void	histwriter_spool_batch(zbx_histwriter_t *writer, zbx_histwriter_batch_t *batch)
+{
+	if (SUCCEED != histwriter_spool_write(writer, batch))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "history storage is not available, dropping " ZBX_FS_SIZE_T
+				" bytes of history", (zbx_fs_size_t)batch->size);
+		writer->dropped_num++;
+	}
+
+	histwriter_batch_free(batch);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: histwriter_trim_queue                                            *
+ *                                                                            *
+ * Purpose: keeps the memory queue within its limit by spooling or dropping   *
+ *          the oldest batches                                                *
+ *                                                                            *
+ ******************************************************************************/
+static void	histwriter_trim_queue(zbx_histwriter_t *writer)
+{
+	zbx_histwriter_batch_t	*batch;
+
+	while (ZBX_HISTWRITER_QUEUE_MAX < writer->queue_size &&
+			NULL != (batch = (zbx_histwriter_batch_t *)zbx_queue_ptr_pop(&writer->queue)))
+	{
+		writer->queue_size -= batch->size;
+		histwriter_spool_batch(writer, batch);
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: histwriter_add_batch                                             *
+ *                                                                            *
+ * Purpose: queues batch received from a history syncer                       *
+ *                                                                            *
+ * Comments: the message data is taken over by the batch                      *
+ *                                                                            *
+ ******************************************************************************/
+static void	histwriter_add_batch(zbx_histwriter_t *writer, zbx_ipc_message_t *message)
+{
+	zbx_histwriter_batch_t	*batch;
+	char			*out;
+	size_t			out_size;
+
+	batch = (zbx_histwriter_batch_t *)zbx_calloc(NULL, 1, sizeof(zbx_histwriter_batch_t));
+	batch->format = message->code;
+
+	if (SUCCEED == zbx_history_compress((const char *)message->data, message->size, &out, &out_size))
+	{
+		batch->data = out;
+		batch->size = out_size;
+		batch->deflated = 1;
+	}
+	else
+	{
+		batch->data = (char *)message->data;
+		batch->size = message->size;
+		message->data = NULL;
+	}
+
+	zbx_queue_ptr_push(&writer->queue, batch);
+	writer->queue_size += batch->size;
+
+	histwriter_trim_queue(writer);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: histwriter_post                                                  *
+ *                                                                            *
+ * Purpose: starts posting batch to the history storage                       *
+ *                                                                            *
+ ******************************************************************************/
+static int	histwriter_post(zbx_histwriter_t *writer, zbx_histwriter_batch_t *batch)
+{
+	if (NULL == (batch->handle = zbx_history_curl_get()))
+	{
+		zabbix_log(LOG_LEVEL_ERR, "cannot initialize cURL session");
+		return FAIL;
+	}
+
+	curl_easy_setopt(batch->handle, CURLOPT_URL, ZBX_IPC_HISTWRITER_ROWBINARY == batch->format ?
+			writer->url_rowbinary : writer->url_values);
+	curl_easy_setopt(batch->handle, CURLOPT_POST, 1L);
+	curl_easy_setopt(batch->handle, CURLOPT_POSTFIELDS, batch->data);
+	curl_easy_setopt(batch->handle, CURLOPT_POSTFIELDSIZE, (long)batch->size);
+	curl_easy_setopt(batch->handle, CURLOPT_WRITEFUNCTION, histwriter_discard_cb);
+	curl_easy_setopt(batch->handle, CURLOPT_FAILONERROR, 1L);
+	curl_easy_setopt(batch->handle, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(batch->handle, CURLOPT_TIMEOUT, (long)ZBX_HISTWRITER_POST_TIMEOUT);
+	curl_easy_setopt(batch->handle, CURLOPT_PRIVATE, batch);
+
+	if (0 != batch->deflated)
+		curl_easy_setopt(batch->handle, CURLOPT_HTTPHEADER, writer->headers_deflate);
+
+	curl_multi_add_handle(writer->handle, batch->handle);
+	zbx_vector_ptr_append(&writer->sending, batch);
+
+	if (NULL != batch->path)
+		writer->spool_sending++;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: histwriter_post_finish                                           *
+ *                                                                            *
+ * Purpose: takes finished or aborted post off the multi handle               *
+ *                                                                            *
+ ******************************************************************************/
+static void	histwriter_post_finish(zbx_histwriter_t *writer, zbx_histwriter_batch_t *batch)
+{
+	int	i;
+
+	curl_multi_remove_handle(writer->handle, batch->handle);
+	zbx_history_curl_release(batch->handle);
+	batch->handle = NULL;
+
+	if (FAIL != (i = zbx_vector_ptr_search(&writer->sending, batch, ZBX_DEFAULT_PTR_COMPARE_FUNC)))
+		zbx_vector_ptr_remove_noorder(&writer->sending, i);
+
+	if (NULL != batch->path)
+		writer->spool_sending--;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: histwriter_send                                                  *
+ *                                                                            *
+ * Purpose: starts posting the queued batches, the spooled ones are replayed  *
+ *          when there are no fresh batches                                   *
+ *                                                                            *
+ ******************************************************************************/
+static void	histwriter_send(zbx_histwriter_t *writer, double now)
+{
+	zbx_histwriter_batch_t	*batch;
+
+	if (now < writer->retry_at)
+		return;
+
+	/* the history syncers spool the batches themselves while the writer is not reachable */
+	if (0 == writer->spool.values_num && 0 == writer->spool_sending && writer->spool_scan_at <= now)
+	{
+		histwriter_spool_scan(writer);
+		writer->spool_scan_at = now + ZBX_HISTWRITER_SCAN_PERIOD;
+	}
+
+	while (ZBX_HISTWRITER_SENDING_MAX > writer->sending.values_num)
+	{
+		if (NULL != (batch = (zbx_histwriter_batch_t *)zbx_queue_ptr_pop(&writer->queue)))
+			writer->queue_size -= batch->size;
+		else if (NULL == (batch = histwriter_spool_read(writer)))
+			break;
+
+		if (SUCCEED != histwriter_post(writer, batch))
+		{
+			if (NULL != batch->path)
+			{
+				histwriter_spool_return(writer, batch);
+			}
+			else
+			{
+				zbx_queue_ptr_push(&writer->queue, batch);
+				writer->queue_size += batch->size;
+			}
+
+			break;
+		}
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: histwriter_retry                                                 *
+ *                                                                            *
+ * Purpose: puts batch that failed on transport level back for a later post   *
+ *                                                                            *
+ ******************************************************************************/
+static void	histwriter_retry(zbx_histwriter_t *writer, zbx_histwriter_batch_t *batch, double now)
+{
+	/* the batches in flight fail together, the pause is extended once per round */
+	if (writer->retry_at <= now)
+	{
+		writer->backoff = (0 == writer->backoff ? 1 : MIN(writer->backoff * 2, ZBX_HISTWRITER_BACKOFF_MAX));
+		writer->retry_at = now + writer->backoff;
+	}
+
+	if (NULL != batch->path)
+	{
+		histwriter_spool_return(writer, batch);
+		return;
+	}
+
+	zbx_queue_ptr_push(&writer->queue, batch);
+	writer->queue_size += batch->size;
+
+	histwriter_trim_queue(writer);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: histwriter_perform                                               *
+ *                                                                            *
+ * Purpose: advances the posts in flight and handles the finished ones        *
+ *                                                                            *
+ ******************************************************************************/
+static void	histwriter_perform(zbx_histwriter_t *writer, double now)
+{
+	CURLMsg			*msg;
+	CURLMcode		code;
+	CURLcode		result;
+	int			running, msgnum;
+	long			http_code;
+	zbx_histwriter_batch_t	*batch;
+
+	if (0 == writer->sending.values_num)
+		return;
+
+	if (CURLM_OK != (code = curl_multi_perform(writer->handle, &running)))
+	{
+		zabbix_log(LOG_LEVEL_ERR, "cannot perform on curl multi handle: %s", curl_multi_strerror(code));
+		return;
+	}
+
+	while (NULL != (msg = curl_multi_info_read(writer->handle, &msgnum)))
+	{
+		if (CURLMSG_DONE != msg->msg)
+			continue;
+
+		result = msg->data.result;
+		curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&batch);
+
+		/* If the error is due to malformed data, there is no sense on re-trying to send. */
+		if (CURLE_HTTP_RETURNED_ERROR == result)
+		{
+			curl_easy_getinfo(batch->handle, CURLINFO_RESPONSE_CODE, &http_code);
+			zabbix_log(LOG_LEVEL_ERR, "cannot send data to clickhouse, HTTP error %ld", http_code);
+		}
+		else if (CURLE_OK != result)
+			zabbix_log(LOG_LEVEL_WARNING, "cannot send to clickhouse: %s", curl_easy_strerror(result));
+
+		/* msg is not valid after the handle is removed */
+		histwriter_post_finish(writer, batch);
+
+		switch (result)
+		{
+			case CURLE_OK:
+				writer->sent_num++;
+				writer->backoff = 0;
+				break;
+			case CURLE_HTTP_RETURNED_ERROR:
+				writer->dropped_num++;
+				break;
+			default:
+				histwriter_retry(writer, batch, now);
+				continue;
+		}
+
+		if (NULL != batch->path)
+			histwriter_spool_remove(writer, batch);
+
+		histwriter_batch_free(batch);
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: histwriter_stop                                                  *
+ *                                                                            *
+ * Purpose: spools the batches in memory when the writer is stopped           *
+ *                                                                            *
+ * Comments: The posts in flight are aborted and spooled first, they are      *
+ *           older than the queued batches. Clickhouse might have stored some *
+ *           of them already, those are stored again after the restart.       *
+ *                                                                            *
+ ******************************************************************************/
+static void	histwriter_stop(zbx_histwriter_t *writer)
+{
+	zbx_histwriter_batch_t	*batch;
+	int			batches_num;
+	zbx_uint64_t		dropped_num;
+
+	batches_num = writer->sending.values_num + zbx_queue_ptr_values_num(&writer->queue);
+	dropped_num = writer->dropped_num;
+
+	while (0 != writer->sending.values_num)
+	{
+		batch = (zbx_histwriter_batch_t *)writer->sending.values[0];
+		histwriter_post_finish(writer, batch);
+
+		/* replayed batch is still in its spool file */
+		if (NULL != batch->path)
+			histwriter_batch_free(batch);
+		else
+			histwriter_spool_batch(writer, batch);
+	}
+
+	while (NULL != (batch = (zbx_histwriter_batch_t *)zbx_queue_ptr_pop(&writer->queue)))
+	{
+		writer->queue_size -= batch->size;
+		histwriter_spool_batch(writer, batch);
+	}
+
+	if (0 != batches_num)
+	{
+		zabbix_log(LOG_LEVEL_INFORMATION, "history writer stopped with %d unsent batches, " ZBX_FS_UI64
+				" of them dropped", batches_num, writer->dropped_num - dropped_num);
+	}
+}
+
+static void	histwriter_terminate_handler(int sig)
+{
+	ZBX_UNUSED(sig);
+
+	histwriter_terminate = 1;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: histwriter_init                                                  *
+ *                                                                            *
+ ******************************************************************************/
+static void	histwriter_init(zbx_histwriter_t *writer)
+{
+	char	*base_url, *query, *query_esc;
+
+	memset(writer, 0, sizeof(zbx_histwriter_t));
+
+	if (NULL == (writer->handle = curl_multi_init()))
+	{
+		zabbix_log(LOG_LEVEL_CRIT, "cannot initialize cURL multi session");
+		exit(EXIT_FAILURE);
+	}
+
+	base_url = zbx_strdup(NULL, CONFIG_HISTORY_STORAGE_URL);
+	zbx_rtrim(base_url, "/");
+
+	/* binary body cannot carry the statement, it is passed in the query parameter */
+	query = zbx_dsprintf(NULL, "INSERT INTO %s FORMAT RowBinary", CONFIG_HISTORY_STORAGE_TABLE_NAME);
+	query_esc = curl_easy_escape(NULL, query, 0);
+	writer->url_rowbinary = zbx_dsprintf(NULL, "%s/?query=%s", base_url, query_esc);
+	writer->url_values = base_url;
+	curl_free(query_esc);
+	zbx_free(query);
+
+	writer->headers_deflate = curl_slist_append(NULL, ZBX_HISTORY_CONTENT_ENCODING);
+
+	zbx_queue_ptr_create(&writer->queue);
+	zbx_vector_ptr_create(&writer->spool);
+
+	zbx_vector_ptr_create(&writer->sending);
+
+	histwriter_spool_scan(writer);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: history_writer_thread                                            *
+ *                                                                            *
+ * Purpose: posts the history batches of history syncers to clickhouse        *
+ *                                                                            *
+ * Comments: the syncers only pass the batches over IPC. The batches are      *
+ *           compressed and posted here without blocking, posts that fail on  *
+ *           transport level are retried with growing pauses and the batches  *
+ *           over the memory limit are spooled to HistoryStorageSpoolDir.     *
+ *           The multi handle lives as long as the process, so its            *
+ *           connections to clickhouse are kept alive between the posts.      *
+ *           The writer is stopped after the final history sync of the main   *
+ *           process, the batches it has not posted by then are spooled.      *
+ *                                                                            *
+ ******************************************************************************/
+ZBX_THREAD_ENTRY(history_writer_thread, args)
+{
+	zbx_ipc_service_t	service;
+	zbx_ipc_client_t	*client;
+	zbx_ipc_message_t	*message;
+	zbx_histwriter_t	writer;
+	char			*error = NULL;
+	int			ret, fds;
+	double			time_stat, time_idle = 0, time_now, sec;
+	struct sigaction	phan;
+
+#define	STAT_INTERVAL	5	/* if a process is busy and does not sleep then update status not faster than */
+				/* once in STAT_INTERVAL seconds */
+
+	process_type = ((zbx_thread_args_t *)args)->process_type;
+	server_num = ((zbx_thread_args_t *)args)->server_num;
+	process_num = ((zbx_thread_args_t *)args)->process_num;
+
+	zbx_setproctitle("%s #%d starting", get_process_type_string(process_type), process_num);
+
+	zabbix_log(LOG_LEVEL_INFORMATION, "%s #%d started [%s #%d]", get_program_type_string(program_type),
+			server_num, get_process_type_string(process_type), process_num);
+
+	if (FAIL == zbx_ipc_service_start(&service, ZBX_IPC_SERVICE_HISTWRITER, &error))
+	{
+		zabbix_log(LOG_LEVEL_CRIT, "cannot start history writer service: %s", error);
+		zbx_free(error);
+		exit(EXIT_FAILURE);
+	}
+
+	histwriter_init(&writer);
+
+	sigemptyset(&phan.sa_mask);
+	phan.sa_flags = 0;
+	phan.sa_handler = histwriter_terminate_handler;
+	sigaction(SIGTERM, &phan, NULL);
+
+	time_stat = zbx_time();
+
+	zbx_setproctitle("%s #%d started", get_process_type_string(process_type), process_num);
+
+	update_selfmon_counter(ZBX_PROCESS_STATE_BUSY);
+
+	while (0 == histwriter_terminate)
+	{
+		time_now = zbx_time();
+
+		if (STAT_INTERVAL < time_now - time_stat)
+		{
+			zbx_setproctitle("%s #%d [sent " ZBX_FS_UI64 ", spooled " ZBX_FS_UI64 ", dropped " ZBX_FS_UI64
+					" batches, queued %d, spool %d, idle " ZBX_FS_DBL " sec during " ZBX_FS_DBL
+					" sec]", get_process_type_string(process_type), process_num, writer.sent_num,
+					writer.spooled_num, writer.dropped_num, zbx_queue_ptr_values_num(&writer.queue),
+					writer.spool.values_num, time_idle, time_now - time_stat);
+
+			time_stat = time_now;
+			time_idle = 0;
+			writer.sent_num = 0;
+			writer.spooled_num = 0;
+			writer.dropped_num = 0;
+		}
+
+		update_selfmon_counter(ZBX_PROCESS_STATE_IDLE);
+
+		/* while posting, the network is waited for in short slices so the syncers are not kept waiting */
+		if (0 != writer.sending.values_num)
+		{
+			curl_multi_wait(writer.handle, NULL, 0, ZBX_HISTWRITER_WAIT_MS, &fds);
+			ret = zbx_ipc_service_recv(&service, 0, &client, &message);
+		}
+		else
+			ret = zbx_ipc_service_recv(&service, 1, &client, &message);
+
+		update_selfmon_counter(ZBX_PROCESS_STATE_BUSY);
+		sec = zbx_time();
+		zbx_update_env(sec);
+
+		if (ZBX_IPC_RECV_IMMEDIATE != ret)
+			time_idle += sec - time_now;
+
+		while (NULL != message)
+		{
+			switch (message->code)
+			{
+				case ZBX_IPC_HISTWRITER_VALUES:
+				case ZBX_IPC_HISTWRITER_ROWBINARY:
+					histwriter_add_batch(&writer, message);
+					break;
+			}
+
+			zbx_ipc_message_free(message);
+			zbx_ipc_client_release(client);
+
+			zbx_ipc_service_recv(&service, 0, &client, &message);
+		}
+
+		if (NULL != client)
+			zbx_ipc_client_release(client);
+
+		histwriter_perform(&writer, sec);
+		histwriter_send(&writer, sec);
+	}
+
+	zbx_setproctitle("%s #%d [stopping]", get_process_type_string(process_type), process_num);
+
+	/* the batches written before the termination signal are still in the sockets */
+	while (ZBX_IPC_RECV_TIMEOUT != zbx_ipc_service_recv(&service, 1, &client, &message))
+	{
+		if (NULL != message)
+		{
+			if (ZBX_IPC_HISTWRITER_VALUES == message->code || ZBX_IPC_HISTWRITER_ROWBINARY == message->code)
+				histwriter_add_batch(&writer, message);
+
+			zbx_ipc_message_free(message);
+		}
+
+		if (NULL != client)
+			zbx_ipc_client_release(client);
+	}
+
+	histwriter_stop(&writer);
+
+	zbx_ipc_service_close(&service);
+
+	zabbix_log(LOG_LEVEL_INFORMATION, "%s #%d stopped [%s #%d]", get_program_type_string(program_type),
+			server_num, get_process_type_string(process_type), process_num);
+
+	exit(EXIT_SUCCESS);
+#undef STAT_INTERVAL
+}
+
+#else
+
+ZBX_THREAD_ENTRY(history_writer_thread, args)
+{
+	process_type = ((zbx_thread_args_t *)args)->process_type;
+	server_num = ((zbx_thread_args_t *)args)->server_num;
+	process_num = ((zbx_thread_args_t *)args)->process_num;
+
+	zabbix_log(LOG_LEVEL_WARNING, "%s #%d started [%s #%d]: cURL library support >= 7.28.0 is required",
+			get_program_type_string(program_type), server_num, get_process_type_string(process_type),
+			process_num);
+
+	for (;;)
+		zbx_sleep_loop(SEC_PER_HOUR);
+}
+
+#endif
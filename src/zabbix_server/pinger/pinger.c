@@ -142,57 +142,55 @@ static void	process_values(icmpitem_t *items, int first_index, int last_index, Z
 					" min=" ZBX_FS_DBL " max=" ZBX_FS_DBL " sum=" ZBX_FS_DBL,
 					host->addr, host->cnt, host->rcv, host->min, host->max, host->sum);
 		}
+	}
+
+	for (i = first_index; i < last_index; i++)
+	{
+		const icmpitem_t	*item = &items[i];
+		const ZBX_FPING_HOST	*host = &hosts[item->host_index];
+
+		if (NOTSUPPORTED == ping_result)
+		{
+			process_value(item->itemid, NULL, NULL, ts, NOTSUPPORTED, error);
+			continue;
+		}
+
+		if (0 == host->cnt)
+		{
+			process_value(item->itemid, NULL, NULL, ts, NOTSUPPORTED,
+					(char *)"Cannot send ICMP ping packets to this host.");
+			continue;
+		}
 
-		for (i = first_index; i < last_index; i++)
+		switch (item->icmpping)
 		{
-			const icmpitem_t	*item = &items[i];
-
-			if (0 != strcmp(item->addr, host->addr))
-				continue;
-
-			if (NOTSUPPORTED == ping_result)
-			{
-				process_value(item->itemid, NULL, NULL, ts, NOTSUPPORTED, error);
-				continue;
-			}
-
-			if (0 == host->cnt)
-			{
-				process_value(item->itemid, NULL, NULL, ts, NOTSUPPORTED,
-						(char *)"Cannot send ICMP ping packets to this host.");
-				continue;
-			}
-
-			switch (item->icmpping)
-			{
-				case ICMPPING:
-					value_uint64 = (0 != host->rcv ? 1 : 0);
-					process_value(item->itemid, &value_uint64, NULL, ts, SUCCEED, NULL);
-					break;
-				case ICMPPINGSEC:
-					switch (item->type)
-					{
-						case ICMPPINGSEC_MIN:
-							value_dbl = host->min;
-							break;
-						case ICMPPINGSEC_MAX:
-							value_dbl = host->max;
-							break;
-						case ICMPPINGSEC_AVG:
-							value_dbl = (0 != host->rcv ? host->sum / host->rcv : 0);
-							break;
-					}
-
-					if (0 < value_dbl && ZBX_FLOAT_PRECISION > value_dbl)
-						value_dbl = ZBX_FLOAT_PRECISION;
-
-					process_value(item->itemid, NULL, &value_dbl, ts, SUCCEED, NULL);
-					break;
-				case ICMPPINGLOSS:
-					value_dbl = (100 * (host->cnt - host->rcv)) / (double)host->cnt;
-					process_value(item->itemid, NULL, &value_dbl, ts, SUCCEED, NULL);
-					break;
-			}
+			case ICMPPING:
+				value_uint64 = (0 != host->rcv ? 1 : 0);
+				process_value(item->itemid, &value_uint64, NULL, ts, SUCCEED, NULL);
+				break;
+			case ICMPPINGSEC:
+				switch (item->type)
+				{
+					case ICMPPINGSEC_MIN:
+						value_dbl = host->min;
+						break;
+					case ICMPPINGSEC_MAX:
+						value_dbl = host->max;
+						break;
+					case ICMPPINGSEC_AVG:
+						value_dbl = (0 != host->rcv ? host->sum / host->rcv : 0);
+						break;
+				}
+
+				if (0 < value_dbl && ZBX_FLOAT_PRECISION > value_dbl)
+					value_dbl = ZBX_FLOAT_PRECISION;
+
+				process_value(item->itemid, NULL, &value_dbl, ts, SUCCEED, NULL);
+				break;
+			case ICMPPINGLOSS:
+				value_dbl = (100 * (host->cnt - host->rcv)) / (double)host->cnt;
+				process_value(item->itemid, NULL, &value_dbl, ts, SUCCEED, NULL);
+				break;
 		}
 	}
 
@@ -477,27 +475,51 @@ static void	free_hosts(icmpitem_t **items, int *items_count)
 	*items_count = 0;
 }
 
-static void	add_pinger_host(ZBX_FPING_HOST **hosts, int *hosts_alloc, int *hosts_count, char *addr)
+typedef struct
+{
+	const char	*addr;
+	int		index;
+}
+zbx_pinger_host_index_t;
+
+static zbx_hash_t	pinger_host_index_hash(const void *data)
 {
-	const char	*__function_name = "add_pinger_host";
+	const char	*addr = ((const zbx_pinger_host_index_t *)data)->addr;
 
-	int		i;
-	size_t		sz;
-	ZBX_FPING_HOST	*h;
+	return ZBX_DEFAULT_STRING_HASH_ALGO(addr, strlen(addr), ZBX_DEFAULT_HASH_SEED);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: add_pinger_host                                                  *
+ *                                                                            *
+ * Purpose: add host address to the ping list unless it is already there      *
+ *                                                                            *
+ * Return value: index of the host in the ping list                           *
+ *                                                                            *
+ ******************************************************************************/
+static int	add_pinger_host(ZBX_FPING_HOST **hosts, int *hosts_alloc, int *hosts_count, zbx_hashset_t *hosts_index,
+		char *addr)
+{
+	const char		*__function_name = "add_pinger_host";
+
+	size_t			sz;
+	ZBX_FPING_HOST		*h;
+	zbx_pinger_host_index_t	host_index_local, *host_index;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s() addr:'%s'", __function_name, addr);
 
-	for (i = 0; i < *hosts_count; i++)
-	{
-		if (0 == strcmp(addr, (*hosts)[i].addr))
-			return;
-	}
+	host_index_local.addr = addr;
+
+	if (NULL != (host_index = (zbx_pinger_host_index_t *)zbx_hashset_search(hosts_index, &host_index_local)))
+		return host_index->index;
 
-	(*hosts_count)++;
+	host_index_local.index = (*hosts_count)++;
+	zbx_hashset_insert(hosts_index, &host_index_local, sizeof(host_index_local));
 
 	if (*hosts_alloc < *hosts_count)
 	{
-		*hosts_alloc += 4;
+		*hosts_alloc *= 2;
 		sz = *hosts_alloc * sizeof(ZBX_FPING_HOST);
 		*hosts = (ZBX_FPING_HOST *)zbx_realloc(*hosts, sz);
 	}
@@ -507,6 +529,8 @@ static void	add_pinger_host(ZBX_FPING_HOST **hosts, int *hosts_alloc, int *hosts
 	h->addr = addr;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+
+	return host_index_local.index;
 }
 
 /******************************************************************************
@@ -533,15 +557,19 @@ static void	process_pinger_hosts(icmpitem_t *items, int items_count)
 	static int		hosts_alloc = 4;
 	int			hosts_count = 0;
 	zbx_timespec_t		ts;
+	zbx_hashset_t		hosts_index;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
 	if (NULL == hosts)
 		hosts = (ZBX_FPING_HOST *)zbx_malloc(hosts, sizeof(ZBX_FPING_HOST) * hosts_alloc);
 
+	zbx_hashset_create(&hosts_index, 100, pinger_host_index_hash, ZBX_DEFAULT_STR_COMPARE_FUNC);
+
 	for (i = 0; i < items_count; i++)
 	{
-		add_pinger_host(&hosts, &hosts_alloc, &hosts_count, items[i].addr);
+		items[i].host_index = add_pinger_host(&hosts, &hosts_alloc, &hosts_count, &hosts_index,
+				items[i].addr);
 
 		if (i == items_count - 1 || items[i].count != items[i + 1].count || items[i].interval != items[i + 1].interval ||
 				items[i].size != items[i + 1].size || items[i].timeout != items[i + 1].timeout)
@@ -559,9 +587,12 @@ static void	process_pinger_hosts(icmpitem_t *items, int items_count)
 
 			hosts_count = 0;
 			first_index = i + 1;
+			zbx_hashset_clear(&hosts_index);
 		}
 	}
 
+	zbx_hashset_destroy(&hosts_index);
+
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
 
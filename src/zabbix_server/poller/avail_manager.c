@@ -0,0 +1,570 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2018 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "common.h"
+
+#include "log.h"
+#include "daemon.h"
+#include "db.h"
+#include "dbcache.h"
+#include "zbxself.h"
+#include "zbxipcservice.h"
+#include "zbxserialize.h"
+
+#include "avail_manager.h"
+
+extern unsigned char	process_type, program_type;
+extern int		server_num, process_num;
+
+/*
+ * Async and unreachable pollers collect host availability changes during a poll round and pass them to the
+ * availability manager, which writes them into database. A slow or locked database then delays only the
+ * manager and never the requests the pollers keep in flight.
+ */
+
+#ifdef HAVE_IPCSERVICE
+
+/* the poller side connection to the manager, written without blocking */
+static zbx_ipc_socket_t	manager_socket = {-1};
+static unsigned char	*manager_tx = NULL;
+static size_t		manager_tx_alloc = 0, manager_tx_size = 0, manager_tx_offset = 0;
+
+/* the changes not sent yet, zbx_host_availability_t by hostid */
+static zbx_hashset_t	manager_queue;
+static int		manager_queue_initialized = 0;
+
+static volatile sig_atomic_t	availman_terminate = 0;
+
+/******************************************************************************
+ *                                                                            *
+ * Function: availability_serialize                                           *
+ *                                                                            *
+ * Purpose: packs host availability changes into IPC message data            *
+ *                                                                            *
+ * Parameters: data  - [OUT] the packed data                                  *
+ *             hosts - [IN] the host availability changes                     *
+ *                          (zbx_host_availability_t *)                       *
+ *                                                                            *
+ * Return value: the size of packed data                                      *
+ *                                                                            *
+ ******************************************************************************/
+static zbx_uint32_t	availability_serialize(unsigned char **data, const zbx_vector_ptr_t *hosts)
+{
+	zbx_uint32_t			data_len = 0, error_len;
+	const zbx_host_availability_t	*ha;
+	const zbx_agent_availability_t	*agent;
+	const char			*error;
+	unsigned char			*ptr;
+	int				i, j;
+
+	zbx_serialize_prepare_value(data_len, hosts->values_num);
+
+	for (i = 0; i < hosts->values_num; i++)
+	{
+		ha = (const zbx_host_availability_t *)hosts->values[i];
+
+		zbx_serialize_prepare_value(data_len, ha->hostid);
+
+		for (j = 0; j < ZBX_AGENT_MAX; j++)
+		{
+			agent = &ha->agents[j];
+			error = agent->error;
+
+			zbx_serialize_prepare_value(data_len, agent->flags);
+			zbx_serialize_prepare_value(data_len, agent->available);
+			zbx_serialize_prepare_str(data_len, error);
+			zbx_serialize_prepare_value(data_len, agent->errors_from);
+			zbx_serialize_prepare_value(data_len, agent->disable_until);
+		}
+	}
+
+	*data = (unsigned char *)zbx_malloc(NULL, data_len);
+	ptr = *data;
+
+	ptr += zbx_serialize_value(ptr, hosts->values_num);
+
+	for (i = 0; i < hosts->values_num; i++)
+	{
+		ha = (const zbx_host_availability_t *)hosts->values[i];
+
+		ptr += zbx_serialize_value(ptr, ha->hostid);
+
+		for (j = 0; j < ZBX_AGENT_MAX; j++)
+		{
+			agent = &ha->agents[j];
+			error = agent->error;
+			error_len = (NULL != error ? strlen(error) + 1 : 0);
+
+			ptr += zbx_serialize_value(ptr, agent->flags);
+			ptr += zbx_serialize_value(ptr, agent->available);
+			ptr += zbx_serialize_str(ptr, error, error_len);
+			ptr += zbx_serialize_value(ptr, agent->errors_from);
+			ptr += zbx_serialize_value(ptr, agent->disable_until);
+		}
+	}
+
+	return data_len;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: availability_deserialize                                         *
+ *                                                                            *
+ * Purpose: unpacks host availability changes from IPC message data          *
+ *                                                                            *
+ * Parameters: data  - [IN] the packed data                                   *
+ *             hosts - [OUT] the host availability changes                    *
+ *                           (zbx_host_availability_t *)                      *
+ *                                                                            *
+ ******************************************************************************/
+static void	availability_deserialize(const unsigned char *data, zbx_vector_ptr_t *hosts)
+{
+	zbx_host_availability_t		*ha;
+	zbx_agent_availability_t	*agent;
+	zbx_uint32_t			error_len;
+	int				i, j, hosts_num;
+
+	data += zbx_deserialize_value(data, &hosts_num);
+
+	zbx_vector_ptr_reserve(hosts, hosts->values_num + hosts_num);
+
+	for (i = 0; i < hosts_num; i++)
+	{
+		ha = (zbx_host_availability_t *)zbx_malloc(NULL, sizeof(zbx_host_availability_t));
+
+		data += zbx_deserialize_value(data, &ha->hostid);
+
+		for (j = 0; j < ZBX_AGENT_MAX; j++)
+		{
+			agent = &ha->agents[j];
+
+			data += zbx_deserialize_value(data, &agent->flags);
+			data += zbx_deserialize_value(data, &agent->available);
+			data += zbx_deserialize_str(data, &agent->error, error_len);
+			data += zbx_deserialize_value(data, &agent->errors_from);
+			data += zbx_deserialize_value(data, &agent->disable_until);
+		}
+
+		zbx_vector_ptr_append(hosts, ha);
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: availability_merge                                               *
+ *                                                                            *
+ * Purpose: adds host availability change to the changes not sent yet, the    *
+ *          newer fields of the same host replace the older ones              *
+ *                                                                            *
+ ******************************************************************************/
+static void	availability_merge(const zbx_host_availability_t *ha)
+{
+	zbx_host_availability_t		*queued, ha_local;
+	zbx_agent_availability_t	*dst;
+	const zbx_agent_availability_t	*src;
+	int				i;
+
+	if (NULL == (queued = (zbx_host_availability_t *)zbx_hashset_search(&manager_queue, &ha->hostid)))
+	{
+		zbx_host_availability_init(&ha_local, ha->hostid);
+		queued = (zbx_host_availability_t *)zbx_hashset_insert(&manager_queue, &ha_local, sizeof(ha_local));
+	}
+
+	for (i = 0; i < ZBX_AGENT_MAX; i++)
+	{
+		src = &ha->agents[i];
+		dst = &queued->agents[i];
+
+		if (0 != (src->flags & ZBX_FLAGS_AGENT_STATUS_AVAILABLE))
+			dst->available = src->available;
+
+		if (0 != (src->flags & ZBX_FLAGS_AGENT_STATUS_ERROR))
+			dst->error = zbx_strdup(dst->error, src->error);
+
+		if (0 != (src->flags & ZBX_FLAGS_AGENT_STATUS_ERRORS_FROM))
+			dst->errors_from = src->errors_from;
+
+		if (0 != (src->flags & ZBX_FLAGS_AGENT_STATUS_DISABLE_UNTIL))
+			dst->disable_until = src->disable_until;
+
+		dst->flags |= src->flags;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: availability_write                                               *
+ *                                                                            *
+ * Purpose: writes as much of the message being sent as the socket takes      *
+ *          without blocking                                                  *
+ *                                                                            *
+ * Return value: SUCCEED - the message was sent or the rest is kept for the   *
+ *                         next call                                          *
+ *               FAIL    - the connection has failed                          *
+ *                                                                            *
+ ******************************************************************************/
+static int	availability_write(void)
+{
+	ssize_t	n;
+
+	while (manager_tx_offset != manager_tx_size)
+	{
+		if (-1 == (n = write(manager_socket.fd, manager_tx + manager_tx_offset,
+				manager_tx_size - manager_tx_offset)))
+		{
+			if (EINTR == errno)
+				continue;
+
+			if (EAGAIN == errno || EWOULDBLOCK == errno)
+				return SUCCEED;
+
+			zabbix_log(LOG_LEVEL_WARNING, "cannot send host availability to availability manager service:"
+					" %s", zbx_strerror(errno));
+			return FAIL;
+		}
+
+		manager_tx_offset += (size_t)n;
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: availability_connect                                             *
+ *                                                                            *
+ * Purpose: opens non-blocking connection to the availability manager         *
+ *                                                                            *
+ ******************************************************************************/
+static int	availability_connect(void)
+{
+	char	*error = NULL;
+	int	flags;
+
+	if (FAIL == zbx_ipc_socket_open(&manager_socket, ZBX_IPC_SERVICE_AVAILABILITY, 0, &error))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot connect to availability manager service: %s", error);
+		zbx_free(error);
+		manager_socket.fd = -1;
+		return FAIL;
+	}
+
+	if (-1 == (flags = fcntl(manager_socket.fd, F_GETFL, 0)) ||
+			-1 == fcntl(manager_socket.fd, F_SETFL, flags | O_NONBLOCK))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot make availability manager connection non-blocking: %s",
+				zbx_strerror(errno));
+		zbx_ipc_socket_close(&manager_socket);
+		manager_socket.fd = -1;
+		return FAIL;
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_availability_send                                            *
+ *                                                                            *
+ * Purpose: passes host availability changes to the availability manager     *
+ *          without waiting for it                                            *
+ *                                                                            *
+ * Parameters: hosts - [IN/OUT] the host availability changes                 *
+ *                              (zbx_host_availability_t *), taken from the   *
+ *                              vector. On failure the vector gets all the    *
+ *                              changes not sent yet.                         *
+ *                                                                            *
+ * Return value: SUCCEED - the changes were sent or kept to be sent later     *
+ *               FAIL    - the manager is not reachable, the caller has to    *
+ *                         write the returned changes itself                  *
+ *                                                                            *
+ * Comments: While the manager is writing into database it does not read its  *
+ *           socket, so the changes that do not fit into the socket buffer    *
+ *           are kept and sent with the next call. The kept changes are       *
+ *           merged by host, so they take memory for one change per host at   *
+ *           most. Should be called every poller round, even without changes, *
+ *           to send the kept ones.                                           *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_availability_send(zbx_vector_ptr_t *hosts)
+{
+	zbx_hashset_iter_t		iter;
+	zbx_host_availability_t		*ha;
+	zbx_vector_ptr_t		queued;
+	unsigned char			*data;
+	zbx_uint32_t			data_len, header[2];
+	int				i;
+
+	if (0 == manager_queue_initialized)
+	{
+		zbx_hashset_create_ext(&manager_queue, 100, ZBX_DEFAULT_UINT64_HASH_FUNC,
+				ZBX_DEFAULT_UINT64_COMPARE_FUNC, (zbx_clean_func_t)zbx_host_availability_clean,
+				ZBX_DEFAULT_MEM_MALLOC_FUNC, ZBX_DEFAULT_MEM_REALLOC_FUNC, ZBX_DEFAULT_MEM_FREE_FUNC);
+		manager_queue_initialized = 1;
+	}
+
+	for (i = 0; i < hosts->values_num; i++)
+		availability_merge((zbx_host_availability_t *)hosts->values[i]);
+
+	zbx_vector_ptr_clear_ext(hosts, (zbx_mem_free_func_t)zbx_host_availability_free);
+
+	if (-1 == manager_socket.fd && SUCCEED != availability_connect())
+		goto fail;
+
+	if (SUCCEED != availability_write())
+		goto fail;
+
+	if (manager_tx_offset != manager_tx_size || 0 == manager_queue.num_data)
+		return SUCCEED;
+
+	/* the next message is formatted only after the previous one is sent completely */
+	zbx_vector_ptr_create(&queued);
+	zbx_hashset_iter_reset(&manager_queue, &iter);
+
+	while (NULL != (ha = (zbx_host_availability_t *)zbx_hashset_iter_next(&iter)))
+		zbx_vector_ptr_append(&queued, ha);
+
+	data_len = availability_serialize(&data, &queued);
+	zbx_vector_ptr_destroy(&queued);
+	zbx_hashset_clear(&manager_queue);
+
+	/* the message is framed the same way as by zbx_ipc_socket_write(): code and size followed by data */
+	header[0] = ZBX_IPC_AVAILABILITY_UPDATE;
+	header[1] = data_len;
+
+	manager_tx_size = sizeof(header) + data_len;
+
+	if (manager_tx_alloc < manager_tx_size)
+	{
+		manager_tx_alloc = manager_tx_size;
+		manager_tx = (unsigned char *)zbx_realloc(manager_tx, manager_tx_alloc);
+	}
+
+	memcpy(manager_tx, header, sizeof(header));
+	memcpy(manager_tx + sizeof(header), data, data_len);
+	manager_tx_offset = 0;
+	zbx_free(data);
+
+	if (SUCCEED != availability_write())
+		goto fail;
+
+	return SUCCEED;
+fail:
+	/* the manager has gone, the message not sent completely is lost with the connection */
+	if (-1 != manager_socket.fd)
+	{
+		zbx_ipc_socket_close(&manager_socket);
+		manager_socket.fd = -1;
+	}
+
+	manager_tx_offset = manager_tx_size = 0;
+
+	zbx_hashset_iter_reset(&manager_queue, &iter);
+
+	while (NULL != (ha = (zbx_host_availability_t *)zbx_hashset_iter_next(&iter)))
+	{
+		zbx_host_availability_t	*copy;
+
+		copy = (zbx_host_availability_t *)zbx_malloc(NULL, sizeof(zbx_host_availability_t));
+		*copy = *ha;
+		zbx_vector_ptr_append(hosts, copy);
+
+		/* the error strings are passed to the copy */
+		memset(ha->agents, 0, sizeof(ha->agents));
+	}
+
+	zbx_hashset_clear(&manager_queue);
+
+	return FAIL;
+}
+
+static void	availman_terminate_handler(int sig)
+{
+	ZBX_UNUSED(sig);
+
+	availman_terminate = 1;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: availman_flush                                                   *
+ *                                                                            *
+ * Purpose: writes the received host availability changes into database      *
+ *                                                                            *
+ * Return value: the number of written changes                                *
+ *                                                                            *
+ ******************************************************************************/
+static int	availman_flush(zbx_vector_ptr_t *hosts)
+{
+	int	hosts_num = hosts->values_num;
+
+	if (0 == hosts_num)
+		return 0;
+
+	zbx_db_update_hosts_availability(hosts);
+	zbx_vector_ptr_clear_ext(hosts, (zbx_mem_free_func_t)zbx_host_availability_free);
+
+	return hosts_num;
+}
+
+ZBX_THREAD_ENTRY(availability_manager_thread, args)
+{
+	zbx_ipc_service_t	service;
+	zbx_ipc_client_t	*client;
+	zbx_ipc_message_t	*message;
+	zbx_vector_ptr_t	hosts;
+	char			*error = NULL;
+	int			ret, written_num = 0;
+	double			time_stat, time_idle = 0, time_now, sec;
+	struct sigaction	phan;
+
+#define	STAT_INTERVAL	5	/* if a process is busy and does not sleep then update status not faster than */
+				/* once in STAT_INTERVAL seconds */
+
+	process_type = ((zbx_thread_args_t *)args)->process_type;
+	server_num = ((zbx_thread_args_t *)args)->server_num;
+	process_num = ((zbx_thread_args_t *)args)->process_num;
+
+	zbx_setproctitle("%s #%d starting", get_process_type_string(process_type), process_num);
+
+	zabbix_log(LOG_LEVEL_INFORMATION, "%s #%d started [%s #%d]", get_program_type_string(program_type),
+			server_num, get_process_type_string(process_type), process_num);
+
+	if (FAIL == zbx_ipc_service_start(&service, ZBX_IPC_SERVICE_AVAILABILITY, &error))
+	{
+		zabbix_log(LOG_LEVEL_CRIT, "cannot start availability manager service: %s", error);
+		zbx_free(error);
+		exit(EXIT_FAILURE);
+	}
+
+	/* the manager is stopped after the pollers to write their last changes */
+	sigemptyset(&phan.sa_mask);
+	phan.sa_flags = 0;
+	phan.sa_handler = availman_terminate_handler;
+	sigaction(SIGTERM, &phan, NULL);
+
+	zbx_vector_ptr_create(&hosts);
+
+	zbx_setproctitle("%s #%d [connecting to the database]", get_process_type_string(process_type), process_num);
+
+	DBconnect(ZBX_DB_CONNECT_NORMAL);
+
+	time_stat = zbx_time();
+
+	zbx_setproctitle("%s #%d started", get_process_type_string(process_type), process_num);
+
+	update_selfmon_counter(ZBX_PROCESS_STATE_BUSY);
+
+	while (0 == availman_terminate)
+	{
+		time_now = zbx_time();
+
+		if (STAT_INTERVAL < time_now - time_stat)
+		{
+			zbx_setproctitle("%s #%d [written %d host changes, idle " ZBX_FS_DBL " sec during "
+					ZBX_FS_DBL " sec]", get_process_type_string(process_type), process_num,
+					written_num, time_idle, time_now - time_stat);
+
+			time_stat = time_now;
+			time_idle = 0;
+			written_num = 0;
+		}
+
+		update_selfmon_counter(ZBX_PROCESS_STATE_IDLE);
+		ret = zbx_ipc_service_recv(&service, 1, &client, &message);
+		update_selfmon_counter(ZBX_PROCESS_STATE_BUSY);
+		sec = zbx_time();
+		zbx_update_env(sec);
+
+		if (ZBX_IPC_RECV_IMMEDIATE != ret)
+			time_idle += sec - time_now;
+
+		/* the changes queued while the previous ones were written go to database in one transaction */
+		while (NULL != message)
+		{
+			if (ZBX_IPC_AVAILABILITY_UPDATE == message->code)
+				availability_deserialize(message->data, &hosts);
+
+			zbx_ipc_message_free(message);
+			zbx_ipc_client_release(client);
+
+			zbx_ipc_service_recv(&service, 0, &client, &message);
+		}
+
+		if (NULL != client)
+			zbx_ipc_client_release(client);
+
+		written_num += availman_flush(&hosts);
+	}
+
+	zbx_setproctitle("%s #%d [stopping]", get_process_type_string(process_type), process_num);
+
+	/* the changes sent before the pollers stopped are still in the sockets */
+	while (ZBX_IPC_RECV_TIMEOUT != zbx_ipc_service_recv(&service, 1, &client, &message))
+	{
+		if (NULL != message)
+		{
+			if (ZBX_IPC_AVAILABILITY_UPDATE == message->code)
+				availability_deserialize(message->data, &hosts);
+
+			zbx_ipc_message_free(message);
+		}
+
+		if (NULL != client)
+			zbx_ipc_client_release(client);
+	}
+
+	availman_flush(&hosts);
+	zbx_vector_ptr_destroy(&hosts);
+
+	DBclose();
+
+	zbx_ipc_service_close(&service);
+
+	zabbix_log(LOG_LEVEL_INFORMATION, "%s #%d stopped [%s #%d]", get_program_type_string(program_type),
+			server_num, get_process_type_string(process_type), process_num);
+
+	exit(EXIT_SUCCESS);
+#undef STAT_INTERVAL
+}
+
+#else
+
+int	zbx_availability_send(zbx_vector_ptr_t *hosts)
+{
+	ZBX_UNUSED(hosts);
+
+	return FAIL;
+}
+
+ZBX_THREAD_ENTRY(availability_manager_thread, args)
+{
+	process_type = ((zbx_thread_args_t *)args)->process_type;
+	server_num = ((zbx_thread_args_t *)args)->server_num;
+	process_num = ((zbx_thread_args_t *)args)->process_num;
+
+	zabbix_log(LOG_LEVEL_WARNING, "%s #%d started [%s #%d]: IPC services support is required",
+			get_program_type_string(program_type), server_num, get_process_type_string(process_type),
+			process_num);
+
+	for (;;)
+		zbx_sleep_loop(SEC_PER_HOUR);
+}
+
+#endif
@@ -0,0 +1,35 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2018 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#ifndef ZABBIX_AVAIL_MANAGER_H
+#define ZABBIX_AVAIL_MANAGER_H
+
+#include "common.h"
+#include "threads.h"
+#include "zbxalgo.h"
+
+#define ZBX_IPC_SERVICE_AVAILABILITY	"availability"
+
+#define ZBX_IPC_AVAILABILITY_UPDATE	1	/* host availability changes */
+
+int	zbx_availability_send(zbx_vector_ptr_t *hosts);
+
+ZBX_THREAD_ENTRY(availability_manager_thread, args);
+
+#endif
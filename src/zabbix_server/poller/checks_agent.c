@@ -18,11 +18,18 @@
 **/
 
 #include "common.h"
+
+#ifdef HAVE_LIBEVENT
+#	include <event.h>
+#endif
+
 #include "comms.h"
 #include "log.h"
+#include "../../libs/zbxcrypto/tls_tcp.h"
 #include "../../libs/zbxcrypto/tls_tcp_active.h"
 
 #include "checks_agent.h"
+#include "resolver.h"
 
 #if !(defined(HAVE_POLARSSL) || defined(HAVE_GNUTLS) || defined(HAVE_OPENSSL))
 extern unsigned char	program_type;
@@ -153,167 +160,747 @@ out:
 	return ret;
 }
 
-#define INIT			10
-#define SKIPPED			11
-#define SOCKET_CREATED	12
-#define CONNECT_SENT	13
+#ifdef HAVE_LIBEVENT
+
+#define SOCKET_CREATED		12
+#define CONNECT_SENT		13
 #define REQ_SENT		14
 #define	CLOSED			15
+#define TLS_HANDSHAKE		16
 #define ZBX_AGENT_MAX_RESPONSE_TIME 2
 
-//this function follows the socket status and 
-//handles operations according to the socket state
-void handle_socket_operation(zbx_socket_t *socket, DC_ITEM * item, int *errcode, int *conn_status, 
-						 AGENT_RESULT *result, int *active_agents) 
+/* agents serve StartAgents=3 connections at once by default, the rest would wait in the listen queue */
+#define ZBX_AGENT_HOST_MAX_CONNECTIONS	3
+
+#define ZBX_AGENT_RECV_MORE	1
+
+/* "ZBXD", protocol flags, data length and reserved field of the Zabbix protocol header */
+#define ZBX_AGENT_HEADER_DATA	"ZBXD"
+#define ZBX_AGENT_HEADER_LEN	(ZBX_CONST_STRLEN(ZBX_AGENT_HEADER_DATA) + 1 + 2 * sizeof(zbx_uint32_t))
+
+/* the connections to one agent interface, opened in waves of ZBX_AGENT_HOST_MAX_CONNECTIONS */
+typedef struct
 {
-	
-	ZBX_SOCKADDR	servaddr_in;
-	struct hostent	*hp;
-	ssize_t		received_len;
-	
-	int status;
+	zbx_uint64_t		interfaceid;
+	int			active;		/* the connections in progress */
+	int			next;		/* the first connection in the queue waiting for its turn */
+	int			starting;	/* the connections are being started, see agent_host_start() */
+	zbx_vector_ptr_t	queue;
+}
+zbx_agent_host_t;
 
-	switch (*conn_status) {
-		case SOCKET_CREATED:
-			zabbix_log(LOG_LEVEL_DEBUG,"Starting connect to item");
+/* async agent connection, one per polled item, lives until the item gets its result */
+typedef struct
+{
+	zbx_socket_t	s;
+	DC_ITEM		*item;
+	AGENT_RESULT	*result;
+	int		*errcode;
+	int		conn_status;
+	ZBX_SOCKADDR	addr;
+	socklen_t	addr_len;
+	double		deadline;
+	struct event	*ev;
+	short		tls_wait;	/* the socket event TLS handshake waits for */
+	const char	*tls_arg1;
+	const char	*tls_arg2;
+	char		*buf;
+	size_t		buf_alloc;
+	size_t		buf_offset;
+	zbx_agent_host_t	*host;
+	zbx_async_done_cb_t	done_cb;
+	void		*data;
+	int		index;
+}
+zbx_agent_conn_t;
 
-			if (NULL == (hp = gethostbyname(item->interface.addr)))
+static struct event_base	*agent_base = NULL;
+static struct event		*agent_timer = NULL;
+static unsigned int		agent_active = 0;
+static zbx_hashset_t		agent_hosts;
+
+static void	agent_host_start(zbx_agent_host_t *host);
+
+/******************************************************************************
+ *                                                                            *
+ * Function: agent_conn_close                                                 *
+ *                                                                            *
+ * Purpose: closes the connection once the item has got its result           *
+ *                                                                            *
+ ******************************************************************************/
+static void	agent_conn_close(zbx_agent_conn_t *conn)
+{
+#if defined(HAVE_POLARSSL) || defined(HAVE_GNUTLS) || defined(HAVE_OPENSSL)
+	/* there is no TLS session to shut down if the handshake has not finished */
+	if (TLS_HANDSHAKE == conn->conn_status)
+		zbx_tls_connect_cancel(&conn->s);
+#endif
+	zbx_tcp_close(&conn->s);
+	conn->s.socket = ZBX_SOCKET_ERROR;
+	conn->conn_status = CLOSED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: agent_conn_finish                                                *
+ *                                                                            *
+ * Purpose: releases the closed connection and hands the item result over to  *
+ *          the caller                                                        *
+ *                                                                            *
+ ******************************************************************************/
+static void	agent_conn_finish(zbx_agent_conn_t *conn)
+{
+	zbx_agent_host_t	*host = conn->host;
+
+	if (NULL != conn->ev)
+		event_free(conn->ev);
+
+	zbx_free(conn->buf);
+	agent_active--;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "finished socket processing %u", agent_active);
+
+	conn->done_cb(conn->data, conn->index);
+	zbx_free(conn);
+
+	if (NULL == host)
+		return;
+
+	host->active--;
+
+	/* the next connection of the wave is started by agent_host_start() itself */
+	if (0 == host->starting)
+		agent_host_start(host);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: agent_conn_recv                                                  *
+ *                                                                            *
+ * Purpose: reads all data available in the socket without blocking           *
+ *                                                                            *
+ * Return value: SUCCEED - the whole response is received                     *
+ *               ZBX_AGENT_RECV_MORE - the response is not complete yet       *
+ *               FAIL - network error                                         *
+ *                                                                            *
+ * Comments: agents close connection after the response, but the header      *
+ *           allows to stop reading as soon as the whole message arrived     *
+ *                                                                            *
+ ******************************************************************************/
+static int	agent_conn_recv(zbx_agent_conn_t *conn)
+{
+	char		buf[ZBX_STAT_BUF_LEN];
+	ssize_t		nbytes;
+	zbx_uint32_t	len;
+
+	for (;;)
+	{
+#if defined(HAVE_POLARSSL) || defined(HAVE_GNUTLS) || defined(HAVE_OPENSSL)
+		if (NULL != conn->s.tls_ctx)
+		{
+			char	*error = NULL;
+
+			if (ZBX_PROTO_ERROR == (nbytes = zbx_tls_read_nb(&conn->s, buf, sizeof(buf), &error)) &&
+					NULL != error)
 			{
-				SET_MSG_RESULT(result, zbx_strdup(NULL, "Cannot get hostname for the ip."));
-				*conn_status=FAIL;
-				*errcode=CONFIG_ERROR;
-				break;	
+				zabbix_log(LOG_LEVEL_DEBUG, "cannot read from agent at [%s]: %s",
+						conn->item->interface.addr, error);
+				zbx_free(error);
+				errno = ECONNRESET;
+				return FAIL;
 			}
-#if !defined(_WINDOWS) && !SOCK_CLOEXEC
-			fcntl(socket->socket, F_SETFD, FD_CLOEXEC);
+		}
+		else
 #endif
-			servaddr_in.sin_family = AF_INET;
-			servaddr_in.sin_addr.s_addr = ((struct in_addr *)(hp->h_addr))->s_addr;
-			servaddr_in.sin_port = htons(item->interface.port);
-			
-			zabbix_log(LOG_LEVEL_DEBUG,"Doing connect to host %s",item->interface.addr);
-
-			status = connect(socket->socket, (const struct sockaddr *)&servaddr_in, sizeof(servaddr_in));
-			
-			//async connects will return immediately with the error status and EINPROGRESS as errno
-			if (ZBX_PROTO_ERROR == status && EINPROGRESS != errno )
-			{	
-				zabbix_log(LOG_LEVEL_DEBUG,"Connect fail");
-				*conn_status = FAIL;
-				*errcode = CONFIG_ERROR;
-				SET_MSG_RESULT(result, zbx_strdup(NULL, "Cannot  connect to the host"));
-				break;	
+			nbytes = ZBX_TCP_READ(conn->s.socket, buf, sizeof(buf));
+
+		if (0 == nbytes)
+			return SUCCEED;
+
+		if (ZBX_PROTO_ERROR == nbytes)
+		{
+			if (EINTR == errno)
+				continue;
+
+			if (EAGAIN == errno || EWOULDBLOCK == errno)
+				break;
+
+			return FAIL;
+		}
+
+		if (ZBX_MAX_RECV_DATA_SIZE < conn->buf_offset + nbytes)
+			return FAIL;
+
+		if (conn->buf_alloc < conn->buf_offset + nbytes + 1)
+		{
+			while (conn->buf_alloc < conn->buf_offset + nbytes + 1)
+				conn->buf_alloc = (0 == conn->buf_alloc ? sizeof(buf) : conn->buf_alloc * 2);
+
+			conn->buf = (char *)zbx_realloc(conn->buf, conn->buf_alloc);
+		}
+
+		memcpy(conn->buf + conn->buf_offset, buf, nbytes);
+		conn->buf_offset += nbytes;
+	}
+
+	if (ZBX_AGENT_HEADER_LEN > conn->buf_offset ||
+			0 != strncmp(conn->buf, ZBX_AGENT_HEADER_DATA, ZBX_CONST_STRLEN(ZBX_AGENT_HEADER_DATA)))
+	{
+		return ZBX_AGENT_RECV_MORE;
+	}
+
+	memcpy(&len, conn->buf + ZBX_CONST_STRLEN(ZBX_AGENT_HEADER_DATA) + 1, sizeof(zbx_uint32_t));
+
+	if (ZBX_AGENT_HEADER_LEN + zbx_letoh_uint32(len) > conn->buf_offset)
+		return ZBX_AGENT_RECV_MORE;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: agent_conn_set_result                                            *
+ *                                                                            *
+ * Purpose: parses received agent response into the item result               *
+ *                                                                            *
+ ******************************************************************************/
+static void	agent_conn_set_result(zbx_agent_conn_t *conn)
+{
+	char		*data;
+	size_t		data_len;
+	zbx_uint32_t	len;
+
+	if (NULL == conn->buf)
+	{
+		SET_MSG_RESULT(conn->result, zbx_dsprintf(NULL, "Received empty response from Zabbix Agent at [%s]."
+				" Assuming that agent dropped connection because of access permissions.",
+				conn->item->interface.addr));
+		*conn->errcode = NETWORK_ERROR;
+		return;
+	}
+
+	data = conn->buf;
+	data_len = conn->buf_offset;
+
+	if (ZBX_AGENT_HEADER_LEN <= data_len &&
+			0 == strncmp(data, ZBX_AGENT_HEADER_DATA, ZBX_CONST_STRLEN(ZBX_AGENT_HEADER_DATA)))
+	{
+		if (0 != (data[ZBX_CONST_STRLEN(ZBX_AGENT_HEADER_DATA)] & ZBX_TCP_COMPRESS))
+		{
+			SET_MSG_RESULT(conn->result, zbx_strdup(NULL, "Compressed responses from Zabbix Agent are not"
+					" supported."));
+			*conn->errcode = NETWORK_ERROR;
+			return;
+		}
+
+		memcpy(&len, data + ZBX_CONST_STRLEN(ZBX_AGENT_HEADER_DATA) + 1, sizeof(zbx_uint32_t));
+		len = zbx_letoh_uint32(len);
+
+		if (ZBX_AGENT_HEADER_LEN + len > data_len)
+		{
+			SET_MSG_RESULT(conn->result, zbx_dsprintf(NULL, "Received incomplete response from Zabbix Agent"
+					" at [%s].", conn->item->interface.addr));
+			*conn->errcode = NETWORK_ERROR;
+			return;
+		}
+
+		data += ZBX_AGENT_HEADER_LEN;
+		data_len = len;
+	}
+
+	data[data_len] = '\0';
+
+	zbx_rtrim(data, " \r\n");
+	zbx_ltrim(data, " ");
+
+	zabbix_log(LOG_LEVEL_DEBUG, "get value from agent result: '%s'", data);
+
+	if (0 == strcmp(data, ZBX_NOTSUPPORTED))
+	{
+		/* 'ZBX_NOTSUPPORTED\0<error message>' */
+		if (sizeof(ZBX_NOTSUPPORTED) < data_len)
+			SET_MSG_RESULT(conn->result, zbx_dsprintf(NULL, "%s", data + sizeof(ZBX_NOTSUPPORTED)));
+		else
+			SET_MSG_RESULT(conn->result, zbx_strdup(NULL, "Not supported by Zabbix Agent"));
+
+		*conn->errcode = NOTSUPPORTED;
+	}
+	else if (0 == strcmp(data, ZBX_ERROR))
+	{
+		SET_MSG_RESULT(conn->result, zbx_strdup(NULL, "Zabbix Agent non-critical error"));
+		*conn->errcode = AGENT_ERROR;
+	}
+	else if (0 == data_len)
+	{
+		SET_MSG_RESULT(conn->result, zbx_dsprintf(NULL, "Received empty response from Zabbix Agent at [%s]."
+				" Assuming that agent dropped connection because of access permissions.",
+				conn->item->interface.addr));
+		*conn->errcode = NETWORK_ERROR;
+	}
+	else
+	{
+		set_result_type(conn->result, ITEM_VALUE_TYPE_TEXT, data);
+		*conn->errcode = SUCCEED;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: agent_conn_send                                                  *
+ *                                                                            *
+ * Purpose: sends the item key over the established connection               *
+ *                                                                            *
+ ******************************************************************************/
+static void	agent_conn_send(zbx_agent_conn_t *conn)
+{
+	zabbix_log(LOG_LEVEL_DEBUG, "Sending [%s]", conn->item->key);
+
+	if (SUCCEED != zbx_tcp_send(&conn->s, conn->item->key))
+	{
+		zabbix_log(LOG_LEVEL_DEBUG, "Data send fail, aborting session");
+		SET_MSG_RESULT(conn->result, zbx_strdup(NULL, "Cannot send request to the agent"));
+		*conn->errcode = NETWORK_ERROR;
+		agent_conn_close(conn);
+		return;
+	}
+
+	conn->conn_status = REQ_SENT;
+}
+
+#if defined(HAVE_POLARSSL) || defined(HAVE_GNUTLS) || defined(HAVE_OPENSSL)
+/******************************************************************************
+ *                                                                            *
+ * Function: agent_conn_handshake                                             *
+ *                                                                            *
+ * Purpose: performs the TLS handshake step the socket is ready for, sends    *
+ *          the request once the handshake is complete                        *
+ *                                                                            *
+ ******************************************************************************/
+static void	agent_conn_handshake(zbx_agent_conn_t *conn)
+{
+	char	*error = NULL;
+
+	switch (zbx_tls_connect_nb(&conn->s, conn->item->host.tls_connect, conn->tls_arg1, conn->tls_arg2, &error))
+	{
+		case ZBX_TLS_WAIT_READ:
+			conn->tls_wait = EV_READ;
+			break;
+		case ZBX_TLS_WAIT_WRITE:
+			conn->tls_wait = EV_WRITE;
+			break;
+		case SUCCEED:
+			agent_conn_send(conn);
+			break;
+		default:
+			SET_MSG_RESULT(conn->result, zbx_dsprintf(NULL, "TCP successful, cannot establish TLS to"
+					" [[%s]:%hu]: %s", conn->item->interface.addr, conn->item->interface.port,
+					error));
+			zbx_free(error);
+			*conn->errcode = NETWORK_ERROR;
+
+			/* the TLS context is gone already, only the socket is left to close */
+			conn->conn_status = CLOSED;
+			agent_conn_close(conn);
+	}
+}
+#endif
+
+/******************************************************************************
+ *                                                                            *
+ * Function: handle_socket_operation                                          *
+ *                                                                            *
+ * Purpose: advances the connection state machine, called by the event loop   *
+ *          whenever the socket is ready for the operation the state waits for*
+ *                                                                            *
+ ******************************************************************************/
+static void	handle_socket_operation(zbx_agent_conn_t *conn)
+{
+	int		status, sock_error;
+	socklen_t	sock_error_len = sizeof(sock_error);
+
+	switch (conn->conn_status)
+	{
+		case SOCKET_CREATED:
+			zabbix_log(LOG_LEVEL_DEBUG, "Doing connect to host %s", conn->item->interface.addr);
+
+			status = connect(conn->s.socket, (const struct sockaddr *)&conn->addr, conn->addr_len);
+
+			/* async connects will return immediately with the error status and EINPROGRESS as errno */
+			if (ZBX_PROTO_ERROR == status && EINPROGRESS != errno)
+			{
+				zabbix_log(LOG_LEVEL_DEBUG, "Connect fail");
+				SET_MSG_RESULT(conn->result, zbx_dsprintf(NULL, "Cannot connect to the host: %s",
+						zbx_strerror(errno)));
+				*conn->errcode = NETWORK_ERROR;
+				agent_conn_close(conn);
+				break;
 			}
 
-			*conn_status=CONNECT_SENT;
+			conn->conn_status = CONNECT_SENT;
 			break;
 
 		case CONNECT_SENT:
-			zabbix_log(LOG_LEVEL_DEBUG,"Sending data to the socket");
+			/* the socket became writable, connect() has finished one way or another */
+			if (0 != getsockopt(conn->s.socket, SOL_SOCKET, SO_ERROR, &sock_error, &sock_error_len))
+				sock_error = errno;
 
-			if (SUCCEED != zbx_tcp_send(socket, item->key))
+			if (0 != sock_error)
 			{
-				*errcode = NETWORK_ERROR;
-				*conn_status = FAIL;
-				SET_MSG_RESULT(result, zbx_strdup(NULL, "Cannot send request to the agent"));
-				zabbix_log(LOG_LEVEL_DEBUG,"Data send fail, aborting session");
+				zabbix_log(LOG_LEVEL_DEBUG, "Connection to %s has failed", conn->item->interface.addr);
+				SET_MSG_RESULT(conn->result, zbx_dsprintf(NULL, "Connection to the host failed: %s",
+						zbx_strerror(sock_error)));
+				*conn->errcode = NETWORK_ERROR;
+				agent_conn_close(conn);
+				break;
+			}
+#if defined(HAVE_POLARSSL) || defined(HAVE_GNUTLS) || defined(HAVE_OPENSSL)
+			if (ZBX_TCP_SEC_UNENCRYPTED != conn->item->host.tls_connect)
+			{
+				conn->conn_status = TLS_HANDSHAKE;
+				agent_conn_handshake(conn);
+				break;
 			}
-			
-			*conn_status=REQ_SENT;
+#endif
+			agent_conn_send(conn);
 			break;
+#if defined(HAVE_POLARSSL) || defined(HAVE_GNUTLS) || defined(HAVE_OPENSSL)
+		case TLS_HANDSHAKE:
+			agent_conn_handshake(conn);
+			break;
+#endif
 
 		case REQ_SENT:
-			if (FAIL != (received_len = zbx_tcp_recv_ext(socket, 0)))
+			switch (agent_conn_recv(conn))
 			{
-				*errcode = SUCCEED;
-				zabbix_log(LOG_LEVEL_DEBUG, "get value from agent result: '%s'", socket->buffer);
-
-				zbx_rtrim(socket->buffer, " \r\n");
-				zbx_ltrim(socket->buffer, " ");
-
-				if (0 == strcmp(socket->buffer, ZBX_NOTSUPPORTED))
-				{
-					/* 'ZBX_NOTSUPPORTED\0<error message>' */
-					if (sizeof(ZBX_NOTSUPPORTED) < socket->read_bytes)
-						SET_MSG_RESULT(result, zbx_dsprintf(NULL, "%s", socket->buffer + sizeof(ZBX_NOTSUPPORTED)));
-					else
-						SET_MSG_RESULT(result, zbx_strdup(NULL, "Not supported by Zabbix Agent"));
-						*errcode = NOTSUPPORTED;
-				}
-				else if (0 == strcmp(socket->buffer, ZBX_ERROR))
-				{
-					SET_MSG_RESULT(result, zbx_strdup(NULL, "Zabbix Agent non-critical error"));
-					*errcode = AGENT_ERROR;
-				}
-				else if (0 == received_len)
-				{
-					SET_MSG_RESULT(result, zbx_dsprintf(NULL, "Received empty response from Zabbix Agent at [%s]."
-						" Assuming that agent dropped connection because of access permissions.", item->interface.addr));
-					*errcode = NETWORK_ERROR;
-				}
-				else
-					set_result_type(result, ITEM_VALUE_TYPE_TEXT, socket->buffer);
-			} else 
-			{
-					zabbix_log(LOG_LEVEL_DEBUG, "Get value from agent failed: %s", zbx_socket_strerror());
-					SET_MSG_RESULT(result, zbx_dsprintf(NULL, "Get value from agent failed: %s", zbx_socket_strerror()));
-					*errcode=NETWORK_ERROR;
-			}					
-		
-			zbx_tcp_close(socket);				
-			
-			socket->socket=0;
-			*conn_status=FAIL;
-			
-			*active_agents=*active_agents-1;
-			
-			zabbix_log(LOG_LEVEL_DEBUG, "finished socket processing %d",*active_agents);
+				case ZBX_AGENT_RECV_MORE:
+					return;
+				case SUCCEED:
+					agent_conn_set_result(conn);
+					break;
+				default:
+					zabbix_log(LOG_LEVEL_DEBUG, "Get value from agent failed: %s",
+							zbx_strerror(errno));
+					SET_MSG_RESULT(conn->result, zbx_dsprintf(NULL,
+							"Get value from agent failed: %s", zbx_strerror(errno)));
+					*conn->errcode = NETWORK_ERROR;
+			}
+
+			agent_conn_close(conn);
+			break;
+	}
+}
+
+static void	agent_event_cb(evutil_socket_t fd, short what, void *arg);
+
+/******************************************************************************
+ *                                                                            *
+ * Function: agent_conn_schedule                                              *
+ *                                                                            *
+ * Purpose: registers the connection in the event loop for the socket event   *
+ *          its current state is waiting for, finishes closed connections     *
+ *                                                                            *
+ ******************************************************************************/
+static void	agent_conn_schedule(zbx_agent_conn_t *conn)
+{
+	short		what;
+	double		left;
+	struct timeval	tv;
+
+	switch (conn->conn_status)
+	{
+		case CONNECT_SENT:
+			what = EV_WRITE;
+			break;
+		case TLS_HANDSHAKE:
+			what = conn->tls_wait;
+			break;
+		case REQ_SENT:
+			what = EV_READ;
 			break;
-	} 
+		default:
+			agent_conn_finish(conn);
+			return;
+	}
 
+	if (0 >= (left = conn->deadline - zbx_time()))
+	{
+		SET_MSG_RESULT(conn->result, zbx_strdup(NULL, "Waiting for response timed out"));
+		*conn->errcode = TIMEOUT_ERROR;
+		agent_conn_close(conn);
+		agent_conn_finish(conn);
+		return;
+	}
+
+	tv.tv_sec = (time_t)left;
+	tv.tv_usec = (suseconds_t)((left - tv.tv_sec) * 1000000);
+
+	/* the event is not pending here, so it can be reassigned to wait for another operation */
+	if (NULL == conn->ev)
+		conn->ev = event_new(agent_base, conn->s.socket, what, agent_event_cb, conn);
+	else
+		event_assign(conn->ev, agent_base, conn->s.socket, what, agent_event_cb, conn);
+
+	event_add(conn->ev, &tv);
 }
 
+static void	agent_event_cb(evutil_socket_t fd, short what, void *arg)
+{
+	zbx_agent_conn_t	*conn = (zbx_agent_conn_t *)arg;
 
-int	get_value_agent_async(DC_ITEM *items, AGENT_RESULT *results, int *errcodes, int num)
+	ZBX_UNUSED(fd);
+
+	if (0 != (what & EV_TIMEOUT))
+	{
+		zabbix_log(LOG_LEVEL_DEBUG, "Connection to %s has timed out while waiting for response",
+				conn->item->interface.addr);
+		SET_MSG_RESULT(conn->result, zbx_strdup(NULL, "Waiting for response timed out"));
+		*conn->errcode = TIMEOUT_ERROR;
+		agent_conn_close(conn);
+	}
+	else
+		handle_socket_operation(conn);
+
+	agent_conn_schedule(conn);
+}
+
+static void	agent_timer_cb(evutil_socket_t fd, short what, void *arg)
 {
-	const char	*__function_name = "get_value_agent_async";
-	zbx_socket_t	*s;	
-	char		*tls_arg1, *tls_arg2;
-	int			i,	ret=SUCCEED,	max_socket;
-	// connects=0;
-	int 		*conn_status;
-	unsigned int active_agents=0;
-	unsigned int starttime;
+	ZBX_UNUSED(fd);
+	ZBX_UNUSED(what);
+	ZBX_UNUSED(arg);
+}
+
+static void	agent_batch_done_cb(void *data, int index)
+{
+	ZBX_UNUSED(data);
+	ZBX_UNUSED(index);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: agent_conn_bind                                                  *
+ *                                                                            *
+ * Purpose: binds the connection socket to SourceIP if it is configured       *
+ *                                                                            *
+ ******************************************************************************/
+static int	agent_conn_bind(zbx_agent_conn_t *conn, char *error, size_t max_error_len)
+{
+	struct addrinfo	hints, *ai = NULL;
+	int		err, ret = FAIL;
 
+	if (NULL == CONFIG_SOURCE_IP)
+		return SUCCEED;
 
-	zabbix_log(LOG_LEVEL_DEBUG,"Started async agent polling for %d items", num);
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = ((struct sockaddr *)&conn->addr)->sa_family;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_NUMERICHOST;
 
-	if (NULL == (s=zbx_malloc(NULL, num*sizeof(zbx_socket_t)))) {
-		zabbix_log(LOG_LEVEL_WARNING,"Couldn't allocate memory for sockets");
-		return FAIL;
-	};
+	if (0 != (err = getaddrinfo(CONFIG_SOURCE_IP, NULL, &hints, &ai)))
+	{
+		zbx_snprintf(error, max_error_len, "Invalid source IP address [%s]: %s", CONFIG_SOURCE_IP,
+				gai_strerror(err));
+		goto out;
+	}
 
-	memset(s, 0, num*sizeof(zbx_socket_t));
-	
-	if (NULL == (conn_status=zbx_malloc(NULL, num*sizeof(unsigned int))))
+	if (ZBX_PROTO_ERROR == zbx_bind(conn->s.socket, ai->ai_addr, ai->ai_addrlen))
 	{
-		zabbix_log(LOG_LEVEL_WARNING,"Couldn't allocate memory for sockets");
+		zbx_snprintf(error, max_error_len, "Cannot bind to source IP address [%s]: %s", CONFIG_SOURCE_IP,
+				zbx_strerror(errno));
+		goto out;
+	}
+
+	ret = SUCCEED;
+out:
+	if (NULL != ai)
+		freeaddrinfo(ai);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: agent_raise_fd_limit                                             *
+ *                                                                            *
+ * Purpose: lets the poller have as many sockets open as the hard limit allows*
+ *                                                                            *
+ ******************************************************************************/
+static void	agent_raise_fd_limit(void)
+{
+	struct rlimit	rlim;
+
+	if (0 != getrlimit(RLIMIT_NOFILE, &rlim) || rlim.rlim_cur >= rlim.rlim_max)
+		return;
+
+	rlim.rlim_cur = rlim.rlim_max;
+
+	if (0 != setrlimit(RLIMIT_NOFILE, &rlim))
+		zabbix_log(LOG_LEVEL_DEBUG, "cannot raise open files limit: %s", zbx_strerror(errno));
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: agent_init                                                       *
+ *                                                                            *
+ * Purpose: creates the event loop shared by all async agent connections of  *
+ *          the process                                                       *
+ *                                                                            *
+ ******************************************************************************/
+static int	agent_init(void)
+{
+	if (NULL != agent_base)
+		return SUCCEED;
+
+	agent_raise_fd_limit();
+
+	if (NULL == (agent_base = event_base_new()))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot initialize event base for async agent polling");
 		return FAIL;
-	};
+	}
+
+	agent_timer = evtimer_new(agent_base, agent_timer_cb, NULL);
+
+	zbx_hashset_create(&agent_hosts, 100, ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+	return SUCCEED;
+}
 
-	//starting connections
-	for ( i = 0; i < num; i++ ) 
+/******************************************************************************
+ *                                                                            *
+ * Function: agent_conn_start                                                 *
+ *                                                                            *
+ * Purpose: opens the connection socket and starts connecting to the agent   *
+ *                                                                            *
+ ******************************************************************************/
+static void	agent_conn_start(zbx_agent_conn_t *conn)
+{
+	char	error[MAX_STRING_LEN];
+
+	if (ZBX_SOCKET_ERROR == (conn->s.socket = socket(((struct sockaddr *)&conn->addr)->sa_family,
+			SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)))
+	{
+		SET_MSG_RESULT(conn->result, zbx_dsprintf(NULL, "Couldn't create socket: %s", zbx_strerror(errno)));
+		*conn->errcode = NETWORK_ERROR;
+		agent_conn_finish(conn);
+		return;
+	}
+
+	if (SUCCEED != agent_conn_bind(conn, error, sizeof(error)))
+	{
+		SET_MSG_RESULT(conn->result, zbx_strdup(NULL, error));
+		*conn->errcode = NETWORK_ERROR;
+		agent_conn_close(conn);
+		agent_conn_finish(conn);
+		return;
+	}
+
+	/* the connection is timed from its own start, not from the start of the batch */
+	conn->deadline = zbx_time() + ZBX_AGENT_MAX_RESPONSE_TIME * 2;
+	conn->conn_status = SOCKET_CREATED;
+
+	handle_socket_operation(conn);
+	agent_conn_schedule(conn);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: agent_host_start                                                 *
+ *                                                                            *
+ * Purpose: starts the queued connections of the agent interface as long as  *
+ *          there are free connection slots                                   *
+ *                                                                            *
+ * Comments: the host is removed as soon as it has no connections left, so   *
+ *           it must not be used after this call                              *
+ *                                                                            *
+ ******************************************************************************/
+static void	agent_host_start(zbx_agent_host_t *host)
+{
+	zbx_agent_conn_t	*conn;
+
+	/* connections failing right away finish from within agent_conn_start(), the loop starts the next ones */
+	host->starting = 1;
+
+	while (ZBX_AGENT_HOST_MAX_CONNECTIONS > host->active && host->next < host->queue.values_num)
 	{
-		conn_status[i]=INIT;
-		s[i].buf_type = ZBX_BUF_TYPE_STAT;
+		conn = (zbx_agent_conn_t *)host->queue.values[host->next++];
+		host->active++;
+		agent_conn_start(conn);
+	}
+
+	host->starting = 0;
+
+	if (host->next == host->queue.values_num)
+	{
+		zbx_vector_ptr_clear(&host->queue);
+		host->next = 0;
+
+		if (0 == host->active)
+		{
+			zbx_vector_ptr_destroy(&host->queue);
+			zbx_hashset_remove_direct(&agent_hosts, host);
+		}
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_async_agent_start                                            *
+ *                                                                            *
+ * Purpose: starts polling of agent items without waiting for the results    *
+ *                                                                            *
+ * Parameters: items    - [IN] the items to poll, non-agent items are skipped *
+ *             results  - [OUT] the item results                              *
+ *             errcodes - [IN/OUT] the item error codes, only NOT_PROCESSED   *
+ *                                 items are polled                           *
+ *             num      - [IN] the number of items                            *
+ *             done_cb  - [IN] called once for every item as soon as it is    *
+ *                             finished with, possibly before this function   *
+ *                             returns                                        *
+ *             data     - [IN] the callback data                              *
+ *                                                                            *
+ * Return value: SUCCEED - the items were taken                               *
+ *               FAIL - the event loop could not be initialized, all items    *
+ *                      are left NOT_PROCESSED                                *
+ *                                                                            *
+ * Comments: items, results and errcodes must stay in place until the last   *
+ *           callback. Host names must be resolved by zbx_resolver_resolve()  *
+ *           beforehand, the items with names not resolved yet fail with     *
+ *           NETWORK_ERROR. No more than ZBX_AGENT_HOST_MAX_CONNECTIONS are open *
+ *           to the same interface at once, the rest wait for their turn.     *
+ *           The connections are driven by zbx_async_agent_poll().            *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_async_agent_start(DC_ITEM *items, AGENT_RESULT *results, int *errcodes, int num,
+		zbx_async_done_cb_t done_cb, void *data)
+{
+	const char		*__function_name = "zbx_async_agent_start";
+	zbx_agent_conn_t	*conn;
+	zbx_agent_host_t	*host, host_local;
+	zbx_vector_ptr_t	hosts;
+	char			error[MAX_STRING_LEN];
+	int			i, j, *indexes, indexes_num = 0;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() num:%d", __function_name, num);
+
+	if (SUCCEED != agent_init())
+	{
+		for (i = 0; i < num; i++)
+			done_cb(data, i);
+
+		return FAIL;
+	}
 
-		//cheick if the item is agent type
-		if (  ITEM_TYPE_ZABBIX != items[i].type )	
-		{	
-			conn_status[i]=SKIPPED;
+	indexes = (int *)zbx_malloc(NULL, num * sizeof(int));
+
+	for (i = 0; i < num; i++)
+	{
+		if (ITEM_TYPE_ZABBIX != items[i].type || NOT_PROCESSED != errcodes[i])
+		{
+			done_cb(data, i);
 			continue;
 		}
-			
+
 		zabbix_log(LOG_LEVEL_TRACE, "In %s() host:'%s' addr:'%s' key:'%s' conn:'%s'", __function_name,
 				items[i].host.host, items[i].interface.addr, items[i].key,
 				zbx_tcp_connection_type_name(items[i].host.tls_connect));
@@ -321,128 +908,225 @@ int	get_value_agent_async(DC_ITEM *items, AGENT_RESULT *results, int *errcodes,
 		switch (items[i].host.tls_connect)
 		{
 			case ZBX_TCP_SEC_UNENCRYPTED:
-				tls_arg1 = NULL;
-				tls_arg2 = NULL;
-				break;
 #if defined(HAVE_POLARSSL) || defined(HAVE_GNUTLS) || defined(HAVE_OPENSSL)
 			case ZBX_TCP_SEC_TLS_CERT:
-				tls_arg1 = item->host.tls_issuer;
-				tls_arg2 = item->host.tls_subject;
-				break;
 			case ZBX_TCP_SEC_TLS_PSK:
-				tls_arg1 = items[i].host.tls_psk_identity;
-				tls_arg2 = items[i].host.tls_psk;
+#endif
 				break;
-#else
+#if !defined(HAVE_POLARSSL) && !defined(HAVE_GNUTLS) && !defined(HAVE_OPENSSL)
 			case ZBX_TCP_SEC_TLS_CERT:
 			case ZBX_TCP_SEC_TLS_PSK:
-				SET_MSG_RESULT(&results[i], zbx_dsprintf(NULL, "A TLS connection is configured to be used with agent"
-					" but support for TLS was not compiled into %s.",
-					get_program_type_string(program_type)));
-				conn_status[i]=SKIPPED;
-				errcodes[i]=CONFIG_ERROR;
+				SET_MSG_RESULT(&results[i], zbx_dsprintf(NULL, "A TLS connection is configured to be used"
+						" with agent but support for TLS was not compiled into %s.",
+						get_program_type_string(program_type)));
+				errcodes[i] = CONFIG_ERROR;
+				done_cb(data, i);
 				continue;
 #endif
 			default:
 				THIS_SHOULD_NEVER_HAPPEN;
 				SET_MSG_RESULT(&results[i], zbx_strdup(NULL, "Invalid TLS connection parameters."));
-				conn_status[i]=SKIPPED;
-				errcodes[i]=CONFIG_ERROR;
+				errcodes[i] = CONFIG_ERROR;
+				done_cb(data, i);
 				continue;
 		}
 
-				
-		if (ZBX_SOCKET_ERROR == (s[i].socket = socket(AF_INET,  SOCK_STREAM | SOCK_NONBLOCK |  SOCK_CLOEXEC, 0)))
-		{
-			conn_status[i]=SKIPPED;
-			errcodes[i]=CONFIG_ERROR;
-			SET_MSG_RESULT(&results[i], zbx_strdup(NULL, "Couldn't create socket"));
-			continue;
-		}
-		conn_status[i]=SOCKET_CREATED;
-		max_socket=s[i].socket;
-		active_agents++;
-		
-		//todo: binding to the source ip code
-				
-		handle_socket_operation(&s[i],&items[i],&errcodes[i],&conn_status[i],&results[i],&active_agents);
-		
+		indexes[indexes_num++] = i;
 	}
-			
-	starttime=time(NULL);
-	zabbix_log(LOG_LEVEL_DEBUG,"Starting waiting for %d sockets to connect",active_agents);
 
-	while (active_agents>0 && (time(NULL)-starttime)< ZBX_AGENT_MAX_RESPONSE_TIME *2) 
+	zbx_vector_ptr_create(&hosts);
+
+	/* queueing connections */
+	for (j = 0; j < indexes_num; j++)
 	{
-		
-		//this was the simplest and compact way to implement async io
-		//i has tried select() + FD_ISSET, while its seems to work
-		//it requires much more CPU for large batches of hosts
-		//probably it's worth of trying libevent if some problems arise, especially it's already 
-		//used and linked to the daemon, but one usleep hanles all that 
-		
-		usleep(10000);
-		
-		for ( i=0; i<num; i++) 
+		i = indexes[j];
+
+		conn = (zbx_agent_conn_t *)zbx_calloc(NULL, 1, sizeof(zbx_agent_conn_t));
+		conn->s.buf_type = ZBX_BUF_TYPE_STAT;
+		conn->item = &items[i];
+		conn->result = &results[i];
+		conn->errcode = &errcodes[i];
+		conn->done_cb = done_cb;
+		conn->data = data;
+		conn->index = i;
+		conn->conn_status = CLOSED;
+		agent_active++;
+#if defined(HAVE_POLARSSL) || defined(HAVE_GNUTLS) || defined(HAVE_OPENSSL)
+		switch (items[i].host.tls_connect)
 		{
-			if (SKIPPED == conn_status[i] || FAIL == conn_status[i] || CLOSED == conn_status[i]) 
-				continue;
+			case ZBX_TCP_SEC_TLS_CERT:
+				conn->tls_arg1 = items[i].host.tls_issuer;
+				conn->tls_arg2 = items[i].host.tls_subject;
+				break;
+			case ZBX_TCP_SEC_TLS_PSK:
+				conn->tls_arg1 = items[i].host.tls_psk_identity;
+				conn->tls_arg2 = items[i].host.tls_psk;
+				break;
+		}
+#endif
 
-			//the socket is in connection phase, checking that it's ready to be written to
-			if (CONNECT_SENT == conn_status[i]) {
-				int result,ret;
-				socklen_t result_len = sizeof(result);
-				
-				ret=getsockopt(s[i].socket, SOL_SOCKET, SO_ERROR, &result, &result_len); 
-				if (ret<0)
-				{
-    				zabbix_log(LOG_LEVEL_DEBUG, "Connection is not ready yet %d", ret);
-    				continue;
-				}
-				if ( 0!= result ) {
-					zabbix_log(LOG_LEVEL_DEBUG, "Connection %d has failed", i);
-					SET_MSG_RESULT(&results[i], zbx_strdup(NULL, "Connection to the host failed: check firewall rules and agent is running"));
-					conn_status[i]==CLOSED;
-					errcodes[i]=NETWORK_ERROR;
-					continue;
-				}
-				
-			} else 	if (REQ_SENT == conn_status[i] ) 
-			{ 
-				//checking if there are some data waiting for us in the socket
-				int count;
-				ioctl(s[i].socket, FIONREAD, &count);
-			
-				if ( 0 == count) continue;  
-				
-			} else {
-				//self-check zabbix team syle: this should never happen :)
-				THIS_SHOULD_NEVER_HAPPEN;
-				continue;
-			}
+		if (SUCCEED != zbx_resolver_get_addr(items[i].interface.addr, items[i].interface.port, &conn->addr,
+				&conn->addr_len, error, sizeof(error)))
+		{
+			SET_MSG_RESULT(&results[i], zbx_strdup(NULL, error));
+			errcodes[i] = NETWORK_ERROR;
+			agent_conn_finish(conn);
+			continue;
+		}
+
+		if (NULL == (host = (zbx_agent_host_t *)zbx_hashset_search(&agent_hosts,
+				&items[i].interface.interfaceid)))
+		{
+			host_local.interfaceid = items[i].interface.interfaceid;
+			host_local.active = 0;
+			host_local.next = 0;
+			host_local.starting = 0;
+			zbx_vector_ptr_create(&host_local.queue);
 
-			handle_socket_operation(&s[i],&items[i],&errcodes[i],&conn_status[i],&results[i],&active_agents);
+			host = (zbx_agent_host_t *)zbx_hashset_insert(&agent_hosts, &host_local, sizeof(host_local));
 		}
-		
-	} 
-	
-	zabbix_log(LOG_LEVEL_DEBUG,"There are %d active connections timed-out",active_agents); 
 
-	//closing sockets for timed out items
-	for ( i = 0; i < num; i++) 
+		conn->host = host;
+		zbx_vector_ptr_append(&host->queue, conn);
+
+		if (1 == host->queue.values_num - host->next)
+			zbx_vector_ptr_append(&hosts, host);
+	}
+
+	zbx_free(indexes);
+
+	/* starting connections after queueing the whole batch, so the hosts are not removed in between */
+	for (j = 0; j < hosts.values_num; j++)
+		agent_host_start((zbx_agent_host_t *)hosts.values[j]);
+
+	zbx_vector_ptr_destroy(&hosts);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() active connections:%u", __function_name, agent_active);
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_async_agent_poll                                             *
+ *                                                                            *
+ * Purpose: processes ready agent connections                                 *
+ *                                                                            *
+ * Parameters: timeout - [IN] the maximum time to wait for network events,    *
+ *                            milliseconds                                    *
+ *                                                                            *
+ * Return value: the number of connections still in progress                  *
+ *                                                                            *
+ * Comments: returns as soon as some connections were processed, finished     *
+ *           items are reported through their callbacks                       *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_async_agent_poll(int timeout)
+{
+	struct timeval	tv;
+
+	if (0 == agent_active)
+		return 0;
+
+	tv.tv_sec = timeout / 1000;
+	tv.tv_usec = (timeout % 1000) * 1000;
+	evtimer_add(agent_timer, &tv);
+
+	if (-1 == event_base_loop(agent_base, EVLOOP_ONCE))
+		zabbix_log(LOG_LEVEL_WARNING, "async agent event loop has failed");
+
+	evtimer_del(agent_timer);
+
+	return (int)agent_active;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: get_value_agent_async                                            *
+ *                                                                            *
+ * Purpose: retrieve data from Zabbix agents without blocking on any of them  *
+ *                                                                            *
+ * Parameters: items    - [IN] the items to poll, non-agent items are skipped *
+ *             results  - [OUT] the item results                              *
+ *             errcodes - [IN/OUT] the item error codes, only NOT_PROCESSED   *
+ *                                 items are polled                           *
+ *             num      - [IN] the number of items                            *
+ *                                                                            *
+ * Return value: SUCCEED - the batch was processed                            *
+ *               FAIL - the event loop could not be initialized               *
+ *                                                                            *
+ * Comments: waits for the whole batch, see zbx_async_agent_start() for the   *
+ *           details. The host names must be resolved by the caller, the      *
+ *           items the names of which are still being resolved must be kept   *
+ *           out of the batch with an error code.                             *
+ *                                                                            *
+ ******************************************************************************/
+int	get_value_agent_async(DC_ITEM *items, AGENT_RESULT *results, int *errcodes, int num)
+{
+	const char	*__function_name = "get_value_agent_async";
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() num:%d", __function_name, num);
+
+	if (SUCCEED != zbx_async_agent_start(items, results, errcodes, num, agent_batch_done_cb, NULL))
+		return FAIL;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "Starting waiting for %u sockets to connect", agent_active);
+
+	/* every connection keeps a pending event until it is finished, so the loop exits with the last one */
+	if (0 != agent_active && -1 == event_base_dispatch(agent_base))
+		zabbix_log(LOG_LEVEL_WARNING, "async agent event loop has failed");
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() %d items, %u not finished", __function_name, num, agent_active);
+
+	return SUCCEED;
+}
+
+#else	/* HAVE_LIBEVENT */
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_async_agent_start                                            *
+ *                                                                            *
+ * Purpose: polls agent items one by one when built without libevent          *
+ *                                                                            *
+ * Comments: the items are finished before the function returns, see         *
+ *           get_value_agent()                                                *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_async_agent_start(DC_ITEM *items, AGENT_RESULT *results, int *errcodes, int num,
+		zbx_async_done_cb_t done_cb, void *data)
+{
+	int	i;
+
+	for (i = 0; i < num; i++)
 	{
-		if (s[i].socket) zbx_tcp_close(&s[i]);
+		if (ITEM_TYPE_ZABBIX == items[i].type && NOT_PROCESSED == errcodes[i])
+			errcodes[i] = get_value_agent(&items[i], &results[i]);
 
-		if (REQ_SENT == conn_status[i] || CONNECT_SENT ==conn_status[i]) {
-			zabbix_log(LOG_LEVEL_DEBUG, "Connection %d has timed out while waiting for responce", num);
-			SET_MSG_RESULT(&results[i], zbx_strdup(NULL, "Waiting for responce timed out"));
-			errcodes[i]=TIMEOUT_ERROR;
-			continue;
-		}
+		done_cb(data, i);
+	}
+
+	return SUCCEED;
+}
+
+int	zbx_async_agent_poll(int timeout)
+{
+	ZBX_UNUSED(timeout);
+
+	return 0;
+}
+
+int	get_value_agent_async(DC_ITEM *items, AGENT_RESULT *results, int *errcodes, int num)
+{
+	int	i;
+
+	for (i = 0; i < num; i++)
+	{
+		if (ITEM_TYPE_ZABBIX == items[i].type && NOT_PROCESSED == errcodes[i])
+			errcodes[i] = get_value_agent(&items[i], &results[i]);
 	}
 
-	zbx_free(s);
-	zbx_free(conn_status);
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s: %d agents, %d succesifull",__function_name, num, num-active_agents);
+	return SUCCEED;
 }
 
+#endif	/* HAVE_LIBEVENT */
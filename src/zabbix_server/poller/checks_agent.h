@@ -22,13 +22,15 @@
 
 #include "dbcache.h"
 #include "sysinfo.h"
+#include "poller.h"
 
 extern char	*CONFIG_SOURCE_IP;
 
 int	get_value_agent(DC_ITEM *item, AGENT_RESULT *result);
 
-//this is coming soon 
 int	get_value_agent_async(DC_ITEM *items, AGENT_RESULT *results, int *errcodes, int num);
-
+int	zbx_async_agent_start(DC_ITEM *items, AGENT_RESULT *results, int *errcodes, int num,
+		zbx_async_done_cb_t done_cb, void *data);
+int	zbx_async_agent_poll(int timeout);
 
 #endif
@@ -28,6 +28,8 @@
 #include "comms.h"
 #include "zbxalgo.h"
 #include "zbxjson.h"
+#include "resolver.h"
+#include "snmp_udp.h"
 
 /*
  * SNMP Dynamic Index Cache
@@ -422,10 +424,8 @@ static struct snmp_session	*zbx_snmp_open_session(const DC_ITEM *item, char *err
 {
 	const char		*__function_name = "zbx_snmp_open_session";
 	struct snmp_session	session, *ss = NULL;
-	char			addr[128];
-#ifdef HAVE_IPV6
+	char			addr[128], ip[INTERFACE_IP_LEN_MAX];
 	int			family;
-#endif
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
@@ -459,24 +459,42 @@ static struct snmp_session	*zbx_snmp_open_session(const DC_ITEM *item, char *err
 	session.timeout = CONFIG_TIMEOUT * 1000 * 1000;	/* timeout of one attempt in microseconds */
 							/* (net-snmp default = 1 second) */
 
-#ifdef HAVE_IPV6
-	if (SUCCEED != get_address_family(item->interface.addr, &family, error, max_error_len))
-		goto end;
-
-	if (PF_INET == family)
+	/* async pollers resolve names in advance, use the cached address to keep Net-SNMP from blocking on DNS */
+	if (SUCCEED == zbx_resolver_get_ip(item->interface.addr, ip, sizeof(ip), &family))
 	{
-		zbx_snprintf(addr, sizeof(addr), "%s:%hu", item->interface.addr, item->interface.port);
+		if (AF_INET == family)
+			zbx_snprintf(addr, sizeof(addr), "udp:%s:%hu", ip, item->interface.port);
+		else
+			zbx_snprintf(addr, sizeof(addr), "udp6:[%s]:%hu", ip, item->interface.port);
 	}
 	else
 	{
-		if (item->interface.useip)
-			zbx_snprintf(addr, sizeof(addr), "udp6:[%s]:%hu", item->interface.addr, item->interface.port);
+#ifdef HAVE_IPV6
+		if (SUCCEED != get_address_family(item->interface.addr, &family, error, max_error_len))
+			goto end;
+
+		if (PF_INET == family)
+		{
+			zbx_snprintf(addr, sizeof(addr), "%s:%hu", item->interface.addr, item->interface.port);
+		}
 		else
-			zbx_snprintf(addr, sizeof(addr), "udp6:%s:%hu", item->interface.addr, item->interface.port);
-	}
+		{
+			if (item->interface.useip)
+			{
+				zbx_snprintf(addr, sizeof(addr), "udp6:[%s]:%hu", item->interface.addr,
+						item->interface.port);
+			}
+			else
+			{
+				zbx_snprintf(addr, sizeof(addr), "udp6:%s:%hu", item->interface.addr,
+						item->interface.port);
+			}
+		}
 #else
-	zbx_snprintf(addr, sizeof(addr), "%s:%hu", item->interface.addr, item->interface.port);
+		zbx_snprintf(addr, sizeof(addr), "%s:%hu", item->interface.addr, item->interface.port);
 #endif
+	}
+
 	session.peername = addr;
 
 	/* remote_port is no longer used in latest versions of Net-SNMP */
@@ -988,6 +1006,225 @@ static int	zbx_oid_is_new(zbx_hashset_t *hs, size_t root_len, const oid *p_oid,
 #undef ZBX_OIDS_MAX_NUM
 }
 
+/* OID tree walk state */
+typedef struct
+{
+	const char		*snmp_oid;	/* the OID of the walked table */
+	oid			root[MAX_OID_LEN];
+	size_t			root_len;
+	oid			last[MAX_OID_LEN];	/* the last OID received, the next request starts from it */
+	size_t			last_len;
+	size_t			root_string_len;
+	size_t			root_numeric_len;
+	int			check_oid_increase;
+	zbx_hashset_t		oids_seen;
+	zbx_snmp_walk_cb_func	*walk_cb_func;
+	void			*walk_cb_arg;
+}
+zbx_snmp_walk_t;
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_snmp_walk_init                                               *
+ *                                                                            *
+ * Purpose: prepares walking of an OID tree                                   *
+ *                                                                            *
+ * Parameters: walk          - [OUT] the walk state                           *
+ *             snmp_oid      - [IN] OID of table with values of interest,     *
+ *                                  must stay in place until the walk is      *
+ *                                  cleaned                                   *
+ *             walk_cb_func  - [IN] callback function to process discovered   *
+ *                                  OIDs and their values                     *
+ *             walk_cb_arg   - [IN] argument to pass to the callback function *
+ *             error         - [OUT] a buffer to store error message          *
+ *             max_error_len - [IN] maximum error message length              *
+ *                                                                            *
+ * Return value: CONFIG_ERROR - the OID cannot be parsed                      *
+ *               SUCCEED - the walk can be started                            *
+ *                                                                            *
+ ******************************************************************************/
+static int	zbx_snmp_walk_init(zbx_snmp_walk_t *walk, const char *snmp_oid, zbx_snmp_walk_cb_func walk_cb_func,
+		void *walk_cb_arg, char *error, size_t max_error_len)
+{
+	char	oid_index[MAX_STRING_LEN];
+
+	walk->snmp_oid = snmp_oid;
+	walk->root_len = MAX_OID_LEN;
+	walk->check_oid_increase = 1;
+	walk->walk_cb_func = walk_cb_func;
+	walk->walk_cb_arg = walk_cb_arg;
+
+	/* create OID from string */
+	if (NULL == snmp_parse_oid(snmp_oid, walk->root, &walk->root_len))
+	{
+		zbx_snprintf(error, max_error_len, "snmp_parse_oid(): cannot parse OID \"%s\".", snmp_oid);
+		return CONFIG_ERROR;
+	}
+
+	if (-1 == zbx_snmp_print_oid(oid_index, sizeof(oid_index), walk->root, walk->root_len,
+			ZBX_OID_INDEX_STRING))
+	{
+		zbx_snprintf(error, max_error_len, "zbx_snmp_print_oid(): cannot print OID \"%s\" with string indices.",
+				snmp_oid);
+		return CONFIG_ERROR;
+	}
+
+	walk->root_string_len = strlen(oid_index);
+
+	if (-1 == zbx_snmp_print_oid(oid_index, sizeof(oid_index), walk->root, walk->root_len,
+			ZBX_OID_INDEX_NUMERIC))
+	{
+		zbx_snprintf(error, max_error_len, "zbx_snmp_print_oid(): cannot print OID \"%s\""
+				" with numeric indices.", snmp_oid);
+		return CONFIG_ERROR;
+	}
+
+	walk->root_numeric_len = strlen(oid_index);
+
+	/* the walk starts from the root OID */
+	memcpy(walk->last, walk->root, walk->root_len * sizeof(oid));
+	walk->last_len = walk->root_len;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_snmp_walk_clean                                              *
+ *                                                                            *
+ * Purpose: releases the resources allocated during the walk                  *
+ *                                                                            *
+ ******************************************************************************/
+static void	zbx_snmp_walk_clean(zbx_snmp_walk_t *walk)
+{
+	if (0 == walk->check_oid_increase)
+		zbx_hashset_destroy(&walk->oids_seen);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_snmp_walk_process                                            *
+ *                                                                            *
+ * Purpose: passes the variable bindings of a walk response to the walk       *
+ *          callback                                                          *
+ *                                                                            *
+ * Parameters: walk          - [IN/OUT] the walk state                        *
+ *             response      - [IN] GetResponse-PDU without errors            *
+ *             num_vars      - [OUT] the number of processed variables        *
+ *             running       - [OUT] 0 if the walk is over                    *
+ *             error         - [OUT] a buffer to store error message          *
+ *             max_error_len - [IN] maximum error message length              *
+ *                                                                            *
+ * Return value: NOTSUPPORTED - the device returned an exception value or     *
+ *                              OIDs that cannot be walked                    *
+ *               SUCCEED - the response was processed                         *
+ *                                                                            *
+ ******************************************************************************/
+static int	zbx_snmp_walk_process(zbx_snmp_walk_t *walk, const struct snmp_pdu *response, int *num_vars,
+		int *running, char *error, size_t max_error_len)
+{
+	char			oid_index[MAX_STRING_LEN];
+	struct variable_list	*var;
+	AGENT_RESULT		snmp_result;
+
+	for (*num_vars = 0, var = response->variables; NULL != var; (*num_vars)++, var = var->next_variable)
+	{
+		/* verify if we are in the same subtree */
+		if (SNMP_ENDOFMIBVIEW == var->type || var->name_length < walk->root_len ||
+				0 != memcmp(walk->root, var->name, walk->root_len * sizeof(oid)))
+		{
+			/* reached the end or past this subtree */
+			*running = 0;
+			return SUCCEED;
+		}
+		else if (SNMP_NOSUCHOBJECT != var->type && SNMP_NOSUCHINSTANCE != var->type)
+		{
+			/* not an exception value */
+
+			if (1 == walk->check_oid_increase)	/* typical case */
+			{
+				int	res;
+
+				/* normally devices return OIDs in increasing order, */
+				/* snmp_oid_compare() will return -1 in this case */
+
+				if (-1 != (res = snmp_oid_compare(walk->last, walk->last_len, var->name,
+						var->name_length)))
+				{
+					if (0 == res)	/* got the same OID */
+					{
+						zbx_strlcpy(error, "OID not changing.", max_error_len);
+						*running = 0;
+						return NOTSUPPORTED;
+					}
+					else	/* 1 == res */
+					{
+						/* OID decreased. Disable further checks of increasing */
+						/* and set up a protection against endless looping. */
+
+						walk->check_oid_increase = 0;
+						zbx_detect_loop_init(&walk->oids_seen);
+					}
+				}
+			}
+
+			if (0 == walk->check_oid_increase && FAIL == zbx_oid_is_new(&walk->oids_seen, walk->root_len,
+					var->name, var->name_length))
+			{
+				zbx_strlcpy(error, "OID loop detected or too many OIDs.", max_error_len);
+				*running = 0;
+				return NOTSUPPORTED;
+			}
+
+			if (SUCCEED != zbx_snmp_choose_index(oid_index, sizeof(oid_index), var->name,
+					var->name_length, walk->root_string_len, walk->root_numeric_len))
+			{
+				zbx_snprintf(error, max_error_len, "zbx_snmp_choose_index():"
+						" cannot choose appropriate index while walking for"
+						" OID \"%s\".", walk->snmp_oid);
+				*running = 0;
+				return NOTSUPPORTED;
+			}
+
+			init_result(&snmp_result);
+
+			if (SUCCEED == zbx_snmp_set_result(var, &snmp_result) &&
+					NULL != GET_STR_RESULT(&snmp_result))
+			{
+				walk->walk_cb_func(walk->walk_cb_arg, walk->snmp_oid, oid_index, snmp_result.str);
+			}
+			else
+			{
+				char	**msg;
+
+				msg = GET_MSG_RESULT(&snmp_result);
+
+				zabbix_log(LOG_LEVEL_DEBUG, "cannot get index '%s' string value: %s",
+						oid_index, NULL != msg && NULL != *msg ? *msg : "(null)");
+			}
+
+			free_result(&snmp_result);
+
+			/* go to next variable */
+			memcpy((char *)walk->last, (char *)var->name, var->name_length * sizeof(oid));
+			walk->last_len = var->name_length;
+		}
+		else
+		{
+			/* an exception value, so stop */
+			char	*errmsg;
+
+			errmsg = zbx_get_snmp_type_error(var->type);
+			zbx_strlcpy(error, errmsg, max_error_len);
+			zbx_free(errmsg);
+			*running = 0;
+			return NOTSUPPORTED;
+		}
+	}
+
+	return SUCCEED;
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: zbx_snmp_walk                                                    *
@@ -1022,50 +1259,16 @@ static int	zbx_snmp_walk(struct snmp_session *ss, const DC_ITEM *item, const cha
 	const char		*__function_name = "zbx_snmp_walk";
 
 	struct snmp_pdu		*pdu, *response;
-	oid			anOID[MAX_OID_LEN], rootOID[MAX_OID_LEN];
-	size_t			anOID_len = MAX_OID_LEN, rootOID_len = MAX_OID_LEN, root_string_len, root_numeric_len;
-	char			oid_index[MAX_STRING_LEN];
-	struct variable_list	*var;
-	int			status, level, running, num_vars, check_oid_increase = 1, ret = SUCCEED;
-	AGENT_RESULT		snmp_result;
-	zbx_hashset_t		oids_seen;
+	int			status, level, running, num_vars, ret = SUCCEED;
+	zbx_snmp_walk_t		walk;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s() type:%d OID:'%s' bulk:%d", __function_name, (int)item->type, snmp_oid, bulk);
 
 	if (ITEM_TYPE_SNMPv1 == item->type)	/* GetBulkRequest-PDU available since SNMPv2 */
 		bulk = SNMP_BULK_DISABLED;
 
-	/* create OID from string */
-	if (NULL == snmp_parse_oid(snmp_oid, rootOID, &rootOID_len))
-	{
-		zbx_snprintf(error, max_error_len, "snmp_parse_oid(): cannot parse OID \"%s\".", snmp_oid);
-		ret = CONFIG_ERROR;
-		goto out;
-	}
-
-	if (-1 == zbx_snmp_print_oid(oid_index, sizeof(oid_index), rootOID, rootOID_len, ZBX_OID_INDEX_STRING))
-	{
-		zbx_snprintf(error, max_error_len, "zbx_snmp_print_oid(): cannot print OID \"%s\" with string indices.",
-				snmp_oid);
-		ret = CONFIG_ERROR;
-		goto out;
-	}
-
-	root_string_len = strlen(oid_index);
-
-	if (-1 == zbx_snmp_print_oid(oid_index, sizeof(oid_index), rootOID, rootOID_len, ZBX_OID_INDEX_NUMERIC))
-	{
-		zbx_snprintf(error, max_error_len, "zbx_snmp_print_oid(): cannot print OID \"%s\""
-				" with numeric indices.", snmp_oid);
-		ret = CONFIG_ERROR;
+	if (SUCCEED != (ret = zbx_snmp_walk_init(&walk, snmp_oid, walk_cb_func, walk_cb_arg, error, max_error_len)))
 		goto out;
-	}
-
-	root_numeric_len = strlen(oid_index);
-
-	/* copy rootOID to anOID */
-	memcpy(anOID, rootOID, rootOID_len * sizeof(oid));
-	anOID_len = rootOID_len;
 
 	/* initialize variables */
 	level = 0;
@@ -1081,7 +1284,7 @@ static int	zbx_snmp_walk(struct snmp_session *ss, const DC_ITEM *item, const cha
 			break;
 		}
 
-		if (NULL == snmp_add_null_var(pdu, anOID, anOID_len))	/* add OID as variable to PDU */
+		if (NULL == snmp_add_null_var(pdu, walk.last, walk.last_len))	/* add OID as variable to PDU */
 		{
 			zbx_strlcpy(error, "snmp_add_null_var(): cannot add null variable.", max_error_len);
 			ret = CONFIG_ERROR;
@@ -1134,104 +1337,7 @@ static int	zbx_snmp_walk(struct snmp_session *ss, const DC_ITEM *item, const cha
 		}
 
 		/* process response */
-		for (num_vars = 0, var = response->variables; NULL != var; num_vars++, var = var->next_variable)
-		{
-			/* verify if we are in the same subtree */
-			if (SNMP_ENDOFMIBVIEW == var->type || var->name_length < rootOID_len ||
-					0 != memcmp(rootOID, var->name, rootOID_len * sizeof(oid)))
-			{
-				/* reached the end or past this subtree */
-				running = 0;
-				break;
-			}
-			else if (SNMP_NOSUCHOBJECT != var->type && SNMP_NOSUCHINSTANCE != var->type)
-			{
-				/* not an exception value */
-
-				if (1 == check_oid_increase)	/* typical case */
-				{
-					int	res;
-
-					/* normally devices return OIDs in increasing order, */
-					/* snmp_oid_compare() will return -1 in this case */
-
-					if (-1 != (res = snmp_oid_compare(anOID, anOID_len, var->name,
-							var->name_length)))
-					{
-						if (0 == res)	/* got the same OID */
-						{
-							zbx_strlcpy(error, "OID not changing.", max_error_len);
-							ret = NOTSUPPORTED;
-							running = 0;
-							break;
-						}
-						else	/* 1 == res */
-						{
-							/* OID decreased. Disable further checks of increasing */
-							/* and set up a protection against endless looping. */
-
-							check_oid_increase = 0;
-							zbx_detect_loop_init(&oids_seen);
-						}
-					}
-				}
-
-				if (0 == check_oid_increase && FAIL == zbx_oid_is_new(&oids_seen, rootOID_len,
-						var->name, var->name_length))
-				{
-					zbx_strlcpy(error, "OID loop detected or too many OIDs.", max_error_len);
-					ret = NOTSUPPORTED;
-					running = 0;
-					break;
-				}
-
-				if (SUCCEED != zbx_snmp_choose_index(oid_index, sizeof(oid_index), var->name,
-						var->name_length, root_string_len, root_numeric_len))
-				{
-					zbx_snprintf(error, max_error_len, "zbx_snmp_choose_index():"
-							" cannot choose appropriate index while walking for"
-							" OID \"%s\".", snmp_oid);
-					ret = NOTSUPPORTED;
-					running = 0;
-					break;
-				}
-
-				init_result(&snmp_result);
-
-				if (SUCCEED == zbx_snmp_set_result(var, &snmp_result) &&
-						NULL != GET_STR_RESULT(&snmp_result))
-				{
-					walk_cb_func(walk_cb_arg, snmp_oid, oid_index, snmp_result.str);
-				}
-				else
-				{
-					char	**msg;
-
-					msg = GET_MSG_RESULT(&snmp_result);
-
-					zabbix_log(LOG_LEVEL_DEBUG, "cannot get index '%s' string value: %s",
-							oid_index, NULL != msg && NULL != *msg ? *msg : "(null)");
-				}
-
-				free_result(&snmp_result);
-
-				/* go to next variable */
-				memcpy((char *)anOID, (char *)var->name, var->name_length * sizeof(oid));
-				anOID_len = var->name_length;
-			}
-			else
-			{
-				/* an exception value, so stop */
-				char	*errmsg;
-
-				errmsg = zbx_get_snmp_type_error(var->type);
-				zbx_strlcpy(error, errmsg, max_error_len);
-				zbx_free(errmsg);
-				ret = NOTSUPPORTED;
-				running = 0;
-				break;
-			}
-		}
+		ret = zbx_snmp_walk_process(&walk, response, &num_vars, &running, error, max_error_len);
 
 		if (*max_succeed < num_vars)
 			*max_succeed = num_vars;
@@ -1240,8 +1346,7 @@ next:
 			snmp_free_pdu(response);
 	}
 
-	if (0 == check_oid_increase)
-		zbx_hashset_destroy(&oids_seen);
+	zbx_snmp_walk_clean(&walk);
 out:
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(ret));
 
@@ -1753,6 +1858,50 @@ static void	zbx_snmp_ddata_clean(zbx_snmp_ddata_t *data)
 	free_request(&data->request);
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_snmp_ddata_set_result                                        *
+ *                                                                            *
+ * Purpose: sets the discovered SNMP objects as the low level discovery       *
+ *          result                                                            *
+ *                                                                            *
+ * Parameters: data   - [IN] snmp discovery data object                       *
+ *             result - [OUT] the discovery item result                       *
+ *                                                                            *
+ ******************************************************************************/
+static void	zbx_snmp_ddata_set_result(const zbx_snmp_ddata_t *data, AGENT_RESULT *result)
+{
+	int				i, j;
+	struct zbx_json			js;
+	const zbx_snmp_dobject_t	*obj;
+
+	zbx_json_init(&js, ZBX_JSON_STAT_BUF_LEN);
+	zbx_json_addarray(&js, ZBX_PROTO_TAG_DATA);
+
+	for (i = 0; i < data->index.values_num; i++)
+	{
+		obj = (const zbx_snmp_dobject_t *)data->index.values[i];
+
+		zbx_json_addobject(&js, NULL);
+		zbx_json_addstring(&js, "{#SNMPINDEX}", obj->index, ZBX_JSON_TYPE_STRING);
+
+		for (j = 0; j < data->request.nparam / 2; j++)
+		{
+			if (NULL == obj->values[j])
+				continue;
+
+			zbx_json_addstring(&js, data->request.params[j * 2], obj->values[j], ZBX_JSON_TYPE_STRING);
+		}
+		zbx_json_close(&js);
+	}
+
+	zbx_json_close(&js);
+
+	SET_TEXT_RESULT(result, zbx_strdup(NULL, js.buffer));
+
+	zbx_json_free(&js);
+}
+
 static void	zbx_snmp_walk_discovery_cb(void *arg, const char *snmp_oid, const char *index, const char *value)
 {
 	zbx_snmp_ddata_t	*data = (zbx_snmp_ddata_t *)arg;
@@ -1781,11 +1930,9 @@ static int	zbx_snmp_process_discovery(struct snmp_session *ss, const DC_ITEM *it
 {
 	const char	*__function_name = "zbx_snmp_process_discovery";
 
-	int			i, j, ret;
+	int			ret;
 	char			oid_translated[ITEM_SNMP_OID_LEN_MAX];
-	struct zbx_json		js;
 	zbx_snmp_ddata_t	data;
-	zbx_snmp_dobject_t	*obj;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
@@ -1803,31 +1950,7 @@ static int	zbx_snmp_process_discovery(struct snmp_session *ss, const DC_ITEM *it
 		}
 	}
 
-	zbx_json_init(&js, ZBX_JSON_STAT_BUF_LEN);
-	zbx_json_addarray(&js, ZBX_PROTO_TAG_DATA);
-
-	for (i = 0; i < data.index.values_num; i++)
-	{
-		obj = (zbx_snmp_dobject_t *)data.index.values[i];
-
-		zbx_json_addobject(&js, NULL);
-		zbx_json_addstring(&js, "{#SNMPINDEX}", obj->index, ZBX_JSON_TYPE_STRING);
-
-		for (j = 0; j < data.request.nparam / 2; j++)
-		{
-			if (NULL == obj->values[j])
-				continue;
-
-			zbx_json_addstring(&js, data.request.params[j * 2], obj->values[j], ZBX_JSON_TYPE_STRING);
-		}
-		zbx_json_close(&js);
-	}
-
-	zbx_json_close(&js);
-
-	SET_TEXT_RESULT(result, zbx_strdup(NULL, js.buffer));
-
-	zbx_json_free(&js);
+	zbx_snmp_ddata_set_result(&data, result);
 clean:
 	zbx_snmp_ddata_clean(&data);
 out:
@@ -2169,413 +2292,1329 @@ void	zbx_init_snmp(void)
 
 
 
-//to do: consider giving up this function, it's pretty useless, could be replaced by one if statement
-int async_submit_result (int status, struct snmp_session *sp, struct snmp_pdu *response, AGENT_RESULT *result)
-{
-	const char	*__function_name = "async_submit_result";
-	struct variable_list *var;
+#define ZBX_ASYNC_SNMP_RETRIES	1
+#define ZBX_ASYNC_SNMP_TIMEOUT	2
+#define ZBX_ASYNC_SNMP_MAX_BATCH_TIME	30	/* walking big tables takes many requests */
 
-	zabbix_log(LOG_LEVEL_DEBUG, "In: %s() started ",__function_name);
+#define ZBX_ASYNC_SNMP_TASK_DYNAMIC	0
+#define ZBX_ASYNC_SNMP_TASK_DISCOVERY	1
 
+/* dynamic index or discovery item, needs walking OID trees of the device */
+typedef struct
+{
+	int			index;		/* the item index in the items array */
+	unsigned char		type;
+	char			*index_oid;	/* dynamic index: the translated OID of the index table */
+	char			*index_value;	/* dynamic index: the value to look for in the index table */
+	char			*idx;		/* dynamic index: the cached index being verified */
+	char			*walk_oid;	/* discovery: the translated OID being walked */
+	zbx_snmp_ddata_t	ddata;		/* discovery: the discovered objects */
+}
+zbx_async_snmp_task_t;
 
-	switch (status) 
-	{
-		case STAT_SUCCESS:
-			var = response->variables;
-		 	zabbix_log(LOG_LEVEL_DEBUG, "In: %s() stat_success %ld",__function_name,response->errstat);
+/* the OID requested by an async SNMP session */
+typedef struct
+{
+	int			index;		/* the item index in the items array */
+	zbx_async_snmp_task_t	*task;		/* the dynamic index item the cached index is verified for */
+	oid			*name;
+	size_t			name_len;
+}
+zbx_async_snmp_var_t;
 
-			if (SNMP_ERR_NOERROR == response->errstat) 
-			{
-				zabbix_log(LOG_LEVEL_DEBUG, "In: %s() before while ",__function_name);
-				while (var) 
-				{
-					zabbix_log(LOG_LEVEL_DEBUG, "%s() calling zbx_snmp_set_result ",__function_name);
-					zbx_snmp_set_result(var, result);
-					var = var->next_variable;
-				}
-			} else 
+/* async SNMP session, polls the items of one host with as few requests as the host allows */
+typedef struct
+{
+	struct snmp_session	*ss;		/* SNMPv3 session */
+	zbx_snmp_udp_peer_t	*peer;		/* SNMPv1/v2c peer on the shared UDP socket */
+	zbx_uint64_t		interfaceid;
+	const DC_ITEM		*items;
+	AGENT_RESULT		*results;
+	int			*errcodes;
+	zbx_async_snmp_var_t	*vars;		/* the OIDs to get, cached index verifications go first */
+	int			vars_num;
+	int			vars_alloc;
+	int			verify_num;	/* the number of cached indexes not verified yet */
+	int			current;	/* the first OID of the GET request in flight */
+	int			request_num;	/* the number of OIDs in the GET request in flight */
+	int			max_vars;	/* the current limit of variables per request */
+	int			bulk;
+	int			walk_bulk;	/* GetBulkRequest-PDU is not available in SNMPv1 */
+	int			max_succeed;
+	int			min_fail;
+	zbx_vector_ptr_t	tasks;		/* the items that need walking, walked one after another */
+	int			task_current;
+	zbx_snmp_walk_t		*walk;		/* the walk in flight */
+	int			walk_max_vars;
+	int			walk_level;
+	zbx_vector_str_t	walked;		/* the index tables walked by the session */
+	zbx_async_done_cb_t	done_cb;
+	void			*data;
+}
+zbx_async_snmp_session_t;
+
+static zbx_vector_ptr_t	async_snmp_sessions;
+static int		async_snmp_initialized = 0;
+
+static void	async_snmp_batch_done_cb(void *data, int index)
+{
+	ZBX_UNUSED(data);
+	ZBX_UNUSED(index);
+}
+
+static int	async_snmp_add_var(zbx_async_snmp_session_t *session, int index, const char *snmp_oid,
+		zbx_async_snmp_task_t *task);
+static int	async_snmp_response(int operation, struct snmp_session *sp, int reqid, struct snmp_pdu *pdu,
+		void *magic);
+
+static void	async_snmp_task_free(zbx_async_snmp_task_t *task)
+{
+	if (ZBX_ASYNC_SNMP_TASK_DISCOVERY == task->type)
+	{
+		zbx_snmp_ddata_clean(&task->ddata);
+		zbx_free(task->walk_oid);
+	}
+	else
+	{
+		zbx_free(task->index_oid);
+		zbx_free(task->index_value);
+		zbx_free(task->idx);
+	}
+
+	zbx_free(task);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_item_done                                             *
+ *                                                                            *
+ * Purpose: sets the item result and hands it over to the caller              *
+ *                                                                            *
+ * Parameters: session - [IN] the session                                     *
+ *             index   - [IN] the item index                                  *
+ *             errcode - [IN] the item error code                             *
+ *             error   - [IN] the error message if errcode is not SUCCEED,    *
+ *                            NULL if the result is already set               *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_snmp_item_done(zbx_async_snmp_session_t *session, int index, int errcode, const char *error)
+{
+	if (NULL != error)
+		SET_MSG_RESULT(&session->results[index], zbx_strdup(NULL, error));
+
+	session->errcodes[index] = errcode;
+	session->done_cb(session->data, index);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_add_indexed_var                                       *
+ *                                                                            *
+ * Purpose: adds the OID of dynamic index item with the found index to the    *
+ *          OIDs to get                                                       *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_snmp_add_indexed_var(zbx_async_snmp_session_t *session, const zbx_async_snmp_task_t *task,
+		const char *idx)
+{
+	const char	*snmp_oid = session->items[task->index].snmp_oid;
+	char		base_oid[ITEM_SNMP_OID_LEN_MAX], oid_translated[ITEM_SNMP_OID_LEN_MAX];
+
+	zbx_strlcpy(base_oid, snmp_oid, MIN(sizeof(base_oid), (size_t)(strchr(snmp_oid, '[') - snmp_oid + 1)));
+	zbx_snmp_translate(oid_translated, base_oid, sizeof(oid_translated));
+	zbx_strlcat(oid_translated, ".", sizeof(oid_translated));
+	zbx_strlcat(oid_translated, idx, sizeof(oid_translated));
+
+	if (SUCCEED != async_snmp_add_var(session, task->index, oid_translated, NULL))
+		session->done_cb(session->data, task->index);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_verify_done                                           *
+ *                                                                            *
+ * Purpose: checks if the cached index of dynamic index item still points to  *
+ *          the value the item is looking for                                 *
+ *                                                                            *
+ * Parameters: session - [IN] the session                                     *
+ *             task    - [IN] the dynamic index item                          *
+ *             var     - [IN] the value at the cached index, NULL on error    *
+ *             errcode - [IN] the error code if var is NULL                   *
+ *             error   - [IN] the error message if var is NULL                *
+ *                                                                            *
+ * Comments: the item is walked for the index if the value has changed or     *
+ *           cannot be retrieved, network errors fail the item                *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_snmp_verify_done(zbx_async_snmp_session_t *session, zbx_async_snmp_task_t *task,
+		const struct variable_list *var, int errcode, const char *error)
+{
+	AGENT_RESULT	result;
+	int		ret = FAIL;
+
+	if (NULL == var)
+	{
+		if (NOTSUPPORTED != errcode)
+		{
+			async_snmp_item_done(session, task->index, errcode, error);
+			async_snmp_task_free(task);
+			return;
+		}
+	}
+	else
+	{
+		init_result(&result);
+
+		if (SUCCEED == zbx_snmp_set_result(var, &result) && NULL != GET_STR_RESULT(&result) &&
+				0 == strcmp(result.str, task->index_value))
+		{
+			ret = SUCCEED;
+		}
+
+		free_result(&result);
+	}
+
+	if (SUCCEED == ret)
+	{
+		async_snmp_add_indexed_var(session, task, task->idx);
+		async_snmp_task_free(task);
+	}
+	else
+		zbx_vector_ptr_append(&session->tasks, task);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_var_done                                              *
+ *                                                                            *
+ * Purpose: processes the value of the first OID of the request and moves to  *
+ *          the next OID                                                      *
+ *                                                                            *
+ * Parameters: session - [IN] the session                                     *
+ *             var     - [IN] the received value, NULL on error               *
+ *             errcode - [IN] the error code if var is NULL                   *
+ *             error   - [IN] the error message if var is NULL                *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_snmp_var_done(zbx_async_snmp_session_t *session, const struct variable_list *var, int errcode,
+		const char *error)
+{
+	zbx_async_snmp_var_t	*request_var = &session->vars[session->current++];
+	zbx_async_snmp_task_t	*task = request_var->task;
+	int			index = request_var->index;
+
+	zbx_free(request_var->name);
+
+	if (NULL != task)
+	{
+		session->verify_num--;
+		async_snmp_verify_done(session, task, var, errcode, error);
+		return;
+	}
+
+	if (NULL != var)
+		async_snmp_item_done(session, index, zbx_snmp_set_result(var, &session->results[index]), NULL);
+	else
+		async_snmp_item_done(session, index, errcode, error);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_set_error                                             *
+ *                                                                            *
+ * Purpose: sets the same error for the given number of the next OIDs         *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_snmp_set_error(zbx_async_snmp_session_t *session, int num, int errcode, const char *error)
+{
+	while (0 < num-- && session->current < session->vars_num)
+		async_snmp_var_done(session, NULL, errcode, error);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_walk_free                                             *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_snmp_walk_free(zbx_async_snmp_session_t *session)
+{
+	zbx_snmp_walk_clean(session->walk);
+	zbx_free(session->walk);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_task_fail                                             *
+ *                                                                            *
+ * Purpose: sets the error for the item being walked and moves to the next    *
+ *          item that needs walking                                           *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_snmp_task_fail(zbx_async_snmp_session_t *session, int errcode, const char *error)
+{
+	zbx_async_snmp_task_t	*task = (zbx_async_snmp_task_t *)session->tasks.values[session->task_current++];
+
+	if (NULL != session->walk)
+		async_snmp_walk_free(session);
+
+	async_snmp_item_done(session, task->index, errcode, error);
+	async_snmp_task_free(task);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_fail                                                  *
+ *                                                                            *
+ * Purpose: sets the same error for all the items the session has not polled  *
+ *          yet and finishes the session                                      *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_snmp_fail(zbx_async_snmp_session_t *session, int errcode, const char *error)
+{
+	async_snmp_set_error(session, session->vars_num - session->current, errcode, error);
+
+	while (session->task_current < session->tasks.values_num)
+		async_snmp_task_fail(session, errcode, error);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_is_finished                                           *
+ *                                                                            *
+ ******************************************************************************/
+static int	async_snmp_is_finished(const zbx_async_snmp_session_t *session)
+{
+	if (session->current < session->vars_num || session->task_current < session->tasks.values_num)
+		return FAIL;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_shrink                                                *
+ *                                                                            *
+ * Purpose: lowers the number of variables per request after the host failed *
+ *          to handle the request in flight                                   *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_snmp_shrink(zbx_async_snmp_session_t *session, int max_vars)
+{
+	if (session->min_fail > session->request_num)
+		session->min_fail = session->request_num;
+
+	session->max_vars = MAX(max_vars, 1);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_send_pdu                                              *
+ *                                                                            *
+ * Purpose: sends the request through the shared UDP socket or through the   *
+ *          Net-SNMP session, the PDU is freed in any case                    *
+ *                                                                            *
+ * Parameters: session    - [IN] the session                                  *
+ *             pdu        - [IN] the request                                  *
+ *             retries    - [IN] the number of retransmissions                *
+ *             snmp_errno - [OUT] Net-SNMP error code on failure              *
+ *                                                                            *
+ * Return value: SUCCEED - the request was sent                               *
+ *               FAIL - otherwise                                             *
+ *                                                                            *
+ ******************************************************************************/
+static int	async_snmp_send_pdu(zbx_async_snmp_session_t *session, struct snmp_pdu *pdu, int retries,
+		int *snmp_errno)
+{
+	int	ret;
+
+	if (NULL != session->peer)
+	{
+		ret = zbx_snmp_udp_send(session->peer, pdu, retries, ZBX_ASYNC_SNMP_TIMEOUT * 1000,
+				async_snmp_response, session, snmp_errno);
+		snmp_free_pdu(pdu);
+
+		return ret;
+	}
+
+	session->ss->retries = retries;
+
+	if (0 != snmp_send(session->ss, pdu))
+		return SUCCEED;
+
+	snmp_free_pdu(pdu);
+	*snmp_errno = session->ss->s_snmp_errno;
+
+	return FAIL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_send                                                  *
+ *                                                                            *
+ * Purpose: sends GET request for the next OIDs of the session                *
+ *                                                                            *
+ * Return value: SUCCEED - the request was sent                               *
+ *               FAIL - the OIDs were failed, the session is finished         *
+ *                                                                            *
+ ******************************************************************************/
+static int	async_snmp_send(zbx_async_snmp_session_t *session)
+{
+	const char	*__function_name = "async_snmp_send";
+	struct snmp_pdu	*pdu;
+	int		i, snmp_errno;
+
+	while (session->current < session->vars_num)
+	{
+		if (NULL == (pdu = snmp_pdu_create(SNMP_MSG_GET)))
+		{
+			async_snmp_fail(session, CONFIG_ERROR, "snmp_pdu_create(): cannot create PDU object.");
+			return FAIL;
+		}
+
+		session->request_num = MIN(session->max_vars, session->vars_num - session->current);
+
+		for (i = session->current; i < session->current + session->request_num; i++)
+		{
+			if (NULL == snmp_add_null_var(pdu, session->vars[i].name, session->vars[i].name_len))
 			{
-				zabbix_log(LOG_LEVEL_DEBUG, "%s() there was an error in SNMP responce from the host",__function_name);
+				snmp_free_pdu(pdu);
+				async_snmp_fail(session, CONFIG_ERROR, "snmp_add_null_var(): cannot add null variable.");
+				return FAIL;
 			}
+		}
+
+		/* requests of several variables are not retried, a smaller request is sent instead */
+		if (SUCCEED == async_snmp_send_pdu(session, pdu, 1 == session->request_num ? ZBX_ASYNC_SNMP_RETRIES : 0,
+				&snmp_errno))
+		{
 			return SUCCEED;
+		}
+
+		zabbix_log(LOG_LEVEL_DEBUG, "%s() cannot send request of %d variables to host \"%s\": %s",
+				__function_name, session->request_num,
+				session->items[session->vars[session->current].index].host.host,
+				snmp_api_errstring(snmp_errno));
+
+		/* the request may exceed UDP datagram size or "msgMaxSize" limit of SNMPv3 device */
+		if (1 < session->request_num && SNMPERR_TOO_LONG == snmp_errno)
+		{
+			async_snmp_shrink(session, session->request_num / 2);
+			continue;
+		}
+
+		async_snmp_fail(session, NETWORK_ERROR, "Couldn't send snmp packet");
+	}
+
+	return FAIL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_walk_send                                             *
+ *                                                                            *
+ * Purpose: sends the next GetBulkRequest or GetNextRequest of the walk in    *
+ *          flight                                                            *
+ *                                                                            *
+ * Return value: SUCCEED - the request was sent                               *
+ *               FAIL - the walked item or the whole session was failed       *
+ *                                                                            *
+ ******************************************************************************/
+static int	async_snmp_walk_send(zbx_async_snmp_session_t *session)
+{
+	struct snmp_pdu	*pdu;
+	int		snmp_errno;
+
+	if (NULL == (pdu = snmp_pdu_create(SNMP_BULK_ENABLED == session->walk_bulk ? SNMP_MSG_GETBULK :
+			SNMP_MSG_GETNEXT)))
+	{
+		async_snmp_fail(session, CONFIG_ERROR, "snmp_pdu_create(): cannot create PDU object.");
+		return FAIL;
+	}
+
+	if (NULL == snmp_add_null_var(pdu, session->walk->last, session->walk->last_len))
+	{
+		snmp_free_pdu(pdu);
+		async_snmp_task_fail(session, CONFIG_ERROR, "snmp_add_null_var(): cannot add null variable.");
+		return FAIL;
+	}
+
+	if (SNMP_BULK_ENABLED == session->walk_bulk)
+	{
+		pdu->non_repeaters = 0;
+		pdu->max_repetitions = session->walk_max_vars;
+	}
+
+	if (SUCCEED == async_snmp_send_pdu(session, pdu, SNMP_BULK_ENABLED != session->walk_bulk ||
+			(1 == session->walk_max_vars && 0 == session->walk_level) ? ZBX_ASYNC_SNMP_RETRIES : 0,
+			&snmp_errno))
+	{
+		return SUCCEED;
+	}
+
+	zabbix_log(LOG_LEVEL_DEBUG, "cannot send walk request: %s", snmp_api_errstring(snmp_errno));
+	async_snmp_fail(session, NETWORK_ERROR, "Couldn't send snmp packet");
+
+	return FAIL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_walk_start                                            *
+ *                                                                            *
+ * Purpose: prepares walking of an OID tree for the item being walked         *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_snmp_walk_start(zbx_async_snmp_session_t *session, const char *snmp_oid,
+		zbx_snmp_walk_cb_func walk_cb_func, void *walk_cb_arg)
+{
+	char	error[MAX_STRING_LEN];
+	int	ret;
+
+	session->walk = (zbx_snmp_walk_t *)zbx_malloc(NULL, sizeof(zbx_snmp_walk_t));
+
+	if (SUCCEED != (ret = zbx_snmp_walk_init(session->walk, snmp_oid, walk_cb_func, walk_cb_arg, error,
+			sizeof(error))))
+	{
+		zbx_free(session->walk);
+		async_snmp_task_fail(session, ret, error);
+		return;
+	}
+
+	session->walk_max_vars = (SNMP_BULK_ENABLED == session->walk_bulk ? session->max_vars : 1);
+	session->walk_level = 0;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_task_next                                             *
+ *                                                                            *
+ * Purpose: starts the next walk of the item being walked or sets the item    *
+ *          result when all the walks are done                                *
+ *                                                                            *
+ * Comments: an index table is walked only once per session, the dynamic      *
+ *           index items of the same table share it through the index cache   *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_snmp_task_next(zbx_async_snmp_session_t *session)
+{
+	zbx_async_snmp_task_t	*task = (zbx_async_snmp_task_t *)session->tasks.values[session->task_current];
+	const DC_ITEM		*item = &session->items[task->index];
+	char			oid_translated[ITEM_SNMP_OID_LEN_MAX];
+	size_t			idx_alloc = 0;
+
+	if (ZBX_ASYNC_SNMP_TASK_DISCOVERY == task->type)
+	{
+		if (task->ddata.num < task->ddata.request.nparam / 2)
+		{
+			zbx_snmp_translate(oid_translated, task->ddata.request.params[task->ddata.num * 2 + 1],
+					sizeof(oid_translated));
+			task->walk_oid = zbx_strdup(task->walk_oid, oid_translated);
+
+			async_snmp_walk_start(session, task->walk_oid, zbx_snmp_walk_discovery_cb, &task->ddata);
+			return;
+		}
+
+		zbx_snmp_ddata_set_result(&task->ddata, &session->results[task->index]);
+		async_snmp_item_done(session, task->index, SUCCEED, NULL);
+	}
+	else
+	{
+		if (FAIL == zbx_vector_str_search(&session->walked, task->index_oid, ZBX_DEFAULT_STR_COMPARE_FUNC))
+		{
+			cache_del_snmp_index_subtree(item, task->index_oid);
+			async_snmp_walk_start(session, task->index_oid, zbx_snmp_walk_cache_cb, (void *)item);
+			return;
+		}
+
+		if (SUCCEED == cache_get_snmp_index(item, task->index_oid, task->index_value, &task->idx, &idx_alloc))
+		{
+			async_snmp_add_indexed_var(session, task, task->idx);
+		}
+		else
+		{
+			zbx_snprintf(oid_translated, sizeof(oid_translated), "Cannot find index of \"%s\" in \"%s\".",
+					task->index_value, task->index_oid);
+			async_snmp_item_done(session, task->index, NOTSUPPORTED, oid_translated);
+		}
+	}
+
+	async_snmp_task_free(task);
+	session->task_current++;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_next                                                  *
+ *                                                                            *
+ * Purpose: sends the next request of the session                             *
+ *                                                                            *
+ * Comments: cached indexes are verified first, then the items that need      *
+ *           walking are walked one by one and finally the values of all the  *
+ *           other items, including the dynamic index ones, are requested     *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_snmp_next(zbx_async_snmp_session_t *session)
+{
+	while (SUCCEED != async_snmp_is_finished(session))
+	{
+		if (NULL != session->walk)
+		{
+			if (SUCCEED == async_snmp_walk_send(session))
+				return;
+		}
+		else if (0 != session->verify_num || session->task_current == session->tasks.values_num)
+		{
+			if (SUCCEED == async_snmp_send(session))
+				return;
+		}
+		else
+			async_snmp_task_next(session);
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_check_vars                                            *
+ *                                                                            *
+ * Purpose: checks that the response variable bindings match the request     *
+ *                                                                            *
+ * Return value: SUCCEED - the variable bindings can be mapped to the items  *
+ *               FAIL - otherwise, error describes the problem               *
+ *                                                                            *
+ ******************************************************************************/
+static int	async_snmp_check_vars(const zbx_async_snmp_session_t *session, const struct snmp_pdu *pdu,
+		char *error, size_t max_error_len)
+{
+	const struct variable_list	*var;
+	const zbx_async_snmp_var_t	*req;
+	const char			*host;
+	char				sent_oid[ITEM_SNMP_OID_LEN_MAX], received_oid[ITEM_SNMP_OID_LEN_MAX];
+	int				i;
+
+	host = session->items[session->vars[session->current].index].host.host;
+
+	for (i = 0, var = pdu->variables; i < session->request_num && NULL != var; i++, var = var->next_variable)
+	{
+		req = &session->vars[session->current + i];
+
+		if (req->name_len == var->name_length && 0 == memcmp(req->name, var->name, req->name_len * sizeof(oid)))
+			continue;
+
+		zbx_snmp_dump_oid(sent_oid, sizeof(sent_oid), req->name, req->name_len);
+		zbx_snmp_dump_oid(received_oid, sizeof(received_oid), var->name, var->name_length);
+
+		if (1 == session->request_num)
+		{
+			zabbix_log(LOG_LEVEL_DEBUG, "SNMP response from host \"%s\" contains variable bindings that do"
+					" not match the request: sent \"%s\", received \"%s\"", host, sent_oid,
+					received_oid);
+			continue;
+		}
+
+		zabbix_log(LOG_LEVEL_WARNING, "SNMP response from host \"%s\" contains variable bindings that do"
+				" not match the request: sent \"%s\", received \"%s\"", host, sent_oid, received_oid);
+		zbx_strlcpy(error, "Invalid SNMP response: variable bindings do not match the request.",
+				max_error_len);
+
+		return FAIL;
+	}
+
+	if (i < session->request_num)
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "SNMP response from host \"%s\" contains too few variable bindings", host);
+		zbx_strlcpy(error, "Invalid SNMP response: too few variable bindings.", max_error_len);
+
+		return FAIL;
+	}
+
+	if (NULL != var)
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "SNMP response from host \"%s\" contains too many variable bindings",
+				host);
+		zbx_strlcpy(error, "Invalid SNMP response: too many variable bindings.", max_error_len);
+
+		return FAIL;
+	}
+
+	return SUCCEED;
+}
+
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_get_response                                          *
+ *                                                                            *
+ * Purpose: maps the response variable bindings to the OIDs of GET request    *
+ *                                                                            *
+ * Comments: follows zbx_snmp_get_values() - the request is halved when the   *
+ *           host cannot handle it and the OIDs are queried one by one after  *
+ *           a timeout                                                        *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_snmp_get_response(zbx_async_snmp_session_t *session, int operation, struct snmp_pdu *pdu)
+{
+	struct variable_list	*var;
+	char			error[MAX_STRING_LEN];
+	int			i;
+
+	if (NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE != operation)
+	{
+		if (1 < session->request_num)
+		{
+			/* some devices do not answer requests that are too big instead of reporting tooBig */
+			async_snmp_shrink(session, 1);
+		}
+		else
+		{
+			/* the host does not answer, do not wait for the rest of its items */
+			async_snmp_fail(session, TIMEOUT_ERROR, "snmp timeout");
+		}
+	}
+	else if (SNMP_ERR_NOERROR == pdu->errstat)
+	{
+		if (SUCCEED != async_snmp_check_vars(session, pdu, error, sizeof(error)))
+		{
+			if (1 < session->request_num)
+				async_snmp_shrink(session, session->request_num / 2);
+			else
+				async_snmp_set_error(session, 1, NOTSUPPORTED, error);
+		}
+		else
+		{
+			if (session->max_succeed < session->request_num)
+				session->max_succeed = session->request_num;
 
-			case STAT_TIMEOUT:
-				zabbix_log(LOG_LEVEL_DEBUG, "%s() there was a timeout in SNMP request to %s",__function_name,sp->peername);
-				return FAIL;
+			for (var = pdu->variables; NULL != var; var = var->next_variable)
+				async_snmp_var_done(session, var, SUCCEED, NULL);
+		}
+	}
+	else if (SNMP_ERR_NOSUCHNAME == pdu->errstat && 0 != pdu->errindex)
+	{
+		/* SNMPv1 rejects the whole request because of the bad variable, see zbx_snmp_get_values() */
+		if (0 > (i = pdu->errindex - 1) || i >= session->request_num)
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "SNMP response from host \"%s\" contains an out of bounds error"
+					" index: %ld", session->items[session->vars[session->current].index].host.host,
+					pdu->errindex);
+			async_snmp_set_error(session, session->request_num, NOTSUPPORTED,
+					"Invalid SNMP response: error index out of bounds.");
+		}
+		else
+		{
+			zbx_async_snmp_var_t	bad = session->vars[session->current + i];
+
+			/* the order of the OIDs is not important, the rest is requested again */
+			session->vars[session->current + i] = session->vars[session->current];
+			session->vars[session->current] = bad;
 
-			case STAT_ERROR:
-				zabbix_log(LOG_LEVEL_DEBUG, "%s() there was an error in SNMP responce from %s",__function_name,sp->peername);
-				return 0;
+			zbx_snprintf(error, sizeof(error), "SNMP error: %s", snmp_errstring(pdu->errstat));
+			async_snmp_set_error(session, 1, NOTSUPPORTED, error);
+		}
+	}
+	else if (SNMP_ERR_TOOBIG == pdu->errstat && 1 < session->request_num)
+	{
+		async_snmp_shrink(session, session->request_num / 2);
+	}
+	else
+	{
+		zbx_snprintf(error, sizeof(error), "SNMP error: %s", snmp_errstring(pdu->errstat));
+		async_snmp_set_error(session, session->request_num, NOTSUPPORTED, error);
 	}
-	return 0;
 }
 
-/* structures keep thread safe per session configuration to be used in snmp callbacks */
-struct async_snmp_conf
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_walk_response                                         *
+ *                                                                            *
+ * Purpose: passes the response variable bindings to the walk in flight       *
+ *                                                                            *
+ * Comments: follows zbx_snmp_walk() - max-repetitions is lowered when the    *
+ *           host cannot handle the request                                   *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_snmp_walk_response(zbx_async_snmp_session_t *session, int operation, struct snmp_pdu *pdu)
 {
-	size_t	parsed_oid_lens[MAX_ASYNC_SNMP_ITEMS];
-	char	oids_translated[MAX_ASYNC_SNMP_ITEMS][ITEM_SNMP_OID_LEN_MAX];
-	oid		parsed_oids[MAX_ASYNC_SNMP_ITEMS][MAX_OID_LEN];
-
-	int				*errcodes;
-	AGENT_RESULT	*results;
-	const DC_ITEM	*items;
-	int				active_hosts; /* hosts that we have not completed */
-
-};
+	zbx_async_snmp_task_t	*task = (zbx_async_snmp_task_t *)session->tasks.values[session->task_current];
+	char			error[MAX_STRING_LEN];
+	int			ret, num_vars, running = 1;
 
-struct async_snmp_session 
-{
-	struct			snmp_session *sess;		/* SNMP session data */
-	int				current_item;		/* Items index  in the items array we've processing */
-	int				max_items;		//items count int the items array, to stop iterating
-	struct			async_snmp_conf *conf;
-};
-/*
- * SNMP callback  responce handler
- */
-int asynch_response(int operation, struct snmp_session *sp, int reqid,
-		    struct snmp_pdu *pdu, void *magic)
-{
+	if (1 < session->walk_max_vars && (NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE != operation ||
+			SNMP_ERR_TOOBIG == pdu->errstat))
+	{
+		if (session->min_fail > session->walk_max_vars)
+			session->min_fail = session->walk_max_vars;
 
-	const char	*__function_name = "asynch_response";
+		if (0 == session->walk_level)
+			session->walk_max_vars /= 2;
+		else if (1 == session->walk_level)
+			session->walk_max_vars = 1;
 
-	struct async_snmp_session *sess = (struct async_snmp_session *)magic;
-	struct async_snmp_conf *conf=sess->conf;
+		session->walk_level++;
+		return;
+	}
 
-	struct snmp_pdu *req;
-	zbx_uint64_t	prev_hostid;
+	if (NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE != operation)
+	{
+		async_snmp_fail(session, TIMEOUT_ERROR, "snmp timeout");
+		return;
+	}
 
-	prev_hostid=conf->items[sess->current_item].host.hostid;
-//	zabbix_log(LOG_LEVEL_DEBUG, "In %s() callout hostid %d responce is %u", __function_name,prev_hostid,pdu);
+	if (SNMP_ERR_NOERROR != pdu->errstat)
+	{
+		ret = zbx_get_snmp_response_error(session->ss, &session->items[task->index].interface, STAT_SUCCESS,
+				pdu, error, sizeof(error));
+		async_snmp_task_fail(session, ret, error);
+		return;
+	}
 
-	if (operation != NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE) {
+	ret = zbx_snmp_walk_process(session->walk, pdu, &num_vars, &running, error, sizeof(error));
 
-		SET_MSG_RESULT(&conf->results[sess->current_item], zbx_strdup(NULL, "snmp timeout"));
-		conf->errcodes[sess->current_item]=TIMEOUT_ERROR;
-		async_submit_result(STAT_TIMEOUT, sp, pdu,&conf->results[sess->current_item]);
+	if (session->max_succeed < num_vars)
+		session->max_succeed = num_vars;
 
-		conf->active_hosts--;
-		return 1;
-	} else 
+	if (SUCCEED != ret)
 	{
-		async_submit_result(STAT_SUCCESS, sess->sess, pdu, &conf->results[sess->current_item]);
-		conf->errcodes[sess->current_item]=SUCCEED;
-	}
-
-	//iterating to next snmp item in the list while processing the same host
-	//and skipping any non-snmp type items 
-	sess->current_item++;
-	while (sess->current_item < sess->max_items ) {
-		if  (SUCCEED == is_snmp_type(conf->items[sess->current_item].type)) {
-			zabbix_log(LOG_LEVEL_DEBUG, "In %s() found snmp item",__function_name);
-			break;
-		}
-		sess->current_item++;
-		zabbix_log(LOG_LEVEL_DEBUG, "In %s() skipping non-snmp item",__function_name);
+		async_snmp_task_fail(session, ret, error);
+		return;
 	}
 
-	//checking if we're not at the end of items list
-	if ( sess->current_item < sess->max_items) {
-
-		//and still processing the same host
-		if (conf->items[sess->current_item].host.hostid == prev_hostid ) {
+	if (0 != running)
+		return;
 
-			//then sending next oid query in case there is an oid
-			if ( conf->items[sess->current_item].snmp_oid ) {
+	async_snmp_walk_free(session);
 
-				zabbix_log(LOG_LEVEL_DEBUG, "In %s() Parsing oids and adding null vals", __function_name);
-				conf->parsed_oid_lens[sess->current_item] = MAX_OID_LEN;
+	if (ZBX_ASYNC_SNMP_TASK_DISCOVERY == task->type)
+		task->ddata.num++;
+	else
+		zbx_vector_str_append(&session->walked, zbx_strdup(NULL, task->index_oid));
+}
 
-				//oid translation
-				if (NULL != conf->items[sess->current_item].snmp_oid )	
-				{
-					zbx_snmp_translate(	conf->oids_translated[sess->current_item], 
-										conf->items[sess->current_item].snmp_oid,
-										sizeof(conf->oids_translated[sess->current_item]));
-				}  else 
-				{
-					SET_MSG_RESULT(	&conf->results[sess->current_item], 
-									zbx_dsprintf(NULL, "zbx_snmp_translate(): cannot parse OID \"%s\".",
-									conf->oids_translated[sess->current_item]));
-					zabbix_log(	LOG_LEVEL_DEBUG, "In %s() cannot translate oid %s for hostid %ld", 
-								__function_name,
-								conf->oids_translated[sess->current_item],
-								conf->items[sess->current_item].host.hostid);
-
-					conf->errcodes[sess->current_item] = CONFIG_ERROR;
-					conf->active_hosts--;
-					return 1;
-				}
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_response                                              *
+ *                                                                            *
+ * Purpose: net-snmp callback, processes the response and sends the next      *
+ *          request of the session                                            *
+ *                                                                            *
+ ******************************************************************************/
+static int	async_snmp_response(int operation, struct snmp_session *sp, int reqid, struct snmp_pdu *pdu,
+		void *magic)
+{
+	zbx_async_snmp_session_t	*session = (zbx_async_snmp_session_t *)magic;
 
-				if (NULL == snmp_parse_oid(	conf->oids_translated[sess->current_item],
-											conf->parsed_oids[sess->current_item], 
-											&conf->parsed_oid_lens[sess->current_item])) 
-				{
-					SET_MSG_RESULT(	&conf->results[sess->current_item], 
-									zbx_dsprintf(NULL, "snmp_parse_oid(): cannot parse OID \"%s\".",
-												conf->oids_translated[sess->current_item]));
-
-					zabbix_log(	LOG_LEVEL_DEBUG, 
-								"In %s() cannot snmp_parse_oid %s for hostid %ld", 
-								__function_name,
-								conf->oids_translated[sess->current_item],
-								conf->items[sess->current_item].host.hostid);
-
-					conf->errcodes[sess->current_item] = CONFIG_ERROR;
-					conf->active_hosts--;
-					return 1;
-				}
+	ZBX_UNUSED(sp);
+	ZBX_UNUSED(reqid);
 
-				if (NULL == (req = snmp_pdu_create(SNMP_MSG_GET))) 
-				{
-					zabbix_log(LOG_LEVEL_DEBUG, "In %s() cannot create pdu for hostid %ld", 
-							__function_name,conf->items[sess->current_item].host.hostid);
+	if (SUCCEED == async_snmp_is_finished(session))
+		return 1;
 
-					conf->errcodes[sess->current_item]=CONFIG_ERROR;
-					conf->active_hosts--;
-					return 1;
-				}
+	if (NULL != session->walk)
+		async_snmp_walk_response(session, operation, pdu);
+	else
+		async_snmp_get_response(session, operation, pdu);
 
-				if (NULL == snmp_add_null_var(req, conf->parsed_oids[sess->current_item], conf->parsed_oid_lens[sess->current_item]))
-				{
-					SET_MSG_RESULT(&conf->results[sess->current_item], zbx_strdup(NULL, "snmp_add_null_var(): cannot add null variable."));
-					zabbix_log(LOG_LEVEL_DEBUG, "In %s() cannot add  vars  hostid %ld", 
-							__function_name,conf->items[sess->current_item].host.hostid);
-
-					conf->errcodes[sess->current_item] = CONFIG_ERROR;
-					snmp_free_pdu(req);
-					conf->active_hosts--;
-					return 1;
-				}
+	async_snmp_next(session);
 
-				if (snmp_send(sp, req)) {
-					return 1;
-				} else {
-					snmp_perror("snmp_send");
-					snmp_free_pdu(req);
+	return 1;
+}
 
-					zabbix_log(LOG_LEVEL_DEBUG, "In %s() couldn't send snmp request for  hostid %ld", 
-							__function_name,conf->items[sess->current_item].host.hostid);
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_session_free                                          *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_snmp_session_free(zbx_async_snmp_session_t *session)
+{
+	if (NULL != session->ss || NULL != session->peer)
+	{
+		if (NULL != session->ss)
+			zbx_snmp_close_session(session->ss);
+		else
+			zbx_snmp_udp_peer_free(session->peer);
 
-					SET_MSG_RESULT(&conf->results[sess->current_item], zbx_strdup(NULL, "snmp_send couldn't send a packet"));
-					conf->errcodes[sess->current_item] = NETWORK_ERROR;
-				}
-			}
+		if (SNMP_BULK_ENABLED == session->bulk &&
+				(0 != session->max_succeed || MAX_SNMP_ITEMS + 1 != session->min_fail))
+		{
+			DCconfig_update_interface_snmp_stats(session->interfaceid, session->max_succeed,
+					session->min_fail);
 		}
 	}
 
-	conf->active_hosts--;
-	return 1;
+	zbx_vector_ptr_destroy(&session->tasks);
+	zbx_vector_str_clear_ext(&session->walked, zbx_str_free);
+	zbx_vector_str_destroy(&session->walked);
+	zbx_free(session->vars);
+	zbx_free(session);
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_release_finished                                      *
+ *                                                                            *
+ * Purpose: closes sessions that have no more items to poll                   *
+ *                                                                            *
+ * Comments: sessions cannot be closed from within net-snmp callbacks, so     *
+ *           finished sessions are released after each read                   *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_snmp_release_finished(void)
+{
+	zbx_async_snmp_session_t	*session;
+	int				i;
+
+	for (i = 0; i < async_snmp_sessions.values_num;)
+	{
+		session = (zbx_async_snmp_session_t *)async_snmp_sessions.values[i];
 
-void	get_values_snmp_async(const DC_ITEM *items, AGENT_RESULT *results, int *errcodes, int num)
+		if (SUCCEED != async_snmp_is_finished(session))
+		{
+			i++;
+			continue;
+		}
+
+		async_snmp_session_free(session);
+		zbx_vector_ptr_remove_noorder(&async_snmp_sessions, i);
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_add_var                                               *
+ *                                                                            *
+ * Purpose: adds the OID to get to the session                                *
+ *                                                                            *
+ * Parameters: session  - [IN] the session                                    *
+ *             index    - [IN] the item index                                 *
+ *             snmp_oid - [IN] the translated OID                             *
+ *             task     - [IN] the dynamic index item the cached index is     *
+ *                             verified for, NULL for the item value OIDs     *
+ *                                                                            *
+ * Return value: SUCCEED - the OID was added                                  *
+ *               FAIL - the OID cannot be parsed, the item error is set       *
+ *                                                                            *
+ ******************************************************************************/
+static int	async_snmp_add_var(zbx_async_snmp_session_t *session, int index, const char *snmp_oid,
+		zbx_async_snmp_task_t *task)
 {
-	const char		*__function_name = "get_values_snmp";
+	oid			parsed_oid[MAX_OID_LEN];
+	size_t			parsed_oid_len = MAX_OID_LEN;
+	zbx_async_snmp_var_t	*var;
 
-	char				error[MAX_STRING_LEN];
-	struct snmp_session	*ss [MAX_ASYNC_SNMP_ITEMS];
-	int					i, err = SUCCEED, max_succeed = 0,ret=0;
-	struct snmp_pdu		*pdus[MAX_ASYNC_SNMP_ITEMS], *response;
+	if (NULL == snmp_parse_oid(snmp_oid, parsed_oid, &parsed_oid_len))
+	{
+		SET_MSG_RESULT(&session->results[index], zbx_dsprintf(NULL, "snmp_parse_oid(): cannot parse OID"
+				" \"%s\".", snmp_oid));
+		session->errcodes[index] = CONFIG_ERROR;
+		return FAIL;
+	}
+
+	if (session->vars_num == session->vars_alloc)
+	{
+		session->vars_alloc = MAX(8, session->vars_alloc * 2);
+		session->vars = (zbx_async_snmp_var_t *)zbx_realloc(session->vars,
+				session->vars_alloc * sizeof(zbx_async_snmp_var_t));
+	}
 
-	size_t			max_error_len;
+	if (NULL != task)
+	{
+		/* verifications are kept before the other OIDs, so the indexes are known before the values are */
+		/* requested, verifications are added only before the session starts                           */
+		session->vars[session->vars_num++] = session->vars[session->verify_num];
+		var = &session->vars[session->verify_num++];
+	}
+	else
+		var = &session->vars[session->vars_num++];
 
-	struct		variable_list *var;
-	int			snmp_sessions=0;
-	struct		async_snmp_session *hs;
-	struct		async_snmp_conf *conf;
+	var->index = index;
+	var->task = task;
+	var->name_len = parsed_oid_len;
+	var->name = (oid *)zbx_malloc(NULL, parsed_oid_len * sizeof(oid));
+	memcpy(var->name, parsed_oid, parsed_oid_len * sizeof(oid));
 
-	zbx_uint64_t	last_hostid=0;
+	return SUCCEED;
+}
 
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_add_dynamic                                           *
+ *                                                                            *
+ * Purpose: adds dynamic index item to the session                            *
+ *                                                                            *
+ * Comments: if the index is cached it is verified before the value is        *
+ *           requested, otherwise the index table is walked                   *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_snmp_add_dynamic(zbx_async_snmp_session_t *session, int index)
+{
+	const DC_ITEM		*item = &session->items[index];
+	char			method[8], index_oid[ITEM_SNMP_OID_LEN_MAX], index_value[ITEM_SNMP_OID_LEN_MAX],
+				oid_translated[ITEM_SNMP_OID_LEN_MAX];
+	size_t			idx_alloc = 0;
+	zbx_async_snmp_task_t	*task;
 
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s() Started. Got num:%d OIDs to parse",
-			__function_name, num);
+	if (3 != num_key_param(item->snmp_oid))
+	{
+		SET_MSG_RESULT(&session->results[index], zbx_dsprintf(NULL, "OID \"%s\" contains unsupported"
+				" parameters.", item->snmp_oid));
+		session->errcodes[index] = CONFIG_ERROR;
+		session->done_cb(session->data, index);
+		return;
+	}
 
+	get_key_param(item->snmp_oid, 1, method, sizeof(method));
+	get_key_param(item->snmp_oid, 2, index_oid, sizeof(index_oid));
+	get_key_param(item->snmp_oid, 3, index_value, sizeof(index_value));
 
-	if (NULL == (hs = zbx_malloc(NULL, sizeof(struct async_snmp_session) * MAX_ASYNC_SNMP_ITEMS))) 	return;
-	if (NULL == (conf = zbx_malloc(NULL,sizeof(struct async_snmp_conf)))) return;
+	if (0 != strcmp("index", method))
+	{
+		SET_MSG_RESULT(&session->results[index], zbx_dsprintf(NULL, "Unsupported method \"%s\" in the OID"
+				" \"%s\".", method, item->snmp_oid));
+		session->errcodes[index] = CONFIG_ERROR;
+		session->done_cb(session->data, index);
+		return;
+	}
 
-	
-	conf->items=items;
-	conf->results=results;
-	conf->errcodes=errcodes;
-	conf->active_hosts=0;
+	zbx_snmp_translate(oid_translated, index_oid, sizeof(oid_translated));
 
+	task = (zbx_async_snmp_task_t *)zbx_malloc(NULL, sizeof(zbx_async_snmp_task_t));
+	task->index = index;
+	task->type = ZBX_ASYNC_SNMP_TASK_DYNAMIC;
+	task->index_oid = zbx_strdup(NULL, oid_translated);
+	task->index_value = zbx_strdup(NULL, index_value);
+	task->idx = NULL;
 
-	for ( i = 0; i < num; i++) 
+	if (SUCCEED != cache_get_snmp_index(item, task->index_oid, task->index_value, &task->idx, &idx_alloc))
 	{
+		zbx_vector_ptr_append(&session->tasks, task);
+		return;
+	}
 
-		if (SUCCEED != is_snmp_type( items[i].type )) {
-			zabbix_log(LOG_LEVEL_DEBUG, "skipping non-snmp item %d",i);
-			continue;	
-		}
-		
+	zbx_snprintf(oid_translated, sizeof(oid_translated), "%s.%s", task->index_oid, task->idx);
+
+	if (SUCCEED != async_snmp_add_var(session, index, oid_translated, task))
+	{
+		async_snmp_task_free(task);
+		session->done_cb(session->data, index);
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_add_item                                              *
+ *                                                                            *
+ * Purpose: adds the item to the session                                      *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_snmp_add_item(zbx_async_snmp_session_t *session, int index)
+{
+	const DC_ITEM		*item = &session->items[index];
+	char			error[MAX_STRING_LEN], oid_translated[ITEM_SNMP_OID_LEN_MAX];
+	zbx_async_snmp_task_t	*task;
+
+	if (0 != (ZBX_FLAG_DISCOVERY_RULE & item->flags) || 0 == strncmp(item->snmp_oid, "discovery[", 10))
+	{
+		task = (zbx_async_snmp_task_t *)zbx_malloc(NULL, sizeof(zbx_async_snmp_task_t));
 
-		if (  
-			0 != (ZBX_FLAG_DISCOVERY_RULE & items[i].flags) ||
-			0 == strncmp(items[i].snmp_oid, "discovery[", 10) || 
-			NULL != strchr(items[i].snmp_oid, '[')
-			)
+		if (SUCCEED != zbx_snmp_ddata_init(&task->ddata, item->snmp_oid, error, sizeof(error)))
 		{
-			//skipping any dynamic items, they will be processed slow-old-sync way
-			zabbix_log(LOG_LEVEL_DEBUG, "skipping discovery item %d",i);
-			continue;
+			zbx_free(task);
+			async_snmp_item_done(session, index, CONFIG_ERROR, error);
+			return;
 		}
 
-		//setting fail code by default to disable for a while items we haven't been able to access
-		errcodes[i]=TIMEOUT_ERROR;
+		task->index = index;
+		task->type = ZBX_ASYNC_SNMP_TASK_DISCOVERY;
+		task->ddata.num = 0;
+		task->walk_oid = NULL;
 
-		if (items[i].host.hostid != last_hostid) 
+		zbx_vector_ptr_append(&session->tasks, task);
+	}
+	else if (NULL != strchr(item->snmp_oid, '['))
+	{
+		async_snmp_add_dynamic(session, index);
+	}
+	else
+	{
+		if (0 != num_key_param(item->snmp_oid))
 		{
-			last_hostid=items[i].host.hostid;
-			zabbix_log(LOG_LEVEL_DEBUG, "In %s() found new host host id %ld, session is %d", __function_name,last_hostid,snmp_sessions);
+			zbx_snprintf(error, sizeof(error), "OID \"%s\" contains unsupported parameters.",
+					item->snmp_oid);
+			async_snmp_item_done(session, index, CONFIG_ERROR, error);
+			return;
+		}
 
-			hs[snmp_sessions].conf=conf;
-			hs[snmp_sessions].current_item=i;
-			hs[snmp_sessions].max_items=num;
+		zbx_snmp_translate(oid_translated, item->snmp_oid, sizeof(oid_translated));
 
-			conf->parsed_oid_lens[i] = MAX_OID_LEN;
+		if (SUCCEED != async_snmp_add_var(session, index, oid_translated, NULL))
+			session->done_cb(session->data, index);
+	}
+}
 
-			zabbix_log(LOG_LEVEL_DEBUG, "In %s() init completed %ld", __function_name,last_hostid);
+/******************************************************************************
+ *                                                                            *
+ * Function: async_snmp_same_session                                          *
+ *                                                                            *
+ * Purpose: checks if two items can be polled by the same SNMP session        *
+ *                                                                            *
+ * Comments: compares the same fields as the configuration cache uses to      *
+ *           group SNMP items for the synchronous pollers                     *
+ *                                                                            *
+ ******************************************************************************/
+static int	async_snmp_same_session(const DC_ITEM *i1, const DC_ITEM *i2)
+{
+	if (i1->interface.interfaceid != i2->interface.interfaceid || i1->interface.port != i2->interface.port ||
+			i1->type != i2->type)
+	{
+		return FAIL;
+	}
 
-			//starting new session for it:
-			if (NULL == (ss[snmp_sessions]=zbx_snmp_open_session(&items[i], error, sizeof(error))))
-			{
-				err = CONFIG_ERROR;
-				errcodes[i]=FAIL;
-				zabbix_log(LOG_LEVEL_DEBUG, "In %s() Opening snmp sessions: failed to open session for item %d", __function_name,i);
-				SET_MSG_RESULT(&results[i], zbx_dsprintf(NULL, "Couldn't open snmp session"));
-				
-				continue;
-			} 
+	if (0 != strcmp(i1->snmp_community, i2->snmp_community))
+		return FAIL;
 
-#define SNMP_RETRIES	1
-#define SNMP_TIMEOUT	2
-			ss[snmp_sessions]->callback = asynch_response;
-			ss[snmp_sessions]->callback_magic = &hs[snmp_sessions];
-			ss[snmp_sessions]->retries=SNMP_RETRIES;
-			ss[snmp_sessions]->timeout=SNMP_TIMEOUT*1000*1000;
+	/* the SNMPv3 fields are not set for the other versions */
+	if (ITEM_TYPE_SNMPv3 != i1->type)
+		return SUCCEED;
 
-			zabbix_log(LOG_LEVEL_DEBUG, "In %s() session is opened %ld", __function_name,last_hostid);
+	if (0 != strcmp(i1->snmpv3_securityname, i2->snmpv3_securityname) ||
+			0 != strcmp(i1->snmpv3_authpassphrase, i2->snmpv3_authpassphrase) ||
+			0 != strcmp(i1->snmpv3_privpassphrase, i2->snmpv3_privpassphrase) ||
+			0 != strcmp(i1->snmpv3_contextname, i2->snmpv3_contextname))
+	{
+		return FAIL;
+	}
 
-			if (NULL != items[i].snmp_oid )
-			{
-				zbx_snmp_translate(conf->oids_translated[i], items[i].snmp_oid, sizeof(conf->oids_translated[i]));
-			}  else 
-			{
-				zabbix_log(LOG_LEVEL_DEBUG, "In %s() cannot translate empty oid %s for hostid %ld", __function_name, 
-						conf->oids_translated[i],items[i].host.hostid);
+	if (i1->snmpv3_securitylevel != i2->snmpv3_securitylevel ||
+			i1->snmpv3_authprotocol != i2->snmpv3_authprotocol ||
+			i1->snmpv3_privprotocol != i2->snmpv3_privprotocol)
+	{
+		return FAIL;
+	}
 
-				SET_MSG_RESULT(&results[i], zbx_dsprintf(NULL, "snmp_parse_oid(): empty OID"));
-				errcodes[i] = CONFIG_ERROR;
-				continue;
-			}
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_async_snmp_start                                             *
+ *                                                                            *
+ * Purpose: starts polling of SNMP items without waiting for the results     *
+ *                                                                            *
+ * Parameters: items    - [IN] the items to poll                              *
+ *             results  - [OUT] the item results                              *
+ *             errcodes - [IN/OUT] the item error codes, only NOT_PROCESSED   *
+ *                                 items are polled                           *
+ *             num      - [IN] the number of items                            *
+ *             done_cb  - [IN] called once for every item as soon as it is    *
+ *                             finished with, possibly before this function   *
+ *                             returns                                        *
+ *             data     - [IN] the callback data                              *
+ *                                                                            *
+ * Comments: one session is opened for every run of consecutive items of the  *
+ *           same SNMP interface and credentials. It packs as many OIDs into  *
+ *           a GET request as the interface statistics suggest and walks the  *
+ *           tables of dynamic index and discovery items with GetBulkRequest. *
+ *           Items that are not SNMP are left NOT_PROCESSED. Host names must  *
+ *           be resolved by zbx_resolver_resolve() beforehand. Items, results *
+ *           and errcodes must stay in place until the last callback. The     *
+ *           sessions are driven by zbx_async_snmp_poll().                    *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_async_snmp_start(const DC_ITEM *items, AGENT_RESULT *results, int *errcodes, int num,
+		zbx_async_done_cb_t done_cb, void *data)
+{
+	const char			*__function_name = "zbx_async_snmp_start";
+	char				error[MAX_STRING_LEN];
+	zbx_async_snmp_session_t	*session = NULL;
+	const DC_ITEM			*first = NULL;
+	int				i;
 
-			//zabbix_log(LOG_LEVEL_DEBUG, "In %s() Opening snmp sessions: created session for item %d, code is %d", __function_name,i,errcodes[i]);
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() num:%d", __function_name, num);
 
-			if (NULL == snmp_parse_oid(conf->oids_translated[i], conf->parsed_oids[i], &conf->parsed_oid_lens[i]))
-			{
-				SET_MSG_RESULT(&results[i], zbx_dsprintf(NULL, "snmp_parse_oid(): cannot parse OID \"%s\".",
-						conf->oids_translated[i]));
-				zabbix_log(LOG_LEVEL_DEBUG, "In %s() cannot snmp_parse_oid %s for hostid %ld", __function_name,
-					conf->oids_translated[i], items[i].host.hostid);
-				errcodes[i] = CONFIG_ERROR;
-				continue;
-			}
+	if (0 == async_snmp_initialized)
+	{
+		zbx_vector_ptr_create(&async_snmp_sessions);
+		async_snmp_initialized = 1;
+	}
 
-			if (NULL == (pdus[snmp_sessions] = snmp_pdu_create(SNMP_MSG_GET)))
-			{
-				SET_MSG_RESULT(&results[i], zbx_dsprintf(NULL, "snmp_pdu_create(): cannot create PDU object "));
-				zabbix_log(LOG_LEVEL_DEBUG, "In %s() cannot create pdu for hostid %ld",__function_name,conf->items[i].host.hostid);
-				errcodes[i]=CONFIG_ERROR;
-				continue;
-			}
+	for (i = 0; i < num; i++)
+	{
+		if (NOT_PROCESSED != errcodes[i] || SUCCEED != is_snmp_type(items[i].type))
+		{
+			done_cb(data, i);
+			continue;
+		}
 
+		if (NULL == first || SUCCEED != async_snmp_same_session(first, &items[i]))
+		{
+			session = (zbx_async_snmp_session_t *)zbx_malloc(NULL, sizeof(zbx_async_snmp_session_t));
+
+			session->ss = NULL;
+			session->peer = NULL;
+			session->interfaceid = items[i].interface.interfaceid;
+			session->items = items;
+			session->results = results;
+			session->errcodes = errcodes;
+			session->vars = NULL;
+			session->vars_num = 0;
+			session->vars_alloc = 0;
+			session->verify_num = 0;
+			session->current = 0;
+			session->request_num = 0;
+			session->max_succeed = 0;
+			session->min_fail = MAX_SNMP_ITEMS + 1;
+			zbx_vector_ptr_create(&session->tasks);
+			session->task_current = 0;
+			session->walk = NULL;
+			zbx_vector_str_create(&session->walked);
+			session->done_cb = done_cb;
+			session->data = data;
+
+			zbx_vector_ptr_append(&async_snmp_sessions, session);
+			first = &items[i];
+		}
 
-			if (NULL == snmp_add_null_var(pdus[snmp_sessions], conf->parsed_oids[i], conf->parsed_oid_lens[i]))
-			{
-				SET_MSG_RESULT(&results[i], zbx_strdup(NULL, "snmp_add_null_var(): cannot add null variable."));
-				zabbix_log(LOG_LEVEL_DEBUG, "In %s() cannot add  vars  hostid %ld",__function_name,conf->items[i].host.hostid);
-				errcodes[i] = CONFIG_ERROR;
-				snmp_free_pdu(pdus[snmp_sessions]);
-				//zbx_snmp_close_session(ss[snmp_sessions]);
-				continue;
-			}
+		async_snmp_add_item(session, i);
+	}
 
+	/* sessions are opened when all of them are complete, callbacks may come right after sending */
+	for (i = 0; i < async_snmp_sessions.values_num; i++)
+	{
+		session = (zbx_async_snmp_session_t *)async_snmp_sessions.values[i];
 
-			zabbix_log(LOG_LEVEL_DEBUG, "In %s() Sending packet ",__function_name);
+		if (NULL != session->ss || NULL != session->peer || SUCCEED == async_snmp_is_finished(session))
+			continue;
 
-			if (snmp_send(ss[snmp_sessions], pdus[snmp_sessions]))
-				conf->active_hosts++;
-			else {
-				snmp_perror("snmp_send");
+		first = &items[0 != session->vars_num ? session->vars[0].index :
+				((zbx_async_snmp_task_t *)session->tasks.values[0])->index];
 
-				snmp_free_pdu(pdus[snmp_sessions]);
-				//zbx_snmp_close_session(ss[snmp_sessions]);
-				zabbix_log(LOG_LEVEL_DEBUG, "In %s() couldn't send snmp request for hostid %ld",__function_name,conf->items[i].host.hostid);
-				SET_MSG_RESULT(&results[i], zbx_strdup(NULL, "Couldn't send snmp packet"));
-				errcodes[i] = NETWORK_ERROR;
+		/* SNMPv3 needs user based security model of Net-SNMP, the other versions share one socket */
+		if (ITEM_TYPE_SNMPv3 != first->type)
+		{
+			if (NULL == (session->peer = zbx_snmp_udp_peer_create(first, error, sizeof(error))))
+			{
+				zabbix_log(LOG_LEVEL_DEBUG, "%s() cannot prepare requests to host \"%s\": %s",
+						__function_name, first->host.host, error);
+				async_snmp_fail(session, NETWORK_ERROR, error);
 				continue;
 			}
-
-			snmp_sessions++;
-		    
-		} else {
-			//the next item belogns to the same host as before.
-			//iterating to the next item
-			zabbix_log(LOG_LEVEL_DEBUG, "%s() Skipping item %d as it belongs to the same host",__function_name,i);
+		}
+		else if (NULL == (session->ss = zbx_snmp_open_session(first, error, sizeof(error))))
+		{
+			zabbix_log(LOG_LEVEL_DEBUG, "%s() cannot open session for host \"%s\": %s", __function_name,
+					first->host.host, error);
+			async_snmp_fail(session, CONFIG_ERROR, error);
 			continue;
 		}
+		else
+		{
+			session->ss->callback = async_snmp_response;
+			session->ss->callback_magic = session;
+			session->ss->timeout = ZBX_ASYNC_SNMP_TIMEOUT * 1000 * 1000;
+		}
 
-	} //iteration over the items array
-	int starttime=time(NULL);
-
+		session->max_vars = DCconfig_get_suggested_snmp_vars(session->interfaceid, &session->bulk);
+		session->walk_bulk = (ITEM_TYPE_SNMPv1 == first->type ? SNMP_BULK_DISABLED : session->bulk);
 
-#define SNMP_MAX_BATCH_TIME (SNMP_RETRIES+1)*SNMP_TIMEOUT
+		async_snmp_next(session);
+	}
 
-	 while (conf->active_hosts > 0  && (time(NULL)-starttime)< SNMP_MAX_BATCH_TIME) {
+	zbx_snmp_udp_flush();
+	async_snmp_release_finished();
 
-		int fds = 0, block = 1, sessions;
-		fd_set fdset;
-		struct timeval timeout;
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() active sessions:%d", __function_name,
+			async_snmp_sessions.values_num);
+}
 
-		timeout.tv_sec=SNMP_TIMEOUT;
-		timeout.tv_usec=0;
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_async_snmp_poll                                              *
+ *                                                                            *
+ * Purpose: processes SNMP responses and timeouts                             *
+ *                                                                            *
+ * Parameters: timeout - [IN] the maximum time to wait for responses,         *
+ *                            milliseconds                                    *
+ *                                                                            *
+ * Return value: the number of sessions still in progress                     *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_async_snmp_poll(int timeout)
+{
+	int		fds = 0, block = 0;
+	fd_set		fdset;
+	struct timeval	tv;
 
-		FD_ZERO(&fdset);
+	if (0 == async_snmp_initialized || 0 == async_snmp_sessions.values_num)
+		return 0;
 
-		snmp_select_info(&fds,&fdset,&timeout,&block);
-		fds = select(fds, &fdset, NULL, NULL, block ? NULL : &timeout);
+	tv.tv_sec = timeout / 1000;
+	tv.tv_usec = (timeout % 1000) * 1000;
 
-		if (fds < 0) {
-			zabbix_log(LOG_LEVEL_DEBUG, "End of %s() Something unexpected happened with fds ", __function_name);
-			break;
-		}
+	FD_ZERO(&fdset);
 
-		if (fds)
-			snmp_read(&fdset);
-		else
-			snmp_timeout();
-		zabbix_log(LOG_LEVEL_DEBUG, "In %s() : waiting for %d pollers to finish", __function_name, conf->active_hosts);
-	}
+	/* both lower the timeout to the nearest retransmission */
+	snmp_select_info(&fds, &fdset, &tv, &block);
+	zbx_snmp_udp_select_info(&fds, &fdset, &tv);
 
-	/* sessions cleanup */
-	for (i = 0; i < snmp_sessions; i++ ) 
+	if (0 > (fds = select(fds, &fdset, NULL, NULL, &tv)))
 	{
-		zabbix_log(LOG_LEVEL_DEBUG, "End of %s() freeing session for  item %d", __function_name,i);
-		zbx_snmp_close_session(ss[i]);
-	}
+		if (EINTR != errno)
+			zabbix_log(LOG_LEVEL_WARNING, "cannot wait for SNMP responses: %s", zbx_strerror(errno));
 
+		FD_ZERO(&fdset);
+	}
+	else if (0 < fds)
+		snmp_read(&fdset);
+	else
+		snmp_timeout();
 
-	zbx_free(hs);
-	zbx_free(conf);
+	/* responses, retransmissions and timeouts of the shared socket */
+	zbx_snmp_udp_read(&fdset);
 
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(ret));
+	async_snmp_release_finished();
 
-	return;
+	return async_snmp_sessions.values_num;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: get_values_snmp_async                                            *
+ *                                                                            *
+ * Purpose: polls SNMP items of a batch and waits for all of them             *
+ *                                                                            *
+ * Comments: see zbx_async_snmp_start() for the details. The host names must  *
+ *           be resolved by the caller, the items the names of which are      *
+ *           still being resolved must be kept out of the batch with an error *
+ *           code.                                                            *
+ *                                                                            *
+ ******************************************************************************/
+void	get_values_snmp_async(const DC_ITEM *items, AGENT_RESULT *results, int *errcodes, int num)
+{
+	const char			*__function_name = "get_values_snmp_async";
+	zbx_async_snmp_session_t	*session;
+	int				i;
+	time_t				starttime;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() num:%d", __function_name, num);
+
+	zbx_async_snmp_start(items, results, errcodes, num, async_snmp_batch_done_cb, NULL);
+
+	starttime = time(NULL);
+
+	while (0 != zbx_async_snmp_poll(ZBX_ASYNC_SNMP_TIMEOUT * 1000))
+	{
+		if (ZBX_ASYNC_SNMP_MAX_BATCH_TIME > time(NULL) - starttime)
+			continue;
+
+		for (i = 0; i < async_snmp_sessions.values_num; i++)
+		{
+			session = (zbx_async_snmp_session_t *)async_snmp_sessions.values[i];
+			async_snmp_fail(session, TIMEOUT_ERROR, "snmp timeout");
+		}
+
+		async_snmp_release_finished();
+	}
 
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+}
 
 #endif	/* HAVE_NETSNMP */
@@ -24,6 +24,7 @@
 #include "log.h"
 #include "dbcache.h"
 #include "sysinfo.h"
+#include "poller.h"
 
 extern char	*CONFIG_SOURCE_IP;
 extern int	CONFIG_TIMEOUT;
@@ -33,6 +34,9 @@ void	zbx_init_snmp(void);
 int	get_value_snmp(const DC_ITEM *item, AGENT_RESULT *result);
 void	get_values_snmp(const DC_ITEM *items, AGENT_RESULT *results, int *errcodes, int num);
 void	get_values_snmp_async(const DC_ITEM *items, AGENT_RESULT *results, int *errcodes, int num);
+void	zbx_async_snmp_start(const DC_ITEM *items, AGENT_RESULT *results, int *errcodes, int num,
+		zbx_async_done_cb_t done_cb, void *data);
+int	zbx_async_snmp_poll(int timeout);
 #endif
 
 #endif
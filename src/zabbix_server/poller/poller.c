@@ -41,12 +41,15 @@
 #include "checks_java.h"
 #include "checks_calculated.h"
 #include "checks_http.h"
+#include "resolver.h"
+#include "avail_manager.h"
 #include "../../libs/zbxcrypto/tls.h"
 #include "zbxjson.h"
 #include "zbxhttp.h"
 
 extern unsigned char	process_type, program_type;
 extern int		server_num, process_num;
+extern int		CONFIG_AVAILMAN_FORKS;
 
 /******************************************************************************
  *                                                                            *
@@ -79,6 +82,73 @@ static int	db_host_update_availability(const zbx_host_availability_t *ha)
 	return FAIL;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: host_update_availability                                         *
+ *                                                                            *
+ * Purpose: writes host availability changes into database or keeps them to   *
+ *          be written together with other changes                            *
+ *                                                                            *
+ * Parameters: ha             - [IN] the host availability data               *
+ *             availabilities - [OUT] the changes to write later, NULL to     *
+ *                                    write right away                        *
+ *                                                                            *
+ * Return value: SUCCEED - the availability changes were written or kept      *
+ *               FAIL    - no changes in availability data were detected      *
+ *                                                                            *
+ ******************************************************************************/
+static int	host_update_availability(const zbx_host_availability_t *ha, zbx_vector_ptr_t *availabilities)
+{
+	zbx_host_availability_t	*copy;
+	int			i;
+
+	if (NULL == availabilities)
+		return db_host_update_availability(ha);
+
+	if (FAIL == zbx_host_availability_is_set(ha))
+		return FAIL;
+
+	copy = (zbx_host_availability_t *)zbx_malloc(NULL, sizeof(zbx_host_availability_t));
+	*copy = *ha;
+
+	for (i = 0; i < ZBX_AGENT_MAX; i++)
+	{
+		if (NULL != copy->agents[i].error)
+			copy->agents[i].error = zbx_strdup(NULL, copy->agents[i].error);
+	}
+
+	zbx_vector_ptr_append(availabilities, copy);
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: poller_flush_availability                                        *
+ *                                                                            *
+ * Purpose: passes the kept host availability changes to the availability     *
+ *          manager                                                           *
+ *                                                                            *
+ * Comments: the manager writes them into database, so the requests in        *
+ *           flight do not wait for it. The changes are written right here    *
+ *           only when no manager runs (proxy) or it cannot be reached.       *
+ *           Called every round, also without changes, to send the changes    *
+ *           the manager socket has not taken yet.                            *
+ *                                                                            *
+ ******************************************************************************/
+static void	poller_flush_availability(zbx_vector_ptr_t *availabilities)
+{
+	if (0 != CONFIG_AVAILMAN_FORKS && SUCCEED == zbx_availability_send(availabilities))
+		return;
+
+	if (0 == availabilities->values_num)
+		return;
+
+	zbx_db_update_hosts_availability(availabilities);
+
+	zbx_vector_ptr_clear_ext(availabilities, (zbx_mem_free_func_t)zbx_host_availability_free);
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: host_get_availability                                            *
@@ -226,9 +296,9 @@ static unsigned char	host_availability_agent_by_item_type(unsigned char type)
 	}
 }
 
-void	zbx_activate_item_host(DC_ITEM *item, zbx_timespec_t *ts)
+static void	item_host_activate(DC_ITEM *item, zbx_timespec_t *ts, zbx_vector_ptr_t *availabilities)
 {
-	const char		*__function_name = "zbx_activate_item_host";
+	const char		*__function_name = "item_host_activate";
 	zbx_host_availability_t	in, out;
 	unsigned char		agent_type;
 
@@ -247,7 +317,7 @@ void	zbx_activate_item_host(DC_ITEM *item, zbx_timespec_t *ts)
 	if (FAIL == DChost_activate(item->host.hostid, agent_type, ts, &in.agents[agent_type], &out.agents[agent_type]))
 		goto out;
 
-	if (FAIL == db_host_update_availability(&out))
+	if (FAIL == host_update_availability(&out, availabilities))
 		goto out;
 
 	host_set_availability(&item->host, agent_type, &out);
@@ -269,9 +339,10 @@ out:
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
 
-void	zbx_deactivate_item_host(DC_ITEM *item, zbx_timespec_t *ts, const char *error)
+static void	item_host_deactivate(DC_ITEM *item, zbx_timespec_t *ts, const char *error,
+		zbx_vector_ptr_t *availabilities)
 {
-	const char		*__function_name = "zbx_deactivate_item_host";
+	const char		*__function_name = "item_host_deactivate";
 	zbx_host_availability_t	in, out;
 	unsigned char		agent_type;
 
@@ -293,7 +364,7 @@ void	zbx_deactivate_item_host(DC_ITEM *item, zbx_timespec_t *ts, const char *err
 		goto out;
 	}
 
-	if (FAIL == db_host_update_availability(&out))
+	if (FAIL == host_update_availability(&out, availabilities))
 		goto out;
 
 	host_set_availability(&item->host, agent_type, &out);
@@ -334,6 +405,125 @@ out:
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
 
+void	zbx_activate_item_host(DC_ITEM *item, zbx_timespec_t *ts)
+{
+	item_host_activate(item, ts, NULL);
+}
+
+void	zbx_deactivate_item_host(DC_ITEM *item, zbx_timespec_t *ts, const char *error)
+{
+	item_host_deactivate(item, ts, error, NULL);
+}
+
+#define ZBX_POLLER_INTERFACE_TTL	SEC_PER_HOUR	/* forget the interfaces not polled for this long */
+
+/* the state of a host interface polled by the async and unreachable pollers, which take items of many */
+/* hosts at once, so the last availability set can not be tracked per batch                            */
+typedef struct
+{
+	zbx_uint64_t	interfaceid;
+	int		last_available;	/* the availability this poller has set the last time */
+	int		errors;		/* network error periods in a row */
+	int		backoff_until;	/* async checks of the interface are not started before this time */
+	int		lastaccess;
+}
+zbx_poller_interface_t;
+
+static zbx_hashset_t	poller_interfaces;
+static int		poller_interfaces_prune;
+
+static void	poller_interfaces_init(void)
+{
+	zbx_hashset_create(&poller_interfaces, 100, ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+	poller_interfaces_prune = time(NULL) + ZBX_POLLER_INTERFACE_TTL;
+}
+
+static zbx_poller_interface_t	*poller_interface_get(zbx_uint64_t interfaceid, int now)
+{
+	zbx_poller_interface_t	*iface, iface_local;
+
+	if (NULL == (iface = (zbx_poller_interface_t *)zbx_hashset_search(&poller_interfaces, &interfaceid)))
+	{
+		iface_local.interfaceid = interfaceid;
+		iface_local.last_available = HOST_AVAILABLE_UNKNOWN;
+		iface_local.errors = 0;
+		iface_local.backoff_until = 0;
+
+		iface = (zbx_poller_interface_t *)zbx_hashset_insert(&poller_interfaces, &iface_local,
+				sizeof(iface_local));
+	}
+
+	iface->lastaccess = now;
+
+	return iface;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: poller_interface_update                                          *
+ *                                                                            *
+ * Purpose: updates the interface state with the item check result            *
+ *                                                                            *
+ * Parameters: iface   - [IN/OUT] the interface                               *
+ *             errcode - [IN] the item error code                             *
+ *             now     - [IN] the current time                                *
+ *                                                                            *
+ * Comments: Network errors back the interface off for UnreachableDelay       *
+ *           doubled with every failed period up to UnavailableDelay. Only    *
+ *           the first error of a period counts, the rest come from the       *
+ *           checks started before it. The last availability is reset then    *
+ *           to let host availability be updated once per period.             *
+ *                                                                            *
+ ******************************************************************************/
+static void	poller_interface_update(zbx_poller_interface_t *iface, int errcode, int now)
+{
+	int	delay, i;
+
+	switch (errcode)
+	{
+		case SUCCEED:
+		case NOTSUPPORTED:
+		case AGENT_ERROR:
+			iface->errors = 0;
+			iface->backoff_until = 0;
+			break;
+		case NETWORK_ERROR:
+		case GATEWAY_ERROR:
+		case TIMEOUT_ERROR:
+			if (now < iface->backoff_until)
+				break;
+
+			delay = CONFIG_UNREACHABLE_DELAY;
+
+			for (i = 0; i < iface->errors && delay < CONFIG_UNAVAILABLE_DELAY; i++)
+				delay *= 2;
+
+			iface->errors++;
+			iface->backoff_until = now + MIN(delay, CONFIG_UNAVAILABLE_DELAY);
+			iface->last_available = HOST_AVAILABLE_UNKNOWN;
+			break;
+	}
+}
+
+static void	poller_interfaces_clean(int now)
+{
+	zbx_hashset_iter_t	iter;
+	zbx_poller_interface_t	*iface;
+
+	if (now < poller_interfaces_prune)
+		return;
+
+	zbx_hashset_iter_reset(&poller_interfaces, &iter);
+
+	while (NULL != (iface = (zbx_poller_interface_t *)zbx_hashset_iter_next(&iter)))
+	{
+		if (iface->lastaccess + ZBX_POLLER_INTERFACE_TTL < now)
+			zbx_hashset_iter_remove(&iter);
+	}
+
+	poller_interfaces_prune = now + ZBX_POLLER_INTERFACE_TTL;
+}
+
 static void	free_result_ptr(AGENT_RESULT *result)
 {
 	free_result(result);
@@ -483,272 +673,628 @@ static int	parse_query_fields(const DC_ITEM *item, char **query_fields)
 	return SUCCEED;
 }
 
+/* the polled items returned to the queue under one cache lock */
+typedef struct
+{
+	zbx_uint64_t	*itemids;
+	unsigned char	*states;
+	int		*lastclocks;
+	int		*errcodes;
+	int		num;
+	int		alloc;
+}
+zbx_poller_requeue_t;
+
+static void	poller_requeue_init(zbx_poller_requeue_t *requeue, int alloc)
+{
+	requeue->itemids = (zbx_uint64_t *)zbx_malloc(NULL, sizeof(zbx_uint64_t) * alloc);
+	requeue->states = (unsigned char *)zbx_malloc(NULL, sizeof(unsigned char) * alloc);
+	requeue->lastclocks = (int *)zbx_malloc(NULL, sizeof(int) * alloc);
+	requeue->errcodes = (int *)zbx_malloc(NULL, sizeof(int) * alloc);
+	requeue->num = 0;
+	requeue->alloc = alloc;
+}
+
+static void	poller_requeue_add(zbx_poller_requeue_t *requeue, zbx_uint64_t itemid, unsigned char state,
+		int lastclock, int errcode)
+{
+	if (requeue->num == requeue->alloc)
+	{
+		requeue->alloc *= 2;
+		requeue->itemids = (zbx_uint64_t *)zbx_realloc(requeue->itemids, sizeof(zbx_uint64_t) * requeue->alloc);
+		requeue->states = (unsigned char *)zbx_realloc(requeue->states, sizeof(unsigned char) * requeue->alloc);
+		requeue->lastclocks = (int *)zbx_realloc(requeue->lastclocks, sizeof(int) * requeue->alloc);
+		requeue->errcodes = (int *)zbx_realloc(requeue->errcodes, sizeof(int) * requeue->alloc);
+	}
+
+	requeue->itemids[requeue->num] = itemid;
+	requeue->states[requeue->num] = state;
+	requeue->lastclocks[requeue->num] = lastclock;
+	requeue->errcodes[requeue->num] = errcode;
+	requeue->num++;
+}
+
 /******************************************************************************
  *                                                                            *
- * Function: get_values                                                       *
+ * Function: poller_requeue_flush                                             *
  *                                                                            *
- * Purpose: retrieve values of metrics from monitored hosts                   *
+ * Purpose: returns the collected items to the queue                          *
  *                                                                            *
- * Parameters: poller_type - [IN] poller type (ZBX_POLLER_TYPE_...)           *
+ * Parameters: requeue     - [IN/OUT] the items to requeue                    *
+ *             poller_type - [IN] poller type (ZBX_POLLER_TYPE_...)           *
+ *             nextcheck   - [OUT] the next check of the poller queue, not    *
+ *                                 changed if there was nothing to requeue    *
  *                                                                            *
- * Return value: number of items processed                                    *
+ ******************************************************************************/
+static void	poller_requeue_flush(zbx_poller_requeue_t *requeue, unsigned char poller_type, int *nextcheck)
+{
+	if (0 == requeue->num)
+		return;
+
+	DCpoller_requeue_items(requeue->itemids, requeue->states, requeue->lastclocks, requeue->errcodes,
+			requeue->num, poller_type, nextcheck);
+
+	requeue->num = 0;
+}
+
+/******************************************************************************
  *                                                                            *
- * Author: Alexei Vladishev                                                   *
+ * Function: prepare_item                                                     *
  *                                                                            *
- * Comments: processes single item at a time except for Java, SNMP items,     *
- * 				agent
- * 		    																  *
- *           see DCconfig_get_poller_items()                                  *
+ * Purpose: expands macros in the item fields used by checks                  *
+ *                                                                            *
+ * Parameters: item    - [IN/OUT] the item                                    *
+ *             result  - [OUT] the item result, initialized here              *
+ *             errcode - [OUT] NOT_PROCESSED or CONFIG_ERROR                  *
+ *             port    - [IN/OUT] the buffer for port macro expansion         *
  *                                                                            *
  ******************************************************************************/
-static int	get_values(unsigned char poller_type, int *nextcheck,int *processed_num)
+static void	prepare_item(DC_ITEM *item, AGENT_RESULT *result, int *errcode, char **port)
 {
-	const char		*__function_name = "get_values";
-	//stack is noet enough for 8k items
-	DC_ITEM			*items;//[MAX_POLLER_ITEMS];
-	AGENT_RESULT		*results;//[MAX_POLLER_ITEMS];
-	int			*errcodes;//[MAX_POLLER_ITEMS];
-	zbx_timespec_t		timespec;
-	char			*port = NULL, error[ITEM_ERROR_LEN_MAX];
-	int			i, num_collected=0, num, last_available = HOST_AVAILABLE_UNKNOWN, MAX_ITEMS=1;
-	zbx_vector_ptr_t	add_results;
-	
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+	char	error[ITEM_ERROR_LEN_MAX];
 
-	switch (poller_type)
+	init_result(result);
+	*errcode = NOT_PROCESSED;
+
+	/* the key and SNMP community and OID buffers may be preset by the caller, see async_strings_take() */
+	if (NULL == item->key)
+		item->key = zbx_strdup(NULL, item->key_orig);
+
+	if (SUCCEED != substitute_key_macros(&item->key, NULL, item, NULL,
+			MACRO_TYPE_ITEM_KEY, error, sizeof(error)))
 	{
-		case ZBX_POLLER_TYPE_ASYNC_AGENT:
-			MAX_ITEMS=MAX_ASYNC_AGENT_ITEMS;
-			break;
-		case ZBX_POLLER_TYPE_ASYNC_SNMP:
-			MAX_ITEMS=MAX_ASYNC_SNMP_ITEMS;
-			break;
-		case ZBX_POLLER_TYPE_UNREACHABLE:
-			MAX_ITEMS=MAX_UNREACH_ITEMS;
-			break;
-		default: 
-			MAX_ITEMS=MAX_POLLER_ITEMS;
+		SET_MSG_RESULT(result, zbx_strdup(NULL, error));
+		*errcode = CONFIG_ERROR;
+		return;
 	}
 
-	if (NULL == (items=zbx_malloc(NULL,sizeof(DC_ITEM)*MAX_ITEMS))) 
-	{
-		zabbix_log(LOG_LEVEL_WARNING,"Cannot allocate memory for polling");
-		return FAIL;
-	};
-	if (NULL == (results=zbx_malloc(NULL,sizeof(AGENT_RESULT)*MAX_ITEMS))) 
+	switch (item->type)
 	{
-		zabbix_log(LOG_LEVEL_WARNING,"Cannot allocate memory for polling");
-		return FAIL;
-	};
-	if (NULL == (errcodes=zbx_malloc(NULL,sizeof(int)*MAX_ITEMS))) 
+		case ITEM_TYPE_ZABBIX:
+		case ITEM_TYPE_SNMPv1:
+		case ITEM_TYPE_SNMPv2c:
+		case ITEM_TYPE_SNMPv3:
+		case ITEM_TYPE_JMX:
+			ZBX_STRDUP(*port, item->interface.port_orig);
+			substitute_simple_macros(NULL, NULL, NULL, NULL, &item->host.hostid, NULL,
+					NULL, NULL, NULL, port, MACRO_TYPE_COMMON, NULL, 0);
+			if (FAIL == is_ushort(*port, &item->interface.port))
+			{
+				SET_MSG_RESULT(result, zbx_dsprintf(NULL, "Invalid port number [%s]",
+							item->interface.port_orig));
+				*errcode = CONFIG_ERROR;
+				return;
+			}
+			break;
+	}
+
+	switch (item->type)
 	{
-		zabbix_log(LOG_LEVEL_WARNING,"Cannot allocate memory for polling");
-		return FAIL;
-	};
- 
+		case ITEM_TYPE_SNMPv3:
+			ZBX_STRDUP(item->snmpv3_securityname, item->snmpv3_securityname_orig);
+			ZBX_STRDUP(item->snmpv3_authpassphrase, item->snmpv3_authpassphrase_orig);
+			ZBX_STRDUP(item->snmpv3_privpassphrase, item->snmpv3_privpassphrase_orig);
+			ZBX_STRDUP(item->snmpv3_contextname, item->snmpv3_contextname_orig);
+
+			substitute_simple_macros(NULL, NULL, NULL, NULL, &item->host.hostid, NULL,
+					NULL, NULL, NULL, &item->snmpv3_securityname,
+					MACRO_TYPE_COMMON, NULL, 0);
+			substitute_simple_macros(NULL, NULL, NULL, NULL, &item->host.hostid, NULL,
+					NULL, NULL, NULL, &item->snmpv3_authpassphrase,
+					MACRO_TYPE_COMMON, NULL, 0);
+			substitute_simple_macros(NULL, NULL, NULL, NULL, &item->host.hostid, NULL,
+					NULL, NULL, NULL, &item->snmpv3_privpassphrase,
+					MACRO_TYPE_COMMON, NULL, 0);
+			substitute_simple_macros(NULL, NULL, NULL, NULL, &item->host.hostid, NULL,
+					NULL, NULL, NULL, &item->snmpv3_contextname,
+					MACRO_TYPE_COMMON, NULL, 0);
+			/* break; is not missing here */
+		case ITEM_TYPE_SNMPv1:
+		case ITEM_TYPE_SNMPv2c:
+			if (NULL == item->snmp_community)
+				item->snmp_community = zbx_strdup(NULL, item->snmp_community_orig);
 
-	num = DCconfig_get_poller_items(poller_type, items);
-	*processed_num=num;
+			if (NULL == item->snmp_oid)
+				item->snmp_oid = zbx_strdup(NULL, item->snmp_oid_orig);
 
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s(), got %d items", __function_name,num);
+			substitute_simple_macros(NULL, NULL, NULL, NULL, &item->host.hostid, NULL,
+					NULL, NULL, NULL, &item->snmp_community, MACRO_TYPE_COMMON, NULL, 0);
+			if (SUCCEED != substitute_key_macros(&item->snmp_oid, &item->host.hostid, NULL,
+					NULL, MACRO_TYPE_SNMP_OID, error, sizeof(error)))
+			{
+				SET_MSG_RESULT(result, zbx_strdup(NULL, error));
+				*errcode = CONFIG_ERROR;
+				return;
+			}
+			break;
+		case ITEM_TYPE_SSH:
+			ZBX_STRDUP(item->publickey, item->publickey_orig);
+			ZBX_STRDUP(item->privatekey, item->privatekey_orig);
+
+			substitute_simple_macros(NULL, NULL, NULL, NULL, &item->host.hostid, NULL,
+					NULL, NULL, NULL, &item->publickey, MACRO_TYPE_COMMON, NULL, 0);
+			substitute_simple_macros(NULL, NULL, NULL, NULL, &item->host.hostid, NULL,
+					NULL, NULL, NULL, &item->privatekey, MACRO_TYPE_COMMON, NULL, 0);
+			/* break; is not missing here */
+		case ITEM_TYPE_TELNET:
+		case ITEM_TYPE_DB_MONITOR:
+			substitute_simple_macros(NULL, NULL, NULL, NULL, NULL, NULL, item,
+					NULL, NULL, &item->params, MACRO_TYPE_PARAMS_FIELD, NULL, 0);
+			/* break; is not missing here */
+		case ITEM_TYPE_SIMPLE:
+			item->username = zbx_strdup(item->username, item->username_orig);
+			item->password = zbx_strdup(item->password, item->password_orig);
 
+			substitute_simple_macros(NULL, NULL, NULL, NULL, &item->host.hostid, NULL,
+					NULL, NULL, NULL, &item->username, MACRO_TYPE_COMMON, NULL, 0);
+			substitute_simple_macros(NULL, NULL, NULL, NULL, &item->host.hostid, NULL,
+					NULL, NULL, NULL, &item->password, MACRO_TYPE_COMMON, NULL, 0);
+			break;
+		case ITEM_TYPE_JMX:
+			item->username = zbx_strdup(item->username, item->username_orig);
+			item->password = zbx_strdup(item->password, item->password_orig);
+			item->jmx_endpoint = zbx_strdup(item->jmx_endpoint, item->jmx_endpoint_orig);
+
+			substitute_simple_macros(NULL, NULL, NULL, NULL, &item->host.hostid, NULL,
+					NULL, NULL, NULL, &item->username, MACRO_TYPE_COMMON, NULL, 0);
+			substitute_simple_macros(NULL, NULL, NULL, NULL, &item->host.hostid, NULL,
+					NULL, NULL, NULL, &item->password, MACRO_TYPE_COMMON, NULL, 0);
+			substitute_simple_macros(NULL, NULL, NULL, NULL, NULL, NULL, item,
+					NULL, NULL, &item->jmx_endpoint, MACRO_TYPE_JMX_ENDPOINT, NULL, 0);
+			break;
+		case ITEM_TYPE_HTTPAGENT:
+			ZBX_STRDUP(item->timeout, item->timeout_orig);
+			ZBX_STRDUP(item->url, item->url_orig);
+			ZBX_STRDUP(item->status_codes, item->status_codes_orig);
+			ZBX_STRDUP(item->http_proxy, item->http_proxy_orig);
+			ZBX_STRDUP(item->ssl_cert_file, item->ssl_cert_file_orig);
+			ZBX_STRDUP(item->ssl_key_file, item->ssl_key_file_orig);
+			ZBX_STRDUP(item->ssl_key_password, item->ssl_key_password_orig);
+			ZBX_STRDUP(item->username, item->username_orig);
+			ZBX_STRDUP(item->password, item->password_orig);
+
+			substitute_simple_macros(NULL, NULL, NULL, NULL, &item->host.hostid, NULL,
+					NULL, NULL, NULL, &item->timeout, MACRO_TYPE_COMMON, NULL, 0);
+			substitute_simple_macros(NULL, NULL, NULL,NULL, NULL, &item->host, item, NULL,
+					NULL, &item->url, MACRO_TYPE_HTTP_RAW, NULL, 0);
+
+			if (SUCCEED != zbx_http_punycode_encode_url(&item->url))
+			{
+				SET_MSG_RESULT(result, zbx_strdup(NULL, "Cannot encode URL into punycode"));
+				*errcode = CONFIG_ERROR;
+				return;
+			}
 
-	if (0 == num)
-	{
-		*nextcheck = DCconfig_get_poller_nextcheck(poller_type);
-		goto exit;
+			if (FAIL == parse_query_fields(item, &item->query_fields))
+			{
+				SET_MSG_RESULT(result, zbx_strdup(NULL, "Invalid query fields"));
+				*errcode = CONFIG_ERROR;
+				return;
+			}
+
+			switch (item->post_type)
+			{
+				case ZBX_POSTTYPE_XML:
+					if (SUCCEED != substitute_macros_xml(&item->posts, item, NULL,
+							error, sizeof(error)))
+					{
+						SET_MSG_RESULT(result, zbx_dsprintf(NULL, "%s.", error));
+						*errcode = CONFIG_ERROR;
+						return;
+					}
+					break;
+				case ZBX_POSTTYPE_JSON:
+					substitute_simple_macros(NULL, NULL, NULL,NULL, NULL, &item->host,
+							item, NULL, NULL, &item->posts,
+							MACRO_TYPE_HTTP_JSON, NULL, 0);
+					break;
+				default:
+					substitute_simple_macros(NULL, NULL, NULL,NULL, NULL, &item->host,
+							item, NULL, NULL, &item->posts,
+							MACRO_TYPE_HTTP_RAW, NULL, 0);
+					break;
+			}
+
+			substitute_simple_macros(NULL, NULL, NULL,NULL, NULL, &item->host, item, NULL,
+					NULL, &item->headers, MACRO_TYPE_HTTP_RAW, NULL, 0);
+			substitute_simple_macros(NULL, NULL, NULL, NULL, &item->host.hostid, NULL,
+					NULL, NULL, NULL, &item->status_codes, MACRO_TYPE_COMMON, NULL, 0);
+			substitute_simple_macros(NULL, NULL, NULL, NULL, &item->host.hostid, NULL,
+					NULL, NULL, NULL, &item->http_proxy, MACRO_TYPE_COMMON, NULL, 0);
+			substitute_simple_macros(NULL, NULL, NULL,NULL, NULL, &item->host, item, NULL,
+					NULL, &item->ssl_cert_file, MACRO_TYPE_HTTP_RAW, NULL, 0);
+			substitute_simple_macros(NULL, NULL, NULL,NULL, NULL, &item->host, item, NULL,
+					NULL, &item->ssl_key_file, MACRO_TYPE_HTTP_RAW, NULL, 0);
+			substitute_simple_macros(NULL, NULL, NULL, NULL, &item->host.hostid, NULL, NULL,
+					NULL, NULL, &item->ssl_key_password, MACRO_TYPE_COMMON, NULL, 0);
+			substitute_simple_macros(NULL, NULL, NULL, NULL, &item->host.hostid, NULL,
+					NULL, NULL, NULL, &item->username, MACRO_TYPE_COMMON, NULL, 0);
+			substitute_simple_macros(NULL, NULL, NULL, NULL, &item->host.hostid, NULL,
+					NULL, NULL, NULL, &item->password, MACRO_TYPE_COMMON, NULL, 0);
+			break;
 	}
+}
 
-	/* prepare items */
-	for (i = 0; i < num; i++)
+/******************************************************************************
+ *                                                                            *
+ * Function: process_item_result                                              *
+ *                                                                            *
+ * Purpose: passes the polled item value to preprocessing and updates the     *
+ *          host availability                                                 *
+ *                                                                            *
+ * Parameters: item           - [IN] the item, its fields are freed here      *
+ *             result         - [IN] the item result, freed here              *
+ *             errcode        - [IN] the item error code                      *
+ *             timespec       - [IN] the value timestamp                      *
+ *             add_results    - [IN] additional results of vmware.eventlog    *
+ *             last_available - [IN/OUT] the last availability set by the     *
+ *                                       caller                               *
+ *             availabilities - [OUT] the host availability changes to be     *
+ *                                    written by poller_flush_availability()  *
+ *                                                                            *
+ * Return value: number of values passed to preprocessing                     *
+ *                                                                            *
+ * Comments: The caller returns the item to the queue. The configuration     *
+ *           cache gets the availability change at once, the database gets    *
+ *           it when the caller flushes the collected changes.                *
+ *                                                                            *
+ ******************************************************************************/
+static int	process_item_result(DC_ITEM *item, AGENT_RESULT *result, int errcode, zbx_timespec_t *timespec,
+		const zbx_vector_ptr_t *add_results, int *last_available, zbx_vector_ptr_t *availabilities)
+{
+	int	num_collected = 0;
+
+	switch (errcode)
 	{
-		init_result(&results[i]);
-		errcodes[i] = NOT_PROCESSED;
+		case SUCCEED:
+		case NOTSUPPORTED:
+		case AGENT_ERROR:
+			if (HOST_AVAILABLE_TRUE != *last_available)
+			{
+				item_host_activate(item, timespec, availabilities);
+				*last_available = HOST_AVAILABLE_TRUE;
+			}
+			break;
+		case NETWORK_ERROR:
+		case GATEWAY_ERROR:
+		case TIMEOUT_ERROR:
+			/* mass failures are written into database once per poller round, not host by host */
+			if (HOST_AVAILABLE_FALSE != *last_available)
+			{
+				item_host_deactivate(item, timespec, result->msg, availabilities);
+				*last_available = HOST_AVAILABLE_FALSE;
+			}
+			break;
+		case NOT_PROCESSED:
+			//this might happen on async processing for snmp
+			//when a host fails answering an item, next ones are not requested
+		case CONFIG_ERROR:
+			/* nothing to do */
+			break;
+		default:
+			zbx_error("unknown response code returned: %d", errcode);
+			THIS_SHOULD_NEVER_HAPPEN;
+	}
 
-		ZBX_STRDUP(items[i].key, items[i].key_orig);
-		if (SUCCEED != substitute_key_macros(&items[i].key, NULL, &items[i], NULL,
-				MACRO_TYPE_ITEM_KEY, error, sizeof(error)))
+	if (SUCCEED == errcode)
+	{
+		if (0 == add_results->values_num)
 		{
-			SET_MSG_RESULT(&results[i], zbx_strdup(NULL, error));
-			errcodes[i] = CONFIG_ERROR;
-			continue;
+			item->state = ITEM_STATE_NORMAL;
+			num_collected++;
+			zbx_preprocess_item_value(item->itemid, item->value_type, item->flags,
+					result, timespec, item->state, NULL);
 		}
-
-		switch (items[i].type)
+		else
 		{
-			case ITEM_TYPE_ZABBIX:
-			case ITEM_TYPE_SNMPv1:
-			case ITEM_TYPE_SNMPv2c:
-			case ITEM_TYPE_SNMPv3:
-			case ITEM_TYPE_JMX:
-				ZBX_STRDUP(port, items[i].interface.port_orig);
-				substitute_simple_macros(NULL, NULL, NULL, NULL, &items[i].host.hostid, NULL,
-						NULL, NULL, NULL, &port, MACRO_TYPE_COMMON, NULL, 0);
-				if (FAIL == is_ushort(port, &items[i].interface.port))
-				{
-					SET_MSG_RESULT(&results[i], zbx_dsprintf(NULL, "Invalid port number [%s]",
-								items[i].interface.port_orig));
-					errcodes[i] = CONFIG_ERROR;
-					continue;
-				}
-				break;
-		}
+			/* vmware.eventlog item returns vector of AGENT_RESULT representing events */
 
-		switch (items[i].type)
-		{
-			case ITEM_TYPE_SNMPv3:
-				ZBX_STRDUP(items[i].snmpv3_securityname, items[i].snmpv3_securityname_orig);
-				ZBX_STRDUP(items[i].snmpv3_authpassphrase, items[i].snmpv3_authpassphrase_orig);
-				ZBX_STRDUP(items[i].snmpv3_privpassphrase, items[i].snmpv3_privpassphrase_orig);
-				ZBX_STRDUP(items[i].snmpv3_contextname, items[i].snmpv3_contextname_orig);
-
-				substitute_simple_macros(NULL, NULL, NULL, NULL, &items[i].host.hostid, NULL,
-						NULL, NULL, NULL, &items[i].snmpv3_securityname,
-						MACRO_TYPE_COMMON, NULL, 0);
-				substitute_simple_macros(NULL, NULL, NULL, NULL, &items[i].host.hostid, NULL,
-						NULL, NULL, NULL, &items[i].snmpv3_authpassphrase,
-						MACRO_TYPE_COMMON, NULL, 0);
-				substitute_simple_macros(NULL, NULL, NULL, NULL, &items[i].host.hostid, NULL,
-						NULL, NULL, NULL, &items[i].snmpv3_privpassphrase,
-						MACRO_TYPE_COMMON, NULL, 0);
-				substitute_simple_macros(NULL, NULL, NULL, NULL, &items[i].host.hostid, NULL,
-						NULL, NULL, NULL, &items[i].snmpv3_contextname,
-						MACRO_TYPE_COMMON, NULL, 0);
-				/* break; is not missing here */
-			case ITEM_TYPE_SNMPv1:
-			case ITEM_TYPE_SNMPv2c:
-				ZBX_STRDUP(items[i].snmp_community, items[i].snmp_community_orig);
-				ZBX_STRDUP(items[i].snmp_oid, items[i].snmp_oid_orig);
-
-				substitute_simple_macros(NULL, NULL, NULL, NULL, &items[i].host.hostid, NULL,
-						NULL, NULL, NULL, &items[i].snmp_community, MACRO_TYPE_COMMON, NULL, 0);
-				if (SUCCEED != substitute_key_macros(&items[i].snmp_oid, &items[i].host.hostid, NULL,
-						NULL, MACRO_TYPE_SNMP_OID, error, sizeof(error)))
-				{
-					SET_MSG_RESULT(&results[i], zbx_strdup(NULL, error));
-					errcodes[i] = CONFIG_ERROR;
-					continue;
-				}
-				break;
-			case ITEM_TYPE_SSH:
-				ZBX_STRDUP(items[i].publickey, items[i].publickey_orig);
-				ZBX_STRDUP(items[i].privatekey, items[i].privatekey_orig);
-
-				substitute_simple_macros(NULL, NULL, NULL, NULL, &items[i].host.hostid, NULL,
-						NULL, NULL, NULL, &items[i].publickey, MACRO_TYPE_COMMON, NULL, 0);
-				substitute_simple_macros(NULL, NULL, NULL, NULL, &items[i].host.hostid, NULL,
-						NULL, NULL, NULL, &items[i].privatekey, MACRO_TYPE_COMMON, NULL, 0);
-				/* break; is not missing here */
-			case ITEM_TYPE_TELNET:
-			case ITEM_TYPE_DB_MONITOR:
-				substitute_simple_macros(NULL, NULL, NULL, NULL, NULL, NULL, &items[i],
-						NULL, NULL, &items[i].params, MACRO_TYPE_PARAMS_FIELD, NULL, 0);
-				/* break; is not missing here */
-			case ITEM_TYPE_SIMPLE:
-				items[i].username = zbx_strdup(items[i].username, items[i].username_orig);
-				items[i].password = zbx_strdup(items[i].password, items[i].password_orig);
-
-				substitute_simple_macros(NULL, NULL, NULL, NULL, &items[i].host.hostid, NULL,
-						NULL, NULL, NULL, &items[i].username, MACRO_TYPE_COMMON, NULL, 0);
-				substitute_simple_macros(NULL, NULL, NULL, NULL, &items[i].host.hostid, NULL,
-						NULL, NULL, NULL, &items[i].password, MACRO_TYPE_COMMON, NULL, 0);
-				break;
-			case ITEM_TYPE_JMX:
-				items[i].username = zbx_strdup(items[i].username, items[i].username_orig);
-				items[i].password = zbx_strdup(items[i].password, items[i].password_orig);
-				items[i].jmx_endpoint = zbx_strdup(items[i].jmx_endpoint, items[i].jmx_endpoint_orig);
-
-				substitute_simple_macros(NULL, NULL, NULL, NULL, &items[i].host.hostid, NULL,
-						NULL, NULL, NULL, &items[i].username, MACRO_TYPE_COMMON, NULL, 0);
-				substitute_simple_macros(NULL, NULL, NULL, NULL, &items[i].host.hostid, NULL,
-						NULL, NULL, NULL, &items[i].password, MACRO_TYPE_COMMON, NULL, 0);
-				substitute_simple_macros(NULL, NULL, NULL, NULL, NULL, NULL, &items[i],
-						NULL, NULL, &items[i].jmx_endpoint, MACRO_TYPE_JMX_ENDPOINT, NULL, 0);
-				break;
-			case ITEM_TYPE_HTTPAGENT:
-				ZBX_STRDUP(items[i].timeout, items[i].timeout_orig);
-				ZBX_STRDUP(items[i].url, items[i].url_orig);
-				ZBX_STRDUP(items[i].status_codes, items[i].status_codes_orig);
-				ZBX_STRDUP(items[i].http_proxy, items[i].http_proxy_orig);
-				ZBX_STRDUP(items[i].ssl_cert_file, items[i].ssl_cert_file_orig);
-				ZBX_STRDUP(items[i].ssl_key_file, items[i].ssl_key_file_orig);
-				ZBX_STRDUP(items[i].ssl_key_password, items[i].ssl_key_password_orig);
-				ZBX_STRDUP(items[i].username, items[i].username_orig);
-				ZBX_STRDUP(items[i].password, items[i].password_orig);
-
-				substitute_simple_macros(NULL, NULL, NULL, NULL, &items[i].host.hostid, NULL,
-						NULL, NULL, NULL, &items[i].timeout, MACRO_TYPE_COMMON, NULL, 0);
-				substitute_simple_macros(NULL, NULL, NULL,NULL, NULL, &items[i].host, &items[i], NULL,
-						NULL, &items[i].url, MACRO_TYPE_HTTP_RAW, NULL, 0);
-
-				if (SUCCEED != zbx_http_punycode_encode_url(&items[i].url))
+			int		j;
+			zbx_timespec_t	ts_tmp = *timespec;
+
+			for (j = 0; j < add_results->values_num; j++)
+			{
+				AGENT_RESULT	*add_result = (AGENT_RESULT *)add_results->values[j];
+
+				if (ISSET_MSG(add_result))
 				{
-					SET_MSG_RESULT(&results[i], zbx_strdup(NULL, "Cannot encode URL into punycode"));
-					errcodes[i] = CONFIG_ERROR;
-					continue;
+					item->state = ITEM_STATE_NOTSUPPORTED;
+					num_collected++;
+					zbx_preprocess_item_value(item->itemid, item->value_type,
+							item->flags, NULL, &ts_tmp, item->state,
+							add_result->msg);
 				}
-
-				if (FAIL == parse_query_fields(&items[i], &items[i].query_fields))
+				else
 				{
-					SET_MSG_RESULT(&results[i], zbx_strdup(NULL, "Invalid query fields"));
-					errcodes[i] = CONFIG_ERROR;
-					continue;
+					item->state = ITEM_STATE_NORMAL;
+					num_collected++;
+					zbx_preprocess_item_value(item->itemid, item->value_type,
+							item->flags, add_result, &ts_tmp, item->state,
+							NULL);
 				}
 
-				switch (items[i].post_type)
+				/* ensure that every log item value timestamp is unique */
+				if (++ts_tmp.ns == 1000000000)
 				{
-					case ZBX_POSTTYPE_XML:
-						if (SUCCEED != substitute_macros_xml(&items[i].posts, &items[i], NULL,
-								error, sizeof(error)))
-						{
-							SET_MSG_RESULT(&results[i], zbx_dsprintf(NULL, "%s.", error));
-							errcodes[i] = CONFIG_ERROR;
-							continue;
-						}
-						break;
-					case ZBX_POSTTYPE_JSON:
-						substitute_simple_macros(NULL, NULL, NULL,NULL, NULL, &items[i].host,
-								&items[i], NULL, NULL, &items[i].posts,
-								MACRO_TYPE_HTTP_JSON, NULL, 0);
-						break;
-					default:
-						substitute_simple_macros(NULL, NULL, NULL,NULL, NULL, &items[i].host,
-								&items[i], NULL, NULL, &items[i].posts,
-								MACRO_TYPE_HTTP_RAW, NULL, 0);
-						break;
+					ts_tmp.sec++;
+					ts_tmp.ns = 0;
 				}
-
-				substitute_simple_macros(NULL, NULL, NULL,NULL, NULL, &items[i].host, &items[i], NULL,
-						NULL, &items[i].headers, MACRO_TYPE_HTTP_RAW, NULL, 0);
-				substitute_simple_macros(NULL, NULL, NULL, NULL, &items[i].host.hostid, NULL,
-						NULL, NULL, NULL, &items[i].status_codes, MACRO_TYPE_COMMON, NULL, 0);
-				substitute_simple_macros(NULL, NULL, NULL, NULL, &items[i].host.hostid, NULL,
-						NULL, NULL, NULL, &items[i].http_proxy, MACRO_TYPE_COMMON, NULL, 0);
-				substitute_simple_macros(NULL, NULL, NULL,NULL, NULL, &items[i].host, &items[i], NULL,
-						NULL, &items[i].ssl_cert_file, MACRO_TYPE_HTTP_RAW, NULL, 0);
-				substitute_simple_macros(NULL, NULL, NULL,NULL, NULL, &items[i].host, &items[i], NULL,
-						NULL, &items[i].ssl_key_file, MACRO_TYPE_HTTP_RAW, NULL, 0);
-				substitute_simple_macros(NULL, NULL, NULL, NULL, &items[i].host.hostid, NULL, NULL,
-						NULL, NULL, &items[i].ssl_key_password, MACRO_TYPE_COMMON, NULL, 0);
-				substitute_simple_macros(NULL, NULL, NULL, NULL, &items[i].host.hostid, NULL,
-						NULL, NULL, NULL, &items[i].username, MACRO_TYPE_COMMON, NULL, 0);
-				substitute_simple_macros(NULL, NULL, NULL, NULL, &items[i].host.hostid, NULL,
-						NULL, NULL, NULL, &items[i].password, MACRO_TYPE_COMMON, NULL, 0);
-				break;
+			}
 		}
 	}
+	else if (NOTSUPPORTED == errcode || AGENT_ERROR == errcode || CONFIG_ERROR == errcode)
+	{
+		item->state = ITEM_STATE_NOTSUPPORTED;
+		num_collected++;
+		zbx_preprocess_item_value(item->itemid, item->value_type, item->flags, NULL, timespec,
+				item->state, result->msg);
+	}
 
-	zbx_free(port);
-	zbx_vector_ptr_create(&add_results);
+	zbx_free(item->key);
 
-#ifdef HAVE_NETSNMP
-	if (ZBX_POLLER_TYPE_ASYNC_SNMP == poller_type  || ZBX_POLLER_TYPE_UNREACHABLE == poller_type) {
-		get_values_snmp_async(items, results, errcodes, num);
-	}
-#endif
-	if (ZBX_POLLER_TYPE_ASYNC_AGENT == poller_type || ZBX_POLLER_TYPE_UNREACHABLE == poller_type) 
+	switch (item->type)
 	{
-		get_value_agent_async(items, results, errcodes, num);
+		case ITEM_TYPE_SNMPv3:
+			zbx_free(item->snmpv3_securityname);
+			zbx_free(item->snmpv3_authpassphrase);
+			zbx_free(item->snmpv3_privpassphrase);
+			zbx_free(item->snmpv3_contextname);
+			/* break; is not missing here */
+		case ITEM_TYPE_SNMPv1:
+		case ITEM_TYPE_SNMPv2c:
+			zbx_free(item->snmp_community);
+			zbx_free(item->snmp_oid);
+			break;
+		case ITEM_TYPE_HTTPAGENT:
+			zbx_free(item->timeout);
+			zbx_free(item->url);
+			zbx_free(item->query_fields);
+			zbx_free(item->status_codes);
+			zbx_free(item->http_proxy);
+			zbx_free(item->ssl_cert_file);
+			zbx_free(item->ssl_key_file);
+			zbx_free(item->ssl_key_password);
+			zbx_free(item->username);
+			zbx_free(item->password);
+			break;
+		case ITEM_TYPE_SSH:
+			zbx_free(item->publickey);
+			zbx_free(item->privatekey);
+			/* break; is not missing here */
+		case ITEM_TYPE_TELNET:
+		case ITEM_TYPE_DB_MONITOR:
+		case ITEM_TYPE_SIMPLE:
+			zbx_free(item->username);
+			zbx_free(item->password);
+			break;
+		case ITEM_TYPE_JMX:
+			zbx_free(item->username);
+			zbx_free(item->password);
+			zbx_free(item->jmx_endpoint);
+			break;
+	}
+	free_result(result);
+
+	return num_collected;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: get_value_sync                                                   *
+ *                                                                            *
+ * Purpose: polls the item the blocking way                                   *
+ *                                                                            *
+ ******************************************************************************/
+static void	get_value_sync(DC_ITEM *item, AGENT_RESULT *result, int *errcode, zbx_vector_ptr_t *add_results)
+{
+	/* retrieve item values */
+	if (SUCCEED == is_snmp_type(item->type))
+	{
+#ifdef HAVE_NETSNMP
+		/* SNMP checks use their own timeouts */
+		get_values_snmp(item, result, errcode, 1);
+#else
+		SET_MSG_RESULT(result, zbx_strdup(NULL, "Support for SNMP checks was not compiled in."));
+		*errcode = CONFIG_ERROR;
+#endif
+	}
+	else if (ITEM_TYPE_JMX == item->type)
+	{
+		zbx_alarm_on(CONFIG_TIMEOUT);
+		get_values_java(ZBX_JAVA_GATEWAY_REQUEST_JMX, item, result, errcode, 1);
+		zbx_alarm_off();
+	}
+	else
+		*errcode = get_value(item, result, add_results);
+}
+
+#define ZBX_ASYNC_DEFER_TIME	1	/* seconds to defer the items the host name of which is being resolved */
+
+/******************************************************************************
+ *                                                                            *
+ * Function: poller_resolve                                                   *
+ *                                                                            *
+ * Purpose: sends DNS requests for the host names of the items polled by the  *
+ *          async checks of the batch and marks the items the names of which *
+ *          are not resolved yet as deferred                                  *
+ *                                                                            *
+ * Parameters: poller_type - [IN] poller type (ZBX_POLLER_TYPE_...)           *
+ *             items       - [IN] the items                                   *
+ *             errcodes    - [IN/OUT] the item error codes                    *
+ *             num         - [IN] the number of items                         *
+ *             deferred    - [OUT] the items to be returned to the queue      *
+ *                                 without polling                            *
+ *                                                                            *
+ * Comments: the poller does not wait for DNS replies, the deferred items are *
+ *           taken from the queue again after ZBX_ASYNC_DEFER_TIME seconds.   *
+ *           The replies are processed with the next DNS requests.            *
+ *                                                                            *
+ ******************************************************************************/
+static void	poller_resolve(unsigned char poller_type, const DC_ITEM *items, int *errcodes, int num,
+		unsigned char *deferred)
+{
+	const char	**names;
+	int		i, names_num = 0;
+
+	names = (const char **)zbx_malloc(NULL, num * sizeof(const char *));
+
+	for (i = 0; i < num; i++)
+	{
+		deferred[i] = 0;
+
+		if (NOT_PROCESSED != errcodes[i])
+			continue;
+
+		if (ITEM_TYPE_ZABBIX == items[i].type && (ZBX_POLLER_TYPE_ASYNC_AGENT == poller_type ||
+				ZBX_POLLER_TYPE_UNREACHABLE == poller_type))
+		{
+			deferred[i] = 1;
+		}
+#ifdef HAVE_NETSNMP
+		if (SUCCEED == is_snmp_type(items[i].type) && (ZBX_POLLER_TYPE_ASYNC_SNMP == poller_type ||
+				ZBX_POLLER_TYPE_UNREACHABLE == poller_type))
+		{
+			deferred[i] = 1;
+		}
+#endif
+		if (0 != deferred[i])
+			names[names_num++] = items[i].interface.addr;
+	}
+
+	zbx_resolver_resolve(names, names_num);
+	zbx_free(names);
+
+	for (i = 0; i < num; i++)
+	{
+		if (0 == deferred[i])
+			continue;
+
+		if (SUCCEED != zbx_resolver_is_pending(items[i].interface.addr))
+		{
+			deferred[i] = 0;
+			continue;
+		}
+
+		/* any error code keeps the checks off the item, it is not processed as a result */
+		errcodes[i] = NETWORK_ERROR;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: get_values                                                       *
+ *                                                                            *
+ * Purpose: retrieve values of metrics from monitored hosts                   *
+ *                                                                            *
+ * Parameters: poller_type - [IN] poller type (ZBX_POLLER_TYPE_...)           *
+ *                                                                            *
+ * Return value: number of items processed                                    *
+ *                                                                            *
+ * Author: Alexei Vladishev                                                   *
+ *                                                                            *
+ * Comments: processes single item at a time except for Java, SNMP items,     *
+ * 				agent
+ * 		    																  *
+ *           see DCconfig_get_poller_items()                                  *
+ *                                                                            *
+ ******************************************************************************/
+static int	get_values(unsigned char poller_type, int *nextcheck,int *processed_num)
+{
+	const char		*__function_name = "get_values";
+	/* the stack is not enough for thousands of items, the arrays are allocated once and reused */
+	static DC_ITEM		*items = NULL;
+	static AGENT_RESULT	*results = NULL;
+	static int		*errcodes = NULL;
+	static zbx_poller_requeue_t	requeue;
+	static zbx_vector_ptr_t	availabilities;
+	static unsigned char	*deferred = NULL;
+	static zbx_vector_uint64_t	deferred_itemids;
+	zbx_poller_interface_t	*iface;
+	zbx_timespec_t		timespec;
+	char			*port = NULL;
+	int			i, num_collected=0, num, last_available = HOST_AVAILABLE_UNKNOWN, MAX_ITEMS=1;
+	zbx_vector_ptr_t	add_results;
+	
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+
+	switch (poller_type)
+	{
+		case ZBX_POLLER_TYPE_ASYNC_AGENT:
+			MAX_ITEMS=MAX_ASYNC_AGENT_ITEMS;
+			break;
+		case ZBX_POLLER_TYPE_ASYNC_SNMP:
+			MAX_ITEMS=MAX_ASYNC_SNMP_ITEMS;
+			break;
+		case ZBX_POLLER_TYPE_UNREACHABLE:
+			MAX_ITEMS=MAX_UNREACH_ITEMS;
+			break;
+		default: 
+			MAX_ITEMS=MAX_POLLER_ITEMS;
+	}
+
+	/* the poller type does not change during the process lifetime */
+	if (NULL == items)
+	{
+		items = (DC_ITEM *)zbx_malloc(NULL, sizeof(DC_ITEM) * MAX_ITEMS);
+		results = (AGENT_RESULT *)zbx_malloc(NULL, sizeof(AGENT_RESULT) * MAX_ITEMS);
+		errcodes = (int *)zbx_malloc(NULL, sizeof(int) * MAX_ITEMS);
+		poller_requeue_init(&requeue, MAX_ITEMS);
+		zbx_vector_ptr_create(&availabilities);
+		deferred = (unsigned char *)zbx_malloc(NULL, sizeof(unsigned char) * MAX_ITEMS);
+		zbx_vector_uint64_create(&deferred_itemids);
+	}
+
+	num = DCconfig_get_poller_items(poller_type, items);
+	*processed_num=num;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s(), got %d items", __function_name,num);
+
+
+	if (0 == num)
+	{
+		*nextcheck = DCconfig_get_poller_nextcheck(poller_type);
+		poller_flush_availability(&availabilities);
+		goto exit;
+	}
+
+	/* prepare items */
+	for (i = 0; i < num; i++)
+		prepare_item(&items[i], &results[i], &errcodes[i], &port);
+
+	zbx_free(port);
+	zbx_vector_ptr_create(&add_results);
+
+	/* a slow DNS name does not hold the batch, its items are polled after the reply */
+	poller_resolve(poller_type, items, errcodes, num, deferred);
+
+#ifdef HAVE_NETSNMP
+	if (ZBX_POLLER_TYPE_ASYNC_SNMP == poller_type  || ZBX_POLLER_TYPE_UNREACHABLE == poller_type) {
+		get_values_snmp_async(items, results, errcodes, num);
+	}
+#endif
+	if (ZBX_POLLER_TYPE_ASYNC_AGENT == poller_type || ZBX_POLLER_TYPE_UNREACHABLE == poller_type) 
+	{
+		get_value_agent_async(items, results, errcodes, num);
 	}
 
 	/* by design normal threads where not likely to get */
@@ -757,29 +1303,8 @@ static int	get_values(unsigned char poller_type, int *nextcheck,int *processed_n
 	/* part is fixed to be ready for it 		  */
 	for (i = 0; i < num; i++) {
 		/* it maybe that some items are already processed by async methods, skipping them */		
-		if ( NOT_PROCESSED == errcodes[i]) {
-			/* retrieve item values */
-			if (SUCCEED == is_snmp_type(items[i].type))
-			{	
-#ifdef HAVE_NETSNMP
-				/* SNMP checks use their own timeouts */
-				get_values_snmp(items+i, results+i, errcodes+i, 1);
-#else
-				SET_MSG_RESULT(&results[i], zbx_strdup(NULL, "Support for SNMP checks was not compiled in."));
-				errcodes[i] = CONFIG_ERROR;
-#endif
-			}
-			else if (ITEM_TYPE_JMX == items[i].type)
-			{
-				zbx_alarm_on(CONFIG_TIMEOUT);
-				get_values_java(ZBX_JAVA_GATEWAY_REQUEST_JMX, items+i, results+i, errcodes+i, 1);
-				zbx_alarm_off();
-			}
-			else 
-			{	
-				errcodes[i] = get_value(&items[i], &results[i], &add_results);
-			}
-		}	
+		if ( NOT_PROCESSED == errcodes[i])
+			get_value_sync(&items[i], &results[i], &errcodes[i], &add_results);
 	}
 	
 	zbx_timespec(&timespec);
@@ -788,163 +1313,653 @@ static int	get_values(unsigned char poller_type, int *nextcheck,int *processed_n
 	/* process item values */
 	for (i = 0; i < num; i++)
 	{
-		switch (errcodes[i])
+		int	*plast_available = &last_available;
+
+		if (0 != deferred[i])
 		{
-			case SUCCEED:
-			case NOTSUPPORTED:
-			case AGENT_ERROR:
-				if (HOST_AVAILABLE_TRUE != last_available)
-				{
-					zbx_activate_item_host(&items[i], &timespec);
-					last_available = HOST_AVAILABLE_TRUE;
-				}
-				break;
-			case NETWORK_ERROR:
-			case GATEWAY_ERROR:
-			case TIMEOUT_ERROR:
-				/* for mass problems don't mark host as unreach for async and unreach pollers, because:
-				first, that sometimes causes a "poll" bug in mysql lib (100% thread load on waiting in a poll for mysql, probably solvable by alarm)
-				second, there seems to be no reason for that, async pollers live just fine having even all hosts unreachable */
-				if ( HOST_AVAILABLE_FALSE != last_available && 
-						(ZBX_POLLER_TYPE_NORMAL == poller_type || 
-						 ZBX_POLLER_TYPE_JAVA == poller_type ) )
-				{
-					zbx_deactivate_item_host(&items[i], &timespec, results[i].msg);
-					last_available = HOST_AVAILABLE_FALSE;
-				}
-				break;
-			case NOT_PROCESSED:
-				//this might happen on async processing for snmp
-				//when a host fails answering an item, next ones are not requested
-			case CONFIG_ERROR:
-				/* nothing to do */
-				break;
-			default:
-				zbx_error("unknown response code returned: %d", errcodes[i]);
-				THIS_SHOULD_NEVER_HAPPEN;
+			/* frees the expanded item fields without passing anything to preprocessing */
+			process_item_result(&items[i], &results[i], NOT_PROCESSED, NULL, &add_results, NULL, NULL);
+			zbx_vector_uint64_append(&deferred_itemids, items[i].itemid);
+			continue;
 		}
 
-		if (SUCCEED == errcodes[i])
+		/* the unreachable poller takes items of different hosts */
+		if (ZBX_POLLER_TYPE_UNREACHABLE == poller_type && 0 != items[i].interface.interfaceid)
 		{
-			if (0 == add_results.values_num)
-			{
-				items[i].state = ITEM_STATE_NORMAL;
-				num_collected++;
-				zbx_preprocess_item_value(items[i].itemid, items[i].value_type, items[i].flags,
-						&results[i], &timespec, items[i].state, NULL);
-			}
-			else
-			{
-				/* vmware.eventlog item returns vector of AGENT_RESULT representing events */
+			iface = poller_interface_get(items[i].interface.interfaceid, timespec.sec);
+			poller_interface_update(iface, errcodes[i], timespec.sec);
+			plast_available = &iface->last_available;
+		}
 
-				int		j;
-				zbx_timespec_t	ts_tmp = timespec;
+		num_collected += process_item_result(&items[i], &results[i], errcodes[i], &timespec, &add_results,
+				plast_available, &availabilities);
+		poller_requeue_add(&requeue, items[i].itemid, items[i].state, timespec.sec, errcodes[i]);
+	}
 
-				for (j = 0; j < add_results.values_num; j++)
-				{
-					AGENT_RESULT	*add_result = (AGENT_RESULT *)add_results.values[j];
+	/* the deferred items are requeued first, so the queue head below takes them into account */
+	if (0 != deferred_itemids.values_num)
+	{
+		zbx_dc_requeue_deferred_items(deferred_itemids.values, deferred_itemids.values_num,
+				timespec.sec + ZBX_ASYNC_DEFER_TIME);
+		zbx_vector_uint64_clear(&deferred_itemids);
 
-					if (ISSET_MSG(add_result))
-					{
-						items[i].state = ITEM_STATE_NOTSUPPORTED;
-						num_collected++;
-						zbx_preprocess_item_value(items[i].itemid, items[i].value_type,
-								items[i].flags, NULL, &ts_tmp, items[i].state,
-								add_result->msg);
-					}
-					else
-					{
-						items[i].state = ITEM_STATE_NORMAL;
-						num_collected++;
-						zbx_preprocess_item_value(items[i].itemid, items[i].value_type,
-								items[i].flags, add_result, &ts_tmp, items[i].state,
-								NULL);
-					}
+		if (0 == requeue.num)
+			*nextcheck = DCconfig_get_poller_nextcheck(poller_type);
+	}
 
-					/* ensure that every log item value timestamp is unique */
-					if (++ts_tmp.ns == 1000000000)
-					{
-						ts_tmp.sec++;
-						ts_tmp.ns = 0;
-					}
-				}
-			}
+	poller_requeue_flush(&requeue, poller_type, nextcheck);
+	poller_flush_availability(&availabilities);
+
+	if (ZBX_POLLER_TYPE_UNREACHABLE == poller_type)
+		poller_interfaces_clean(timespec.sec);
+
+	zbx_preprocessor_flush();
+	zbx_vector_ptr_clear_ext(&add_results, (zbx_mem_free_func_t)free_result_ptr);
+	zbx_vector_ptr_destroy(&add_results);
+
+	DCconfig_clean_items(items, NULL, num);
+exit:
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%d", __function_name, num);
+	return num_collected;
+}
+
+
+
+#define ZBX_ASYNC_POLL_TIMEOUT	100	/* milliseconds to wait for network events before topping up the window */
+#define ZBX_ASYNC_ROUND_TIME	1	/* seconds to run the pipeline before returning to the poller loop */
+#define ZBX_ASYNC_REFILL_PARTS	16	/* the window is topped up when this part of it is free */
+
+struct zbx_async_pipeline;
+
+/* the key and SNMP community and OID buffers an arena slot keeps for the next item taking it */
+typedef struct
+{
+	char	*key;
+	char	*snmp_community;
+	char	*snmp_oid;
+	size_t	key_alloc;
+	size_t	snmp_community_alloc;
+	size_t	snmp_oid_alloc;
+}
+zbx_async_strings_t;
+
+/* items taken from the queue at once, they are passed to preprocessing one by one as soon as polled */
+typedef struct
+{
+	struct zbx_async_pipeline	*pipeline;
+	DC_ITEM				*items;
+	AGENT_RESULT			*results;
+	int				*errcodes;
+	int				offset;		/* the first arena slot of the batch */
+	int				num;
+	int				pending;	/* the items not returned to the queue yet */
+	int				*fallback;	/* the items the async check has not taken */
+	int				fallback_num;
+	unsigned char			*deferred;	/* the items waiting for the host name to be resolved */
+}
+zbx_async_batch_t;
+
+/* the in-flight window of an async poller */
+typedef struct zbx_async_pipeline
+{
+	unsigned char		poller_type;
+	zbx_vector_ptr_t	batches;	/* sorted by the arena offset */
+	zbx_vector_ptr_t	add_results;
+	int			window;		/* the maximum number of items in flight */
+	int			in_flight;
+	int			collected;	/* the values passed to preprocessing */
+	int			next_fetch;	/* when the queue has due items next time */
+
+	/* the window sized arena the batches take their slots from, allocated once */
+	DC_ITEM			*items;
+	AGENT_RESULT		*results;
+	int			*errcodes;
+	int			*fallback;
+	unsigned char		*deferred;
+	zbx_async_strings_t	*strings;
+
+	zbx_poller_requeue_t	requeue;	/* the polled items, returned to the queue once per poll */
+	zbx_vector_uint64_t	deferred_itemids;	/* the items returned to the queue without polling */
+	zbx_vector_ptr_t	availabilities;	/* the host availability changes, sent once per round */
+}
+zbx_async_pipeline_t;
+
+static int	async_batch_compare(const void *d1, const void *d2)
+{
+	const zbx_async_batch_t	*b1 = *(const zbx_async_batch_t **)d1;
+	const zbx_async_batch_t	*b2 = *(const zbx_async_batch_t **)d2;
+
+	ZBX_RETURN_IF_NOT_EQUAL(b1->offset, b2->offset);
+
+	return 0;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_pipeline_free_range                                        *
+ *                                                                            *
+ * Purpose: finds the largest range of arena slots not taken by the batches   *
+ *                                                                            *
+ * Parameters: pipeline - [IN] the async poller window                        *
+ *             offset   - [OUT] the first slot of the range                   *
+ *                                                                            *
+ * Return value: the number of slots in the range                             *
+ *                                                                            *
+ ******************************************************************************/
+static int	async_pipeline_free_range(const zbx_async_pipeline_t *pipeline, int *offset)
+{
+	const zbx_async_batch_t	*batch;
+	int			i, start = 0, end, max = 0;
+
+	*offset = 0;
+
+	for (i = 0; i <= pipeline->batches.values_num; i++)
+	{
+		if (i < pipeline->batches.values_num)
+		{
+			batch = (const zbx_async_batch_t *)pipeline->batches.values[i];
+			end = batch->offset;
 		}
-		else if (NOTSUPPORTED == errcodes[i] || AGENT_ERROR == errcodes[i] || CONFIG_ERROR == errcodes[i])
+		else
+			end = pipeline->window;
+
+		if (end - start > max)
 		{
-			items[i].state = ITEM_STATE_NOTSUPPORTED;
-			num_collected++;
-			zbx_preprocess_item_value(items[i].itemid, items[i].value_type, items[i].flags, NULL, &timespec,
-					items[i].state, results[i].msg);
+			max = end - start;
+			*offset = start;
 		}
 
-		DCpoller_requeue_items(&items[i].itemid, &items[i].state, &timespec.sec, &errcodes[i], 1, poller_type,
-					nextcheck);
+		if (i < pipeline->batches.values_num)
+			start = batch->offset + batch->num;
+	}
 
-		zbx_free(items[i].key);
+	return max;
+}
 
-		switch (items[i].type)
+static char	*async_string_take(char **buf, size_t *alloc, const char *src)
+{
+	size_t	size;
+	char	*ptr;
+
+	if (*alloc < (size = strlen(src) + 1))
+	{
+		*buf = (char *)zbx_realloc(*buf, size);
+		*alloc = size;
+	}
+
+	memcpy(*buf, src, size);
+
+	ptr = *buf;
+	*buf = NULL;
+	*alloc = 0;
+
+	return ptr;
+}
+
+static void	async_string_return(char **buf, size_t *alloc, char **str)
+{
+	if (NULL == *str)
+		return;
+
+	/* macro expansion reallocates the string to its exact size */
+	zbx_free(*buf);
+	*buf = *str;
+	*alloc = strlen(*str) + 1;
+	*str = NULL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_strings_take                                               *
+ *                                                                            *
+ * Purpose: presets the item key and SNMP community and OID with the original *
+ *          values copied into the buffers of the arena slot                  *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_strings_take(zbx_async_strings_t *strings, DC_ITEM *item)
+{
+	item->key = async_string_take(&strings->key, &strings->key_alloc, item->key_orig);
+
+	if (SUCCEED == is_snmp_type(item->type))
+	{
+		item->snmp_community = async_string_take(&strings->snmp_community, &strings->snmp_community_alloc,
+				item->snmp_community_orig);
+		item->snmp_oid = async_string_take(&strings->snmp_oid, &strings->snmp_oid_alloc,
+				item->snmp_oid_orig);
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_strings_return                                             *
+ *                                                                            *
+ * Purpose: gives the item key and SNMP community and OID back to the arena   *
+ *          slot instead of freeing them                                      *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_strings_return(zbx_async_strings_t *strings, DC_ITEM *item)
+{
+	async_string_return(&strings->key, &strings->key_alloc, &item->key);
+
+	if (SUCCEED == is_snmp_type(item->type))
+	{
+		async_string_return(&strings->snmp_community, &strings->snmp_community_alloc, &item->snmp_community);
+		async_string_return(&strings->snmp_oid, &strings->snmp_oid_alloc, &item->snmp_oid);
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_item_finish                                                *
+ *                                                                            *
+ * Purpose: passes the polled item to preprocessing, it is returned to the    *
+ *          queue by async_pipeline_requeue()                                 *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_item_finish(zbx_async_batch_t *batch, int index)
+{
+	zbx_async_pipeline_t	*pipeline = batch->pipeline;
+	DC_ITEM			*item = &batch->items[index];
+	zbx_poller_interface_t	*iface;
+	zbx_timespec_t		timespec;
+
+	zbx_timespec(&timespec);
+
+	iface = poller_interface_get(item->interface.interfaceid, timespec.sec);
+	poller_interface_update(iface, batch->errcodes[index], timespec.sec);
+
+	/* the strings are kept before process_item_result() frees them */
+	async_strings_return(&pipeline->strings[batch->offset + index], item);
+
+	pipeline->collected += process_item_result(item, &batch->results[index], batch->errcodes[index],
+			&timespec, &pipeline->add_results, &iface->last_available, &pipeline->availabilities);
+
+	zbx_vector_ptr_clear_ext(&pipeline->add_results, (zbx_mem_free_func_t)free_result_ptr);
+
+	/* the items of a backed off interface are not taken from the queue until the back-off ends */
+	poller_requeue_add(&pipeline->requeue, item->itemid, item->state, MAX(timespec.sec, iface->backoff_until),
+			batch->errcodes[index]);
+
+	batch->pending--;
+	pipeline->in_flight--;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_item_defer                                                 *
+ *                                                                            *
+ * Purpose: drops the item not polled because its host name is still being    *
+ *          resolved, it is returned to the queue by async_pipeline_requeue() *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_item_defer(zbx_async_batch_t *batch, int index)
+{
+	zbx_async_pipeline_t	*pipeline = batch->pipeline;
+	DC_ITEM			*item = &batch->items[index];
+
+	async_strings_return(&pipeline->strings[batch->offset + index], item);
+
+	/* frees the expanded item fields without passing anything to preprocessing */
+	process_item_result(item, &batch->results[index], NOT_PROCESSED, NULL, &pipeline->add_results, NULL, NULL);
+
+	zbx_vector_uint64_append(&pipeline->deferred_itemids, item->itemid);
+
+	batch->pending--;
+	pipeline->in_flight--;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_pipeline_requeue                                           *
+ *                                                                            *
+ * Purpose: returns the items polled since the last call to the queue under   *
+ *          one cache lock                                                    *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_pipeline_requeue(zbx_async_pipeline_t *pipeline)
+{
+	int	nextcheck = FAIL;
+
+	poller_requeue_flush(&pipeline->requeue, pipeline->poller_type, &nextcheck);
+
+	/* the requeued items may be due before the queue head seen at the last fetch */
+	if (FAIL != nextcheck && nextcheck < pipeline->next_fetch)
+		pipeline->next_fetch = nextcheck;
+
+	if (0 != pipeline->deferred_itemids.values_num)
+	{
+		nextcheck = time(NULL) + ZBX_ASYNC_DEFER_TIME;
+
+		zbx_dc_requeue_deferred_items(pipeline->deferred_itemids.values,
+				pipeline->deferred_itemids.values_num, nextcheck);
+		zbx_vector_uint64_clear(&pipeline->deferred_itemids);
+
+		if (nextcheck < pipeline->next_fetch)
+			pipeline->next_fetch = nextcheck;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_item_is_checked                                            *
+ *                                                                            *
+ * Purpose: checks if the item is polled by the async check of the poller,   *
+ *          the other items are polled the old way                            *
+ *                                                                            *
+ ******************************************************************************/
+static int	async_item_is_checked(unsigned char poller_type, const DC_ITEM *item, int errcode)
+{
+	if (NOT_PROCESSED != errcode)
+		return FAIL;
+
+	if (ZBX_POLLER_TYPE_ASYNC_AGENT == poller_type)
+		return ITEM_TYPE_ZABBIX == item->type ? SUCCEED : FAIL;
+#ifdef HAVE_NETSNMP
+	return is_snmp_type(item->type);
+#else
+	return FAIL;
+#endif
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: async_pipeline_resolve                                           *
+ *                                                                            *
+ * Purpose: sends DNS requests for the host names of the batch and marks the  *
+ *          items the names of which are not resolved yet as deferred         *
+ *                                                                            *
+ * Comments: the poller does not wait for DNS replies, the deferred items are *
+ *           taken from the queue again after ZBX_ASYNC_DEFER_TIME seconds    *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_pipeline_resolve(zbx_async_batch_t *batch)
+{
+	unsigned char	poller_type = batch->pipeline->poller_type;
+	const char	**names;
+	int		i, names_num = 0;
+
+	names = (const char **)zbx_malloc(NULL, batch->num * sizeof(const char *));
+
+	for (i = 0; i < batch->num; i++)
+	{
+		batch->deferred[i] = 0;
+
+		if (SUCCEED == async_item_is_checked(poller_type, &batch->items[i], batch->errcodes[i]))
+			names[names_num++] = batch->items[i].interface.addr;
+	}
+
+	zbx_resolver_resolve(names, names_num);
+	zbx_free(names);
+
+	for (i = 0; i < batch->num; i++)
+	{
+		if (SUCCEED != async_item_is_checked(poller_type, &batch->items[i], batch->errcodes[i]) ||
+				SUCCEED != zbx_resolver_is_pending(batch->items[i].interface.addr))
 		{
-			case ITEM_TYPE_SNMPv3:
-				zbx_free(items[i].snmpv3_securityname);
-				zbx_free(items[i].snmpv3_authpassphrase);
-				zbx_free(items[i].snmpv3_privpassphrase);
-				zbx_free(items[i].snmpv3_contextname);
-				/* break; is not missing here */
-			case ITEM_TYPE_SNMPv1:
-			case ITEM_TYPE_SNMPv2c:
-				zbx_free(items[i].snmp_community);
-				zbx_free(items[i].snmp_oid);
-				break;
-			case ITEM_TYPE_HTTPAGENT:
-				zbx_free(items[i].timeout);
-				zbx_free(items[i].url);
-				zbx_free(items[i].query_fields);
-				zbx_free(items[i].status_codes);
-				zbx_free(items[i].http_proxy);
-				zbx_free(items[i].ssl_cert_file);
-				zbx_free(items[i].ssl_key_file);
-				zbx_free(items[i].ssl_key_password);
-				zbx_free(items[i].username);
-				zbx_free(items[i].password);
-				break;
-			case ITEM_TYPE_SSH:
-				zbx_free(items[i].publickey);
-				zbx_free(items[i].privatekey);
-				/* break; is not missing here */
-			case ITEM_TYPE_TELNET:
-			case ITEM_TYPE_DB_MONITOR:
-			case ITEM_TYPE_SIMPLE:
-				zbx_free(items[i].username);
-				zbx_free(items[i].password);
-				break;
-			case ITEM_TYPE_JMX:
-				zbx_free(items[i].username);
-				zbx_free(items[i].password);
-				zbx_free(items[i].jmx_endpoint);
-				break;
+			continue;
 		}
-		free_result(&results[i]);
+
+		/* any error code keeps the async checks off the item, it is not processed as a result */
+		batch->deferred[i] = 1;
+		batch->errcodes[i] = NETWORK_ERROR;
 	}
-	
-	zbx_preprocessor_flush();
-	zbx_vector_ptr_clear_ext(&add_results, (zbx_mem_free_func_t)free_result_ptr);
-	zbx_vector_ptr_destroy(&add_results);
+}
 
-	DCconfig_clean_items(items, NULL, num);
+/******************************************************************************
+ *                                                                            *
+ * Function: async_item_done                                                  *
+ *                                                                            *
+ * Purpose: async check callback, called once for every item of a batch       *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_item_done(void *data, int index)
+{
+	zbx_async_batch_t	*batch = (zbx_async_batch_t *)data;
 
-exit:	
+	if (0 != batch->deferred[index])
+	{
+		async_item_defer(batch, index);
+		return;
+	}
 
-	zbx_free(items);
-	zbx_free(results);
-	zbx_free(errcodes);
+	if (NOT_PROCESSED == batch->errcodes[index])
+	{
+		batch->fallback[batch->fallback_num++] = index;
+		return;
+	}
 
+	async_item_finish(batch, index);
+}
 
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%d", __function_name, num);
-	return num_collected;
+/******************************************************************************
+ *                                                                            *
+ * Function: async_pipeline_refill                                            *
+ *                                                                            *
+ * Purpose: takes due items from the queue into the free part of the window   *
+ *          and starts polling them                                           *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_pipeline_refill(zbx_async_pipeline_t *pipeline)
+{
+	const char		*__function_name = "async_pipeline_refill";
+	zbx_async_batch_t	*batch;
+	char			*port = NULL;
+	int			i, max_items, nextcheck, offset, now;
+
+	max_items = async_pipeline_free_range(pipeline, &offset);
+
+	/* topping up the window with a few items at a time would just make the cache lock busy */
+	if (0 == max_items || (0 != pipeline->in_flight && pipeline->window / ZBX_ASYNC_REFILL_PARTS > max_items))
+		return;
+
+	if (time(NULL) < pipeline->next_fetch)
+		return;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() max_items:%d", __function_name, max_items);
+
+	batch = (zbx_async_batch_t *)zbx_malloc(NULL, sizeof(zbx_async_batch_t));
+	batch->offset = offset;
+	batch->items = pipeline->items + offset;
+
+	if (max_items > (batch->num = zbx_dc_get_poller_items(pipeline->poller_type, batch->items, max_items)))
+	{
+		/* the queue has no more due items, do not lock the cache until the next one */
+		if (FAIL == (nextcheck = DCconfig_get_poller_nextcheck(pipeline->poller_type)))
+			nextcheck = time(NULL) + POLLER_DELAY;
+
+		pipeline->next_fetch = nextcheck;
+	}
+
+	if (0 == batch->num)
+	{
+		zbx_free(batch);
+		goto out;
+	}
+
+	batch->pipeline = pipeline;
+	batch->results = pipeline->results + offset;
+	batch->errcodes = pipeline->errcodes + offset;
+	batch->fallback = pipeline->fallback + offset;
+	batch->fallback_num = 0;
+	batch->deferred = pipeline->deferred + offset;
+	batch->pending = batch->num;
+
+	now = time(NULL);
+
+	for (i = 0; i < batch->num; i++)
+	{
+		async_strings_take(&pipeline->strings[offset + i], &batch->items[i]);
+		prepare_item(&batch->items[i], &batch->results[i], &batch->errcodes[i], &port);
+
+		/* items due before the back-off ended are not checked, the check callback requeues them */
+		if (NOT_PROCESSED == batch->errcodes[i] && now < poller_interface_get(
+				batch->items[i].interface.interfaceid, now)->backoff_until)
+		{
+			SET_MSG_RESULT(&batch->results[i], zbx_strdup(NULL, "Interface checks are backed off after"
+					" network errors."));
+			batch->errcodes[i] = NETWORK_ERROR;
+		}
+	}
+
+	zbx_free(port);
+
+	async_pipeline_resolve(batch);
+
+	zbx_vector_ptr_append(&pipeline->batches, batch);
+	zbx_vector_ptr_sort(&pipeline->batches, async_batch_compare);
+	pipeline->in_flight += batch->num;
+
+	if (ZBX_POLLER_TYPE_ASYNC_AGENT == pipeline->poller_type)
+	{
+		zbx_async_agent_start(batch->items, batch->results, batch->errcodes, batch->num, async_item_done,
+				batch);
+	}
+	else
+	{
+#ifdef HAVE_NETSNMP
+		zbx_async_snmp_start(batch->items, batch->results, batch->errcodes, batch->num, async_item_done,
+				batch);
+#else
+		for (i = 0; i < batch->num; i++)
+			async_item_done(batch, i);
+#endif
+	}
+
+	/* items the async checks do not handle are polled right away the old way */
+	for (i = 0; i < batch->fallback_num; i++)
+	{
+		get_value_sync(&batch->items[batch->fallback[i]], &batch->results[batch->fallback[i]],
+				&batch->errcodes[batch->fallback[i]], &pipeline->add_results);
+		async_item_finish(batch, batch->fallback[i]);
+	}
+
+	batch->fallback_num = 0;
+out:
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() in flight:%d", __function_name, pipeline->in_flight);
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: async_pipeline_release                                           *
+ *                                                                            *
+ * Purpose: frees the batches all items of which are back in the queue,       *
+ *          their arena slots can be taken by the next batches                *
+ *                                                                            *
+ ******************************************************************************/
+static void	async_pipeline_release(zbx_async_pipeline_t *pipeline)
+{
+	zbx_async_batch_t	*batch;
+	int			i;
+
+	for (i = 0; i < pipeline->batches.values_num;)
+	{
+		batch = (zbx_async_batch_t *)pipeline->batches.values[i];
+
+		if (0 != batch->pending)
+		{
+			i++;
+			continue;
+		}
+
+		DCconfig_clean_items(batch->items, NULL, batch->num);
+		zbx_free(batch);
+
+		zbx_vector_ptr_remove(&pipeline->batches, i);
+	}
+}
+
+static void	async_pipeline_init(zbx_async_pipeline_t *pipeline, unsigned char poller_type)
+{
+	pipeline->poller_type = poller_type;
+	pipeline->window = (ZBX_POLLER_TYPE_ASYNC_AGENT == poller_type ? MAX_ASYNC_AGENT_ITEMS :
+			MAX_ASYNC_SNMP_ITEMS);
+	pipeline->in_flight = 0;
+	pipeline->collected = 0;
+	pipeline->next_fetch = 0;
+
+	pipeline->items = (DC_ITEM *)zbx_malloc(NULL, sizeof(DC_ITEM) * pipeline->window);
+	pipeline->results = (AGENT_RESULT *)zbx_malloc(NULL, sizeof(AGENT_RESULT) * pipeline->window);
+	pipeline->errcodes = (int *)zbx_malloc(NULL, sizeof(int) * pipeline->window);
+	pipeline->fallback = (int *)zbx_malloc(NULL, sizeof(int) * pipeline->window);
+	pipeline->deferred = (unsigned char *)zbx_malloc(NULL, sizeof(unsigned char) * pipeline->window);
+	pipeline->strings = (zbx_async_strings_t *)zbx_calloc(NULL, pipeline->window, sizeof(zbx_async_strings_t));
+
+	poller_requeue_init(&pipeline->requeue, pipeline->window);
+	zbx_vector_uint64_create(&pipeline->deferred_itemids);
+	zbx_vector_ptr_create(&pipeline->availabilities);
+
+	zbx_vector_ptr_create(&pipeline->batches);
+	zbx_vector_ptr_create(&pipeline->add_results);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: get_values_async                                                 *
+ *                                                                            *
+ * Purpose: retrieve values of metrics from monitored hosts keeping a window  *
+ *          of requests in flight                                             *
+ *                                                                            *
+ * Parameters: pipeline  - [IN] the async poller window                       *
+ *             nextcheck - [OUT] when the poller has to be run next time      *
+ *                                                                            *
+ * Return value: number of values passed to preprocessing                     *
+ *                                                                            *
+ * Comments: every polled item goes to preprocessing and back to the queue as *
+ *           soon as it has the result, and the freed window slots are        *
+ *           refilled with due items, so an unresponsive host holds just its  *
+ *           own slots until the timeout instead of the whole batch.          *
+ *           Returns every ZBX_ASYNC_ROUND_TIME seconds to let the poller     *
+ *           update its status.                                               *
+ *                                                                            *
+ ******************************************************************************/
+static int	get_values_async(zbx_async_pipeline_t *pipeline, int *nextcheck)
+{
+	const char	*__function_name = "get_values_async";
+	double		end;
+	int		collected;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() in flight:%d", __function_name, pipeline->in_flight);
+
+	end = zbx_time() + ZBX_ASYNC_ROUND_TIME;
+
+	do
+	{
+		async_pipeline_refill(pipeline);
 
+		if (0 == pipeline->in_flight)
+			break;
+
+		if (ZBX_POLLER_TYPE_ASYNC_AGENT == pipeline->poller_type)
+			zbx_async_agent_poll(ZBX_ASYNC_POLL_TIMEOUT);
+#ifdef HAVE_NETSNMP
+		else
+			zbx_async_snmp_poll(ZBX_ASYNC_POLL_TIMEOUT);
+#endif
+		zbx_resolver_poll();
+		async_pipeline_requeue(pipeline);
+		zbx_preprocessor_flush();
+		async_pipeline_release(pipeline);
+	}
+	while (zbx_time() < end);
+
+	async_pipeline_requeue(pipeline);
+	zbx_preprocessor_flush();
+	async_pipeline_release(pipeline);
+
+	poller_flush_availability(&pipeline->availabilities);
+	poller_interfaces_clean(time(NULL));
+
+	/* do not sleep while there are requests in flight */
+	*nextcheck = (0 != pipeline->in_flight ? (int)time(NULL) : pipeline->next_fetch);
+
+	collected = pipeline->collected;
+	pipeline->collected = 0;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%d in flight:%d", __function_name, collected,
+			pipeline->in_flight);
+
+	return collected;
+}
 
 ZBX_THREAD_ENTRY(poller_thread, args)
 {
@@ -952,6 +1967,7 @@ ZBX_THREAD_ENTRY(poller_thread, args)
 	double		sec, total_sec = 0.0, old_total_sec = 0.0;
 	time_t		last_stat_time;
 	unsigned char	poller_type;
+	zbx_async_pipeline_t	*pipeline = NULL;
 
 #define	STAT_INTERVAL	5	/* if a process is busy and does not sleep then update status not faster than */
 				/* once in STAT_INTERVAL seconds */
@@ -977,6 +1993,15 @@ ZBX_THREAD_ENTRY(poller_thread, args)
 
 	DBconnect(ZBX_DB_CONNECT_NORMAL);
 
+	if (ZBX_POLLER_TYPE_ASYNC_AGENT == poller_type || ZBX_POLLER_TYPE_ASYNC_SNMP == poller_type)
+	{
+		pipeline = (zbx_async_pipeline_t *)zbx_malloc(NULL, sizeof(zbx_async_pipeline_t));
+		async_pipeline_init(pipeline, poller_type);
+		poller_interfaces_init();
+	}
+	else if (ZBX_POLLER_TYPE_UNREACHABLE == poller_type)
+		poller_interfaces_init();
+
 	for (;;)
 	{
 		sec = zbx_time();
@@ -989,7 +2014,10 @@ ZBX_THREAD_ENTRY(poller_thread, args)
 					old_total_sec);
 		}
 
-		processed += get_values(poller_type, &nextcheck,&processed);
+		if (NULL != pipeline)
+			processed += get_values_async(pipeline, &nextcheck);
+		else
+			processed += get_values(poller_type, &nextcheck,&processed);
 		total_sec += zbx_time() - sec;
 
 		sleeptime = calculate_sleeptime(nextcheck, POLLER_DELAY);
@@ -32,4 +32,8 @@ ZBX_THREAD_ENTRY(poller_thread, args);
 void	zbx_activate_item_host(DC_ITEM *item, zbx_timespec_t *ts);
 void	zbx_deactivate_item_host(DC_ITEM *item, zbx_timespec_t *ts, const char *error);
 
+/* async checks call it exactly once for every item they were given, items left NOT_PROCESSED */
+/* were not taken by the check and must be polled the synchronous way                        */
+typedef void	(*zbx_async_done_cb_t)(void *data, int index);
+
 #endif
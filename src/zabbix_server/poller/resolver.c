@@ -0,0 +1,471 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2018 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "common.h"
+
+#ifdef HAVE_LIBEVENT
+#	include <event2/event.h>
+#	include <event2/dns.h>
+#	include <event2/util.h>
+#endif
+
+#include "log.h"
+#include "zbxalgo.h"
+#include "resolver.h"
+
+/*
+ * Async and unreachable pollers resolve host names of a whole batch at once before any connection is made:
+ * the names missing in the cache are sent to the DNS servers concurrently with evdns and the poller goes on
+ * with the items whose names are known, the others are polled once the replies arrive. Results, including
+ * failures, are kept in a per-process cache for a bounded time.
+ */
+
+#define ZBX_RESOLVER_TTL		300	/* seconds a resolved address is kept in the cache */
+#define ZBX_RESOLVER_TTL_SPREAD		60	/* up to this many seconds are taken off the TTL depending on */
+						/* the name, so the names resolved together expire apart */
+#define ZBX_RESOLVER_NEGATIVE_TTL	60	/* seconds a resolution failure is kept in the cache */
+#define ZBX_RESOLVER_TIMEOUT		"2"	/* seconds to wait for a DNS server reply */
+#define ZBX_RESOLVER_ATTEMPTS		"2"	/* number of times a request is sent to DNS servers */
+
+#define ZBX_RESOLVER_PENDING		1
+
+typedef struct
+{
+	char		*name;
+	ZBX_SOCKADDR	addr;
+	socklen_t	addr_len;
+	int		status;
+	int		expires;
+	char		*error;
+
+	/* the expired entry is being resolved again, its last result is used until the reply */
+	unsigned char	refreshing;
+}
+zbx_resolver_entry_t;
+
+static zbx_hashset_t		resolver_cache;
+static int			resolver_initialized = 0;
+static int			resolver_lastpurge = 0;
+
+#ifdef HAVE_LIBEVENT
+static int			resolver_pending = 0;
+static struct event_base	*resolver_base = NULL;
+static struct evdns_base	*resolver_dns = NULL;
+#endif
+
+static zbx_hash_t	resolver_entry_hash(const void *data)
+{
+	const char	*name = *(const char **)data;
+
+	return ZBX_DEFAULT_STRING_HASH_ALGO(name, strlen(name), ZBX_DEFAULT_HASH_SEED);
+}
+
+static void	resolver_entry_clean(zbx_resolver_entry_t *entry)
+{
+	zbx_free(entry->name);
+	zbx_free(entry->error);
+}
+
+static void	resolver_init(void)
+{
+	if (0 != resolver_initialized)
+		return;
+
+	zbx_hashset_create(&resolver_cache, 100, resolver_entry_hash, ZBX_DEFAULT_STR_COMPARE_FUNC);
+	resolver_lastpurge = time(NULL);
+	resolver_initialized = 1;
+
+#ifdef HAVE_LIBEVENT
+	if (NULL == (resolver_base = event_base_new()))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot initialize event base for DNS resolver, host names will be"
+				" resolved synchronously");
+		return;
+	}
+
+	if (NULL == (resolver_dns = evdns_base_new(resolver_base, EVDNS_BASE_INITIALIZE_NAMESERVERS)))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot initialize DNS resolver from system configuration, host"
+				" names will be resolved synchronously");
+		return;
+	}
+
+	evdns_base_set_option(resolver_dns, "timeout:", ZBX_RESOLVER_TIMEOUT);
+	evdns_base_set_option(resolver_dns, "attempts:", ZBX_RESOLVER_ATTEMPTS);
+#endif
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: resolver_set_addrinfo                                            *
+ *                                                                            *
+ * Purpose: stores resolution result in the cache entry                       *
+ *                                                                            *
+ * Parameters: entry  - [IN/OUT] the cache entry                              *
+ *             result - [IN] getaddrinfo() compatible result code             *
+ *             ai     - [IN] the resolved addresses                           *
+ *                                                                            *
+ * Comments: a failed refresh keeps the last resolved address, it is tried    *
+ *           again after ZBX_RESOLVER_NEGATIVE_TTL seconds                    *
+ *                                                                            *
+ ******************************************************************************/
+static void	resolver_set_addrinfo(zbx_resolver_entry_t *entry, int result, const struct addrinfo *ai)
+{
+	int	now, refreshing;
+
+	now = time(NULL);
+	refreshing = entry->refreshing;
+	entry->refreshing = 0;
+
+	for (; 0 == result && NULL != ai; ai = ai->ai_next)
+	{
+#ifdef HAVE_IPV6
+		if (AF_INET != ai->ai_family && AF_INET6 != ai->ai_family)
+			continue;
+#else
+		if (AF_INET != ai->ai_family)
+			continue;
+#endif
+		if (sizeof(entry->addr) < ai->ai_addrlen)
+			continue;
+
+		memcpy(&entry->addr, ai->ai_addr, ai->ai_addrlen);
+		entry->addr_len = ai->ai_addrlen;
+		entry->status = SUCCEED;
+		zbx_free(entry->error);
+		entry->expires = now + ZBX_RESOLVER_TTL - (int)(ZBX_DEFAULT_STRING_HASH_ALGO(entry->name,
+				strlen(entry->name), ZBX_DEFAULT_HASH_SEED) % ZBX_RESOLVER_TTL_SPREAD);
+
+		return;
+	}
+
+	if (0 != refreshing && SUCCEED == entry->status)
+	{
+		zabbix_log(LOG_LEVEL_DEBUG, "cannot refresh address of '%s', the last one is kept", entry->name);
+		entry->expires = now + ZBX_RESOLVER_NEGATIVE_TTL;
+		return;
+	}
+
+	zbx_free(entry->error);
+
+	if (0 == result)
+		entry->error = zbx_dsprintf(NULL, "%s: unsupported address family", entry->name);
+#ifdef HAVE_LIBEVENT
+	else
+		entry->error = zbx_dsprintf(NULL, "%s: [%d] %s", entry->name, result, evutil_gai_strerror(result));
+#else
+	else
+		entry->error = zbx_dsprintf(NULL, "%s: [%d] %s", entry->name, result, gai_strerror(result));
+#endif
+	entry->status = FAIL;
+	entry->expires = now + ZBX_RESOLVER_NEGATIVE_TTL;
+}
+
+#ifdef HAVE_LIBEVENT
+static void	resolver_addrinfo_cb(int result, struct evutil_addrinfo *ai, void *arg)
+{
+	zbx_resolver_entry_t	*entry = (zbx_resolver_entry_t *)arg;
+
+	resolver_pending--;
+	resolver_set_addrinfo(entry, result, ai);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "resolved '%s': %s", entry->name, zbx_result_string(entry->status));
+
+	if (NULL != ai)
+		evutil_freeaddrinfo(ai);
+}
+#endif
+
+static void	resolver_hints_init(struct addrinfo *hints, int flags)
+{
+	memset(hints, 0, sizeof(struct addrinfo));
+#ifdef HAVE_IPV6
+	hints->ai_family = PF_UNSPEC;
+#else
+	hints->ai_family = PF_INET;
+#endif
+	hints->ai_socktype = SOCK_STREAM;
+	hints->ai_flags = flags;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: resolver_parse_numeric                                           *
+ *                                                                            *
+ * Purpose: converts IP address to socket address without any DNS requests    *
+ *                                                                            *
+ * Return value: SUCCEED - the name is an IP address                          *
+ *               FAIL - otherwise                                             *
+ *                                                                            *
+ ******************************************************************************/
+static int	resolver_parse_numeric(const char *name, ZBX_SOCKADDR *addr, socklen_t *addr_len)
+{
+	struct addrinfo		hints, *ai = NULL;
+	zbx_resolver_entry_t	entry;
+
+	resolver_hints_init(&hints, AI_NUMERICHOST);
+
+	if (0 != getaddrinfo(name, NULL, &hints, &ai))
+		return FAIL;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.name = (char *)name;
+	resolver_set_addrinfo(&entry, 0, ai);
+	freeaddrinfo(ai);
+
+	if (SUCCEED != entry.status)
+	{
+		zbx_free(entry.error);
+		return FAIL;
+	}
+
+	memcpy(addr, &entry.addr, entry.addr_len);
+	*addr_len = entry.addr_len;
+
+	return SUCCEED;
+}
+
+static void	resolver_purge(int now)
+{
+	zbx_hashset_iter_t	iter;
+	zbx_resolver_entry_t	*entry;
+
+	zbx_hashset_iter_reset(&resolver_cache, &iter);
+
+	while (NULL != (entry = (zbx_resolver_entry_t *)zbx_hashset_iter_next(&iter)))
+	{
+		if (ZBX_RESOLVER_PENDING == entry->status || 0 != entry->refreshing || entry->expires > now)
+			continue;
+
+		resolver_entry_clean(entry);
+		zbx_hashset_iter_remove(&iter);
+	}
+
+	resolver_lastpurge = now;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_resolver_poll                                                *
+ *                                                                            *
+ * Purpose: processes the DNS replies and timeouts without waiting for them   *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_resolver_poll(void)
+{
+#ifdef HAVE_LIBEVENT
+	if (0 < resolver_pending && -1 == event_base_loop(resolver_base, EVLOOP_NONBLOCK))
+		zabbix_log(LOG_LEVEL_WARNING, "DNS resolver event loop has failed");
+#endif
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_resolver_is_pending                                          *
+ *                                                                            *
+ * Purpose: checks if the host name is still being resolved                   *
+ *                                                                            *
+ * Return value: SUCCEED - the DNS request has not been answered yet          *
+ *               FAIL - the name is resolved, failed or was not requested     *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_resolver_is_pending(const char *name)
+{
+	zbx_resolver_entry_t	entry_local, *entry;
+
+	if (0 == resolver_initialized)
+		return FAIL;
+
+	entry_local.name = (char *)name;
+
+	if (NULL == (entry = (zbx_resolver_entry_t *)zbx_hashset_search(&resolver_cache, &entry_local)))
+		return FAIL;
+
+	return ZBX_RESOLVER_PENDING == entry->status ? SUCCEED : FAIL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_resolver_resolve                                             *
+ *                                                                            *
+ * Purpose: resolves host names that are not cached yet or have expired       *
+ *                                                                            *
+ * Parameters: names     - [IN] the host names or IP addresses                *
+ *             names_num - [IN] the number of names                           *
+ *                                                                            *
+ * Comments: The requests are sent concurrently and the function returns      *
+ *           without waiting for the replies, the names that are not known    *
+ *           yet are reported by zbx_resolver_is_pending(). The replies are   *
+ *           processed by zbx_resolver_poll().                                *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_resolver_resolve(const char **names, int names_num)
+{
+	const char		*__function_name = "zbx_resolver_resolve";
+	int			i, now, requests = 0;
+	zbx_resolver_entry_t	entry_local, *entry;
+	ZBX_SOCKADDR		addr;
+	socklen_t		addr_len;
+	struct addrinfo		hints, *ai;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() names_num:%d", __function_name, names_num);
+
+	resolver_init();
+	zbx_resolver_poll();
+	now = time(NULL);
+
+	if (ZBX_RESOLVER_NEGATIVE_TTL <= now - resolver_lastpurge)
+		resolver_purge(now);
+
+	resolver_hints_init(&hints, 0);
+
+	for (i = 0; i < names_num; i++)
+	{
+		entry_local.name = (char *)names[i];
+
+		if (NULL != (entry = (zbx_resolver_entry_t *)zbx_hashset_search(&resolver_cache, &entry_local)))
+		{
+			if (ZBX_RESOLVER_PENDING == entry->status || 0 != entry->refreshing || entry->expires > now)
+				continue;
+
+			/* the expired result is still used, so the items of the host are not deferred */
+			entry->refreshing = 1;
+		}
+		else
+		{
+			if (SUCCEED == resolver_parse_numeric(names[i], &addr, &addr_len))
+				continue;
+
+			memset(&entry_local, 0, sizeof(entry_local));
+			entry_local.name = zbx_strdup(NULL, names[i]);
+			entry = (zbx_resolver_entry_t *)zbx_hashset_insert(&resolver_cache, &entry_local,
+					sizeof(entry_local));
+			entry->status = ZBX_RESOLVER_PENDING;
+		}
+
+		requests++;
+#ifdef HAVE_LIBEVENT
+		if (NULL != resolver_dns)
+		{
+			/* the callback is called immediately if the name can be resolved without DNS requests */
+			resolver_pending++;
+			evdns_getaddrinfo(resolver_dns, entry->name, NULL, (const struct evutil_addrinfo *)&hints,
+					resolver_addrinfo_cb, entry);
+			continue;
+		}
+#endif
+		ai = NULL;
+		resolver_set_addrinfo(entry, getaddrinfo(entry->name, NULL, &hints, &ai), ai);
+
+		if (NULL != ai)
+			freeaddrinfo(ai);
+	}
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() requests:%d cached:%d", __function_name, requests,
+			resolver_cache.num_data);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_resolver_get_addr                                            *
+ *                                                                            *
+ * Purpose: gets socket address of the host from the cache                    *
+ *                                                                            *
+ * Parameters: name     - [IN] host name or IP address                        *
+ *             port     - [IN] the port to set in the socket address          *
+ *             addr     - [OUT] the socket address                            *
+ *             addr_len - [OUT] the socket address length                     *
+ *             error    - [OUT] the error message                             *
+ *             max_error_len - [IN] the error message buffer size             *
+ *                                                                            *
+ * Return value: SUCCEED - the address was found                              *
+ *               FAIL - the name cannot be resolved or was not resolved by    *
+ *                      zbx_resolver_resolve() yet                            *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_resolver_get_addr(const char *name, unsigned short port, ZBX_SOCKADDR *addr, socklen_t *addr_len,
+		char *error, size_t max_error_len)
+{
+	zbx_resolver_entry_t	entry_local, *entry;
+
+	if (SUCCEED != resolver_parse_numeric(name, addr, addr_len))
+	{
+		entry_local.name = (char *)name;
+
+		if (0 == resolver_initialized || NULL == (entry = (zbx_resolver_entry_t *)zbx_hashset_search(
+				&resolver_cache, &entry_local)) || ZBX_RESOLVER_PENDING == entry->status)
+		{
+			zbx_snprintf(error, max_error_len, "Cannot resolve [%s]: not resolved yet", name);
+			return FAIL;
+		}
+
+		if (SUCCEED != entry->status)
+		{
+			zbx_snprintf(error, max_error_len, "Cannot resolve %s", entry->error);
+			return FAIL;
+		}
+
+		memcpy(addr, &entry->addr, entry->addr_len);
+		*addr_len = entry->addr_len;
+	}
+
+#ifdef HAVE_IPV6
+	if (AF_INET6 == ((struct sockaddr *)addr)->sa_family)
+	{
+		((struct sockaddr_in6 *)addr)->sin6_port = htons(port);
+		return SUCCEED;
+	}
+#endif
+	((struct sockaddr_in *)addr)->sin_port = htons(port);
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_resolver_get_ip                                              *
+ *                                                                            *
+ * Purpose: gets IP address of the host from the cache in text form, for the  *
+ *          libraries that accept peer address as a string                    *
+ *                                                                            *
+ * Parameters: name   - [IN] host name or IP address                          *
+ *             ip     - [OUT] the IP address                                  *
+ *             ip_len - [IN] the IP address buffer size                       *
+ *             family - [OUT] the address family                              *
+ *                                                                            *
+ * Return value: SUCCEED - the address was found                              *
+ *               FAIL - otherwise                                             *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_resolver_get_ip(const char *name, char *ip, size_t ip_len, int *family)
+{
+	ZBX_SOCKADDR	addr;
+	socklen_t	addr_len;
+	char		error[MAX_STRING_LEN];
+
+	if (SUCCEED != zbx_resolver_get_addr(name, 0, &addr, &addr_len, error, sizeof(error)))
+		return FAIL;
+
+	*family = ((struct sockaddr *)&addr)->sa_family;
+
+	if (0 != getnameinfo((struct sockaddr *)&addr, addr_len, ip, ip_len, NULL, 0, NI_NUMERICHOST))
+		return FAIL;
+
+	return SUCCEED;
+}
@@ -0,0 +1,33 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2018 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#ifndef ZABBIX_RESOLVER_H
+#define ZABBIX_RESOLVER_H
+
+#include "common.h"
+#include "comms.h"
+
+void	zbx_resolver_resolve(const char **names, int names_num);
+void	zbx_resolver_poll(void);
+int	zbx_resolver_is_pending(const char *name);
+int	zbx_resolver_get_addr(const char *name, unsigned short port, ZBX_SOCKADDR *addr, socklen_t *addr_len,
+		char *error, size_t max_error_len);
+int	zbx_resolver_get_ip(const char *name, char *ip, size_t ip_len, int *family);
+
+#endif
@@ -0,0 +1,1254 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2018 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+/* recvmmsg() and sendmmsg() are GNU extensions */
+#ifndef _GNU_SOURCE
+#	define _GNU_SOURCE
+#endif
+
+#include "common.h"
+
+#ifdef HAVE_NETSNMP
+
+#define SNMP_NO_DEBUGGING		/* disabling debugging messages from Net-SNMP library */
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include "comms.h"
+#include "log.h"
+#include "zbxalgo.h"
+#include "resolver.h"
+#include "snmp_udp.h"
+
+/*
+ * SNMPv1/v2c engine on shared UDP sockets
+ * =======================================
+ *
+ * Net-SNMP opens a socket for every session, so polling many devices at once costs a file descriptor and socket
+ * setup per device. Community based SNMP needs no per-peer state on the wire, so the async SNMP poller encodes
+ * and decodes GetRequest, GetNextRequest and GetBulkRequest messages itself and sends all of them through one
+ * socket per address family. Responses are matched to peers by request-id. Datagrams are sent and received in
+ * batches where sendmmsg() and recvmmsg() are available.
+ *
+ * Every peer has at most one request in flight. The request is retransmitted with the same request-id until
+ * the retries are exhausted, then the peer callback is called with NETSNMP_CALLBACK_OP_TIMED_OUT. Received
+ * responses are parsed into Net-SNMP PDUs, so the callbacks are the same as for Net-SNMP sessions.
+ */
+
+#define ZBX_SNMP_UDP_MAX_PACKET	65507		/* the largest UDP payload */
+#define ZBX_SNMP_UDP_BATCH	32		/* datagrams per sendmmsg() and recvmmsg() call */
+#define ZBX_SNMP_UDP_MAX_READS	16		/* read calls per socket in one zbx_snmp_udp_read() */
+#define ZBX_SNMP_UDP_RCVBUF	(4 * ZBX_MEBIBYTE)
+
+#if defined(MSG_WAITFORONE)
+#	define ZBX_SNMP_UDP_MMSG
+#endif
+
+#define ZBX_BER_SEQUENCE	0x30
+
+struct zbx_snmp_udp_peer
+{
+	ZBX_SOCKADDR		addr;
+	socklen_t		addr_len;
+	int			fd;
+	long			version;
+	char			*community;
+
+	/* the request in flight */
+	zbx_uint64_t		reqid;		/* 0 if there is no request in flight */
+	unsigned char		*packet;
+	size_t			packet_len;
+	int			retries;
+	int			timeout;	/* milliseconds */
+	zbx_uint64_t		deadline;	/* milliseconds */
+	netsnmp_callback	callback;
+	void			*magic;
+	unsigned char		queued;		/* the request waits for sending */
+};
+
+typedef struct
+{
+	zbx_uint64_t		reqid;
+	zbx_snmp_udp_peer_t	*peer;
+}
+zbx_snmp_udp_request_t;
+
+/* BER encoder, writes from the end of the buffer so lengths are known before the headers are written */
+typedef struct
+{
+	unsigned char	*buf;
+	size_t		pos;
+}
+zbx_ber_writer_t;
+
+static int			udp_initialized = 0;
+static int			udp_fd_inet = -1;
+static int			udp_fd_inet6 = -1;
+static unsigned int		udp_reqid;
+static zbx_hashset_t		udp_requests;	/* requests in flight by request-id */
+static zbx_binary_heap_t	udp_timeouts;	/* requests in flight by deadline */
+static zbx_vector_ptr_t		udp_queue;	/* peers with requests to send */
+static unsigned char		*udp_buffer;	/* encoding and receiving buffer */
+
+static zbx_uint64_t	snmp_udp_time(void)
+{
+	zbx_timespec_t	ts;
+
+	zbx_timespec(&ts);
+
+	return (zbx_uint64_t)ts.sec * 1000 + ts.ns / 1000000;
+}
+
+static int	snmp_udp_deadline_compare(const void *d1, const void *d2)
+{
+	const zbx_binary_heap_elem_t	*e1 = (const zbx_binary_heap_elem_t *)d1;
+	const zbx_binary_heap_elem_t	*e2 = (const zbx_binary_heap_elem_t *)d2;
+
+	const zbx_snmp_udp_peer_t	*p1 = (const zbx_snmp_udp_peer_t *)e1->data;
+	const zbx_snmp_udp_peer_t	*p2 = (const zbx_snmp_udp_peer_t *)e2->data;
+
+	ZBX_RETURN_IF_NOT_EQUAL(p1->deadline, p2->deadline);
+
+	return 0;
+}
+
+static void	snmp_udp_init(void)
+{
+	if (0 != udp_initialized)
+		return;
+
+	zbx_hashset_create(&udp_requests, 1000, ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+	zbx_binary_heap_create(&udp_timeouts, snmp_udp_deadline_compare, ZBX_BINARY_HEAP_OPTION_DIRECT);
+	zbx_vector_ptr_create(&udp_queue);
+
+	udp_buffer = (unsigned char *)zbx_malloc(NULL, ZBX_SNMP_UDP_BATCH * (ZBX_SNMP_UDP_MAX_PACKET + 1));
+
+	/* start from a random request-id, so responses to the previous poller run are not mistaken for new ones */
+	udp_reqid = (unsigned int)getpid() ^ (unsigned int)snmp_udp_time();
+
+	udp_initialized = 1;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: snmp_udp_socket                                                  *
+ *                                                                            *
+ * Purpose: gets the shared socket of the address family, opens it on the     *
+ *          first use                                                         *
+ *                                                                            *
+ ******************************************************************************/
+static int	snmp_udp_socket(int family, char *error, size_t max_error_len)
+{
+	int		*fd, flags, rcvbuf = ZBX_SNMP_UDP_RCVBUF, err;
+	struct addrinfo	hints, *ai = NULL;
+
+#ifdef HAVE_IPV6
+	fd = (AF_INET6 == family ? &udp_fd_inet6 : &udp_fd_inet);
+#else
+	fd = &udp_fd_inet;
+#endif
+	if (-1 != *fd)
+		return *fd;
+
+	if (-1 == (*fd = socket(family, SOCK_DGRAM, 0)))
+	{
+		zbx_snprintf(error, max_error_len, "Cannot create UDP socket: %s", zbx_strerror(errno));
+		return -1;
+	}
+
+	if (-1 == (flags = fcntl(*fd, F_GETFL, 0)) || -1 == fcntl(*fd, F_SETFL, flags | O_NONBLOCK))
+	{
+		zbx_snprintf(error, max_error_len, "Cannot set UDP socket to non-blocking mode: %s",
+				zbx_strerror(errno));
+		goto fail;
+	}
+
+	/* responses of many devices may arrive between two reads */
+	if (-1 == setsockopt(*fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)))
+	{
+		zabbix_log(LOG_LEVEL_DEBUG, "cannot set receive buffer size of UDP socket: %s",
+				zbx_strerror(errno));
+	}
+
+	if (NULL != CONFIG_SOURCE_IP)
+	{
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = family;
+		hints.ai_socktype = SOCK_DGRAM;
+		hints.ai_flags = AI_NUMERICHOST;
+
+		if (0 != (err = getaddrinfo(CONFIG_SOURCE_IP, NULL, &hints, &ai)))
+		{
+			zbx_snprintf(error, max_error_len, "Invalid source IP address [%s]: %s", CONFIG_SOURCE_IP,
+					gai_strerror(err));
+			goto fail;
+		}
+
+		if (ZBX_PROTO_ERROR == zbx_bind(*fd, ai->ai_addr, ai->ai_addrlen))
+		{
+			zbx_snprintf(error, max_error_len, "Cannot bind to source IP address [%s]: %s",
+					CONFIG_SOURCE_IP, zbx_strerror(errno));
+			freeaddrinfo(ai);
+			goto fail;
+		}
+
+		freeaddrinfo(ai);
+	}
+
+	return *fd;
+fail:
+	close(*fd);
+	*fd = -1;
+
+	return -1;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * BER encoding                                                               *
+ *                                                                            *
+ ******************************************************************************/
+
+static int	ber_put_byte(zbx_ber_writer_t *ber, unsigned char value)
+{
+	if (0 == ber->pos)
+		return FAIL;
+
+	ber->buf[--ber->pos] = value;
+
+	return SUCCEED;
+}
+
+static int	ber_put_bytes(zbx_ber_writer_t *ber, const unsigned char *data, size_t len)
+{
+	if (ber->pos < len)
+		return FAIL;
+
+	ber->pos -= len;
+	memcpy(ber->buf + ber->pos, data, len);
+
+	return SUCCEED;
+}
+
+static int	ber_put_header(zbx_ber_writer_t *ber, unsigned char type, size_t len)
+{
+	unsigned char	len_bytes = 0;
+
+	if (0x80 > len)
+	{
+		if (SUCCEED != ber_put_byte(ber, (unsigned char)len))
+			return FAIL;
+	}
+	else
+	{
+		do
+		{
+			if (SUCCEED != ber_put_byte(ber, (unsigned char)(len & 0xff)))
+				return FAIL;
+
+			len_bytes++;
+		}
+		while (0 != (len >>= 8));
+
+		if (SUCCEED != ber_put_byte(ber, 0x80 | len_bytes))
+			return FAIL;
+	}
+
+	return ber_put_byte(ber, type);
+}
+
+static int	ber_put_integer(zbx_ber_writer_t *ber, long value)
+{
+	size_t		end = ber->pos;
+	unsigned char	byte;
+
+	/* the shortest two's complement form */
+	do
+	{
+		byte = (unsigned char)(value & 0xff);
+
+		if (SUCCEED != ber_put_byte(ber, byte))
+			return FAIL;
+
+		value >>= 8;
+	}
+	while (!((0 == value && 0 == (byte & 0x80)) || (-1 == value && 0 != (byte & 0x80))));
+
+	return ber_put_header(ber, ASN_INTEGER, end - ber->pos);
+}
+
+static int	ber_put_subid(zbx_ber_writer_t *ber, zbx_uint64_t subid)
+{
+	if (SUCCEED != ber_put_byte(ber, (unsigned char)(subid & 0x7f)))
+		return FAIL;
+
+	while (0 != (subid >>= 7))
+	{
+		if (SUCCEED != ber_put_byte(ber, (unsigned char)(0x80 | (subid & 0x7f))))
+			return FAIL;
+	}
+
+	return SUCCEED;
+}
+
+static int	ber_put_oid(zbx_ber_writer_t *ber, const oid *name, size_t name_len)
+{
+	size_t	i, end = ber->pos;
+
+	if (2 > name_len || 2 < name[0] || (2 > name[0] && 40 <= name[1]))
+		return FAIL;
+
+	for (i = name_len - 1; 2 <= i; i--)
+	{
+		if (SUCCEED != ber_put_subid(ber, name[i]))
+			return FAIL;
+	}
+
+	if (SUCCEED != ber_put_subid(ber, (zbx_uint64_t)name[0] * 40 + name[1]))
+		return FAIL;
+
+	return ber_put_header(ber, ASN_OBJECT_ID, end - ber->pos);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: snmp_udp_encode                                                  *
+ *                                                                            *
+ * Purpose: encodes SNMPv1/v2c message of the request PDU                     *
+ *                                                                            *
+ * Parameters: peer  - [IN] the peer the message is sent to                   *
+ *             pdu   - [IN] GetRequest, GetNextRequest or GetBulkRequest      *
+ *             reqid - [IN] the request-id                                    *
+ *             ber   - [OUT] the encoded message is in ber->buf from          *
+ *                           ber->pos till the end of the buffer              *
+ *                                                                            *
+ * Return value: SUCCEED - the message was encoded                            *
+ *               SNMPERR_TOO_LONG - the message does not fit into a datagram  *
+ *               SNMPERR_BAD_ASN1_BUILD - the OIDs cannot be encoded          *
+ *                                                                            *
+ ******************************************************************************/
+static int	snmp_udp_encode(const zbx_snmp_udp_peer_t *peer, const struct snmp_pdu *pdu, zbx_uint64_t reqid,
+		zbx_ber_writer_t *ber)
+{
+	const struct variable_list	*var;
+	const struct variable_list	**vars = NULL;
+	int				vars_num = 0, vars_alloc = 0, i, ret = SNMPERR_TOO_LONG;
+	size_t				vb_end, vbl_end, pdu_end, msg_end = ber->pos;
+
+	/* variable bindings are written backwards */
+	for (var = pdu->variables; NULL != var; var = var->next_variable)
+	{
+		if (vars_num == vars_alloc)
+		{
+			vars_alloc = MAX(16, vars_alloc * 2);
+			vars = (const struct variable_list **)zbx_realloc(vars, vars_alloc * sizeof(*vars));
+		}
+
+		vars[vars_num++] = var;
+	}
+
+	vbl_end = ber->pos;
+
+	for (i = vars_num - 1; 0 <= i; i--)
+	{
+		vb_end = ber->pos;
+
+		if (SUCCEED != ber_put_byte(ber, 0) || SUCCEED != ber_put_byte(ber, ASN_NULL))
+			goto out;
+
+		if (SUCCEED != ber_put_oid(ber, vars[i]->name, vars[i]->name_length))
+		{
+			ret = (0 == ber->pos ? SNMPERR_TOO_LONG : SNMPERR_BAD_ASN1_BUILD);
+			goto out;
+		}
+
+		if (SUCCEED != ber_put_header(ber, ZBX_BER_SEQUENCE, vb_end - ber->pos))
+			goto out;
+	}
+
+	if (SUCCEED != ber_put_header(ber, ZBX_BER_SEQUENCE, vbl_end - ber->pos))
+		goto out;
+
+	pdu_end = vbl_end;
+
+	/* non-repeaters and max-repetitions of GetBulkRequest take place of error-status and error-index */
+	if (SUCCEED != ber_put_integer(ber, pdu->errindex) || SUCCEED != ber_put_integer(ber, pdu->errstat) ||
+			SUCCEED != ber_put_integer(ber, (long)reqid) ||
+			SUCCEED != ber_put_header(ber, (unsigned char)pdu->command, pdu_end - ber->pos))
+	{
+		goto out;
+	}
+
+	if (SUCCEED != ber_put_bytes(ber, (const unsigned char *)peer->community, strlen(peer->community)) ||
+			SUCCEED != ber_put_header(ber, ASN_OCTET_STR, strlen(peer->community)) ||
+			SUCCEED != ber_put_integer(ber, peer->version) ||
+			SUCCEED != ber_put_header(ber, ZBX_BER_SEQUENCE, msg_end - ber->pos))
+	{
+		goto out;
+	}
+
+	ret = SUCCEED;
+out:
+	zbx_free(vars);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * BER decoding                                                               *
+ *                                                                            *
+ ******************************************************************************/
+
+static int	ber_get_header(const unsigned char **data, const unsigned char *end, unsigned char *type, size_t *len)
+{
+	const unsigned char	*ptr = *data;
+	size_t			len_bytes;
+
+	if (2 > end - ptr)
+		return FAIL;
+
+	*type = *ptr++;
+
+	if (0 == (*ptr & 0x80))
+	{
+		*len = *ptr++;
+	}
+	else
+	{
+		len_bytes = *ptr++ & 0x7f;
+
+		if (0 == len_bytes || sizeof(size_t) < len_bytes || len_bytes > (size_t)(end - ptr))
+			return FAIL;
+
+		for (*len = 0; 0 < len_bytes; len_bytes--)
+			*len = (*len << 8) | *ptr++;
+	}
+
+	if (*len > (size_t)(end - ptr))
+		return FAIL;
+
+	*data = ptr;
+
+	return SUCCEED;
+}
+
+static int	ber_get_tlv(const unsigned char **data, const unsigned char *end, unsigned char expected_type,
+		const unsigned char **value, size_t *len)
+{
+	unsigned char	type;
+
+	if (SUCCEED != ber_get_header(data, end, &type, len) || expected_type != type)
+		return FAIL;
+
+	*value = *data;
+	*data += *len;
+
+	return SUCCEED;
+}
+
+static int	ber_get_integer(const unsigned char *value, size_t len, long *result)
+{
+	unsigned long	acc;
+	size_t		i;
+
+	if (0 == len || sizeof(long) < len)
+		return FAIL;
+
+	/* sign extension */
+	acc = (0 != (value[0] & 0x80) ? ~0UL : 0UL);
+
+	for (i = 0; i < len; i++)
+		acc = (acc << 8) | value[i];
+
+	*result = (long)acc;
+
+	return SUCCEED;
+}
+
+static int	ber_get_unsigned(const unsigned char *value, size_t len, zbx_uint64_t *result)
+{
+	/* unsigned types have a leading zero byte when the high bit is set */
+	if (1 < len && 0 == value[0])
+	{
+		value++;
+		len--;
+	}
+
+	if (0 == len || sizeof(zbx_uint64_t) < len)
+		return FAIL;
+
+	for (*result = 0; 0 < len; len--)
+		*result = (*result << 8) | *value++;
+
+	return SUCCEED;
+}
+
+static int	ber_get_integer_tlv(const unsigned char **data, const unsigned char *end, long *result)
+{
+	const unsigned char	*value;
+	size_t			len;
+
+	if (SUCCEED != ber_get_tlv(data, end, ASN_INTEGER, &value, &len))
+		return FAIL;
+
+	return ber_get_integer(value, len, result);
+}
+
+static int	ber_get_oid(const unsigned char *value, size_t len, oid *name, size_t *name_len)
+{
+	const unsigned char	*end = value + len;
+	zbx_uint64_t		subid;
+
+	*name_len = 0;
+
+	while (value < end)
+	{
+		subid = 0;
+
+		do
+		{
+			if (value == end || 0 != (subid >> 57))
+				return FAIL;
+
+			subid = (subid << 7) | (*value & 0x7f);
+		}
+		while (0 != (*value++ & 0x80));
+
+		if (0 == *name_len)
+		{
+			/* the first two sub-identifiers are encoded in one */
+			name[0] = (40 > subid ? 0 : (80 > subid ? 1 : 2));
+			name[1] = (oid)(subid - name[0] * 40);
+			*name_len = 2;
+			continue;
+		}
+
+		if (MAX_OID_LEN == *name_len)
+			return FAIL;
+
+		name[(*name_len)++] = (oid)subid;
+	}
+
+	return 0 == *name_len ? FAIL : SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: snmp_udp_add_value                                               *
+ *                                                                            *
+ * Purpose: decodes the variable binding value and adds the variable to PDU   *
+ *                                                                            *
+ ******************************************************************************/
+static int	snmp_udp_add_value(struct snmp_pdu *pdu, const oid *name, size_t name_len, unsigned char type,
+		const unsigned char *value, size_t len)
+{
+	long			integer;
+	zbx_uint64_t		ui64;
+	struct counter64	c64;
+	oid			objid[MAX_OID_LEN];
+	size_t			objid_len;
+
+	switch (type)
+	{
+		case ASN_INTEGER:
+			if (SUCCEED != ber_get_integer(value, len, &integer))
+				return FAIL;
+			break;
+		case ASN_COUNTER:
+		case ASN_GAUGE:
+		case ASN_TIMETICKS:
+		case ASN_UINTEGER:
+			if (SUCCEED != ber_get_unsigned(value, len, &ui64) || __UINT64_C(0xffffffff) < ui64)
+				return FAIL;
+
+			integer = (long)ui64;
+			break;
+		case ASN_COUNTER64:
+			if (SUCCEED != ber_get_unsigned(value, len, &ui64))
+				return FAIL;
+
+			c64.high = (unsigned long)(ui64 >> 32);
+			c64.low = (unsigned long)(ui64 & __UINT64_C(0xffffffff));
+			return NULL != snmp_pdu_add_variable(pdu, name, name_len, type, &c64, sizeof(c64)) ?
+					SUCCEED : FAIL;
+		case ASN_OBJECT_ID:
+			if (SUCCEED != ber_get_oid(value, len, objid, &objid_len))
+				return FAIL;
+
+			return NULL != snmp_pdu_add_variable(pdu, name, name_len, type, objid,
+					objid_len * sizeof(oid)) ? SUCCEED : FAIL;
+		case ASN_IPADDRESS:
+			if (4 != len)
+				return FAIL;
+			/* break; is not missing here */
+		case ASN_OCTET_STR:
+		case ASN_OPAQUE:
+#ifdef OPAQUE_SPECIAL_TYPES
+			/* floats and 64-bit integers wrapped into Opaque */
+			if (ASN_OPAQUE == type && 3 <= len && ASN_OPAQUE_TAG1 == value[0] && len - 3 == value[2])
+			{
+				switch (value[1])
+				{
+					case ASN_OPAQUE_FLOAT:
+						if (4 == value[2])
+						{
+							float		f;
+							zbx_uint32_t	u32 = ((zbx_uint32_t)value[3] << 24) |
+									((zbx_uint32_t)value[4] << 16) |
+									((zbx_uint32_t)value[5] << 8) | value[6];
+
+							memcpy(&f, &u32, sizeof(f));
+							return NULL != snmp_pdu_add_variable(pdu, name, name_len,
+									ASN_OPAQUE_FLOAT, &f, sizeof(f)) ? SUCCEED : FAIL;
+						}
+						break;
+					case ASN_OPAQUE_DOUBLE:
+						if (8 == value[2] && SUCCEED == ber_get_unsigned(value + 3, 8, &ui64))
+						{
+							double	d;
+
+							memcpy(&d, &ui64, sizeof(d));
+							return NULL != snmp_pdu_add_variable(pdu, name, name_len,
+									ASN_OPAQUE_DOUBLE, &d, sizeof(d)) ? SUCCEED : FAIL;
+						}
+						break;
+					case ASN_OPAQUE_COUNTER64:
+					case ASN_OPAQUE_U64:
+					case ASN_OPAQUE_I64:
+						if (SUCCEED == ber_get_unsigned(value + 3, len - 3, &ui64))
+						{
+							c64.high = (unsigned long)(ui64 >> 32);
+							c64.low = (unsigned long)(ui64 & __UINT64_C(0xffffffff));
+							return NULL != snmp_pdu_add_variable(pdu, name, name_len, value[1],
+									&c64, sizeof(c64)) ? SUCCEED : FAIL;
+						}
+						break;
+				}
+			}
+#endif
+			return NULL != snmp_pdu_add_variable(pdu, name, name_len, type, value, len) ? SUCCEED : FAIL;
+		case ASN_NULL:
+		case SNMP_NOSUCHOBJECT:
+		case SNMP_NOSUCHINSTANCE:
+		case SNMP_ENDOFMIBVIEW:
+			return NULL != snmp_pdu_add_variable(pdu, name, name_len, type, NULL, 0) ? SUCCEED : FAIL;
+		default:
+			return FAIL;
+	}
+
+	return NULL != snmp_pdu_add_variable(pdu, name, name_len, type, &integer, sizeof(integer)) ? SUCCEED : FAIL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: snmp_udp_decode                                                  *
+ *                                                                            *
+ * Purpose: decodes SNMPv1/v2c GetResponse message                            *
+ *                                                                            *
+ * Parameters: data  - [IN] the received datagram                             *
+ *             len   - [IN] the datagram length                               *
+ *             reqid - [OUT] the request-id of the response                   *
+ *                                                                            *
+ * Return value: the response PDU or NULL if the datagram is not a valid      *
+ *               response                                                     *
+ *                                                                            *
+ ******************************************************************************/
+static struct snmp_pdu	*snmp_udp_decode(const unsigned char *data, size_t len, zbx_uint64_t *reqid)
+{
+	const unsigned char	*end = data + len, *value, *vbl_end;
+	size_t			value_len;
+	unsigned char		type;
+	long			version, id, errstat, errindex;
+	oid			name[MAX_OID_LEN];
+	size_t			name_len;
+	struct snmp_pdu		*pdu;
+
+	if (SUCCEED != ber_get_header(&data, end, &type, &value_len) || ZBX_BER_SEQUENCE != type)
+		return NULL;
+
+	end = data + value_len;
+
+	if (SUCCEED != ber_get_integer_tlv(&data, end, &version) ||
+			SUCCEED != ber_get_tlv(&data, end, ASN_OCTET_STR, &value, &value_len))
+	{
+		return NULL;
+	}
+
+	if (SUCCEED != ber_get_header(&data, end, &type, &value_len) || SNMP_MSG_RESPONSE != type)
+		return NULL;
+
+	end = data + value_len;
+
+	if (SUCCEED != ber_get_integer_tlv(&data, end, &id) || SUCCEED != ber_get_integer_tlv(&data, end, &errstat) ||
+			SUCCEED != ber_get_integer_tlv(&data, end, &errindex))
+	{
+		return NULL;
+	}
+
+	if (SUCCEED != ber_get_header(&data, end, &type, &value_len) || ZBX_BER_SEQUENCE != type)
+		return NULL;
+
+	vbl_end = data + value_len;
+
+	if (NULL == (pdu = snmp_pdu_create(SNMP_MSG_RESPONSE)))
+		return NULL;
+
+	pdu->version = version;
+	pdu->reqid = id;
+	pdu->errstat = errstat;
+	pdu->errindex = errindex;
+
+	while (data < vbl_end)
+	{
+		const unsigned char	*vb, *vb_end;
+		size_t			vb_len;
+
+		if (SUCCEED != ber_get_tlv(&data, vbl_end, ZBX_BER_SEQUENCE, &vb, &vb_len))
+			goto fail;
+
+		vb_end = vb + vb_len;
+
+		if (SUCCEED != ber_get_tlv(&vb, vb_end, ASN_OBJECT_ID, &value, &value_len) ||
+				SUCCEED != ber_get_oid(value, value_len, name, &name_len))
+		{
+			goto fail;
+		}
+
+		if (SUCCEED != ber_get_header(&vb, vb_end, &type, &value_len) ||
+				SUCCEED != snmp_udp_add_value(pdu, name, name_len, type, vb, value_len))
+		{
+			goto fail;
+		}
+	}
+
+	*reqid = (zbx_uint64_t)(unsigned long)id;
+
+	return pdu;
+fail:
+	snmp_free_pdu(pdu);
+
+	return NULL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Request tracking                                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+static void	snmp_udp_dequeue(zbx_snmp_udp_peer_t *peer)
+{
+	int	i;
+
+	if (0 == peer->queued)
+		return;
+
+	if (FAIL != (i = zbx_vector_ptr_search(&udp_queue, peer, ZBX_DEFAULT_PTR_COMPARE_FUNC)))
+		zbx_vector_ptr_remove(&udp_queue, i);
+
+	peer->queued = 0;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: snmp_udp_cancel                                                  *
+ *                                                                            *
+ * Purpose: forgets the request in flight of the peer                         *
+ *                                                                            *
+ ******************************************************************************/
+static void	snmp_udp_cancel(zbx_snmp_udp_peer_t *peer)
+{
+	if (0 == peer->reqid)
+		return;
+
+	snmp_udp_dequeue(peer);
+	zbx_hashset_remove(&udp_requests, &peer->reqid);
+	zbx_binary_heap_remove_direct(&udp_timeouts, peer->reqid);
+
+	zbx_free(peer->packet);
+	peer->reqid = 0;
+}
+
+static void	snmp_udp_enqueue(zbx_snmp_udp_peer_t *peer)
+{
+	if (0 != peer->queued)
+		return;
+
+	zbx_vector_ptr_append(&udp_queue, peer);
+	peer->queued = 1;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: snmp_udp_complete                                                *
+ *                                                                            *
+ * Purpose: finishes the request in flight and passes the response or the     *
+ *          timeout to the peer callback                                      *
+ *                                                                            *
+ ******************************************************************************/
+static void	snmp_udp_complete(zbx_snmp_udp_peer_t *peer, int operation, struct snmp_pdu *pdu)
+{
+	zbx_uint64_t	reqid = peer->reqid;
+
+	/* the callback may send the next request of the peer */
+	snmp_udp_cancel(peer);
+
+	peer->callback(operation, NULL, (int)reqid, pdu, peer->magic);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_snmp_udp_peer_create                                         *
+ *                                                                            *
+ * Purpose: prepares sending requests to the item interface                   *
+ *                                                                            *
+ * Parameters: item          - [IN] SNMPv1 or SNMPv2c item                    *
+ *             error         - [OUT] the error message                        *
+ *             max_error_len - [IN] the error message buffer size             *
+ *                                                                            *
+ * Return value: the peer or NULL if the interface address is not resolved   *
+ *               or the socket cannot be opened                               *
+ *                                                                            *
+ * Comments: the interface address must be resolved by zbx_resolver_resolve() *
+ *                                                                            *
+ ******************************************************************************/
+zbx_snmp_udp_peer_t	*zbx_snmp_udp_peer_create(const DC_ITEM *item, char *error, size_t max_error_len)
+{
+	zbx_snmp_udp_peer_t	*peer;
+	ZBX_SOCKADDR		addr;
+	socklen_t		addr_len;
+	int			fd;
+
+	snmp_udp_init();
+
+	if (SUCCEED != zbx_resolver_get_addr(item->interface.addr, item->interface.port, &addr, &addr_len, error,
+			max_error_len))
+	{
+		return NULL;
+	}
+
+	if (-1 == (fd = snmp_udp_socket(((struct sockaddr *)&addr)->sa_family, error, max_error_len)))
+		return NULL;
+
+	peer = (zbx_snmp_udp_peer_t *)zbx_malloc(NULL, sizeof(zbx_snmp_udp_peer_t));
+	memset(peer, 0, sizeof(zbx_snmp_udp_peer_t));
+
+	memcpy(&peer->addr, &addr, addr_len);
+	peer->addr_len = addr_len;
+	peer->fd = fd;
+	peer->version = (ITEM_TYPE_SNMPv1 == item->type ? SNMP_VERSION_1 : SNMP_VERSION_2c);
+	peer->community = zbx_strdup(NULL, item->snmp_community);
+
+	return peer;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_snmp_udp_peer_free                                           *
+ *                                                                            *
+ * Purpose: frees the peer, the callback is not called for the request in     *
+ *          flight                                                            *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_snmp_udp_peer_free(zbx_snmp_udp_peer_t *peer)
+{
+	snmp_udp_cancel(peer);
+
+	zbx_free(peer->community);
+	zbx_free(peer);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_snmp_udp_send                                                *
+ *                                                                            *
+ * Purpose: queues the request for sending                                    *
+ *                                                                            *
+ * Parameters: peer       - [IN] the peer                                     *
+ *             pdu        - [IN] GetRequest, GetNextRequest or GetBulkRequest *
+ *                               PDU, stays with the caller                   *
+ *             retries    - [IN] the number of retransmissions                *
+ *             timeout    - [IN] the timeout of one attempt, milliseconds     *
+ *             callback   - [IN] called with the response or the timeout      *
+ *             magic      - [IN] the callback data                            *
+ *             snmp_errno - [OUT] Net-SNMP error code on failure              *
+ *                                                                            *
+ * Return value: SUCCEED - the request was queued, see zbx_snmp_udp_flush()   *
+ *               FAIL - the request cannot be encoded                         *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_snmp_udp_send(zbx_snmp_udp_peer_t *peer, const struct snmp_pdu *pdu, int retries, int timeout,
+		netsnmp_callback callback, void *magic, int *snmp_errno)
+{
+	zbx_ber_writer_t	ber;
+	zbx_snmp_udp_request_t	request_local;
+	zbx_binary_heap_elem_t	elem;
+	int			ret;
+
+	snmp_udp_cancel(peer);
+
+	/* request-id is a positive 32-bit integer */
+	udp_reqid = udp_reqid % 0x7fffffff + 1;
+
+	ber.buf = udp_buffer;
+	ber.pos = ZBX_SNMP_UDP_MAX_PACKET;
+
+	if (SUCCEED != (ret = snmp_udp_encode(peer, pdu, udp_reqid, &ber)))
+	{
+		*snmp_errno = ret;
+		return FAIL;
+	}
+
+	peer->packet_len = ZBX_SNMP_UDP_MAX_PACKET - ber.pos;
+	peer->packet = (unsigned char *)zbx_malloc(NULL, peer->packet_len);
+	memcpy(peer->packet, ber.buf + ber.pos, peer->packet_len);
+
+	peer->reqid = udp_reqid;
+	peer->retries = retries;
+	peer->timeout = timeout;
+	peer->deadline = snmp_udp_time() + timeout;
+	peer->callback = callback;
+	peer->magic = magic;
+
+	request_local.reqid = peer->reqid;
+	request_local.peer = peer;
+	zbx_hashset_insert(&udp_requests, &request_local, sizeof(request_local));
+
+	elem.key = peer->reqid;
+	elem.data = (const void *)peer;
+	zbx_binary_heap_insert(&udp_timeouts, &elem);
+
+	snmp_udp_enqueue(peer);
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_snmp_udp_flush                                               *
+ *                                                                            *
+ * Purpose: sends the queued requests                                         *
+ *                                                                            *
+ * Comments: requests that cannot be sent because the socket buffer is full   *
+ *           stay queued, other send errors are left to the retransmission    *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_snmp_udp_flush(void)
+{
+	zbx_snmp_udp_peer_t	*peer;
+	int			i, sent = 0;
+#ifdef ZBX_SNMP_UDP_MMSG
+	struct mmsghdr		msgs[ZBX_SNMP_UDP_BATCH];
+	struct iovec		iovs[ZBX_SNMP_UDP_BATCH];
+	int			j, num, ret;
+#endif
+
+	if (0 == udp_initialized)
+		return;
+
+	while (sent < udp_queue.values_num)
+	{
+		peer = (zbx_snmp_udp_peer_t *)udp_queue.values[sent];
+#ifdef ZBX_SNMP_UDP_MMSG
+		/* batch the consecutive requests sent through the same socket */
+		for (num = 0; num < ZBX_SNMP_UDP_BATCH && sent + num < udp_queue.values_num; num++)
+		{
+			zbx_snmp_udp_peer_t	*next = (zbx_snmp_udp_peer_t *)udp_queue.values[sent + num];
+
+			if (next->fd != peer->fd)
+				break;
+
+			iovs[num].iov_base = next->packet;
+			iovs[num].iov_len = next->packet_len;
+
+			memset(&msgs[num], 0, sizeof(msgs[num]));
+			msgs[num].msg_hdr.msg_name = &next->addr;
+			msgs[num].msg_hdr.msg_namelen = next->addr_len;
+			msgs[num].msg_hdr.msg_iov = &iovs[num];
+			msgs[num].msg_hdr.msg_iovlen = 1;
+		}
+
+		if (-1 == (ret = sendmmsg(peer->fd, msgs, num, 0)))
+		{
+			if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno)
+				break;
+
+			/* the first datagram failed, it will be retransmitted or time out */
+			zabbix_log(LOG_LEVEL_DEBUG, "cannot send SNMP request: %s", zbx_strerror(errno));
+			ret = 1;
+		}
+
+		for (j = 0; j < ret; j++)
+			((zbx_snmp_udp_peer_t *)udp_queue.values[sent + j])->queued = 0;
+
+		sent += ret;
+#else
+		if (-1 == sendto(peer->fd, peer->packet, peer->packet_len, 0, (struct sockaddr *)&peer->addr,
+				peer->addr_len))
+		{
+			if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno)
+				break;
+
+			zabbix_log(LOG_LEVEL_DEBUG, "cannot send SNMP request: %s", zbx_strerror(errno));
+		}
+
+		peer->queued = 0;
+		sent++;
+#endif
+	}
+
+	if (0 == sent)
+		return;
+
+	for (i = sent; i < udp_queue.values_num; i++)
+		udp_queue.values[i - sent] = udp_queue.values[i];
+
+	udp_queue.values_num -= sent;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_snmp_udp_select_info                                         *
+ *                                                                            *
+ * Purpose: adds the shared sockets to the descriptor set and lowers the      *
+ *          timeout to the nearest request deadline                           *
+ *                                                                            *
+ * Parameters: fds    - [IN/OUT] the highest descriptor plus one              *
+ *             fdset  - [IN/OUT] the descriptors to wait for                  *
+ *             tv     - [IN/OUT] the time to wait                             *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_snmp_udp_select_info(int *fds, fd_set *fdset, struct timeval *tv)
+{
+	const zbx_binary_heap_elem_t	*min;
+	zbx_uint64_t			now, wait;
+
+	if (0 == udp_initialized || 0 == udp_requests.num_data)
+		return;
+
+	if (-1 != udp_fd_inet)
+	{
+		FD_SET(udp_fd_inet, fdset);
+		*fds = MAX(*fds, udp_fd_inet + 1);
+	}
+
+	if (-1 != udp_fd_inet6)
+	{
+		FD_SET(udp_fd_inet6, fdset);
+		*fds = MAX(*fds, udp_fd_inet6 + 1);
+	}
+
+	/* the queued requests are sent right after the wait */
+	if (0 != udp_queue.values_num)
+		wait = 0;
+	else if (FAIL == zbx_binary_heap_empty(&udp_timeouts))
+	{
+		min = zbx_binary_heap_find_min(&udp_timeouts);
+		now = snmp_udp_time();
+
+		wait = ((const zbx_snmp_udp_peer_t *)min->data)->deadline;
+		wait = (wait > now ? wait - now : 0);
+	}
+	else
+		return;
+
+	if ((zbx_uint64_t)tv->tv_sec * 1000 + tv->tv_usec / 1000 > wait)
+	{
+		tv->tv_sec = wait / 1000;
+		tv->tv_usec = (wait % 1000) * 1000;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: snmp_udp_process_datagram                                        *
+ *                                                                            *
+ ******************************************************************************/
+static void	snmp_udp_process_datagram(const unsigned char *data, size_t len, const ZBX_SOCKADDR *addr)
+{
+	zbx_snmp_udp_request_t	*request;
+	zbx_snmp_udp_peer_t	*peer;
+	struct snmp_pdu		*pdu;
+	zbx_uint64_t		reqid;
+
+	if (NULL == (pdu = snmp_udp_decode(data, len, &reqid)))
+	{
+		zabbix_log(LOG_LEVEL_DEBUG, "cannot parse SNMP response of %d bytes", (int)len);
+		return;
+	}
+
+	/* late responses to the requests that timed out are dropped */
+	if (NULL == (request = (zbx_snmp_udp_request_t *)zbx_hashset_search(&udp_requests, &reqid)))
+		goto out;
+
+	peer = request->peer;
+
+	if (((const struct sockaddr *)addr)->sa_family != ((struct sockaddr *)&peer->addr)->sa_family)
+		goto out;
+#ifdef HAVE_IPV6
+	if (AF_INET6 == ((const struct sockaddr *)addr)->sa_family)
+	{
+		const struct sockaddr_in6	*a1 = (const struct sockaddr_in6 *)addr;
+		const struct sockaddr_in6	*a2 = (const struct sockaddr_in6 *)&peer->addr;
+
+		if (a1->sin6_port != a2->sin6_port || 0 != memcmp(&a1->sin6_addr, &a2->sin6_addr,
+				sizeof(a1->sin6_addr)))
+		{
+			goto out;
+		}
+	}
+	else
+#endif
+	{
+		const struct sockaddr_in	*a1 = (const struct sockaddr_in *)addr;
+		const struct sockaddr_in	*a2 = (const struct sockaddr_in *)&peer->addr;
+
+		if (a1->sin_port != a2->sin_port || a1->sin_addr.s_addr != a2->sin_addr.s_addr)
+			goto out;
+	}
+
+	if (pdu->version != peer->version)
+		goto out;
+
+	snmp_udp_complete(peer, NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE, pdu);
+out:
+	snmp_free_pdu(pdu);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: snmp_udp_read_socket                                             *
+ *                                                                            *
+ ******************************************************************************/
+static void	snmp_udp_read_socket(int fd)
+{
+	ZBX_SOCKADDR	addrs[ZBX_SNMP_UDP_BATCH];
+	int		i, n, reads;
+#ifdef ZBX_SNMP_UDP_MMSG
+	struct mmsghdr	msgs[ZBX_SNMP_UDP_BATCH];
+	struct iovec	iovs[ZBX_SNMP_UDP_BATCH];
+#else
+	socklen_t	addr_len;
+	ssize_t		len;
+#endif
+
+	for (reads = 0; reads < ZBX_SNMP_UDP_MAX_READS; reads++)
+	{
+#ifdef ZBX_SNMP_UDP_MMSG
+		for (i = 0; i < ZBX_SNMP_UDP_BATCH; i++)
+		{
+			iovs[i].iov_base = udp_buffer + i * (ZBX_SNMP_UDP_MAX_PACKET + 1);
+			iovs[i].iov_len = ZBX_SNMP_UDP_MAX_PACKET + 1;
+
+			memset(&msgs[i], 0, sizeof(msgs[i]));
+			msgs[i].msg_hdr.msg_name = &addrs[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		if (0 >= (n = recvmmsg(fd, msgs, ZBX_SNMP_UDP_BATCH, MSG_DONTWAIT, NULL)))
+			break;
+
+		for (i = 0; i < n; i++)
+		{
+			if (0 != (msgs[i].msg_hdr.msg_flags & MSG_TRUNC))
+				continue;
+
+			snmp_udp_process_datagram((const unsigned char *)iovs[i].iov_base, msgs[i].msg_len,
+					&addrs[i]);
+		}
+#else
+		for (n = 0; n < ZBX_SNMP_UDP_BATCH; n++)
+		{
+			addr_len = sizeof(addrs[0]);
+
+			if (0 > (len = recvfrom(fd, udp_buffer, ZBX_SNMP_UDP_MAX_PACKET, MSG_DONTWAIT,
+					(struct sockaddr *)&addrs[0], &addr_len)))
+			{
+				break;
+			}
+
+			snmp_udp_process_datagram(udp_buffer, (size_t)len, &addrs[0]);
+		}
+
+		ZBX_UNUSED(i);
+#endif
+		if (ZBX_SNMP_UDP_BATCH > n)
+			break;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_snmp_udp_read                                                *
+ *                                                                            *
+ * Purpose: processes the received responses, retransmits or times out the    *
+ *          requests past their deadline and sends the new requests           *
+ *                                                                            *
+ * Parameters: fdset - [IN] the descriptors ready for reading                 *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_snmp_udp_read(const fd_set *fdset)
+{
+	const zbx_binary_heap_elem_t	*min;
+	zbx_binary_heap_elem_t		elem;
+	zbx_snmp_udp_peer_t		*peer;
+	zbx_uint64_t			now;
+
+	if (0 == udp_initialized)
+		return;
+
+	if (-1 != udp_fd_inet && FD_ISSET(udp_fd_inet, fdset))
+		snmp_udp_read_socket(udp_fd_inet);
+
+	if (-1 != udp_fd_inet6 && FD_ISSET(udp_fd_inet6, fdset))
+		snmp_udp_read_socket(udp_fd_inet6);
+
+	now = snmp_udp_time();
+
+	while (FAIL == zbx_binary_heap_empty(&udp_timeouts))
+	{
+		min = zbx_binary_heap_find_min(&udp_timeouts);
+		peer = (zbx_snmp_udp_peer_t *)min->data;
+
+		if (peer->deadline > now)
+			break;
+
+		if (0 < peer->retries)
+		{
+			peer->retries--;
+			peer->deadline = now + peer->timeout;
+
+			elem.key = peer->reqid;
+			elem.data = (const void *)peer;
+			zbx_binary_heap_update_direct(&udp_timeouts, &elem);
+
+			snmp_udp_enqueue(peer);
+			continue;
+		}
+
+		snmp_udp_complete(peer, NETSNMP_CALLBACK_OP_TIMED_OUT, NULL);
+	}
+
+	zbx_snmp_udp_flush();
+}
+
+#endif	/* HAVE_NETSNMP */
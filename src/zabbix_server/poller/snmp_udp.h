@@ -0,0 +1,44 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2018 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#ifndef ZABBIX_SNMP_UDP_H
+#define ZABBIX_SNMP_UDP_H
+
+#include "common.h"
+#include "dbcache.h"
+
+extern char	*CONFIG_SOURCE_IP;
+
+#ifdef HAVE_NETSNMP
+
+/* Net-SNMP headers must be included before this file */
+
+typedef struct zbx_snmp_udp_peer	zbx_snmp_udp_peer_t;
+
+zbx_snmp_udp_peer_t	*zbx_snmp_udp_peer_create(const DC_ITEM *item, char *error, size_t max_error_len);
+void	zbx_snmp_udp_peer_free(zbx_snmp_udp_peer_t *peer);
+int	zbx_snmp_udp_send(zbx_snmp_udp_peer_t *peer, const struct snmp_pdu *pdu, int retries, int timeout,
+		netsnmp_callback callback, void *magic, int *snmp_errno);
+void	zbx_snmp_udp_select_info(int *fds, fd_set *fdset, struct timeval *tv);
+void	zbx_snmp_udp_read(const fd_set *fdset);
+void	zbx_snmp_udp_flush(void);
+
+#endif
+
+#endif
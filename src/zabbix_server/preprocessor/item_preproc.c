@@ -32,6 +32,24 @@
 
 #include "item_preproc.h"
 
+/* preprocessing step data prepared once and reused for all values of the item */
+struct zbx_preproc_compiled
+{
+	/* custom multiplier */
+	zbx_uint64_t		multiplier_ui64;
+	double			multiplier_dbl;
+	int			multiplier_is_ui64;
+
+	/* unescaped trim characters or regular expression substitution output template */
+	char			*str;
+
+	zbx_regexp_t		*regexp;
+	zbx_json_path_t		jsonpath;
+#ifdef HAVE_LIBXML2
+	xmlXPathCompExprPtr	xpath;
+#endif
+};
+
 /******************************************************************************
  *                                                                            *
  * Function: item_preproc_numeric_type_hint                                   *
@@ -136,17 +154,17 @@ int	zbx_item_preproc_convert_value_to_numeric(zbx_variant_t *value_num, const zb
  *                                                                            *
  * Parameters: value_type - [IN] the item type                                *
  *             value      - [IN/OUT] the value to process                     *
- *             params     - [IN] the operation parameters                     *
+ *             multiplier - [IN] the parsed multiplier                        *
  *             errmsg     - [OUT] error message                               *
  *                                                                            *
  * Return value: SUCCEED - the preprocessing step finished successfully       *
  *               FAIL - otherwise, errmsg contains the error message          *
  *                                                                            *
  ******************************************************************************/
-static int	item_preproc_multiplier_variant(unsigned char value_type, zbx_variant_t *value, const char *params,
-		char **errmsg)
+static int	item_preproc_multiplier_variant(unsigned char value_type, zbx_variant_t *value,
+		const zbx_preproc_compiled_t *multiplier, char **errmsg)
 {
-	zbx_uint64_t	multiplier_ui64, value_ui64;
+	zbx_uint64_t	value_ui64;
 	double		value_dbl;
 	zbx_variant_t	value_num;
 
@@ -156,15 +174,15 @@ static int	item_preproc_multiplier_variant(unsigned char value_type, zbx_variant
 	switch (value_num.type)
 	{
 		case ZBX_VARIANT_DBL:
-			value_dbl = value_num.data.dbl * atof(params);
+			value_dbl = value_num.data.dbl * multiplier->multiplier_dbl;
 			zbx_variant_clear(value);
 			zbx_variant_set_dbl(value, value_dbl);
 			break;
 		case ZBX_VARIANT_UI64:
-			if (SUCCEED == is_uint64(params, &multiplier_ui64))
-				value_ui64 = value_num.data.ui64 * multiplier_ui64;
+			if (0 != multiplier->multiplier_is_ui64)
+				value_ui64 = value_num.data.ui64 * multiplier->multiplier_ui64;
 			else
-				value_ui64 = (double)value_num.data.ui64 * atof(params);
+				value_ui64 = (double)value_num.data.ui64 * multiplier->multiplier_dbl;
 
 			zbx_variant_clear(value);
 			zbx_variant_set_ui64(value, value_ui64);
@@ -176,6 +194,30 @@ static int	item_preproc_multiplier_variant(unsigned char value_type, zbx_variant
 	return SUCCEED;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: item_preproc_multiplier_parse                                    *
+ *                                                                            *
+ * Purpose: parse custom multiplier preprocessing operation parameters        *
+ *                                                                            *
+ * Parameters: params     - [IN] the operation parameters                     *
+ *             multiplier - [OUT] the parsed multiplier                       *
+ *                                                                            *
+ * Return value: SUCCEED - the multiplier was parsed successfully             *
+ *               FAIL - the multiplier is not a numerical value               *
+ *                                                                            *
+ ******************************************************************************/
+static int	item_preproc_multiplier_parse(const char *params, zbx_preproc_compiled_t *multiplier)
+{
+	if (FAIL == is_double(params))
+		return FAIL;
+
+	multiplier->multiplier_dbl = atof(params);
+	multiplier->multiplier_is_ui64 = (SUCCEED == is_uint64(params, &multiplier->multiplier_ui64) ? 1 : 0);
+
+	return SUCCEED;
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: item_preproc_multiplier                                          *
@@ -185,6 +227,7 @@ static int	item_preproc_multiplier_variant(unsigned char value_type, zbx_variant
  * Parameters: value_type - [IN] the item type                                *
  *             value      - [IN/OUT] the value to process                     *
  *             params     - [IN] the operation parameters                     *
+ *             compiled   - [IN] the parsed multiplier (optional)             *
  *             errmsg     - [OUT] error message                               *
  *                                                                            *
  * Return value: SUCCEED - the preprocessing step finished successfully       *
@@ -192,13 +235,17 @@ static int	item_preproc_multiplier_variant(unsigned char value_type, zbx_variant
  *                                                                            *
  ******************************************************************************/
 static int	item_preproc_multiplier(unsigned char value_type, zbx_variant_t *value, const char *params,
-		char **errmsg)
+		const zbx_preproc_compiled_t *compiled, char **errmsg)
 {
-	char	*err = NULL;
+	char			*err = NULL;
+	zbx_preproc_compiled_t	multiplier;
 
-	if (FAIL == is_double(params))
+	if (NULL == compiled && SUCCEED == item_preproc_multiplier_parse(params, &multiplier))
+		compiled = &multiplier;
+
+	if (NULL == compiled)
 		err = zbx_dsprintf(NULL, "a numerical value is expected");
-	else if (SUCCEED == item_preproc_multiplier_variant(value_type, value, params, &err))
+	else if (SUCCEED == item_preproc_multiplier_variant(value_type, value, compiled, &err))
 		return SUCCEED;
 
 	*errmsg = zbx_dsprintf(*errmsg, "cannot apply multiplier \"%s\" to value \"%s\" of type \"%s\": %s",
@@ -452,29 +499,38 @@ static void	unescape_trim_params(const char *in, char *out)
  *                                                                            *
  * Purpose: execute trim type preprocessing operation                         *
  *                                                                            *
- * Parameters: value   - [IN/OUT] the value to process                        *
- *             op_type - [IN] the operation type                              *
- *             params  - [IN] the characters to trim                          *
- *             errmsg  - [OUT] error message                                  *
+ * Parameters: value    - [IN/OUT] the value to process                       *
+ *             op_type  - [IN] the operation type                             *
+ *             params   - [IN] the characters to trim                         *
+ *             compiled - [IN] the unescaped characters to trim (optional)    *
+ *             errmsg   - [OUT] error message                                 *
  *                                                                            *
  * Return value: SUCCEED - the value was trimmed successfully                 *
  *               FAIL - otherwise                                             *
  *                                                                            *
  ******************************************************************************/
-static int item_preproc_trim(zbx_variant_t *value, unsigned char op_type, const char *params, char **errmsg)
+static int item_preproc_trim(zbx_variant_t *value, unsigned char op_type, const char *params,
+		const zbx_preproc_compiled_t *compiled, char **errmsg)
 {
-	char	params_raw[ITEM_PREPROC_PARAMS_LEN * ZBX_MAX_BYTES_IN_UTF8_CHAR + 1];
+	char		params_raw[ITEM_PREPROC_PARAMS_LEN * ZBX_MAX_BYTES_IN_UTF8_CHAR + 1];
+	const char	*chars;
 
 	if (FAIL == item_preproc_convert_value(value, ZBX_VARIANT_STR, errmsg))
 		return FAIL;
 
-	unescape_trim_params(params, params_raw);
+	if (NULL == compiled)
+	{
+		unescape_trim_params(params, params_raw);
+		chars = params_raw;
+	}
+	else
+		chars = compiled->str;
 
 	if (ZBX_PREPROC_LTRIM == op_type || ZBX_PREPROC_TRIM == op_type)
-		zbx_ltrim(value->data.str, params_raw);
+		zbx_ltrim(value->data.str, chars);
 
 	if (ZBX_PREPROC_RTRIM == op_type || ZBX_PREPROC_TRIM == op_type)
-		zbx_rtrim(value->data.str, params_raw);
+		zbx_rtrim(value->data.str, chars);
 
 	return SUCCEED;
 }
@@ -485,19 +541,21 @@ static int item_preproc_trim(zbx_variant_t *value, unsigned char op_type, const
  *                                                                            *
  * Purpose: execute right trim preprocessing operation                        *
  *                                                                            *
- * Parameters: value   - [IN/OUT] the value to process                        *
- *             params  - [IN] the characters to trim                          *
- *             errmsg  - [OUT] error message                                  *
+ * Parameters: value    - [IN/OUT] the value to process                       *
+ *             params   - [IN] the characters to trim                         *
+ *             compiled - [IN] the unescaped characters to trim (optional)    *
+ *             errmsg   - [OUT] error message                                 *
  *                                                                            *
  * Return value: SUCCEED - the value was trimmed successfully                 *
  *               FAIL - otherwise                                             *
  *                                                                            *
  ******************************************************************************/
-static int item_preproc_rtrim(zbx_variant_t *value, const char *params, char **errmsg)
+static int item_preproc_rtrim(zbx_variant_t *value, const char *params, const zbx_preproc_compiled_t *compiled,
+		char **errmsg)
 {
 	char	*err = NULL;
 
-	if (SUCCEED == item_preproc_trim(value, ZBX_PREPROC_RTRIM, params, &err))
+	if (SUCCEED == item_preproc_trim(value, ZBX_PREPROC_RTRIM, params, compiled, &err))
 		return SUCCEED;
 
 	*errmsg = zbx_dsprintf(*errmsg, "cannot perform right trim of \"%s\" for value \"%s\" of type \"%s\": %s",
@@ -514,19 +572,21 @@ static int item_preproc_rtrim(zbx_variant_t *value, const char *params, char **e
  *                                                                            *
  * Purpose: execute left trim preprocessing operation                         *
  *                                                                            *
- * Parameters: value   - [IN/OUT] the value to process                        *
- *             params  - [IN] the characters to trim                          *
- *             errmsg  - [OUT] error message                                  *
+ * Parameters: value    - [IN/OUT] the value to process                       *
+ *             params   - [IN] the characters to trim                         *
+ *             compiled - [IN] the unescaped characters to trim (optional)    *
+ *             errmsg   - [OUT] error message                                 *
  *                                                                            *
  * Return value: SUCCEED - the value was trimmed successfully                 *
  *               FAIL - otherwise                                             *
  *                                                                            *
  ******************************************************************************/
-static int item_preproc_ltrim(zbx_variant_t *value, const char *params, char **errmsg)
+static int item_preproc_ltrim(zbx_variant_t *value, const char *params, const zbx_preproc_compiled_t *compiled,
+		char **errmsg)
 {
 	char	*err = NULL;
 
-	if (SUCCEED == item_preproc_trim(value, ZBX_PREPROC_LTRIM, params, &err))
+	if (SUCCEED == item_preproc_trim(value, ZBX_PREPROC_LTRIM, params, compiled, &err))
 		return SUCCEED;
 
 	*errmsg = zbx_dsprintf(*errmsg, "cannot perform left trim of \"%s\" for value \"%s\" of type \"%s\": %s",
@@ -543,19 +603,21 @@ static int item_preproc_ltrim(zbx_variant_t *value, const char *params, char **e
  *                                                                            *
  * Purpose: execute left and right trim preprocessing operation               *
  *                                                                            *
- * Parameters: value   - [IN/OUT] the value to process                        *
- *             params  - [IN] the characters to trim                          *
- *             errmsg  - [OUT] error message                                  *
+ * Parameters: value    - [IN/OUT] the value to process                       *
+ *             params   - [IN] the characters to trim                         *
+ *             compiled - [IN] the unescaped characters to trim (optional)    *
+ *             errmsg   - [OUT] error message                                 *
  *                                                                            *
  * Return value: SUCCEED - the value was trimmed successfully                 *
  *               FAIL - otherwise                                             *
  *                                                                            *
  ******************************************************************************/
-static int item_preproc_lrtrim(zbx_variant_t *value, const char *params, char **errmsg)
+static int item_preproc_lrtrim(zbx_variant_t *value, const char *params, const zbx_preproc_compiled_t *compiled,
+		char **errmsg)
 {
 	char	*err = NULL;
 
-	if (SUCCEED == item_preproc_trim(value, ZBX_PREPROC_TRIM, params, &err))
+	if (SUCCEED == item_preproc_trim(value, ZBX_PREPROC_TRIM, params, compiled, &err))
 		return SUCCEED;
 
 	*errmsg = zbx_dsprintf(*errmsg, "cannot perform trim of \"%s\" for value \"%s\" of type \"%s\": %s",
@@ -721,34 +783,43 @@ static int	item_preproc_hex2dec(zbx_variant_t *value, char **errmsg)
  *                                                                            *
  * Purpose: execute regular expression substitution operation                 *
  *                                                                            *
- * Parameters: value  - [IN/OUT] the value to process                         *
- *             params - [IN] the operation parameters                         *
- *             errmsg - [OUT] error message                                   *
+ * Parameters: value    - [IN/OUT] the value to process                       *
+ *             params   - [IN] the operation parameters                       *
+ *             compiled - [IN] the compiled regular expression (optional)     *
+ *             errmsg   - [OUT] error message                                 *
  *                                                                            *
  * Return value: SUCCEED - the value was processed successfully               *
  *               FAIL - otherwise                                             *
  *                                                                            *
  ******************************************************************************/
-static int	item_preproc_regsub_op(zbx_variant_t *value, const char *params, char **errmsg)
+static int	item_preproc_regsub_op(zbx_variant_t *value, const char *params, const zbx_preproc_compiled_t *compiled,
+		char **errmsg)
 {
 	char	pattern[ITEM_PREPROC_PARAMS_LEN * ZBX_MAX_BYTES_IN_UTF8_CHAR + 1], *output, *new_value = NULL;
 
 	if (FAIL == item_preproc_convert_value(value, ZBX_VARIANT_STR, errmsg))
 		return FAIL;
 
-	zbx_strlcpy(pattern, params, sizeof(pattern));
-	if (NULL == (output = strchr(pattern, '\n')))
+	if (NULL != compiled)
 	{
-		*errmsg = zbx_strdup(*errmsg, "cannot find second parameter");
-		return FAIL;
+		zbx_regexp_sub_precompiled(value->data.str, compiled->regexp, compiled->str, &new_value);
 	}
+	else
+	{
+		zbx_strlcpy(pattern, params, sizeof(pattern));
+		if (NULL == (output = strchr(pattern, '\n')))
+		{
+			*errmsg = zbx_strdup(*errmsg, "cannot find second parameter");
+			return FAIL;
+		}
 
-	*output++ = '\0';
+		*output++ = '\0';
 
-	if (FAIL == zbx_mregexp_sub(value->data.str, pattern, output, &new_value))
-	{
-		*errmsg = zbx_dsprintf(*errmsg, "invalid regular expression \"%s\"", pattern);
-		return FAIL;
+		if (FAIL == zbx_mregexp_sub(value->data.str, pattern, output, &new_value))
+		{
+			*errmsg = zbx_dsprintf(*errmsg, "invalid regular expression \"%s\"", pattern);
+			return FAIL;
+		}
 	}
 
 	if (NULL == new_value)
@@ -769,19 +840,21 @@ static int	item_preproc_regsub_op(zbx_variant_t *value, const char *params, char
  *                                                                            *
  * Purpose: execute regular expression substitution operation                 *
  *                                                                            *
- * Parameters: value  - [IN/OUT] the value to process                         *
- *             params - [IN] the operation parameters                         *
- *             errmsg - [OUT] error message                                   *
+ * Parameters: value    - [IN/OUT] the value to process                       *
+ *             params   - [IN] the operation parameters                       *
+ *             compiled - [IN] the compiled operation parameters (optional)   *
+ *             errmsg   - [OUT] error message                                 *
  *                                                                            *
  * Return value: SUCCEED - the value was processed successfully               *
  *               FAIL - otherwise                                             *
  *                                                                            *
  ******************************************************************************/
-static int	item_preproc_regsub(zbx_variant_t *value, const char *params, char **errmsg)
+static int	item_preproc_regsub(zbx_variant_t *value, const char *params, const zbx_preproc_compiled_t *compiled,
+		char **errmsg)
 {
 	char	*err = NULL;
 
-	if (SUCCEED == item_preproc_regsub_op(value, params, &err))
+	if (SUCCEED == item_preproc_regsub_op(value, params, compiled, &err))
 		return SUCCEED;
 
 	*errmsg = zbx_dsprintf(*errmsg, "cannot perform regular expression match on value \"%s\" of type \"%s\": %s",
@@ -798,24 +871,35 @@ static int	item_preproc_regsub(zbx_variant_t *value, const char *params, char **
  *                                                                            *
  * Purpose: execute jsonpath query                                            *
  *                                                                            *
- * Parameters: value  - [IN/OUT] the value to process                         *
- *             params - [IN] the operation parameters                         *
- *             errmsg - [OUT] error message                                   *
+ * Parameters: value    - [IN/OUT] the value to process                       *
+ *             params   - [IN] the operation parameters                       *
+ *             compiled - [IN] the compiled operation parameters (optional)   *
+ *             errmsg   - [OUT] error message                                 *
  *                                                                            *
  * Return value: SUCCEED - the value was processed successfully               *
  *               FAIL - otherwise                                             *
  *                                                                            *
  ******************************************************************************/
-static int	item_preproc_jsonpath_op(zbx_variant_t *value, const char *params, char **errmsg)
+static int	item_preproc_jsonpath_op(zbx_variant_t *value, const char *params,
+		const zbx_preproc_compiled_t *compiled, char **errmsg)
 {
 	struct zbx_json_parse	jp, jp_out;
 	char			*data = NULL;
 	size_t			data_alloc = 0;
+	int			ret;
 
 	if (FAIL == item_preproc_convert_value(value, ZBX_VARIANT_STR, errmsg))
 		return FAIL;
 
-	if (FAIL == zbx_json_open(value->data.str, &jp) || FAIL == zbx_json_path_open(&jp, params, &jp_out))
+	if (SUCCEED == (ret = zbx_json_open(value->data.str, &jp)))
+	{
+		if (NULL != compiled)
+			ret = zbx_json_path_open_compiled(&jp, &compiled->jsonpath, &jp_out);
+		else
+			ret = zbx_json_path_open(&jp, params, &jp_out);
+	}
+
+	if (FAIL == ret)
 	{
 		*errmsg = zbx_strdup(*errmsg, zbx_json_strerror());
 		return FAIL;
@@ -834,19 +918,21 @@ static int	item_preproc_jsonpath_op(zbx_variant_t *value, const char *params, ch
  *                                                                            *
  * Purpose: execute jsonpath query                                            *
  *                                                                            *
- * Parameters: value  - [IN/OUT] the value to process                         *
- *             params - [IN] the operation parameters                         *
- *             errmsg - [OUT] error message                                   *
+ * Parameters: value    - [IN/OUT] the value to process                       *
+ *             params   - [IN] the operation parameters                       *
+ *             compiled - [IN] the compiled operation parameters (optional)   *
+ *             errmsg   - [OUT] error message                                 *
  *                                                                            *
  * Return value: SUCCEED - the value was processed successfully               *
  *               FAIL - otherwise                                             *
  *                                                                            *
  ******************************************************************************/
-static int	item_preproc_jsonpath(zbx_variant_t *value, const char *params, char **errmsg)
+static int	item_preproc_jsonpath(zbx_variant_t *value, const char *params, const zbx_preproc_compiled_t *compiled,
+		char **errmsg)
 {
 	char	*err = NULL;
 
-	if (SUCCEED == item_preproc_jsonpath_op(value, params, &err))
+	if (SUCCEED == item_preproc_jsonpath_op(value, params, compiled, &err))
 		return SUCCEED;
 
 	*errmsg = zbx_dsprintf(*errmsg, "cannot extract value from json by path \"%s\": %s", params, err);
@@ -861,19 +947,22 @@ static int	item_preproc_jsonpath(zbx_variant_t *value, const char *params, char
  *                                                                            *
  * Purpose: execute xpath query                                               *
  *                                                                            *
- * Parameters: value  - [IN/OUT] the value to process                         *
- *             params - [IN] the operation parameters                         *
- *             errmsg - [OUT] error message                                   *
+ * Parameters: value    - [IN/OUT] the value to process                       *
+ *             params   - [IN] the operation parameters                       *
+ *             compiled - [IN] the compiled operation parameters (optional)   *
+ *             errmsg   - [OUT] error message                                 *
  *                                                                            *
  * Return value: SUCCEED - the value was processed successfully               *
  *               FAIL - otherwise                                             *
  *                                                                            *
  ******************************************************************************/
-static int	item_preproc_xpath_op(zbx_variant_t *value, const char *params, char **errmsg)
+static int	item_preproc_xpath_op(zbx_variant_t *value, const char *params, const zbx_preproc_compiled_t *compiled,
+		char **errmsg)
 {
 #ifndef HAVE_LIBXML2
 	ZBX_UNUSED(value);
 	ZBX_UNUSED(params);
+	ZBX_UNUSED(compiled);
 	*errmsg = zbx_dsprintf(*errmsg, "Zabbix was compiled without libxml2 support");
 	return FAIL;
 #else
@@ -900,7 +989,12 @@ static int	item_preproc_xpath_op(zbx_variant_t *value, const char *params, char
 
 	xpathCtx = xmlXPathNewContext(doc);
 
-	if (NULL == (xpathObj = xmlXPathEvalExpression((xmlChar *)params, xpathCtx)))
+	if (NULL != compiled)
+		xpathObj = xmlXPathCompiledEval(compiled->xpath, xpathCtx);
+	else
+		xpathObj = xmlXPathEvalExpression((xmlChar *)params, xpathCtx);
+
+	if (NULL == xpathObj)
 	{
 		pErr = xmlGetLastError();
 		*errmsg = zbx_dsprintf(*errmsg, "cannot parse xpath: %s", pErr->message);
@@ -973,19 +1067,21 @@ out:
  *                                                                            *
  * Purpose: execute xpath query                                               *
  *                                                                            *
- * Parameters: value  - [IN/OUT] the value to process                         *
- *             params - [IN] the operation parameters                         *
- *             errmsg - [OUT] error message                                   *
+ * Parameters: value    - [IN/OUT] the value to process                       *
+ *             params   - [IN] the operation parameters                       *
+ *             compiled - [IN] the compiled operation parameters (optional)   *
+ *             errmsg   - [OUT] error message                                 *
  *                                                                            *
  * Return value: SUCCEED - the value was processed successfully               *
  *               FAIL - otherwise                                             *
  *                                                                            *
  ******************************************************************************/
-static int	item_preproc_xpath(zbx_variant_t *value, const char *params, char **errmsg)
+static int	item_preproc_xpath(zbx_variant_t *value, const char *params, const zbx_preproc_compiled_t *compiled,
+		char **errmsg)
 {
 	char	*err = NULL;
 
-	if (SUCCEED == item_preproc_xpath_op(value, params, &err))
+	if (SUCCEED == item_preproc_xpath_op(value, params, compiled, &err))
 		return SUCCEED;
 
 	*errmsg = zbx_dsprintf(*errmsg, "cannot extract XML value with xpath \"%s\": %s", params, err);
@@ -1004,6 +1100,8 @@ static int	item_preproc_xpath(zbx_variant_t *value, const char *params, char **e
  *             value         - [IN/OUT] the value to process                  *
  *             ts            - [IN] the value timestamp                       *
  *             op            - [IN] the preprocessing operation to execute    *
+ *             compiled      - [IN] the operation data prepared by            *
+ *                                  zbx_item_preproc_compile() (optional)     *
  *             history_value - [IN/OUT] last historical data of items with    *
  *                                      delta type preprocessing operation    *
  *             errmsg        - [OUT] error message                            *
@@ -1013,20 +1111,21 @@ static int	item_preproc_xpath(zbx_variant_t *value, const char *params, char **e
  *                                                                            *
  ******************************************************************************/
 int	zbx_item_preproc(unsigned char value_type, zbx_variant_t *value, const zbx_timespec_t *ts,
-		const zbx_preproc_op_t *op, zbx_item_history_value_t *history_value, char **errmsg)
+		const zbx_preproc_op_t *op, const zbx_preproc_compiled_t *compiled, zbx_item_history_value_t *history_value,
+		char **errmsg)
 {
 	switch (op->type)
 	{
 		case ZBX_PREPROC_MULTIPLIER:
-			return item_preproc_multiplier(value_type, value, op->params, errmsg);
+			return item_preproc_multiplier(value_type, value, op->params, compiled, errmsg);
 		case ZBX_PREPROC_RTRIM:
-			return item_preproc_rtrim(value, op->params, errmsg);
+			return item_preproc_rtrim(value, op->params, compiled, errmsg);
 		case ZBX_PREPROC_LTRIM:
-			return item_preproc_ltrim(value, op->params, errmsg);
+			return item_preproc_ltrim(value, op->params, compiled, errmsg);
 		case ZBX_PREPROC_TRIM:
-			return item_preproc_lrtrim(value, op->params, errmsg);
+			return item_preproc_lrtrim(value, op->params, compiled, errmsg);
 		case ZBX_PREPROC_REGSUB:
-			return item_preproc_regsub(value, op->params, errmsg);
+			return item_preproc_regsub(value, op->params, compiled, errmsg);
 		case ZBX_PREPROC_BOOL2DEC:
 			return item_preproc_bool2dec(value, errmsg);
 		case ZBX_PREPROC_OCT2DEC:
@@ -1038,12 +1137,162 @@ int	zbx_item_preproc(unsigned char value_type, zbx_variant_t *value, const zbx_t
 		case ZBX_PREPROC_DELTA_SPEED:
 			return item_preproc_delta_speed(value_type, value, ts, history_value, errmsg);
 		case ZBX_PREPROC_XPATH:
-			return item_preproc_xpath(value, op->params, errmsg);
+			return item_preproc_xpath(value, op->params, compiled, errmsg);
 		case ZBX_PREPROC_JSONPATH:
-			return item_preproc_jsonpath(value, op->params, errmsg);
+			return item_preproc_jsonpath(value, op->params, compiled, errmsg);
 	}
 
 	*errmsg = zbx_dsprintf(*errmsg, "unknown preprocessing operation");
 
 	return FAIL;
 }
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_item_preproc_jsonpath_multi                                  *
+ *                                                                            *
+ * Purpose: execute multiple jsonpath queries on the same value in one pass   *
+ *                                                                            *
+ * Parameters: value        - [IN] the value to process                       *
+ *             compiled     - [IN] the compiled jsonpath operations           *
+ *             compiled_num - [IN] the number of operations                   *
+ *             results      - [OUT] the operation results                     *
+ *             ret          - [OUT] SUCCEED - the operation was executed and  *
+ *                                            its result is set               *
+ *                                  FAIL    - otherwise                       *
+ *                                                                            *
+ * Comments: The results are the same as of executing each jsonpath           *
+ *           operation separately. The operations that failed must be        *
+ *           executed separately to get their error messages.                 *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_item_preproc_jsonpath_multi(const zbx_variant_t *value, const zbx_preproc_compiled_t * const *compiled,
+		int compiled_num, zbx_variant_t *results, int *ret)
+{
+	struct zbx_json_parse	jp, *jp_out;
+	const zbx_json_path_t	**paths;
+	char			*data;
+	size_t			data_alloc;
+	int			i;
+
+	for (i = 0; i < compiled_num; i++)
+		ret[i] = FAIL;
+
+	if (ZBX_VARIANT_STR != value->type || FAIL == zbx_json_open(value->data.str, &jp))
+		return;
+
+	paths = (const zbx_json_path_t **)zbx_malloc(NULL, sizeof(zbx_json_path_t *) * compiled_num);
+	jp_out = (struct zbx_json_parse *)zbx_malloc(NULL, sizeof(struct zbx_json_parse) * compiled_num);
+
+	for (i = 0; i < compiled_num; i++)
+		paths[i] = &compiled[i]->jsonpath;
+
+	zbx_json_path_open_multi(&jp, paths, compiled_num, jp_out, ret);
+
+	for (i = 0; i < compiled_num; i++)
+	{
+		if (SUCCEED != ret[i])
+			continue;
+
+		data = NULL;
+		data_alloc = 0;
+		zbx_json_value_dyn(&jp_out[i], &data, &data_alloc);
+		zbx_variant_set_str(&results[i], data);
+	}
+
+	zbx_free(jp_out);
+	zbx_free(paths);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_item_preproc_compile                                         *
+ *                                                                            *
+ * Purpose: prepare preprocessing operation parameters for repeated execution *
+ *                                                                            *
+ * Parameters: op - [IN] the preprocessing operation                          *
+ *                                                                            *
+ * Return value: the prepared operation data or NULL if the operation has     *
+ *               nothing to prepare or its parameters are invalid             *
+ *                                                                            *
+ * Comments: operations without prepared data are executed by parsing their   *
+ *           parameters, so invalid parameters are reported as before         *
+ *                                                                            *
+ ******************************************************************************/
+zbx_preproc_compiled_t	*zbx_item_preproc_compile(const zbx_preproc_op_t *op)
+{
+	zbx_preproc_compiled_t	*compiled;
+	char			*output;
+	const char		*error = NULL;
+
+	compiled = (zbx_preproc_compiled_t *)zbx_malloc(NULL, sizeof(zbx_preproc_compiled_t));
+	memset(compiled, 0, sizeof(zbx_preproc_compiled_t));
+
+	switch (op->type)
+	{
+		case ZBX_PREPROC_MULTIPLIER:
+			if (SUCCEED == item_preproc_multiplier_parse(op->params, compiled))
+				return compiled;
+			break;
+		case ZBX_PREPROC_RTRIM:
+		case ZBX_PREPROC_LTRIM:
+		case ZBX_PREPROC_TRIM:
+			compiled->str = (char *)zbx_malloc(NULL, strlen(op->params) + 1);
+			unescape_trim_params(op->params, compiled->str);
+			return compiled;
+		case ZBX_PREPROC_REGSUB:
+			compiled->str = zbx_strdup(NULL, op->params);
+
+			if (NULL == (output = strchr(compiled->str, '\n')))
+				break;
+
+			*output++ = '\0';
+
+			if (SUCCEED != zbx_mregexp_sub_compile(compiled->str, output, &compiled->regexp, &error))
+				break;
+
+			/* keep only the output template */
+			memmove(compiled->str, output, strlen(output) + 1);
+			return compiled;
+		case ZBX_PREPROC_JSONPATH:
+			if (SUCCEED == zbx_json_path_compile(op->params, &compiled->jsonpath))
+				return compiled;
+			break;
+#ifdef HAVE_LIBXML2
+		case ZBX_PREPROC_XPATH:
+			if (NULL != (compiled->xpath = xmlXPathCompile((xmlChar *)op->params)))
+				return compiled;
+			break;
+#endif
+	}
+
+	zbx_item_preproc_compiled_free(compiled);
+
+	return NULL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_item_preproc_compiled_free                                   *
+ *                                                                            *
+ * Purpose: free preprocessing operation data prepared by                     *
+ *          zbx_item_preproc_compile()                                        *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_item_preproc_compiled_free(zbx_preproc_compiled_t *compiled)
+{
+	if (NULL == compiled)
+		return;
+
+	zbx_free(compiled->str);
+
+	if (NULL != compiled->regexp)
+		zbx_regexp_free(compiled->regexp);
+
+	zbx_json_path_clear(&compiled->jsonpath);
+#ifdef HAVE_LIBXML2
+	if (NULL != compiled->xpath)
+		xmlXPathFreeCompExpr(compiled->xpath);
+#endif
+	zbx_free(compiled);
+}
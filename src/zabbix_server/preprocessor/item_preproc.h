@@ -22,8 +22,16 @@
 
 #include "dbcache.h"
 
+typedef struct zbx_preproc_compiled zbx_preproc_compiled_t;
+
 int	zbx_item_preproc(unsigned char value_type, zbx_variant_t *value, const zbx_timespec_t *ts,
-		const zbx_preproc_op_t *op, zbx_item_history_value_t *history_value, char **errmsg);
+		const zbx_preproc_op_t *op, const zbx_preproc_compiled_t *compiled, zbx_item_history_value_t *history_value,
+		char **errmsg);
+
+zbx_preproc_compiled_t	*zbx_item_preproc_compile(const zbx_preproc_op_t *op);
+void	zbx_item_preproc_compiled_free(zbx_preproc_compiled_t *compiled);
+void	zbx_item_preproc_jsonpath_multi(const zbx_variant_t *value, const zbx_preproc_compiled_t * const *compiled,
+		int compiled_num, zbx_variant_t *results, int *ret);
 
 int	zbx_item_preproc_convert_value_to_numeric(zbx_variant_t *value_num, const zbx_variant_t *value,
 		unsigned char value_type, char **errmsg);
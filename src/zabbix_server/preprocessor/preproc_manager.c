@@ -30,6 +30,7 @@
 
 #include "preprocessing.h"
 #include "preproc_manager.h"
+#include "preproc_ring.h"
 #include "linked_list.h"
 
 extern unsigned char	process_type, program_type;
@@ -43,6 +44,12 @@ extern int		server_num, process_num, CONFIG_PREPROCESSOR_FORKS;
 //this must be big enough to hold buffer for occasional slowdownds, so 10-15 threads might submit data without stucking
 #define ZBX_PREPROCESSING_MAX_QUEUE_TRESHOLD 1000000
 
+/* the maximum number of ring records processed before checking for results */
+#define ZBX_PREPROCESSING_RING_BATCH	64
+
+/* the maximum number of values sent to preprocessing worker in one task batch */
+#define ZBX_PREPROCESSING_WORKER_BATCH	64
+
 
 typedef enum
 {
@@ -64,6 +71,8 @@ typedef struct preprocessing_request
 	int				steps_num;	/* number of preprocessing steps */
 	unsigned char			value_type;	/* value type from configuration */
 							/* at the beginning of preprocessing queue */
+	zbx_uint64_t			master_valueid;	/* the master value of dependent item value, */
+							/* 0 for other values                        */
 }
 zbx_preprocessing_request_t;
 
@@ -71,7 +80,7 @@ zbx_preprocessing_request_t;
 typedef struct
 {
 	zbx_ipc_client_t	*client;	/* the connected preprocessing worker client */
-	zbx_list_item_t		*queue_item;	/* queued item */
+	zbx_vector_ptr_t	queue_items;	/* queued items being processed by worker */
 }
 zbx_preprocessing_worker_t;
 
@@ -97,6 +106,9 @@ typedef struct
 	zbx_uint64_t			queued_num;	/* queued value counter */
 	zbx_uint64_t			preproc_num;	/* queued values with preprocessing steps */
 	zbx_list_iterator_t		priority_tail;	/* iterator to the last queued priority item */
+	int				shard;		/* the manager shard, values are routed by itemid */
+	zbx_uint64_t			master_valueid;	/* the last id given to master values of */
+							/* dependent items                       */
 }
 zbx_preprocessing_manager_t;
 
@@ -168,41 +180,36 @@ static void	preprocessor_sync_configuration(zbx_preprocessing_manager_t *manager
 
 /******************************************************************************
  *                                                                            *
- * Function: preprocessor_get_queued_item                                     *
+ * Function: preprocessor_get_queued_items                                    *
  *                                                                            *
- * Purpose: get queued item value with no dependencies (or with resolved      *
+ * Purpose: get queued item values with no dependencies (or with resolved     *
  *          dependencies)                                                     *
  *                                                                            *
- * Parameters: manager - [IN] preprocessing manager                           *
- *                                                                            *
- * Return value: pointer to the queued item or NULL if none                   *
+ * Parameters: manager     - [IN] preprocessing manager                       *
+ *             queue_items - [OUT] the queued items                           *
+ *             max_num     - [IN] the maximum number of items to get          *
  *                                                                            *
  ******************************************************************************/
-static zbx_list_item_t	*preprocessor_get_queued_item(zbx_preprocessing_manager_t *manager)
+static void	preprocessor_get_queued_items(zbx_preprocessing_manager_t *manager, zbx_vector_ptr_t *queue_items,
+		int max_num)
 {
-	const char			*__function_name = "preprocessor_get_queued_item";
+	const char			*__function_name = "preprocessor_get_queued_items";
 	zbx_list_iterator_t		iterator;
 	zbx_preprocessing_request_t	*request;
-	zbx_list_item_t			*item = NULL;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
 	zbx_list_iterator_init(&manager->queue, &iterator);
-	while (SUCCEED == zbx_list_iterator_next(&iterator))
+	while (queue_items->values_num < max_num && SUCCEED == zbx_list_iterator_next(&iterator))
 	{
 		zbx_list_iterator_peek(&iterator, (void **)&request);
 
+		/* queued item is found */
 		if (REQUEST_STATE_QUEUED == request->state)
-		{
-			/* queued item is found */
-			item = iterator.current;
-			break;
-		}
+			zbx_vector_ptr_append(queue_items, iterator.current);
 	}
 
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
-
-	return item;
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() items:%d", __function_name, queue_items->values_num);
 }
 
 /******************************************************************************
@@ -258,7 +265,7 @@ static zbx_preprocessing_worker_t	*preprocessor_get_free_worker(zbx_preprocessin
 
 	for (i = 0; i < manager->worker_count; i++)
 	{
-		if (NULL == manager->workers[i].queue_item)
+		if (0 == manager->workers[i].queue_items.values_num)
 			return &manager->workers[i];
 	}
 
@@ -269,18 +276,41 @@ static zbx_preprocessing_worker_t	*preprocessor_get_free_worker(zbx_preprocessin
  *                                                                            *
  * Function: preprocessor_create_task                                         *
  *                                                                            *
- * Purpose: create preprocessing task for request                             *
+ * Purpose: create preprocessing task for requests                            *
  *                                                                            *
- * Parameters: manager - [IN] preprocessing manager                           *
- *             request - [IN] preprocessing request                           *
- *             task    - [OUT] preprocessing task data                        *
+ * Parameters: manager      - [IN] preprocessing manager                      *
+ *             queue_items  - [IN] queued items of the requests               *
+ *             requests_num - [IN] the number of requests                     *
+ *             task         - [OUT] preprocessing task data                   *
+ *                                                                            *
+ * Comments: More than one request is passed only for dependent items of the  *
+ *           same master value, they share the value of the first request.    *
  *                                                                            *
  ******************************************************************************/
-static zbx_uint32_t	preprocessor_create_task(zbx_preprocessing_manager_t *manager,
-		zbx_preprocessing_request_t *request, unsigned char **task)
+static zbx_uint32_t	preprocessor_create_task(zbx_preprocessing_manager_t *manager, void **queue_items,
+		int requests_num, unsigned char **task)
 {
-	zbx_uint32_t	size;
-	zbx_variant_t	value;
+	zbx_uint32_t			size;
+	zbx_variant_t			value;
+	zbx_preprocessing_request_t	*request;
+	zbx_preproc_task_item_t		*items;
+	int				i;
+
+	items = (zbx_preproc_task_item_t *)zbx_malloc(NULL, sizeof(zbx_preproc_task_item_t) * requests_num);
+
+	for (i = 0; i < requests_num; i++)
+	{
+		request = (zbx_preprocessing_request_t *)((zbx_list_item_t *)queue_items[i])->data;
+
+		items[i].itemid = request->value.itemid;
+		items[i].value_type = request->value_type;
+		items[i].history_value = (zbx_item_history_value_t *)zbx_hashset_search(&manager->history_cache,
+				&request->value.itemid);
+		items[i].steps = request->steps;
+		items[i].steps_num = request->steps_num;
+	}
+
+	request = (zbx_preprocessing_request_t *)((zbx_list_item_t *)queue_items[0])->data;
 
 	if (ISSET_LOG(request->value.result))
 		zbx_variant_set_str(&value, request->value.result->log->value);
@@ -295,9 +325,9 @@ static zbx_uint32_t	preprocessor_create_task(zbx_preprocessing_manager_t *manage
 	else
 		THIS_SHOULD_NEVER_HAPPEN;
 
-	size = zbx_preprocessor_pack_task(task, request->value.itemid, request->value_type, request->value.ts, &value,
-			(zbx_item_history_value_t *)zbx_hashset_search(&manager->history_cache, &request->value.itemid), request->steps,
-			request->steps_num);
+	size = zbx_preprocessor_pack_task(task, request->value.ts, &value, items, requests_num);
+
+	zbx_free(items);
 
 	return size;
 }
@@ -310,37 +340,91 @@ static zbx_uint32_t	preprocessor_create_task(zbx_preprocessing_manager_t *manage
  *                                                                            *
  * Parameters: manager - [IN] preprocessing manager                           *
  *                                                                            *
+ * Comments: Queued values are split between free workers in batches, each    *
+ *           batch is sent as a sequence of packed tasks prefixed with their  *
+ *           sizes. Dependent items of the same master value are grouped into *
+ *           one task to send the value once. The worker replies with a       *
+ *           result per item in the same order.                               *
+ *                                                                            *
  ******************************************************************************/
 static void	preprocessor_assign_tasks(zbx_preprocessing_manager_t *manager)
 {
 	const char			*__function_name = "preprocessor_assign_tasks";
-	zbx_list_item_t			*queue_item;
 	zbx_preprocessing_request_t	*request;
 	zbx_preprocessing_worker_t	*worker;
 	zbx_uint32_t			size;
-	unsigned char			*task;
+	unsigned char			*task, *data = NULL;
+	size_t				data_alloc = 0, data_offset;
+	int				i, j, batch_size;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
-	while (NULL != (worker = preprocessor_get_free_worker(manager)) &&
-			NULL != (queue_item = preprocessor_get_queued_item(manager)))
+	if (0 == manager->worker_count)
+		goto out;
+
+	/* distribute the queued values evenly between workers to keep them all busy */
+	if (ZBX_PREPROCESSING_WORKER_BATCH < (batch_size = (int)(manager->preproc_num / manager->worker_count)))
+		batch_size = ZBX_PREPROCESSING_WORKER_BATCH;
+	else if (1 > batch_size)
+		batch_size = 1;
+
+	while (NULL != (worker = preprocessor_get_free_worker(manager)))
 	{
-		request = (zbx_preprocessing_request_t *)queue_item->data;
-		size = preprocessor_create_task(manager, request, &task);
+		preprocessor_get_queued_items(manager, &worker->queue_items, batch_size);
+
+		if (0 == worker->queue_items.values_num)
+			break;
 
-		if (FAIL == zbx_ipc_client_send(worker->client, ZBX_IPC_PREPROCESSOR_REQUEST, task, size))
+		data_offset = 0;
+
+		for (i = 0; i < worker->queue_items.values_num; i = j)
+		{
+			request = (zbx_preprocessing_request_t *)((zbx_list_item_t *)worker->queue_items.values[i])->data;
+
+			/* dependent items of the same master value are enqueued one after another */
+			for (j = i + 1; 0 != request->master_valueid && j < worker->queue_items.values_num; j++)
+			{
+				if (request->master_valueid != ((zbx_preprocessing_request_t *)
+						((zbx_list_item_t *)worker->queue_items.values[j])->data)->master_valueid)
+				{
+					break;
+				}
+			}
+
+			size = preprocessor_create_task(manager, worker->queue_items.values + i, j - i, &task);
+
+			if (data_alloc < data_offset + sizeof(zbx_uint32_t) + size)
+			{
+				while (data_alloc < data_offset + sizeof(zbx_uint32_t) + size)
+					data_alloc += ZBX_KIBIBYTE * 16;
+
+				data = (unsigned char *)zbx_realloc(data, data_alloc);
+			}
+
+			memcpy(data + data_offset, &size, sizeof(zbx_uint32_t));
+			memcpy(data + data_offset + sizeof(zbx_uint32_t), task, size);
+			data_offset += sizeof(zbx_uint32_t) + size;
+			zbx_free(task);
+
+			for (; i < j; i++)
+			{
+				request = (zbx_preprocessing_request_t *)
+						((zbx_list_item_t *)worker->queue_items.values[i])->data;
+				request->state = REQUEST_STATE_PROCESSING;
+				request_free_steps(request);
+			}
+		}
+
+		if (FAIL == zbx_ipc_client_send(worker->client, ZBX_IPC_PREPROCESSOR_REQUEST, data,
+				(zbx_uint32_t)data_offset))
 		{
 			zabbix_log(LOG_LEVEL_CRIT, "cannot send data to preprocessing worker");
 			exit(EXIT_FAILURE);
 		}
-
-		request->state = REQUEST_STATE_PROCESSING;
-		worker->queue_item = queue_item;
-
-		request_free_steps(request);
-		zbx_free(task);
 	}
 
+	zbx_free(data);
+out:
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
 
@@ -543,14 +627,16 @@ static void	preprocessor_copy_value(zbx_preproc_item_value_t *target, zbx_prepro
  *                                                                            *
  * Purpose: enqueue preprocessing request                                     *
  *                                                                            *
- * Parameters: manage   - [IN] preprocessing manager                          *
- *             value    - [IN] item value                                     *
- *             master   - [IN] request should be enqueued after this item     *
- *                             (NULL for the end of the queue)                *
+ * Parameters: manage         - [IN] preprocessing manager                    *
+ *             value          - [IN] item value                               *
+ *             master         - [IN] request should be enqueued after this    *
+ *                                   item (NULL for the end of the queue)     *
+ *             master_valueid - [IN] the master value of dependent item       *
+ *                                   value, 0 for other values                *
  *                                                                            *
  ******************************************************************************/
 static void	preprocessor_enqueue(zbx_preprocessing_manager_t *manager, zbx_preproc_item_value_t *value,
-		zbx_list_item_t *master)
+		zbx_list_item_t *master, zbx_uint64_t master_valueid)
 {
 	const char			*__function_name = "preprocessor_enqueue";
 	zbx_preprocessing_request_t	*request;
@@ -595,6 +681,7 @@ static void	preprocessor_enqueue(zbx_preprocessing_manager_t *manager, zbx_prepr
 	if (REQUEST_STATE_QUEUED == state)
 	{
 		request->value_type = item->value_type;
+		request->master_valueid = master_valueid;
 		request->steps = (zbx_preproc_op_t *)zbx_malloc(NULL, sizeof(zbx_preproc_op_t) * item->preproc_ops_num);
 		request->steps_num = item->preproc_ops_num;
 
@@ -666,6 +753,7 @@ static void	preprocessor_enqueue_dependent(zbx_preprocessing_manager_t *manager,
 	int				i;
 	zbx_preproc_item_t		*item, item_local;
 	zbx_preproc_item_value_t	value;
+	zbx_uint64_t			master_valueid;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s() itemid: %" PRIu64, __function_name, source_value->itemid);
 
@@ -675,11 +763,13 @@ static void	preprocessor_enqueue_dependent(zbx_preprocessing_manager_t *manager,
 		if (NULL != (item = (zbx_preproc_item_t *)zbx_hashset_search(&manager->item_config, &item_local)) &&
 				0 != item->dep_itemids_num)
 		{
+			master_valueid = ++manager->master_valueid;
+
 			for (i = item->dep_itemids_num - 1; i >= 0; i--)
 			{
 				preprocessor_copy_value(&value, source_value);
 				value.itemid = item->dep_itemids[i];
-				preprocessor_enqueue(manager, &value, master);
+				preprocessor_enqueue(manager, &value, master, master_valueid);
 			}
 
 			preprocessor_assign_tasks(manager);
@@ -690,6 +780,30 @@ static void	preprocessor_enqueue_dependent(zbx_preprocessing_manager_t *manager,
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: preprocessor_enqueue_packed                                      *
+ *                                                                            *
+ * Purpose: unpack and enqueue item values                                    *
+ *                                                                            *
+ * Parameters: manager - [IN] preprocessing manager                           *
+ *             data    - [IN] packed item values                              *
+ *             size    - [IN] the data size                                   *
+ *                                                                            *
+ ******************************************************************************/
+static void	preprocessor_enqueue_packed(zbx_preprocessing_manager_t *manager, unsigned char *data,
+		zbx_uint32_t size)
+{
+	zbx_uint32_t			offset = 0;
+	zbx_preproc_item_value_t	value;
+
+	while (offset < size)
+	{
+		offset += zbx_preprocessor_unpack_value(&value, data + offset);
+		preprocessor_enqueue(manager, &value, NULL, 0);
+	}
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: preprocessor_add_request                                         *
@@ -702,24 +816,54 @@ static void	preprocessor_enqueue_dependent(zbx_preprocessing_manager_t *manager,
  ******************************************************************************/
 static void	preprocessor_add_request(zbx_preprocessing_manager_t *manager, zbx_ipc_message_t *message)
 {
-	const char			*__function_name = "preprocessor_add_request";
-	zbx_uint32_t			offset = 0;
-	zbx_preproc_item_value_t	value;
+	const char	*__function_name = "preprocessor_add_request";
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+
+	preprocessor_sync_configuration(manager);
+	preprocessor_enqueue_packed(manager, message->data, message->size);
+	preprocessor_assign_tasks(manager);
+	preprocessing_flush_queue(manager);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: preprocessor_add_ring_requests                                   *
+ *                                                                            *
+ * Purpose: handle preprocessing requests passed through shared memory ring   *
+ *                                                                            *
+ * Parameters: manager - [IN] preprocessing manager                           *
+ *             data    - [IN] the first read ring record                      *
+ *             size    - [IN] the record size                                 *
+ *                                                                            *
+ ******************************************************************************/
+static void	preprocessor_add_ring_requests(zbx_preprocessing_manager_t *manager, unsigned char *data,
+		zbx_uint32_t size)
+{
+	const char	*__function_name = "preprocessor_add_ring_requests";
+	int		records_num = 0;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
 	preprocessor_sync_configuration(manager);
 
-	while (offset < message->size)
+	do
 	{
-		offset += zbx_preprocessor_unpack_value(&value, message->data + offset);
-		preprocessor_enqueue(manager, &value, NULL);
+		preprocessor_enqueue_packed(manager, data, size);
+		records_num++;
 	}
+	while (ZBX_PREPROCESSING_RING_BATCH > records_num &&
+			NULL != (data = zbx_preprocessor_ring_read(manager->shard, &size)));
+
+	/* unpacked values have their own copies of data */
+	zbx_preprocessor_ring_release(manager->shard);
 
 	preprocessor_assign_tasks(manager);
 	preprocessing_flush_queue(manager);
 
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() records:%d", __function_name, records_num);
 }
 
 /******************************************************************************
@@ -832,32 +976,27 @@ out:
 
 /******************************************************************************
  *                                                                            *
- * Function: preprocessor_add_result                                          *
+ * Function: preprocessor_set_result                                          *
  *                                                                            *
- * Purpose: handle preprocessing result                                       *
+ * Purpose: apply preprocessing result to the processed queue item            *
  *                                                                            *
- * Parameters: manager - [IN] preprocessing manager                           *
- *             client  - [IN] IPC client                                      *
- *             message - [IN] packed preprocessing result                     *
+ * Parameters: manager    - [IN] preprocessing manager                        *
+ *             queue_item - [IN] the processed queue item                     *
+ *             data       - [IN] packed preprocessing result                  *
  *                                                                            *
  ******************************************************************************/
-static void	preprocessor_add_result(zbx_preprocessing_manager_t *manager, zbx_ipc_client_t *client,
-		zbx_ipc_message_t *message)
+static void	preprocessor_set_result(zbx_preprocessing_manager_t *manager, zbx_list_item_t *queue_item,
+		const unsigned char *data)
 {
-	const char			*__function_name = "preprocessor_add_result";
-	zbx_preprocessing_worker_t	*worker;
 	zbx_preprocessing_request_t	*request;
 	zbx_variant_t			value;
 	char				*error;
 	zbx_item_history_value_t	*history_value, *cached_value;
 	zbx_delta_item_index_t		*index;
 
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+	request = (zbx_preprocessing_request_t *)queue_item->data;
 
-	worker = preprocessor_get_worker_by_client(manager, client);
-	request = (zbx_preprocessing_request_t *)worker->queue_item->data;
-
-	zbx_preprocessor_unpack_result(&value, &history_value, &error, message->data);
+	zbx_preprocessor_unpack_result(&value, &history_value, &error, data);
 
 	if (NULL != history_value)
 	{
@@ -885,20 +1024,62 @@ static void	preprocessor_add_result(zbx_preprocessing_manager_t *manager, zbx_ip
 		request->pending->state = REQUEST_STATE_QUEUED;
 
 	if (NULL != (index = (zbx_delta_item_index_t *)zbx_hashset_search(&manager->delta_items, &request->value.itemid)) &&
-			worker->queue_item == index->queue_item)
+			queue_item == index->queue_item)
 	{
 		/* item is removed from delta index if it was present in delta item index*/
 		zbx_hashset_remove_direct(&manager->delta_items, index);
 	}
 
 	if (FAIL != preprocessor_set_variant_result(request, &value, error))
-		preprocessor_enqueue_dependent(manager, &request->value, worker->queue_item);
+		preprocessor_enqueue_dependent(manager, &request->value, queue_item);
 
-	worker->queue_item = NULL;
 	zbx_variant_clear(&value);
 	zbx_free(history_value);
 
 	manager->preproc_num--;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: preprocessor_add_result                                          *
+ *                                                                            *
+ * Purpose: handle preprocessing results of worker task batch                 *
+ *                                                                            *
+ * Parameters: manager - [IN] preprocessing manager                           *
+ *             client  - [IN] IPC client                                      *
+ *             message - [IN] packed preprocessing results                    *
+ *                                                                            *
+ ******************************************************************************/
+static void	preprocessor_add_result(zbx_preprocessing_manager_t *manager, zbx_ipc_client_t *client,
+		zbx_ipc_message_t *message)
+{
+	const char			*__function_name = "preprocessor_add_result";
+	zbx_preprocessing_worker_t	*worker;
+	const unsigned char		*data = message->data;
+	zbx_uint32_t			size;
+	int				i;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+
+	worker = preprocessor_get_worker_by_client(manager, client);
+
+	/* results are returned in the same order as tasks were sent */
+	for (i = 0; i < worker->queue_items.values_num; i++)
+	{
+		if (data + sizeof(zbx_uint32_t) > message->data + message->size)
+		{
+			THIS_SHOULD_NEVER_HAPPEN;
+			exit(EXIT_FAILURE);
+		}
+
+		memcpy(&size, data, sizeof(zbx_uint32_t));
+		data += sizeof(zbx_uint32_t);
+
+		preprocessor_set_result(manager, (zbx_list_item_t *)worker->queue_items.values[i], data);
+		data += size;
+	}
+
+	zbx_vector_ptr_clear(&worker->queue_items);
 
 	preprocessor_assign_tasks(manager);
 	preprocessing_flush_queue(manager);
@@ -923,6 +1104,8 @@ static void	preprocessor_init_manager(zbx_preprocessing_manager_t *manager)
 
 	memset(manager, 0, sizeof(zbx_preprocessing_manager_t));
 
+	manager->shard = process_num - 1;
+
 	manager->workers = (zbx_preprocessing_worker_t *)zbx_calloc(NULL, CONFIG_PREPROCESSOR_FORKS, sizeof(zbx_preprocessing_worker_t));
 	zbx_list_create(&manager->queue);
 	zbx_hashset_create_ext(&manager->item_config, 0, ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC,
@@ -972,6 +1155,7 @@ static void preprocessor_register_worker(zbx_preprocessing_manager_t *manager, z
 
 		worker = (zbx_preprocessing_worker_t *)&manager->workers[manager->worker_count++];
 		worker->client = client;
+		zbx_vector_ptr_create(&worker->queue_items);
 
 		preprocessor_assign_tasks(manager);
 	}
@@ -991,6 +1175,10 @@ static void preprocessor_register_worker(zbx_preprocessing_manager_t *manager, z
 static void	preprocessor_destroy_manager(zbx_preprocessing_manager_t *manager)
 {
 	zbx_preprocessing_request_t	*request;
+	int				i;
+
+	for (i = 0; i < manager->worker_count; i++)
+		zbx_vector_ptr_destroy(&manager->workers[i].queue_items);
 
 	zbx_free(manager->workers);
 
@@ -1009,12 +1197,15 @@ ZBX_THREAD_ENTRY(preprocessing_manager_thread, args)
 {
 	zbx_ipc_service_t	service_requests;
 	zbx_ipc_service_t	service_results;
-	char				*error = NULL;
+	char				*error = NULL, service[MAX_STRING_LEN];
 	zbx_ipc_client_t		*client;
 	zbx_ipc_message_t		*message;
 	zbx_preprocessing_manager_t	manager;
-	int				ret;
+	int				ret, armed = FAIL;
 	double				time_stat, time_idle = 0, time_now, time_flush, sec;
+	unsigned char			*ring_data;
+	zbx_uint32_t			ring_size;
+	zbx_uint64_t			ring_used, ring_total, ring_stalls;
 
 #define	STAT_INTERVAL	5	/* if a process is busy and does not sleep then update status not faster than */
 				/* once in STAT_INTERVAL seconds */
@@ -1028,21 +1219,30 @@ ZBX_THREAD_ENTRY(preprocessing_manager_thread, args)
 	zabbix_log(LOG_LEVEL_INFORMATION, "%s #%d started [%s #%d]", get_program_type_string(program_type),
 			server_num, get_process_type_string(process_type), process_num);
 
-	if (FAIL == zbx_ipc_service_start(&service_requests, ZBX_IPC_SERVICE_PREPROCESSING, &error))
+	preprocessor_init_manager(&manager);
+
+	zbx_preprocessor_get_service_name(ZBX_IPC_SERVICE_PREPROCESSING, manager.shard, service, sizeof(service));
+
+	if (FAIL == zbx_ipc_service_start(&service_requests, service, &error))
 	{
 		zabbix_log(LOG_LEVEL_CRIT, "cannot start preprocessing service for requests: %s", error);
 		zbx_free(error);
 		exit(EXIT_FAILURE);
 	}
 
-	if (FAIL == zbx_ipc_service_start(&service_results, ZBX_IPC_SERVICE_PREPROCESSING_WORKER, &error))
+	zbx_preprocessor_get_service_name(ZBX_IPC_SERVICE_PREPROCESSING_WORKER, manager.shard, service,
+			sizeof(service));
+
+	if (FAIL == zbx_ipc_service_start(&service_results, service, &error))
 	{
 		zabbix_log(LOG_LEVEL_CRIT, "cannot start preprocessing service: %s", error);
 		zbx_free(error);
 		exit(EXIT_FAILURE);
 	}
 
-	preprocessor_init_manager(&manager);
+	/* producers and workers ring the doorbell when the manager sleeps */
+	zbx_ipc_service_set_wakeup(&service_requests, zbx_preprocessor_ring_get_doorbell(manager.shard));
+	zbx_ipc_service_set_wakeup(&service_results, zbx_preprocessor_ring_get_doorbell(manager.shard));
 
 	/* initialize statistics */
 	time_stat = zbx_time();
@@ -1058,10 +1258,14 @@ ZBX_THREAD_ENTRY(preprocessing_manager_thread, args)
 
 		if (STAT_INTERVAL < time_now - time_stat)
 		{
+			zbx_preprocessor_ring_get_stats(manager.shard, &ring_used, &ring_total, &ring_stalls);
+
 			zbx_setproctitle("%s #%d [queued " ZBX_FS_UI64 ", processed " ZBX_FS_UI64 " values, idle "
-					ZBX_FS_DBL " sec during " ZBX_FS_DBL " sec]",
+					ZBX_FS_DBL " sec during " ZBX_FS_DBL " sec, ring " ZBX_FS_UI64 "/" ZBX_FS_UI64
+					" bytes, " ZBX_FS_UI64 " stalls]",
 					get_process_type_string(process_type), process_num,
-					manager.queued_num, manager.processed_num, time_idle, time_now - time_stat);
+					manager.queued_num, manager.processed_num, time_idle, time_now - time_stat,
+					ring_used, ring_total, ring_stalls);
 
 			time_stat = time_now;
 			time_idle = 0;
@@ -1070,19 +1274,56 @@ ZBX_THREAD_ENTRY(preprocessing_manager_thread, args)
 
 		update_selfmon_counter(ZBX_PROCESS_STATE_IDLE);
 
-		if (manager.queued_num > ZBX_PREPROCESSING_MAX_QUEUE_TRESHOLD )
+		ring_data = NULL;
+
+		/* results are read first to free workers and the queue */
+		ret = zbx_ipc_service_recv(&service_results, 0, &client, &message);
+
+		if (manager.queued_num > ZBX_PREPROCESSING_MAX_QUEUE_TRESHOLD)
 		{
-			ret = zbx_ipc_service_recv(&service_results,0, &client, &message);
+			/* stop reading requests, producers will wait for credit */
 			preprocessor_assign_tasks(&manager);
 			preprocessing_flush_queue(&manager);
-		 } else
+		}
+		else if (NULL == message)
 		{
-			ret = zbx_ipc_service_recv(&service_results, 0, &client, &message);
-			if (NULL == message)
+			if (NULL != (ring_data = zbx_preprocessor_ring_read(manager.shard, &ring_size)))
+				ret = ZBX_IPC_RECV_IMMEDIATE;
+			else
 				ret = zbx_ipc_service_recv(&service_requests, 0, &client, &message);
-			/* CPU burn prevention */
-			if (NULL == message)	
-					usleep(1000);			
+		}
+
+		if (NULL != message || NULL != ring_data)
+		{
+			if (SUCCEED == armed)
+			{
+				zbx_preprocessor_ring_disarm(manager.shard);
+				armed = FAIL;
+			}
+		}
+		else if (FAIL == armed)
+		{
+			/* announce sleep and check for work once more - the work passed before the */
+			/* announcement is found by the next check, after it the doorbell is rung   */
+			zbx_preprocessor_ring_arm(manager.shard);
+			armed = SUCCEED;
+		}
+		else
+		{
+			/* wait for results while values are being preprocessed, otherwise for requests */
+			if (0 != manager.preproc_num || manager.queued_num > ZBX_PREPROCESSING_MAX_QUEUE_TRESHOLD)
+			{
+				ret = zbx_ipc_service_recv(&service_results, ZBX_PREPROCESSING_MANAGER_DELAY, &client,
+						&message);
+			}
+			else
+			{
+				ret = zbx_ipc_service_recv(&service_requests, ZBX_PREPROCESSING_MANAGER_DELAY, &client,
+						&message);
+			}
+
+			zbx_preprocessor_ring_disarm(manager.shard);
+			armed = FAIL;
 		}
 
 		update_selfmon_counter(ZBX_PROCESS_STATE_BUSY);
@@ -1092,6 +1333,9 @@ ZBX_THREAD_ENTRY(preprocessing_manager_thread, args)
 		if (ZBX_IPC_RECV_IMMEDIATE != ret)
 			time_idle += sec - time_now;
 
+		if (NULL != ring_data)
+			preprocessor_add_ring_requests(&manager, ring_data, ring_size);
+
 		if (NULL != message)
 		{
 			switch (message->code)
@@ -0,0 +1,542 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2018 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "common.h"
+#include "log.h"
+
+#include "preproc_ring.h"
+
+/*
+ * Shared memory rings carrying packed item values from the processes that gather them
+ * (pollers, trappers, ...) to the preprocessing managers, one ring per manager.
+ *
+ * Producers reserve space by moving the head with compare-and-swap, copy the record and
+ * then publish it by setting the record state. The manager reads published records in
+ * order, zeroes the consumed bytes and moves the tail. The free space between the tail
+ * and the head is the credit of producers - when it is exhausted they wait until the
+ * manager releases space.
+ *
+ * The manager sleeps in IPC service loop when it has nothing to do, with the doorbell pipe
+ * registered as wakeup descriptor. A process that passes values rings the doorbell only
+ * if the manager announced that it is going to sleep, so in busy periods no system calls
+ * are made to pass the values.
+ */
+
+extern zbx_uint64_t	CONFIG_PREPROCESSING_RING_SIZE;
+extern int		CONFIG_PREPROCMAN_FORKS;
+
+#define ZBX_PREPROC_RING_CACHE_LINE	64
+
+#define ZBX_PREPROC_RING_RECORD_DATA	1
+#define ZBX_PREPROC_RING_RECORD_PAD	2
+
+/* records larger than this part of the ring are sent through IPC socket */
+#define ZBX_PREPROC_RING_RECORD_MAX(size)	((size) / 4)
+
+/* producers waiting for credit re-check the ring at least this often (microseconds) */
+#define ZBX_PREPROC_RING_CREDIT_WAIT	10000
+
+#define preproc_ring_barrier()			__sync_synchronize()
+#define preproc_ring_cas(ptr, old, new)		__sync_bool_compare_and_swap(ptr, old, new)
+#define preproc_ring_load(ptr)			__sync_add_and_fetch(ptr, 0)
+
+typedef struct
+{
+	volatile zbx_uint32_t	state;
+	zbx_uint32_t		data_size;
+}
+zbx_preproc_ring_record_t;
+
+typedef struct
+{
+	/* bytes reserved by producers */
+	volatile zbx_uint64_t	head;
+	char			pad1[ZBX_PREPROC_RING_CACHE_LINE - sizeof(zbx_uint64_t)];
+
+	/* bytes released by the manager */
+	volatile zbx_uint64_t	tail;
+
+	/* the position of the next record to read, records before it are not released yet */
+	zbx_uint64_t		read_pos;
+	char			pad2[ZBX_PREPROC_RING_CACHE_LINE - 2 * sizeof(zbx_uint64_t)];
+
+	/* the manager is going to sleep on the doorbell */
+	volatile int		manager_waiting;
+
+	/* producers waiting for credit */
+	volatile int		producers_waiting;
+
+	/* the number of times producers had to wait for credit */
+	volatile zbx_uint64_t	stalls;
+
+	/* the ring data size, power of two or 0 if the ring is disabled */
+	zbx_uint64_t		size;
+
+	/* the manager doorbell and producer credit notification pipes, inherited by forked processes */
+	int			doorbell[2];
+	int			credit[2];
+}
+zbx_preproc_ring_t;
+
+#define preproc_ring_data(ring)	((unsigned char *)((ring) + 1))
+
+/* the rings of preprocessing managers */
+static zbx_preproc_ring_t	**rings = NULL;
+
+/* producer: the end of the last record written by this process to each ring */
+static zbx_uint64_t		*rings_last_end;
+
+/******************************************************************************
+ *                                                                            *
+ * Function: preproc_ring_pipe                                                *
+ *                                                                            *
+ * Purpose: create non-blocking pipe                                          *
+ *                                                                            *
+ ******************************************************************************/
+static int	preproc_ring_pipe(int *fds, char **error)
+{
+	int	i;
+
+	if (-1 == pipe(fds))
+	{
+		*error = zbx_dsprintf(*error, "cannot create pipe: %s", zbx_strerror(errno));
+		return FAIL;
+	}
+
+	for (i = 0; i < 2; i++)
+	{
+		if (-1 == fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK))
+		{
+			*error = zbx_dsprintf(*error, "cannot set pipe to non-blocking mode: %s", zbx_strerror(errno));
+			return FAIL;
+		}
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_preprocessor_ring_init                                       *
+ *                                                                            *
+ * Purpose: allocate the rings of preprocessing managers in shared memory and *
+ *          create notification pipes                                         *
+ *                                                                            *
+ * Parameters: error - [OUT] the error message                                *
+ *                                                                            *
+ * Return value: SUCCEED - the rings were initialized                         *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ * Comments: must be called before forking the server processes               *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_preprocessor_ring_init(char **error)
+{
+	const char		*__function_name = "zbx_preprocessor_ring_init";
+
+	zbx_uint64_t		size = 0, shm_size;
+	int			shm_id, i, ret = FAIL;
+	unsigned char		*p;
+	zbx_preproc_ring_t	*ring;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() size:" ZBX_FS_UI64 " managers:%d", __function_name,
+			CONFIG_PREPROCESSING_RING_SIZE, CONFIG_PREPROCMAN_FORKS);
+
+	/* record positions are masked, so the size is rounded down to power of two */
+	if (0 != CONFIG_PREPROCESSING_RING_SIZE)
+	{
+		for (size = ZBX_KIBIBYTE; size * 2 <= CONFIG_PREPROCESSING_RING_SIZE; size *= 2)
+			;
+	}
+
+	shm_size = (sizeof(zbx_preproc_ring_t) + size) * CONFIG_PREPROCMAN_FORKS;
+
+	if (-1 == (shm_id = shmget(IPC_PRIVATE, shm_size, 0600)))
+	{
+		*error = zbx_dsprintf(*error, "cannot allocate shared memory of size " ZBX_FS_UI64
+				" for preprocessing ring: %s", shm_size, zbx_strerror(errno));
+		goto out;
+	}
+
+	if ((void *)(-1) == (p = (unsigned char *)shmat(shm_id, NULL, 0)))
+	{
+		*error = zbx_dsprintf(*error, "cannot attach shared memory for preprocessing ring: %s",
+				zbx_strerror(errno));
+		goto out;
+	}
+
+	if (-1 == shmctl(shm_id, IPC_RMID, NULL))
+		zbx_error("cannot mark shared memory %d for destruction: %s", shm_id, zbx_strerror(errno));
+
+	memset(p, 0, shm_size);
+
+	rings = (zbx_preproc_ring_t **)zbx_malloc(NULL, sizeof(zbx_preproc_ring_t *) * CONFIG_PREPROCMAN_FORKS);
+	rings_last_end = (zbx_uint64_t *)zbx_calloc(NULL, CONFIG_PREPROCMAN_FORKS, sizeof(zbx_uint64_t));
+
+	for (i = 0; i < CONFIG_PREPROCMAN_FORKS; i++)
+	{
+		ring = (zbx_preproc_ring_t *)(p + (sizeof(zbx_preproc_ring_t) + size) * i);
+		ring->size = size;
+
+		if (SUCCEED != preproc_ring_pipe(ring->doorbell, error) ||
+				SUCCEED != preproc_ring_pipe(ring->credit, error))
+		{
+			goto out;
+		}
+
+		rings[i] = ring;
+	}
+
+	ret = SUCCEED;
+out:
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s size:" ZBX_FS_UI64, __function_name, zbx_result_string(ret),
+			size);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: preproc_ring_wait_credit                                         *
+ *                                                                            *
+ * Purpose: wait until the manager releases ring space                        *
+ *                                                                            *
+ * Parameters: shard - [IN] the preprocessing manager shard                   *
+ *                                                                            *
+ * Comments: the wait is bounded, so a missed notification only delays the   *
+ *           producer                                                         *
+ *                                                                            *
+ ******************************************************************************/
+static void	preproc_ring_wait_credit(int shard)
+{
+	zbx_preproc_ring_t	*ring = rings[shard];
+	fd_set			fds;
+	struct timeval		tv = {0, ZBX_PREPROC_RING_CREDIT_WAIT};
+	char			byte;
+
+	__sync_add_and_fetch(&ring->producers_waiting, 1);
+
+	/* the manager must be awake to release space */
+	zbx_preprocessor_ring_notify(shard);
+
+	FD_ZERO(&fds);
+	FD_SET(ring->credit[0], &fds);
+
+	/* each waiting producer takes one byte of the credit notification */
+	if (0 < select(ring->credit[0] + 1, &fds, NULL, NULL, &tv) && -1 == read(ring->credit[0], &byte, 1) &&
+			EAGAIN != errno)
+	{
+		zabbix_log(LOG_LEVEL_DEBUG, "cannot read preprocessing ring credit: %s", zbx_strerror(errno));
+	}
+
+	__sync_sub_and_fetch(&ring->producers_waiting, 1);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: preproc_ring_reserve                                             *
+ *                                                                            *
+ * Purpose: reserve space for a record                                        *
+ *                                                                            *
+ * Parameters: ring - [IN] the ring                                           *
+ *             len  - [IN] the record length including header                 *
+ *             pos  - [OUT] the record position                               *
+ *                                                                            *
+ * Return value: SUCCEED - the space was reserved                             *
+ *               FAIL    - there is no credit left                            *
+ *                                                                            *
+ * Comments: records do not wrap around the ring end, the space up to the end *
+ *           is filled with padding record instead                            *
+ *                                                                            *
+ ******************************************************************************/
+static int	preproc_ring_reserve(zbx_preproc_ring_t *ring, zbx_uint64_t len, zbx_uint64_t *pos)
+{
+	zbx_uint64_t			head, tail, offset, pad;
+	zbx_preproc_ring_record_t	*record;
+
+	do
+	{
+		head = preproc_ring_load(&ring->head);
+		tail = preproc_ring_load(&ring->tail);
+		offset = head & (ring->size - 1);
+		pad = (offset + len > ring->size ? ring->size - offset : 0);
+
+		if (head + pad + len - tail > ring->size)
+			return FAIL;
+	}
+	while (!preproc_ring_cas(&ring->head, head, head + pad + len));
+
+	if (0 != pad)
+	{
+		record = (zbx_preproc_ring_record_t *)(preproc_ring_data(ring) + offset);
+		record->data_size = pad - sizeof(zbx_preproc_ring_record_t);
+		preproc_ring_barrier();
+		record->state = ZBX_PREPROC_RING_RECORD_PAD;
+	}
+
+	*pos = head + pad;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_preprocessor_ring_write                                      *
+ *                                                                            *
+ * Purpose: pass packed values to the preprocessing manager                   *
+ *                                                                            *
+ * Parameters: shard - [IN] the preprocessing manager shard                   *
+ *             data  - [IN] the packed values                                 *
+ *             size  - [IN] the data size                                     *
+ *                                                                            *
+ * Return value: SUCCEED - the data was written to the ring                   *
+ *               FAIL    - the data does not fit in the ring and must be sent *
+ *                         through IPC socket                                 *
+ *                                                                            *
+ * Comments: waits while the ring is full                                     *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_preprocessor_ring_write(int shard, const unsigned char *data, zbx_uint32_t size)
+{
+	zbx_preproc_ring_t		*ring;
+	zbx_uint64_t			len, pos;
+	zbx_preproc_ring_record_t	*record;
+
+	len = (sizeof(zbx_preproc_ring_record_t) + size + 7) & ~(zbx_uint64_t)7;
+
+	if (NULL == rings || len > ZBX_PREPROC_RING_RECORD_MAX((ring = rings[shard])->size))
+		return FAIL;
+
+	if (SUCCEED != preproc_ring_reserve(ring, len, &pos))
+	{
+		__sync_add_and_fetch(&ring->stalls, 1);
+
+		do
+			preproc_ring_wait_credit(shard);
+		while (SUCCEED != preproc_ring_reserve(ring, len, &pos));
+	}
+
+	record = (zbx_preproc_ring_record_t *)(preproc_ring_data(ring) + (pos & (ring->size - 1)));
+	record->data_size = size;
+	memcpy(record + 1, data, size);
+	preproc_ring_barrier();
+	record->state = ZBX_PREPROC_RING_RECORD_DATA;
+
+	rings_last_end[shard] = pos + len;
+
+	zbx_preprocessor_ring_notify(shard);
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_preprocessor_ring_sync                                       *
+ *                                                                            *
+ * Purpose: wait until the manager has read all records written by this       *
+ *          process                                                           *
+ *                                                                            *
+ * Parameters: shard - [IN] the preprocessing manager shard                   *
+ *                                                                            *
+ * Comments: used before sending values through IPC socket to keep the order  *
+ *           of item values                                                   *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_preprocessor_ring_sync(int shard)
+{
+	while (NULL != rings && preproc_ring_load(&rings[shard]->tail) < rings_last_end[shard])
+		preproc_ring_wait_credit(shard);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_preprocessor_ring_notify                                     *
+ *                                                                            *
+ * Purpose: wake up the preprocessing manager if it is going to sleep         *
+ *                                                                            *
+ * Parameters: shard - [IN] the preprocessing manager shard                   *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_preprocessor_ring_notify(int shard)
+{
+	zbx_preproc_ring_t	*ring;
+
+	if (NULL == rings)
+		return;
+
+	ring = rings[shard];
+
+	/* the work must be visible before checking the manager state */
+	preproc_ring_barrier();
+
+	if (0 != ring->manager_waiting && preproc_ring_cas(&ring->manager_waiting, 1, 0))
+	{
+		/* full pipe means the doorbell is already ringing */
+		if (-1 == write(ring->doorbell[1], "", 1) && EAGAIN != errno)
+			zabbix_log(LOG_LEVEL_DEBUG, "cannot wake up preprocessing manager: %s", zbx_strerror(errno));
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_preprocessor_ring_read                                       *
+ *                                                                            *
+ * Purpose: get the next record from the ring                                 *
+ *                                                                            *
+ * Parameters: shard - [IN] the preprocessing manager shard                   *
+ *             size  - [OUT] the record data size                             *
+ *                                                                            *
+ * Return value: the record data or NULL if there are no published records    *
+ *                                                                            *
+ * Comments: the data stays valid until zbx_preprocessor_ring_release() call  *
+ *                                                                            *
+ ******************************************************************************/
+unsigned char	*zbx_preprocessor_ring_read(int shard, zbx_uint32_t *size)
+{
+	zbx_preproc_ring_t		*ring = rings[shard];
+	zbx_preproc_ring_record_t	*record;
+	zbx_uint32_t			state;
+
+	if (0 == ring->size)
+		return NULL;
+
+	for (;;)
+	{
+		record = (zbx_preproc_ring_record_t *)(preproc_ring_data(ring) + (ring->read_pos & (ring->size - 1)));
+
+		/* reserved space is zeroed, the record is being written */
+		if (0 == (state = record->state))
+			return NULL;
+
+		preproc_ring_barrier();
+
+		ring->read_pos += (sizeof(zbx_preproc_ring_record_t) + record->data_size + 7) & ~(zbx_uint64_t)7;
+
+		if (ZBX_PREPROC_RING_RECORD_DATA == state)
+		{
+			*size = record->data_size;
+			return (unsigned char *)(record + 1);
+		}
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_preprocessor_ring_release                                    *
+ *                                                                            *
+ * Purpose: return the space of read records to producers                     *
+ *                                                                            *
+ * Parameters: shard - [IN] the preprocessing manager shard                   *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_preprocessor_ring_release(int shard)
+{
+	zbx_preproc_ring_t	*ring = rings[shard];
+	zbx_uint64_t		tail, offset, len, first;
+	int			waiting;
+	char			buf[64];
+
+	if ((tail = ring->tail) == ring->read_pos)
+		return;
+
+	/* zero the space, so stale bytes are not taken for record headers */
+	offset = tail & (ring->size - 1);
+	len = ring->read_pos - tail;
+	first = MIN(len, ring->size - offset);
+	memset(preproc_ring_data(ring) + offset, 0, first);
+	memset(preproc_ring_data(ring), 0, len - first);
+
+	preproc_ring_barrier();
+
+	/* the manager is the only writer of tail, swap is used for atomic 64-bit store */
+	(void)preproc_ring_cas(&ring->tail, tail, ring->read_pos);
+
+	if (0 < (waiting = ring->producers_waiting))
+	{
+		memset(buf, 0, sizeof(buf));
+
+		if (-1 == write(ring->credit[1], buf, MIN(waiting, (int)sizeof(buf))) && EAGAIN != errno)
+			zabbix_log(LOG_LEVEL_DEBUG, "cannot notify preprocessing producers: %s", zbx_strerror(errno));
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_preprocessor_ring_get_doorbell                               *
+ *                                                                            *
+ * Purpose: get the descriptor readable when the manager is woken up          *
+ *                                                                            *
+ * Parameters: shard - [IN] the preprocessing manager shard                   *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_preprocessor_ring_get_doorbell(int shard)
+{
+	return rings[shard]->doorbell[0];
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_preprocessor_ring_arm                                        *
+ *                                                                            *
+ * Purpose: announce that the manager is going to sleep                       *
+ *                                                                            *
+ * Parameters: shard - [IN] the preprocessing manager shard                   *
+ *                                                                            *
+ * Comments: the manager must check for work once more after arming and then  *
+ *           either disarm or wait for doorbell                               *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_preprocessor_ring_arm(int shard)
+{
+	rings[shard]->manager_waiting = 1;
+	preproc_ring_barrier();
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_preprocessor_ring_disarm                                     *
+ *                                                                            *
+ * Purpose: announce that the manager is awake                                *
+ *                                                                            *
+ * Parameters: shard - [IN] the preprocessing manager shard                   *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_preprocessor_ring_disarm(int shard)
+{
+	rings[shard]->manager_waiting = 0;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_preprocessor_ring_get_stats                                  *
+ *                                                                            *
+ * Parameters: shard  - [IN] the preprocessing manager shard                  *
+ *             used   - [OUT] the used ring space                             *
+ *             size   - [OUT] the ring size                                   *
+ *             stalls - [OUT] the number of times producers waited for credit *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_preprocessor_ring_get_stats(int shard, zbx_uint64_t *used, zbx_uint64_t *size, zbx_uint64_t *stalls)
+{
+	zbx_preproc_ring_t	*ring = rings[shard];
+
+	*used = preproc_ring_load(&ring->head) - ring->tail;
+	*size = ring->size;
+	*stalls = preproc_ring_load(&ring->stalls);
+}
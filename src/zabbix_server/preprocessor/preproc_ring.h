@@ -0,0 +1,40 @@
+/*
+** Zabbix
+** Copyright (C) 2001-2018 Zabbix SIA
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#ifndef ZABBIX_PREPROC_RING_H
+#define ZABBIX_PREPROC_RING_H
+
+#include "common.h"
+
+int	zbx_preprocessor_ring_init(char **error);
+
+/* producer side */
+int	zbx_preprocessor_ring_write(int shard, const unsigned char *data, zbx_uint32_t size);
+void	zbx_preprocessor_ring_sync(int shard);
+void	zbx_preprocessor_ring_notify(int shard);
+
+/* preprocessing manager side */
+unsigned char	*zbx_preprocessor_ring_read(int shard, zbx_uint32_t *size);
+void	zbx_preprocessor_ring_release(int shard);
+int	zbx_preprocessor_ring_get_doorbell(int shard);
+void	zbx_preprocessor_ring_arm(int shard);
+void	zbx_preprocessor_ring_disarm(int shard);
+void	zbx_preprocessor_ring_get_stats(int shard, zbx_uint64_t *used, zbx_uint64_t *size, zbx_uint64_t *stalls);
+
+#endif
@@ -24,13 +24,158 @@
 #include "zbxipcservice.h"
 #include "zbxserialize.h"
 #include "preprocessing.h"
+#include "preproc_ring.h"
 
 #include "sysinfo.h"
 #include "preproc_worker.h"
 #include "item_preproc.h"
 
 extern unsigned char	process_type, program_type;
-extern int		server_num, process_num;
+extern int		server_num, process_num, CONFIG_PREPROCMAN_FORKS;
+
+/* the period of unused compiled preprocessing step cleanup */
+#define ZBX_PREPROC_WORKER_CACHE_PURGE_PERIOD	SEC_PER_HOUR
+
+/* compiled item preprocessing steps */
+typedef struct
+{
+	zbx_uint64_t		itemid;
+	zbx_preproc_op_t	*steps;		/* the steps the compiled data was prepared for */
+	zbx_preproc_compiled_t	**compiled;	/* compiled step data, NULL for steps without it */
+	int			steps_num;
+	int			lastaccess;
+}
+zbx_preproc_worker_item_t;
+
+/* unpacked preprocessing task */
+typedef struct
+{
+	zbx_uint64_t			itemid;
+	unsigned char			value_type;
+	const zbx_timespec_t		*ts;		/* shared by the items of the same task */
+	zbx_variant_t			value;
+	zbx_item_history_value_t	*history_value;
+	zbx_preproc_op_t		*steps;
+	int				steps_num;
+	int				step;		/* the first step to execute */
+}
+zbx_preproc_worker_task_t;
+
+static void	worker_item_clear(zbx_preproc_worker_item_t *item)
+{
+	int	i;
+
+	for (i = 0; i < item->steps_num; i++)
+	{
+		zbx_free(item->steps[i].params);
+		zbx_item_preproc_compiled_free(item->compiled[i]);
+	}
+
+	zbx_free(item->steps);
+	zbx_free(item->compiled);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: worker_item_steps_compare                                        *
+ *                                                                            *
+ * Purpose: check if the cached item preprocessing steps match the task steps *
+ *                                                                            *
+ * Return value: SUCCEED - the steps match                                    *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ ******************************************************************************/
+static int	worker_item_steps_compare(const zbx_preproc_worker_item_t *item, const zbx_preproc_op_t *steps,
+		int steps_num)
+{
+	int	i;
+
+	if (item->steps_num != steps_num)
+		return FAIL;
+
+	for (i = 0; i < steps_num; i++)
+	{
+		if (item->steps[i].type != steps[i].type || 0 != strcmp(item->steps[i].params, steps[i].params))
+			return FAIL;
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: worker_get_compiled_steps                                        *
+ *                                                                            *
+ * Purpose: get compiled preprocessing steps of the item, compiling them if   *
+ *          the item is not cached yet or its steps have been changed         *
+ *                                                                            *
+ * Parameters: cache     - [IN] the compiled item step cache                  *
+ *             itemid    - [IN] the item identifier                           *
+ *             steps     - [IN] the item preprocessing steps                  *
+ *             steps_num - [IN] the number of preprocessing steps             *
+ *             now       - [IN] the current time                              *
+ *                                                                            *
+ * Return value: the compiled step data array                                 *
+ *                                                                            *
+ ******************************************************************************/
+static zbx_preproc_compiled_t	**worker_get_compiled_steps(zbx_hashset_t *cache, zbx_uint64_t itemid,
+		const zbx_preproc_op_t *steps, int steps_num, int now)
+{
+	zbx_preproc_worker_item_t	*item, item_local;
+	int				i;
+
+	if (NULL != (item = (zbx_preproc_worker_item_t *)zbx_hashset_search(cache, &itemid)))
+	{
+		if (SUCCEED == worker_item_steps_compare(item, steps, steps_num))
+		{
+			item->lastaccess = now;
+			return item->compiled;
+		}
+
+		/* item preprocessing configuration has been changed, compile the new steps */
+		worker_item_clear(item);
+	}
+	else
+	{
+		item_local.itemid = itemid;
+		item = (zbx_preproc_worker_item_t *)zbx_hashset_insert(cache, &item_local, sizeof(item_local));
+	}
+
+	item->steps = (zbx_preproc_op_t *)zbx_malloc(NULL, sizeof(zbx_preproc_op_t) * steps_num);
+	item->compiled = (zbx_preproc_compiled_t **)zbx_malloc(NULL, sizeof(zbx_preproc_compiled_t *) * steps_num);
+
+	for (i = 0; i < steps_num; i++)
+	{
+		item->steps[i].type = steps[i].type;
+		item->steps[i].params = zbx_strdup(NULL, steps[i].params);
+		item->compiled[i] = zbx_item_preproc_compile(&steps[i]);
+	}
+
+	item->steps_num = steps_num;
+	item->lastaccess = now;
+
+	return item->compiled;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: worker_purge_cache                                               *
+ *                                                                            *
+ * Purpose: remove compiled steps of items not preprocessed for a while       *
+ *                                                                            *
+ ******************************************************************************/
+static void	worker_purge_cache(zbx_hashset_t *cache, int now)
+{
+	zbx_hashset_iter_t		iter;
+	zbx_preproc_worker_item_t	*item;
+
+	zbx_hashset_iter_reset(cache, &iter);
+	while (NULL != (item = (zbx_preproc_worker_item_t *)zbx_hashset_iter_next(&iter)))
+	{
+		if (now - item->lastaccess >= ZBX_PREPROC_WORKER_CACHE_PURGE_PERIOD)
+			zbx_hashset_iter_remove(&iter);
+	}
+}
 
 /******************************************************************************
  *                                                                            *
@@ -38,44 +183,47 @@ extern int		server_num, process_num;
  *                                                                            *
  * Purpose: handle item value preprocessing task                              *
  *                                                                            *
- * Parameters: socket  - [IN] IPC socket                                      *
- *             message - [IN] packed preprocessing task                       *
+ * Parameters: cache - [IN] the compiled item step cache                      *
+ *             task  - [IN] unpacked task item, its data is freed             *
+ *             now   - [IN] the current time                                  *
+ *             data  - [OUT] packed preprocessing result                      *
+ *                                                                            *
+ * Return value: the packed preprocessing result size                         *
  *                                                                            *
  ******************************************************************************/
-static void worker_preprocess_value(zbx_ipc_socket_t *socket, zbx_ipc_message_t *message)
+static zbx_uint32_t	worker_preprocess_value(zbx_hashset_t *cache, zbx_preproc_worker_task_t *task, int now,
+		unsigned char **data)
 {
-	zbx_uint32_t			size = 0;
-	unsigned char			*data = NULL, value_type;
-	zbx_uint64_t			itemid;
-	zbx_variant_t			value, value_num;
-	int				i, steps_num;
+	zbx_uint32_t			size;
+	zbx_variant_t			value_num;
+	int				i;
 	char				*error = NULL;
-	zbx_timespec_t			*ts;
-	zbx_item_history_value_t	*history_value, history_value_local;
-	zbx_preproc_op_t		*steps;
+	zbx_item_history_value_t	*history_value = task->history_value, history_value_local;
+	zbx_preproc_compiled_t		**compiled;
 
-	zbx_preprocessor_unpack_task(&itemid, &value_type, &ts, &value, &history_value, &steps, &steps_num,
-			message->data);
+	compiled = worker_get_compiled_steps(cache, task->itemid, task->steps, task->steps_num, now);
 
-	for (i = 0; i < steps_num; i++)
+	for (i = task->step; i < task->steps_num; i++)
 	{
-		zbx_preproc_op_t	*op = &steps[i];
+		zbx_preproc_op_t	*op = &task->steps[i];
 
 		if ((ZBX_PREPROC_DELTA_VALUE == op->type || ZBX_PREPROC_DELTA_SPEED == op->type) &&
 				NULL == history_value)
 		{
-			if (FAIL != zbx_item_preproc_convert_value_to_numeric(&value_num, &value, value_type, &error))
+			if (FAIL != zbx_item_preproc_convert_value_to_numeric(&value_num, &task->value, task->value_type,
+					&error))
 			{
-				history_value_local.timestamp = *ts;
+				history_value_local.timestamp = *task->ts;
 				zbx_variant_set_variant(&history_value_local.value, &value_num);
 				history_value = &history_value_local;
 			}
 
-			zbx_variant_clear(&value);
+			zbx_variant_clear(&task->value);
 			break;
 		}
 
-		if (SUCCEED != zbx_item_preproc(value_type, &value, ts, op, history_value, &error))
+		if (SUCCEED != zbx_item_preproc(task->value_type, &task->value, task->ts, op, compiled[i], history_value,
+				&error))
 		{
 			char	*errmsg_full;
 
@@ -86,20 +234,195 @@ static void worker_preprocess_value(zbx_ipc_socket_t *socket, zbx_ipc_message_t
 			break;
 		}
 
-		if (ZBX_VARIANT_NONE == value.type)
+		if (ZBX_VARIANT_NONE == task->value.type)
 			break;
 	}
 
-	size = zbx_preprocessor_pack_result(&data, &value, history_value, error);
-	zbx_variant_clear(&value);
+	size = zbx_preprocessor_pack_result(data, &task->value, history_value, error);
+	zbx_variant_clear(&task->value);
 	zbx_free(error);
-	zbx_free(ts);
-	zbx_free(steps);
+	zbx_free(task->steps);
 
 	if (history_value != &history_value_local)
 		zbx_free(history_value);
 
-	if (FAIL == zbx_ipc_socket_write(socket, ZBX_IPC_PREPROCESSOR_RESULT, data, size))
+	return size;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: worker_prepare_jsonpath                                          *
+ *                                                                            *
+ * Purpose: execute the first jsonpath step of dependent items in one pass    *
+ *          over their master value                                           *
+ *                                                                            *
+ * Parameters: cache     - [IN] the compiled item step cache                  *
+ *             value     - [IN] the master value                              *
+ *             tasks     - [IN/OUT] the dependent items                       *
+ *             tasks_num - [IN] the number of dependent items                 *
+ *             now       - [IN] the current time                              *
+ *                                                                            *
+ * Comments: The items with successfully executed first step get its result   *
+ *           and continue from the second step. Failed queries are left to be *
+ *           executed normally to report their errors.                        *
+ *                                                                            *
+ ******************************************************************************/
+static void	worker_prepare_jsonpath(zbx_hashset_t *cache, const zbx_variant_t *value,
+		zbx_preproc_worker_task_t *tasks, int tasks_num, int now)
+{
+	int			i, queries_num = 0, *indexes, *ret;
+	zbx_preproc_compiled_t	**compiled, **steps;
+	zbx_variant_t		*results;
+
+	if (ZBX_VARIANT_STR != value->type)
+		return;
+
+	indexes = (int *)zbx_malloc(NULL, sizeof(int) * tasks_num * 2);
+	ret = indexes + tasks_num;
+	compiled = (zbx_preproc_compiled_t **)zbx_malloc(NULL, sizeof(zbx_preproc_compiled_t *) * tasks_num);
+
+	for (i = 0; i < tasks_num; i++)
+	{
+		if (0 == tasks[i].steps_num || ZBX_PREPROC_JSONPATH != tasks[i].steps[0].type)
+			continue;
+
+		steps = worker_get_compiled_steps(cache, tasks[i].itemid, tasks[i].steps, tasks[i].steps_num, now);
+
+		/* invalid json paths are executed separately to report errors */
+		if (NULL == steps[0])
+			continue;
+
+		indexes[queries_num] = i;
+		compiled[queries_num++] = steps[0];
+	}
+
+	if (2 <= queries_num)
+	{
+		results = (zbx_variant_t *)zbx_malloc(NULL, sizeof(zbx_variant_t) * queries_num);
+
+		zbx_item_preproc_jsonpath_multi(value, (const zbx_preproc_compiled_t * const *)compiled, queries_num,
+				results, ret);
+
+		for (i = 0; i < queries_num; i++)
+		{
+			if (SUCCEED != ret[i])
+				continue;
+
+			tasks[indexes[i]].value = results[i];
+			tasks[indexes[i]].step = 1;
+		}
+
+		zbx_free(results);
+	}
+
+	zbx_free(compiled);
+	zbx_free(indexes);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: worker_preprocess_values                                         *
+ *                                                                            *
+ * Purpose: handle item value preprocessing task batch                        *
+ *                                                                            *
+ * Parameters: socket  - [IN] IPC socket                                      *
+ *             message - [IN] packed preprocessing tasks, each prefixed with  *
+ *                            its size                                        *
+ *             cache   - [IN] the compiled item step cache                    *
+ *             now     - [IN] the current time                                *
+ *                                                                            *
+ * Comments: Results are sent back with a single message, one result per      *
+ *           task item in the same order as the items were received.          *
+ *                                                                            *
+ ******************************************************************************/
+static void	worker_preprocess_values(zbx_ipc_socket_t *socket, zbx_ipc_message_t *message, zbx_hashset_t *cache,
+		int now)
+{
+	const unsigned char		*ptr = message->data;
+	unsigned char			*result, *data = NULL;
+	zbx_uint32_t			task_size, size;
+	size_t				data_alloc = 0, data_offset = 0;
+	zbx_preproc_worker_task_t	*tasks = NULL, *task;
+	zbx_preproc_task_item_t		*items;
+	zbx_timespec_t			*ts;
+	zbx_variant_t			value;
+	int				i, last, items_num, tasks_alloc = 0;
+
+	while (ptr < message->data + message->size)
+	{
+		memcpy(&task_size, ptr, sizeof(zbx_uint32_t));
+		ptr += sizeof(zbx_uint32_t);
+
+		zbx_preprocessor_unpack_task(&ts, &value, &items, &items_num, ptr);
+		ptr += task_size;
+
+		if (tasks_alloc < items_num)
+		{
+			tasks_alloc = items_num;
+			tasks = (zbx_preproc_worker_task_t *)zbx_realloc(tasks,
+					sizeof(zbx_preproc_worker_task_t) * tasks_alloc);
+		}
+
+		for (i = 0; i < items_num; i++)
+		{
+			task = &tasks[i];
+			task->itemid = items[i].itemid;
+			task->value_type = items[i].value_type;
+			task->ts = ts;
+			task->history_value = items[i].history_value;
+			task->steps = items[i].steps;
+			task->steps_num = items[i].steps_num;
+			task->step = 0;
+			zbx_variant_set_none(&task->value);
+		}
+
+		if (1 < items_num)
+			worker_prepare_jsonpath(cache, &value, tasks, items_num, now);
+
+		/* the items not prepared get copies of the value, the last one takes the value itself */
+		for (i = 0, last = -1; i < items_num; i++)
+		{
+			if (ZBX_VARIANT_NONE != tasks[i].value.type)
+				continue;
+
+			if (-1 != last)
+				zbx_variant_set_variant(&tasks[last].value, &value);
+
+			last = i;
+		}
+
+		if (-1 != last)
+			tasks[last].value = value;
+		else
+			zbx_variant_clear(&value);
+
+		for (i = 0; i < items_num; i++)
+		{
+			result = NULL;
+			size = worker_preprocess_value(cache, &tasks[i], now, &result);
+
+			if (data_alloc < data_offset + sizeof(zbx_uint32_t) + size)
+			{
+				while (data_alloc < data_offset + sizeof(zbx_uint32_t) + size)
+					data_alloc += ZBX_KIBIBYTE * 16;
+
+				data = (unsigned char *)zbx_realloc(data, data_alloc);
+			}
+
+			memcpy(data + data_offset, &size, sizeof(zbx_uint32_t));
+			memcpy(data + data_offset + sizeof(zbx_uint32_t), result, size);
+			data_offset += sizeof(zbx_uint32_t) + size;
+
+			zbx_free(result);
+		}
+
+		zbx_free(items);
+		zbx_free(ts);
+	}
+
+	zbx_free(tasks);
+
+	if (FAIL == zbx_ipc_socket_write(socket, ZBX_IPC_PREPROCESSOR_RESULT, data, (zbx_uint32_t)data_offset))
 	{
 		zabbix_log(LOG_LEVEL_CRIT, "cannot send preprocessing result");
 		exit(EXIT_FAILURE);
@@ -111,9 +434,11 @@ static void worker_preprocess_value(zbx_ipc_socket_t *socket, zbx_ipc_message_t
 ZBX_THREAD_ENTRY(preprocessing_worker_thread, args)
 {
 	pid_t			ppid;
-	char			*error = NULL;
+	char			*error = NULL, service[MAX_STRING_LEN];
 	zbx_ipc_socket_t	socket;
 	zbx_ipc_message_t	message;
+	int			shard, now, purge_time;
+	zbx_hashset_t		cache;
 
 	process_type = ((zbx_thread_args_t *)args)->process_type;
 	server_num = ((zbx_thread_args_t *)args)->server_num;
@@ -122,8 +447,16 @@ ZBX_THREAD_ENTRY(preprocessing_worker_thread, args)
 	zbx_setproctitle("%s #%d starting", get_process_type_string(process_type), process_num);
 
 	zbx_ipc_message_init(&message);
+	zbx_hashset_create_ext(&cache, 100, ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC,
+			(zbx_clean_func_t)worker_item_clear, ZBX_DEFAULT_MEM_MALLOC_FUNC, ZBX_DEFAULT_MEM_REALLOC_FUNC,
+			ZBX_DEFAULT_MEM_FREE_FUNC);
+	purge_time = (int)time(NULL) + ZBX_PREPROC_WORKER_CACHE_PURGE_PERIOD;
 
-	if (FAIL == zbx_ipc_socket_open(&socket, ZBX_IPC_SERVICE_PREPROCESSING_WORKER, 10, &error))
+	/* workers are distributed evenly among preprocessing managers */
+	shard = (process_num - 1) % CONFIG_PREPROCMAN_FORKS;
+	zbx_preprocessor_get_service_name(ZBX_IPC_SERVICE_PREPROCESSING_WORKER, shard, service, sizeof(service));
+
+	if (FAIL == zbx_ipc_socket_open(&socket, service, 10, &error))
 	{
 		zabbix_log(LOG_LEVEL_CRIT, "cannot connect to preprocessing service: %s", error);
 		zbx_free(error);
@@ -132,6 +465,7 @@ ZBX_THREAD_ENTRY(preprocessing_worker_thread, args)
 
 	ppid = getppid();
 	zbx_ipc_socket_write(&socket, ZBX_IPC_PREPROCESSOR_WORKER, (unsigned char *)&ppid, sizeof(ppid));
+	zbx_preprocessor_ring_notify(shard);
 
 	zabbix_log(LOG_LEVEL_INFORMATION, "%s #%d started [%s #%d]", get_program_type_string(program_type),
 			server_num, get_process_type_string(process_type), process_num);
@@ -152,15 +486,22 @@ ZBX_THREAD_ENTRY(preprocessing_worker_thread, args)
 
 		update_selfmon_counter(ZBX_PROCESS_STATE_BUSY);
 		zbx_update_env(zbx_time());
+		now = (int)time(NULL);
 
 		switch (message.code)
 		{
 			case ZBX_IPC_PREPROCESSOR_REQUEST:
-				worker_preprocess_value(&socket, &message);
+				worker_preprocess_values(&socket, &message, &cache, now);
 				break;
 		}
 
 		zbx_ipc_message_clean(&message);
+
+		if (now >= purge_time)
+		{
+			worker_purge_cache(&cache, now);
+			purge_time = now + ZBX_PREPROC_WORKER_CACHE_PURGE_PERIOD;
+		}
 	}
 
 	return 0;
@@ -26,6 +26,7 @@
 
 #include "preproc.h"
 #include "preprocessing.h"
+#include "preproc_ring.h"
 
 #define PACKED_FIELD_RAW	0
 #define PACKED_FIELD_STRING	1
@@ -43,8 +44,18 @@ zbx_packed_field_t;
 #define PACKED_FIELD(value, size)	\
 		(zbx_packed_field_t){(value), (size), (0 == (size) ? PACKED_FIELD_STRING : PACKED_FIELD_RAW)};
 
-static zbx_ipc_message_t	cached_message	= (zbx_ipc_message_t){0, 0, NULL};
-static int			cached_values	= 0;
+/* the connection and the values cached for a preprocessing manager shard */
+typedef struct
+{
+	zbx_ipc_socket_t	socket;
+	zbx_ipc_message_t	cached_message;
+	int			cached_values;
+}
+zbx_preprocessor_shard_t;
+
+extern int	CONFIG_PREPROCMAN_FORKS;
+
+static zbx_preprocessor_shard_t	*shards = NULL;
 
 /******************************************************************************
  *                                                                            *
@@ -178,37 +189,39 @@ static zbx_uint32_t	preprocessor_pack_value(zbx_ipc_message_t *message, zbx_prep
  * Purpose: pack preprocessing task data into a single buffer that can be     *
  *          used in IPC                                                       *
  *                                                                            *
- * Parameters: data          - [OUT] memory buffer for packed data            *
- *             itemid        - [IN] item id                                   *
- *             value_type    - [IN] item value type                           *
- *             ts            - [IN] value timestamp                           *
- *             value         - [IN] item value                                *
- *             history_value - [IN] history data for delta preprocessing      *
- *             steps         - [IN] preprocessing steps                       *
- *             steps_num     - [IN] preprocessing step count                  *
+ * Parameters: data      - [OUT] memory buffer for packed data                *
+ *             ts        - [IN] value timestamp                               *
+ *             value     - [IN] item value                                    *
+ *             items     - [IN] the items to preprocess the value for         *
+ *             items_num - [IN] the number of items                           *
  *                                                                            *
  * Return value: size of packed data                                          *
  *                                                                            *
+ * Comments: The value is packed once for all items, the task has more than   *
+ *           one item only for dependent items of the same master value.      *
+ *                                                                            *
  ******************************************************************************/
-zbx_uint32_t	zbx_preprocessor_pack_task(unsigned char **data, zbx_uint64_t itemid, unsigned char value_type,
-		zbx_timespec_t *ts, zbx_variant_t *value, zbx_item_history_value_t *history_value,
-		const zbx_preproc_op_t *steps, int steps_num)
+zbx_uint32_t	zbx_preprocessor_pack_task(unsigned char **data, zbx_timespec_t *ts, zbx_variant_t *value,
+		const zbx_preproc_task_item_t *items, int items_num)
 {
-	zbx_packed_field_t	*offset, *fields;
-	unsigned char		ts_marker, history_marker;
-	zbx_uint32_t		size;
-	int			i;
-	zbx_ipc_message_t	message;
+	zbx_packed_field_t		*offset, *fields;
+	unsigned char			ts_marker, *history_markers;
+	zbx_uint32_t			size;
+	int				i, j, fields_num;
+	zbx_ipc_message_t		message;
+	const zbx_preproc_task_item_t	*item;
+	zbx_item_history_value_t	*history_value;
+
+	/* 6 is a max field count of the value and 9 - of an item (without preprocessing step fields) */
+	for (i = 0, fields_num = 6; i < items_num; i++)
+		fields_num += 9 + items[i].steps_num * 2;
 
-	/* 14 is a max field count (without preprocessing step fields) */
-	fields = (zbx_packed_field_t *)zbx_malloc(NULL, (14 + steps_num * 2) * sizeof(zbx_packed_field_t));
+	fields = (zbx_packed_field_t *)zbx_malloc(NULL, fields_num * sizeof(zbx_packed_field_t));
+	history_markers = (unsigned char *)zbx_malloc(NULL, items_num);
 
 	offset = fields;
 	ts_marker = (NULL != ts);
-	history_marker = (NULL != history_value);
 
-	*offset++ = PACKED_FIELD(&itemid, sizeof(zbx_uint64_t));
-	*offset++ = PACKED_FIELD(&value_type, sizeof(unsigned char));
 	*offset++ = PACKED_FIELD(&ts_marker, sizeof(unsigned char));
 
 	if (NULL != ts)
@@ -237,41 +250,54 @@ zbx_uint32_t	zbx_preprocessor_pack_task(unsigned char **data, zbx_uint64_t itemi
 			THIS_SHOULD_NEVER_HAPPEN;
 	}
 
-	*offset++ = PACKED_FIELD(&history_marker, sizeof(unsigned char));
-	if (NULL != history_value)
+	*offset++ = PACKED_FIELD(&items_num, sizeof(int));
+
+	for (i = 0; i < items_num; i++)
 	{
-		*offset++ = PACKED_FIELD(&history_value->value_type, sizeof(unsigned char));
-		*offset++ = PACKED_FIELD(&history_value->value.type, sizeof(unsigned char));
+		item = &items[i];
+		history_value = item->history_value;
+		history_markers[i] = (NULL != history_value);
 
-		switch (history_value->value.type)
+		*offset++ = PACKED_FIELD(&item->itemid, sizeof(zbx_uint64_t));
+		*offset++ = PACKED_FIELD(&item->value_type, sizeof(unsigned char));
+		*offset++ = PACKED_FIELD(&history_markers[i], sizeof(unsigned char));
+
+		if (NULL != history_value)
 		{
-			case ZBX_VARIANT_UI64:
-				*offset++ = PACKED_FIELD(&history_value->value.data.ui64, sizeof(zbx_uint64_t));
-				break;
+			*offset++ = PACKED_FIELD(&history_value->value_type, sizeof(unsigned char));
+			*offset++ = PACKED_FIELD(&history_value->value.type, sizeof(unsigned char));
 
-			case ZBX_VARIANT_DBL:
-				*offset++ = PACKED_FIELD(&history_value->value.data.dbl, sizeof(double));
-				break;
+			switch (history_value->value.type)
+			{
+				case ZBX_VARIANT_UI64:
+					*offset++ = PACKED_FIELD(&history_value->value.data.ui64, sizeof(zbx_uint64_t));
+					break;
 
-			default:
-				THIS_SHOULD_NEVER_HAPPEN;
-		}
+				case ZBX_VARIANT_DBL:
+					*offset++ = PACKED_FIELD(&history_value->value.data.dbl, sizeof(double));
+					break;
 
-		*offset++ = PACKED_FIELD(&history_value->timestamp.sec, sizeof(int));
-		*offset++ = PACKED_FIELD(&history_value->timestamp.ns, sizeof(int));
-	}
+				default:
+					THIS_SHOULD_NEVER_HAPPEN;
+			}
+
+			*offset++ = PACKED_FIELD(&history_value->timestamp.sec, sizeof(int));
+			*offset++ = PACKED_FIELD(&history_value->timestamp.ns, sizeof(int));
+		}
 
-	*offset++ = PACKED_FIELD(&steps_num, sizeof(int));
+		*offset++ = PACKED_FIELD(&item->steps_num, sizeof(int));
 
-	for (i = 0; i < steps_num; i++)
-	{
-		*offset++ = PACKED_FIELD(&steps[i].type, sizeof(char));
-		*offset++ = PACKED_FIELD(steps[i].params, 0);
+		for (j = 0; j < item->steps_num; j++)
+		{
+			*offset++ = PACKED_FIELD(&item->steps[j].type, sizeof(char));
+			*offset++ = PACKED_FIELD(item->steps[j].params, 0);
+		}
 	}
 
 	zbx_ipc_message_init(&message);
 	size = message_pack_data(&message, fields, offset - fields);
 	*data = message.data;
+	zbx_free(history_markers);
 	zbx_free(fields);
 
 	return size;
@@ -430,29 +456,24 @@ zbx_uint32_t	zbx_preprocessor_unpack_value(zbx_preproc_item_value_t *value, unsi
  *                                                                            *
  * Purpose: unpack preprocessing task data from IPC data buffer               *
  *                                                                            *
- * Parameters: itemid        - [OUT] itemid                                   *
- *             value_type    - [OUT] item value type                          *
- *             ts            - [OUT] value timestamp                          *
- *             value         - [OUT] item value                               *
- *             history_value - [OUT] history data for delta preprocessing     *
- *             steps         - [OUT] preprocessing steps                      *
- *             steps_num     - [OUT] preprocessing step count                 *
- *             data          - [IN] IPC data buffer                           *
+ * Parameters: ts        - [OUT] value timestamp                              *
+ *             value     - [OUT] item value                                   *
+ *             items     - [OUT] the items to preprocess the value for        *
+ *             items_num - [OUT] the number of items                          *
+ *             data      - [IN] IPC data buffer                               *
  *                                                                            *
  ******************************************************************************/
-void	zbx_preprocessor_unpack_task(zbx_uint64_t *itemid, unsigned char *value_type, zbx_timespec_t **ts,
-		zbx_variant_t *value, zbx_item_history_value_t **history_value, zbx_preproc_op_t **steps,
-		int *steps_num, const unsigned char *data)
+void	zbx_preprocessor_unpack_task(zbx_timespec_t **ts, zbx_variant_t *value, zbx_preproc_task_item_t **items,
+		int *items_num, const unsigned char *data)
 {
 	zbx_uint32_t			value_len;
 	const unsigned char		*offset = data;
 	unsigned char 			ts_marker, history_marker;
-	zbx_item_history_value_t	*hvalue = NULL;
+	zbx_item_history_value_t	*hvalue;
 	zbx_timespec_t			*timespec = NULL;
-	int				i;
+	zbx_preproc_task_item_t		*item;
+	int				i, j;
 
-	offset += zbx_deserialize_uint64(offset, itemid);
-	offset += zbx_deserialize_char(offset, value_type);
 	offset += zbx_deserialize_char(offset, &ts_marker);
 
 	if (0 != ts_marker)
@@ -484,45 +505,60 @@ void	zbx_preprocessor_unpack_task(zbx_uint64_t *itemid, unsigned char *value_typ
 			THIS_SHOULD_NEVER_HAPPEN;
 	}
 
-	offset += zbx_deserialize_char(offset, &history_marker);
-	if (0 != history_marker)
+	offset += zbx_deserialize_int(offset, items_num);
+	*items = (zbx_preproc_task_item_t *)zbx_malloc(NULL, sizeof(zbx_preproc_task_item_t) * (*items_num));
+
+	for (i = 0; i < *items_num; i++)
 	{
-		hvalue = (zbx_item_history_value_t *)zbx_malloc(NULL, sizeof(zbx_item_history_value_t));
+		item = &(*items)[i];
 
-		offset += zbx_deserialize_char(offset, &hvalue->value_type);
-		offset += zbx_deserialize_char(offset, &hvalue->value.type);
+		offset += zbx_deserialize_uint64(offset, &item->itemid);
+		offset += zbx_deserialize_char(offset, &item->value_type);
+		offset += zbx_deserialize_char(offset, &history_marker);
 
-		switch (hvalue->value.type)
+		hvalue = NULL;
+
+		if (0 != history_marker)
 		{
-			case ZBX_VARIANT_UI64:
-				offset += zbx_deserialize_uint64(offset, &hvalue->value.data.ui64);
-				break;
+			hvalue = (zbx_item_history_value_t *)zbx_malloc(NULL, sizeof(zbx_item_history_value_t));
 
-			case ZBX_VARIANT_DBL:
-				offset += zbx_deserialize_double(offset, &hvalue->value.data.dbl);
-				break;
+			offset += zbx_deserialize_char(offset, &hvalue->value_type);
+			offset += zbx_deserialize_char(offset, &hvalue->value.type);
 
-			default:
-				THIS_SHOULD_NEVER_HAPPEN;
+			switch (hvalue->value.type)
+			{
+				case ZBX_VARIANT_UI64:
+					offset += zbx_deserialize_uint64(offset, &hvalue->value.data.ui64);
+					break;
+
+				case ZBX_VARIANT_DBL:
+					offset += zbx_deserialize_double(offset, &hvalue->value.data.dbl);
+					break;
+
+				default:
+					THIS_SHOULD_NEVER_HAPPEN;
+			}
+
+			offset += zbx_deserialize_int(offset, &hvalue->timestamp.sec);
+			offset += zbx_deserialize_int(offset, &hvalue->timestamp.ns);
 		}
 
-		offset += zbx_deserialize_int(offset, &hvalue->timestamp.sec);
-		offset += zbx_deserialize_int(offset, &hvalue->timestamp.ns);
-	}
+		item->history_value = hvalue;
+		offset += zbx_deserialize_int(offset, &item->steps_num);
 
-	*history_value = hvalue;
-	offset += zbx_deserialize_int(offset, steps_num);
-	if (0 < *steps_num)
-	{
-		*steps = (zbx_preproc_op_t *)zbx_malloc(NULL, sizeof(zbx_preproc_op_t) * (*steps_num));
-		for (i = 0; i < *steps_num; i++)
+		if (0 < item->steps_num)
 		{
-			offset += zbx_deserialize_char(offset, &(*steps)[i].type);
-			offset += zbx_deserialize_str_ptr(offset, (*steps)[i].params, value_len);
+			item->steps = (zbx_preproc_op_t *)zbx_malloc(NULL, sizeof(zbx_preproc_op_t) * item->steps_num);
+
+			for (j = 0; j < item->steps_num; j++)
+			{
+				offset += zbx_deserialize_char(offset, &item->steps[j].type);
+				offset += zbx_deserialize_str_ptr(offset, item->steps[j].params, value_len);
+			}
 		}
+		else
+			item->steps = NULL;
 	}
-	else
-		*steps = NULL;
 }
 
 /******************************************************************************
@@ -592,46 +628,143 @@ void	zbx_preprocessor_unpack_result(zbx_variant_t *value, zbx_item_history_value
 	(void)zbx_deserialize_str(offset, error, value_len);
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_preprocessor_get_shard                                       *
+ *                                                                            *
+ * Purpose: get the preprocessing manager shard processing item values        *
+ *                                                                            *
+ * Parameters: itemid - [IN] the item id                                      *
+ *                                                                            *
+ * Return value: the shard index                                              *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_preprocessor_get_shard(zbx_uint64_t itemid)
+{
+	if (1 == CONFIG_PREPROCMAN_FORKS)
+		return 0;
+
+	return (int)(ZBX_DEFAULT_UINT64_HASH_FUNC(&itemid) % (zbx_hash_t)CONFIG_PREPROCMAN_FORKS);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_preprocessor_get_service_name                                *
+ *                                                                            *
+ * Purpose: get the IPC service name of preprocessing manager shard           *
+ *                                                                            *
+ * Parameters: service - [IN] the base service name                           *
+ *             shard   - [IN] the preprocessing manager shard                 *
+ *             name    - [OUT] the service name                               *
+ *             size    - [IN] the name buffer size                            *
+ *                                                                            *
+ * Comments: the first shard uses the base service name                       *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_preprocessor_get_service_name(const char *service, int shard, char *name, size_t size)
+{
+	if (0 == shard)
+		zbx_strlcpy(name, service, size);
+	else
+		zbx_snprintf(name, size, "%s_%d", service, shard + 1);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: preprocessor_get_shard                                           *
+ *                                                                            *
+ * Purpose: get the connection and value cache of preprocessing manager shard *
+ *                                                                            *
+ ******************************************************************************/
+static zbx_preprocessor_shard_t	*preprocessor_get_shard(int shard)
+{
+	if (NULL == shards)
+	{
+		shards = (zbx_preprocessor_shard_t *)zbx_calloc(NULL, CONFIG_PREPROCMAN_FORKS,
+				sizeof(zbx_preprocessor_shard_t));
+	}
+
+	return &shards[shard];
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: preprocessor_send                                                *
  *                                                                            *
  * Purpose: sends command to preprocessor manager                             *
  *                                                                            *
- * Parameters: code     - [IN] message code                                   *
+ * Parameters: shard    - [IN] the preprocessing manager shard                *
+ *             code     - [IN] message code                                   *
  *             data     - [IN] message data                                   *
  *             size     - [IN] message data size                              *
  *             response - [OUT] response message (can be NULL if response is  *
  *                              not requested)                                *
  *                                                                            *
  ******************************************************************************/
-static void	preprocessor_send(zbx_uint32_t code, unsigned char *data, zbx_uint32_t size,
+static void	preprocessor_send(int shard, zbx_uint32_t code, unsigned char *data, zbx_uint32_t size,
 		zbx_ipc_message_t *response)
 {
-	char			*error = NULL;
-	static zbx_ipc_socket_t	socket = {0};
+	char			*error = NULL, service[MAX_STRING_LEN];
+	zbx_ipc_socket_t	*socket = &preprocessor_get_shard(shard)->socket;
 
-	/* each process has a permanent connection to preprocessing manager */
-	if (0 == socket.fd && FAIL == zbx_ipc_socket_open(&socket, ZBX_IPC_SERVICE_PREPROCESSING, SEC_PER_MIN,
-			&error))
+	/* each process has a permanent connection to every preprocessing manager */
+	if (0 == socket->fd)
 	{
-		zabbix_log(LOG_LEVEL_CRIT, "cannot connect to preprocessing service: %s", error);
-		exit(EXIT_FAILURE);
+		zbx_preprocessor_get_service_name(ZBX_IPC_SERVICE_PREPROCESSING, shard, service, sizeof(service));
+
+		if (FAIL == zbx_ipc_socket_open(socket, service, SEC_PER_MIN, &error))
+		{
+			zabbix_log(LOG_LEVEL_CRIT, "cannot connect to preprocessing service: %s", error);
+			exit(EXIT_FAILURE);
+		}
 	}
 
-	if (FAIL == zbx_ipc_socket_write(&socket, code, data, size))
+	if (FAIL == zbx_ipc_socket_write(socket, code, data, size))
 	{
 		zabbix_log(LOG_LEVEL_CRIT, "cannot send data to preprocessing service");
 		exit(EXIT_FAILURE);
 	}
 
-	if (NULL != response && FAIL == zbx_ipc_socket_read(&socket, response))
+	zbx_preprocessor_ring_notify(shard);
+
+	if (NULL != response && FAIL == zbx_ipc_socket_read(socket, response))
 	{
 		zabbix_log(LOG_LEVEL_CRIT, "cannot receive data from preprocessing service");
 		exit(EXIT_FAILURE);
 	}
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: preprocessor_flush_shard                                         *
+ *                                                                            *
+ * Purpose: send the values cached for preprocessing manager shard            *
+ *                                                                            *
+ * Parameters: shard - [IN] the preprocessing manager shard                   *
+ *                                                                            *
+ * Comments: values are passed through the shared memory ring when they fit   *
+ *           in it, otherwise through IPC socket after the manager has read   *
+ *           the values written to the ring earlier                           *
+ *                                                                            *
+ ******************************************************************************/
+static void	preprocessor_flush_shard(int shard)
+{
+	zbx_ipc_message_t	*message = &shards[shard].cached_message;
+
+	if (0 == message->size)
+		return;
+
+	if (SUCCEED != zbx_preprocessor_ring_write(shard, message->data, message->size))
+	{
+		zbx_preprocessor_ring_sync(shard);
+		preprocessor_send(shard, ZBX_IPC_PREPROCESSOR_REQUEST, message->data, message->size, NULL);
+	}
+
+	zbx_ipc_message_clean(message);
+	zbx_ipc_message_init(message);
+	shards[shard].cached_values = 0;
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: zbx_preprocess_item_value                                        *
@@ -654,6 +787,7 @@ void	zbx_preprocess_item_value(zbx_uint64_t itemid, unsigned char item_value_typ
 {
 	const char			*__function_name = "zbx_preprocess_item_value";
 	zbx_preproc_item_value_t	value;
+	zbx_preprocessor_shard_t	*shard;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
@@ -672,11 +806,14 @@ void	zbx_preprocess_item_value(zbx_uint64_t itemid, unsigned char item_value_typ
 	value.state = state;
 	value.ts = ts;
 
-	preprocessor_pack_value(&cached_message, &value);
-	cached_values++;
+	/* values of an item always go to the same manager, keeping their order and delta state */
+	shard = preprocessor_get_shard(zbx_preprocessor_get_shard(itemid));
 
-	if (MAX_VALUES_LOCAL < cached_values)
-		zbx_preprocessor_flush();
+	preprocessor_pack_value(&shard->cached_message, &value);
+	shard->cached_values++;
+
+	if (MAX_VALUES_LOCAL < shard->cached_values)
+		preprocessor_flush_shard(shard - shards);
 out:
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
@@ -685,39 +822,44 @@ out:
  *                                                                            *
  * Function: zbx_preprocessor_flush                                           *
  *                                                                            *
- * Purpose: send flush command to preprocessing manager                       *
+ * Purpose: send flush command to preprocessing managers                      *
  *                                                                            *
  ******************************************************************************/
 void	zbx_preprocessor_flush(void)
 {
-	if (0 < cached_message.size)
-	{
-		preprocessor_send(ZBX_IPC_PREPROCESSOR_REQUEST, cached_message.data, cached_message.size, NULL);
+	int	i;
 
-		zbx_ipc_message_clean(&cached_message);
-		zbx_ipc_message_init(&cached_message);
-		cached_values = 0;
-	}
+	if (NULL == shards)
+		return;
+
+	for (i = 0; i < CONFIG_PREPROCMAN_FORKS; i++)
+		preprocessor_flush_shard(i);
 }
 
 /******************************************************************************
  *                                                                            *
  * Function: zbx_preprocessor_get_queue_size                                  *
  *                                                                            *
- * Purpose: get queue size (enqueued value count) of preprocessing manager    *
+ * Purpose: get queue size (enqueued value count) of preprocessing managers   *
  *                                                                            *
  * Return value: enqueued item count                                          *
  *                                                                            *
  ******************************************************************************/
 zbx_uint64_t	zbx_preprocessor_get_queue_size(void)
 {
-	zbx_uint64_t		size;
+	zbx_uint64_t		size, total = 0;
 	zbx_ipc_message_t	message;
+	int			i;
 
-	zbx_ipc_message_init(&message);
-	preprocessor_send(ZBX_IPC_PREPROCESSOR_QUEUE, NULL, 0, &message);
-	memcpy(&size, message.data, sizeof(zbx_uint64_t));
-	zbx_ipc_message_clean(&message);
+	for (i = 0; i < CONFIG_PREPROCMAN_FORKS; i++)
+	{
+		zbx_ipc_message_init(&message);
+		preprocessor_send(i, ZBX_IPC_PREPROCESSOR_QUEUE, NULL, 0, &message);
+		memcpy(&size, message.data, sizeof(zbx_uint64_t));
+		zbx_ipc_message_clean(&message);
 
-	return size;
+		total += size;
+	}
+
+	return total;
 }
@@ -45,16 +45,28 @@ typedef struct
 }
 zbx_preproc_item_value_t;
 
-zbx_uint32_t	zbx_preprocessor_pack_task(unsigned char **data, zbx_uint64_t itemid, unsigned char value_type,
-		zbx_timespec_t *ts, zbx_variant_t *value, zbx_item_history_value_t *history_value,
-		const zbx_preproc_op_t *steps, int steps_num);
+/* item of preprocessing task, the dependent items of the same master value are sent in one task */
+typedef struct
+{
+	zbx_uint64_t			itemid;		/* item id */
+	unsigned char			value_type;	/* item value type */
+	zbx_item_history_value_t	*history_value;	/* history data for delta preprocessing */
+	zbx_preproc_op_t		*steps;		/* preprocessing steps */
+	int				steps_num;	/* preprocessing step count */
+}
+zbx_preproc_task_item_t;
+
+int	zbx_preprocessor_get_shard(zbx_uint64_t itemid);
+void	zbx_preprocessor_get_service_name(const char *service, int shard, char *name, size_t size);
+
+zbx_uint32_t	zbx_preprocessor_pack_task(unsigned char **data, zbx_timespec_t *ts, zbx_variant_t *value,
+		const zbx_preproc_task_item_t *items, int items_num);
 zbx_uint32_t	zbx_preprocessor_pack_result(unsigned char **data, zbx_variant_t *value,
 		zbx_item_history_value_t *history_value, char *error);
 
 zbx_uint32_t	zbx_preprocessor_unpack_value(zbx_preproc_item_value_t *value, unsigned char *data);
-void	zbx_preprocessor_unpack_task(zbx_uint64_t *itemid, unsigned char *value_type, zbx_timespec_t **ts,
-		zbx_variant_t *value, zbx_item_history_value_t **history_value, zbx_preproc_op_t **steps,
-		int *steps_num, const unsigned char *data);
+void	zbx_preprocessor_unpack_task(zbx_timespec_t **ts, zbx_variant_t *value, zbx_preproc_task_item_t **items,
+		int *items_num, const unsigned char *data);
 void	zbx_preprocessor_unpack_result(zbx_variant_t *value, zbx_item_history_value_t **history_value,
 		char **error, const unsigned char *data);
 
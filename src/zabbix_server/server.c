@@ -44,12 +44,14 @@
 #include "alerter/alerter.h"
 #include "alerter/alert_manager.h"
 #include "dbsyncer/dbsyncer.h"
+#include "dbsyncer/histwriter.h"
 #include "dbconfig/dbconfig.h"
 #include "discoverer/discoverer.h"
 #include "httppoller/httppoller.h"
 #include "housekeeper/housekeeper.h"
 #include "pinger/pinger.h"
 #include "poller/poller.h"
+#include "poller/avail_manager.h"
 #include "timer/timer.h"
 #include "trapper/trapper.h"
 #include "snmptrapper/snmptrapper.h"
@@ -60,6 +62,7 @@
 #include "taskmanager/taskmanager.h"
 #include "preprocessor/preproc_manager.h"
 #include "preprocessor/preproc_worker.h"
+#include "preprocessor/preproc_ring.h"
 #include "events.h"
 #include "../libs/zbxdbcache/valuecache.h"
 #include "setproctitle.h"
@@ -188,9 +191,12 @@ char	*CONFIG_SERVER			= NULL;		/* not used in zabbix_server, required for linkin
 int	CONFIG_HOUSEKEEPING_FREQUENCY	= 1;
 int	CONFIG_MAX_HOUSEKEEPER_DELETE	= 5000;		/* applies for every separate field value */
 int	CONFIG_HISTSYNCER_FORKS		= 4;
+int	CONFIG_HISTWRITER_FORKS		= 0;
+int	CONFIG_AVAILMAN_FORKS		= 1;
 int	CONFIG_HISTSYNCER_FREQUENCY	= 1;
 int	CONFIG_CONFSYNCER_FORKS		= 1;
 int	CONFIG_CONFSYNCER_FREQUENCY	= 60;
+int	CONFIG_CONFLOADER_FORKS		= 0;
 
 int	CONFIG_VMWARE_FORKS		= 0;
 int	CONFIG_VMWARE_FREQUENCY		= 60;
@@ -198,12 +204,17 @@ int	CONFIG_VMWARE_PERF_FREQUENCY	= 60;
 int	CONFIG_VMWARE_TIMEOUT		= 10;
 
 zbx_uint64_t	CONFIG_CONF_CACHE_SIZE		= 8 * ZBX_MEBIBYTE;
+char		*CONFIG_CONFCACHE_SNAPSHOT_FILE		= NULL;
+int		CONFIG_CONFCACHE_SNAPSHOT_FREQUENCY	= SEC_PER_HOUR;
 zbx_uint64_t	CONFIG_HISTORY_CACHE_SIZE	= 16 * ZBX_MEBIBYTE;
 zbx_uint64_t	CONFIG_HISTORY_INDEX_CACHE_SIZE	= 4 * ZBX_MEBIBYTE;
 zbx_uint64_t	CONFIG_TRENDS_CACHE_SIZE	= 4 * ZBX_MEBIBYTE;
 zbx_uint64_t	CONFIG_VALUE_CACHE_SIZE		= 8 * ZBX_MEBIBYTE;
+char		*CONFIG_VALUE_CACHE_SNAPSHOT_FILE	= NULL;
+int		CONFIG_VALUE_CACHE_SNAPSHOT_FREQUENCY	= SEC_PER_HOUR;
 zbx_uint64_t	CONFIG_VMWARE_CACHE_SIZE	= 8 * ZBX_MEBIBYTE;
 zbx_uint64_t	CONFIG_EXPORT_FILE_SIZE		= ZBX_GIBIBYTE;
+zbx_uint64_t	CONFIG_PREPROCESSING_RING_SIZE	= 16 * ZBX_MEBIBYTE;
 
 int	CONFIG_UNREACHABLE_PERIOD	= 45;
 int	CONFIG_UNREACHABLE_DELAY	= 15;
@@ -216,8 +227,11 @@ char	*CONFIG_FPING_LOCATION		= NULL;
 char	*CONFIG_FPING6_LOCATION		= NULL;
 char	*CONFIG_NMAP_LOCATION		= NULL;
 char	*CONFIG_NMAP_PARAMS		= NULL;
+int	CONFIG_ICMP_PING_ENGINE		= 1;
+int	CONFIG_ICMP_PING_RATE		= 1000;
 char	*CONFIG_HISTORY_STORAGE_TYPE	= NULL;
 char	*CONFIG_HISTORY_STORAGE_TABLE_NAME = NULL;
+char	*CONFIG_HISTORY_STORAGE_FORMAT	= NULL;
 
 char	*CONFIG_DBHOST			= NULL;
 char	*CONFIG_DBNAME			= NULL;
@@ -282,6 +296,9 @@ static char	*CONFIG_SOCKET_PATH	= NULL;
 char	*CONFIG_HISTORY_STORAGE_URL		= NULL;
 char	*CONFIG_HISTORY_STORAGE_OPTS		= NULL;
 int	CONFIG_HISTORY_STORAGE_PIPELINES	= 0;
+char	*CONFIG_HISTORY_STORAGE_SPOOL_DIR	= NULL;
+int	CONFIG_HISTORY_STORAGE_COMPRESS	= 1;
+zbx_uint64_t	CONFIG_HISTORY_STORAGE_SPOOL_SIZE	= ZBX_GIBIBYTE;
 
 int	get_process_info_by_thread(int local_server_num, unsigned char *local_process_type, int *local_process_num);
 
@@ -329,6 +346,16 @@ int	get_process_info_by_thread(int local_server_num, unsigned char *local_proces
 		*local_process_type = ZBX_PROCESS_TYPE_DISCOVERER;
 		*local_process_num = local_server_num - server_count + CONFIG_DISCOVERER_FORKS;
 	}
+	else if (local_server_num <= (server_count += CONFIG_HISTWRITER_FORKS))
+	{
+		*local_process_type = ZBX_PROCESS_TYPE_HISTWRITER;
+		*local_process_num = local_server_num - server_count + CONFIG_HISTWRITER_FORKS;
+	}
+	else if (local_server_num <= (server_count += CONFIG_AVAILMAN_FORKS))
+	{
+		*local_process_type = ZBX_PROCESS_TYPE_AVAILMAN;
+		*local_process_num = local_server_num - server_count + CONFIG_AVAILMAN_FORKS;
+	}
 	else if (local_server_num <= (server_count += CONFIG_HISTSYNCER_FORKS))
 	{
 		*local_process_type = ZBX_PROCESS_TYPE_HISTSYNCER;
@@ -474,6 +501,9 @@ static void	zbx_set_defaults(void)
 	if (NULL == CONFIG_HISTORY_STORAGE_TABLE_NAME)
 		CONFIG_HISTORY_STORAGE_TABLE_NAME = zbx_strdup(CONFIG_HISTORY_STORAGE_TABLE_NAME, "zabbix.history");
 
+	if (NULL == CONFIG_HISTORY_STORAGE_FORMAT)
+		CONFIG_HISTORY_STORAGE_FORMAT = zbx_strdup(CONFIG_HISTORY_STORAGE_FORMAT, "values");
+
 	if (NULL == CONFIG_EXTERNALSCRIPTS)
 		CONFIG_EXTERNALSCRIPTS = zbx_strdup(CONFIG_EXTERNALSCRIPTS, DEFAULT_EXTERNAL_SCRIPTS_PATH);
 #ifdef HAVE_LIBCURL
@@ -485,6 +515,10 @@ static void	zbx_set_defaults(void)
 
 	if (NULL == CONFIG_HISTORY_STORAGE_OPTS)
 		CONFIG_HISTORY_STORAGE_OPTS = zbx_strdup(CONFIG_HISTORY_STORAGE_OPTS, "uint,dbl,str,log,text");
+
+	/* clickhouse history is posted by a dedicated writer, so the syncers never wait for the network */
+	if (NULL != CONFIG_HISTORY_STORAGE_URL && NULL != strstr(CONFIG_HISTORY_STORAGE_TYPE, "clickhouse"))
+		CONFIG_HISTWRITER_FORKS = 1;
 #endif
 
 #ifdef HAVE_SQLITE3
@@ -527,6 +561,13 @@ static void	zbx_validate_config(ZBX_TASK_EX *task)
 		err = 1;
 	}
 
+	if (CONFIG_PREPROCESSOR_FORKS < CONFIG_PREPROCMAN_FORKS)
+	{
+		zabbix_log(LOG_LEVEL_CRIT, "\"StartPreprocessors\" configuration parameter must not be less than"
+				" \"StartPreprocessingManagers\"");
+		err = 1;
+	}
+
 	if (0 != CONFIG_VALUE_CACHE_SIZE && 128 * ZBX_KIBIBYTE > CONFIG_VALUE_CACHE_SIZE)
 	{
 		zabbix_log(LOG_LEVEL_CRIT, "\"ValueCacheSize\" configuration parameter must be either 0"
@@ -550,6 +591,8 @@ static void	zbx_validate_config(ZBX_TASK_EX *task)
 	err |= (FAIL == check_cfg_feature_str("HistoryStorageTypes", CONFIG_HISTORY_STORAGE_OPTS, "cURL library"));
 	err |= (FAIL == check_cfg_feature_int("HistoryStorageDateIndex", CONFIG_HISTORY_STORAGE_PIPELINES,
 			"cURL library"));
+	err |= (FAIL == check_cfg_feature_str("HistoryStorageSpoolDir", CONFIG_HISTORY_STORAGE_SPOOL_DIR,
+			"cURL library"));
 #endif
 
 #if !defined(HAVE_LIBXML2) || !defined(HAVE_LIBCURL)
@@ -641,8 +684,20 @@ static void	zbx_load_config(ZBX_TASK_EX *task)
 			PARM_OPT,	128 * ZBX_KIBIBYTE,	__UINT64_C(2) * ZBX_GIBIBYTE},
 		{"ValueCacheSize",		&CONFIG_VALUE_CACHE_SIZE,		TYPE_UINT64,
 			PARM_OPT,	0,			__UINT64_C(64) * ZBX_GIBIBYTE},
+		{"ConfigCacheSnapshotFile",	&CONFIG_CONFCACHE_SNAPSHOT_FILE,	TYPE_STRING,
+			PARM_OPT,	0,			0},
+		{"ConfigCacheSnapshotFrequency",	&CONFIG_CONFCACHE_SNAPSHOT_FREQUENCY,	TYPE_INT,
+			PARM_OPT,	SEC_PER_MIN,		SEC_PER_DAY},
+		{"ValueCacheSnapshotFile",	&CONFIG_VALUE_CACHE_SNAPSHOT_FILE,	TYPE_STRING,
+			PARM_OPT,	0,			0},
+		{"ValueCacheSnapshotFrequency",	&CONFIG_VALUE_CACHE_SNAPSHOT_FREQUENCY,	TYPE_INT,
+			PARM_OPT,	0,			SEC_PER_DAY},
+		{"PreprocessingRingSize",	&CONFIG_PREPROCESSING_RING_SIZE,	TYPE_UINT64,
+			PARM_OPT,	0,			__UINT64_C(2) * ZBX_GIBIBYTE},
 		{"CacheUpdateFrequency",	&CONFIG_CONFSYNCER_FREQUENCY,		TYPE_INT,
 			PARM_OPT,	1,			SEC_PER_HOUR},
+		{"StartConfigLoaders",		&CONFIG_CONFLOADER_FORKS,		TYPE_INT,
+			PARM_OPT,	0,			64},
 		{"HousekeepingFrequency",	&CONFIG_HOUSEKEEPING_FREQUENCY,		TYPE_INT,
 			PARM_OPT,	0,			24},
 		{"MaxHousekeeperDelete",	&CONFIG_MAX_HOUSEKEEPER_DELETE,		TYPE_INT,
@@ -657,6 +712,10 @@ static void	zbx_load_config(ZBX_TASK_EX *task)
 			PARM_OPT,	0,			0},
 		{"Fping6Location",		&CONFIG_FPING6_LOCATION,		TYPE_STRING,
 			PARM_OPT,	0,			0},
+		{"IcmpPingEngine",		&CONFIG_ICMP_PING_ENGINE,		TYPE_INT,
+			PARM_OPT,	0,			1},
+		{"IcmpPingRate",		&CONFIG_ICMP_PING_RATE,			TYPE_INT,
+			PARM_OPT,	1,			1000000},
 		{"Timeout",			&CONFIG_TIMEOUT,			TYPE_INT,
 			PARM_OPT,	1,			30},
 		{"TrapperTimeout",		&CONFIG_TRAPPER_TIMEOUT,		TYPE_INT,
@@ -749,6 +808,8 @@ static void	zbx_load_config(ZBX_TASK_EX *task)
 			PARM_OPT,	1,			100},
 		{"StartPreprocessors",		&CONFIG_PREPROCESSOR_FORKS,		TYPE_INT,
 			PARM_OPT,	1,			1000},
+		{"StartPreprocessingManagers",	&CONFIG_PREPROCMAN_FORKS,		TYPE_INT,
+			PARM_OPT,	1,			64},
 		{"HistoryStorageURL",		&CONFIG_HISTORY_STORAGE_URL,		TYPE_STRING,
 			PARM_OPT,	0,			0},
 		{"HistoryStorageTypes",		&CONFIG_HISTORY_STORAGE_OPTS,		TYPE_STRING_LIST,
@@ -763,6 +824,14 @@ static void	zbx_load_config(ZBX_TASK_EX *task)
 			PARM_OPT,	1,			0},
 		{"HistoryStorageTableName",		&CONFIG_HISTORY_STORAGE_TABLE_NAME,		TYPE_STRING,
 			PARM_OPT,	1,			0},
+		{"HistoryStorageFormat",	&CONFIG_HISTORY_STORAGE_FORMAT,		TYPE_STRING,
+			PARM_OPT,	0,			0},
+		{"HistoryStorageSpoolDir",	&CONFIG_HISTORY_STORAGE_SPOOL_DIR,	TYPE_STRING,
+			PARM_OPT,	0,			0},
+		{"HistoryStorageCompress",	&CONFIG_HISTORY_STORAGE_COMPRESS,	TYPE_INT,
+			PARM_OPT,	0,			1},
+		{"HistoryStorageSpoolSize",	&CONFIG_HISTORY_STORAGE_SPOOL_SIZE,	TYPE_UINT64,
+			PARM_OPT,	ZBX_MEBIBYTE,	__UINT64_C(1024) * ZBX_GIBIBYTE},
 		{NULL}
 	};
 
@@ -1031,6 +1100,13 @@ int	MAIN_ZABBIX_ENTRY(int flags)
 		exit(EXIT_FAILURE);
 	}
 
+	if (SUCCEED != zbx_preprocessor_ring_init(&error))
+	{
+		zabbix_log(LOG_LEVEL_CRIT, "cannot initialize preprocessing ring: %s", error);
+		zbx_free(error);
+		exit(EXIT_FAILURE);
+	}
+
 	if (0 != CONFIG_VMWARE_FORKS && SUCCEED != zbx_vmware_init(&error))
 	{
 		zabbix_log(LOG_LEVEL_CRIT, "cannot initialize VMware cache: %s", error);
@@ -1097,6 +1173,10 @@ int	MAIN_ZABBIX_ENTRY(int flags)
 	/* update maintenance states */
 	zbx_dc_update_maintenances();
 
+	/* restore value cache contents saved before the last shutdown */
+	if (NULL != CONFIG_VALUE_CACHE_SNAPSHOT_FILE)
+		zbx_vc_snapshot_load(CONFIG_VALUE_CACHE_SNAPSHOT_FILE);
+
 	DBclose();
 
 	zbx_vc_enable();
@@ -1105,7 +1185,8 @@ int	MAIN_ZABBIX_ENTRY(int flags)
 			+ CONFIG_UNREACHABLE_POLLER_FORKS + CONFIG_ASYNC_SNMP_POLLER_FORKS 
 			+ CONFIG_ASYNC_AGENT_POLLER_FORKS + CONFIG_TRAPPER_FORKS + CONFIG_PINGER_FORKS
 			+ CONFIG_ALERTER_FORKS + CONFIG_HOUSEKEEPER_FORKS + CONFIG_TIMER_FORKS
-			+ CONFIG_HTTPPOLLER_FORKS + CONFIG_DISCOVERER_FORKS + CONFIG_HISTSYNCER_FORKS
+			+ CONFIG_HTTPPOLLER_FORKS + CONFIG_DISCOVERER_FORKS + CONFIG_HISTWRITER_FORKS
+			+ CONFIG_AVAILMAN_FORKS + CONFIG_HISTSYNCER_FORKS
 			+ CONFIG_ESCALATOR_FORKS + CONFIG_IPMIPOLLER_FORKS + CONFIG_JAVAPOLLER_FORKS
 			+ CONFIG_SNMPTRAPPER_FORKS + CONFIG_PROXYPOLLER_FORKS + CONFIG_SELFMON_FORKS
 			+ CONFIG_VMWARE_FORKS + CONFIG_TASKMANAGER_FORKS + CONFIG_IPMIMANAGER_FORKS
@@ -1187,6 +1268,12 @@ int	MAIN_ZABBIX_ENTRY(int flags)
 			case ZBX_PROCESS_TYPE_DISCOVERER:
 				threads[i] = zbx_thread_start(discoverer_thread, &thread_args);
 				break;
+			case ZBX_PROCESS_TYPE_HISTWRITER:
+				threads[i] = zbx_thread_start(history_writer_thread, &thread_args);
+				break;
+			case ZBX_PROCESS_TYPE_AVAILMAN:
+				threads[i] = zbx_thread_start(availability_manager_thread, &thread_args);
+				break;
 			case ZBX_PROCESS_TYPE_HISTSYNCER:
 				threads[i] = zbx_thread_start(dbsyncer_thread, &thread_args);
 				break;
@@ -1258,6 +1345,10 @@ int	MAIN_ZABBIX_ENTRY(int flags)
 
 void	zbx_on_exit(void)
 {
+	ZBX_THREAD_HANDLE	histwriter = ZBX_THREAD_HANDLE_NULL, availman = ZBX_THREAD_HANDLE_NULL;
+	unsigned char		process_type;
+	int			i, process_num;
+
 	zabbix_log(LOG_LEVEL_DEBUG, "zbx_on_exit() called");
 
 	if (SUCCEED == DBtxn_ongoing())
@@ -1265,8 +1356,30 @@ void	zbx_on_exit(void)
 
 	if (NULL != threads)
 	{
+		/* the history writer takes the history flushed below, it is stopped after that */
+		/* the availability manager writes the last changes of the pollers once they have stopped */
+		for (i = 0; i < threads_num; i++)
+		{
+			if (SUCCEED != get_process_info_by_thread(i + 1, &process_type, &process_num))
+				continue;
+
+			if (ZBX_PROCESS_TYPE_HISTWRITER == process_type)
+			{
+				histwriter = threads[i];
+				threads[i] = ZBX_THREAD_HANDLE_NULL;
+			}
+			else if (ZBX_PROCESS_TYPE_AVAILMAN == process_type)
+			{
+				availman = threads[i];
+				threads[i] = ZBX_THREAD_HANDLE_NULL;
+			}
+		}
+
 		zbx_threads_wait(threads, threads_num);	/* wait for all child processes to exit */
 		zbx_free(threads);
+
+		if (ZBX_THREAD_HANDLE_NULL != availman)
+			zbx_threads_wait(&availman, 1);
 	}
 #ifdef HAVE_PTHREAD_PROCESS_SHARED
 	zbx_locks_disable();
@@ -1278,8 +1391,15 @@ void	zbx_on_exit(void)
 
 	free_database_cache();
 
+	if (ZBX_THREAD_HANDLE_NULL != histwriter)
+		zbx_threads_wait(&histwriter, 1);
+
 	DBclose();
 
+	/* all history is flushed at this point, so the snapshot has the latest item values */
+	if (NULL != CONFIG_VALUE_CACHE_SNAPSHOT_FILE)
+		zbx_vc_snapshot_write(CONFIG_VALUE_CACHE_SNAPSHOT_FILE, ZBX_VC_SNAPSHOT_SHUTDOWN);
+
 	free_configuration_cache();
 
 	/* free history value cache */